@@ -0,0 +1,70 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "radix_sort.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+void RadixSort(RadixSortItem* items, RadixSortItem* temp, i32 count, i32 keyBytes)
+{
+    assert(count >= 0);
+    assert(keyBytes >= 1 && keyBytes <= 8);
+
+    if (count < 2)
+        return;
+
+    // Histograms of all bytes are gathered in one pass
+    i32 histograms[8][256];
+    memset(histograms, 0, sizeof(histograms[0]) * keyBytes);
+
+    for (i32 i = 0; i < count; ++i)
+    {
+        u64 key = items[i].key_;
+        for (i32 b = 0; b < keyBytes; ++b)
+            ++histograms[b][(key >> (b * 8)) & 0xffu];
+    }
+
+    RadixSortItem* src = items;
+    RadixSortItem* dest = temp;
+
+    for (i32 b = 0; b < keyBytes; ++b)
+    {
+        i32* histogram = histograms[b];
+        i32 shift = b * 8;
+
+        // The byte is the same in all keys, the pass would not change the order
+        if (histogram[(src[0].key_ >> shift) & 0xffu] == count)
+            continue;
+
+        i32 offsets[256];
+        i32 offset = 0;
+        for (i32 i = 0; i < 256; ++i)
+        {
+            offsets[i] = offset;
+            offset += histogram[i];
+        }
+
+        for (i32 i = 0; i < count; ++i)
+        {
+            const RadixSortItem& item = src[i];
+            dest[offsets[(item.key_ >> shift) & 0xffu]++] = item;
+        }
+
+        RadixSortItem* swap = src;
+        src = dest;
+        dest = swap;
+    }
+
+    if (src != items)
+        memcpy(items, src, sizeof(RadixSortItem) * count);
+}
+
+}
@@ -0,0 +1,35 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../common/config.h"
+
+#include "../common/primitive_types.h"
+
+#include <bit>
+
+namespace dviglo
+{
+
+/// Sort key and index of the sorted element.
+struct RadixSortItem
+{
+    /// Sort key.
+    u64 key_;
+    /// Index of the element in the unsorted array.
+    i32 index_;
+};
+
+/// Stable LSD radix sort of items by key in ascending order. Only the lowest keyBytes bytes of the keys are used.
+/// Temp must have room for count items. Passes where all keys have the same byte value are skipped.
+DV_API void RadixSort(RadixSortItem* items, RadixSortItem* temp, i32 count, i32 keyBytes = 8);
+
+/// Convert float to a key that sorts in the same order as the float values.
+inline u32 FloatToRadixKey(float value)
+{
+    u32 bits = std::bit_cast<u32>(value);
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+}
@@ -16,6 +16,9 @@ using namespace std;
 namespace dviglo
 {
 
+/// Index of the current thread as seen by the work queue.
+static thread_local i32 currentThreadIndex = NINDEX;
+
 /// Worker thread managed by the work queue.
 class WorkerThread : public Thread, public RefCounted
 {
@@ -61,6 +64,8 @@ WorkQueue::WorkQueue() :
     maxNonThreadedWorkMs_(5)
 {
     subscribe_to_event(E_BEGINFRAME, DV_HANDLER(WorkQueue, HandleBeginFrame));
+    // The work queue is created in the main thread
+    currentThreadIndex = 0;
     instance_ = this;
     DV_LOGDEBUG("WorkQueue constructed");
 }
@@ -216,6 +221,16 @@ i32 WorkQueue::RemoveWorkItems(const Vector<SharedPtr<WorkItem>>& items)
     return removed;
 }
 
+void WorkQueue::CancelWorkItem(SharedPtr<WorkItem> item)
+{
+    if (!item || RemoveWorkItem(item))
+        return;
+
+    // A worker thread has taken the item. Give up the time slice until it finishes
+    while (!item->completed_)
+        Time::Sleep(0);
+}
+
 void WorkQueue::Pause()
 {
     if (!paused_)
@@ -303,10 +318,17 @@ bool WorkQueue::IsCompleted(i32 priority) const
     return true;
 }
 
+i32 WorkQueue::GetCurrentThreadIndex()
+{
+    return currentThreadIndex;
+}
+
 void WorkQueue::ProcessItems(i32 threadIndex)
 {
     assert(threadIndex >= 0);
 
+    currentThreadIndex = threadIndex;
+
     bool wasActive = false;
 
     for (;;)
@@ -86,6 +86,8 @@ public:
     bool RemoveWorkItem(SharedPtr<WorkItem> item);
     /// Remove a number of work items before they have started executing. Return the number of items successfully removed.
     i32 RemoveWorkItems(const Vector<SharedPtr<WorkItem>>& items);
+    /// Remove a work item if it has not started executing, otherwise wait for it to complete. The calling thread yields while waiting.
+    void CancelWorkItem(SharedPtr<WorkItem> item);
     /// Pause worker threads.
     void Pause();
     /// Resume worker threads.
@@ -101,6 +103,8 @@ public:
 
     /// Return number of worker threads.
     i32 GetNumThreads() const { return threads_.Size(); }
+    /// Return index of the calling thread: 0 = main thread, 1+ = worker threads, NINDEX = thread not managed by the work queue.
+    static i32 GetCurrentThreadIndex();
 
     /// Return whether all work with at least the specified priority is finished.
     bool IsCompleted(i32 priority) const;
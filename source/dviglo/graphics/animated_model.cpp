@@ -22,6 +22,7 @@
 #include "graphics.h"
 #include "material.h"
 #include "octree.h"
+#include "pose_cache.h"
 
 #include "../common/debug_new.h"
 
@@ -65,7 +66,11 @@ AnimatedModel::AnimatedModel() :
     isMaster_(true),
     loading_(false),
     assignBonesPending_(false),
-    forceAnimationUpdate_(false)
+    forceAnimationUpdate_(false),
+    lazyBoneNodes_(false),
+    boneNodesDirty_(false),
+    modelPoseDirty_(true),
+    syncingBoneNodes_(false)
 {
 }
 
@@ -93,6 +98,7 @@ void AnimatedModel::register_object()
     DV_ACCESSOR_ATTRIBUTE("Can Be Occluded", IsOccludee, SetOccludee, true, AM_DEFAULT);
     DV_ATTRIBUTE("Cast Shadows", castShadows_, false, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("Update When Invisible", GetUpdateInvisible, SetUpdateInvisible, false, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Lazy Bone Nodes", GetLazyBoneNodes, SetLazyBoneNodes, false, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("Draw Distance", GetDrawDistance, SetDrawDistance, 0.0f, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("Shadow Distance", GetShadowDistance, SetShadowDistance, 0.0f, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("LOD Bias", GetLodBias, SetLodBias, 1.0f, AM_DEFAULT);
@@ -689,6 +695,12 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
         return;
     }
 
+    localPose_.Clear();
+    modelPose_.Clear();
+    poseOrder_.Clear();
+    boneNodesDirty_ = false;
+    modelPoseDirty_ = true;
+
     if (isMaster_)
     {
         // Check if bone structure has stayed compatible (reloading the model). In that case retain the old bones and animations
@@ -894,7 +906,28 @@ const Vector<byte>& AnimatedModel::GetMorphsAttr() const
 
 void AnimatedModel::UpdateBoneBoundingBox()
 {
-    if (skeleton_.GetNumBones())
+    if (lazyBoneNodes_ && isMaster_ && skeleton_.GetNumBones())
+    {
+        // The model space pose is already in the node's local space
+        if (modelPoseDirty_)
+            UpdateModelPose();
+
+        boneBoundingBox_.Clear();
+
+        const Vector<Bone>& bones = skeleton_.GetBones();
+        for (i32 i = 0; i < bones.Size(); ++i)
+        {
+            const Bone& bone = bones[i];
+            if (!bone.node_)
+                continue;
+
+            if (bone.collisionMask_ & BONECOLLISION_BOX)
+                boneBoundingBox_.Merge(bone.boundingBox_.Transformed(modelPose_[i]));
+            else if (bone.collisionMask_ & BONECOLLISION_SPHERE)
+                boneBoundingBox_.Merge(Sphere(modelPose_[i].Translation(), bone.radius_ * 0.5f));
+        }
+    }
+    else if (skeleton_.GetNumBones())
     {
         // The bone bounding box is in local space, so need the node's inverse transform
         boneBoundingBox_.Clear();
@@ -941,7 +974,13 @@ void AnimatedModel::OnMarkedDirty(Node* node)
         skinningDirty_ = true;
         // Bone bounding box doesn't need to be marked dirty when only the base scene node moves
         if (node != node_)
+        {
             boneBoundingBoxDirty_ = true;
+            // Bones without animation take their transforms from the nodes. The model space pose does not change when
+            // the bones are only dirtied through the model's node
+            if (!syncingBoneNodes_ && !node_->IsDirty())
+                modelPoseDirty_ = true;
+        }
     }
 }
 
@@ -1265,6 +1304,71 @@ void AnimatedModel::UpdateAnimation(const FrameInfo& frame)
     ApplyAnimation();
 }
 
+void AnimatedModel::SetPoseCache(PoseCache* cache)
+{
+    if (cache == poseCache_)
+        return;
+
+    poseCache_ = cache;
+    MarkAnimationDirty();
+}
+
+PoseCache* AnimatedModel::GetPoseCache() const
+{
+    return poseCache_;
+}
+
+void AnimatedModel::SetLazyBoneNodes(bool enable)
+{
+    if (enable == lazyBoneNodes_)
+        return;
+
+    // Bring the nodes up to date before they are read again
+    if (!enable)
+        SyncBoneNodes();
+
+    lazyBoneNodes_ = enable;
+    modelPoseDirty_ = true;
+    skinningDirty_ = true;
+    boneBoundingBoxDirty_ = true;
+}
+
+void AnimatedModel::SyncBoneNodes()
+{
+    if (!boneNodesDirty_)
+        return;
+
+    boneNodesDirty_ = false;
+
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    if (localPose_.Size() != bones.Size())
+        return;
+
+    for (i32 i = 0; i < bones.Size(); ++i)
+    {
+        const Bone& bone = bones[i];
+        if (bone.animated_ && bone.node_)
+        {
+            const BonePose& pose = localPose_[i];
+            bone.node_->SetTransformSilent(pose.position_, pose.rotation_, pose.scale_);
+        }
+    }
+
+    // The transforms were applied silently, so mark dirty from the bones that have no parent bone node
+    syncingBoneNodes_ = true;
+    for (i32 i = 0; i < bones.Size(); ++i)
+    {
+        const Bone& bone = bones[i];
+        if (!bone.node_)
+            continue;
+
+        i32 parentIndex = bone.parentIndex_;
+        if (parentIndex == i || parentIndex < 0 || parentIndex >= bones.Size() || !bones[parentIndex].node_)
+            bone.node_->MarkDirty();
+    }
+    syncingBoneNodes_ = false;
+}
+
 void AnimatedModel::ApplyAnimation()
 {
     // Make sure animations are in ascending priority order
@@ -1274,16 +1378,27 @@ void AnimatedModel::ApplyAnimation()
         animationOrderDirty_ = false;
     }
 
-    // Reset skeleton, apply all animations, calculate bones' bounding box. Make sure this is only done for the master model
+    // Reset the pose, apply all animations, calculate bones' bounding box. Make sure this is only done for the master model
     // (first AnimatedModel in a node)
     if (isMaster_)
     {
-        skeleton_.ResetSilent();
-        for (Vector<SharedPtr<AnimationState>>::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
-            (*i)->Apply();
+        if (!poseCache_ || !ApplyCachedAnimation())
+        {
+            ResetLocalPose();
+            for (Vector<SharedPtr<AnimationState>>::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+                (*i)->Apply();
+        }
+
+        boneNodesDirty_ = true;
+        modelPoseDirty_ = true;
+        skinningDirty_ = true;
 
-        // Skeleton reset and animations apply the node transforms "silently" to avoid repeated marking dirty. Mark dirty now
-        node_->MarkDirty();
+        if (!lazyBoneNodes_ || NeedBoneNodeSync())
+            SyncBoneNodes();
+
+        // The bone nodes may already have been dirty, or were not written at all, so queue the octree update here
+        if (!updateQueued_ && octant_)
+            octant_->GetRoot()->queue_update(this);
 
         // Calculate new bone bounding box
         UpdateBoneBoundingBox();
@@ -1292,6 +1407,166 @@ void AnimatedModel::ApplyAnimation()
     animationDirty_ = false;
 }
 
+bool AnimatedModel::ApplyCachedAnimation()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+
+    // Bones that are not animated keep the transforms of their nodes, which differ between models
+    for (const Bone& bone : bones)
+    {
+        if (!bone.animated_ && bone.node_)
+            return false;
+    }
+
+    // The key is reused between frames to avoid allocating
+    PoseCacheKey& key = poseCacheKey_;
+    key.Clear();
+    key.model_ = model_;
+
+    for (const SharedPtr<AnimationState>& state : animationStates_)
+    {
+        if (!state->GetAnimation() || !state->IsEnabled())
+            continue;
+
+        Bone* startBone = state->GetStartBone();
+        key.states_.Push(PoseCacheState{state->GetAnimation(), poseCache_->GetTimeIndex(state->GetTime()),
+            state->GetWeight(), startBone ? skeleton_.GetBoneIndex(startBone) : NINDEX, state->blend_mode(),
+            state->IsLooped()});
+        state->GetBoneWeights(key.boneWeights_);
+    }
+
+    if (poseCache_->GetPose(key, localPose_) && localPose_.Size() == bones.Size())
+        return true;
+
+    // Sample at the quantized time positions, so that the pose is the same for all models with this key
+    ResetLocalPose();
+    i32 stateIndex = 0;
+    for (const SharedPtr<AnimationState>& state : animationStates_)
+    {
+        if (state->GetAnimation() && state->IsEnabled())
+            state->Apply(poseCache_->GetTime(key.states_[stateIndex++].timeIndex_));
+    }
+    poseCache_->StorePose(key, localPose_);
+
+    return true;
+}
+
+void AnimatedModel::ResetLocalPose()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    localPose_.Resize(bones.Size());
+
+    for (i32 i = 0; i < bones.Size(); ++i)
+    {
+        const Bone& bone = bones[i];
+        BonePose& pose = localPose_[i];
+
+        if (bone.animated_ || !bone.node_)
+        {
+            pose.position_ = bone.initialPosition_;
+            pose.rotation_ = bone.initialRotation_;
+            pose.scale_ = bone.initialScale_;
+        }
+        else
+        {
+            pose.position_ = bone.node_->GetPosition();
+            pose.rotation_ = bone.node_->GetRotation();
+            pose.scale_ = bone.node_->GetScale();
+        }
+    }
+}
+
+void AnimatedModel::UpdateModelPose()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    if (localPose_.Size() != bones.Size())
+        ResetLocalPose();
+
+    // Parents must be calculated before children, but the skeleton does not guarantee the bone order
+    if (poseOrder_.Size() != bones.Size())
+    {
+        Vector<i32> depths(bones.Size());
+        for (i32 i = 0; i < bones.Size(); ++i)
+        {
+            i32 depth = 0;
+            i32 index = i;
+            while (depth < bones.Size())
+            {
+                i32 parentIndex = bones[index].parentIndex_;
+                if (parentIndex == index || parentIndex < 0 || parentIndex >= bones.Size())
+                    break;
+                index = parentIndex;
+                ++depth;
+            }
+            depths[i] = depth;
+        }
+
+        poseOrder_.Resize(bones.Size());
+        for (i32 i = 0; i < bones.Size(); ++i)
+            poseOrder_[i] = i;
+
+        stable_sort(poseOrder_.Begin(), poseOrder_.End(), [&depths](i32 lhs, i32 rhs) { return depths[lhs] < depths[rhs]; });
+    }
+
+    modelPose_.Resize(bones.Size());
+
+    for (i32 i : poseOrder_)
+    {
+        const Bone& bone = bones[i];
+        BonePose& pose = localPose_[i];
+
+        // Bones without animation are controlled through their nodes
+        if (!bone.animated_ && bone.node_)
+        {
+            pose.position_ = bone.node_->GetPosition();
+            pose.rotation_ = bone.node_->GetRotation();
+            pose.scale_ = bone.node_->GetScale();
+        }
+
+        Matrix3x4 transform(pose.position_, pose.rotation_, pose.scale_);
+        i32 parentIndex = bone.parentIndex_;
+        if (parentIndex == i || parentIndex < 0 || parentIndex >= bones.Size())
+            modelPose_[i] = transform;
+        else
+            modelPose_[i] = modelPose_[parentIndex] * transform;
+    }
+
+    modelPoseDirty_ = false;
+}
+
+bool AnimatedModel::NeedBoneNodeSync() const
+{
+    // Other models in the node skin with the bone nodes
+    for (const SharedPtr<Component>& component : node_->GetComponents())
+    {
+        if (component != this && component->GetType() == AnimatedModel::GetTypeStatic())
+            return true;
+    }
+
+    // Components or child nodes attached to the bones read the bone transforms
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    i32 numChildren = 0;
+    i32 numChildBones = 0;
+
+    for (i32 i = 0; i < bones.Size(); ++i)
+    {
+        const Bone& bone = bones[i];
+        if (!bone.node_)
+            continue;
+
+        if (bone.node_->GetNumComponents())
+            return true;
+
+        numChildren += bone.node_->GetNumChildren();
+
+        i32 parentIndex = bone.parentIndex_;
+        if (parentIndex != i && parentIndex >= 0 && parentIndex < bones.Size() && bones[parentIndex].node_)
+            ++numChildBones;
+    }
+
+    return numChildren != numChildBones;
+}
+
 void AnimatedModel::UpdateSkinning()
 {
     // Note: the model's world transform will be baked in the skin matrices
@@ -1299,8 +1574,32 @@ void AnimatedModel::UpdateSkinning()
     // Use model's world transform in case a bone is missing
     const Matrix3x4& worldTransform = node_->GetWorldTransform();
 
+    // Skinning from the pose buffers, without reading the bone nodes
+    if (lazyBoneNodes_ && isMaster_)
+    {
+        if (modelPoseDirty_)
+            UpdateModelPose();
+
+        for (i32 i = 0; i < bones.Size(); ++i)
+        {
+            const Bone& bone = bones[i];
+            if (bone.node_)
+                skinMatrices_[i] = worldTransform * modelPose_[i] * bone.offsetMatrix_;
+            else
+                skinMatrices_[i] = worldTransform;
+        }
+
+        if (geometrySkinMatrices_.Size())
+        {
+            for (i32 i = 0; i < bones.Size(); ++i)
+            {
+                for (Matrix3x4* skinMatrix : geometrySkinMatrixPtrs_[i])
+                    *skinMatrix = skinMatrices_[i];
+            }
+        }
+    }
     // Skinning with global matrices only
-    if (!geometrySkinMatrices_.Size())
+    else if (!geometrySkinMatrices_.Size())
     {
         for (unsigned i = 0; i < bones.Size(); ++i)
         {
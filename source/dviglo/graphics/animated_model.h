@@ -5,6 +5,7 @@
 #pragma once
 
 #include "model.h"
+#include "pose_cache.h"
 #include "skeleton.h"
 #include "static_model.h"
 
@@ -78,6 +79,16 @@ public:
     void SetMorphWeight(StringHash nameHash, float weight);
     /// Reset all vertex morphs to zero.
     void ResetMorphWeights();
+    /// Set whether bone nodes are updated only on request. The skin matrices and the bone bounding box are then calculated
+    /// from the pose buffers, and animated bone nodes are written but not read. Bone nodes are still updated on every
+    /// animation update if something is attached to them. Recommended for crowds.
+    void SetLazyBoneNodes(bool enable);
+    /// Write the animated pose to the bone nodes if they are out of date. Call before reading bone nodes when lazy bone
+    /// nodes are enabled.
+    void SyncBoneNodes();
+    /// Set a pose cache shared with other models, or null to disable. Models that use the same cache and play the same
+    /// animations at the same quantized time positions sample the pose only once.
+    void SetPoseCache(PoseCache* cache);
     /// Apply all animation states to nodes.
     void ApplyAnimation();
 
@@ -105,6 +116,18 @@ public:
     /// Return whether to update animation when not visible.
     bool GetUpdateInvisible() const { return updateInvisible_; }
 
+    /// Return whether bone nodes are updated only on request.
+    bool GetLazyBoneNodes() const { return lazyBoneNodes_; }
+
+    /// Return shared pose cache.
+    PoseCache* GetPoseCache() const;
+
+    /// Return local bone transforms of the last applied animation.
+    const Vector<BonePose>& GetLocalPose() const { return localPose_; }
+
+    /// Return model space bone transforms. Only updated when lazy bone nodes are enabled.
+    const Vector<Matrix3x4>& GetModelPose() const { return modelPose_; }
+
     /// Return all vertex morphs.
     const Vector<ModelMorph>& GetMorphs() const { return morphs_; }
 
@@ -181,6 +204,14 @@ private:
     void CopyMorphVertices(void* destVertexData, void* srcVertexData, i32 vertexCount, VertexBuffer* destBuffer, VertexBuffer* srcBuffer);
     /// Recalculate animations. Called from Update().
     void UpdateAnimation(const FrameInfo& frame);
+    /// Reset the local pose to the initial transforms of animated bones and the node transforms of other bones.
+    void ResetLocalPose();
+    /// Apply the animation states through the pose cache. Return false if the pose can not be cached.
+    bool ApplyCachedAnimation();
+    /// Recalculate model space bone transforms from the local pose.
+    void UpdateModelPose();
+    /// Return whether the bone nodes are read by something else than this model.
+    bool NeedBoneNodeSync() const;
     /// Recalculate skinning.
     void UpdateSkinning();
     /// Reapply all vertex morphs.
@@ -199,6 +230,16 @@ private:
     Vector<ModelMorph> morphs_;
     /// Animation states.
     Vector<SharedPtr<AnimationState>> animationStates_;
+    /// Local bone transforms that the animation states are sampled and blended to.
+    Vector<BonePose> localPose_;
+    /// Model space bone transforms.
+    Vector<Matrix3x4> modelPose_;
+    /// Bone indices ordered so that parents come before children.
+    Vector<i32> poseOrder_;
+    /// Shared pose cache.
+    SharedPtr<PoseCache> poseCache_;
+    /// Pose cache lookup key, reused between frames.
+    PoseCacheKey poseCacheKey_;
     /// Skinning matrices.
     Vector<Matrix3x4> skinMatrices_;
     /// Mapping of subgeometry bone indices, used if more bones than skinning shader can manage.
@@ -241,6 +282,14 @@ private:
     bool assignBonesPending_;
     /// Force animation update after becoming visible flag.
     bool forceAnimationUpdate_;
+    /// Lazy bone nodes flag.
+    bool lazyBoneNodes_;
+    /// Bone nodes out of date flag.
+    bool boneNodesDirty_;
+    /// Model space bone transforms dirty flag.
+    bool modelPoseDirty_;
+    /// Writing the pose to the bone nodes flag.
+    bool syncingBoneNodes_;
 };
 
 }
@@ -11,6 +11,7 @@
 #include "../io/file_system.h"
 #include "../io/log.h"
 #include "../io/serializer.h"
+#include "../math/bounding_box.h"
 #include "../resource/json_file.h"
 #include "../resource/resource_cache.h"
 #include "../resource/xml_file.h"
@@ -34,10 +35,105 @@ inline bool CompareKeyFrames(AnimationKeyFrame& lhs, AnimationKeyFrame& rhs)
     return lhs.time_ < rhs.time_;
 }
 
+/// Largest value of the three smallest components of a unit quaternion.
+static const float QUATERNION_COMPONENT_MAX = 0.70710678f;
+
+/// Return number of quantized values in a compressed track sample.
+static i32 GetSampleStride(AnimationChannels channelMask, AnimationChannels constantChannels)
+{
+    i32 stride = 0;
+    if (!!(channelMask & AnimationChannels::Position) && !(constantChannels & AnimationChannels::Position))
+        stride += 3;
+    if (!!(channelMask & AnimationChannels::Rotation) && !(constantChannels & AnimationChannels::Rotation))
+        stride += 3;
+    if (!!(channelMask & AnimationChannels::Scale) && !(constantChannels & AnimationChannels::Scale))
+        stride += 3;
+    return stride;
+}
+
+/// Quantize a vector to three 16-bit values.
+static void QuantizeVector(const Vector3& value, const Vector3& min, const Vector3& step, u16* dest)
+{
+    const float* data = value.Data();
+    const float* minData = min.Data();
+    const float* stepData = step.Data();
+
+    for (i32 i = 0; i < 3; ++i)
+        dest[i] = stepData[i] > 0.f ? (u16)Clamp(RoundToInt((data[i] - minData[i]) / stepData[i]), 0, 65535) : 0;
+}
+
+static Vector3 DequantizeVector(const u16* src, const Vector3& min, const Vector3& step)
+{
+    return Vector3(min.x + src[0] * step.x, min.y + src[1] * step.y, min.z + src[2] * step.z);
+}
+
+/// Quantize a unit quaternion to 48 bits. The largest component is left out and reconstructed from the others, as q and -q
+/// are the same rotation. Its index is stored in the top bits of the first two values.
+static void QuantizeRotation(const Quaternion& rotation, u16* dest)
+{
+    const float* data = rotation.Data();
+    i32 largest = 0;
+    for (i32 i = 1; i < 4; ++i)
+    {
+        if (Abs(data[i]) > Abs(data[largest]))
+            largest = i;
+    }
+
+    float sign = data[largest] < 0.f ? -1.f : 1.f;
+    float values[3];
+    for (i32 i = 0, j = 0; i < 4; ++i)
+    {
+        if (i != largest)
+            values[j++] = Clamp(data[i] * sign / QUATERNION_COMPONENT_MAX * 0.5f + 0.5f, 0.f, 1.f);
+    }
+
+    dest[0] = (u16)(RoundToInt(values[0] * 32767.f) | (largest & 1) << 15);
+    dest[1] = (u16)(RoundToInt(values[1] * 32767.f) | (largest >> 1) << 15);
+    dest[2] = (u16)RoundToInt(values[2] * 65535.f);
+}
+
+static Quaternion DequantizeRotation(const u16* src)
+{
+    i32 largest = (src[0] >> 15) | (src[1] >> 15) << 1;
+    float values[3] = {
+        ((src[0] & 0x7fff) * (1.f / 32767.f) - 0.5f) * 2.f * QUATERNION_COMPONENT_MAX,
+        ((src[1] & 0x7fff) * (1.f / 32767.f) - 0.5f) * 2.f * QUATERNION_COMPONENT_MAX,
+        (src[2] * (1.f / 65535.f) - 0.5f) * 2.f * QUATERNION_COMPONENT_MAX
+    };
+
+    float data[4];
+    for (i32 i = 0, j = 0; i < 4; ++i)
+    {
+        if (i != largest)
+            data[i] = values[j++];
+    }
+    data[largest] = sqrtf(Max(1.f - values[0] * values[0] - values[1] * values[1] - values[2] * values[2], 0.f));
+
+    return Quaternion(data[0], data[1], data[2], data[3]);
+}
+
+static bool EqualsWithin(const Vector3& lhs, const Vector3& rhs, float tolerance)
+{
+    return Abs(lhs.x - rhs.x) <= tolerance && Abs(lhs.y - rhs.y) <= tolerance && Abs(lhs.z - rhs.z) <= tolerance;
+}
+
+static bool EqualsWithin(const Quaternion& lhs, const Quaternion& rhs, float tolerance)
+{
+    float sign = lhs.DotProduct(rhs) < 0.f ? -1.f : 1.f;
+    return Abs(lhs.w_ * sign - rhs.w_) <= tolerance && Abs(lhs.x_ * sign - rhs.x_) <= tolerance &&
+        Abs(lhs.y_ * sign - rhs.y_) <= tolerance && Abs(lhs.z_ * sign - rhs.z_) <= tolerance;
+}
+
 void AnimationTrack::SetKeyFrame(i32 index, const AnimationKeyFrame& keyFrame)
 {
     assert(index >= 0);
 
+    if (IsCompressed())
+    {
+        DV_LOGERROR("Can not modify keyframes of compressed animation track " + name_);
+        return;
+    }
+
     if (index < keyFrames_.Size())
     {
         keyFrames_[index] = keyFrame;
@@ -49,6 +145,12 @@ void AnimationTrack::SetKeyFrame(i32 index, const AnimationKeyFrame& keyFrame)
 
 void AnimationTrack::AddKeyFrame(const AnimationKeyFrame& keyFrame)
 {
+    if (IsCompressed())
+    {
+        DV_LOGERROR("Can not modify keyframes of compressed animation track " + name_);
+        return;
+    }
+
     bool needSort = keyFrames_.Size() ? keyFrames_.Back().time_ > keyFrame.time_ : false;
     keyFrames_.Push(keyFrame);
     if (needSort)
@@ -58,6 +160,13 @@ void AnimationTrack::AddKeyFrame(const AnimationKeyFrame& keyFrame)
 void AnimationTrack::InsertKeyFrame(i32 index, const AnimationKeyFrame& keyFrame)
 {
     assert(index >= 0);
+
+    if (IsCompressed())
+    {
+        DV_LOGERROR("Can not modify keyframes of compressed animation track " + name_);
+        return;
+    }
+
     keyFrames_.Insert(index, keyFrame);
     sort(keyFrames_.Begin(), keyFrames_.End(), CompareKeyFrames);
 }
@@ -87,20 +196,298 @@ bool AnimationTrack::GetKeyFrameIndex(float time, i32& index) const
     if (time < 0.0f)
         time = 0.0f;
 
-    if (index >= keyFrames_.Size())
-        index = keyFrames_.Size() - 1;
+    i32 numKeyFrames = keyFrames_.Size();
+    if (index >= numKeyFrames)
+        index = numKeyFrames - 1;
+    else if (index < 0)
+        index = 0;
+
+    // Normal playback stays within the same keyframe or advances to the next
+    const AnimationKeyFrame* keyFrames = keyFrames_.Buffer();
+    for (i32 i = index; i < numKeyFrames && i <= index + 1; ++i)
+    {
+        if ((!i || time >= keyFrames[i].time_) && (i == numKeyFrames - 1 || time < keyFrames[i + 1].time_))
+        {
+            index = i;
+            return true;
+        }
+    }
+
+    // Seeks and reverse or random playback: find the last keyframe at or before the time
+    const AnimationKeyFrame* next = upper_bound(keyFrames, keyFrames + numKeyFrames, time,
+        [](float lhs, const AnimationKeyFrame& rhs) { return lhs < rhs.time_; });
+    index = Max((i32)(next - keyFrames) - 1, 0);
+
+    return true;
+}
+
+bool AnimationTrack::Sample(float time, float length, bool looped, i32& keyFrameIndex, Vector3& position,
+    Quaternion& rotation, Vector3& scale) const
+{
+    if (IsCompressed())
+    {
+        float samplePosition = Clamp(time * sampleRate_, 0.f, (float)(numSamples_ - 1));
+        i32 index = Min((i32)samplePosition, numSamples_ - 1);
+        i32 nextIndex = Min(index + 1, numSamples_ - 1);
+        float t = samplePosition - (float)index;
+
+        keyFrameIndex = index;
+
+        // In looped playback, the samples after the last keyframe come from the extra samples at the end
+        i32 loopStart = numSamples_ - numLoopSamples_;
+        if (looped && index >= loopStart)
+            index += numLoopSamples_;
+        if (looped && nextIndex >= loopStart)
+            nextIndex += numLoopSamples_;
+
+        i32 stride = GetSampleStride(channelMask_, constantChannels_);
+        const u16* sample = samples_.Buffer() + index * stride;
+        const u16* nextSample = samples_.Buffer() + nextIndex * stride;
+
+        if (!!(channelMask_ & AnimationChannels::Position))
+        {
+            if (!!(constantChannels_ & AnimationChannels::Position))
+                position = positionMin_;
+            else
+            {
+                position = DequantizeVector(sample, positionMin_, positionStep_).Lerp(
+                    DequantizeVector(nextSample, positionMin_, positionStep_), t);
+                sample += 3;
+                nextSample += 3;
+            }
+        }
+        if (!!(channelMask_ & AnimationChannels::Rotation))
+        {
+            if (!!(constantChannels_ & AnimationChannels::Rotation))
+                rotation = constantRotation_;
+            else
+            {
+                rotation = DequantizeRotation(sample).Nlerp(DequantizeRotation(nextSample), t, true);
+                sample += 3;
+                nextSample += 3;
+            }
+        }
+        if (!!(channelMask_ & AnimationChannels::Scale))
+        {
+            if (!!(constantChannels_ & AnimationChannels::Scale))
+                scale = scaleMin_;
+            else
+                scale = DequantizeVector(sample, scaleMin_, scaleStep_).Lerp(DequantizeVector(nextSample, scaleMin_, scaleStep_), t);
+        }
+
+        return true;
+    }
+
+    if (!GetKeyFrameIndex(time, keyFrameIndex))
+        return false;
+
+    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
+    i32 nextFrame = keyFrameIndex + 1;
+    bool interpolate = true;
+    if (nextFrame >= keyFrames_.Size())
+    {
+        if (!looped)
+        {
+            nextFrame = keyFrameIndex;
+            interpolate = false;
+        }
+        else
+            nextFrame = 0;
+    }
+
+    const AnimationKeyFrame* keyFrame = &keyFrames_[keyFrameIndex];
+
+    if (interpolate)
+    {
+        const AnimationKeyFrame* nextKeyFrame = &keyFrames_[nextFrame];
+        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
+        if (timeInterval < 0.0f)
+            timeInterval += length;
+        float t = timeInterval > 0.0f ? (time - keyFrame->time_) / timeInterval : 1.0f;
+
+        if (!!(channelMask_ & AnimationChannels::Position))
+            position = keyFrame->position_.Lerp(nextKeyFrame->position_, t);
+        if (!!(channelMask_ & AnimationChannels::Rotation))
+            rotation = keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t);
+        if (!!(channelMask_ & AnimationChannels::Scale))
+            scale = keyFrame->scale_.Lerp(nextKeyFrame->scale_, t);
+    }
+    else
+    {
+        if (!!(channelMask_ & AnimationChannels::Position))
+            position = keyFrame->position_;
+        if (!!(channelMask_ & AnimationChannels::Rotation))
+            rotation = keyFrame->rotation_;
+        if (!!(channelMask_ & AnimationChannels::Scale))
+            scale = keyFrame->scale_;
+    }
+
+    return true;
+}
+
+void AnimationTrack::Compress(float length, float sampleRate, float tolerance)
+{
+    if (IsCompressed() || keyFrames_.Empty())
+        return;
+
+    // The last sample is at the animation length, so that sampling never needs to wrap
+    i32 numSamples = length > 0.f && sampleRate > 0.f ? Max(CeilToInt(length * sampleRate), 1) + 1 : 1;
+    float rate = numSamples > 1 ? (float)(numSamples - 1) / length : 0.f;
+
+    auto sampleTime = [=](i32 index) { return index < numSamples - 1 ? (float)index / rate : length; };
+
+    // Samples after the last keyframe differ in looped playback, which interpolates from the last keyframe to the first
+    i32 loopStart = numSamples;
+    if (keyFrames_.Size() > 1)
+    {
+        while (loopStart > 1 && sampleTime(loopStart - 1) > keyFrames_.Back().time_)
+            --loopStart;
+    }
+    i32 numLoopSamples = numSamples - loopStart;
+    i32 numTotalSamples = numSamples + numLoopSamples;
+
+    Vector<Vector3> positions(numTotalSamples);
+    Vector<Quaternion> rotations(numTotalSamples);
+    Vector<Vector3> scales(numTotalSamples);
+    i32 keyFrameIndex = 0;
+
+    for (i32 i = 0; i < numTotalSamples; ++i)
+    {
+        bool looped = i >= numSamples;
+        Sample(sampleTime(looped ? i - numLoopSamples : i), length, looped, keyFrameIndex, positions[i], rotations[i], scales[i]);
+    }
+
+    constantChannels_ = AnimationChannels::None;
+    bool constantPosition = true;
+    bool constantRotation = true;
+    bool constantScale = true;
+    for (i32 i = 1; i < numTotalSamples; ++i)
+    {
+        constantPosition = constantPosition && EqualsWithin(positions[i], positions[0], tolerance);
+        constantRotation = constantRotation && EqualsWithin(rotations[i], rotations[0], tolerance);
+        constantScale = constantScale && EqualsWithin(scales[i], scales[0], tolerance);
+    }
+
+    if (constantPosition)
+        constantChannels_ |= AnimationChannels::Position;
+    if (constantRotation)
+        constantChannels_ |= AnimationChannels::Rotation;
+    if (constantScale)
+        constantChannels_ |= AnimationChannels::Scale;
+
+    // Quantize positions and scales inside their bounds
+    BoundingBox positionBounds(positions.Buffer(), positions.Size());
+    BoundingBox scaleBounds(scales.Buffer(), scales.Size());
+    positionMin_ = constantPosition ? positions[0] : positionBounds.min_;
+    positionStep_ = constantPosition ? Vector3::ZERO : (positionBounds.max_ - positionBounds.min_) / 65535.f;
+    constantRotation_ = rotations[0];
+    scaleMin_ = constantScale ? scales[0] : scaleBounds.min_;
+    scaleStep_ = constantScale ? Vector3::ZERO : (scaleBounds.max_ - scaleBounds.min_) / 65535.f;
+
+    i32 stride = GetSampleStride(channelMask_, constantChannels_);
+    samples_.Resize(numTotalSamples * stride);
+    u16* dest = samples_.Buffer();
+
+    for (i32 i = 0; i < numTotalSamples; ++i)
+    {
+        if (!!(channelMask_ & AnimationChannels::Position) && !constantPosition)
+        {
+            QuantizeVector(positions[i], positionMin_, positionStep_, dest);
+            dest += 3;
+        }
+        if (!!(channelMask_ & AnimationChannels::Rotation) && !constantRotation)
+        {
+            QuantizeRotation(rotations[i], dest);
+            dest += 3;
+        }
+        if (!!(channelMask_ & AnimationChannels::Scale) && !constantScale)
+        {
+            QuantizeVector(scales[i], scaleMin_, scaleStep_, dest);
+            dest += 3;
+        }
+    }
+
+    numSamples_ = numSamples;
+    numLoopSamples_ = numLoopSamples;
+    sampleRate_ = rate;
+    Vector<AnimationKeyFrame>().Swap(keyFrames_);
+}
+
+void AnimationTrack::SaveCompressed(Serializer& dest) const
+{
+    dest.WriteI32(numSamples_);
+    dest.WriteI32(numLoopSamples_);
+    dest.WriteFloat(sampleRate_);
+    dest.WriteU8(to_u8(constantChannels_));
+
+    if (!!(channelMask_ & AnimationChannels::Position))
+    {
+        dest.WriteVector3(positionMin_);
+        dest.WriteVector3(positionStep_);
+    }
+    if (!!(channelMask_ & AnimationChannels::Rotation))
+        dest.WriteQuaternion(constantRotation_);
+    if (!!(channelMask_ & AnimationChannels::Scale))
+    {
+        dest.WriteVector3(scaleMin_);
+        dest.WriteVector3(scaleStep_);
+    }
+
+    dest.WriteI32(samples_.Size());
+    dest.Write(samples_.Buffer(), samples_.Size() * (i32)sizeof(u16));
+}
 
-    // Check for being too far ahead
-    while (index && time < keyFrames_[index].time_)
-        --index;
+bool AnimationTrack::LoadCompressed(Deserializer& source)
+{
+    numSamples_ = source.ReadI32();
+    numLoopSamples_ = source.ReadI32();
+    sampleRate_ = source.ReadFloat();
+    constantChannels_ = AnimationChannels(source.ReadU8());
 
-    // Check for being too far behind
-    while (index < keyFrames_.Size() - 1 && time >= keyFrames_[index + 1].time_)
-        ++index;
+    if (!!(channelMask_ & AnimationChannels::Position))
+    {
+        positionMin_ = source.ReadVector3();
+        positionStep_ = source.ReadVector3();
+    }
+    if (!!(channelMask_ & AnimationChannels::Rotation))
+        constantRotation_ = source.ReadQuaternion();
+    if (!!(channelMask_ & AnimationChannels::Scale))
+    {
+        scaleMin_ = source.ReadVector3();
+        scaleStep_ = source.ReadVector3();
+    }
 
+    // Check the sample count against the data left in the stream before allocating
+    i32 numValues = source.ReadI32();
+    i64 expectedValues = ((i64)numSamples_ + numLoopSamples_) * GetSampleStride(channelMask_, constantChannels_);
+    if (numSamples_ <= 0 || numLoopSamples_ < 0 || numLoopSamples_ >= numSamples_ || numValues != expectedValues ||
+        (i64)numValues * (i64)sizeof(u16) > source.GetSize() - source.GetPosition())
+    {
+        numSamples_ = 0;
+        numLoopSamples_ = 0;
+        samples_.Clear();
+        return false;
+    }
+
+    samples_.Resize(numValues);
+    i32 size = numValues * (i32)sizeof(u16);
+    if (source.Read(samples_.Buffer(), size) != size)
+    {
+        numSamples_ = 0;
+        numLoopSamples_ = 0;
+        samples_.Clear();
+        return false;
+    }
+
+    keyFrames_.Clear();
     return true;
 }
 
+i32 AnimationTrack::GetDataSize() const
+{
+    return keyFrames_.Size() * (i32)sizeof(AnimationKeyFrame) + samples_.Size() * (i32)sizeof(u16);
+}
+
 Animation::Animation() :
     length_(0.f)
 {
@@ -118,7 +505,9 @@ bool Animation::begin_load(Deserializer& source)
     unsigned memoryUse = sizeof(Animation);
 
     // Check ID
-    if (source.ReadFileID() != "UANI")
+    String fileID = source.ReadFileID();
+    bool compressedFormat = fileID == "UANC";
+    if (fileID != "UANI" && !compressedFormat)
     {
         DV_LOGERROR(source.GetName() + " is not a valid animation file");
         return false;
@@ -139,6 +528,17 @@ bool Animation::begin_load(Deserializer& source)
         AnimationTrack* newTrack = CreateTrack(source.ReadString());
         newTrack->channelMask_ = AnimationChannels(source.ReadU8());
 
+        if (compressedFormat && source.ReadBool())
+        {
+            if (!newTrack->LoadCompressed(source))
+            {
+                DV_LOGERROR(source.GetName() + " has invalid compressed track " + newTrack->name_);
+                return false;
+            }
+            memoryUse += newTrack->GetDataSize();
+            continue;
+        }
+
         unsigned keyFrames = source.ReadU32();
         newTrack->keyFrames_.Resize(keyFrames);
         memoryUse += keyFrames * sizeof(AnimationKeyFrame);
@@ -215,8 +615,12 @@ bool Animation::begin_load(Deserializer& source)
 
 bool Animation::Save(Serializer& dest) const
 {
+    bool compressed = false;
+    for (HashMap<StringHash, AnimationTrack>::ConstIterator i = tracks_.Begin(); i != tracks_.End(); ++i)
+        compressed = compressed || i->second_.IsCompressed();
+
     // Write ID, name and length
-    dest.WriteFileID("UANI");
+    dest.WriteFileID(compressed ? "UANC" : "UANI");
     dest.WriteString(animationName_);
     dest.WriteFloat(length_);
 
@@ -227,6 +631,17 @@ bool Animation::Save(Serializer& dest) const
         const AnimationTrack& track = i->second_;
         dest.WriteString(track.name_);
         dest.WriteU8(to_u8(track.channelMask_));
+
+        if (compressed)
+        {
+            dest.WriteBool(track.IsCompressed());
+            if (track.IsCompressed())
+            {
+                track.SaveCompressed(dest);
+                continue;
+            }
+        }
+
         dest.WriteU32(track.keyFrames_.Size());
 
         // Write keyframes of the track
@@ -377,6 +792,19 @@ SharedPtr<Animation> Animation::Clone(const String& cloneName) const
     return ret;
 }
 
+void Animation::Compress(float sampleRate, float tolerance)
+{
+    i32 memoryUse = sizeof(Animation) + triggers_.Size() * sizeof(AnimationTriggerPoint);
+
+    for (HashMap<StringHash, AnimationTrack>::Iterator i = tracks_.Begin(); i != tracks_.End(); ++i)
+    {
+        i->second_.Compress(length_, sampleRate, tolerance);
+        memoryUse += sizeof(AnimationTrack) + i->second_.GetDataSize();
+    }
+
+    SetMemoryUse(memoryUse);
+}
+
 AnimationTrack* Animation::GetTrack(i32 index)
 {
     assert(index >= 0);
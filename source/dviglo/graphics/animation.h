@@ -15,6 +15,14 @@
 namespace dviglo
 {
 
+class Deserializer;
+class Serializer;
+
+/// Default samples per second of compressed animation tracks.
+inline constexpr float DEFAULT_ANIMATION_SAMPLE_RATE = 30.f;
+/// Default tolerance for storing a channel of a compressed track only once.
+inline constexpr float DEFAULT_ANIMATION_TOLERANCE = 0.0001f;
+
 enum class AnimationChannels : u8
 {
     None     = 0,
@@ -69,6 +77,24 @@ struct DV_API AnimationTrack
     i32 GetNumKeyFrames() const { return keyFrames_.Size(); }
     /// Return keyframe index based on time and previous index. Return false if animation is empty.
     bool GetKeyFrameIndex(float time, i32& index) const;
+    /// Sample the track at a time position. Animation length is used for wrapping the last keyframe to the first when
+    /// looped. The keyframe index is a hint for uncompressed tracks. Return false if the track is empty.
+    bool Sample(float time, float length, bool looped, i32& keyFrameIndex, Vector3& position, Quaternion& rotation,
+        Vector3& scale) const;
+    /// Resample the keyframes uniformly over the animation length and quantize them. Channels that stay within the
+    /// tolerance are stored only once. The keyframes are released. Compressed tracks are sampled in constant time. The
+    /// samples after the last keyframe are stored a second time for looped playback, which interpolates back to the first keyframe.
+    void Compress(float length, float sampleRate = DEFAULT_ANIMATION_SAMPLE_RATE, float tolerance = DEFAULT_ANIMATION_TOLERANCE);
+    /// Write compressed data to a stream.
+    void SaveCompressed(Serializer& dest) const;
+    /// Read compressed data from a stream. Return true if successful.
+    bool LoadCompressed(Deserializer& source);
+
+    /// Return whether the track is compressed.
+    bool IsCompressed() const { return numSamples_ > 0; }
+
+    /// Return memory use of the keyframes or the compressed data in bytes.
+    i32 GetDataSize() const;
 
     /// Bone or scene node name.
     String name_;
@@ -78,6 +104,26 @@ struct DV_API AnimationTrack
     AnimationChannels channelMask_{};
     /// Keyframes.
     Vector<AnimationKeyFrame> keyFrames_;
+    /// Number of uniform samples in the compressed data, or 0 if the track is not compressed.
+    i32 numSamples_{};
+    /// Number of extra samples stored after the uniform samples. They replace the last uniform samples in looped playback.
+    i32 numLoopSamples_{};
+    /// Compressed data samples per second.
+    float sampleRate_{};
+    /// Channels stored only once in the compressed data.
+    AnimationChannels constantChannels_{};
+    /// Dequantization offset of positions, or the constant position.
+    Vector3 positionMin_;
+    /// Position per quantization step.
+    Vector3 positionStep_;
+    /// Constant rotation.
+    Quaternion constantRotation_;
+    /// Dequantization offset of scales, or the constant scale.
+    Vector3 scaleMin_;
+    /// Scale per quantization step.
+    Vector3 scaleStep_;
+    /// Quantized samples. Each sample has three values for each of the channels that are not constant.
+    Vector<u16> samples_;
 };
 
 /// %Animation trigger point.
@@ -137,6 +183,8 @@ public:
     void SetNumTriggers(i32 num);
     /// Clone the animation.
     SharedPtr<Animation> Clone(const String& cloneName = String::EMPTY) const;
+    /// Compress all tracks. See AnimationTrack::Compress(). Saving then uses the compressed format.
+    void Compress(float sampleRate = DEFAULT_ANIMATION_SAMPLE_RATE, float tolerance = DEFAULT_ANIMATION_TOLERANCE);
 
     /// Return animation name.
     const String& GetAnimationName() const { return animationName_; }
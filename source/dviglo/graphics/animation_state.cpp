@@ -18,6 +18,7 @@ namespace dviglo
 AnimationStateTrack::AnimationStateTrack() :
     track_(nullptr),
     bone_(nullptr),
+    boneIndex_(NINDEX),
     weight_(1.0f),
     keyFrame_(0)
 {
@@ -131,6 +132,7 @@ void AnimationState::SetStartBone(Bone* startBone)
         if (trackBone && trackBone->node_)
         {
             stateTrack.bone_ = trackBone;
+            stateTrack.boneIndex_ = skeleton.GetBoneIndex(trackBone);
             stateTrack.node_ = trackBone->node_;
             stateTracks_.Push(stateTrack);
         }
@@ -428,114 +430,100 @@ float AnimationState::GetLength() const
     return animation_ ? animation_->GetLength() : 0.0f;
 }
 
+void AnimationState::GetBoneWeights(Vector<float>& dest) const
+{
+    for (const AnimationStateTrack& stateTrack : stateTracks_)
+        dest.Push(stateTrack.weight_);
+}
+
 void AnimationState::Apply()
+{
+    Apply(time_);
+}
+
+void AnimationState::Apply(float time)
 {
     if (!animation_ || !IsEnabled())
         return;
 
     if (model_)
-        ApplyToModel();
+        ApplyToModel(time);
     else
-        ApplyToNodes();
+        ApplyToNodes(time);
 }
 
-void AnimationState::ApplyToModel()
+void AnimationState::ApplyToModel(float time)
 {
+    Vector<BonePose>& pose = model_->localPose_;
+
     for (Vector<AnimationStateTrack>::Iterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
     {
         AnimationStateTrack& stateTrack = *i;
         float finalWeight = weight_ * stateTrack.weight_;
 
         // Do not apply if zero effective weight or the bone has animation disabled
-        if (Equals(finalWeight, 0.0f) || !stateTrack.bone_->animated_)
+        if (Equals(finalWeight, 0.0f) || !stateTrack.bone_->animated_ || stateTrack.boneIndex_ >= pose.Size() ||
+            stateTrack.boneIndex_ == NINDEX)
             continue;
 
-        ApplyTrack(stateTrack, finalWeight, true);
+        ApplyTrack(stateTrack, time, finalWeight, pose[stateTrack.boneIndex_]);
     }
 }
 
-void AnimationState::ApplyToNodes()
+void AnimationState::ApplyToNodes(float time)
 {
     // When applying to a node hierarchy, can only use full weight (nothing to blend to)
     for (Vector<AnimationStateTrack>::Iterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
-        ApplyTrack(*i, 1.0f, false);
-}
-
-void AnimationState::ApplyTrack(AnimationStateTrack& stateTrack, float weight, bool silent)
-{
-    const AnimationTrack* track = stateTrack.track_;
-    Node* node = stateTrack.node_;
-
-    if (track->keyFrames_.Empty() || !node)
-        return;
+    {
+        Node* node = i->node_;
+        if (!node)
+            continue;
 
-    i32& frame = stateTrack.keyFrame_;
-    track->GetKeyFrameIndex(time_, frame);
+        BonePose pose{node->GetPosition(), node->GetRotation(), node->GetScale()};
+        if (!ApplyTrack(*i, time, 1.0f, pose))
+            continue;
 
-    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
-    i32 nextFrame = frame + 1;
-    bool interpolate = true;
-    if (nextFrame >= track->keyFrames_.Size())
-    {
-        if (!looped_)
-        {
-            nextFrame = frame;
-            interpolate = false;
-        }
-        else
-            nextFrame = 0;
+        const AnimationChannels channelMask = i->track_->channelMask_;
+        if (!!(channelMask & AnimationChannels::Position))
+            node->SetPosition(pose.position_);
+        if (!!(channelMask & AnimationChannels::Rotation))
+            node->SetRotation(pose.rotation_);
+        if (!!(channelMask & AnimationChannels::Scale))
+            node->SetScale(pose.scale_);
     }
+}
 
-    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
+bool AnimationState::ApplyTrack(AnimationStateTrack& stateTrack, float time, float weight, BonePose& pose)
+{
+    const AnimationTrack* track = stateTrack.track_;
     const AnimationChannels channelMask = track->channelMask_;
 
     Vector3 newPosition;
     Quaternion newRotation;
     Vector3 newScale;
 
-    if (interpolate)
-    {
-        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
-        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
-        if (timeInterval < 0.0f)
-            timeInterval += animation_->GetLength();
-        float t = timeInterval > 0.0f ? (time_ - keyFrame->time_) / timeInterval : 1.0f;
-
-        if (!!(channelMask & AnimationChannels::Position))
-            newPosition = keyFrame->position_.Lerp(nextKeyFrame->position_, t);
-        if (!!(channelMask & AnimationChannels::Rotation))
-            newRotation = keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t);
-        if (!!(channelMask & AnimationChannels::Scale))
-            newScale = keyFrame->scale_.Lerp(nextKeyFrame->scale_, t);
-    }
-    else
-    {
-        if (!!(channelMask & AnimationChannels::Position))
-            newPosition = keyFrame->position_;
-        if (!!(channelMask & AnimationChannels::Rotation))
-            newRotation = keyFrame->rotation_;
-        if (!!(channelMask & AnimationChannels::Scale))
-            newScale = keyFrame->scale_;
-    }
+    if (!track->Sample(time, animation_->GetLength(), looped_, stateTrack.keyFrame_, newPosition, newRotation, newScale))
+        return false;
 
     if (blendingMode_ == ABM_ADDITIVE) // not ABM_LERP
     {
         if (!!(channelMask & AnimationChannels::Position))
         {
             Vector3 delta = newPosition - stateTrack.bone_->initialPosition_;
-            newPosition = node->GetPosition() + delta * weight;
+            pose.position_ += delta * weight;
         }
         if (!!(channelMask & AnimationChannels::Rotation))
         {
             Quaternion delta = newRotation * stateTrack.bone_->initialRotation_.Inverse();
-            newRotation = (delta * node->GetRotation()).normalized();
+            newRotation = (delta * pose.rotation_).normalized();
             if (!Equals(weight, 1.0f))
-                newRotation = node->GetRotation().Slerp(newRotation, weight);
+                newRotation = pose.rotation_.Slerp(newRotation, weight);
+            pose.rotation_ = newRotation;
         }
         if (!!(channelMask & AnimationChannels::Scale))
         {
             Vector3 delta = newScale - stateTrack.bone_->initialScale_;
-            newScale = node->GetScale() + delta * weight;
+            pose.scale_ += delta * weight;
         }
     }
     else
@@ -543,32 +531,22 @@ void AnimationState::ApplyTrack(AnimationStateTrack& stateTrack, float weight, b
         if (!Equals(weight, 1.0f)) // not full weight
         {
             if (!!(channelMask & AnimationChannels::Position))
-                newPosition = node->GetPosition().Lerp(newPosition, weight);
+                newPosition = pose.position_.Lerp(newPosition, weight);
             if (!!(channelMask & AnimationChannels::Rotation))
-                newRotation = node->GetRotation().Slerp(newRotation, weight);
+                newRotation = pose.rotation_.Slerp(newRotation, weight);
             if (!!(channelMask & AnimationChannels::Scale))
-                newScale = node->GetScale().Lerp(newScale, weight);
+                newScale = pose.scale_.Lerp(newScale, weight);
         }
-    }
 
-    if (silent)
-    {
         if (!!(channelMask & AnimationChannels::Position))
-            node->SetPositionSilent(newPosition);
+            pose.position_ = newPosition;
         if (!!(channelMask & AnimationChannels::Rotation))
-            node->SetRotationSilent(newRotation);
+            pose.rotation_ = newRotation;
         if (!!(channelMask & AnimationChannels::Scale))
-            node->SetScaleSilent(newScale);
-    }
-    else
-    {
-        if (!!(channelMask & AnimationChannels::Position))
-            node->SetPosition(newPosition);
-        if (!!(channelMask & AnimationChannels::Rotation))
-            node->SetRotation(newRotation);
-        if (!!(channelMask & AnimationChannels::Scale))
-            node->SetScale(newScale);
+            pose.scale_ = newScale;
     }
+
+    return true;
 }
 
 }
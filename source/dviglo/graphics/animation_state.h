@@ -21,6 +21,7 @@ class Skeleton;
 class StringHash;
 struct AnimationTrack;
 struct Bone;
+struct BonePose;
 
 /// %Animation blending mode.
 enum AnimationBlendMode
@@ -43,6 +44,8 @@ struct AnimationStateTrack
     const AnimationTrack* track_;
     /// Bone pointer.
     Bone* bone_;
+    /// Bone index in the model's skeleton and pose buffers.
+    i32 boneIndex_;
     /// Scene node pointer.
     WeakPtr<Node> node_;
     /// Blending weight.
@@ -128,16 +131,21 @@ public:
     /// Return blending layer.
     unsigned char GetLayer() const { return layer_; }
 
+    /// Append the per-bone blending weights of all tracks to a vector.
+    void GetBoneWeights(Vector<float>& dest) const;
+
     /// Apply the animation at the current time position.
     void Apply();
+    /// Apply the animation at a specific time position without changing the current one.
+    void Apply(float time);
 
 private:
-    /// Apply animation to a skeleton. Transform changes are applied silently, so the model needs to dirty its root model afterward.
-    void ApplyToModel();
+    /// Apply animation to the model's local pose buffer. The model writes the pose to the bone nodes afterward.
+    void ApplyToModel(float time);
     /// Apply animation to a scene node hierarchy.
-    void ApplyToNodes();
-    /// Apply track.
-    void ApplyTrack(AnimationStateTrack& stateTrack, float weight, bool silent);
+    void ApplyToNodes(float time);
+    /// Sample a track and blend it to a bone pose. Return false if the track is empty.
+    bool ApplyTrack(AnimationStateTrack& stateTrack, float time, float weight, BonePose& pose);
 
     /// Animated model (model mode).
     WeakPtr<AnimatedModel> model_;
@@ -23,6 +23,9 @@ using namespace std;
 namespace dviglo
 {
 
+/// Minimum number of batches for using radix sort. Comparison sort is faster for small queues.
+static const i32 MIN_RADIX_SORT_BATCHES = 256;
+
 inline bool CompareBatchesState(Batch* lhs, Batch* rhs)
 {
     if (lhs->renderOrder_ != rhs->renderOrder_)
@@ -63,6 +66,12 @@ inline bool CompareBatchGroupOrder(BatchGroup* lhs, BatchGroup* rhs)
     return lhs->renderOrder_ < rhs->renderOrder_;
 }
 
+/// Return radix sort key for ascending render order.
+inline u64 GetRenderOrderRadixKey(const Batch* batch)
+{
+    return (u8)batch->renderOrder_ ^ 0x80u;
+}
+
 void CalculateShadowMatrix(Matrix4& dest, LightBatchQueue* queue, i32 split)
 {
     assert(split >= 0);
@@ -164,24 +173,24 @@ void Batch::CalculateSortKey()
                (((hash64)materialID) << 16u) | geometryID;
 }
 
-void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool allowDepthWrite) const
+void Batch::Prepare(DrawCommandBuffer& commands, Camera* camera, bool setModelTransform) const
 {
     if (!vertexShader_ || !pixelShader_)
         return;
 
-    Graphics* graphics = DV_GRAPHICS;
     Renderer* renderer = DV_RENDERER;
     Node* cameraNode = camera ? camera->GetNode() : nullptr;
     Light* light = lightQueue_ ? lightQueue_->light_ : nullptr;
     Texture2D* shadowMap = lightQueue_ ? lightQueue_->shadowMap_ : nullptr;
 
     // Set shaders first. The available shader parameters and their register/uniform positions depend on the currently set shaders
-    graphics->SetShaders(vertexShader_, pixelShader_);
+    commands.SetShaders(vertexShader_, pixelShader_);
 
     // Set pass / material-specific renderstates
+    BlendMode blend = BLEND_REPLACE;
     if (pass_ && material_)
     {
-        BlendMode blend = pass_->blend_mode();
+        blend = pass_->blend_mode();
         // Turn additive blending into subtract if the light is negative
         if (light && light->IsNegative())
         {
@@ -190,8 +199,8 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
             else if (blend == BLEND_ADDALPHA)
                 blend = BLEND_SUBTRACTALPHA;
         }
-        graphics->SetBlendMode(blend, pass_->GetAlphaToCoverage() || material_->GetAlphaToCoverage());
-        graphics->SetLineAntiAlias(material_->GetLineAntiAlias());
+        commands.SetBlendMode(blend, pass_->GetAlphaToCoverage() || material_->GetAlphaToCoverage());
+        commands.SetLineAntiAlias(material_->GetLineAntiAlias());
 
         bool isShadowPass = pass_->GetIndex() == Technique::shadowPassIndex;
         CullMode effectiveCullMode = pass_->GetCullMode();
@@ -199,155 +208,104 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
         if (effectiveCullMode == MAX_CULLMODES)
             effectiveCullMode = isShadowPass ? material_->GetShadowCullMode() : material_->GetCullMode();
 
-        renderer->SetCullMode(effectiveCullMode, camera);
+        commands.SetCullMode(Renderer::GetEffectiveCullMode(effectiveCullMode, camera));
         if (!isShadowPass)
         {
             const BiasParameters& depthBias = material_->GetDepthBias();
-            graphics->SetDepthBias(depthBias.constantBias_, depthBias.slopeScaledBias_);
+            commands.SetDepthBias(depthBias.constantBias_, depthBias.slopeScaledBias_);
         }
 
         // Use the "least filled" fill mode combined from camera & material
-        graphics->SetFillMode((FillMode)(Max(camera->fill_mode(), material_->fill_mode())));
-        graphics->SetDepthTest(pass_->GetDepthTestMode());
-        graphics->SetDepthWrite(pass_->GetDepthWrite() && allowDepthWrite);
+        commands.SetFillMode((FillMode)(Max(camera->fill_mode(), material_->fill_mode())));
+        commands.SetDepthTest(pass_->GetDepthTestMode());
+        commands.SetDepthWrite(pass_->GetDepthWrite());
     }
 
     // Set global (per-frame) shader parameters
-    if (graphics->NeedParameterUpdate(SP_FRAME, nullptr))
-        view->SetGlobalShaderParameters();
+    commands.SetFrameParameters();
 
     // Set camera & viewport shader parameters
-    hash32 cameraHash = (hash32)(size_t)camera;
-    IntRect viewport = graphics->GetViewport();
-    IntVector2 viewSize = IntVector2(viewport.Width(), viewport.Height());
-    hash32 viewportHash = (hash32)viewSize.x | (hash32)viewSize.y << 16u;
-    if (graphics->NeedParameterUpdate(SP_CAMERA, reinterpret_cast<const void*>(cameraHash + viewportHash)))
-    {
-        view->SetCameraShaderParameters(camera);
-        // During renderpath commands the G-Buffer or viewport texture is assumed to always be viewport-sized
-        view->SetGBufferShaderParameters(viewSize, IntRect(0, 0, viewSize.x, viewSize.y));
-    }
+    commands.SetCameraParameters(camera);
 
     // Set model or skinning transforms
-    if (setModelTransform && graphics->NeedParameterUpdate(SP_OBJECT, worldTransform_))
+    if (setModelTransform && commands.BeginParameterGroup(SP_OBJECT, worldTransform_))
     {
         if (geometryType_ == GEOM_SKINNED)
         {
-            graphics->SetShaderParameter(VSP_SKINMATRICES, reinterpret_cast<const float*>(worldTransform_),
+            commands.SetShaderParameter(VSP_SKINMATRICES, reinterpret_cast<const float*>(worldTransform_),
                 12 * numWorldTransforms_);
         }
         else
-            graphics->SetShaderParameter(VSP_MODEL, *worldTransform_);
+            commands.SetShaderParameter(VSP_MODEL, *worldTransform_);
 
         // Set the orientation for billboards, either from the object itself or from the camera
         if (geometryType_ == GEOM_BILLBOARD)
         {
             if (numWorldTransforms_ > 1)
-                graphics->SetShaderParameter(VSP_BILLBOARDROT, worldTransform_[1].RotationMatrix());
+                commands.SetShaderParameter(VSP_BILLBOARDROT, worldTransform_[1].RotationMatrix());
             else
-                graphics->SetShaderParameter(VSP_BILLBOARDROT, cameraNode->GetWorldRotation().RotationMatrix());
-        }
-    }
-
-    // Set zone-related shader parameters
-    BlendMode blend = graphics->blend_mode();
-    // If the pass is additive, override fog color to black so that shaders do not need a separate additive path
-    bool overrideFogColorToBlack = blend == BLEND_ADD || blend == BLEND_ADDALPHA;
-    hash32 zoneHash = (hash32)(size_t)zone_;
-    if (overrideFogColorToBlack)
-        zoneHash += 0x80000000;
-    if (zone_ && graphics->NeedParameterUpdate(SP_ZONE, reinterpret_cast<const void*>(zoneHash)))
-    {
-        graphics->SetShaderParameter(VSP_AMBIENTSTARTCOLOR, zone_->GetAmbientStartColor());
-        graphics->SetShaderParameter(VSP_AMBIENTENDCOLOR,
-            zone_->GetAmbientEndColor().ToVector4() - zone_->GetAmbientStartColor().ToVector4());
-
-        const BoundingBox& box = zone_->GetBoundingBox();
-        Vector3 boxSize = box.Size();
-        Matrix3x4 adjust(Matrix3x4::IDENTITY);
-        adjust.SetScale(Vector3(1.0f / boxSize.x, 1.0f / boxSize.y, 1.0f / boxSize.z));
-        adjust.SetTranslation(Vector3(0.5f, 0.5f, 0.5f));
-        Matrix3x4 zoneTransform = adjust * zone_->GetInverseWorldTransform();
-        graphics->SetShaderParameter(VSP_ZONE, zoneTransform);
-
-        graphics->SetShaderParameter(PSP_AMBIENTCOLOR, zone_->GetAmbientColor());
-        graphics->SetShaderParameter(PSP_FOGCOLOR, overrideFogColorToBlack ? Color::BLACK : zone_->GetFogColor());
-        graphics->SetShaderParameter(PSP_ZONEMIN, zone_->GetBoundingBox().min_);
-        graphics->SetShaderParameter(PSP_ZONEMAX, zone_->GetBoundingBox().max_);
-
-        float farClip = camera->GetFarClip();
-        float fogStart = Min(zone_->GetFogStart(), farClip);
-        float fogEnd = Min(zone_->GetFogEnd(), farClip);
-        if (fogStart >= fogEnd * (1.0f - M_LARGE_EPSILON))
-            fogStart = fogEnd * (1.0f - M_LARGE_EPSILON);
-        float fogRange = Max(fogEnd - fogStart, M_EPSILON);
-        Vector4 fogParams(fogEnd / farClip, farClip / fogRange, 0.0f, 0.0f);
-
-        Node* zoneNode = zone_->GetNode();
-        if (zone_->GetHeightFog() && zoneNode)
-        {
-            Vector3 worldFogHeightVec = zoneNode->GetWorldTransform() * Vector3(0.0f, zone_->GetFogHeight(), 0.0f);
-            fogParams.z = worldFogHeightVec.y;
-            fogParams.w = zone_->GetFogHeightScale() / Max(zoneNode->GetWorldScale().y, M_EPSILON);
+                commands.SetShaderParameter(VSP_BILLBOARDROT, cameraNode->GetWorldRotation().RotationMatrix());
         }
 
-        graphics->SetShaderParameter(PSP_FOGPARAMS, fogParams);
+        commands.EndParameterGroup();
     }
 
+    // Set zone-related shader parameters. If the pass is additive, override fog color to black so that shaders do not need
+    // a separate additive path
+    if (zone_)
+        commands.SetZoneParameters(zone_, camera, blend == BLEND_ADD || blend == BLEND_ADDALPHA);
+
     // Set light-related shader parameters
     if (lightQueue_)
     {
-        if (light && graphics->NeedParameterUpdate(SP_LIGHT, lightQueue_))
+        if (light && commands.BeginParameterGroup(SP_LIGHT, lightQueue_))
         {
             Node* lightNode = light->GetNode();
             float atten = 1.0f / Max(light->GetRange(), M_EPSILON);
             Vector3 lightDir(lightNode->GetWorldRotation() * Vector3::BACK);
             Vector4 lightPos(lightNode->GetWorldPosition(), atten);
 
-            graphics->SetShaderParameter(VSP_LIGHTDIR, lightDir);
-            graphics->SetShaderParameter(VSP_LIGHTPOS, lightPos);
+            commands.SetShaderParameter(VSP_LIGHTDIR, lightDir);
+            commands.SetShaderParameter(VSP_LIGHTPOS, lightPos);
 
-            if (graphics->HasShaderParameter(VSP_LIGHTMATRICES))
+            switch (light->GetLightType())
             {
-                switch (light->GetLightType())
+            case LIGHT_DIRECTIONAL:
                 {
-                case LIGHT_DIRECTIONAL:
-                    {
-                        Matrix4 shadowMatrices[MAX_CASCADE_SPLITS];
-                        i32 numSplits = Min(MAX_CASCADE_SPLITS, lightQueue_->shadowSplits_.Size());
+                    Matrix4 shadowMatrices[MAX_CASCADE_SPLITS];
+                    i32 numSplits = Min(MAX_CASCADE_SPLITS, lightQueue_->shadowSplits_.Size());
 
-                        for (i32 i = 0; i < numSplits; ++i)
-                            CalculateShadowMatrix(shadowMatrices[i], lightQueue_, i);
+                    for (i32 i = 0; i < numSplits; ++i)
+                        CalculateShadowMatrix(shadowMatrices[i], lightQueue_, i);
 
-                        graphics->SetShaderParameter(VSP_LIGHTMATRICES, shadowMatrices[0].Data(), 16 * numSplits);
-                    }
-                    break;
+                    commands.SetShaderParameter(VSP_LIGHTMATRICES, shadowMatrices[0].Data(), 16 * numSplits);
+                }
+                break;
 
-                case LIGHT_SPOT:
-                    {
-                        Matrix4 shadowMatrices[2];
+            case LIGHT_SPOT:
+                {
+                    Matrix4 shadowMatrices[2];
 
-                        CalculateSpotMatrix(shadowMatrices[0], light);
-                        bool isShadowed = shadowMap && graphics->HasTextureUnit(TU_SHADOWMAP);
-                        if (isShadowed)
-                            CalculateShadowMatrix(shadowMatrices[1], lightQueue_, 0);
+                    CalculateSpotMatrix(shadowMatrices[0], light);
+                    bool isShadowed = shadowMap != nullptr;
+                    if (isShadowed)
+                        CalculateShadowMatrix(shadowMatrices[1], lightQueue_, 0);
 
-                        graphics->SetShaderParameter(VSP_LIGHTMATRICES, shadowMatrices[0].Data(), isShadowed ? 32 : 16);
-                    }
-                    break;
+                    commands.SetShaderParameter(VSP_LIGHTMATRICES, shadowMatrices[0].Data(), isShadowed ? 32 : 16);
+                }
+                break;
 
-                case LIGHT_POINT:
-                    {
-                        Matrix4 lightVecRot(lightNode->GetWorldRotation().RotationMatrix());
-                        // HLSL compiler will pack the parameters as if the matrix is only 3x4, so must be careful to not overwrite
-                        // the next parameter
-                        if (GParams::get_gapi() == GAPI_OPENGL)
-                            graphics->SetShaderParameter(VSP_LIGHTMATRICES, lightVecRot.Data(), 16);
-                        else
-                            graphics->SetShaderParameter(VSP_LIGHTMATRICES, lightVecRot.Data(), 12);
-                    }
-                    break;
+            case LIGHT_POINT:
+                {
+                    Matrix4 lightVecRot(lightNode->GetWorldRotation().RotationMatrix());
+                    // HLSL compiler will pack the parameters as if the matrix is only 3x4, so must be careful to not overwrite
+                    // the next parameter
+                    if (GParams::get_gapi() == GAPI_OPENGL)
+                        commands.SetShaderParameter(VSP_LIGHTMATRICES, lightVecRot.Data(), 16);
+                    else
+                        commands.SetShaderParameter(VSP_LIGHTMATRICES, lightVecRot.Data(), 12);
                 }
+                break;
             }
 
             float fade = 1.0f;
@@ -359,54 +317,51 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
                 fade = Min(1.0f - (light->distance() - fadeStart) / (fadeEnd - fadeStart), 1.0f);
 
             // Negative lights will use subtract blending, so write absolute RGB values to the shader parameter
-            graphics->SetShaderParameter(PSP_LIGHTCOLOR, Color(light->GetEffectiveColor().Abs(),
+            commands.SetShaderParameter(PSP_LIGHTCOLOR, Color(light->GetEffectiveColor().Abs(),
                 light->GetEffectiveSpecularIntensity()) * fade);
-            graphics->SetShaderParameter(PSP_LIGHTDIR, lightDir);
-            graphics->SetShaderParameter(PSP_LIGHTPOS, lightPos);
-            graphics->SetShaderParameter(PSP_LIGHTRAD, light->GetRadius());
-            graphics->SetShaderParameter(PSP_LIGHTLENGTH, light->GetLength());
+            commands.SetShaderParameter(PSP_LIGHTDIR, lightDir);
+            commands.SetShaderParameter(PSP_LIGHTPOS, lightPos);
+            commands.SetShaderParameter(PSP_LIGHTRAD, light->GetRadius());
+            commands.SetShaderParameter(PSP_LIGHTLENGTH, light->GetLength());
 
-            if (graphics->HasShaderParameter(PSP_LIGHTMATRICES))
+            switch (light->GetLightType())
             {
-                switch (light->GetLightType())
+            case LIGHT_DIRECTIONAL:
                 {
-                case LIGHT_DIRECTIONAL:
-                    {
-                        Matrix4 shadowMatrices[MAX_CASCADE_SPLITS];
-                        i32 numSplits = Min(MAX_CASCADE_SPLITS, lightQueue_->shadowSplits_.Size());
+                    Matrix4 shadowMatrices[MAX_CASCADE_SPLITS];
+                    i32 numSplits = Min(MAX_CASCADE_SPLITS, lightQueue_->shadowSplits_.Size());
 
-                        for (i32 i = 0; i < numSplits; ++i)
-                            CalculateShadowMatrix(shadowMatrices[i], lightQueue_, i);
+                    for (i32 i = 0; i < numSplits; ++i)
+                        CalculateShadowMatrix(shadowMatrices[i], lightQueue_, i);
 
-                        graphics->SetShaderParameter(PSP_LIGHTMATRICES, shadowMatrices[0].Data(), 16 * numSplits);
-                    }
-                    break;
+                    commands.SetShaderParameter(PSP_LIGHTMATRICES, shadowMatrices[0].Data(), 16 * numSplits);
+                }
+                break;
 
-                case LIGHT_SPOT:
-                    {
-                        Matrix4 shadowMatrices[2];
+            case LIGHT_SPOT:
+                {
+                    Matrix4 shadowMatrices[2];
 
-                        CalculateSpotMatrix(shadowMatrices[0], light);
-                        bool isShadowed = lightQueue_->shadowMap_ != nullptr;
-                        if (isShadowed)
-                            CalculateShadowMatrix(shadowMatrices[1], lightQueue_, 0);
+                    CalculateSpotMatrix(shadowMatrices[0], light);
+                    bool isShadowed = lightQueue_->shadowMap_ != nullptr;
+                    if (isShadowed)
+                        CalculateShadowMatrix(shadowMatrices[1], lightQueue_, 0);
 
-                        graphics->SetShaderParameter(PSP_LIGHTMATRICES, shadowMatrices[0].Data(), isShadowed ? 32 : 16);
-                    }
-                    break;
+                    commands.SetShaderParameter(PSP_LIGHTMATRICES, shadowMatrices[0].Data(), isShadowed ? 32 : 16);
+                }
+                break;
 
-                case LIGHT_POINT:
-                    {
-                        Matrix4 lightVecRot(lightNode->GetWorldRotation().RotationMatrix());
-                        // HLSL compiler will pack the parameters as if the matrix is only 3x4, so must be careful to not overwrite
-                        // the next parameter
-                        if (GParams::get_gapi() == GAPI_OPENGL)
-                            graphics->SetShaderParameter(PSP_LIGHTMATRICES, lightVecRot.Data(), 16);
-                        else
-                            graphics->SetShaderParameter(PSP_LIGHTMATRICES, lightVecRot.Data(), 12);
-                    }
-                    break;
+            case LIGHT_POINT:
+                {
+                    Matrix4 lightVecRot(lightNode->GetWorldRotation().RotationMatrix());
+                    // HLSL compiler will pack the parameters as if the matrix is only 3x4, so must be careful to not overwrite
+                    // the next parameter
+                    if (GParams::get_gapi() == GAPI_OPENGL)
+                        commands.SetShaderParameter(PSP_LIGHTMATRICES, lightVecRot.Data(), 16);
+                    else
+                        commands.SetShaderParameter(PSP_LIGHTMATRICES, lightVecRot.Data(), 12);
                 }
+                break;
             }
 
             // Set shadow mapping shader parameters
@@ -441,7 +396,7 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
                         addX -= 0.5f / width;
                         addY -= 0.5f / height;
                     }
-                    graphics->SetShaderParameter(PSP_SHADOWCUBEADJUST, Vector4(mulX, mulY, addX, addY));
+                    commands.SetShaderParameter(PSP_SHADOWCUBEADJUST, Vector4(mulX, mulY, addX, addY));
                 }
 
                 {
@@ -460,7 +415,7 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
                     float fadeEnd = shadowRange / viewFarClip;
                     float fadeRange = fadeEnd - fadeStart;
 
-                    graphics->SetShaderParameter(PSP_SHADOWDEPTHFADE, Vector4(q, r, fadeStart, 1.0f / fadeRange));
+                    commands.SetShaderParameter(PSP_SHADOWDEPTHFADE, Vector4(q, r, fadeStart, 1.0f / fadeRange));
                 }
 
                 {
@@ -474,12 +429,12 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
                     float samples = 1.0f;
                     if (renderer->GetShadowQuality() == SHADOWQUALITY_PCF_16BIT || renderer->GetShadowQuality() == SHADOWQUALITY_PCF_24BIT)
                         samples = 4.0f;
-                    graphics->SetShaderParameter(PSP_SHADOWINTENSITY, Vector4(pcfValues / samples, intensity, 0.0f, 0.0f));
+                    commands.SetShaderParameter(PSP_SHADOWINTENSITY, Vector4(pcfValues / samples, intensity, 0.0f, 0.0f));
                 }
 
                 float sizeX = 1.0f / (float)shadowMap->GetWidth();
                 float sizeY = 1.0f / (float)shadowMap->GetHeight();
-                graphics->SetShaderParameter(PSP_SHADOWMAPINVSIZE, Vector2(sizeX, sizeY));
+                commands.SetShaderParameter(PSP_SHADOWMAPINVSIZE, Vector2(sizeX, sizeY));
 
                 Vector4 lightSplits(M_LARGE_VALUE, M_LARGE_VALUE, M_LARGE_VALUE, M_LARGE_VALUE);
                 if (lightQueue_->shadowSplits_.Size() > 1)
@@ -489,10 +444,9 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
                 if (lightQueue_->shadowSplits_.Size() > 3)
                     lightSplits.z = lightQueue_->shadowSplits_[2].farSplit_ / camera->GetFarClip();
 
-                graphics->SetShaderParameter(PSP_SHADOWSPLITS, lightSplits);
+                commands.SetShaderParameter(PSP_SHADOWSPLITS, lightSplits);
 
-                if (graphics->HasShaderParameter(PSP_VSMSHADOWPARAMS))
-                    graphics->SetShaderParameter(PSP_VSMSHADOWPARAMS, renderer->GetVSMShadowParameters());
+                commands.SetShaderParameter(PSP_VSMSHADOWPARAMS, renderer->GetVSMShadowParameters());
 
                 if (light->GetShadowBias().normalOffset_ > 0.0f)
                 {
@@ -519,13 +473,14 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
 #ifdef MOBILE_GRAPHICS
                     normalOffsetScale *= renderer.GetMobileNormalOffsetMul();
 #endif
-                    graphics->SetShaderParameter(VSP_NORMALOFFSETSCALE, normalOffsetScale);
-                    graphics->SetShaderParameter(PSP_NORMALOFFSETSCALE, normalOffsetScale);
+                    commands.SetShaderParameter(VSP_NORMALOFFSETSCALE, normalOffsetScale);
+                    commands.SetShaderParameter(PSP_NORMALOFFSETSCALE, normalOffsetScale);
                 }
             }
+
+            commands.EndParameterGroup();
         }
-        else if (lightQueue_->vertexLights_.Size() && graphics->HasShaderParameter(VSP_VERTEXLIGHTS) &&
-                 graphics->NeedParameterUpdate(SP_LIGHT, lightQueue_))
+        else if (lightQueue_->vertexLights_.Size() && commands.BeginParameterGroup(SP_LIGHT, lightQueue_))
         {
             Vector4 vertexLights[MAX_VERTEX_LIGHTS * 3];
             const Vector<Light*>& lights = lightQueue_->vertexLights_;
@@ -572,69 +527,66 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
                 vertexLights[i * 3 + 2] = Vector4(vertexLightNode->GetWorldPosition(), invCutoff);
             }
 
-            graphics->SetShaderParameter(VSP_VERTEXLIGHTS, vertexLights[0].Data(), lights.Size() * 3 * 4);
+            commands.SetShaderParameter(VSP_VERTEXLIGHTS, vertexLights[0].Data(), lights.Size() * 3 * 4);
+            commands.EndParameterGroup();
         }
     }
 
-    // Set zone texture if necessary
+    // Set zone texture if necessary. Textures are set on replay only if the shaders use the texture unit
 #ifndef DV_GLES2
-    if (zone_ && graphics->HasTextureUnit(TU_ZONE))
-        graphics->SetTexture(TU_ZONE, zone_->GetZoneTexture());
+    if (zone_)
+        commands.SetTexture(TU_ZONE, zone_->GetZoneTexture());
 #else
     // On OpenGL ES2 set the zone texture to the environment unit instead
-    if (zone_ && zone_->GetZoneTexture() && graphics->HasTextureUnit(TU_ENVIRONMENT))
-        graphics->SetTexture(TU_ENVIRONMENT, zone_->GetZoneTexture());
+    if (zone_ && zone_->GetZoneTexture())
+        commands.SetTexture(TU_ENVIRONMENT, zone_->GetZoneTexture());
 #endif
 
     // Set material-specific shader parameters and textures
     if (material_)
     {
-        if (graphics->NeedParameterUpdate(SP_MATERIAL, reinterpret_cast<const void*>(material_->GetShaderParameterHash())))
-        {
-            const HashMap<StringHash, MaterialShaderParameter>& parameters = material_->GetShaderParameters();
-            for (HashMap<StringHash, MaterialShaderParameter>::ConstIterator i = parameters.Begin(); i != parameters.End(); ++i)
-                graphics->SetShaderParameter(i->first_, i->second_.value_);
-        }
+        commands.SetMaterialParameters(material_);
 
         const HashMap<TextureUnit, SharedPtr<Texture>>& textures = material_->GetTextures();
         for (HashMap<TextureUnit, SharedPtr<Texture>>::ConstIterator i = textures.Begin(); i != textures.End(); ++i)
-        {
-            if (graphics->HasTextureUnit(i->first_))
-                graphics->SetTexture(i->first_, i->second_.Get());
-        }
+            commands.SetTexture(i->first_, i->second_.Get());
     }
 
     // Set light-related textures
     if (light)
     {
-        if (shadowMap && graphics->HasTextureUnit(TU_SHADOWMAP))
-            graphics->SetTexture(TU_SHADOWMAP, shadowMap);
-        if (graphics->HasTextureUnit(TU_LIGHTRAMP))
-        {
-            Texture* rampTexture = light->GetRampTexture();
-            if (!rampTexture)
-                rampTexture = renderer->GetDefaultLightRamp();
-            graphics->SetTexture(TU_LIGHTRAMP, rampTexture);
-        }
-        if (graphics->HasTextureUnit(TU_LIGHTSHAPE))
-        {
-            Texture* shapeTexture = light->GetShapeTexture();
-            if (!shapeTexture && light->GetLightType() == LIGHT_SPOT)
-                shapeTexture = renderer->GetDefaultLightSpot();
-            graphics->SetTexture(TU_LIGHTSHAPE, shapeTexture);
-        }
+        if (shadowMap)
+            commands.SetTexture(TU_SHADOWMAP, shadowMap);
+
+        Texture* rampTexture = light->GetRampTexture();
+        if (!rampTexture)
+            rampTexture = renderer->GetDefaultLightRamp();
+        commands.SetTexture(TU_LIGHTRAMP, rampTexture);
+
+        Texture* shapeTexture = light->GetShapeTexture();
+        if (!shapeTexture && light->GetLightType() == LIGHT_SPOT)
+            shapeTexture = renderer->GetDefaultLightSpot();
+        commands.SetTexture(TU_LIGHTSHAPE, shapeTexture);
     }
 }
 
-void Batch::Draw(View* view, Camera* camera, bool allowDepthWrite) const
+void Batch::Record(DrawCommandBuffer& commands, Camera* camera) const
 {
     if (!geometry_->IsEmpty())
     {
-        Prepare(view, camera, true, allowDepthWrite);
-        geometry_->Draw();
+        Prepare(commands, camera, true);
+        commands.Draw(geometry_);
     }
 }
 
+void Batch::Draw(View* view, Camera* camera, bool allowDepthWrite) const
+{
+    DrawCommandBuffer& commands = view->GetScratchCommands();
+    commands.Clear();
+    Record(commands, camera);
+    commands.Replay(view, allowDepthWrite);
+}
+
 void BatchGroup::SetInstancingData(void* lockedData, i32 stride, i32& freeIndex)
 {
     assert(stride >= 0);
@@ -659,46 +611,31 @@ void BatchGroup::SetInstancingData(void* lockedData, i32 stride, i32& freeIndex)
     freeIndex += instances_.Size();
 }
 
-void BatchGroup::Draw(View* view, Camera* camera, bool allowDepthWrite) const
+void BatchGroup::Record(DrawCommandBuffer& commands, Camera* camera) const
 {
-    Graphics* graphics = DV_GRAPHICS;
-
     if (instances_.Size() && !geometry_->IsEmpty())
     {
         // Draw as individual objects if instancing not supported or could not fill the instancing buffer
         VertexBuffer* instanceBuffer = DV_RENDERER->GetInstancingBuffer().get();
         if (!instanceBuffer || geometryType_ != GEOM_INSTANCED || startIndex_ == NINDEX)
         {
-            Batch::Prepare(view, camera, false, allowDepthWrite);
-
-            graphics->SetIndexBuffer(geometry_->GetIndexBuffer().get());
-            graphics->SetVertexBuffers(geometry_->GetVertexBuffers());
+            Batch::Prepare(commands, camera, false);
 
             for (const InstanceData& instance : instances_)
             {
-                if (graphics->NeedParameterUpdate(SP_OBJECT, instance.worldTransform_))
-                    graphics->SetShaderParameter(VSP_MODEL, *instance.worldTransform_);
+                if (commands.BeginParameterGroup(SP_OBJECT, instance.worldTransform_))
+                {
+                    commands.SetShaderParameter(VSP_MODEL, *instance.worldTransform_);
+                    commands.EndParameterGroup();
+                }
 
-                graphics->Draw(geometry_->GetPrimitiveType(), geometry_->GetIndexStart(), geometry_->GetIndexCount(),
-                    geometry_->GetVertexStart(), geometry_->GetVertexCount());
+                commands.Draw(geometry_);
             }
         }
         else
         {
-            Batch::Prepare(view, camera, false, allowDepthWrite);
-            Vector<VertexBuffer*> vertexBuffers;
-
-            // TODO: Тут вырезал какую-то оптимизацию, которая крэшилась
-
-            vertexBuffers.Resize(geometry_->GetVertexBuffers().Size());
-            for (int i = 0; i < geometry_->GetVertexBuffers().Size(); ++i)
-                vertexBuffers[i] = geometry_->GetVertexBuffers()[i].get();
-            vertexBuffers.Push(instanceBuffer);
-
-            graphics->SetIndexBuffer(geometry_->GetIndexBuffer().get());
-            graphics->SetVertexBuffers(vertexBuffers, startIndex_);
-            graphics->DrawInstanced(geometry_->GetPrimitiveType(), geometry_->GetIndexStart(), geometry_->GetIndexCount(),
-                geometry_->GetVertexStart(), geometry_->GetVertexCount(), instances_.Size());
+            Batch::Prepare(commands, camera, false);
+            commands.DrawInstanced(geometry_, instanceBuffer, startIndex_, instances_.Size());
         }
     }
 }
@@ -715,6 +652,8 @@ void BatchQueue::Clear(int maxSortedInstances)
     sortedBatches_.Clear();
     batchGroups_.Clear();
     maxSortedInstances_ = maxSortedInstances;
+    commands_.Clear();
+    recorded_ = false;
 }
 
 void BatchQueue::SortBackToFront()
@@ -724,7 +663,7 @@ void BatchQueue::SortBackToFront()
     for (i32 i = 0; i < batches_.Size(); ++i)
         sortedBatches_[i] = &batches_[i];
 
-    sort(sortedBatches_.Begin(), sortedBatches_.End(), CompareBatchesBackToFront);
+    SortBatches(sortedBatches_, BATCH_SORT_BACK_TO_FRONT);
 
     sortedBatchGroups_.Resize(batchGroups_.Size());
 
@@ -776,10 +715,10 @@ void BatchQueue::SortFrontToBack2Pass(Vector<Batch*>& batches)
     // Mobile devices likely use a tiled deferred approach, with which front-to-back sorting is irrelevant. The 2-pass
     // method is also time consuming, so just sort with state having priority
 #ifdef MOBILE_GRAPHICS
-    sort(batches.Begin(), batches.End(), CompareBatchesState);
+    SortBatches(batches, BATCH_SORT_STATE);
 #else
     // For desktop, first sort by distance and remap shader/material/geometry IDs in the sort key
-    sort(batches.Begin(), batches.End(), CompareBatchesFrontToBack);
+    SortBatches(batches, BATCH_SORT_FRONT_TO_BACK);
 
     hash32 freeShaderID = 0;
     hash16 freeMaterialID = 0;
@@ -827,10 +766,93 @@ void BatchQueue::SortFrontToBack2Pass(Vector<Batch*>& batches)
     geometryRemapping_.Clear();
 
     // Finally sort again with the rewritten ID's
-    sort(batches.Begin(), batches.End(), CompareBatchesState);
+    SortBatches(batches, BATCH_SORT_STATE);
 #endif
 }
 
+void BatchQueue::SortBatches(Vector<Batch*>& batches, BatchSortMode mode)
+{
+    i32 numBatches = batches.Size();
+
+    if (numBatches < MIN_RADIX_SORT_BATCHES)
+    {
+        switch (mode)
+        {
+        case BATCH_SORT_STATE:
+            sort(batches.Begin(), batches.End(), CompareBatchesState);
+            break;
+
+        case BATCH_SORT_FRONT_TO_BACK:
+            sort(batches.Begin(), batches.End(), CompareBatchesFrontToBack);
+            break;
+
+        case BATCH_SORT_BACK_TO_FRONT:
+            sort(batches.Begin(), batches.End(), CompareBatchesBackToFront);
+            break;
+        }
+
+        return;
+    }
+
+    radixSortItems_.Resize(numBatches);
+    radixSortTemp_.Resize(numBatches);
+    RadixSortItem* items = radixSortItems_.Buffer();
+    RadixSortItem* temp = radixSortTemp_.Buffer();
+    Batch** src = batches.Buffer();
+
+    // The keys do not fit into 64 bits together, so sort by the least significant key first and rely on
+    // the stability of the following passes. Keys are gathered in the order left by the previous pass
+    switch (mode)
+    {
+    case BATCH_SORT_STATE:
+        for (i32 i = 0; i < numBatches; ++i)
+            items[i] = {FloatToRadixKey(src[i]->distance_), i};
+        RadixSort(items, temp, numBatches, 4);
+
+        for (i32 i = 0; i < numBatches; ++i)
+            items[i].key_ = src[items[i].index_]->sortKey_;
+        RadixSort(items, temp, numBatches, 8);
+
+        for (i32 i = 0; i < numBatches; ++i)
+            items[i].key_ = GetRenderOrderRadixKey(src[items[i].index_]);
+        RadixSort(items, temp, numBatches, 1);
+        break;
+
+    case BATCH_SORT_FRONT_TO_BACK:
+        for (i32 i = 0; i < numBatches; ++i)
+            items[i] = {src[i]->sortKey_, i};
+        RadixSort(items, temp, numBatches, 8);
+
+        for (i32 i = 0; i < numBatches; ++i)
+        {
+            const Batch* batch = src[items[i].index_];
+            items[i].key_ = GetRenderOrderRadixKey(batch) << 32u | FloatToRadixKey(batch->distance_);
+        }
+        RadixSort(items, temp, numBatches, 5);
+        break;
+
+    case BATCH_SORT_BACK_TO_FRONT:
+        for (i32 i = 0; i < numBatches; ++i)
+            items[i] = {src[i]->sortKey_, i};
+        RadixSort(items, temp, numBatches, 8);
+
+        for (i32 i = 0; i < numBatches; ++i)
+        {
+            const Batch* batch = src[items[i].index_];
+            items[i].key_ = GetRenderOrderRadixKey(batch) << 32u | (u32)~FloatToRadixKey(batch->distance_);
+        }
+        RadixSort(items, temp, numBatches, 5);
+        break;
+    }
+
+    radixSortBatches_.Resize(numBatches);
+    Batch** unsorted = radixSortBatches_.Buffer();
+    memcpy(unsorted, src, sizeof(Batch*) * numBatches);
+
+    for (i32 i = 0; i < numBatches; ++i)
+        src[i] = unsorted[items[i].index_];
+}
+
 void BatchQueue::SetInstancingData(void* lockedData, i32 stride, i32& freeIndex)
 {
     assert(stride >= 0);
@@ -838,18 +860,23 @@ void BatchQueue::SetInstancingData(void* lockedData, i32 stride, i32& freeIndex)
         i->second_.SetInstancingData(lockedData, stride, freeIndex);
 }
 
-void BatchQueue::Draw(View* view, Camera* camera, bool markToStencil, bool usingLightOptimization, bool allowDepthWrite) const
+void BatchQueue::Record(Camera* camera, bool markToStencil, bool usingLightOptimization) const
 {
-    Graphics* graphics = DV_GRAPHICS;
+    commands_.Clear();
+    recorded_ = true;
+    recordedCamera_ = camera;
+    recordedReverseCulling_ = camera && camera->GetReverseCulling();
+    recordedMarkToStencil_ = markToStencil;
+    recordedLightOptimization_ = usingLightOptimization;
 
     // If View has set up its own light optimizations, do not disturb the stencil/scissor test settings
     if (!usingLightOptimization)
     {
-        graphics->SetScissorTest(false);
+        commands_.SetScissorTest(nullptr, camera);
 
         // During G-buffer rendering, mark opaque pixels' lightmask to stencil buffer if requested
         if (!markToStencil)
-            graphics->SetStencilTest(false);
+            commands_.SetStencilTest(false);
     }
 
     // Instanced
@@ -857,29 +884,39 @@ void BatchQueue::Draw(View* view, Camera* camera, bool markToStencil, bool using
     {
         BatchGroup* group = *i;
         if (markToStencil)
-            graphics->SetStencilTest(true, CMP_ALWAYS, OP_REF, OP_KEEP, OP_KEEP, group->lightMask_);
+            commands_.SetStencilTest(true, group->lightMask_);
 
-        group->Draw(view, camera, allowDepthWrite);
+        group->Record(commands_, camera);
     }
     // Non-instanced
     for (Vector<Batch*>::ConstIterator i = sortedBatches_.Begin(); i != sortedBatches_.End(); ++i)
     {
         Batch* batch = *i;
         if (markToStencil)
-            graphics->SetStencilTest(true, CMP_ALWAYS, OP_REF, OP_KEEP, OP_KEEP, batch->lightMask_);
+            commands_.SetStencilTest(true, batch->lightMask_);
         if (!usingLightOptimization)
         {
             // If drawing an alpha batch, we can optimize fillrate by scissor test
             if (!batch->isBase_ && batch->lightQueue_)
-                DV_RENDERER->OptimizeLightByScissor(batch->lightQueue_->light_, camera);
+                commands_.SetScissorTest(batch->lightQueue_->light_, camera);
             else
-                graphics->SetScissorTest(false);
+                commands_.SetScissorTest(nullptr, camera);
         }
 
-        batch->Draw(view, camera, allowDepthWrite);
+        batch->Record(commands_, camera);
     }
 }
 
+void BatchQueue::Draw(View* view, Camera* camera, bool markToStencil, bool usingLightOptimization, bool allowDepthWrite) const
+{
+    // The queue may have been recorded in advance by View, possibly for another view sharing the queue
+    if (!recorded_ || recordedCamera_ != camera || recordedReverseCulling_ != (camera && camera->GetReverseCulling()) ||
+        recordedMarkToStencil_ != markToStencil || recordedLightOptimization_ != usingLightOptimization)
+        Record(camera, markToStencil, usingLightOptimization);
+
+    commands_.Replay(view, allowDepthWrite);
+}
+
 i32 BatchQueue::GetNumInstances() const
 {
     i32 total = 0;
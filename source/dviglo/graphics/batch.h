@@ -5,6 +5,8 @@
 #pragma once
 
 #include "../containers/ptr.h"
+#include "../containers/radix_sort.h"
+#include "draw_command_buffer.h"
 #include "drawable.h"
 #include "material.h"
 #include "../math/math_defs.h"
@@ -51,9 +53,11 @@ struct Batch
 
     /// Calculate state sorting key, which consists of base pass flag, light, pass and geometry.
     void CalculateSortKey();
-    /// Prepare for rendering.
-    void Prepare(View* view, Camera* camera, bool setModelTransform, bool allowDepthWrite) const;
-    /// Prepare and draw.
+    /// Record render state, shaders, shader parameters and textures for rendering.
+    void Prepare(DrawCommandBuffer& commands, Camera* camera, bool setModelTransform) const;
+    /// Record preparing and drawing.
+    void Record(DrawCommandBuffer& commands, Camera* camera) const;
+    /// Prepare and draw immediately. Records into the view's scratch command buffer.
     void Draw(View* view, Camera* camera, bool allowDepthWrite) const;
 
     /// State sorting key.
@@ -147,8 +151,8 @@ struct BatchGroup : public Batch
 
     /// Pre-set the instance data. Buffer must be big enough to hold all data.
     void SetInstancingData(void* lockedData, i32 stride, i32& freeIndex);
-    /// Prepare and draw.
-    void Draw(View* view, Camera* camera, bool allowDepthWrite) const;
+    /// Record preparing and drawing.
+    void Record(DrawCommandBuffer& commands, Camera* camera) const;
 
     /// Instance data.
     Vector<InstanceData> instances_;
@@ -204,6 +208,17 @@ struct BatchGroupKey
     hash32 ToHash() const;
 };
 
+/// Order of batches in a batch queue.
+enum BatchSortMode
+{
+    /// Render order, then state, then distance.
+    BATCH_SORT_STATE = 0,
+    /// Render order, then increasing distance, then state.
+    BATCH_SORT_FRONT_TO_BACK,
+    /// Render order, then decreasing distance, then state.
+    BATCH_SORT_BACK_TO_FRONT
+};
+
 /// Queue that contains both instanced and non-instanced draw calls.
 struct BatchQueue
 {
@@ -216,9 +231,13 @@ public:
     void SortFrontToBack();
     /// Sort batches front to back while also maintaining state sorting.
     void SortFrontToBack2Pass(Vector<Batch*>& batches);
+    /// Sort batches. Large queues are radix sorted over contiguous key and index pairs.
+    void SortBatches(Vector<Batch*>& batches, BatchSortMode mode);
     /// Pre-set instance data of all groups. The vertex buffer must be big enough to hold all data.
     void SetInstancingData(void* lockedData, i32 stride, i32& freeIndex);
-    /// Draw.
+    /// Record draw commands. Can be called from a worker thread.
+    void Record(Camera* camera, bool markToStencil, bool usingLightOptimization) const;
+    /// Draw. Records the draw commands first unless already recorded with the same arguments.
     void Draw(View* view, Camera* camera, bool markToStencil, bool usingLightOptimization, bool allowDepthWrite) const;
     /// Return the combined amount of instances.
     i32 GetNumInstances() const;
@@ -235,6 +254,13 @@ public:
     /// Geometry remapping table for 2-pass state and distance sort.
     HashMap<hash16, hash16> geometryRemapping_;
 
+    /// Keys and batch indices for radix sort.
+    Vector<RadixSortItem> radixSortItems_;
+    /// Temporary buffer for radix sort.
+    Vector<RadixSortItem> radixSortTemp_;
+    /// Batches in unsorted order for radix sort.
+    Vector<Batch*> radixSortBatches_;
+
     /// Unsorted non-instanced draw calls.
     Vector<Batch> batches_;
     /// Sorted non-instanced draw calls.
@@ -253,6 +279,19 @@ public:
     StringHash vsExtraDefinesHash_;
     /// Hash for pixel shader extra defines.
     StringHash psExtraDefinesHash_;
+
+    /// Recorded draw commands.
+    mutable DrawCommandBuffer commands_;
+    /// Whether the draw commands have been recorded since the queue was cleared.
+    mutable bool recorded_{};
+    /// Camera of the recorded draw commands.
+    mutable Camera* recordedCamera_{};
+    /// Reverse culling of the camera when the draw commands were recorded.
+    mutable bool recordedReverseCulling_{};
+    /// Stencil marking mode of the recorded draw commands.
+    mutable bool recordedMarkToStencil_{};
+    /// Light optimization mode of the recorded draw commands.
+    mutable bool recordedLightOptimization_{};
 };
 
 /// Queue for shadow map draw calls.
@@ -264,6 +303,8 @@ struct ShadowBatchQueue
     IntRect shadowViewport_;
     /// Shadow caster draw calls.
     BatchQueue shadowBatches_;
+    /// Static shadow caster draw calls. Only filled when the light's cached shadow map must be rendered again.
+    BatchQueue staticShadowBatches_;
     /// Directional light cascade near split distance.
     float nearSplit_{};
     /// Directional light cascade far split distance.
@@ -279,6 +320,10 @@ struct LightBatchQueue
     bool negative_;
     /// Shadow map depth texture.
     Texture2D* shadowMap_;
+    /// Cached shadow map of the static shadow casters, copied to the shadow map before rendering the other casters.
+    Texture2D* staticShadowMap_;
+    /// Whether the static shadow casters must be rendered to the cached shadow map.
+    bool renderStaticShadowMap_;
     /// Lit geometry draw calls, base (replace blend mode).
     BatchQueue litBaseBatches_;
     /// Lit geometry draw calls, non-base (additive).
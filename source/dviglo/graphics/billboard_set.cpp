@@ -4,6 +4,8 @@
 
 #include "../core/context.h"
 #include "../core/profiler.h"
+#include "../core/thread.h"
+#include "../core/work_queue.h"
 #include "batch.h"
 #include "billboard_set.h"
 #include "camera.h"
@@ -17,6 +19,8 @@
 #include "../resource/resource_cache.h"
 #include "../scene/node.h"
 
+#include <emmintrin.h>
+
 #include "../common/debug_new.h"
 
 using namespace std;
@@ -52,9 +56,151 @@ static const StringVector billboardsStructureElementNames =
     "   Is Enabled"
 };
 
-inline bool CompareBillboards(Billboard* lhs, Billboard* rhs)
+static const i32 MIN_BILLBOARDS_PER_WORK_ITEM = 2048;
+
+/// Vertex expansion shared by the work items.
+struct BillboardVertexWork
+{
+    /// Billboards in drawing order.
+    Billboard* const* billboards_;
+    /// Locked vertex data.
+    float* dest_;
+    /// Billboard scale.
+    Vector3 scale_;
+    /// Fixed screen size flag.
+    bool fixedScreenSize_;
+    /// FC_DIRECTION vertex format flag.
+    bool direction_;
+};
+
+static void WriteBillboardVerticesWork(const WorkItem* item, i32 /*threadIndex*/)
 {
-    return lhs->sortDistance_ > rhs->sortDistance_;
+    const BillboardVertexWork* work = reinterpret_cast<const BillboardVertexWork*>(item->aux_);
+    Billboard* const* start = reinterpret_cast<Billboard* const*>(item->start_);
+    Billboard* const* end = reinterpret_cast<Billboard* const*>(item->end_);
+    i32 first = (i32)(start - work->billboards_);
+
+    if (work->direction_)
+        WriteDirectionBillboardVertices(work->dest_ + first * 44, start, (i32)(end - start), work->scale_, work->fixedScreenSize_);
+    else
+        WriteBillboardVertices(work->dest_ + first * 32, start, (i32)(end - start), work->scale_, work->fixedScreenSize_);
+}
+
+void WriteBillboardVertices(float* dest, Billboard* const* billboards, i32 count, const Vector3& scale, bool fixedScreenSize)
+{
+    // Corner signs of the rotated size components
+    const __m128 cornerSignsA = _mm_setr_ps(-1.f, 1.f, 1.f, -1.f);
+    const __m128 cornerSignsB = _mm_setr_ps(1.f, 1.f, -1.f, -1.f);
+    const __m128 cornerSignsC = _mm_setr_ps(1.f, -1.f, -1.f, 1.f);
+
+    for (i32 i = 0; i < count; ++i)
+    {
+        const Billboard& billboard = *billboards[i];
+
+        Vector2 size(billboard.size_.x * scale.x, billboard.size_.y * scale.y);
+        if (fixedScreenSize)
+            size *= billboard.screenScaleFactor_;
+
+        float sine = 0.f;
+        float cosine = 1.f;
+        if (billboard.rotation_ != 0.f)
+            SinCos(billboard.rotation_, sine, cosine);
+
+        // X offsets of corners 0..3 are -sc+ts, sc+ts, sc-ts, -sc-ts and Y offsets ss+tc, -ss+tc, -ss-tc, ss-tc
+        __m128 offsetX = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(size.x * cosine), cornerSignsA),
+            _mm_mul_ps(_mm_set1_ps(size.y * sine), cornerSignsB));
+        __m128 offsetY = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(size.x * sine), cornerSignsC),
+            _mm_mul_ps(_mm_set1_ps(size.y * cosine), cornerSignsB));
+        __m128 offsets01 = _mm_unpacklo_ps(offsetX, offsetY);
+        __m128 offsets23 = _mm_unpackhi_ps(offsetX, offsetY);
+
+        const Rect& uv = billboard.uv_;
+        __m128 uv01 = _mm_setr_ps(uv.min_.x, uv.min_.y, uv.max_.x, uv.min_.y);
+        __m128 uv23 = _mm_setr_ps(uv.max_.x, uv.max_.y, uv.min_.x, uv.max_.y);
+
+        __m128 positionColor = _mm_castsi128_ps(_mm_setr_epi32(bit_cast<i32>(billboard.position_.x),
+            bit_cast<i32>(billboard.position_.y), bit_cast<i32>(billboard.position_.z), (i32)billboard.color_.ToU32()));
+
+        _mm_storeu_ps(dest, positionColor);
+        _mm_storeu_ps(dest + 4, _mm_movelh_ps(uv01, offsets01));
+        _mm_storeu_ps(dest + 8, positionColor);
+        _mm_storeu_ps(dest + 12, _mm_movehl_ps(offsets01, uv01));
+        _mm_storeu_ps(dest + 16, positionColor);
+        _mm_storeu_ps(dest + 20, _mm_movelh_ps(uv23, offsets23));
+        _mm_storeu_ps(dest + 24, positionColor);
+        _mm_storeu_ps(dest + 28, _mm_movehl_ps(offsets23, uv23));
+
+        dest += 32;
+    }
+}
+
+void WriteDirectionBillboardVertices(float* dest, Billboard* const* billboards, i32 count, const Vector3& scale,
+    bool fixedScreenSize)
+{
+    for (i32 i = 0; i < count; ++i)
+    {
+        const Billboard& billboard = *billboards[i];
+
+        Vector2 size(billboard.size_.x * scale.x, billboard.size_.y * scale.y);
+        color32 color = billboard.color_.ToU32();
+        if (fixedScreenSize)
+            size *= billboard.screenScaleFactor_;
+
+        float rot2D[2][2];
+        SinCos(billboard.rotation_, rot2D[0][1], rot2D[0][0]);
+        rot2D[1][0] = -rot2D[0][1];
+        rot2D[1][1] = rot2D[0][0];
+
+        dest[0] = billboard.position_.x;
+        dest[1] = billboard.position_.y;
+        dest[2] = billboard.position_.z;
+        dest[3] = billboard.direction_.x;
+        dest[4] = billboard.direction_.y;
+        dest[5] = billboard.direction_.z;
+        ((color32&)dest[6]) = color;
+        dest[7] = billboard.uv_.min_.x;
+        dest[8] = billboard.uv_.min_.y;
+        dest[9] = -size.x * rot2D[0][0] + size.y * rot2D[0][1];
+        dest[10] = -size.x * rot2D[1][0] + size.y * rot2D[1][1];
+
+        dest[11] = billboard.position_.x;
+        dest[12] = billboard.position_.y;
+        dest[13] = billboard.position_.z;
+        dest[14] = billboard.direction_.x;
+        dest[15] = billboard.direction_.y;
+        dest[16] = billboard.direction_.z;
+        ((color32&)dest[17]) = color;
+        dest[18] = billboard.uv_.max_.x;
+        dest[19] = billboard.uv_.min_.y;
+        dest[20] = size.x * rot2D[0][0] + size.y * rot2D[0][1];
+        dest[21] = size.x * rot2D[1][0] + size.y * rot2D[1][1];
+
+        dest[22] = billboard.position_.x;
+        dest[23] = billboard.position_.y;
+        dest[24] = billboard.position_.z;
+        dest[25] = billboard.direction_.x;
+        dest[26] = billboard.direction_.y;
+        dest[27] = billboard.direction_.z;
+        ((color32&)dest[28]) = color;
+        dest[29] = billboard.uv_.max_.x;
+        dest[30] = billboard.uv_.max_.y;
+        dest[31] = size.x * rot2D[0][0] - size.y * rot2D[0][1];
+        dest[32] = size.x * rot2D[1][0] - size.y * rot2D[1][1];
+
+        dest[33] = billboard.position_.x;
+        dest[34] = billboard.position_.y;
+        dest[35] = billboard.position_.z;
+        dest[36] = billboard.direction_.x;
+        dest[37] = billboard.direction_.y;
+        dest[38] = billboard.direction_.z;
+        ((color32&)dest[39]) = color;
+        dest[40] = billboard.uv_.min_.x;
+        dest[41] = billboard.uv_.max_.y;
+        dest[42] = -size.x * rot2D[0][0] - size.y * rot2D[0][1];
+        dest[43] = -size.x * rot2D[1][0] - size.y * rot2D[1][1];
+
+        dest += 44;
+    }
 }
 
 BillboardSet::BillboardSet() :
@@ -67,6 +213,7 @@ BillboardSet::BillboardSet() :
     fixedScreenSize_(false),
     faceCameraMode_(FC_ROTATE_XYZ),
     minAngle_(0.0f),
+    sortThreshold_(0.0f),
     geometry_(new Geometry()),
     vertexBuffer_(make_shared<VertexBuffer>()),
     indexBuffer_(make_shared<IndexBuffer>()),
@@ -105,6 +252,7 @@ void BillboardSet::register_object()
     DV_ATTRIBUTE("Cast Shadows", castShadows_, false, AM_DEFAULT);
     DV_ENUM_ACCESSOR_ATTRIBUTE("Face Camera Mode", GetFaceCameraMode, SetFaceCameraMode, faceCameraModeNames, FC_ROTATE_XYZ, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("Min Angle", GetMinAngle, SetMinAngle, 0.0f, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Sort Threshold", GetSortThreshold, SetSortThreshold, 0.0f, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("Draw Distance", GetDrawDistance, SetDrawDistance, 0.0f, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("Shadow Distance", GetShadowDistance, SetShadowDistance, 0.0f, AM_DEFAULT);
     DV_ACCESSOR_ATTRIBUTE("Animation LOD Bias", GetAnimationLodBias, SetAnimationLodBias, 1.0f, AM_DEFAULT);
@@ -171,10 +319,11 @@ void BillboardSet::update_batches(const FrameInfo& frame)
 
     Vector3 worldPos = node_->GetWorldPosition();
     Vector3 offset = (worldPos - frame.camera_->GetNode()->GetWorldPosition());
-    // Sort if position relative to camera has changed
-    if (offset != previousOffset_ || frame.camera_->IsOrthographic() != hasOrthoCamera_)
+    // Sort if position relative to camera has changed more than the threshold
+    bool orthoChanged = frame.camera_->IsOrthographic() != hasOrthoCamera_;
+    if (offset != previousOffset_ || orthoChanged)
     {
-        if (sorted_)
+        if (sorted_ && ((offset - previousOffset_).LengthSquared() > sortThreshold_ * sortThreshold_ || orthoChanged))
             sortThisFrame_ = true;
         if (faceCameraMode_ == FC_DIRECTION)
             bufferDirty_ = true;
@@ -323,6 +472,12 @@ void BillboardSet::SetMinAngle(float angle)
     MarkNetworkUpdate();
 }
 
+void BillboardSet::SetSortThreshold(float distance)
+{
+    sortThreshold_ = Max(distance, 0.0f);
+    MarkNetworkUpdate();
+}
+
 void BillboardSet::SetAnimationLodBias(float bias)
 {
     animationLodBias_ = Max(bias, 0.0f);
@@ -599,17 +754,42 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
     }
 
     sortedBillboards_.Resize(enabledBillboards);
-    i32 index = 0;
+
+    // With a sort threshold, keep the previous order until the camera moves past the threshold or the enabled
+    // billboards change. A zero threshold sorts on every update, as the billboards may have moved
+    bool sortNow = false;
+    if (sorted_)
+    {
+        sortNow = sortThisFrame_ || sortThreshold_ <= 0.0f || sortItems_.Size() != enabledBillboards;
+        for (i32 i = 0; !sortNow && i < enabledBillboards; ++i)
+        {
+            i32 billboardIndex = sortItems_[i].index_;
+            sortNow = billboardIndex >= billboards_.Size() || !billboards_[billboardIndex].enabled_;
+        }
+
+        if (sortNow)
+        {
+            sortItems_.Resize(enabledBillboards);
+            sortTemp_.Resize(enabledBillboards);
+        }
+    }
 
     // Then set initial sort order and distances
-    for (Billboard& billboard : billboards_)
+    i32 index = 0;
+    for (i32 i = 0; i < billboards_.Size(); ++i)
     {
-        if (billboard.enabled_)
+        Billboard& billboard = billboards_[i];
+        if (!billboard.enabled_)
+            continue;
+
+        if (sortNow)
         {
-            sortedBillboards_[index++] = &billboard;
-            if (sorted_)
-                billboard.sortDistance_ = frame.camera_->GetDistanceSquared(billboardTransform * billboard.position_);
+            billboard.sortDistance_ = frame.camera_->GetDistanceSquared(billboardTransform * billboard.position_);
+            // Far to near
+            sortItems_[index].key_ = ~FloatToRadixKey(billboard.sortDistance_);
+            sortItems_[index].index_ = i;
         }
+        sortedBillboards_[index++] = &billboard;
     }
 
     batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, enabledBillboards * 6, false);
@@ -619,140 +799,50 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
     if (!enabledBillboards)
         return;
 
-    if (sorted_)
+    if (sortNow)
     {
-        sort(sortedBillboards_.Begin(), sortedBillboards_.End(), CompareBillboards);
+        RadixSort(&sortItems_[0], &sortTemp_[0], enabledBillboards, sizeof(u32));
+
         Vector3 worldPos = node_->GetWorldPosition();
         // Store the "last sorted position" now
         previousOffset_ = (worldPos - frame.camera_->GetNode()->GetWorldPosition());
     }
 
+    if (sorted_)
+    {
+        for (i32 i = 0; i < enabledBillboards; ++i)
+            sortedBillboards_[i] = &billboards_[sortItems_[i].index_];
+    }
+
     auto* dest = (float*)vertexBuffer_->Lock(0, enabledBillboards * 4, true);
     if (!dest)
         return;
 
-    if (faceCameraMode_ != FC_DIRECTION)
+    BillboardVertexWork work{&sortedBillboards_[0], dest, billboardScale, fixedScreenSize_, faceCameraMode_ == FC_DIRECTION};
+    WorkQueue* queue = DV_WORK_QUEUE;
+    i32 numItems = Min(enabledBillboards / MIN_BILLBOARDS_PER_WORK_ITEM, (queue->GetNumThreads() + 1) * 2);
+
+    // Expand the vertices in parallel for large billboard sets. The locked data is plain memory until unlocked. Fan out
+    // only from the main thread outside of another Complete(), as waiting for the queue from a work item could deadlock
+    if (numItems > 1 && Thread::IsMainThread() && !queue->IsCompleting())
     {
-        for (i32 i = 0; i < enabledBillboards; ++i)
+        for (i32 i = 0; i < numItems; ++i)
         {
-            Billboard& billboard = *sortedBillboards_[i];
-
-            Vector2 size(billboard.size_.x * billboardScale.x, billboard.size_.y * billboardScale.y);
-            color32 color = billboard.color_.ToU32();
-            if (fixedScreenSize_)
-                size *= billboard.screenScaleFactor_;
-
-            float rotationMatrix[2][2];
-            SinCos(billboard.rotation_, rotationMatrix[0][1], rotationMatrix[0][0]);
-            rotationMatrix[1][0] = -rotationMatrix[0][1];
-            rotationMatrix[1][1] = rotationMatrix[0][0];
-
-            dest[0] = billboard.position_.x;
-            dest[1] = billboard.position_.y;
-            dest[2] = billboard.position_.z;
-            ((color32&)dest[3]) = color;
-            dest[4] = billboard.uv_.min_.x;
-            dest[5] = billboard.uv_.min_.y;
-            dest[6] = -size.x * rotationMatrix[0][0] + size.y * rotationMatrix[0][1];
-            dest[7] = -size.x * rotationMatrix[1][0] + size.y * rotationMatrix[1][1];
-
-            dest[8] = billboard.position_.x;
-            dest[9] = billboard.position_.y;
-            dest[10] = billboard.position_.z;
-            ((color32&)dest[11]) = color;
-            dest[12] = billboard.uv_.max_.x;
-            dest[13] = billboard.uv_.min_.y;
-            dest[14] = size.x * rotationMatrix[0][0] + size.y * rotationMatrix[0][1];
-            dest[15] = size.x * rotationMatrix[1][0] + size.y * rotationMatrix[1][1];
-
-            dest[16] = billboard.position_.x;
-            dest[17] = billboard.position_.y;
-            dest[18] = billboard.position_.z;
-            ((color32&)dest[19]) = color;
-            dest[20] = billboard.uv_.max_.x;
-            dest[21] = billboard.uv_.max_.y;
-            dest[22] = size.x * rotationMatrix[0][0] - size.y * rotationMatrix[0][1];
-            dest[23] = size.x * rotationMatrix[1][0] - size.y * rotationMatrix[1][1];
-
-            dest[24] = billboard.position_.x;
-            dest[25] = billboard.position_.y;
-            dest[26] = billboard.position_.z;
-            ((color32&)dest[27]) = color;
-            dest[28] = billboard.uv_.min_.x;
-            dest[29] = billboard.uv_.max_.y;
-            dest[30] = -size.x * rotationMatrix[0][0] - size.y * rotationMatrix[0][1];
-            dest[31] = -size.x * rotationMatrix[1][0] - size.y * rotationMatrix[1][1];
-
-            dest += 32;
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = WI_MAX_PRIORITY;
+            item->workFunction_ = WriteBillboardVerticesWork;
+            item->aux_ = &work;
+            item->start_ = (void*)(work.billboards_ + (i64)i * enabledBillboards / numItems);
+            item->end_ = (void*)(work.billboards_ + (i64)(i + 1) * enabledBillboards / numItems);
+            queue->AddWorkItem(item);
         }
+
+        queue->Complete(WI_MAX_PRIORITY);
     }
+    else if (work.direction_)
+        WriteDirectionBillboardVertices(dest, work.billboards_, enabledBillboards, billboardScale, fixedScreenSize_);
     else
-    {
-        for (i32 i = 0; i < enabledBillboards; ++i)
-        {
-            Billboard& billboard = *sortedBillboards_[i];
-
-            Vector2 size(billboard.size_.x * billboardScale.x, billboard.size_.y * billboardScale.y);
-            color32 color = billboard.color_.ToU32();
-            if (fixedScreenSize_)
-                size *= billboard.screenScaleFactor_;
-
-            float rot2D[2][2];
-            SinCos(billboard.rotation_, rot2D[0][1], rot2D[0][0]);
-            rot2D[1][0] = -rot2D[0][1];
-            rot2D[1][1] = rot2D[0][0];
-
-            dest[0] = billboard.position_.x;
-            dest[1] = billboard.position_.y;
-            dest[2] = billboard.position_.z;
-            dest[3] = billboard.direction_.x;
-            dest[4] = billboard.direction_.y;
-            dest[5] = billboard.direction_.z;
-            ((color32&)dest[6]) = color;
-            dest[7] = billboard.uv_.min_.x;
-            dest[8] = billboard.uv_.min_.y;
-            dest[9] = -size.x * rot2D[0][0] + size.y * rot2D[0][1];
-            dest[10] = -size.x * rot2D[1][0] + size.y * rot2D[1][1];
-
-            dest[11] = billboard.position_.x;
-            dest[12] = billboard.position_.y;
-            dest[13] = billboard.position_.z;
-            dest[14] = billboard.direction_.x;
-            dest[15] = billboard.direction_.y;
-            dest[16] = billboard.direction_.z;
-            ((color32&)dest[17]) = color;
-            dest[18] = billboard.uv_.max_.x;
-            dest[19] = billboard.uv_.min_.y;
-            dest[20] = size.x * rot2D[0][0] + size.y * rot2D[0][1];
-            dest[21] = size.x * rot2D[1][0] + size.y * rot2D[1][1];
-
-            dest[22] = billboard.position_.x;
-            dest[23] = billboard.position_.y;
-            dest[24] = billboard.position_.z;
-            dest[25] = billboard.direction_.x;
-            dest[26] = billboard.direction_.y;
-            dest[27] = billboard.direction_.z;
-            ((color32&)dest[28]) = color;
-            dest[29] = billboard.uv_.max_.x;
-            dest[30] = billboard.uv_.max_.y;
-            dest[31] = size.x * rot2D[0][0] - size.y * rot2D[0][1];
-            dest[32] = size.x * rot2D[1][0] - size.y * rot2D[1][1];
-
-            dest[33] = billboard.position_.x;
-            dest[34] = billboard.position_.y;
-            dest[35] = billboard.position_.z;
-            dest[36] = billboard.direction_.x;
-            dest[37] = billboard.direction_.y;
-            dest[38] = billboard.direction_.z;
-            ((color32&)dest[39]) = color;
-            dest[40] = billboard.uv_.min_.x;
-            dest[41] = billboard.uv_.max_.y;
-            dest[42] = -size.x * rot2D[0][0] - size.y * rot2D[0][1];
-            dest[43] = -size.x * rot2D[1][0] - size.y * rot2D[1][1];
-
-            dest += 44;
-        }
-    }
+        WriteBillboardVertices(dest, work.billboards_, enabledBillboards, billboardScale, fixedScreenSize_);
 
     vertexBuffer_->Unlock();
     vertexBuffer_->ClearDataLost();
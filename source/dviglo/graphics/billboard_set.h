@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "../containers/radix_sort.h"
 #include "drawable.h"
 #include "../io/vector_buffer.h"
 #include "../math/color.h"
@@ -39,6 +40,13 @@ struct DV_API Billboard
     float screenScaleFactor_;
 };
 
+/// Write 4 vertices per billboard (position, color, UV, corner offset) using SSE. Dest must have room for count * 32 floats.
+DV_API void WriteBillboardVertices(float* dest, Billboard* const* billboards, i32 count, const Vector3& scale,
+    bool fixedScreenSize);
+/// Write 4 vertices per billboard for the FC_DIRECTION mode, which adds the direction. Dest must have room for count * 44 floats.
+DV_API void WriteDirectionBillboardVertices(float* dest, Billboard* const* billboards, i32 count, const Vector3& scale,
+    bool fixedScreenSize);
+
 /// %Billboard component.
 class DV_API BillboardSet : public Drawable
 {
@@ -79,6 +87,8 @@ public:
     void SetMinAngle(float angle);
     /// Set animation LOD bias.
     void SetAnimationLodBias(float bias);
+    /// Set how far the camera must move relative to the billboard set before sorted billboards are sorted again. Until then the previous order is kept, also when the billboards change without being enabled or disabled. Default 0: sort on every change and on any camera movement.
+    void SetSortThreshold(float distance);
     /// Mark for bounding box and vertex buffer update. Call after modifying the billboards.
     void Commit();
 
@@ -115,6 +125,9 @@ public:
     /// Return animation LOD bias.
     float GetAnimationLodBias() const { return animationLodBias_; }
 
+    /// Return camera movement that triggers sorting again.
+    float GetSortThreshold() const { return sortThreshold_; }
+
     /// Set material attribute.
     void SetMaterialAttr(const ResourceRef& value);
     /// Set billboards attribute.
@@ -152,6 +165,8 @@ protected:
     FaceCameraMode faceCameraMode_;
     /// Minimal angle between billboard normal and look-at direction.
     float minAngle_;
+    /// Camera movement that triggers sorting again.
+    float sortThreshold_;
 
 private:
     /// Resize billboard vertex and index buffers.
@@ -185,8 +200,12 @@ private:
     i32 sortFrameNumber_;
     /// Previous offset to camera for determining whether sorting is necessary.
     Vector3 previousOffset_;
-    /// Billboard pointers for sorting.
+    /// Billboard pointers in drawing order.
     Vector<Billboard*> sortedBillboards_;
+    /// Distance keys for sorting.
+    Vector<RadixSortItem> sortItems_;
+    /// Temporary buffer for sorting.
+    Vector<RadixSortItem> sortTemp_;
     /// Attribute buffer for network replication.
     mutable VectorBuffer attrBuffer_;
 };
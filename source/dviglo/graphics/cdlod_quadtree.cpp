@@ -0,0 +1,131 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "cdlod_quadtree.h"
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+static const i32 MAX_LEVELS = 16;
+
+void CdlodQuadtree::Define(const IntVector2& numVertices, i32 patchSize, const Vector3& spacing, float minHeight,
+    float maxHeight)
+{
+    numVertices_ = numVertices;
+    patchSize_ = patchSize;
+    spacing_ = spacing;
+    minHeight_ = minHeight;
+    maxHeight_ = maxHeight;
+    numLevels_ = 0;
+
+    if (numVertices.x < 2 || numVertices.y < 2 || patchSize < 1)
+    {
+        origin_ = Vector2::ZERO;
+        return;
+    }
+
+    // The root covers the whole heightmap
+    i32 numQuads = Max(numVertices.x, numVertices.y) - 1;
+    numLevels_ = 1;
+    while ((patchSize << (numLevels_ - 1)) < numQuads && numLevels_ < MAX_LEVELS)
+        ++numLevels_;
+
+    origin_ = Vector2(-0.5f * (float)(numVertices.x - 1) * spacing.x, -0.5f * (float)(numVertices.y - 1) * spacing.z);
+}
+
+void CdlodQuadtree::Select(const Vector3& viewPosition, float lodDistance, float viewDistance, Vector<CdlodNode>& dest) const
+{
+    if (numLevels_)
+        SelectNode(GetRoot(), viewPosition, lodDistance, viewDistance, dest);
+}
+
+void CdlodQuadtree::ResolveResident(const Vector<CdlodNode>& selected, const HashSet<u64>& resident,
+    Vector<CdlodNode>& dest) const
+{
+    HashSet<u64> drawn;
+    i32 start = dest.Size();
+
+    for (const CdlodNode& node : selected)
+    {
+        CdlodNode current = node;
+        while (!resident.Contains(current.GetKey()) && current.level_ < numLevels_ - 1)
+            current = current.GetParent();
+
+        if (resident.Contains(current.GetKey()) && !drawn.Contains(current.GetKey()))
+        {
+            drawn.Insert(current.GetKey());
+            dest.Push(current);
+        }
+    }
+
+    // A fallback ancestor covers its selected descendants that are resident
+    for (i32 i = start; i < dest.Size();)
+    {
+        bool covered = false;
+        for (CdlodNode ancestor = dest[i]; ancestor.level_ < numLevels_ - 1 && !covered;)
+        {
+            ancestor = ancestor.GetParent();
+            covered = drawn.Contains(ancestor.GetKey());
+        }
+
+        if (covered)
+            dest.Erase(i);
+        else
+            ++i;
+    }
+}
+
+bool CdlodQuadtree::IsValid(const CdlodNode& node) const
+{
+    if (node.level_ < 0 || node.level_ >= numLevels_ || node.coords_.x < 0 || node.coords_.y < 0)
+        return false;
+
+    IntVector2 origin = GetNodeOrigin(node);
+    return origin.x < numVertices_.x - 1 && origin.y < numVertices_.y - 1;
+}
+
+BoundingBox CdlodQuadtree::GetNodeBox(const CdlodNode& node) const
+{
+    IntVector2 start = GetNodeOrigin(node);
+    i32 size = patchSize_ << node.level_;
+    IntVector2 end(Min(start.x + size, numVertices_.x - 1), Min(start.y + size, numVertices_.y - 1));
+
+    return BoundingBox(
+        Vector3(origin_.x + (float)start.x * spacing_.x, minHeight_, origin_.y + (float)start.y * spacing_.z),
+        Vector3(origin_.x + (float)end.x * spacing_.x, maxHeight_, origin_.y + (float)end.y * spacing_.z));
+}
+
+float CdlodQuadtree::GetNodeDistance(const CdlodNode& node, const Vector3& position) const
+{
+    BoundingBox box = GetNodeBox(node);
+    Vector3 closest(Clamp(position.x, box.min_.x, box.max_.x), Clamp(position.y, box.min_.y, box.max_.y),
+        Clamp(position.z, box.min_.z, box.max_.z));
+    return (position - closest).Length();
+}
+
+void CdlodQuadtree::SelectNode(const CdlodNode& node, const Vector3& viewPosition, float lodDistance, float viewDistance,
+    Vector<CdlodNode>& dest) const
+{
+    float distance = GetNodeDistance(node, viewPosition);
+    if (viewDistance > 0.f && distance > viewDistance)
+        return;
+
+    if (!node.level_ || distance >= lodDistance * (float)(1 << (node.level_ - 1)))
+    {
+        dest.Push(node);
+        return;
+    }
+
+    for (i32 i = 0; i < 4; ++i)
+    {
+        CdlodNode child{node.level_ - 1, IntVector2(node.coords_.x * 2 + (i & 1), node.coords_.y * 2 + (i >> 1))};
+        if (IsValid(child))
+            SelectNode(child, viewPosition, lodDistance, viewDistance, dest);
+    }
+}
+
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/hash_set.h"
+#include "../containers/vector.h"
+#include "../math/bounding_box.h"
+#include "../math/vector2.h"
+
+namespace dviglo
+{
+
+/// Node of a CDLOD terrain quadtree.
+struct CdlodNode
+{
+    /// Return a key that identifies the node.
+    u64 GetKey() const { return (u64)level_ << 48u | (u64)(u32)coords_.x << 24u | (u64)(u32)coords_.y; }
+
+    /// Return the parent node.
+    CdlodNode GetParent() const { return CdlodNode{level_ + 1, IntVector2(coords_.x >> 1, coords_.y >> 1)}; }
+
+    /// Test for equality with another node.
+    bool operator ==(const CdlodNode& rhs) const { return level_ == rhs.level_ && coords_ == rhs.coords_; }
+
+    /// Test for inequality with another node.
+    bool operator !=(const CdlodNode& rhs) const { return !(*this == rhs); }
+
+    /// LOD level. 0 is the most detailed.
+    i32 level_;
+    /// Coordinates among the nodes of the same level. (0,0) is the southwest corner.
+    IntVector2 coords_;
+};
+
+/// Quadtree of a heightmap terrain for continuous distance-based LOD (CDLOD). Every node is drawn as a patch with the same number of vertices, so nodes of a coarser level cover a larger area with a larger vertex stride.
+class DV_API CdlodQuadtree
+{
+public:
+    /// Define for a heightmap. Patch size is the number of quads along the edge of a patch. The height range is used for the node bounding boxes.
+    void Define(const IntVector2& numVertices, i32 patchSize, const Vector3& spacing, float minHeight, float maxHeight);
+    /// Append the nodes to draw for a local-space view position. Nodes of level n are used up to a distance of LOD distance * 2^n. Nodes farther than the view distance are skipped, unless it is 0. The nodes cover the terrain without overlap.
+    void Select(const Vector3& viewPosition, float lodDistance, float viewDistance, Vector<CdlodNode>& dest) const;
+    /// Replace the selected nodes that are not resident with their closest resident ancestor. Nodes without a resident ancestor are dropped, as are nodes covered by an ancestor that is drawn instead.
+    void ResolveResident(const Vector<CdlodNode>& selected, const HashSet<u64>& resident, Vector<CdlodNode>& dest) const;
+
+    /// Return whether a node covers a part of the heightmap.
+    bool IsValid(const CdlodNode& node) const;
+    /// Return the local-space bounding box of a node.
+    BoundingBox GetNodeBox(const CdlodNode& node) const;
+    /// Return local-space distance from a point to the bounding box of a node.
+    float GetNodeDistance(const CdlodNode& node, const Vector3& position) const;
+
+    /// Return the heightmap coordinates of the first vertex of a node.
+    IntVector2 GetNodeOrigin(const CdlodNode& node) const { return node.coords_ * (patchSize_ << node.level_); }
+
+    /// Return the distance between the vertices of a node in heightmap pixels.
+    i32 GetNodeStride(const CdlodNode& node) const { return 1 << node.level_; }
+
+    /// Return the root node.
+    CdlodNode GetRoot() const { return CdlodNode{numLevels_ - 1, IntVector2::ZERO}; }
+
+    /// Return number of levels. 0 if not defined.
+    i32 GetNumLevels() const { return numLevels_; }
+
+    /// Return heightmap size.
+    const IntVector2& GetNumVertices() const { return numVertices_; }
+
+    /// Return patch size.
+    i32 GetPatchSize() const { return patchSize_; }
+
+    /// Return local-space position of the first heightmap vertex. The terrain is centered on the origin.
+    const Vector2& GetOrigin() const { return origin_; }
+
+private:
+    /// Select a node or its children.
+    void SelectNode(const CdlodNode& node, const Vector3& viewPosition, float lodDistance, float viewDistance,
+        Vector<CdlodNode>& dest) const;
+
+    /// Heightmap size.
+    IntVector2 numVertices_{IntVector2::ZERO};
+    /// Number of quads along the edge of a patch.
+    i32 patchSize_{};
+    /// Number of levels.
+    i32 numLevels_{};
+    /// Vertex spacing.
+    Vector3 spacing_{Vector3::ONE};
+    /// Local-space position of the first heightmap vertex.
+    Vector2 origin_{Vector2::ZERO};
+    /// Minimum height.
+    float minHeight_{};
+    /// Maximum height.
+    float maxHeight_{};
+};
+
+}
@@ -0,0 +1,876 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "cdlod_terrain.h"
+
+#include "../core/context.h"
+#include "../core/profiler.h"
+#include "../core/work_queue.h"
+#include "camera.h"
+#include "geometry.h"
+#include "material.h"
+#include "renderer.h"
+#include "terrain_patch.h"
+#include "viewport.h"
+#include "../graphics_api/index_buffer.h"
+#include "../graphics_api/vertex_buffer.h"
+#include "../io/file.h"
+#include "../io/log.h"
+#include "../resource/resource_cache.h"
+#include "../scene/node.h"
+#include "../scene/scene.h"
+#include "../scene/scene_events.h"
+
+#include <algorithm>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+extern const char* GEOMETRY_CATEGORY;
+
+static const Vector3 DEFAULT_SPACING(1.0f, 0.25f, 1.0f);
+static const i32 DEFAULT_PATCH_SIZE = 32;
+static const i32 MIN_PATCH_SIZE = 4;
+static const i32 MAX_PATCH_SIZE = 128;
+static const float DEFAULT_LOD_DISTANCE = 64.0f;
+static const float DEFAULT_VIEW_DISTANCE = 2000.0f;
+static const i32 DEFAULT_MAX_PATCHES = 512;
+static const i32 MAX_BUILD_JOBS = 16;
+/// Position, normal, texture coordinate and tangent.
+static const i32 PATCH_VERTEX_FLOATS = 12;
+static const VertexElements PATCH_VERTEX_ELEMENTS = VertexElements::Position | VertexElements::Normal
+    | VertexElements::TexCoord1 | VertexElements::Tangent;
+
+/// Patch build inputs and results. Owns copies of the inputs so that the worker does not access the terrain.
+struct CdlodBuildJob
+{
+    /// Quadtree node.
+    CdlodNode node_;
+    /// Full path of the heightmap file.
+    String fileName_;
+    /// Heightmap size in pixels.
+    IntVector2 numVertices_;
+    /// Heightmap coordinates of the first vertex.
+    IntVector2 origin_;
+    /// Distance between vertices in heightmap pixels.
+    i32 stride_;
+    /// Patch quads per side.
+    i32 patchSize_;
+    /// Vertex and height spacing.
+    Vector3 spacing_;
+    /// Interleaved vertex data.
+    Vector<float> vertexData_;
+    /// Vertex positions for raycasts.
+    shared_ptr<byte[]> positionData_;
+    /// Vertex heights for height queries.
+    Vector<float> heights_;
+    /// Local-space bounding box.
+    BoundingBox box_;
+    /// Whether the heightmap could be read.
+    bool success_{};
+    /// Work item.
+    SharedPtr<WorkItem> item_;
+};
+
+/// Read the heights of the patch vertices with a border of one vertex. Coordinates outside the heightmap are clamped to the edges.
+static bool ReadHeights(const CdlodBuildJob& job, Vector<float>& dest)
+{
+    File file(job.fileName_);
+    if (!file.IsOpen())
+        return false;
+
+    const IntVector2& size = job.numVertices_;
+    i32 border = job.patchSize_ + 3;
+    i32 minX = Max(job.origin_.x - job.stride_, 0);
+    i32 maxX = Min(job.origin_.x + (job.patchSize_ + 1) * job.stride_, size.x - 1);
+    float scale = job.spacing_.y / 256.0f;
+    Vector<u16> row(maxX - minX + 1);
+    dest.Resize(border * border);
+
+    for (i32 j = 0; j < border; ++j)
+    {
+        // North row is first in the file
+        i32 z = Clamp(job.origin_.y + (j - 1) * job.stride_, 0, size.y - 1);
+        i64 offset = ((i64)(size.y - 1 - z) * size.x + minX) * (i64)sizeof(u16);
+        i32 bytes = row.Size() * (i32)sizeof(u16);
+        if (file.Seek(offset) != offset || file.Read(row.Buffer(), bytes) != bytes)
+            return false;
+
+        for (i32 i = 0; i < border; ++i)
+        {
+            i32 x = Clamp(job.origin_.x + (i - 1) * job.stride_, 0, size.x - 1);
+            dest[j * border + i] = (float)row[x - minX] * scale;
+        }
+    }
+
+    return true;
+}
+
+/// Write one vertex of a patch.
+static void WriteVertex(float*& dest, const Vector3& position, const Vector3& normal, const Vector2& texCoord)
+{
+    *dest++ = position.x;
+    *dest++ = position.y;
+    *dest++ = position.z;
+    *dest++ = normal.x;
+    *dest++ = normal.y;
+    *dest++ = normal.z;
+    *dest++ = texCoord.x;
+    *dest++ = texCoord.y;
+
+    Vector3 xyz = (Vector3::RIGHT - normal * normal.DotProduct(Vector3::RIGHT)).normalized();
+    *dest++ = xyz.x;
+    *dest++ = xyz.y;
+    *dest++ = xyz.z;
+    *dest++ = 1.0f;
+}
+
+static void BuildPatchWork(const WorkItem* item, i32 /*threadIndex*/)
+{
+    CdlodBuildJob& job = *reinterpret_cast<CdlodBuildJob*>(item->aux_);
+
+    Vector<float> grid;
+    job.success_ = ReadHeights(job, grid);
+    if (!job.success_)
+        return;
+
+    i32 row = job.patchSize_ + 1;
+    i32 border = job.patchSize_ + 3;
+    i32 numGridVertices = row * row;
+    i32 numVertices = numGridVertices + 4 * row;
+    const Vector3& spacing = job.spacing_;
+    const IntVector2& size = job.numVertices_;
+    float up = 0.5f * (spacing.x + spacing.z) * (float)job.stride_;
+
+    job.vertexData_.Resize(numVertices * PATCH_VERTEX_FLOATS);
+    job.positionData_ = make_shared<byte[]>(numVertices * sizeof(Vector3));
+    job.heights_.Resize(numGridVertices);
+    float* vertexData = job.vertexData_.Buffer();
+    float edgeMin = M_INFINITY;
+    float edgeMax = -M_INFINITY;
+
+    for (i32 z = 0; z <= job.patchSize_; ++z)
+    {
+        for (i32 x = 0; x <= job.patchSize_; ++x)
+        {
+            // Vertices past the heightmap edge collapse onto it
+            i32 xPos = Min(job.origin_.x + x * job.stride_, size.x - 1);
+            i32 zPos = Min(job.origin_.y + z * job.stride_, size.y - 1);
+            const float* center = &grid[(z + 1) * border + x + 1];
+            float baseHeight = *center;
+
+            // Same slope-based normal as Terrain, with the vertex stride of the level
+            float nSlope = center[-border] - baseHeight;
+            float neSlope = center[-border + 1] - baseHeight;
+            float eSlope = center[1] - baseHeight;
+            float seSlope = center[border + 1] - baseHeight;
+            float sSlope = center[border] - baseHeight;
+            float swSlope = center[border - 1] - baseHeight;
+            float wSlope = center[-1] - baseHeight;
+            float nwSlope = center[-border - 1] - baseHeight;
+            Vector3 normal = (Vector3(0.0f, up, nSlope) +
+                Vector3(-neSlope, up, neSlope) +
+                Vector3(-eSlope, up, 0.0f) +
+                Vector3(-seSlope, up, -seSlope) +
+                Vector3(0.0f, up, -sSlope) +
+                Vector3(swSlope, up, -swSlope) +
+                Vector3(wSlope, up, 0.0f) +
+                Vector3(nwSlope, up, nwSlope)).normalized();
+
+            Vector3 position((float)(xPos - job.origin_.x) * spacing.x, baseHeight, (float)(zPos - job.origin_.y) * spacing.z);
+            Vector2 texCoord((float)xPos / (float)(size.x - 1), 1.0f - (float)zPos / (float)(size.y - 1));
+            WriteVertex(vertexData, position, normal, texCoord);
+
+            job.heights_[z * row + x] = baseHeight;
+            job.box_.Merge(position);
+
+            if (!x || !z || x == job.patchSize_ || z == job.patchSize_)
+            {
+                edgeMin = Min(edgeMin, baseHeight);
+                edgeMax = Max(edgeMax, baseHeight);
+            }
+        }
+    }
+
+    /* Skirts hang down from the south, north, west and east edges. The gap to a coarser neighbor is an interpolation
+       between heights on the shared edge, so it can not be larger than the height range of the edge */
+    float skirtDepth = edgeMax - edgeMin + up;
+    const float* gridData = job.vertexData_.Buffer();
+    for (i32 edge = 0; edge < 4; ++edge)
+    {
+        for (i32 i = 0; i < row; ++i)
+        {
+            i32 source;
+            if (edge == 0)
+                source = i;
+            else if (edge == 1)
+                source = job.patchSize_ * row + i;
+            else if (edge == 2)
+                source = i * row;
+            else
+                source = i * row + job.patchSize_;
+
+            const float* src = gridData + source * PATCH_VERTEX_FLOATS;
+            Vector3 position(src[0], src[1] - skirtDepth, src[2]);
+            WriteVertex(vertexData, position, Vector3(src[3], src[4], src[5]), Vector2(src[6], src[7]));
+            job.box_.Merge(position);
+        }
+    }
+
+    auto* positions = (float*)job.positionData_.get();
+    for (i32 i = 0; i < numVertices; ++i)
+    {
+        const float* src = gridData + i * PATCH_VERTEX_FLOATS;
+        *positions++ = src[0];
+        *positions++ = src[1];
+        *positions++ = src[2];
+    }
+}
+
+CdlodTerrain::CdlodTerrain() :
+    indexBuffer_(make_shared<IndexBuffer>()),
+    heightMapSize_(IntVector2::ZERO),
+    spacing_(DEFAULT_SPACING),
+    patchSize_(DEFAULT_PATCH_SIZE),
+    lodDistance_(DEFAULT_LOD_DISTANCE),
+    viewDistance_(DEFAULT_VIEW_DISTANCE),
+    maxPatches_(DEFAULT_MAX_PATCHES),
+    updateCount_(0),
+    viewMask_(DEFAULT_VIEWMASK),
+    lightMask_(DEFAULT_LIGHTMASK),
+    shadowMask_(DEFAULT_SHADOWMASK),
+    zoneMask_(DEFAULT_ZONEMASK),
+    castShadows_(false),
+    recreateTerrain_(false),
+    subscribed_(false)
+{
+    indexBuffer_->SetShadowed(true);
+}
+
+CdlodTerrain::~CdlodTerrain()
+{
+    CancelBuildJobs();
+}
+
+void CdlodTerrain::register_object()
+{
+    DV_CONTEXT->RegisterFactory<CdlodTerrain>(GEOMETRY_CATEGORY);
+
+    DV_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, true, AM_DEFAULT);
+    DV_ATTRIBUTE_EX("Height Map File", heightMapFile_, MarkTerrainDirty, String::EMPTY, AM_DEFAULT);
+    DV_ATTRIBUTE_EX("Height Map Size", heightMapSize_, MarkTerrainDirty, IntVector2::ZERO, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Material", GetMaterialAttr, SetMaterialAttr, ResourceRef(Material::GetTypeStatic()),
+        AM_DEFAULT);
+    DV_ATTRIBUTE_EX("Vertex Spacing", spacing_, MarkTerrainDirty, DEFAULT_SPACING, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Patch Size", GetPatchSize, SetPatchSizeAttr, DEFAULT_PATCH_SIZE, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("LOD Distance", GetLodDistance, SetLodDistance, DEFAULT_LOD_DISTANCE, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("View Distance", GetViewDistance, SetViewDistance, DEFAULT_VIEW_DISTANCE, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Max Patches", GetMaxPatches, SetMaxPatches, DEFAULT_MAX_PATCHES, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Cast Shadows", GetCastShadows, SetCastShadows, false, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("View Mask", GetViewMask, SetViewMask, DEFAULT_VIEWMASK, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Light Mask", GetLightMask, SetLightMask, DEFAULT_LIGHTMASK, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Shadow Mask", GetShadowMask, SetShadowMask, DEFAULT_SHADOWMASK, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Zone Mask", GetZoneMask, SetZoneMask, DEFAULT_ZONEMASK, AM_DEFAULT);
+}
+
+void CdlodTerrain::apply_attributes()
+{
+    if (recreateTerrain_)
+        CreateQuadtree();
+}
+
+void CdlodTerrain::OnSetEnabled()
+{
+    // Patches are enabled again by the next update
+    if (!IsEnabledEffective())
+    {
+        for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+        {
+            if (i->second_.patch_)
+                i->second_.patch_->SetEnabled(false);
+        }
+    }
+
+    UpdateEventSubscription();
+}
+
+void CdlodTerrain::SetHeightMapFile(const String& fileName, const IntVector2& size)
+{
+    heightMapFile_ = fileName;
+    heightMapSize_ = size;
+    CreateQuadtree();
+
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetSpacing(const Vector3& spacing)
+{
+    if (spacing != spacing_)
+    {
+        spacing_ = spacing;
+        CreateQuadtree();
+
+        MarkNetworkUpdate();
+    }
+}
+
+void CdlodTerrain::SetPatchSize(i32 size)
+{
+    if (size < MIN_PATCH_SIZE || size > MAX_PATCH_SIZE || !IsPowerOfTwo((u32)size))
+        return;
+
+    if (size != patchSize_)
+    {
+        patchSize_ = size;
+        CreateQuadtree();
+
+        MarkNetworkUpdate();
+    }
+}
+
+void CdlodTerrain::SetLodDistance(float distance)
+{
+    lodDistance_ = Max(distance, 0.0f);
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetViewDistance(float distance)
+{
+    viewDistance_ = Max(distance, 0.0f);
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetMaxPatches(i32 num)
+{
+    maxPatches_ = Max(num, 1);
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetLodCamera(Camera* camera)
+{
+    lodCamera_ = camera;
+}
+
+void CdlodTerrain::SetMaterial(Material* material)
+{
+    material_ = material;
+
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+    {
+        if (i->second_.patch_)
+            i->second_.patch_->SetMaterial(material);
+    }
+
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetViewMask(unsigned mask)
+{
+    viewMask_ = mask;
+
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+    {
+        if (i->second_.patch_)
+            i->second_.patch_->SetViewMask(mask);
+    }
+
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetLightMask(unsigned mask)
+{
+    lightMask_ = mask;
+
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+    {
+        if (i->second_.patch_)
+            i->second_.patch_->SetLightMask(mask);
+    }
+
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetShadowMask(unsigned mask)
+{
+    shadowMask_ = mask;
+
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+    {
+        if (i->second_.patch_)
+            i->second_.patch_->SetShadowMask(mask);
+    }
+
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetZoneMask(unsigned mask)
+{
+    zoneMask_ = mask;
+
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+    {
+        if (i->second_.patch_)
+            i->second_.patch_->SetZoneMask(mask);
+    }
+
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::SetCastShadows(bool enable)
+{
+    castShadows_ = enable;
+
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+    {
+        if (i->second_.patch_)
+            i->second_.patch_->SetCastShadows(enable);
+    }
+
+    MarkNetworkUpdate();
+}
+
+void CdlodTerrain::UpdatePatches()
+{
+    if (!node_ || !quadtree_.GetNumLevels() || heightMapPath_.Empty())
+        return;
+
+    DV_PROFILE(UpdateCdlodTerrain);
+
+    ++updateCount_;
+    CommitBuildJobs();
+
+    // Rebuild the patches whose GPU data was lost
+    for (HashMap<u64, CdlodResidentPatch>::Iterator i = patches_.Begin(); i != patches_.End();)
+    {
+        TerrainPatch* patch = i->second_.patch_;
+        if (!patch || patch->GetVertexBuffer()->IsDataLost())
+        {
+            if (patch)
+                node_->RemoveChild(patch->GetNode());
+            i = patches_.Erase(i);
+        }
+        else
+            ++i;
+    }
+
+    Camera* camera = GetLodCamera();
+    if (!camera || !camera->GetNode())
+        return;
+
+    Vector3 viewPosition = node_->GetWorldTransform().Inverse() * camera->GetNode()->GetWorldPosition();
+    selected_.Clear();
+    quadtree_.Select(viewPosition, lodDistance_, viewDistance_, selected_);
+
+    HashSet<u64> resident;
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+        resident.Insert(i->first_);
+
+    Vector<CdlodNode> requests;
+    HashSet<u64> requested;
+    for (const CdlodNode& node : selected_)
+    {
+        u64 key = node.GetKey();
+        if (resident.Contains(key))
+        {
+            patches_[key].lastUsed_ = updateCount_;
+            continue;
+        }
+
+        // Request the node and its ancestors up to the closest resident one, which is drawn until they are built
+        for (CdlodNode current = node;;)
+        {
+            key = current.GetKey();
+            if (resident.Contains(key) || requested.Contains(key))
+                break;
+
+            requested.Insert(key);
+            if (!runningJobs_.Contains(key))
+                requests.Push(current);
+
+            if (current.level_ >= quadtree_.GetNumLevels() - 1)
+                break;
+            current = current.GetParent();
+        }
+    }
+
+    // Build coarse patches first, so that the detailed patches have something to fall back to while they stream in
+    sort(requests.Begin(), requests.End(), [this, &viewPosition](const CdlodNode& lhs, const CdlodNode& rhs)
+    {
+        if (lhs.level_ != rhs.level_)
+            return lhs.level_ > rhs.level_;
+        return quadtree_.GetNodeDistance(lhs, viewPosition) < quadtree_.GetNodeDistance(rhs, viewPosition);
+    });
+
+    for (i32 i = 0; i < requests.Size() && runningJobs_.Size() < MAX_BUILD_JOBS; ++i)
+        StartBuildJob(requests[i]);
+
+    drawn_.Clear();
+    quadtree_.ResolveResident(selected_, resident, drawn_);
+
+    HashSet<u64> drawnKeys;
+    for (const CdlodNode& node : drawn_)
+    {
+        drawnKeys.Insert(node.GetKey());
+        patches_[node.GetKey()].lastUsed_ = updateCount_;
+    }
+
+    bool enabled = IsEnabledEffective();
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+        i->second_.patch_->SetEnabled(enabled && drawnKeys.Contains(i->first_));
+
+    // Release the least recently used patches. The patches in use are never released, and as they are limited by the view
+    // distance, so is the memory use
+    if (patches_.Size() > maxPatches_)
+    {
+        Vector<Pair<i32, u64>> unused;
+        for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+        {
+            if (i->second_.lastUsed_ != updateCount_)
+                unused.Push(MakePair(i->second_.lastUsed_, i->first_));
+        }
+
+        sort(unused.Begin(), unused.End());
+
+        for (i32 i = 0; i < unused.Size() && patches_.Size() > maxPatches_; ++i)
+        {
+            HashMap<u64, CdlodResidentPatch>::Iterator patch = patches_.Find(unused[i].second_);
+            node_->RemoveChild(patch->second_.patch_->GetNode());
+            patches_.Erase(patch);
+        }
+    }
+}
+
+Camera* CdlodTerrain::GetLodCamera() const
+{
+    if (lodCamera_)
+        return lodCamera_;
+
+    Renderer* renderer = DV_RENDERER;
+    Viewport* viewport = renderer ? renderer->GetViewportForScene(GetScene(), 0) : nullptr;
+    return viewport ? viewport->GetCamera() : nullptr;
+}
+
+Material* CdlodTerrain::GetMaterial() const
+{
+    return material_;
+}
+
+float CdlodTerrain::GetHeight(const Vector3& worldPosition) const
+{
+    if (!node_ || !quadtree_.GetNumLevels())
+        return 0.0f;
+
+    Vector3 position = node_->GetWorldTransform().Inverse() * worldPosition;
+    const Vector2& origin = quadtree_.GetOrigin();
+    const IntVector2& numVertices = quadtree_.GetNumVertices();
+    float xPos = Clamp((position.x - origin.x) / spacing_.x, 0.0f, (float)(numVertices.x - 1));
+    float zPos = Clamp((position.z - origin.y) / spacing_.z, 0.0f, (float)(numVertices.y - 1));
+
+    for (i32 level = 0; level < quadtree_.GetNumLevels(); ++level)
+    {
+        i32 nodeSize = patchSize_ << level;
+        CdlodNode node{level, IntVector2(Min((i32)xPos / nodeSize, (numVertices.x - 2) / nodeSize),
+            Min((i32)zPos / nodeSize, (numVertices.y - 2) / nodeSize))};
+        HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Find(node.GetKey());
+        if (i == patches_.End())
+            continue;
+
+        // Interpolate the triangle of the patch geometry
+        IntVector2 start = quadtree_.GetNodeOrigin(node);
+        float stride = (float)quadtree_.GetNodeStride(node);
+        float x = (xPos - (float)start.x) / stride;
+        float z = (zPos - (float)start.y) / stride;
+        i32 x0 = Min((i32)x, patchSize_ - 1);
+        i32 z0 = Min((i32)z, patchSize_ - 1);
+        float xFrac = x - (float)x0;
+        float zFrac = z - (float)z0;
+        const Vector<float>& heights = i->second_.heights_;
+        i32 row = patchSize_ + 1;
+        float h1, h2, h3;
+
+        if (xFrac + zFrac >= 1.0f)
+        {
+            h1 = heights[(z0 + 1) * row + x0 + 1];
+            h2 = heights[(z0 + 1) * row + x0];
+            h3 = heights[z0 * row + x0 + 1];
+            xFrac = 1.0f - xFrac;
+            zFrac = 1.0f - zFrac;
+        }
+        else
+        {
+            h1 = heights[z0 * row + x0];
+            h2 = heights[z0 * row + x0 + 1];
+            h3 = heights[(z0 + 1) * row + x0];
+        }
+
+        float h = h1 * (1.0f - xFrac - zFrac) + h2 * xFrac + h3 * zFrac;
+        /// \todo This assumes that the terrain scene node is upright
+        return node_->GetWorldScale().y * h + node_->GetWorldPosition().y;
+    }
+
+    return 0.0f;
+}
+
+void CdlodTerrain::SetPatchSizeAttr(i32 value)
+{
+    if (value < MIN_PATCH_SIZE || value > MAX_PATCH_SIZE || !IsPowerOfTwo((u32)value))
+        return;
+
+    if (value != patchSize_)
+    {
+        patchSize_ = value;
+        recreateTerrain_ = true;
+    }
+}
+
+void CdlodTerrain::SetMaterialAttr(const ResourceRef& value)
+{
+    SetMaterial(DV_RES_CACHE->GetResource<Material>(value.name_));
+}
+
+ResourceRef CdlodTerrain::GetMaterialAttr() const
+{
+    return GetResourceRef(material_, Material::GetTypeStatic());
+}
+
+void CdlodTerrain::OnSceneSet(Scene* scene)
+{
+    if (!scene)
+    {
+        CancelBuildJobs();
+        subscribed_ = false;
+        unsubscribe_from_event(E_SCENEPOSTUPDATE);
+    }
+    else
+        UpdateEventSubscription();
+}
+
+void CdlodTerrain::CreateQuadtree()
+{
+    recreateTerrain_ = false;
+
+    CancelBuildJobs();
+    RemoveAllPatches();
+    selected_.Clear();
+    drawn_.Clear();
+    heightMapPath_.Clear();
+
+    if (!heightMapFile_.Empty())
+    {
+        heightMapPath_ = DV_RES_CACHE->GetResourceFileName(heightMapFile_);
+        if (heightMapPath_.Empty())
+            DV_LOGERROR("Could not find terrain heightmap file " + heightMapFile_);
+    }
+
+    // Heights are 16-bit, so the node bounding boxes can use the whole range without reading the heightmap
+    quadtree_.Define(heightMapPath_.Empty() ? IntVector2::ZERO : heightMapSize_, patchSize_, spacing_, 0.0f,
+        65535.0f / 256.0f * spacing_.y);
+
+    if (quadtree_.GetNumLevels())
+        CreateIndexData();
+}
+
+void CdlodTerrain::CreateIndexData()
+{
+    DV_PROFILE(CreateIndexData);
+
+    Vector<u16> indices;
+    i32 row = patchSize_ + 1;
+    i32 skirtStart = row * row;
+
+    for (i32 z = 0; z < patchSize_; ++z)
+    {
+        for (i32 x = 0; x < patchSize_; ++x)
+        {
+            indices.Push((u16)((z + 1) * row + x));
+            indices.Push((u16)(z * row + x + 1));
+            indices.Push((u16)(z * row + x));
+            indices.Push((u16)((z + 1) * row + x));
+            indices.Push((u16)((z + 1) * row + x + 1));
+            indices.Push((u16)(z * row + x + 1));
+        }
+    }
+
+    // Skirts face outward: south, north, west and east
+    for (i32 i = 0; i < patchSize_; ++i)
+    {
+        u16 south = (u16)i;
+        u16 southSkirt = (u16)(skirtStart + i);
+        indices.Push(south);
+        indices.Push((u16)(south + 1));
+        indices.Push(southSkirt);
+        indices.Push((u16)(south + 1));
+        indices.Push((u16)(southSkirt + 1));
+        indices.Push(southSkirt);
+
+        u16 north = (u16)(patchSize_ * row + i);
+        u16 northSkirt = (u16)(skirtStart + row + i);
+        indices.Push(north);
+        indices.Push(northSkirt);
+        indices.Push((u16)(north + 1));
+        indices.Push((u16)(north + 1));
+        indices.Push(northSkirt);
+        indices.Push((u16)(northSkirt + 1));
+
+        u16 west = (u16)(i * row);
+        u16 westSkirt = (u16)(skirtStart + 2 * row + i);
+        indices.Push(west);
+        indices.Push(westSkirt);
+        indices.Push((u16)(west + row));
+        indices.Push((u16)(west + row));
+        indices.Push(westSkirt);
+        indices.Push((u16)(westSkirt + 1));
+
+        u16 east = (u16)(i * row + patchSize_);
+        u16 eastSkirt = (u16)(skirtStart + 3 * row + i);
+        indices.Push(east);
+        indices.Push((u16)(east + row));
+        indices.Push(eastSkirt);
+        indices.Push((u16)(east + row));
+        indices.Push((u16)(eastSkirt + 1));
+        indices.Push(eastSkirt);
+    }
+
+    indexBuffer_->SetSize(indices.Size(), false);
+    indexBuffer_->SetData(&indices[0]);
+}
+
+void CdlodTerrain::StartBuildJob(const CdlodNode& node)
+{
+    shared_ptr<CdlodBuildJob> job = make_shared<CdlodBuildJob>();
+    job->node_ = node;
+    job->fileName_ = heightMapPath_;
+    job->numVertices_ = quadtree_.GetNumVertices();
+    job->origin_ = quadtree_.GetNodeOrigin(node);
+    job->stride_ = quadtree_.GetNodeStride(node);
+    job->patchSize_ = patchSize_;
+    job->spacing_ = spacing_;
+
+    // Not taken from the pool, so that the work queue does not reuse the item before the job is committed
+    job->item_ = new WorkItem();
+    job->item_->priority_ = 0;
+    job->item_->workFunction_ = BuildPatchWork;
+    job->item_->aux_ = job.get();
+    DV_WORK_QUEUE->AddWorkItem(job->item_);
+
+    runningJobs_[node.GetKey()] = job;
+}
+
+void CdlodTerrain::CommitBuildJobs()
+{
+    for (HashMap<u64, shared_ptr<CdlodBuildJob>>::Iterator i = runningJobs_.Begin(); i != runningJobs_.End();)
+    {
+        CdlodBuildJob& job = *i->second_;
+        if (!job.item_->completed_)
+        {
+            ++i;
+            continue;
+        }
+
+        if (!job.success_)
+        {
+            // Stop streaming instead of retrying every frame
+            DV_LOGERROR("Could not read terrain heightmap file " + heightMapPath_);
+            heightMapPath_.Clear();
+            i = runningJobs_.Erase(i);
+            continue;
+        }
+
+        const CdlodNode& node = job.node_;
+        const Vector2& origin = quadtree_.GetOrigin();
+        String nodeName = "Patch_" + String(node.level_) + "_" + String(node.coords_.x) + "_" + String(node.coords_.y);
+
+        // Create the patch scene node as local and temporary so that it is not unnecessarily serialized to either
+        // file or replicated over the network
+        Node* patchNode = node_->CreateTemporaryChild(nodeName, LOCAL);
+        patchNode->SetPosition(Vector3(origin.x + (float)job.origin_.x * spacing_.x, 0.0f,
+            origin.y + (float)job.origin_.y * spacing_.z));
+
+        auto* patch = patchNode->create_component<TerrainPatch>();
+        ApplyPatchSettings(patch);
+
+        VertexBuffer* vertexBuffer = patch->GetVertexBuffer().get();
+        vertexBuffer->SetSize(job.vertexData_.Size() / PATCH_VERTEX_FLOATS, PATCH_VERTEX_ELEMENTS);
+        vertexBuffer->SetData(job.vertexData_.Buffer());
+
+        for (Geometry* geometry : {patch->GetGeometry(), patch->GetMaxLodGeometry(), patch->GetOcclusionGeometry()})
+        {
+            geometry->SetIndexBuffer(indexBuffer_);
+            geometry->SetDrawRange(TRIANGLE_LIST, 0, indexBuffer_->GetIndexCount(), false);
+            geometry->SetRawVertexData(job.positionData_, VertexElements::Position);
+        }
+
+        patch->SetBoundingBox(job.box_);
+
+        CdlodResidentPatch& resident = patches_[node.GetKey()];
+        resident.node_ = node;
+        resident.patch_ = patch;
+        resident.heights_ = std::move(job.heights_);
+        resident.lastUsed_ = updateCount_;
+
+        i = runningJobs_.Erase(i);
+    }
+}
+
+void CdlodTerrain::CancelBuildJobs()
+{
+    // Jobs that worker threads have already taken are waited for
+    for (HashMap<u64, shared_ptr<CdlodBuildJob>>::ConstIterator i = runningJobs_.Begin(); i != runningJobs_.End(); ++i)
+        DV_WORK_QUEUE->CancelWorkItem(i->second_->item_);
+
+    runningJobs_.Clear();
+}
+
+void CdlodTerrain::RemoveAllPatches()
+{
+    for (HashMap<u64, CdlodResidentPatch>::ConstIterator i = patches_.Begin(); i != patches_.End(); ++i)
+    {
+        if (i->second_.patch_ && node_)
+            node_->RemoveChild(i->second_.patch_->GetNode());
+    }
+
+    patches_.Clear();
+}
+
+void CdlodTerrain::ApplyPatchSettings(TerrainPatch* patch) const
+{
+    // Drawn patches are enabled by the update
+    patch->SetEnabled(false);
+    patch->SetMaterial(material_);
+    patch->SetViewMask(viewMask_);
+    patch->SetLightMask(lightMask_);
+    patch->SetShadowMask(shadowMask_);
+    patch->SetZoneMask(zoneMask_);
+    patch->SetCastShadows(castShadows_);
+}
+
+void CdlodTerrain::UpdateEventSubscription()
+{
+    Scene* scene = GetScene();
+    if (!scene)
+        return;
+
+    bool enabled = IsEnabledEffective();
+
+    if (enabled && !subscribed_)
+    {
+        subscribe_to_event(scene, E_SCENEPOSTUPDATE, DV_HANDLER(CdlodTerrain, HandleScenePostUpdate));
+        subscribed_ = true;
+    }
+    else if (!enabled && subscribed_)
+    {
+        unsubscribe_from_event(scene, E_SCENEPOSTUPDATE);
+        subscribed_ = false;
+    }
+}
+
+void CdlodTerrain::HandleScenePostUpdate(StringHash /*eventType*/, VariantMap& /*eventData*/)
+{
+    UpdatePatches();
+}
+
+}
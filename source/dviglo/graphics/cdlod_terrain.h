@@ -0,0 +1,220 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "cdlod_quadtree.h"
+#include "../containers/hash_map.h"
+#include "../scene/component.h"
+
+#include <memory>
+
+namespace dviglo
+{
+
+class Camera;
+class IndexBuffer;
+class Material;
+class TerrainPatch;
+struct CdlodBuildJob;
+
+/// Resident patch of a CDLOD terrain.
+struct CdlodResidentPatch
+{
+    /// Quadtree node.
+    CdlodNode node_;
+    /// Patch component.
+    WeakPtr<TerrainPatch> patch_;
+    /// Vertex heights for height queries.
+    Vector<float> heights_;
+    /// Number of the last update that selected or drew the patch.
+    i32 lastUsed_;
+};
+
+/// Heightmap terrain component for very large heightmaps. Patches of a quadtree are streamed from a raw heightmap file and built in worker threads as the LOD camera moves, so that only the patches within the view distance are kept in memory. Nodes of coarser levels are used farther away (CDLOD), and patch edges have skirts to hide the cracks between levels.
+class DV_API CdlodTerrain : public Component
+{
+    DV_OBJECT(CdlodTerrain);
+
+public:
+    /// Construct.
+    explicit CdlodTerrain();
+    /// Destruct.
+    ~CdlodTerrain() override;
+    /// Register object factory.
+    static void register_object();
+
+    /// Apply attribute changes that can not be applied immediately. Called after scene load or a network update.
+    void apply_attributes() override;
+    /// Handle enabled/disabled state change.
+    void OnSetEnabled() override;
+
+    /// Set heightmap file and its size in pixels. The file contains little-endian 16-bit heights row by row, north row first, and is found from the resource directories. A height of 256 equals one unit of height spacing.
+    void SetHeightMapFile(const String& fileName, const IntVector2& size);
+    /// Set vertex (XZ) and height (Y) spacing.
+    void SetSpacing(const Vector3& spacing);
+    /// Set patch quads per side. Must be a power of two.
+    void SetPatchSize(i32 size);
+    /// Set distance up to which the most detailed patches are used. Each coarser level doubles the distance.
+    void SetLodDistance(float distance);
+    /// Set distance beyond which patches are not streamed in. 0 is unlimited.
+    void SetViewDistance(float distance);
+    /// Set number of resident patches above which the least recently used patches are released.
+    void SetMaxPatches(i32 num);
+    /// Set camera used for LOD selection. By default the camera of the first viewport that shows the scene.
+    void SetLodCamera(Camera* camera);
+    /// Set material.
+    void SetMaterial(Material* material);
+    /// Set view mask for patches. Is and'ed with camera's view mask to see if the object should be rendered.
+    void SetViewMask(unsigned mask);
+    /// Set light mask for patches. Is and'ed with light's and zone's light mask to see if the object should be lit.
+    void SetLightMask(unsigned mask);
+    /// Set shadow mask for patches. Is and'ed with light's light mask and zone's shadow mask to see if the object should be rendered to a shadow map.
+    void SetShadowMask(unsigned mask);
+    /// Set zone mask for patches. Is and'ed with zone's zone mask to see if the object should belong to the zone.
+    void SetZoneMask(unsigned mask);
+    /// Set shadowcaster flag for patches.
+    void SetCastShadows(bool enable);
+    /// Select, stream and release patches for the LOD camera. Called automatically after the scene update.
+    void UpdatePatches();
+
+    /// Return heightmap file name.
+    const String& GetHeightMapFile() const { return heightMapFile_; }
+
+    /// Return heightmap size in pixels.
+    const IntVector2& GetHeightMapSize() const { return heightMapSize_; }
+
+    /// Return vertex and height spacing.
+    const Vector3& GetSpacing() const { return spacing_; }
+
+    /// Return patch quads per side.
+    i32 GetPatchSize() const { return patchSize_; }
+
+    /// Return LOD distance.
+    float GetLodDistance() const { return lodDistance_; }
+
+    /// Return view distance.
+    float GetViewDistance() const { return viewDistance_; }
+
+    /// Return number of resident patches above which patches are released.
+    i32 GetMaxPatches() const { return maxPatches_; }
+
+    /// Return LOD camera.
+    Camera* GetLodCamera() const;
+    /// Return material.
+    Material* GetMaterial() const;
+
+    /// Return quadtree.
+    const CdlodQuadtree& GetQuadtree() const { return quadtree_; }
+
+    /// Return number of resident patches.
+    i32 GetNumPatches() const { return patches_.Size(); }
+
+    /// Return number of patches being built.
+    i32 GetNumPendingPatches() const { return runningJobs_.Size(); }
+
+    /// Return number of patches drawn.
+    i32 GetNumDrawnPatches() const { return drawn_.Size(); }
+
+    /// Return view mask.
+    unsigned GetViewMask() const { return viewMask_; }
+
+    /// Return light mask.
+    unsigned GetLightMask() const { return lightMask_; }
+
+    /// Return shadow mask.
+    unsigned GetShadowMask() const { return shadowMask_; }
+
+    /// Return zone mask.
+    unsigned GetZoneMask() const { return zoneMask_; }
+
+    /// Return shadowcaster flag.
+    bool GetCastShadows() const { return castShadows_; }
+
+    /// Return height at world coordinates from the most detailed resident patch. Return 0 if no patch is resident there.
+    float GetHeight(const Vector3& worldPosition) const;
+
+    /// Set patch size attribute.
+    void SetPatchSizeAttr(i32 value);
+    /// Set material attribute.
+    void SetMaterialAttr(const ResourceRef& value);
+    /// Return material attribute.
+    ResourceRef GetMaterialAttr() const;
+
+protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Scene* scene) override;
+
+private:
+    /// Release all patches and define the quadtree for the current heightmap.
+    void CreateQuadtree();
+    /// Create the index data shared by all patches.
+    void CreateIndexData();
+    /// Start building the patch of a node in a worker thread.
+    void StartBuildJob(const CdlodNode& node);
+    /// Create patches from the finished build jobs.
+    void CommitBuildJobs();
+    /// Wait for the running build jobs and drop them.
+    void CancelBuildJobs();
+    /// Release all patches.
+    void RemoveAllPatches();
+    /// Copy drawable parameters to a patch.
+    void ApplyPatchSettings(TerrainPatch* patch) const;
+    /// Subscribe/unsubscribe from scene post-update as necessary.
+    void UpdateEventSubscription();
+    /// Handle scene post-update event.
+    void HandleScenePostUpdate(StringHash eventType, VariantMap& eventData);
+    /// Mark terrain dirty.
+    void MarkTerrainDirty() { recreateTerrain_ = true; }
+
+    /// Quadtree.
+    CdlodQuadtree quadtree_;
+    /// Resident patches by node key.
+    HashMap<u64, CdlodResidentPatch> patches_;
+    /// Patch build jobs in worker threads by node key.
+    HashMap<u64, std::shared_ptr<CdlodBuildJob>> runningJobs_;
+    /// Nodes selected during the last update.
+    Vector<CdlodNode> selected_;
+    /// Nodes drawn during the last update.
+    Vector<CdlodNode> drawn_;
+    /// Shared index buffer.
+    std::shared_ptr<IndexBuffer> indexBuffer_;
+    /// Material.
+    SharedPtr<Material> material_;
+    /// LOD camera.
+    WeakPtr<Camera> lodCamera_;
+    /// Heightmap file name.
+    String heightMapFile_;
+    /// Full path of the heightmap file.
+    String heightMapPath_;
+    /// Heightmap size in pixels.
+    IntVector2 heightMapSize_;
+    /// Vertex and height spacing.
+    Vector3 spacing_;
+    /// Patch quads per side.
+    i32 patchSize_;
+    /// LOD distance.
+    float lodDistance_;
+    /// View distance.
+    float viewDistance_;
+    /// Number of resident patches above which patches are released.
+    i32 maxPatches_;
+    /// Number of updates.
+    i32 updateCount_;
+    /// View mask.
+    unsigned viewMask_;
+    /// Light mask.
+    unsigned lightMask_;
+    /// Shadow mask.
+    unsigned shadowMask_;
+    /// Zone mask.
+    unsigned zoneMask_;
+    /// Shadowcaster flag.
+    bool castShadows_;
+    /// Terrain needs recreation flag.
+    bool recreateTerrain_;
+    /// Subscribed to scene post update event flag.
+    bool subscribed_;
+};
+
+}
@@ -0,0 +1,380 @@
+// Copyright (c) 2008-2023 the Urho3D project
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "decal_geometry.h"
+#include "geometry.h"
+#include "tangent.h"
+#include "../graphics_api/index_buffer.h"
+#include "../graphics_api/vertex_buffer.h"
+
+#include <algorithm>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+static DecalVertex ClipEdge(const DecalVertex& v0, const DecalVertex& v1, float d0, float d1, bool skinned)
+{
+    DecalVertex ret;
+    float t = d0 / (d0 - d1);
+
+    ret.position_ = v0.position_ + t * (v1.position_ - v0.position_);
+    ret.normal_ = v0.normal_ + t * (v1.normal_ - v0.normal_);
+    if (skinned)
+    {
+        if (*((unsigned*)v0.blendIndices_) != *((unsigned*)v1.blendIndices_))
+        {
+            // Blend weights and indices: if indices are different, choose the vertex nearer to the split plane
+            const DecalVertex& src = Abs(d0) < Abs(d1) ? v0 : v1;
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                ret.blendWeights_[i] = src.blendWeights_[i];
+                ret.blendIndices_[i] = src.blendIndices_[i];
+            }
+        }
+        else
+        {
+            // If indices are same, can interpolate the weights
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                ret.blendWeights_[i] = v0.blendWeights_[i] + t * (v1.blendWeights_[i] - v0.blendWeights_[i]);
+                ret.blendIndices_[i] = v0.blendIndices_[i];
+            }
+        }
+    }
+
+    return ret;
+}
+
+static void ClipPolygon(Vector<DecalVertex>& dest, const Vector<DecalVertex>& src, const Plane& plane, bool skinned)
+{
+    unsigned last = 0;
+    float lastDistance = 0.0f;
+    dest.Clear();
+
+    if (src.Empty())
+        return;
+
+    for (i32 i = 0; i < src.Size(); ++i)
+    {
+        float distance = plane.Distance(src[i].position_);
+        if (distance >= 0.0f)
+        {
+            if (lastDistance < 0.0f)
+                dest.Push(ClipEdge(src[last], src[i], lastDistance, distance, skinned));
+
+            dest.Push(src[i]);
+        }
+        else
+        {
+            if (lastDistance >= 0.0f && i != 0)
+                dest.Push(ClipEdge(src[last], src[i], lastDistance, distance, skinned));
+        }
+
+        last = i;
+        lastDistance = distance;
+    }
+
+    // Recheck the distances of the last and first vertices and add the final clipped vertex if applicable
+    float distance = plane.Distance(src[0].position_);
+    if ((lastDistance < 0.0f && distance >= 0.0f) || (lastDistance >= 0.0f && distance < 0.0f))
+        dest.Push(ClipEdge(src[last], src[0], lastDistance, distance, skinned));
+}
+
+void DecalGeometrySource::Define(Geometry* geometry)
+{
+    *this = DecalGeometrySource();
+    indexStart_ = geometry->GetIndexStart();
+    indexCount_ = geometry->GetIndexCount();
+    vertexStart_ = geometry->GetVertexStart();
+    vertexCount_ = geometry->GetVertexCount();
+
+    IndexBuffer* ib = geometry->GetIndexBuffer().get();
+    if (ib)
+    {
+        indexData_ = ib->GetShadowData();
+        indexStride_ = ib->GetIndexSize();
+    }
+
+    // For morphed models positions, normals and skinning may be in different buffers
+    for (i32 i = 0; i < geometry->GetNumVertexBuffers(); ++i)
+    {
+        VertexBuffer* vb = geometry->GetVertexBuffer(i).get();
+        if (!vb)
+            continue;
+
+        VertexElements elementMask = vb->GetElementMask();
+        byte* data = vb->GetShadowData();
+        if (!data)
+            continue;
+
+        if (!!(elementMask & VertexElements::Position))
+        {
+            positionData_ = data;
+            positionStride_ = vb->GetVertexSize();
+        }
+        if (!!(elementMask & VertexElements::Normal))
+        {
+            normalData_ = data + vb->GetElementOffset(SEM_NORMAL);
+            normalStride_ = vb->GetVertexSize();
+        }
+        if (!!(elementMask & VertexElements::BlendWeights))
+        {
+            skinningData_ = data + vb->GetElementOffset(SEM_BLENDWEIGHTS);
+            skinningStride_ = vb->GetVertexSize();
+        }
+    }
+
+    // Positions and indices are needed
+    if (!positionData_)
+    {
+        // As a fallback, try to get the geometry's raw vertex/index data
+        const Vector<VertexElement>* elements;
+        geometry->GetRawData(positionData_, positionStride_, indexData_, indexStride_, elements);
+    }
+}
+
+static void ClipFaces(Decal& decal, Vector<Vector<DecalVertex>>& faces, const Frustum& frustum, bool skinned)
+{
+    Vector<DecalVertex> tempFace;
+
+    // Clip the acquired faces against all frustum planes
+    for (const auto& plane : frustum.planes_)
+    {
+        for (i32 j = 0; j < faces.Size(); ++j)
+        {
+            Vector<DecalVertex>& face = faces[j];
+            if (face.Empty())
+                continue;
+
+            ClipPolygon(tempFace, face, plane, skinned);
+            face = tempFace;
+        }
+    }
+
+    // Now triangulate the resulting faces into decal vertices
+    for (i32 i = 0; i < faces.Size(); ++i)
+    {
+        Vector<DecalVertex>& face = faces[i];
+        if (face.Size() < 3)
+            continue;
+
+        for (i32 j = 2; j < face.Size(); ++j)
+        {
+            decal.AddVertex(face[0]);
+            decal.AddVertex(face[j - 1]);
+            decal.AddVertex(face[j]);
+        }
+    }
+}
+
+static void CalculateUVs(Decal& decal, const Matrix3x4& view, const Matrix4& projection, const Vector2& topLeftUV,
+    const Vector2& bottomRightUV)
+{
+    Matrix4 viewProj = projection * view;
+
+    for (Vector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+    {
+        Vector3 projected = viewProj * i->position_;
+        i->texCoord_ = Vector2(
+            Lerp(topLeftUV.x, bottomRightUV.x, projected.x * 0.5f + 0.5f),
+            Lerp(bottomRightUV.y, topLeftUV.y, projected.y * 0.5f + 0.5f)
+        );
+    }
+}
+
+static void TransformVertices(Decal& decal, const Matrix3x4& transform)
+{
+    for (Vector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+    {
+        i->position_ = transform * i->position_;
+        i->normal_ = (transform * Vector4(i->normal_, 0.0f)).normalized();
+    }
+}
+
+bool DecalGeometryData::Define(const DecalGeometrySource& source)
+{
+    if (!source.positionData_)
+        return false;
+
+    source_ = source;
+
+    if (source.indexData_)
+    {
+        indices_.Resize(source.indexCount_ / 3 * 3);
+        for (i32 i = 0; i < indices_.Size(); ++i)
+        {
+            indices_[i] = source.indexStride_ == sizeof(unsigned short) ?
+                ((const unsigned short*)source.indexData_)[source.indexStart_ + i] : ((const unsigned*)source.indexData_)[source.indexStart_ + i];
+        }
+    }
+    else
+    {
+        // Non-indexed geometry
+        indices_.Resize(source.vertexCount_ / 3 * 3);
+        for (i32 i = 0; i < indices_.Size(); ++i)
+            indices_[i] = source.vertexStart_ + i;
+    }
+
+    if (indices_.Empty())
+        return true;
+
+    // Copy only the range of vertices the triangles use, the vertex buffer may be shared by other geometries
+    u32 minIndex = M_MAX_UNSIGNED;
+    u32 maxIndex = 0;
+    for (u32 index : indices_)
+    {
+        minIndex = Min(minIndex, index);
+        maxIndex = Max(maxIndex, index);
+    }
+
+    i32 numVertices = maxIndex - minIndex + 1;
+    positions_.Resize(numVertices);
+    for (i32 i = 0; i < numVertices; ++i)
+        positions_[i] = *((const Vector3*)(&source.positionData_[(minIndex + i) * source.positionStride_]));
+
+    if (source.normalData_)
+    {
+        normals_.Resize(numVertices);
+        for (i32 i = 0; i < numVertices; ++i)
+            normals_[i] = *((const Vector3*)(&source.normalData_[(minIndex + i) * source.normalStride_]));
+    }
+
+    for (u32& index : indices_)
+        index -= minIndex;
+
+    return true;
+}
+
+void DecalGeometryData::GetFaces(Vector<Vector<DecalVertex>>& faces, const Frustum& frustum, const Vector3& decalNormal,
+    float normalCutoff)
+{
+    i32 numTriangles = indices_.Size() / 3;
+
+    {
+        lock_guard<mutex> lock(bvhMutex_);
+        if (!bvhBuilt_)
+        {
+            Vector<BoundingBox> boxes(numTriangles);
+            for (i32 i = 0; i < numTriangles; ++i)
+            {
+                boxes[i].Define(positions_[indices_[i * 3]]);
+                boxes[i].Merge(positions_[indices_[i * 3 + 1]]);
+                boxes[i].Merge(positions_[indices_[i * 3 + 2]]);
+            }
+
+            triangleBvh_.Build(boxes.Buffer(), numTriangles);
+            bvhBuilt_ = true;
+        }
+    }
+
+    Vector<i32> triangles;
+    triangleBvh_.Cull(frustum, triangles);
+    // Keep the order of the geometry so that the decal does not depend on the hierarchy
+    sort(triangles.Begin(), triangles.End());
+
+    bool hasNormals = !normals_.Empty();
+
+    for (i32 triangle : triangles)
+    {
+        u32 i0 = indices_[triangle * 3];
+        u32 i1 = indices_[triangle * 3 + 1];
+        u32 i2 = indices_[triangle * 3 + 2];
+        const Vector3& v0 = positions_[i0];
+        const Vector3& v1 = positions_[i1];
+        const Vector3& v2 = positions_[i2];
+
+        // Calculate unsmoothed face normals if no normal data
+        Vector3 faceNormal = Vector3::ZERO;
+        if (!hasNormals)
+            faceNormal = ((v1 - v0).CrossProduct(v2 - v0)).normalized();
+
+        const Vector3& n0 = hasNormals ? normals_[i0] : faceNormal;
+        const Vector3& n1 = hasNormals ? normals_[i1] : faceNormal;
+        const Vector3& n2 = hasNormals ? normals_[i2] : faceNormal;
+
+        // Check if face is too much away from the decal normal
+        if (decalNormal.DotProduct((n0 + n1 + n2) / 3.0f) < normalCutoff)
+            continue;
+
+        // Check if face is culled completely by any of the planes
+        bool culled = false;
+        for (i32 i = PLANE_FAR; i >= 0 && !culled; --i)
+        {
+            const Plane& plane = frustum.planes_[i];
+            culled = plane.Distance(v0) < 0.0f && plane.Distance(v1) < 0.0f && plane.Distance(v2) < 0.0f;
+        }
+
+        if (culled)
+            continue;
+
+        faces.Resize(faces.Size() + 1);
+        Vector<DecalVertex>& face = faces.Back();
+        face.Reserve(3);
+        face.Push(DecalVertex(v0, n0));
+        face.Push(DecalVertex(v1, n1));
+        face.Push(DecalVertex(v2, n2));
+    }
+}
+
+void DecalRequest::Define(const Matrix3x4& targetTransform, const Vector3& worldPosition, const Quaternion& worldRotation,
+    float size, float aspectRatio, float depth)
+{
+    // Center the decal frustum on the world position
+    Vector3 adjustedWorldPosition = worldPosition - 0.5f * depth * (worldRotation * Vector3::FORWARD);
+
+    // Build the decal frustum
+    Matrix3x4 frustumTransform = targetTransform * Matrix3x4(adjustedWorldPosition, worldRotation, 1.0f);
+    frustum_.define_ortho(size, aspectRatio, 1.0, 0.0f, depth, frustumTransform);
+    decalNormal_ = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).normalized();
+
+    // Projection for the UVs
+    view_ = frustumTransform.Inverse();
+    projection_ = Matrix4::ZERO;
+    projection_.m11_ = (1.0f / (size * 0.5f));
+    projection_.m00_ = projection_.m11_ / aspectRatio;
+    projection_.m22_ = 1.0f / depth;
+    projection_.m33_ = 1.0f;
+}
+
+void ClipDecal(Decal& decal, Vector<Vector<DecalVertex>>& faces, const DecalRequest& request, bool skinned)
+{
+    decal.timeToLive_ = request.timeToLive_;
+    ClipFaces(decal, faces, request.frustum_, skinned);
+    if (decal.vertices_.Empty())
+        return;
+
+    CalculateUVs(decal, request.view_, request.projection_, request.topLeftUV_, request.bottomRightUV_);
+
+    // Transform vertices to the decal set's local space and generate tangents
+    TransformVertices(decal, request.transform_);
+    GenerateTangents(&decal.vertices_[0], sizeof(DecalVertex), &decal.indices_[0], sizeof(unsigned short), 0,
+        decal.indices_.Size(), offsetof(DecalVertex, normal_), offsetof(DecalVertex, texCoord_), offsetof(DecalVertex,
+        tangent_));
+
+    decal.CalculateBoundingBox();
+}
+
+void ClipDecal(Decal& decal, const DecalRequest& request)
+{
+    Vector<Vector<DecalVertex>> faces;
+    for (const shared_ptr<DecalGeometryData>& data : request.geometries_)
+        data->GetFaces(faces, request.frustum_, request.decalNormal_, request.normalCutoff_);
+
+    ClipDecal(decal, faces, request, false);
+}
+
+void ClipDecalsWork(const WorkItem* item, i32 threadIndex)
+{
+    auto* job = reinterpret_cast<DecalClipJob*>(item->aux_);
+
+    job->results_.Resize(job->requests_.Size());
+    for (i32 i = 0; i < job->requests_.Size(); ++i)
+        ClipDecal(job->results_[i], job->requests_[i]);
+}
+
+}
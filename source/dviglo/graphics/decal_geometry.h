@@ -0,0 +1,139 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../core/work_queue.h"
+#include "decal_set.h"
+#include "instance_bvh.h"
+
+#include <memory>
+#include <mutex>
+
+namespace dviglo
+{
+
+class Geometry;
+
+/// Vertex and index data of a decal target geometry.
+struct DV_API DecalGeometrySource
+{
+    /// Collect the CPU-side data and draw range of a geometry.
+    void Define(Geometry* geometry);
+
+    /// Test for equality with another source.
+    bool operator ==(const DecalGeometrySource& rhs) const
+    {
+        return positionData_ == rhs.positionData_ && normalData_ == rhs.normalData_ &&
+            skinningData_ == rhs.skinningData_ && indexData_ == rhs.indexData_ &&
+            positionStride_ == rhs.positionStride_ && normalStride_ == rhs.normalStride_ &&
+            skinningStride_ == rhs.skinningStride_ && indexStride_ == rhs.indexStride_ &&
+            indexStart_ == rhs.indexStart_ && indexCount_ == rhs.indexCount_ &&
+            vertexStart_ == rhs.vertexStart_ && vertexCount_ == rhs.vertexCount_;
+    }
+
+    /// Test for inequality with another source.
+    bool operator !=(const DecalGeometrySource& rhs) const { return !(*this == rhs); }
+
+    /// Positions.
+    const byte* positionData_{};
+    /// Normals.
+    const byte* normalData_{};
+    /// Blend weights followed by blend indices.
+    const byte* skinningData_{};
+    /// Indices.
+    const byte* indexData_{};
+    /// Position vertex size.
+    i32 positionStride_{};
+    /// Normal vertex size.
+    i32 normalStride_{};
+    /// Skinning vertex size.
+    i32 skinningStride_{};
+    /// Index size.
+    i32 indexStride_{};
+    /// Index start.
+    i32 indexStart_{};
+    /// Index count.
+    i32 indexCount_{};
+    /// Vertex start.
+    i32 vertexStart_{};
+    /// Vertex count.
+    i32 vertexCount_{};
+};
+
+/// CPU-side copy of a target geometry's triangles with a hierarchy for finding the triangles inside a decal.
+struct DV_API DecalGeometryData
+{
+    /// Copy the triangles of a source. Return false if the source has no position data.
+    bool Define(const DecalGeometrySource& source);
+    /// Return whether the copy was made from the same data and draw range.
+    bool IsValid(const DecalGeometrySource& source) const { return source == source_; }
+    /// Append the triangles that face the decal and are not outside its frustum as faces. May be called from worker threads.
+    void GetFaces(Vector<Vector<DecalVertex>>& faces, const Frustum& frustum, const Vector3& decalNormal, float normalCutoff);
+
+    /// Source geometry. Set by the owner of the copy to detect a destroyed geometry.
+    WeakPtr<Geometry> geometry_;
+    /// Source data the copy was made from.
+    DecalGeometrySource source_;
+    /// Positions of the vertices used by the triangles.
+    Vector<Vector3> positions_;
+    /// Normals. Empty if the geometry has none.
+    Vector<Vector3> normals_;
+    /// Triangle list indices into the positions.
+    Vector<u32> indices_;
+    /// Hierarchy over the triangle bounding boxes. Built on first use.
+    InstanceBvh triangleBvh_;
+    /// Mutex for building the hierarchy.
+    std::mutex bvhMutex_;
+    /// Whether the hierarchy has been built.
+    bool bvhBuilt_{};
+};
+
+/// Clipping frustum and transforms of a decal.
+struct DV_API DecalRequest
+{
+    /// Define the frustum, view, projection and normal from a decal placement. The target transform converts from world to the target's space.
+    void Define(const Matrix3x4& targetTransform, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+        float aspectRatio, float depth);
+
+    /// Cached geometries of the target to clip against. Empty for skinned decals.
+    Vector<std::shared_ptr<DecalGeometryData>> geometries_;
+    /// Decal frustum in the target's space.
+    Frustum frustum_;
+    /// Decal view matrix in the target's space.
+    Matrix3x4 view_;
+    /// Decal projection.
+    Matrix4 projection_;
+    /// Transform from the target's space to the decal set's space.
+    Matrix3x4 transform_;
+    /// Decal normal in the target's space.
+    Vector3 decalNormal_;
+    /// Top left texture coordinate.
+    Vector2 topLeftUV_;
+    /// Bottom right texture coordinate.
+    Vector2 bottomRightUV_;
+    /// Minimum dot product of the decal and face normals.
+    float normalCutoff_{};
+    /// Time to live.
+    float timeToLive_{};
+};
+
+/// Decals added to one target during a frame, clipped together in a worker thread.
+struct DecalClipJob
+{
+    /// Decals to clip.
+    Vector<DecalRequest> requests_;
+    /// Clipped decals, one per request. A decal without vertices missed the target.
+    Vector<Decal> results_;
+    /// Work item.
+    SharedPtr<WorkItem> item_;
+};
+
+/// Clip faces against a decal's frustum and fill the decal's vertices and indices in the decal set's space.
+DV_API void ClipDecal(Decal& decal, Vector<Vector<DecalVertex>>& faces, const DecalRequest& request, bool skinned);
+/// Clip the cached geometries of a request against the decal's frustum. May be called from worker threads.
+DV_API void ClipDecal(Decal& decal, const DecalRequest& request);
+/// Work function that clips the decals of a DecalClipJob passed in the work item's aux pointer.
+DV_API void ClipDecalsWork(const WorkItem* item, i32 threadIndex);
+
+}
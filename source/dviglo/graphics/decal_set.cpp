@@ -3,15 +3,16 @@
 // License: MIT
 
 #include "../core/context.h"
+#include "../core/core_events.h"
 #include "../core/profiler.h"
+#include "../core/work_queue.h"
 #include "animated_model.h"
 #include "batch.h"
 #include "camera.h"
-#include "decal_set.h"
+#include "decal_geometry.h"
 #include "geometry.h"
 #include "graphics.h"
 #include "material.h"
-#include "tangent.h"
 #include "../graphics_api/index_buffer.h"
 #include "../graphics_api/vertex_buffer.h"
 #include "../io/log.h"
@@ -41,77 +42,9 @@ static constexpr VertexElements STATIC_ELEMENT_MASK{VertexElements::Position | V
 static constexpr VertexElements SKINNED_ELEMENT_MASK{VertexElements::Position | VertexElements::Normal
     | VertexElements::TexCoord1 | VertexElements::Tangent | VertexElements::BlendWeights | VertexElements::BlendIndices};
 
-static DecalVertex ClipEdge(const DecalVertex& v0, const DecalVertex& v1, float d0, float d1, bool skinned)
-{
-    DecalVertex ret;
-    float t = d0 / (d0 - d1);
-
-    ret.position_ = v0.position_ + t * (v1.position_ - v0.position_);
-    ret.normal_ = v0.normal_ + t * (v1.normal_ - v0.normal_);
-    if (skinned)
-    {
-        if (*((unsigned*)v0.blendIndices_) != *((unsigned*)v1.blendIndices_))
-        {
-            // Blend weights and indices: if indices are different, choose the vertex nearer to the split plane
-            const DecalVertex& src = Abs(d0) < Abs(d1) ? v0 : v1;
-            for (unsigned i = 0; i < 4; ++i)
-            {
-                ret.blendWeights_[i] = src.blendWeights_[i];
-                ret.blendIndices_[i] = src.blendIndices_[i];
-            }
-        }
-        else
-        {
-            // If indices are same, can interpolate the weights
-            for (unsigned i = 0; i < 4; ++i)
-            {
-                ret.blendWeights_[i] = v0.blendWeights_[i] + t * (v1.blendWeights_[i] - v0.blendWeights_[i]);
-                ret.blendIndices_[i] = v0.blendIndices_[i];
-            }
-        }
-    }
-
-    return ret;
-}
-
-static void ClipPolygon(Vector<DecalVertex>& dest, const Vector<DecalVertex>& src, const Plane& plane, bool skinned)
-{
-    unsigned last = 0;
-    float lastDistance = 0.0f;
-    dest.Clear();
-
-    if (src.Empty())
-        return;
-
-    for (unsigned i = 0; i < src.Size(); ++i)
-    {
-        float distance = plane.Distance(src[i].position_);
-        if (distance >= 0.0f)
-        {
-            if (lastDistance < 0.0f)
-                dest.Push(ClipEdge(src[last], src[i], lastDistance, distance, skinned));
-
-            dest.Push(src[i]);
-        }
-        else
-        {
-            if (lastDistance >= 0.0f && i != 0)
-                dest.Push(ClipEdge(src[last], src[i], lastDistance, distance, skinned));
-        }
-
-        last = i;
-        lastDistance = distance;
-    }
-
-    // Recheck the distances of the last and first vertices and add the final clipped vertex if applicable
-    float distance = plane.Distance(src[0].position_);
-    if ((lastDistance < 0.0f && distance >= 0.0f) || (lastDistance >= 0.0f && distance < 0.0f))
-        dest.Push(ClipEdge(src[last], src[0], lastDistance, distance, skinned));
-}
-
 void Decal::AddVertex(const DecalVertex& vertex)
 {
-    for (unsigned i = 0; i < vertices_.Size(); ++i)
+    for (i32 i = 0; i < vertices_.Size(); ++i)
     {
         if (vertex.position_.Equals(vertices_[i].position_) && vertex.normal_.Equals(vertices_[i].normal_))
         {
@@ -128,7 +61,7 @@ void Decal::AddVertex(const DecalVertex& vertex)
 void Decal::CalculateBoundingBox()
 {
     boundingBox_.Clear();
-    for (unsigned i = 0; i < vertices_.Size(); ++i)
+    for (i32 i = 0; i < vertices_.Size(); ++i)
         boundingBox_.Merge(vertices_[i].position_);
 }
 
@@ -147,7 +80,8 @@ DecalSet::DecalSet() :
     boundingBoxDirty_(true),
     skinningDirty_(false),
     assignBonesPending_(false),
-    subscribed_(false)
+    subscribed_(false),
+    clipEventsSubscribed_(false)
 {
     geometry_->SetIndexBuffer(indexBuffer_);
 
@@ -156,7 +90,10 @@ DecalSet::DecalSet() :
     batches_[0].geometryType_ = GEOM_STATIC_NOINSTANCING;
 }
 
-DecalSet::~DecalSet() = default;
+DecalSet::~DecalSet()
+{
+    CancelClipJobs();
+}
 
 void DecalSet::register_object()
 {
@@ -304,8 +241,6 @@ bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Qu
         bufferDirty_ = true;
     }
 
-    // Center the decal frustum on the world position
-    Vector3 adjustedWorldPosition = worldPosition - 0.5f * depth * (worldRotation * Vector3::FORWARD);
     /// \todo target transform is not right if adding a decal to StaticModelGroup
     Matrix3x4 targetTransform = target->GetNode()->GetWorldTransform().Inverse();
 
@@ -353,116 +288,95 @@ bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Qu
             targetTransform = (bestBone->node_->GetWorldTransform() * bestBone->offsetMatrix_).Inverse();
     }
 
-    // Build the decal frustum
-    Frustum decalFrustum;
-    Matrix3x4 frustumTransform = targetTransform * Matrix3x4(adjustedWorldPosition, worldRotation, 1.0f);
-    decalFrustum.define_ortho(size, aspectRatio, 1.0, 0.0f, depth, frustumTransform);
-
-    Vector3 decalNormal = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).normalized();
-
-    decals_.Resize(decals_.Size() + 1);
-    Decal& newDecal = decals_.Back();
-    newDecal.timeToLive_ = timeToLive;
+    DecalRequest request;
+    InitRequest(request, target, targetTransform, worldPosition, worldRotation, size, aspectRatio, depth, topLeftUV,
+        bottomRightUV, timeToLive, normalCutoff);
 
     Vector<Vector<DecalVertex>> faces;
-    Vector<DecalVertex> tempFace;
-
-    unsigned numBatches = target->GetBatches().Size();
 
-    // Use either a specified subgeometry in the target, or all
-    if (subGeometry < numBatches)
-        GetFaces(faces, target, subGeometry, decalFrustum, decalNormal, normalCutoff);
-    else
+    if (skinned_)
     {
-        for (unsigned i = 0; i < numBatches; ++i)
-            GetFaces(faces, target, i, decalFrustum, decalNormal, normalCutoff);
-    }
+        unsigned numBatches = target->GetBatches().Size();
 
-    // Clip the acquired faces against all frustum planes
-    for (const auto& plane : decalFrustum.planes_)
-    {
-        for (unsigned j = 0; j < faces.Size(); ++j)
+        // Use either a specified subgeometry in the target, or all
+        if (subGeometry < numBatches)
+            GetFaces(faces, target, subGeometry, request.frustum_, request.decalNormal_, normalCutoff);
+        else
         {
-            Vector<DecalVertex>& face = faces[j];
-            if (face.Empty())
-                continue;
-
-            ClipPolygon(tempFace, face, plane, skinned_);
-            face = tempFace;
+            for (unsigned i = 0; i < numBatches; ++i)
+                GetFaces(faces, target, i, request.frustum_, request.decalNormal_, normalCutoff);
         }
     }
-
-    // Now triangulate the resulting faces into decal vertices
-    for (unsigned i = 0; i < faces.Size(); ++i)
+    else
     {
-        Vector<DecalVertex>& face = faces[i];
-        if (face.Size() < 3)
-            continue;
-
-        for (unsigned j = 2; j < face.Size(); ++j)
-        {
-            newDecal.AddVertex(face[0]);
-            newDecal.AddVertex(face[j - 1]);
-            newDecal.AddVertex(face[j]);
-        }
+        GetGeometryData(request.geometries_, target, subGeometry);
     }
 
+    Decal newDecal;
+    if (skinned_)
+        ClipDecal(newDecal, faces, request, true);
+    else
+        ClipDecal(newDecal, request);
+
     // Check if resulted in no triangles
     if (newDecal.vertices_.Empty())
-    {
-        decals_.Pop();
         return true;
-    }
 
-    if (newDecal.vertices_.Size() > maxVertices_)
-    {
-        DV_LOGWARNING("Can not add decal, vertex count " + String(newDecal.vertices_.Size()) + " exceeds maximum " +
-                   String(maxVertices_));
-        decals_.Pop();
+    return CommitDecal(newDecal);
+}
+
+bool DecalSet::AddDecalAsync(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+    float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive, float normalCutoff,
+    unsigned subGeometry)
+{
+    ZoneScoped;
+
+    // Do not add decals in headless mode
+    if (!node_ || GParams::is_headless())
         return false;
-    }
-    if (newDecal.indices_.Size() > maxIndices_)
+
+    if (!target || !target->GetNode())
     {
-        DV_LOGWARNING("Can not add decal, index count " + String(newDecal.indices_.Size()) + " exceeds maximum " +
-                   String(maxIndices_));
-        decals_.Pop();
+        DV_LOGERROR("Null target drawable for decal");
         return false;
     }
 
-    // Calculate UVs
-    Matrix4 projection(Matrix4::ZERO);
-    projection.m11_ = (1.0f / (size * 0.5f));
-    projection.m00_ = projection.m11_ / aspectRatio;
-    projection.m22_ = 1.0f / depth;
-    projection.m33_ = 1.0f;
-
-    CalculateUVs(newDecal, frustumTransform.Inverse(), projection, topLeftUV, bottomRightUV);
-
-    // Transform vertices to this node's local space and generate tangents
-    Matrix3x4 decalTransform = node_->GetWorldTransform().Inverse() * target->GetNode()->GetWorldTransform();
-    TransformVertices(newDecal, skinned_ ? Matrix3x4::IDENTITY : decalTransform);
-    GenerateTangents(&newDecal.vertices_[0], sizeof(DecalVertex), &newDecal.indices_[0], sizeof(unsigned short), 0,
-        newDecal.indices_.Size(), offsetof(DecalVertex, normal_), offsetof(DecalVertex, texCoord_), offsetof(DecalVertex,
-        tangent_));
-
-    newDecal.CalculateBoundingBox();
-    numVertices_ += newDecal.vertices_.Size();
-    numIndices_ += newDecal.indices_.Size();
+    // Skinned decals need the target's bones, which may only be accessed in the main thread
+    if (dynamic_cast<AnimatedModel*>(target))
+    {
+        return AddDecal(target, worldPosition, worldRotation, size, aspectRatio, depth, topLeftUV, bottomRightUV, timeToLive,
+            normalCutoff, subGeometry);
+    }
 
-    // Remove oldest decals if total vertices exceeded
-    while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
-        RemoveDecals(1);
+    if (skinned_)
+    {
+        RemoveAllDecals();
+        skinned_ = false;
+        bufferDirty_ = true;
+    }
 
-    DV_LOGDEBUG("Added decal with " + String(newDecal.vertices_.Size()) + " vertices");
+    DecalRequest request;
+    InitRequest(request, target, target->GetNode()->GetWorldTransform().Inverse(), worldPosition, worldRotation, size,
+        aspectRatio, depth, topLeftUV, bottomRightUV, timeToLive, normalCutoff);
+    GetGeometryData(request.geometries_, target, subGeometry);
+    if (request.geometries_.Empty())
+        return false;
 
-    // If new decal is time limited, subscribe to scene post-update
-    if (newDecal.timeToLive_ > 0.0f && !subscribed_)
-        UpdateEventSubscription(false);
+    shared_ptr<DecalClipJob>& job = pendingJobs_[target];
+    if (!job)
+        job = make_shared<DecalClipJob>();
+    job->requests_.Push(request);
 
-    MarkDecalsDirty();
+    UpdateClipEventSubscription();
     return true;
 }
 
+void DecalSet::ClearGeometryCache()
+{
+    // Running jobs keep their geometries alive
+    geometryCache_.Clear();
+}
+
 void DecalSet::RemoveDecals(unsigned num)
 {
     while (num-- && decals_.Size())
@@ -471,6 +385,8 @@ void DecalSet::RemoveDecals(unsigned num)
 
 void DecalSet::RemoveAllDecals()
 {
+    CancelClipJobs();
+
     if (!decals_.Empty())
     {
         decals_.Clear();
@@ -496,6 +412,17 @@ Material* DecalSet::GetMaterial() const
     return batches_[0].material_;
 }
 
+unsigned DecalSet::GetNumPendingDecals() const
+{
+    unsigned num = 0;
+    for (HashMap<Drawable*, shared_ptr<DecalClipJob>>::ConstIterator i = pendingJobs_.Begin(); i != pendingJobs_.End(); ++i)
+        num += i->second_->requests_.Size();
+    for (const shared_ptr<DecalClipJob>& job : runningJobs_)
+        num += job->requests_.Size();
+
+    return num;
+}
+
 void DecalSet::SetMaterialAttr(const ResourceRef& value)
 {
     SetMaterial(DV_RES_CACHE->GetResource<Material>(value.name_));
@@ -682,68 +609,29 @@ void DecalSet::GetFaces(Vector<Vector<DecalVertex>>& faces, Drawable* target, un
     if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
         return;
 
-    const byte* positionData = nullptr;
-    const byte* normalData = nullptr;
-    const byte* skinningData = nullptr;
-    const byte* indexData = nullptr;
-    i32 positionStride = 0;
-    unsigned normalStride = 0;
-    unsigned skinningStride = 0;
-    i32 indexStride = 0;
-
-    IndexBuffer* ib = geometry->GetIndexBuffer().get();
-    if (ib)
-    {
-        indexData = ib->GetShadowData();
-        indexStride = ib->GetIndexSize();
-    }
-
-    // For morphed models positions, normals and skinning may be in different buffers
-    for (unsigned i = 0; i < geometry->GetNumVertexBuffers(); ++i)
-    {
-        VertexBuffer* vb = geometry->GetVertexBuffer(i).get();
-        if (!vb)
-            continue;
-
-        VertexElements elementMask = vb->GetElementMask();
-        byte* data = vb->GetShadowData();
-        if (!data)
-            continue;
-
-        if (!!(elementMask & VertexElements::Position))
-        {
-            positionData = data;
-            positionStride = vb->GetVertexSize();
-        }
-        if (!!(elementMask & VertexElements::Normal))
-        {
-            normalData = data + vb->GetElementOffset(SEM_NORMAL);
-            normalStride = vb->GetVertexSize();
-        }
-        if (!!(elementMask & VertexElements::BlendWeights))
-        {
-            skinningData = data + vb->GetElementOffset(SEM_BLENDWEIGHTS);
-            skinningStride = vb->GetVertexSize();
-        }
-    }
+    DecalGeometrySource source;
+    source.Define(geometry);
 
     // Positions and indices are needed
-    if (!positionData)
+    if (!source.positionData_)
     {
-        // As a fallback, try to get the geometry's raw vertex/index data
-        const Vector<VertexElement>* elements;
-        geometry->GetRawData(positionData, positionStride, indexData, indexStride, elements);
-        if (!positionData)
-        {
-            DV_LOGWARNING("Can not add decal, target drawable has no CPU-side geometry data");
-            return;
-        }
+        DV_LOGWARNING("Can not add decal, target drawable has no CPU-side geometry data");
+        return;
     }
 
+    const byte* positionData = source.positionData_;
+    const byte* normalData = source.normalData_;
+    const byte* skinningData = source.skinningData_;
+    const byte* indexData = source.indexData_;
+    unsigned positionStride = source.positionStride_;
+    unsigned normalStride = source.normalStride_;
+    unsigned skinningStride = source.skinningStride_;
+    i32 indexStride = source.indexStride_;
+
     if (indexData)
     {
-        unsigned indexStart = geometry->GetIndexStart();
-        unsigned indexCount = geometry->GetIndexCount();
+        unsigned indexStart = source.indexStart_;
+        unsigned indexCount = source.indexCount_;
 
         // 16-bit indices
         if (indexStride == sizeof(unsigned short))
@@ -775,8 +663,8 @@ void DecalSet::GetFaces(Vector<Vector<DecalVertex>>& faces, Drawable* target, un
     else
     {
         // Non-indexed geometry
-        unsigned indices = geometry->GetVertexStart();
-        unsigned indicesEnd = indices + geometry->GetVertexCount();
+        unsigned indices = source.vertexStart_;
+        unsigned indicesEnd = indices + source.vertexCount_;
 
         while (indices + 2 < indicesEnd)
         {
@@ -889,7 +777,7 @@ bool DecalSet::GetBones(Drawable* target, unsigned batchIndex, const float* blen
             }
 
             bool found = false;
-            unsigned index;
+            i32 index;
 
             for (index = 0; index < bones_.Size(); ++index)
             {
@@ -937,27 +825,174 @@ bool DecalSet::GetBones(Drawable* target, unsigned batchIndex, const float* blen
     return true;
 }
 
-void DecalSet::CalculateUVs(Decal& decal, const Matrix3x4& view, const Matrix4& projection, const Vector2& topLeftUV,
-    const Vector2& bottomRightUV)
+void DecalSet::InitRequest(DecalRequest& request, Drawable* target, const Matrix3x4& targetTransform,
+    const Vector3& worldPosition, const Quaternion& worldRotation, float size, float aspectRatio, float depth,
+    const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive, float normalCutoff)
+{
+    request.Define(targetTransform, worldPosition, worldRotation, size, aspectRatio, depth);
+
+    // Skinned decals stay in the bind pose
+    request.transform_ = skinned_ ? Matrix3x4::IDENTITY :
+        node_->GetWorldTransform().Inverse() * target->GetNode()->GetWorldTransform();
+    request.topLeftUV_ = topLeftUV;
+    request.bottomRightUV_ = bottomRightUV;
+    request.normalCutoff_ = normalCutoff;
+    request.timeToLive_ = timeToLive;
+}
+
+void DecalSet::GetGeometryData(Vector<shared_ptr<DecalGeometryData>>& dest, Drawable* target, unsigned subGeometry)
+{
+    unsigned numBatches = target->GetBatches().Size();
+
+    // Use either a specified subgeometry in the target, or all
+    unsigned begin = subGeometry < numBatches ? subGeometry : 0;
+    unsigned end = subGeometry < numBatches ? subGeometry + 1 : numBatches;
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        // Try to use the most accurate LOD level if possible
+        Geometry* geometry = target->GetLodGeometry(i, 0);
+        if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+            continue;
+
+        DecalGeometrySource source;
+        source.Define(geometry);
+
+        HashMap<Geometry*, shared_ptr<DecalGeometryData>>::Iterator it = geometryCache_.Find(geometry);
+        if (it != geometryCache_.End() && it->second_->geometry_.Get() == geometry && it->second_->IsValid(source))
+        {
+            dest.Push(it->second_);
+            continue;
+        }
+
+        // Drop the copies of destroyed geometries before adding a new one
+        for (it = geometryCache_.Begin(); it != geometryCache_.End();)
+        {
+            if (it->second_->geometry_.Expired() || it->first_ == geometry)
+                it = geometryCache_.Erase(it);
+            else
+                ++it;
+        }
+
+        shared_ptr<DecalGeometryData> data = make_shared<DecalGeometryData>();
+        if (!data->Define(source))
+        {
+            DV_LOGWARNING("Can not add decal, target drawable has no CPU-side geometry data");
+            continue;
+        }
+
+        data->geometry_ = geometry;
+        geometryCache_[geometry] = data;
+        dest.Push(data);
+    }
+}
+
+bool DecalSet::CommitDecal(Decal& decal)
+{
+    if (decal.vertices_.Size() > maxVertices_)
+    {
+        DV_LOGWARNING("Can not add decal, vertex count " + String(decal.vertices_.Size()) + " exceeds maximum " +
+                   String(maxVertices_));
+        return false;
+    }
+    if (decal.indices_.Size() > maxIndices_)
+    {
+        DV_LOGWARNING("Can not add decal, index count " + String(decal.indices_.Size()) + " exceeds maximum " +
+                   String(maxIndices_));
+        return false;
+    }
+
+    decals_.Resize(decals_.Size() + 1);
+    Decal& newDecal = decals_.Back();
+    newDecal.timeToLive_ = decal.timeToLive_;
+    newDecal.boundingBox_ = decal.boundingBox_;
+    newDecal.vertices_ = std::move(decal.vertices_);
+    newDecal.indices_ = std::move(decal.indices_);
+    numVertices_ += newDecal.vertices_.Size();
+    numIndices_ += newDecal.indices_.Size();
+
+    DV_LOGDEBUG("Added decal with " + String(newDecal.vertices_.Size()) + " vertices");
+
+    // If new decal is time limited, subscribe to scene post-update
+    if (newDecal.timeToLive_ > 0.0f && !subscribed_)
+        UpdateEventSubscription(false);
+
+    // Remove oldest decals if total vertices exceeded
+    while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
+        RemoveDecals(1);
+
+    MarkDecalsDirty();
+    return true;
+}
+
+void DecalSet::StartClipJobs()
 {
-    Matrix4 viewProj = projection * view;
+    WorkQueue* queue = DV_WORK_QUEUE;
+
+    for (HashMap<Drawable*, shared_ptr<DecalClipJob>>::Iterator i = pendingJobs_.Begin(); i != pendingJobs_.End(); ++i)
+    {
+        const shared_ptr<DecalClipJob>& job = i->second_;
+
+        // Not taken from the pool, so that the work queue does not reuse the item before the job is committed
+        job->item_ = new WorkItem();
+        job->item_->priority_ = 0;
+        job->item_->workFunction_ = ClipDecalsWork;
+        job->item_->aux_ = job.get();
+        queue->AddWorkItem(job->item_);
+        runningJobs_.Push(job);
+    }
+
+    pendingJobs_.Clear();
+}
 
-    for (Vector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+void DecalSet::CommitClipJobs()
+{
+    for (i32 i = 0; i < runningJobs_.Size();)
     {
-        Vector3 projected = viewProj * i->position_;
-        i->texCoord_ = Vector2(
-            Lerp(topLeftUV.x, bottomRightUV.x, projected.x * 0.5f + 0.5f),
-            Lerp(bottomRightUV.y, topLeftUV.y, projected.y * 0.5f + 0.5f)
-        );
+        DecalClipJob& job = *runningJobs_[i];
+        if (!job.item_->completed_)
+        {
+            ++i;
+            continue;
+        }
+
+        for (Decal& decal : job.results_)
+        {
+            if (!decal.vertices_.Empty())
+                CommitDecal(decal);
+        }
+
+        runningJobs_.Erase(i);
     }
 }
 
-void DecalSet::TransformVertices(Decal& decal, const Matrix3x4& transform)
+void DecalSet::CancelClipJobs()
+{
+    pendingJobs_.Clear();
+
+    // Jobs that worker threads have already taken are waited for
+    for (const shared_ptr<DecalClipJob>& job : runningJobs_)
+        DV_WORK_QUEUE->CancelWorkItem(job->item_);
+
+    runningJobs_.Clear();
+    UpdateClipEventSubscription();
+}
+
+void DecalSet::UpdateClipEventSubscription()
 {
-    for (Vector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+    bool enabled = !pendingJobs_.Empty() || !runningJobs_.Empty();
+
+    if (enabled && !clipEventsSubscribed_)
+    {
+        subscribe_to_event(E_POSTRENDERUPDATE, DV_HANDLER(DecalSet, HandlePostRenderUpdate));
+        subscribe_to_event(E_ENDFRAME, DV_HANDLER(DecalSet, HandleEndFrame));
+        clipEventsSubscribed_ = true;
+    }
+    else if (!enabled && clipEventsSubscribed_)
     {
-        i->position_ = transform * i->position_;
-        i->normal_ = (transform * Vector4(i->normal_, 0.0f)).normalized();
+        unsubscribe_from_event(E_POSTRENDERUPDATE);
+        unsubscribe_from_event(E_ENDFRAME);
+        clipEventsSubscribed_ = false;
     }
 }
 
@@ -1010,7 +1045,7 @@ void DecalSet::UpdateBuffers()
 
         for (List<Decal>::ConstIterator i = decals_.Begin(); i != decals_.End(); ++i)
         {
-            for (unsigned j = 0; j < i->vertices_.Size(); ++j)
+            for (i32 j = 0; j < i->vertices_.Size(); ++j)
             {
                 const DecalVertex& vertex = i->vertices_[j];
                 *vertices++ = vertex.position_.x;
@@ -1035,7 +1070,7 @@ void DecalSet::UpdateBuffers()
                 }
             }
 
-            for (unsigned j = 0; j < i->indices_.Size(); ++j)
+            for (i32 j = 0; j < i->indices_.Size(); ++j)
                 *indices++ = i->indices_[j] + indexStart;
 
             indexStart += i->vertices_.Size();
@@ -1054,7 +1089,7 @@ void DecalSet::UpdateSkinning()
     // Use model's world transform in case a bone is missing
     const Matrix3x4& worldTransform = node_->GetWorldTransform();
 
-    for (unsigned i = 0; i < bones_.Size(); ++i)
+    for (i32 i = 0; i < bones_.Size(); ++i)
     {
         const Bone& bone = bones_[i];
         if (bone.node_)
@@ -1154,4 +1189,16 @@ void DecalSet::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData
     }
 }
 
+void DecalSet::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
+{
+    // The decals are clipped while the main thread renders
+    StartClipJobs();
+}
+
+void DecalSet::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    CommitClipJobs();
+    UpdateClipEventSubscription();
+}
+
 }
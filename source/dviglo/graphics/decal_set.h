@@ -4,16 +4,22 @@
 
 #pragma once
 
+#include "../containers/hash_map.h"
 #include "../containers/list.h"
 #include "drawable.h"
 #include "skeleton.h"
 #include "../math/frustum.h"
 
+#include <memory>
+
 namespace dviglo
 {
 
 class IndexBuffer;
 class VertexBuffer;
+struct DecalClipJob;
+struct DecalGeometryData;
+struct DecalRequest;
 
 /// %Decal vertex.
 struct DecalVertex
@@ -119,6 +125,12 @@ public:
     bool AddDecal(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size, float aspectRatio,
         float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive = 0.0f, float normalCutoff = 0.1f,
         unsigned subGeometry = M_MAX_UNSIGNED);
+    /// Add a decal like AddDecal(), but clip it in a worker thread. Decals added to the same target during a frame are clipped together, and appear at the end of the frame in which their clipping finished. Skinned targets are clipped immediately with AddDecal(). Return true if the decal was queued.
+    bool AddDecalAsync(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+        float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive = 0.0f,
+        float normalCutoff = 0.1f, unsigned subGeometry = M_MAX_UNSIGNED);
+    /// Clear the CPU-side copies of target geometries. Must be called if the vertex or index data of a target changes.
+    void ClearGeometryCache();
     /// Remove n oldest decals.
     void RemoveDecals(unsigned num);
     /// Remove all decals.
@@ -130,6 +142,9 @@ public:
     /// Return number of decals.
     unsigned GetNumDecals() const { return decals_.Size(); }
 
+    /// Return number of decals added with AddDecalAsync() that have not been clipped and added yet.
+    unsigned GetNumPendingDecals() const;
+
     /// Retur number of vertices in the decals.
     unsigned GetNumVertices() const { return numVertices_; }
 
@@ -173,11 +188,22 @@ private:
     /// Get bones referenced by skinning data and remap the skinning indices. Return true if successful.
     bool GetBones(Drawable* target, unsigned batchIndex, const float* blendWeights, const unsigned char* blendIndices,
         unsigned char* newBlendIndices);
-    /// Calculate UV coordinates for the decal.
-    void CalculateUVs
-        (Decal& decal, const Matrix3x4& view, const Matrix4& projection, const Vector2& topLeftUV, const Vector2& bottomRightUV);
-    /// Transform decal's vertices from the target geometry to the decal set local space.
-    void TransformVertices(Decal& decal, const Matrix3x4& transform);
+    /// Fill the clipping frustum and the transforms of a decal.
+    void InitRequest(DecalRequest& request, Drawable* target, const Matrix3x4& targetTransform, const Vector3& worldPosition,
+        const Quaternion& worldRotation, float size, float aspectRatio, float depth, const Vector2& topLeftUV,
+        const Vector2& bottomRightUV, float timeToLive, float normalCutoff);
+    /// Return the cached CPU-side copies of the target's geometries, or of one subgeometry.
+    void GetGeometryData(Vector<std::shared_ptr<DecalGeometryData>>& dest, Drawable* target, unsigned subGeometry);
+    /// Add a clipped decal. Return false if it has too many vertices or indices.
+    bool CommitDecal(Decal& decal);
+    /// Start clipping the decals added during the frame in worker threads.
+    void StartClipJobs();
+    /// Add the decals of the finished clipping jobs.
+    void CommitClipJobs();
+    /// Drop the pending decals and wait for the running clipping jobs.
+    void CancelClipJobs();
+    /// Subscribe/unsubscribe from the frame events used by the clipping jobs as necessary.
+    void UpdateClipEventSubscription();
     /// Remove a decal by iterator and return iterator to the next decal.
     List<Decal>::Iterator RemoveDecal(List<Decal>::Iterator i);
     /// Mark decals and the bounding box dirty.
@@ -196,6 +222,10 @@ private:
     void UpdateEventSubscription(bool checkAllDecals);
     /// Handle scene post-update event.
     void HandleScenePostUpdate(StringHash eventType, VariantMap& eventData);
+    /// Handle post-render update event. Start the clipping jobs.
+    void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
+    /// Handle end of frame event. Add the decals of the finished clipping jobs.
+    void HandleEndFrame(StringHash eventType, VariantMap& eventData);
 
     /// Geometry.
     SharedPtr<Geometry> geometry_;
@@ -209,6 +239,12 @@ private:
     Vector<Bone> bones_;
     /// Skinning matrices.
     Vector<Matrix3x4> skinMatrices_;
+    /// CPU-side copies of target geometries.
+    HashMap<Geometry*, std::shared_ptr<DecalGeometryData>> geometryCache_;
+    /// Decals added during the frame waiting to be clipped, per target.
+    HashMap<Drawable*, std::shared_ptr<DecalClipJob>> pendingJobs_;
+    /// Clipping jobs in worker threads.
+    Vector<std::shared_ptr<DecalClipJob>> runningJobs_;
     /// Vertices in the current decals.
     unsigned numVertices_;
     /// Indices in the current decals.
@@ -231,6 +267,8 @@ private:
     bool assignBonesPending_;
     /// Subscribed to scene post update event flag.
     bool subscribed_;
+    /// Subscribed to the frame events of the clipping jobs flag.
+    bool clipEventsSubscribed_;
 };
 
 }
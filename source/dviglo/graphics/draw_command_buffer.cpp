@@ -0,0 +1,470 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "draw_command_buffer.h"
+#include "geometry.h"
+#include "graphics.h"
+#include "material.h"
+#include "renderer.h"
+#include "view.h"
+#include "zone.h"
+#include "../graphics_api/vertex_buffer.h"
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+DrawCommandBuffer::DrawCommandBuffer()
+{
+    Clear();
+}
+
+void DrawCommandBuffer::Clear()
+{
+    commands_.Clear();
+    data_.Clear();
+    openGroup_ = NINDEX;
+    numDraws_ = 0;
+
+    for (i32& index : lastStates_)
+        index = NINDEX;
+
+    for (i32 i = 0; i < MAX_TEXTURE_UNITS; ++i)
+    {
+        textures_[i] = nullptr;
+        texturesRecorded_[i] = false;
+    }
+
+    for (i32 i = 0; i < MAX_SHADER_PARAMETER_GROUPS; ++i)
+    {
+        groupSources_[i] = nullptr;
+        groupsRecorded_[i] = false;
+    }
+}
+
+void DrawCommandBuffer::SetShaders(ShaderVariation* vs, ShaderVariation* ps)
+{
+    i32 numCommands = commands_.Size();
+    AddStateCommand(DCMD_SHADERS, 0, 0, vs, ps);
+    if (commands_.Size() == numCommands)
+        return;
+
+    // Textures are set only if the shaders use them, and Graphics remembers parameter sources per shader program
+    for (bool& recorded : texturesRecorded_)
+        recorded = false;
+    for (bool& recorded : groupsRecorded_)
+        recorded = false;
+}
+
+void DrawCommandBuffer::SetBlendMode(BlendMode mode, bool alphaToCoverage)
+{
+    AddStateCommand(DCMD_BLENDMODE, mode, alphaToCoverage);
+}
+
+void DrawCommandBuffer::SetCullMode(CullMode mode)
+{
+    AddStateCommand(DCMD_CULLMODE, mode);
+}
+
+void DrawCommandBuffer::SetDepthBias(float constantBias, float slopeScaledBias)
+{
+    i32 constantBits, slopeScaledBits;
+    memcpy(&constantBits, &constantBias, sizeof(float));
+    memcpy(&slopeScaledBits, &slopeScaledBias, sizeof(float));
+    AddStateCommand(DCMD_DEPTHBIAS, constantBits, slopeScaledBits);
+}
+
+void DrawCommandBuffer::SetFillMode(FillMode mode)
+{
+    AddStateCommand(DCMD_FILLMODE, mode);
+}
+
+void DrawCommandBuffer::SetDepthTest(CompareMode mode)
+{
+    AddStateCommand(DCMD_DEPTHTEST, mode);
+}
+
+void DrawCommandBuffer::SetDepthWrite(bool enable)
+{
+    AddStateCommand(DCMD_DEPTHWRITE, enable);
+}
+
+void DrawCommandBuffer::SetLineAntiAlias(bool enable)
+{
+    AddStateCommand(DCMD_LINEANTIALIAS, enable);
+}
+
+void DrawCommandBuffer::SetStencilTest(bool enable, u32 lightMask)
+{
+    AddStateCommand(DCMD_STENCILTEST, enable, enable ? (i32)lightMask : 0);
+}
+
+void DrawCommandBuffer::SetScissorTest(Light* light, Camera* camera)
+{
+    AddStateCommand(DCMD_SCISSORTEST, 0, 0, light, light ? camera : nullptr);
+}
+
+bool DrawCommandBuffer::BeginParameterGroup(ShaderParameterGroup group, const void* source)
+{
+    assert(openGroup_ == NINDEX);
+
+    if (!UpdateGroupSource(group, source))
+        return false;
+
+    openGroup_ = commands_.Size();
+    DrawCommand& command = AddCommand(DCMD_PARAMETERGROUP);
+    command.args_[0] = group;
+    command.objects_[0] = const_cast<void*>(source);
+    return true;
+}
+
+void DrawCommandBuffer::EndParameterGroup()
+{
+    assert(openGroup_ != NINDEX);
+
+    commands_[openGroup_].args_[1] = commands_.Size() - openGroup_ - 1;
+    openGroup_ = NINDEX;
+}
+
+void DrawCommandBuffer::SetFrameParameters()
+{
+    if (UpdateGroupSource(SP_FRAME, nullptr))
+        AddCommand(DCMD_FRAMEPARAMETERS);
+}
+
+void DrawCommandBuffer::SetCameraParameters(Camera* camera)
+{
+    // The viewport is a part of the source, so it is compared on replay
+    if (UpdateGroupSource(SP_CAMERA, camera))
+        AddCommand(DCMD_CAMERAPARAMETERS).objects_[0] = camera;
+}
+
+void DrawCommandBuffer::SetZoneParameters(Zone* zone, Camera* camera, bool overrideFogColorToBlack)
+{
+    hash32 zoneHash = (hash32)(size_t)zone;
+    if (overrideFogColorToBlack)
+        zoneHash += 0x80000000;
+
+    if (UpdateGroupSource(SP_ZONE, reinterpret_cast<const void*>(zoneHash)))
+    {
+        DrawCommand& command = AddCommand(DCMD_ZONEPARAMETERS);
+        command.args_[0] = overrideFogColorToBlack;
+        command.args_[1] = (i32)zoneHash;
+        command.objects_[0] = zone;
+        command.objects_[1] = camera;
+    }
+}
+
+void DrawCommandBuffer::SetMaterialParameters(Material* material)
+{
+    if (UpdateGroupSource(SP_MATERIAL, reinterpret_cast<const void*>(material->GetShaderParameterHash())))
+        AddCommand(DCMD_MATERIALPARAMETERS).objects_[0] = material;
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, const float* data, i32 count)
+{
+    AddParameter(param, VAR_BUFFER, data, count);
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, float value)
+{
+    AddParameter(param, VAR_FLOAT, &value, 1);
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, const Vector2& vector)
+{
+    AddParameter(param, VAR_VECTOR2, vector.Data(), 2);
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, const Vector3& vector)
+{
+    AddParameter(param, VAR_VECTOR3, vector.Data(), 3);
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, const Vector4& vector)
+{
+    AddParameter(param, VAR_VECTOR4, vector.Data(), 4);
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, const Color& color)
+{
+    AddParameter(param, VAR_COLOR, color.Data(), 4);
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, const Matrix3& matrix)
+{
+    AddParameter(param, VAR_MATRIX3, matrix.Data(), 9);
+}
+
+void DrawCommandBuffer::SetShaderParameter(const ShaderParameterSlot& param, const Matrix3x4& matrix)
+{
+    AddParameter(param, VAR_MATRIX3X4, matrix.Data(), 12);
+}
+
+void DrawCommandBuffer::SetTexture(TextureUnit unit, Texture* texture)
+{
+    if (texturesRecorded_[unit] && textures_[unit] == texture)
+        return;
+
+    textures_[unit] = texture;
+    texturesRecorded_[unit] = true;
+
+    DrawCommand& command = AddCommand(DCMD_TEXTURE);
+    command.args_[0] = unit;
+    command.objects_[0] = texture;
+}
+
+void DrawCommandBuffer::Draw(Geometry* geometry)
+{
+    AddCommand(DCMD_DRAW).objects_[0] = geometry;
+    ++numDraws_;
+}
+
+void DrawCommandBuffer::DrawInstanced(Geometry* geometry, VertexBuffer* instanceBuffer, i32 startIndex, i32 numInstances)
+{
+    DrawCommand& command = AddCommand(DCMD_DRAWINSTANCED);
+    command.args_[0] = startIndex;
+    command.args_[1] = numInstances;
+    command.objects_[0] = geometry;
+    command.objects_[1] = instanceBuffer;
+    ++numDraws_;
+}
+
+void DrawCommandBuffer::Replay(View* view, bool allowDepthWrite) const
+{
+    Graphics* graphics = DV_GRAPHICS;
+    Vector<VertexBuffer*> vertexBuffers;
+
+    for (i32 i = 0; i < commands_.Size(); ++i)
+    {
+        const DrawCommand& command = commands_[i];
+
+        switch (command.type_)
+        {
+        case DCMD_SHADERS:
+            graphics->SetShaders(static_cast<ShaderVariation*>(command.objects_[0]), static_cast<ShaderVariation*>(command.objects_[1]));
+            break;
+
+        case DCMD_BLENDMODE:
+            graphics->SetBlendMode((BlendMode)command.args_[0], command.args_[1]);
+            break;
+
+        case DCMD_CULLMODE:
+            graphics->SetCullMode((CullMode)command.args_[0]);
+            break;
+
+        case DCMD_DEPTHBIAS:
+            {
+                float constantBias, slopeScaledBias;
+                memcpy(&constantBias, &command.args_[0], sizeof(float));
+                memcpy(&slopeScaledBias, &command.args_[1], sizeof(float));
+                graphics->SetDepthBias(constantBias, slopeScaledBias);
+            }
+            break;
+
+        case DCMD_FILLMODE:
+            graphics->SetFillMode((FillMode)command.args_[0]);
+            break;
+
+        case DCMD_DEPTHTEST:
+            graphics->SetDepthTest((CompareMode)command.args_[0]);
+            break;
+
+        case DCMD_DEPTHWRITE:
+            graphics->SetDepthWrite(command.args_[0] && allowDepthWrite);
+            break;
+
+        case DCMD_LINEANTIALIAS:
+            graphics->SetLineAntiAlias(command.args_[0]);
+            break;
+
+        case DCMD_STENCILTEST:
+            if (command.args_[0])
+                graphics->SetStencilTest(true, CMP_ALWAYS, OP_REF, OP_KEEP, OP_KEEP, (u32)command.args_[1]);
+            else
+                graphics->SetStencilTest(false);
+            break;
+
+        case DCMD_SCISSORTEST:
+            if (command.objects_[0])
+                DV_RENDERER->OptimizeLightByScissor(static_cast<Light*>(command.objects_[0]), static_cast<Camera*>(command.objects_[1]));
+            else
+                graphics->SetScissorTest(false);
+            break;
+
+        case DCMD_PARAMETERGROUP:
+            if (!graphics->NeedParameterUpdate((ShaderParameterGroup)command.args_[0], command.objects_[0]))
+                i += command.args_[1];
+            break;
+
+        case DCMD_FRAMEPARAMETERS:
+            if (graphics->NeedParameterUpdate(SP_FRAME, nullptr))
+                view->SetGlobalShaderParameters();
+            break;
+
+        case DCMD_CAMERAPARAMETERS:
+            {
+                Camera* camera = static_cast<Camera*>(command.objects_[0]);
+                hash32 cameraHash = (hash32)(size_t)camera;
+                IntRect viewport = graphics->GetViewport();
+                IntVector2 viewSize = IntVector2(viewport.Width(), viewport.Height());
+                hash32 viewportHash = (hash32)viewSize.x | (hash32)viewSize.y << 16u;
+                if (graphics->NeedParameterUpdate(SP_CAMERA, reinterpret_cast<const void*>(cameraHash + viewportHash)))
+                {
+                    view->SetCameraShaderParameters(camera);
+                    // During renderpath commands the G-Buffer or viewport texture is assumed to always be viewport-sized
+                    view->SetGBufferShaderParameters(viewSize, IntRect(0, 0, viewSize.x, viewSize.y));
+                }
+            }
+            break;
+
+        case DCMD_ZONEPARAMETERS:
+            if (graphics->NeedParameterUpdate(SP_ZONE, reinterpret_cast<const void*>((hash32)command.args_[1])))
+                view->SetZoneShaderParameters(static_cast<Zone*>(command.objects_[0]), static_cast<Camera*>(command.objects_[1]), command.args_[0]);
+            break;
+
+        case DCMD_MATERIALPARAMETERS:
+            {
+                Material* material = static_cast<Material*>(command.objects_[0]);
+                if (graphics->NeedParameterUpdate(SP_MATERIAL, reinterpret_cast<const void*>(material->GetShaderParameterHash())))
+                {
+                    const HashMap<StringHash, MaterialShaderParameter>& parameters = material->GetShaderParameters();
+                    for (HashMap<StringHash, MaterialShaderParameter>::ConstIterator j = parameters.Begin(); j != parameters.End(); ++j)
+                        graphics->SetShaderParameter(j->second_.slot_, j->second_.value_);
+                }
+            }
+            break;
+
+        case DCMD_PARAMETER:
+            {
+                const ShaderParameterSlot& param = *static_cast<const ShaderParameterSlot*>(command.objects_[0]);
+                const float* data = &data_[command.args_[1]];
+
+                switch (command.args_[0])
+                {
+                case VAR_FLOAT:
+                    graphics->SetShaderParameter(param, *data);
+                    break;
+
+                case VAR_VECTOR2:
+                    graphics->SetShaderParameter(param, *reinterpret_cast<const Vector2*>(data));
+                    break;
+
+                case VAR_VECTOR3:
+                    graphics->SetShaderParameter(param, *reinterpret_cast<const Vector3*>(data));
+                    break;
+
+                case VAR_VECTOR4:
+                    graphics->SetShaderParameter(param, *reinterpret_cast<const Vector4*>(data));
+                    break;
+
+                case VAR_COLOR:
+                    graphics->SetShaderParameter(param, *reinterpret_cast<const Color*>(data));
+                    break;
+
+                case VAR_MATRIX3:
+                    graphics->SetShaderParameter(param, *reinterpret_cast<const Matrix3*>(data));
+                    break;
+
+                case VAR_MATRIX3X4:
+                    graphics->SetShaderParameter(param, *reinterpret_cast<const Matrix3x4*>(data));
+                    break;
+
+                default:
+                    graphics->SetShaderParameter(param, data, command.args_[2]);
+                    break;
+                }
+            }
+            break;
+
+        case DCMD_TEXTURE:
+            if (graphics->HasTextureUnit((TextureUnit)command.args_[0]))
+                graphics->SetTexture(command.args_[0], static_cast<Texture*>(command.objects_[0]));
+            break;
+
+        case DCMD_DRAW:
+            static_cast<Geometry*>(command.objects_[0])->Draw();
+            break;
+
+        case DCMD_DRAWINSTANCED:
+            {
+                Geometry* geometry = static_cast<Geometry*>(command.objects_[0]);
+                const Vector<shared_ptr<VertexBuffer>>& geometryBuffers = geometry->GetVertexBuffers();
+
+                vertexBuffers.Resize(geometryBuffers.Size());
+                for (i32 j = 0; j < geometryBuffers.Size(); ++j)
+                    vertexBuffers[j] = geometryBuffers[j].get();
+                vertexBuffers.Push(static_cast<VertexBuffer*>(command.objects_[1]));
+
+                graphics->SetIndexBuffer(geometry->GetIndexBuffer().get());
+                graphics->SetVertexBuffers(vertexBuffers, command.args_[0]);
+                graphics->DrawInstanced(geometry->GetPrimitiveType(), geometry->GetIndexStart(), geometry->GetIndexCount(),
+                    geometry->GetVertexStart(), geometry->GetVertexCount(), command.args_[1]);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+DrawCommand& DrawCommandBuffer::AddCommand(DrawCommandType type)
+{
+    commands_.Resize(commands_.Size() + 1);
+    DrawCommand& command = commands_.Back();
+    command.type_ = type;
+    command.args_[0] = command.args_[1] = command.args_[2] = 0;
+    command.objects_[0] = command.objects_[1] = nullptr;
+    return command;
+}
+
+void DrawCommandBuffer::AddStateCommand(DrawCommandType type, i32 arg0, i32 arg1, void* object0, void* object1)
+{
+    i32 last = lastStates_[type];
+    if (last != NINDEX)
+    {
+        const DrawCommand& lastCommand = commands_[last];
+        if (lastCommand.args_[0] == arg0 && lastCommand.args_[1] == arg1 && lastCommand.objects_[0] == object0 &&
+            lastCommand.objects_[1] == object1)
+            return;
+    }
+
+    lastStates_[type] = commands_.Size();
+    DrawCommand& command = AddCommand(type);
+    command.args_[0] = arg0;
+    command.args_[1] = arg1;
+    command.objects_[0] = object0;
+    command.objects_[1] = object1;
+}
+
+void DrawCommandBuffer::AddParameter(const ShaderParameterSlot& param, VariantType type, const float* data, i32 count)
+{
+    DrawCommand& command = AddCommand(DCMD_PARAMETER);
+    command.args_[0] = type;
+    command.args_[1] = data_.Size();
+    command.args_[2] = count;
+    command.objects_[0] = const_cast<ShaderParameterSlot*>(&param);
+
+    if (count > 0)
+    {
+        i32 offset = data_.Size();
+        data_.Resize(offset + count);
+        memcpy(&data_[offset], data, count * sizeof(float));
+    }
+}
+
+bool DrawCommandBuffer::UpdateGroupSource(ShaderParameterGroup group, const void* source)
+{
+    if (groupsRecorded_[group] && groupSources_[group] == source)
+        return false;
+
+    groupSources_[group] = source;
+    groupsRecorded_[group] = true;
+    return true;
+}
+
+}
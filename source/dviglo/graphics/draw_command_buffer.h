@@ -0,0 +1,173 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/vector.h"
+#include "../core/variant.h"
+#include "../graphics_api/graphics_defs.h"
+
+namespace dviglo
+{
+
+class Camera;
+class Geometry;
+class Light;
+class Material;
+class ShaderVariation;
+class Texture;
+class VertexBuffer;
+class View;
+class Zone;
+
+/// Recorded draw command type.
+enum DrawCommandType : u8
+{
+    DCMD_SHADERS = 0,
+    DCMD_BLENDMODE,
+    DCMD_CULLMODE,
+    DCMD_DEPTHBIAS,
+    DCMD_FILLMODE,
+    DCMD_DEPTHTEST,
+    DCMD_DEPTHWRITE,
+    DCMD_LINEANTIALIAS,
+    DCMD_STENCILTEST,
+    DCMD_SCISSORTEST,
+    DCMD_PARAMETERGROUP,
+    DCMD_FRAMEPARAMETERS,
+    DCMD_CAMERAPARAMETERS,
+    DCMD_ZONEPARAMETERS,
+    DCMD_MATERIALPARAMETERS,
+    DCMD_PARAMETER,
+    DCMD_TEXTURE,
+    DCMD_DRAW,
+    DCMD_DRAWINSTANCED,
+    MAX_DRAW_COMMAND_TYPES
+};
+
+/// Recorded draw command.
+struct DrawCommand
+{
+    /// Command type.
+    DrawCommandType type_;
+    /// Integer arguments: render state values, texture unit, parameter group and source, parameter type and data range, instance range or number of commands in a parameter group.
+    i32 args_[3];
+    /// Object arguments: shaders, texture, parameter slot, camera, light, zone, material, geometry or instancing buffer.
+    void* objects_[2];
+};
+
+/// Draw calls of a batch queue recorded without touching Graphics, so that worker threads can record several queues in parallel. Redundant render state, texture and shader parameter group changes are dropped while recording. The main thread replays the commands against Graphics.
+class DV_API DrawCommandBuffer
+{
+public:
+    /// Construct empty.
+    DrawCommandBuffer();
+
+    /// Remove all commands and forget the recorded state.
+    void Clear();
+
+    /// Record setting shaders. Textures and shader parameter groups recorded before are set again for the new shaders.
+    void SetShaders(ShaderVariation* vs, ShaderVariation* ps);
+    /// Record setting blend mode.
+    void SetBlendMode(BlendMode mode, bool alphaToCoverage);
+    /// Record setting cull mode. Reverse culling of the camera must have been applied.
+    void SetCullMode(CullMode mode);
+    /// Record setting depth bias.
+    void SetDepthBias(float constantBias, float slopeScaledBias);
+    /// Record setting fill mode.
+    void SetFillMode(FillMode mode);
+    /// Record setting depth test.
+    void SetDepthTest(CompareMode mode);
+    /// Record setting depth write. Disabled when replaying if the render path command does not allow depth write.
+    void SetDepthWrite(bool enable);
+    /// Record setting line antialiasing.
+    void SetLineAntiAlias(bool enable);
+    /// Record marking the light mask to stencil, or disabling stencil test.
+    void SetStencilTest(bool enable, u32 lightMask = 0);
+    /// Record optimizing a light by scissor, or disabling scissor test if the light is null.
+    void SetScissorTest(Light* light, Camera* camera);
+
+    /// Begin recording a shader parameter group. Return false if the group was already recorded with the same source for the current shaders; then nothing needs to be recorded. The group is skipped on replay if Graphics already has the source.
+    bool BeginParameterGroup(ShaderParameterGroup group, const void* source);
+    /// End recording a shader parameter group.
+    void EndParameterGroup();
+    /// Record setting global (per-frame) shader parameters from the view.
+    void SetFrameParameters();
+    /// Record setting camera and viewport shader parameters from the view.
+    void SetCameraParameters(Camera* camera);
+    /// Record setting zone shader parameters from the view. Zone parameters are evaluated on replay, because they may need octree queries.
+    void SetZoneParameters(Zone* zone, Camera* camera, bool overrideFogColorToBlack);
+    /// Record setting material shader parameters.
+    void SetMaterialParameters(Material* material);
+
+    /// Record setting shader float constants. The slot must outlive the commands, e.g. a built-in VSP_ or PSP_ constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, const float* data, i32 count);
+    /// Record setting shader float constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, float value);
+    /// Record setting shader 2D vector constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Vector2& vector);
+    /// Record setting shader 3D vector constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Vector3& vector);
+    /// Record setting shader 4D vector constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Vector4& vector);
+    /// Record setting shader color constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Color& color);
+    /// Record setting shader 3x3 matrix constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Matrix3& matrix);
+    /// Record setting shader 3x4 matrix constant.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Matrix3x4& matrix);
+
+    /// Record setting a texture. Set on replay only if the current shaders use the texture unit.
+    void SetTexture(TextureUnit unit, Texture* texture);
+
+    /// Record drawing a geometry.
+    void Draw(Geometry* geometry);
+    /// Record drawing a geometry instanced from the instancing buffer.
+    void DrawInstanced(Geometry* geometry, VertexBuffer* instanceBuffer, i32 startIndex, i32 numInstances);
+
+    /// Execute the commands on the main thread. The view sets the frame, camera and zone shader parameters.
+    void Replay(View* view, bool allowDepthWrite) const;
+
+    /// Return the commands.
+    const Vector<DrawCommand>& GetCommands() const { return commands_; }
+
+    /// Return number of commands.
+    i32 GetNumCommands() const { return commands_.Size(); }
+
+    /// Return number of recorded draw calls.
+    i32 GetNumDraws() const { return numDraws_; }
+
+    /// Return whether has no commands.
+    bool IsEmpty() const { return commands_.Empty(); }
+
+private:
+    /// Add a command.
+    DrawCommand& AddCommand(DrawCommandType type);
+    /// Add a render state command unless the last command of the same type had the same arguments.
+    void AddStateCommand(DrawCommandType type, i32 arg0, i32 arg1 = 0, void* object0 = nullptr, void* object1 = nullptr);
+    /// Add a shader parameter command with the value copied to the data buffer.
+    void AddParameter(const ShaderParameterSlot& param, VariantType type, const float* data, i32 count);
+    /// Return false if a parameter group was already recorded with the same source for the current shaders. Otherwise remember the source.
+    bool UpdateGroupSource(ShaderParameterGroup group, const void* source);
+
+    /// Commands.
+    Vector<DrawCommand> commands_;
+    /// Shader parameter values.
+    Vector<float> data_;
+    /// Index of the last command of each render state type, or NINDEX if none.
+    i32 lastStates_[MAX_DRAW_COMMAND_TYPES];
+    /// Last recorded texture of each unit since the shaders changed.
+    const Texture* textures_[MAX_TEXTURE_UNITS];
+    /// Whether each texture unit has been recorded since the shaders changed.
+    bool texturesRecorded_[MAX_TEXTURE_UNITS];
+    /// Last recorded source of each shader parameter group since the shaders changed.
+    const void* groupSources_[MAX_SHADER_PARAMETER_GROUPS];
+    /// Whether each shader parameter group has been recorded since the shaders changed.
+    bool groupsRecorded_[MAX_SHADER_PARAMETER_GROUPS];
+    /// Index of the parameter group command being recorded, or NINDEX if none.
+    i32 openGroup_{NINDEX};
+    /// Number of recorded draw calls.
+    i32 numDraws_{};
+};
+
+}
@@ -265,9 +265,10 @@ bool Drawable::IsInView(const FrameInfo& frame, bool anyCamera) const
     return viewFrameNumber_ == frame.frameNumber_ && (anyCamera || viewCameras_.Contains(frame.camera_));
 }
 
-void Drawable::SetZone(Zone* zone, bool temporary)
+void Drawable::SetZone(Zone* zone, bool temporary, u32 zoneSetId)
 {
     zone_ = zone;
+    zoneSetId_ = zoneSetId;
 
     // If the zone assignment was temporary (inconclusive) set the dirty flag so that it will be re-evaluated on the next frame
     zoneDirty_ = temporary;
@@ -361,12 +362,16 @@ void Drawable::OnSceneSet(Scene* scene)
 void Drawable::OnMarkedDirty(Node* node)
 {
     worldBoundingBoxDirty_ = true;
+    ++transformVersion_;
     if (!updateQueued_ && octant_)
         octant_->GetRoot()->queue_update(this);
 
     // Mark zone assignment dirty when transform changes
     if (node == node_)
+    {
         zoneDirty_ = true;
+        zoneSetId_ = 0;
+    }
 }
 
 void Drawable::AddToOctree()
@@ -402,6 +407,10 @@ void Drawable::RemoveFromOctree()
         // Perform subclass specific deinitialization if necessary
         OnRemoveFromOctree();
 
+        Renderer* renderer = DV_RENDERER;
+        if (renderer && renderer->GetCacheBaseBatches())
+            renderer->RemoveCachedBaseBatches(this);
+
         octant_->RemoveDrawable(this);
     }
 }
@@ -209,9 +209,11 @@ public:
 
     /// Return draw call source data.
     const Vector<SourceBatch>& GetBatches() const { return batches_; }
+    /// Return draw call source data culled for a view or shadow camera, after update_batches() for the frame. Default returns all batches. Batch count and order must be the same for all cameras within a frame.
+    virtual const Vector<SourceBatch>& GetCameraBatches(Camera* cullCamera, const FrameInfo& frame) { return batches_; }
 
-    /// Set new zone. Zone assignment may optionally be temporary, meaning it needs to be re-evaluated on the next frame.
-    void SetZone(Zone* zone, bool temporary = false);
+    /// Set new zone. Zone assignment may optionally be temporary, meaning it needs to be re-evaluated on the next frame. A non-zero zone set ID lets a view skip the re-evaluation while the drawable does not move and the view's zones stay the same.
+    void SetZone(Zone* zone, bool temporary = false, u32 zoneSetId = 0);
     /// Set sorting value.
     void SetSortValue(float value);
 
@@ -247,6 +249,12 @@ public:
     /// Return whether current zone is inconclusive or dirty due to the drawable moving.
     bool IsZoneDirty() const { return zoneDirty_; }
 
+    /// Return ID of the zone set the current zone was found from, or 0 if it must be searched again.
+    u32 GetZoneSetId() const { return zoneSetId_; }
+
+    /// Return a counter that is incremented whenever the scene node or another listened node, such as an instance node, is marked dirty.
+    u32 GetTransformVersion() const { return transformVersion_; }
+
     /// Return distance from camera.
     float distance() const { return distance_; }
 
@@ -266,6 +274,9 @@ public:
         return (basePassFlags_ & (1u << batchIndex)) != 0;
     }
 
+    /// Return base pass flags of the first 32 batches.
+    flagset32 GetBasePassFlags() const { return basePassFlags_; }
+
     /// Return per-pixel lights.
     const Vector<Light*>& GetLights() const { return lights_; }
 
@@ -342,8 +353,16 @@ protected:
     bool zoneDirty_;
     /// Octree octant.
     Octant* octant_;
+    /// Proxy index in the octree's dynamic BVH, or NINDEX if not in the BVH.
+    i32 spatialProxy_{NINDEX};
+    /// Index in the octree's list of non-occludees kept outside the dynamic BVH, or NINDEX if not in the list.
+    i32 nonOccludeeIndex_{NINDEX};
     /// Current zone.
     Zone* zone_;
+    /// ID of the zone set the current zone was found from.
+    u32 zoneSetId_{};
+    /// Counter incremented when a listened node is marked dirty.
+    u32 transformVersion_{};
     /// View mask.
     mask32 viewMask_;
     /// Light mask.
@@ -0,0 +1,450 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "debug_renderer.h"
+#include "drawable.h"
+#include "dynamic_aabb_tree.h"
+
+#include "../common/debug_new.h"
+
+namespace dviglo
+{
+
+static const float DEFAULT_MARGIN = 0.1f;
+
+/// Return half of the surface area of a box. Used as the insertion cost heuristic.
+static inline float HalfArea(const BoundingBox& box)
+{
+    Vector3 size = box.Size();
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+/// Return union of two boxes.
+static inline BoundingBox Union(const BoundingBox& a, const BoundingBox& b)
+{
+    BoundingBox ret(a);
+    ret.Merge(b);
+    return ret;
+}
+
+/// Return box usable for the tree. Undefined boxes can not be hit by any query, so their location does not matter.
+static inline BoundingBox ValidBox(const BoundingBox& box)
+{
+    return box.Defined() ? box : BoundingBox(0.0f, 0.0f);
+}
+
+DynamicAabbTree::DynamicAabbTree() :
+    margin_(DEFAULT_MARGIN)
+{
+}
+
+i32 DynamicAabbTree::CreateProxy(const BoundingBox& box, Drawable* drawable)
+{
+    i32 proxyId = AllocateNode();
+    DynamicAabbTreeNode& node = nodes_[proxyId];
+    BoundingBox validBox = ValidBox(box);
+    node.box_ = BoundingBox(validBox.min_ - Vector3(margin_, margin_, margin_), validBox.max_ + Vector3(margin_, margin_, margin_));
+    node.drawable_ = drawable;
+    node.height_ = 0;
+
+    InsertLeaf(proxyId);
+    ++numProxies_;
+    return proxyId;
+}
+
+void DynamicAabbTree::DestroyProxy(i32 proxyId)
+{
+    assert(proxyId >= 0 && proxyId < nodes_.Size() && nodes_[proxyId].IsLeaf());
+
+    RemoveLeaf(proxyId);
+    FreeNode(proxyId);
+    --numProxies_;
+}
+
+bool DynamicAabbTree::MoveProxy(i32 proxyId, const BoundingBox& box)
+{
+    assert(proxyId >= 0 && proxyId < nodes_.Size() && nodes_[proxyId].IsLeaf());
+
+    BoundingBox validBox = ValidBox(box);
+    const BoundingBox& oldBox = nodes_[proxyId].box_;
+
+    // Keep the old box if it still contains the new one and is not excessively large, e.g. after the drawable shrunk
+    if (oldBox.IsInside(validBox) == INSIDE)
+    {
+        Vector3 slack = oldBox.Size() - validBox.Size();
+        float maxSlack = 4.0f * margin_;
+        if (slack.x <= maxSlack && slack.y <= maxSlack && slack.z <= maxSlack)
+            return false;
+    }
+
+    RemoveLeaf(proxyId);
+    nodes_[proxyId].box_ = BoundingBox(validBox.min_ - Vector3(margin_, margin_, margin_), validBox.max_ + Vector3(margin_, margin_, margin_));
+    InsertLeaf(proxyId);
+    return true;
+}
+
+void DynamicAabbTree::Clear()
+{
+    nodes_.Clear();
+    root_ = NINDEX;
+    freeList_ = NINDEX;
+    numProxies_ = 0;
+}
+
+void DynamicAabbTree::GetDrawables(OctreeQuery& query) const
+{
+    if (root_ != NINDEX)
+        GetDrawablesInternal(root_, query, false);
+}
+
+void DynamicAabbTree::Raycast(RayOctreeQuery& query) const
+{
+    if (root_ != NINDEX)
+        RaycastInternal(root_, query);
+}
+
+void DynamicAabbTree::GetDrawablesOnly(RayOctreeQuery& query, Vector<Drawable*>& drawables) const
+{
+    if (root_ != NINDEX)
+        GetDrawablesOnlyInternal(root_, query, drawables);
+}
+
+void DynamicAabbTree::draw_debug_geometry(DebugRenderer* debug, bool depthTest) const
+{
+    if (!debug)
+        return;
+
+    for (const DynamicAabbTreeNode& node : nodes_)
+    {
+        // Draw only internal nodes, leaves are shown by the drawables themselves
+        if (node.height_ > 0 && debug->IsInside(node.box_))
+            debug->AddBoundingBox(node.box_, Color(0.25f, 0.25f, 0.25f), depthTest);
+    }
+}
+
+i32 DynamicAabbTree::AllocateNode()
+{
+    i32 nodeId;
+
+    if (freeList_ != NINDEX)
+    {
+        nodeId = freeList_;
+        freeList_ = nodes_[nodeId].parent_;
+    }
+    else
+    {
+        nodeId = nodes_.Size();
+        nodes_.Resize(nodeId + 1);
+    }
+
+    DynamicAabbTreeNode& node = nodes_[nodeId];
+    node.drawable_ = nullptr;
+    node.parent_ = NINDEX;
+    node.child1_ = NINDEX;
+    node.child2_ = NINDEX;
+    node.height_ = 0;
+    return nodeId;
+}
+
+void DynamicAabbTree::FreeNode(i32 nodeId)
+{
+    DynamicAabbTreeNode& node = nodes_[nodeId];
+    node.drawable_ = nullptr;
+    node.child1_ = NINDEX;
+    node.child2_ = NINDEX;
+    node.height_ = NINDEX;
+    node.parent_ = freeList_;
+    freeList_ = nodeId;
+}
+
+void DynamicAabbTree::InsertLeaf(i32 leaf)
+{
+    if (root_ == NINDEX)
+    {
+        root_ = leaf;
+        nodes_[leaf].parent_ = NINDEX;
+        return;
+    }
+
+    // Find the best sibling by descending towards the child with the lowest cost of the enlarged area
+    BoundingBox leafBox = nodes_[leaf].box_;
+    i32 index = root_;
+    while (!nodes_[index].IsLeaf())
+    {
+        const DynamicAabbTreeNode& node = nodes_[index];
+        i32 child1 = node.child1_;
+        i32 child2 = node.child2_;
+
+        float area = HalfArea(node.box_);
+        float combinedArea = HalfArea(Union(node.box_, leafBox));
+
+        // Cost of creating a new parent for this node and the new leaf
+        float cost = 2.0f * combinedArea;
+        // Minimum cost of pushing the leaf further down the tree
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        float cost1 = HalfArea(Union(leafBox, nodes_[child1].box_)) + inheritanceCost;
+        if (!nodes_[child1].IsLeaf())
+            cost1 -= HalfArea(nodes_[child1].box_);
+
+        float cost2 = HalfArea(Union(leafBox, nodes_[child2].box_)) + inheritanceCost;
+        if (!nodes_[child2].IsLeaf())
+            cost2 -= HalfArea(nodes_[child2].box_);
+
+        if (cost < cost1 && cost < cost2)
+            break;
+
+        index = cost1 < cost2 ? child1 : child2;
+    }
+
+    i32 sibling = index;
+
+    // Create a new parent. Note: allocation may move the node storage, so nodes are accessed by index afterward
+    i32 oldParent = nodes_[sibling].parent_;
+    i32 newParent = AllocateNode();
+    nodes_[newParent].parent_ = oldParent;
+    nodes_[newParent].box_ = Union(leafBox, nodes_[sibling].box_);
+    nodes_[newParent].height_ = nodes_[sibling].height_ + 1;
+    nodes_[newParent].child1_ = sibling;
+    nodes_[newParent].child2_ = leaf;
+    nodes_[sibling].parent_ = newParent;
+    nodes_[leaf].parent_ = newParent;
+
+    if (oldParent != NINDEX)
+    {
+        if (nodes_[oldParent].child1_ == sibling)
+            nodes_[oldParent].child1_ = newParent;
+        else
+            nodes_[oldParent].child2_ = newParent;
+    }
+    else
+        root_ = newParent;
+
+    // Walk back up the tree fixing heights and boxes
+    Refit(newParent);
+}
+
+void DynamicAabbTree::RemoveLeaf(i32 leaf)
+{
+    if (leaf == root_)
+    {
+        root_ = NINDEX;
+        return;
+    }
+
+    i32 parent = nodes_[leaf].parent_;
+    i32 grandParent = nodes_[parent].parent_;
+    i32 sibling = nodes_[parent].child1_ == leaf ? nodes_[parent].child2_ : nodes_[parent].child1_;
+
+    if (grandParent != NINDEX)
+    {
+        // Destroy the parent and connect the sibling to the grandparent
+        if (nodes_[grandParent].child1_ == parent)
+            nodes_[grandParent].child1_ = sibling;
+        else
+            nodes_[grandParent].child2_ = sibling;
+        nodes_[sibling].parent_ = grandParent;
+        FreeNode(parent);
+
+        Refit(grandParent);
+    }
+    else
+    {
+        root_ = sibling;
+        nodes_[sibling].parent_ = NINDEX;
+        FreeNode(parent);
+    }
+}
+
+void DynamicAabbTree::Refit(i32 nodeId)
+{
+    i32 index = nodeId;
+    while (index != NINDEX)
+    {
+        index = Balance(index);
+
+        DynamicAabbTreeNode& node = nodes_[index];
+        const DynamicAabbTreeNode& child1 = nodes_[node.child1_];
+        const DynamicAabbTreeNode& child2 = nodes_[node.child2_];
+        node.height_ = 1 + Max(child1.height_, child2.height_);
+        node.box_ = Union(child1.box_, child2.box_);
+
+        index = node.parent_;
+    }
+}
+
+i32 DynamicAabbTree::Balance(i32 iA)
+{
+    DynamicAabbTreeNode* A = &nodes_[iA];
+    if (A->IsLeaf() || A->height_ < 2)
+        return iA;
+
+    i32 iB = A->child1_;
+    i32 iC = A->child2_;
+    DynamicAabbTreeNode* B = &nodes_[iB];
+    DynamicAabbTreeNode* C = &nodes_[iC];
+
+    i32 balance = C->height_ - B->height_;
+
+    // Rotate C up
+    if (balance > 1)
+    {
+        i32 iF = C->child1_;
+        i32 iG = C->child2_;
+        DynamicAabbTreeNode* F = &nodes_[iF];
+        DynamicAabbTreeNode* G = &nodes_[iG];
+
+        // Swap A and C
+        C->child1_ = iA;
+        C->parent_ = A->parent_;
+        A->parent_ = iC;
+
+        // A's old parent should point to C
+        if (C->parent_ != NINDEX)
+        {
+            if (nodes_[C->parent_].child1_ == iA)
+                nodes_[C->parent_].child1_ = iC;
+            else
+                nodes_[C->parent_].child2_ = iC;
+        }
+        else
+            root_ = iC;
+
+        // Keep the higher child of C under C
+        if (F->height_ > G->height_)
+        {
+            C->child2_ = iF;
+            A->child2_ = iG;
+            G->parent_ = iA;
+            A->box_ = Union(B->box_, G->box_);
+            C->box_ = Union(A->box_, F->box_);
+            A->height_ = 1 + Max(B->height_, G->height_);
+            C->height_ = 1 + Max(A->height_, F->height_);
+        }
+        else
+        {
+            C->child2_ = iG;
+            A->child2_ = iF;
+            F->parent_ = iA;
+            A->box_ = Union(B->box_, F->box_);
+            C->box_ = Union(A->box_, G->box_);
+            A->height_ = 1 + Max(B->height_, F->height_);
+            C->height_ = 1 + Max(A->height_, G->height_);
+        }
+
+        return iC;
+    }
+
+    // Rotate B up
+    if (balance < -1)
+    {
+        i32 iD = B->child1_;
+        i32 iE = B->child2_;
+        DynamicAabbTreeNode* D = &nodes_[iD];
+        DynamicAabbTreeNode* E = &nodes_[iE];
+
+        // Swap A and B
+        B->child1_ = iA;
+        B->parent_ = A->parent_;
+        A->parent_ = iB;
+
+        // A's old parent should point to B
+        if (B->parent_ != NINDEX)
+        {
+            if (nodes_[B->parent_].child1_ == iA)
+                nodes_[B->parent_].child1_ = iB;
+            else
+                nodes_[B->parent_].child2_ = iB;
+        }
+        else
+            root_ = iB;
+
+        // Keep the higher child of B under B
+        if (D->height_ > E->height_)
+        {
+            B->child2_ = iD;
+            A->child1_ = iE;
+            E->parent_ = iA;
+            A->box_ = Union(C->box_, E->box_);
+            B->box_ = Union(A->box_, D->box_);
+            A->height_ = 1 + Max(C->height_, E->height_);
+            B->height_ = 1 + Max(A->height_, D->height_);
+        }
+        else
+        {
+            B->child2_ = iE;
+            A->child1_ = iD;
+            D->parent_ = iA;
+            A->box_ = Union(C->box_, D->box_);
+            B->box_ = Union(A->box_, E->box_);
+            A->height_ = 1 + Max(C->height_, D->height_);
+            B->height_ = 1 + Max(A->height_, E->height_);
+        }
+
+        return iB;
+    }
+
+    return iA;
+}
+
+void DynamicAabbTree::GetDrawablesInternal(i32 nodeId, OctreeQuery& query, bool inside) const
+{
+    const DynamicAabbTreeNode& node = nodes_[nodeId];
+
+    // Leaves are tested by their exact bounding box in the query
+    if (node.IsLeaf())
+    {
+        Drawable* drawable = node.drawable_;
+        query.test_drawables(&drawable, &drawable + 1, inside);
+        return;
+    }
+
+    Intersection res = query.test_octant(node.box_, inside);
+    if (res == INSIDE)
+        inside = true;
+    else if (res == OUTSIDE)
+        return;
+
+    GetDrawablesInternal(node.child1_, query, inside);
+    GetDrawablesInternal(node.child2_, query, inside);
+}
+
+void DynamicAabbTree::RaycastInternal(i32 nodeId, RayOctreeQuery& query) const
+{
+    const DynamicAabbTreeNode& node = nodes_[nodeId];
+
+    if (query.ray_.HitDistance(node.box_) >= query.maxDistance_)
+        return;
+
+    if (node.IsLeaf())
+    {
+        Drawable* drawable = node.drawable_;
+        if (!!(drawable->GetDrawableType() & query.drawableTypes_) && (drawable->GetViewMask() & query.viewMask_))
+            drawable->ProcessRayQuery(query, query.result_);
+        return;
+    }
+
+    RaycastInternal(node.child1_, query);
+    RaycastInternal(node.child2_, query);
+}
+
+void DynamicAabbTree::GetDrawablesOnlyInternal(i32 nodeId, RayOctreeQuery& query, Vector<Drawable*>& drawables) const
+{
+    const DynamicAabbTreeNode& node = nodes_[nodeId];
+
+    if (query.ray_.HitDistance(node.box_) >= query.maxDistance_)
+        return;
+
+    if (node.IsLeaf())
+    {
+        Drawable* drawable = node.drawable_;
+        if (!!(drawable->GetDrawableType() & query.drawableTypes_) && (drawable->GetViewMask() & query.viewMask_))
+            drawables.Push(drawable);
+        return;
+    }
+
+    GetDrawablesOnlyInternal(node.child1_, query, drawables);
+    GetDrawablesOnlyInternal(node.child2_, query, drawables);
+}
+
+}
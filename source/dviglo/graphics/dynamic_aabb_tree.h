@@ -0,0 +1,110 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "octree_query.h"
+
+namespace dviglo
+{
+
+class DebugRenderer;
+class Drawable;
+
+/// Dynamic bounding volume hierarchy node.
+struct DynamicAabbTreeNode
+{
+    /// Return whether is a leaf node.
+    bool IsLeaf() const { return child1_ == NINDEX; }
+
+    /// Enlarged bounding box. For leaves the drawable's world bounding box plus margin.
+    BoundingBox box_;
+    /// Drawable for leaf nodes.
+    Drawable* drawable_{};
+    /// Parent node index, or next free node index if the node is in the free list.
+    i32 parent_{NINDEX};
+    /// First child node index.
+    i32 child1_{NINDEX};
+    /// Second child node index.
+    i32 child2_{NINDEX};
+    /// Height of the subtree. Leaves have 0, free nodes have NINDEX.
+    i32 height_{NINDEX};
+};
+
+/// Dynamic bounding volume hierarchy of drawables. Leaves use enlarged boxes, so that small movements do not need tree updates.
+/// Moved leaves are reinserted and the tree is kept balanced by local rotations. Has no fixed world size or depth limit.
+class DV_API DynamicAabbTree
+{
+public:
+    /// Construct.
+    DynamicAabbTree();
+
+    /// Prevent copy construction.
+    DynamicAabbTree(const DynamicAabbTree& rhs) = delete;
+    /// Prevent assignment.
+    DynamicAabbTree& operator =(const DynamicAabbTree& rhs) = delete;
+
+    /// Add a drawable with its world bounding box. Return proxy index.
+    i32 CreateProxy(const BoundingBox& box, Drawable* drawable);
+    /// Remove a proxy.
+    void DestroyProxy(i32 proxyId);
+    /// Update proxy bounding box. Return true if the proxy had to be reinserted.
+    bool MoveProxy(i32 proxyId, const BoundingBox& box);
+    /// Remove all proxies.
+    void Clear();
+    /// Set the margin added to leaf boxes.
+    void SetMargin(float margin) { margin_ = Max(margin, 0.0f); }
+
+    /// Return drawable objects by a query. Appends to the result vector.
+    void GetDrawables(OctreeQuery& query) const;
+    /// Return drawable objects by a ray query. Appends to the result vector.
+    void Raycast(RayOctreeQuery& query) const;
+    /// Return drawable objects whose bounding box may be hit by a ray query, without testing the drawables themselves.
+    void GetDrawablesOnly(RayOctreeQuery& query, Vector<Drawable*>& drawables) const;
+    /// Draw node boxes to the debug graphics.
+    void draw_debug_geometry(DebugRenderer* debug, bool depthTest) const;
+
+    /// Return proxy drawable.
+    Drawable* GetDrawable(i32 proxyId) const { return nodes_[proxyId].drawable_; }
+    /// Return enlarged proxy bounding box.
+    const BoundingBox& GetProxyBox(i32 proxyId) const { return nodes_[proxyId].box_; }
+    /// Return number of proxies.
+    i32 GetNumProxies() const { return numProxies_; }
+    /// Return tree height. Zero if empty or only one proxy.
+    i32 GetHeight() const { return root_ == NINDEX ? 0 : nodes_[root_].height_; }
+    /// Return leaf box margin.
+    float GetMargin() const { return margin_; }
+
+private:
+    /// Take a node from the free list or allocate a new one.
+    i32 AllocateNode();
+    /// Return a node to the free list.
+    void FreeNode(i32 nodeId);
+    /// Insert a leaf into the tree.
+    void InsertLeaf(i32 leaf);
+    /// Remove a leaf from the tree.
+    void RemoveLeaf(i32 leaf);
+    /// Rotate the subtree if it is unbalanced. Return the new root of the subtree.
+    i32 Balance(i32 a);
+    /// Recompute box and height of a node and its ancestors, rebalancing on the way.
+    void Refit(i32 nodeId);
+    /// Query a subtree, called internally.
+    void GetDrawablesInternal(i32 nodeId, OctreeQuery& query, bool inside) const;
+    /// Ray query a subtree, called internally.
+    void RaycastInternal(i32 nodeId, RayOctreeQuery& query) const;
+    /// Ray query a subtree for drawables only, called internally.
+    void GetDrawablesOnlyInternal(i32 nodeId, RayOctreeQuery& query, Vector<Drawable*>& drawables) const;
+
+    /// Nodes. Proxy indices are leaf node indices.
+    Vector<DynamicAabbTreeNode> nodes_;
+    /// Root node index.
+    i32 root_{NINDEX};
+    /// First free node index.
+    i32 freeList_{NINDEX};
+    /// Number of proxies.
+    i32 numProxies_{};
+    /// Leaf box margin.
+    float margin_;
+};
+
+}
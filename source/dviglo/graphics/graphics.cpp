@@ -7,6 +7,7 @@
 #include "animation.h"
 #include "animation_controller.h"
 #include "camera.h"
+#include "cdlod_terrain.h"
 #include "custom_geometry.h"
 #include "debug_renderer.h"
 #include "decal_set.h"
@@ -16,6 +17,7 @@
 #include "octree.h"
 #include "particle_effect.h"
 #include "particle_emitter.h"
+#include "potentially_visible_set.h"
 #include "ribbon_trail.h"
 #include "skybox.h"
 #include "static_model_group.h"
@@ -26,6 +28,7 @@
 #include "../graphics_api/graphics_impl.h"
 #include "../graphics_api/shader.h"
 #include "../graphics_api/shader_precache.h"
+#include "../graphics_api/shader_warmup.h"
 #include "../graphics_api/texture_2d.h"
 #include "../graphics_api/texture_2d_array.h"
 #include "../graphics_api/texture_3d.h"
@@ -144,56 +147,57 @@ bool Graphics::ToggleFullscreen()
     return SetScreenMode(primaryWindowMode_.width_, primaryWindowMode_.height_, primaryWindowMode_.screenParams_);
 }
 
-void Graphics::SetShaderParameter(StringHash param, const Variant& value)
+template <class ParamType>
+static void SetVariantShaderParameter(Graphics* graphics, const ParamType& param, const Variant& value)
 {
     switch (value.GetType())
     {
     case VAR_BOOL:
-        SetShaderParameter(param, value.GetBool());
+        graphics->SetShaderParameter(param, value.GetBool());
         break;
 
     case VAR_INT:
-        SetShaderParameter(param, value.GetI32());
+        graphics->SetShaderParameter(param, value.GetI32());
         break;
 
     case VAR_FLOAT:
     case VAR_DOUBLE:
-        SetShaderParameter(param, value.GetFloat());
+        graphics->SetShaderParameter(param, value.GetFloat());
         break;
 
     case VAR_VECTOR2:
-        SetShaderParameter(param, value.GetVector2());
+        graphics->SetShaderParameter(param, value.GetVector2());
         break;
 
     case VAR_VECTOR3:
-        SetShaderParameter(param, value.GetVector3());
+        graphics->SetShaderParameter(param, value.GetVector3());
         break;
 
     case VAR_VECTOR4:
-        SetShaderParameter(param, value.GetVector4());
+        graphics->SetShaderParameter(param, value.GetVector4());
         break;
 
     case VAR_COLOR:
-        SetShaderParameter(param, value.GetColor());
+        graphics->SetShaderParameter(param, value.GetColor());
         break;
 
     case VAR_MATRIX3:
-        SetShaderParameter(param, value.GetMatrix3());
+        graphics->SetShaderParameter(param, value.GetMatrix3());
         break;
 
     case VAR_MATRIX3X4:
-        SetShaderParameter(param, value.GetMatrix3x4());
+        graphics->SetShaderParameter(param, value.GetMatrix3x4());
         break;
 
     case VAR_MATRIX4:
-        SetShaderParameter(param, value.GetMatrix4());
+        graphics->SetShaderParameter(param, value.GetMatrix4());
         break;
 
     case VAR_BUFFER:
         {
             const Vector<byte>& buffer = value.GetBuffer();
             if (buffer.Size() >= sizeof(float))
-                SetShaderParameter(param, reinterpret_cast<const float*>(&buffer[0]), buffer.Size() / sizeof(float));
+                graphics->SetShaderParameter(param, reinterpret_cast<const float*>(&buffer[0]), buffer.Size() / sizeof(float));
         }
         break;
 
@@ -203,6 +207,16 @@ void Graphics::SetShaderParameter(StringHash param, const Variant& value)
     }
 }
 
+void Graphics::SetShaderParameter(StringHash param, const Variant& value)
+{
+    SetVariantShaderParameter(this, param, value);
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Variant& value)
+{
+    SetVariantShaderParameter(this, param, value);
+}
+
 IntVector2 Graphics::GetWindowPosition() const
 {
     if (window_)
@@ -361,6 +375,18 @@ void Graphics::PrecacheShaders(Deserializer& source)
     ShaderPrecache::load_shaders(this, source);
 }
 
+void Graphics::BeginPrecacheShaders(Deserializer& source, i32 maxMsPerFrame)
+{
+    shaderWarmup_ = new ShaderWarmup(source, maxMsPerFrame);
+    if (shaderWarmup_->IsFinished())
+        shaderWarmup_.Reset();
+}
+
+float Graphics::GetShaderPrecacheProgress() const
+{
+    return shaderWarmup_ ? shaderWarmup_->GetProgress() : 1.f;
+}
+
 void Graphics::AddGPUObject(GpuObject* object)
 {
     scoped_lock lock(gpuObjectMutex_);
@@ -686,6 +712,10 @@ bool Graphics::BeginFrame()
 
 void Graphics::EndFrame()
 {
+    // Compile part of the shaders being precached after the frame has been rendered
+    if (shaderWarmup_ && IsInitialized() && shaderWarmup_->Update())
+        shaderWarmup_.Reset();
+
     GAPI gapi = GParams::get_gapi();
 
 #ifdef DV_OPENGL
@@ -740,6 +770,18 @@ bool Graphics::ResolveToTexture(TextureCube* texture)
     return {}; // Prevent warning
 }
 
+bool Graphics::CopyDepth(Texture2D* destination, Texture2D* source)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return CopyDepth_OGL(destination, source);
+#endif
+
+    return {}; // Prevent warning
+}
+
 void Graphics::Draw(PrimitiveType type, unsigned vertexStart, unsigned vertexCount)
 {
     GAPI gapi = GParams::get_gapi();
@@ -851,7 +893,7 @@ void Graphics::SetShaderParameter(StringHash param, const float* data, unsigned
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, data, count);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), data, count);
 #endif
 }
 
@@ -861,7 +903,7 @@ void Graphics::SetShaderParameter(StringHash param, float value)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, value);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), value);
 #endif
 }
 
@@ -871,7 +913,7 @@ void Graphics::SetShaderParameter(StringHash param, int value)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, value);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), value);
 #endif
 }
 
@@ -881,7 +923,7 @@ void Graphics::SetShaderParameter(StringHash param, bool value)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, value);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), value);
 #endif
 }
 
@@ -891,7 +933,7 @@ void Graphics::SetShaderParameter(StringHash param, const Color& color)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, color);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), color);
 #endif
 }
 
@@ -901,7 +943,7 @@ void Graphics::SetShaderParameter(StringHash param, const Vector2& vector)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, vector);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), vector);
 #endif
 }
 
@@ -911,7 +953,7 @@ void Graphics::SetShaderParameter(StringHash param, const Matrix3& matrix)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, matrix);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), matrix);
 #endif
 }
 
@@ -921,7 +963,7 @@ void Graphics::SetShaderParameter(StringHash param, const Vector3& vector)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, vector);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), vector);
 #endif
 }
 
@@ -931,7 +973,7 @@ void Graphics::SetShaderParameter(StringHash param, const Matrix4& matrix)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, matrix);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), matrix);
 #endif
 }
 
@@ -941,7 +983,7 @@ void Graphics::SetShaderParameter(StringHash param, const Vector4& vector)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, vector);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), vector);
 #endif
 }
 
@@ -951,7 +993,117 @@ void Graphics::SetShaderParameter(StringHash param, const Matrix3x4& matrix)
 
 #ifdef DV_OPENGL
     if (gapi == GAPI_OPENGL)
-        return SetShaderParameter_OGL(param, matrix);
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), matrix);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const float* data, unsigned count)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), data, count);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, float value)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), value);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, int value)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), value);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, bool value)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), value);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Color& color)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), color);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Vector2& vector)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), vector);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Matrix3& matrix)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), matrix);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Vector3& vector)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), vector);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Matrix4& matrix)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), matrix);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Vector4& vector)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), vector);
+#endif
+}
+
+void Graphics::SetShaderParameter(const ShaderParameterSlot& param, const Matrix3x4& matrix)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return SetShaderParameter_OGL(GetShaderParameter_OGL(param), matrix);
 #endif
 }
 
@@ -979,6 +1131,18 @@ bool Graphics::HasShaderParameter(StringHash param)
     return {}; // Prevent warning
 }
 
+bool Graphics::HasShaderParameter(const ShaderParameterSlot& param)
+{
+    GAPI gapi = GParams::get_gapi();
+
+#ifdef DV_OPENGL
+    if (gapi == GAPI_OPENGL)
+        return HasShaderParameter_OGL(param);
+#endif
+
+    return {}; // Prevent warning
+}
+
 bool Graphics::HasTextureUnit(TextureUnit unit)
 {
     GAPI gapi = GParams::get_gapi();
@@ -1628,6 +1792,7 @@ void register_graphics_library()
     Animation::register_object();
     Material::register_object();
     Model::register_object();
+    PvsData::register_object();
     Shader::register_object();
     Technique::register_object();
     Texture2D::register_object();
@@ -1650,9 +1815,11 @@ void register_graphics_library()
     DecalSet::register_object();
     Terrain::register_object();
     TerrainPatch::register_object();
+    CdlodTerrain::register_object();
     DebugRenderer::register_object();
     Octree::register_object();
     Zone::register_object();
+    PotentiallyVisibleSet::register_object();
 }
 
 }
@@ -28,6 +28,7 @@ class IndexBuffer;
 class RenderSurface;
 class Shader;
 class ShaderPrecache;
+class ShaderWarmup;
 class ShaderVariation;
 class Texture;
 class Texture2D;
@@ -222,6 +223,8 @@ public:
     bool ResolveToTexture(Texture2D* texture);
     /// Resolve a multisampled cube texture on itself.
     bool ResolveToTexture(TextureCube* texture);
+    /// Copy the contents of a depth-stencil texture to another with the same size and format. Return false if not supported.
+    bool CopyDepth(Texture2D* destination, Texture2D* source);
     /// Draw non-indexed geometry.
     void Draw(PrimitiveType type, unsigned vertexStart, unsigned vertexCount);
     /// Draw indexed geometry.
@@ -268,10 +271,36 @@ public:
     void SetShaderParameter(StringHash param, const Matrix3x4& matrix);
     /// Set shader constant from a variant. Supported variant types: bool, float, vector2, vector3, vector4, color.
     void SetShaderParameter(StringHash param, const Variant& value);
+    /// Set shader float constants by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const float* data, unsigned count);
+    /// Set shader float constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, float value);
+    /// Set shader integer constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, int value);
+    /// Set shader boolean constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, bool value);
+    /// Set shader color constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Color& color);
+    /// Set shader 2D vector constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Vector2& vector);
+    /// Set shader 3x3 matrix constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Matrix3& matrix);
+    /// Set shader 3D vector constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Vector3& vector);
+    /// Set shader 4x4 matrix constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Matrix4& matrix);
+    /// Set shader 4D vector constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Vector4& vector);
+    /// Set shader 3x4 matrix constant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Matrix3x4& matrix);
+    /// Set shader constant from a variant by slot.
+    void SetShaderParameter(const ShaderParameterSlot& param, const Variant& value);
     /// Check whether a shader parameter group needs update. Does not actually check whether parameters exist in the shaders.
     bool NeedParameterUpdate(ShaderParameterGroup group, const void* source);
     /// Check whether a shader parameter exists on the currently set shaders.
     bool HasShaderParameter(StringHash param);
+    /// Check whether a shader parameter exists on the currently set shaders.
+    bool HasShaderParameter(const ShaderParameterSlot& param);
     /// Check whether the current vertex or pixel shader uses a texture unit.
     bool HasTextureUnit(TextureUnit unit);
     /// Clear remembered shader parameter source group.
@@ -335,6 +364,8 @@ public:
     void EndDumpShaders();
     /// Precache shader variations from an XML file generated with BeginDumpShaders().
     void PrecacheShaders(Deserializer& source);
+    /// Begin precaching shader variations from an XML file generated with BeginDumpShaders(). Shader sources load in the background and compiling is spread over frames.
+    void BeginPrecacheShaders(Deserializer& source, i32 maxMsPerFrame = 4);
 
     /// Return whether rendering initialized.
     bool IsInitialized() const;
@@ -483,6 +514,18 @@ public:
     /// Return current pixel shader.
     ShaderVariation* GetPixelShader() const { return pixelShader_; }
 
+    /// Return base directory for shaders.
+    const String& GetShaderPath() const { return shaderPath_; }
+
+    /// Return file extension for shaders.
+    const String& GetShaderExtension() const { return shaderExtension_; }
+
+    /// Return whether shaders are being precached in the background.
+    bool IsPrecachingShaders() const { return shaderWarmup_.NotNull(); }
+
+    /// Return the precached fraction of the shader variations being precached in the background. Return 1 if not precaching.
+    float GetShaderPrecacheProgress() const;
+
 #ifdef DV_OPENGL
     // Note: ShaderProgram_OGL class is purposefully API-specific. It should not be used by Urho3D client applications.
 
@@ -740,6 +783,7 @@ private:
     bool ResolveToTexture_OGL(Texture2D* destination, const IntRect& viewport);
     bool ResolveToTexture_OGL(Texture2D* texture);
     bool ResolveToTexture_OGL(TextureCube* texture);
+    bool CopyDepth_OGL(Texture2D* destination, Texture2D* source);
     void Draw_OGL(PrimitiveType type, unsigned vertexStart, unsigned vertexCount);
     void Draw_OGL(PrimitiveType type, unsigned indexStart, unsigned indexCount, unsigned minVertex, unsigned vertexCount);
     void Draw_OGL(PrimitiveType type, unsigned indexStart, unsigned indexCount, unsigned baseVertexIndex, unsigned minVertex, unsigned vertexCount);
@@ -750,19 +794,22 @@ private:
     bool SetVertexBuffers_OGL(const Vector<std::shared_ptr<VertexBuffer>>& buffers, unsigned instanceOffset = 0);
     void SetIndexBuffer_OGL(IndexBuffer* buffer);
     void SetShaders_OGL(ShaderVariation* vs, ShaderVariation* ps);
-    void SetShaderParameter_OGL(StringHash param, const float* data, unsigned count);
-    void SetShaderParameter_OGL(StringHash param, float value);
-    void SetShaderParameter_OGL(StringHash param, int value);
-    void SetShaderParameter_OGL(StringHash param, bool value);
-    void SetShaderParameter_OGL(StringHash param, const Color& color);
-    void SetShaderParameter_OGL(StringHash param, const Vector2& vector);
-    void SetShaderParameter_OGL(StringHash param, const Matrix3& matrix);
-    void SetShaderParameter_OGL(StringHash param, const Vector3& vector);
-    void SetShaderParameter_OGL(StringHash param, const Matrix4& matrix);
-    void SetShaderParameter_OGL(StringHash param, const Vector4& vector);
-    void SetShaderParameter_OGL(StringHash param, const Matrix3x4& matrix);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const float* data, unsigned count);
+    void SetShaderParameter_OGL(const ShaderParameter* info, float value);
+    void SetShaderParameter_OGL(const ShaderParameter* info, int value);
+    void SetShaderParameter_OGL(const ShaderParameter* info, bool value);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const Color& color);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const Vector2& vector);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const Matrix3& matrix);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const Vector3& vector);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const Matrix4& matrix);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const Vector4& vector);
+    void SetShaderParameter_OGL(const ShaderParameter* info, const Matrix3x4& matrix);
     bool NeedParameterUpdate_OGL(ShaderParameterGroup group, const void* source);
     bool HasShaderParameter_OGL(StringHash param);
+    bool HasShaderParameter_OGL(const ShaderParameterSlot& param);
+    const ShaderParameter* GetShaderParameter_OGL(StringHash param);
+    const ShaderParameter* GetShaderParameter_OGL(const ShaderParameterSlot& param);
     bool HasTextureUnit_OGL(TextureUnit unit);
     void ClearParameterSource_OGL(ShaderParameterGroup group);
     void ClearParameterSources_OGL();
@@ -972,6 +1019,8 @@ private:
     mutable String lastShaderName_;
     /// Shader precache utility.
     SharedPtr<ShaderPrecache> shaderPrecache_;
+    /// Shader variations being precached in the background.
+    SharedPtr<ShaderWarmup> shaderWarmup_;
     /// Allowed screen orientations.
     String orientations_;
 
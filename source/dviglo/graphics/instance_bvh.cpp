@@ -0,0 +1,168 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "instance_bvh.h"
+
+#include "../math/frustum.h"
+
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+static const i32 MAX_LEAF_INSTANCES = 8;
+static const i32 MAX_STACK_DEPTH = 64;
+
+void InstanceBvh::Build(const BoundingBox* boxes, i32 count)
+{
+    Clear();
+    if (count <= 0)
+        return;
+
+    order_.Resize(count);
+    for (i32 i = 0; i < count; ++i)
+        order_[i] = i;
+
+    BuildNode(boxes, 0, count);
+
+    // Leaf ranges are not aligned, so the padding allows loading four values from any start
+    for (Vector<float>* values : {&centerX_, &centerY_, &centerZ_, &extentX_, &extentY_, &extentZ_})
+        values->Resize(count + 3, 0.f);
+
+    for (i32 i = 0; i < count; ++i)
+    {
+        // Same arithmetic as Frustum::IsInside() so that the results match exactly
+        const BoundingBox& box = boxes[order_[i]];
+        Vector3 center = box.Center();
+        Vector3 edge = center - box.min_;
+        centerX_[i] = center.x;
+        centerY_[i] = center.y;
+        centerZ_[i] = center.z;
+        extentX_[i] = edge.x;
+        extentY_[i] = edge.y;
+        extentZ_[i] = edge.z;
+    }
+}
+
+void InstanceBvh::Clear()
+{
+    nodes_.Clear();
+    order_.Clear();
+    centerX_.Clear();
+    centerY_.Clear();
+    centerZ_.Clear();
+    extentX_.Clear();
+    extentY_.Clear();
+    extentZ_.Clear();
+}
+
+void InstanceBvh::Cull(const Frustum& frustum, Vector<i32>& dest) const
+{
+    if (nodes_.Empty())
+        return;
+
+    i32 stack[MAX_STACK_DEPTH];
+    i32 stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize)
+    {
+        i32 index = stack[--stackSize];
+        const InstanceBvhNode& node = nodes_[index];
+        Intersection result = frustum.IsInside(node.box_);
+        if (result == OUTSIDE)
+            continue;
+
+        if (result == INSIDE)
+        {
+            // No need to test the instances of a node that is completely inside
+            for (i32 i = node.start_; i < node.start_ + node.count_; ++i)
+                dest.Push(order_[i]);
+        }
+        else if (node.secondChild_ == NINDEX)
+            CullLeaf(frustum, node.start_, node.count_, dest);
+        else
+        {
+            stack[stackSize++] = node.secondChild_;
+            stack[stackSize++] = index + 1;
+        }
+    }
+}
+
+i32 InstanceBvh::BuildNode(const BoundingBox* boxes, i32 start, i32 count)
+{
+    i32 index = nodes_.Size();
+    nodes_.Push(InstanceBvhNode{BoundingBox(), start, count, NINDEX});
+
+    BoundingBox box;
+    BoundingBox centers;
+    for (i32 i = start; i < start + count; ++i)
+    {
+        box.Merge(boxes[order_[i]]);
+        centers.Merge(boxes[order_[i]].Center());
+    }
+    nodes_[index].box_ = box;
+
+    if (count <= MAX_LEAF_INSTANCES)
+        return index;
+
+    // Split at the median of the centers along the longest axis. This keeps the depth logarithmic
+    Vector3 size = centers.Size();
+    i32 axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+    i32 half = count / 2;
+    nth_element(order_.Begin() + start, order_.Begin() + start + half, order_.Begin() + start + count,
+        [boxes, axis](i32 lhs, i32 rhs) { return boxes[lhs].Center().Data()[axis] < boxes[rhs].Center().Data()[axis]; });
+
+    BuildNode(boxes, start, half);
+    i32 secondChild = BuildNode(boxes, start + half, count - half);
+    nodes_[index].secondChild_ = secondChild;
+    return index;
+}
+
+void InstanceBvh::CullLeaf(const Frustum& frustum, i32 start, i32 count, Vector<i32>& dest) const
+{
+    const __m128 zero = _mm_setzero_ps();
+
+    for (i32 i = 0; i < count; i += 4)
+    {
+        i32 base = start + i;
+        __m128 cx = _mm_loadu_ps(&centerX_[base]);
+        __m128 cy = _mm_loadu_ps(&centerY_[base]);
+        __m128 cz = _mm_loadu_ps(&centerZ_[base]);
+        __m128 ex = _mm_loadu_ps(&extentX_[base]);
+        __m128 ey = _mm_loadu_ps(&extentY_[base]);
+        __m128 ez = _mm_loadu_ps(&extentZ_[base]);
+        __m128 outside = zero;
+
+        for (const Plane& plane : frustum.planes_)
+        {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(plane.normal_.x), cx),
+                _mm_mul_ps(_mm_set1_ps(plane.normal_.y), cy)),
+                _mm_mul_ps(_mm_set1_ps(plane.normal_.z), cz)),
+                _mm_set1_ps(plane.d_));
+            __m128 absDist = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(plane.absNormal_.x), ex),
+                _mm_mul_ps(_mm_set1_ps(plane.absNormal_.y), ey)),
+                _mm_mul_ps(_mm_set1_ps(plane.absNormal_.z), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_sub_ps(zero, absDist)));
+        }
+
+        i32 visible = ~_mm_movemask_ps(outside) & 0xf;
+        if (count - i < 4)
+            visible &= (1 << (count - i)) - 1;
+
+        for (i32 j = 0; j < 4; ++j)
+        {
+            if (visible & (1 << j))
+                dest.Push(order_[base + j]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/vector.h"
+#include "../math/bounding_box.h"
+
+namespace dviglo
+{
+
+class Frustum;
+
+/// Node of an instance bounding volume hierarchy.
+struct InstanceBvhNode
+{
+    /// Bounding box of all instances below the node.
+    BoundingBox box_;
+    /// First index into the instance order.
+    i32 start_;
+    /// Number of instances below the node.
+    i32 count_;
+    /// Index of the second child. The first child follows the node. NINDEX for a leaf.
+    i32 secondChild_;
+};
+
+/// Bounding volume hierarchy over instance bounding boxes for frustum culling.
+class DV_API InstanceBvh
+{
+public:
+    /// Build from instance bounding boxes.
+    void Build(const BoundingBox* boxes, i32 count);
+    /// Clear the hierarchy.
+    void Clear();
+    /// Append indices of the instances whose bounding boxes are inside or intersect the frustum. Leaf instances are tested four at a time with SSE.
+    void Cull(const Frustum& frustum, Vector<i32>& dest) const;
+
+    /// Return number of instances.
+    i32 GetNumInstances() const { return order_.Size(); }
+    /// Return nodes. The first is the root.
+    const Vector<InstanceBvhNode>& GetNodes() const { return nodes_; }
+
+private:
+    /// Build a node over a range of the instance order and return its index.
+    i32 BuildNode(const BoundingBox* boxes, i32 start, i32 count);
+    /// Test a leaf range with SSE and append the instances that are not outside.
+    void CullLeaf(const Frustum& frustum, i32 start, i32 count, Vector<i32>& dest) const;
+
+    /// Nodes. The first is the root.
+    Vector<InstanceBvhNode> nodes_;
+    /// Instance indices in the node order.
+    Vector<i32> order_;
+    /// Box centers and half sizes in the node order, padded to a multiple of four.
+    Vector<float> centerX_, centerY_, centerZ_, extentX_, extentY_, extentZ_;
+};
+
+}
@@ -9,6 +9,7 @@
 #include "graphics.h"
 #include "light.h"
 #include "octree_query.h"
+#include "static_shadow_cache.h"
 #include "../graphics_api/texture_2d.h"
 #include "../graphics_api/texture_cube.h"
 #include "../io/log.h"
@@ -621,6 +622,19 @@ void Light::SetLightQueue(LightBatchQueue* queue)
     lightQueue_ = queue;
 }
 
+StaticShadowCache* Light::GetStaticShadowCache()
+{
+    if (!staticShadowCache_)
+        staticShadowCache_ = std::make_unique<StaticShadowCache>();
+
+    return staticShadowCache_.get();
+}
+
+void Light::ResetStaticShadowCache()
+{
+    staticShadowCache_.reset();
+}
+
 Matrix3x4 Light::GetFullscreenQuadTransform(Camera* camera)
 {
     Matrix3x4 quadTransform;
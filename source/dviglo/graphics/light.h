@@ -11,10 +11,13 @@
 #include "../math/color.h"
 #include "../math/frustum.h"
 
+#include <memory>
+
 namespace dviglo
 {
 
 class Camera;
+class StaticShadowCache;
 struct LightBatchQueue;
 
 /// %Light types.
@@ -291,6 +294,10 @@ public:
 
     /// Return light queue. Called by View.
     LightBatchQueue* GetLightQueue() const { return lightQueue_; }
+    /// Return static shadow map cache, creating it if necessary. Called by View.
+    StaticShadowCache* GetStaticShadowCache();
+    /// Release static shadow map cache.
+    void ResetStaticShadowCache();
 
     /// Return a divisor value based on intensity for calculating the sort value.
     float GetIntensityDivisor(float attenuation = 1.0f) const
@@ -345,6 +352,8 @@ private:
     SharedPtr<Texture> shapeTexture_;
     /// Light queue.
     LightBatchQueue* lightQueue_;
+    /// Static shadow map cache.
+    std::unique_ptr<StaticShadowCache> staticShadowCache_;
     /// Specular intensity.
     float specularIntensity_;
     /// Brightness multiplier.
@@ -392,6 +392,7 @@ bool Material::Load(const XmlElement& source)
 
     XmlElement techniqueElem = source.GetChild("technique");
     techniques_.Clear();
+    Technique::MarkStateChanged();
 
     while (techniqueElem)
     {
@@ -545,6 +546,7 @@ bool Material::Load(const JSONValue& source)
     JSONArray techniquesArray = source.Get("techniques").GetArray();
     techniques_.Clear();
     techniques_.Reserve(techniquesArray.Size());
+    Technique::MarkStateChanged();
 
     for (const JSONValue& techVal : techniquesArray)
     {
@@ -896,6 +898,7 @@ void Material::SetNumTechniques(i32 num)
         return;
 
     techniques_.Resize(num);
+    Technique::MarkStateChanged();
     RefreshMemoryUse();
 }
 
@@ -907,6 +910,7 @@ void Material::SetTechnique(i32 index, Technique* tech, MaterialQuality qualityL
         return;
 
     techniques_[index] = TechniqueEntry(tech, qualityLevel, lodDistance);
+    Technique::MarkStateChanged();
     ApplyShaderDefines(index);
 }
 
@@ -930,11 +934,13 @@ void Material::SetPixelShaderDefines(const String& defines)
 
 void Material::SetShaderParameter(const String& name, const Variant& value)
 {
+    StringHash nameHash(name);
+
     MaterialShaderParameter newParam;
     newParam.name_ = name;
+    newParam.slot_ = ShaderParameterSlot(nameHash);
     newParam.value_ = value;
 
-    StringHash nameHash(name);
     shaderParameters_[nameHash] = newParam;
 
     if (nameHash == PSP_MATSPECCOLOR)
@@ -1149,6 +1155,7 @@ SharedPtr<Material> Material::Clone(const String& cloneName) const
 void Material::SortTechniques()
 {
     sort(techniques_.Begin(), techniques_.End(), CompareTechniqueEntries);
+    Technique::MarkStateChanged();
 }
 
 void Material::MarkForAuxView(i32 frameNumber)
@@ -1360,6 +1367,8 @@ void Material::ApplyShaderDefines(i32 index/* = NINDEX*/)
     if (index >= techniques_.Size() || !techniques_[index].original_)
         return;
 
+    Technique::MarkStateChanged();
+
     if (vertexShaderDefines_.Empty() && pixelShaderDefines_.Empty())
         techniques_[index].technique_ = techniques_[index].original_;
     else
@@ -32,6 +32,8 @@ struct MaterialShaderParameter
 {
     /// Name.
     String name_;
+    /// Slot resolved from the name, so that batches set the parameter without a hash map lookup.
+    ShaderParameterSlot slot_;
     /// Value.
     Variant value_;
 };
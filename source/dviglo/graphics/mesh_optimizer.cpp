@@ -0,0 +1,436 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "mesh_optimizer.h"
+
+#include "../containers/vector.h"
+#include "../math/math_defs.h"
+#include "../math/vector3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+// Cache size that the vertex cache optimization models. Forsyth recommends 32, which also suits smaller caches
+static const i32 FORSYTH_CACHE_SIZE = 32;
+// Valences above this use the score of the maximum
+static const i32 FORSYTH_MAX_VALENCE = 32;
+
+namespace
+{
+
+// FIFO cache simulation. Cache entries store the time when the vertex was loaded
+class VertexCacheSimulator
+{
+public:
+    VertexCacheSimulator(i32 vertexCount, i32 cacheSize) :
+        loadTimes_(vertexCount, 0),
+        cacheSize_(cacheSize)
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        // Make all vertices older than the cache
+        time_ += cacheSize_;
+    }
+
+    // Return 1 if the vertex had to be transformed
+    i32 Access(u32 vertex)
+    {
+        if (time_ - loadTimes_[vertex] < cacheSize_)
+            return 0;
+
+        loadTimes_[vertex] = ++time_;
+        return 1;
+    }
+
+    i32 AccessTriangle(const u32* triangle) { return Access(triangle[0]) + Access(triangle[1]) + Access(triangle[2]); }
+
+private:
+    Vector<i32> loadTimes_;
+    i32 cacheSize_;
+    i32 time_{};
+};
+
+struct ForsythScores
+{
+    ForsythScores()
+    {
+        const float cacheDecayPower = 1.5f;
+        const float lastTriScore = 0.75f;
+        const float valenceBoostScale = 2.0f;
+        const float valenceBoostPower = 0.5f;
+
+        for (i32 i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+        {
+            // The vertices of the last triangle get a fixed score, so that the next triangle does not depend on their order
+            if (i < 3)
+                cache_[i] = lastTriScore;
+            else
+                cache_[i] = powf(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), cacheDecayPower);
+        }
+
+        valence_[0] = 0.f;
+        for (i32 i = 1; i <= FORSYTH_MAX_VALENCE; ++i)
+            valence_[i] = valenceBoostScale * powf((float)i, -valenceBoostPower);
+    }
+
+    float Get(i32 cachePosition, i32 valence) const
+    {
+        // Vertices without remaining triangles are never needed again
+        if (valence == 0)
+            return -1.f;
+
+        float score = valence_[Min(valence, FORSYTH_MAX_VALENCE)];
+        if (cachePosition >= 0)
+            score += cache_[cachePosition];
+        return score;
+    }
+
+    float cache_[FORSYTH_CACHE_SIZE];
+    float valence_[FORSYTH_MAX_VALENCE + 1];
+};
+
+const ForsythScores forsythScores;
+
+} // namespace
+
+float CalculateACMR(const u32* indices, i32 indexCount, i32 vertexCount, i32 cacheSize)
+{
+    assert(indexCount >= 0 && indexCount % 3 == 0 && vertexCount >= 0 && cacheSize >= 3);
+
+    if (!indexCount)
+        return 0.f;
+
+    VertexCacheSimulator cache(vertexCount, cacheSize);
+    i32 misses = 0;
+    for (i32 i = 0; i < indexCount; i += 3)
+        misses += cache.AccessTriangle(indices + i);
+
+    return (float)misses / (indexCount / 3);
+}
+
+void OptimizeVertexCache(u32* indices, i32 indexCount, i32 vertexCount)
+{
+    assert(indexCount >= 0 && indexCount % 3 == 0 && vertexCount >= 0);
+
+    const i32 triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    // Triangles adjacent to each vertex. Emitted triangles are moved past the live count of the vertex
+    Vector<i32> liveTriangles(vertexCount, 0);
+    for (i32 i = 0; i < indexCount; ++i)
+    {
+        assert(indices[i] < (u32)vertexCount);
+        ++liveTriangles[indices[i]];
+    }
+
+    Vector<i32> adjacencyOffsets(vertexCount);
+    i32 offset = 0;
+    for (i32 i = 0; i < vertexCount; ++i)
+    {
+        adjacencyOffsets[i] = offset;
+        offset += liveTriangles[i];
+    }
+
+    Vector<i32> adjacency(indexCount);
+    Vector<i32> adjacencyCounts(vertexCount, 0);
+    i32* adjacencyData = &adjacency[0];
+    for (i32 i = 0; i < indexCount; ++i)
+    {
+        u32 vertex = indices[i];
+        adjacencyData[adjacencyOffsets[vertex] + adjacencyCounts[vertex]++] = i / 3;
+    }
+
+    Vector<i32> cachePositions(vertexCount, -1);
+    Vector<float> vertexScores(vertexCount);
+    for (i32 i = 0; i < vertexCount; ++i)
+        vertexScores[i] = forsythScores.Get(-1, liveTriangles[i]);
+
+    Vector<float> triangleScores(triangleCount);
+    Vector<bool> emitted(triangleCount, false);
+    i32 bestTriangle = 0;
+    for (i32 i = 0; i < triangleCount; ++i)
+    {
+        const u32* triangle = indices + i * 3;
+        triangleScores[i] = vertexScores[triangle[0]] + vertexScores[triangle[1]] + vertexScores[triangle[2]];
+        if (triangleScores[i] > triangleScores[bestTriangle])
+            bestTriangle = i;
+    }
+
+    // The cache has room for the vertices of the new triangle before the oldest ones are dropped
+    u32 cache[FORSYTH_CACHE_SIZE + 3];
+    u32 newCache[FORSYTH_CACHE_SIZE + 3];
+    i32 cacheSize = 0;
+
+    Vector<u32> result(indexCount);
+    i32 searchStart = 0;
+
+    for (i32 emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        // None of the cached vertices has triangles left. Take the next triangle in the original order
+        if (bestTriangle == NINDEX)
+        {
+            while (emitted[searchStart])
+                ++searchStart;
+            bestTriangle = searchStart;
+        }
+
+        const u32* triangle = indices + bestTriangle * 3;
+        memcpy(&result[emittedCount * 3], triangle, 3 * sizeof(u32));
+        emitted[bestTriangle] = true;
+
+        // Move the triangle out of the live part of the adjacency lists
+        for (i32 i = 0; i < 3; ++i)
+        {
+            u32 vertex = triangle[i];
+            i32* begin = adjacencyData + adjacencyOffsets[vertex];
+            i32* end = begin + liveTriangles[vertex];
+            i32* found = find(begin, end, bestTriangle);
+            assert(found != end);
+            swap(*found, *(end - 1));
+            --liveTriangles[vertex];
+        }
+
+        // The triangle vertices go to the front of the LRU cache
+        i32 newCacheSize = 0;
+        for (i32 i = 0; i < 3; ++i)
+        {
+            if (find(newCache, newCache + newCacheSize, triangle[i]) == newCache + newCacheSize)
+                newCache[newCacheSize++] = triangle[i];
+        }
+        for (i32 i = 0; i < cacheSize; ++i)
+        {
+            u32 vertex = cache[i];
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                newCache[newCacheSize++] = vertex;
+        }
+
+        // Update the scores of the vertices that moved in the cache or fell out of it
+        for (i32 i = 0; i < newCacheSize; ++i)
+        {
+            u32 vertex = newCache[i];
+            cachePositions[vertex] = i < FORSYTH_CACHE_SIZE ? i : -1;
+            float score = forsythScores.Get(cachePositions[vertex], liveTriangles[vertex]);
+            float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+
+            const i32* neighbours = adjacencyData + adjacencyOffsets[vertex];
+            for (i32 j = 0; j < liveTriangles[vertex]; ++j)
+                triangleScores[neighbours[j]] += delta;
+        }
+
+        // The next triangle is the best one that uses a cached vertex
+        bestTriangle = NINDEX;
+        float bestScore = -1.f;
+        for (i32 i = 0; i < newCacheSize; ++i)
+        {
+            u32 vertex = newCache[i];
+            const i32* neighbours = adjacencyData + adjacencyOffsets[vertex];
+            for (i32 j = 0; j < liveTriangles[vertex]; ++j)
+            {
+                if (triangleScores[neighbours[j]] > bestScore)
+                {
+                    bestTriangle = neighbours[j];
+                    bestScore = triangleScores[neighbours[j]];
+                }
+            }
+        }
+
+        cacheSize = Min(newCacheSize, FORSYTH_CACHE_SIZE);
+        memcpy(cache, newCache, cacheSize * sizeof(u32));
+    }
+
+    memcpy(indices, &result[0], indexCount * sizeof(u32));
+}
+
+void OptimizeOverdraw(u32* indices, i32 indexCount, const byte* positions, i32 positionStride, i32 vertexCount,
+    float threshold)
+{
+    assert(indexCount >= 0 && indexCount % 3 == 0 && vertexCount >= 0 && positionStride >= (i32)sizeof(Vector3));
+
+    const i32 triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    VertexCacheSimulator cache(vertexCount, DEFAULT_VERTEX_CACHE_SIZE);
+
+    // Hard boundaries are where the vertex cache order starts a new patch, so the cache is reloaded anyway
+    Vector<i32> hardBoundaries;
+    for (i32 i = 0; i < triangleCount; ++i)
+    {
+        if (cache.AccessTriangle(indices + i * 3) == 3)
+            hardBoundaries.Push(i);
+    }
+    if (hardBoundaries.Empty() || hardBoundaries[0] != 0)
+        hardBoundaries.Insert(0, 0);
+    hardBoundaries.Push(triangleCount);
+
+    // Split the patches further while the ACMR stays under the threshold
+    Vector<i32> clusters;
+    for (i32 i = 0; i + 1 < hardBoundaries.Size(); ++i)
+    {
+        i32 start = hardBoundaries[i];
+        i32 end = hardBoundaries[i + 1];
+
+        cache.Reset();
+        i32 patchMisses = 0;
+        for (i32 j = start; j < end; ++j)
+            patchMisses += cache.AccessTriangle(indices + j * 3);
+
+        float clusterThreshold = threshold * patchMisses / (end - start);
+
+        clusters.Push(start);
+        cache.Reset();
+        i32 clusterStart = start;
+        i32 clusterMisses = 0;
+        for (i32 j = start; j < end - 1; ++j)
+        {
+            clusterMisses += cache.AccessTriangle(indices + j * 3);
+            if ((float)clusterMisses / (j - clusterStart + 1) <= clusterThreshold)
+            {
+                clusters.Push(j + 1);
+                cache.Reset();
+                clusterStart = j + 1;
+                clusterMisses = 0;
+            }
+        }
+    }
+    clusters.Push(triangleCount);
+
+    const i32 clusterCount = clusters.Size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    auto position = [&](u32 vertex) { return *reinterpret_cast<const Vector3*>(positions + vertex * positionStride); };
+
+    Vector3 meshCenter = Vector3::ZERO;
+    for (i32 i = 0; i < indexCount; ++i)
+        meshCenter += position(indices[i]);
+    meshCenter /= (float)indexCount;
+
+    // Sort key is how much the cluster faces away from the mesh center. These clusters are likely to occlude others
+    Vector<float> sortKeys(clusterCount);
+    for (i32 i = 0; i < clusterCount; ++i)
+    {
+        Vector3 center = Vector3::ZERO;
+        Vector3 normal = Vector3::ZERO;
+        float area = 0.f;
+
+        for (i32 j = clusters[i]; j < clusters[i + 1]; ++j)
+        {
+            Vector3 p0 = position(indices[j * 3]);
+            Vector3 p1 = position(indices[j * 3 + 1]);
+            Vector3 p2 = position(indices[j * 3 + 2]);
+            Vector3 cross = (p1 - p0).CrossProduct(p2 - p0);
+            float triangleArea = cross.Length();
+
+            center += (p0 + p1 + p2) * (triangleArea / 3.f);
+            normal += cross;
+            area += triangleArea;
+        }
+
+        float normalLength = normal.Length();
+        center = area > 0.f ? center / area : position(indices[clusters[i] * 3]);
+        sortKeys[i] = normalLength > 0.f ? (center - meshCenter).DotProduct(normal) / normalLength : 0.f;
+    }
+
+    Vector<i32> order(clusterCount);
+    for (i32 i = 0; i < clusterCount; ++i)
+        order[i] = i;
+    stable_sort(order.Begin(), order.End(), [&](i32 lhs, i32 rhs) { return sortKeys[lhs] > sortKeys[rhs]; });
+
+    Vector<u32> result(indexCount);
+    i32 resultSize = 0;
+    for (i32 cluster : order)
+    {
+        i32 clusterIndexCount = (clusters[cluster + 1] - clusters[cluster]) * 3;
+        memcpy(&result[resultSize], indices + clusters[cluster] * 3, clusterIndexCount * sizeof(u32));
+        resultSize += clusterIndexCount;
+    }
+
+    memcpy(indices, &result[0], indexCount * sizeof(u32));
+}
+
+i32 GenerateVertexRemap(i32* remap, const byte* vertices, i32 vertexCount, i32 vertexSize)
+{
+    assert(vertexCount >= 0 && vertexSize > 0);
+
+    // Open addressing hash table of vertex indices with at most 50% load
+    i32 tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize <<= 1;
+    Vector<i32> table(tableSize, NINDEX);
+
+    i32 uniqueCount = 0;
+    for (i32 i = 0; i < vertexCount; ++i)
+    {
+        const byte* vertex = vertices + i * vertexSize;
+        hash32 hash = 0;
+        for (i32 j = 0; j < vertexSize; ++j)
+            hash = SDBMHash(hash, vertex[j]);
+
+        i32 slot = hash & (tableSize - 1);
+        while (table[slot] != NINDEX && memcmp(vertices + table[slot] * vertexSize, vertex, vertexSize))
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == NINDEX)
+        {
+            table[slot] = i;
+            remap[i] = uniqueCount++;
+        }
+        else
+        {
+            remap[i] = remap[table[slot]];
+        }
+    }
+
+    return uniqueCount;
+}
+
+i32 GenerateVertexFetchRemap(i32* remap, const u32* indices, i32 indexCount, i32 vertexCount)
+{
+    assert(indexCount >= 0 && vertexCount >= 0);
+
+    fill(remap, remap + vertexCount, NINDEX);
+
+    i32 usedCount = 0;
+    for (i32 i = 0; i < indexCount; ++i)
+    {
+        u32 vertex = indices[i];
+        if (remap[vertex] == NINDEX)
+            remap[vertex] = usedCount++;
+    }
+
+    return usedCount;
+}
+
+void RemapIndices(u32* indices, i32 indexCount, const i32* remap)
+{
+    for (i32 i = 0; i < indexCount; ++i)
+    {
+        assert(remap[indices[i]] != NINDEX);
+        indices[i] = (u32)remap[indices[i]];
+    }
+}
+
+void RemapVertices(byte* dest, const byte* vertices, i32 vertexCount, i32 vertexSize, const i32* remap)
+{
+    for (i32 i = 0; i < vertexCount; ++i)
+    {
+        if (remap[i] != NINDEX)
+            memcpy(dest + remap[i] * vertexSize, vertices + i * vertexSize, vertexSize);
+    }
+}
+
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../common/config.h"
+
+#include "../common/primitive_types.h"
+#include "../containers/flag_set.h"
+
+namespace dviglo
+{
+
+/// Vertex cache size for the ACMR calculation, which is close to the cache of modern GPUs.
+inline constexpr i32 DEFAULT_VERTEX_CACHE_SIZE = 16;
+/// Maximum allowed ACMR increase from the overdraw optimization.
+inline constexpr float DEFAULT_OVERDRAW_THRESHOLD = 1.05f;
+
+/// Mesh optimization steps.
+enum class MeshOptimizations : u32
+{
+    None          = 0,
+    /// Reorder triangles for the post-transform vertex cache.
+    VertexCache   = 1 << 0,
+    /// Reorder triangle clusters so that outer triangles are drawn first.
+    Overdraw      = 1 << 1,
+    /// Reorder vertices by first use in the index data and remove unused vertices.
+    VertexFetch   = 1 << 2,
+    /// Merge vertices with identical data.
+    MergeVertices = 1 << 3,
+    All           = VertexCache | Overdraw | VertexFetch | MergeVertices,
+};
+DV_FLAGS(MeshOptimizations);
+
+/// Mesh optimization results.
+struct MeshOptimizationStats
+{
+    /// Average cache miss ratio before optimization.
+    float acmrBefore_{};
+    /// Average cache miss ratio after optimization.
+    float acmrAfter_{};
+    /// Vertex count before optimization.
+    i32 verticesBefore_{};
+    /// Vertex count after optimization.
+    i32 verticesAfter_{};
+    /// Number of optimized triangles.
+    i32 triangles_{};
+};
+
+/// Return average cache miss ratio (transformed vertices per triangle) of a triangle list with a FIFO post-transform
+/// vertex cache. 3 is the worst, 0.5 is the best possible for large regular meshes.
+DV_API float CalculateACMR(const u32* indices, i32 indexCount, i32 vertexCount, i32 cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+/// Reorder the triangles of a triangle list in place for the post-transform vertex cache. Uses the linear-speed vertex
+/// cache optimisation by Tom Forsyth.
+DV_API void OptimizeVertexCache(u32* indices, i32 indexCount, i32 vertexCount);
+
+/// Reorder clusters of a vertex cache optimized triangle list in place so that outward facing triangles at the edges of
+/// the mesh are drawn first. The clusters are split so that ACMR grows at most by the threshold factor.
+DV_API void OptimizeOverdraw(u32* indices, i32 indexCount, const byte* positions, i32 positionStride, i32 vertexCount,
+    float threshold = DEFAULT_OVERDRAW_THRESHOLD);
+
+/// Fill a remap table that maps vertices with identical data to the same new index. Return unique vertex count.
+DV_API i32 GenerateVertexRemap(i32* remap, const byte* vertices, i32 vertexCount, i32 vertexSize);
+
+/// Fill a remap table that orders vertices by first use in the index data. Unused vertices are mapped to NINDEX.
+/// Return used vertex count.
+DV_API i32 GenerateVertexFetchRemap(i32* remap, const u32* indices, i32 indexCount, i32 vertexCount);
+
+/// Rewrite indices in place through a remap table.
+DV_API void RemapIndices(u32* indices, i32 indexCount, const i32* remap);
+
+/// Copy vertices to their remapped positions. Vertices that are mapped to NINDEX are dropped, vertices that are mapped to
+/// the same index must be identical.
+DV_API void RemapVertices(byte* dest, const byte* vertices, i32 vertexCount, i32 vertexSize, const i32* remap);
+
+}
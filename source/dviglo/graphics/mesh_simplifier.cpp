@@ -0,0 +1,309 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "mesh_simplifier.h"
+
+#include "../containers/hash.h"
+#include "../containers/hash_set.h"
+#include "../containers/vector.h"
+#include "../math/bounding_box.h"
+#include "../math/math_defs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+namespace
+{
+
+// Sum of squared distances to planes, weighted by triangle area
+struct Quadric
+{
+    void AddPlane(const Vector3& normal, float distance, float weight)
+    {
+        double a = normal.x, b = normal.y, c = normal.z, d = distance;
+        a2_ += a * a * weight; b2_ += b * b * weight; c2_ += c * c * weight; d2_ += d * d * weight;
+        ab_ += a * b * weight; ac_ += a * c * weight; ad_ += a * d * weight;
+        bc_ += b * c * weight; bd_ += b * d * weight; cd_ += c * d * weight;
+        weight_ += weight;
+    }
+
+    void Add(const Quadric& rhs)
+    {
+        a2_ += rhs.a2_; b2_ += rhs.b2_; c2_ += rhs.c2_; d2_ += rhs.d2_;
+        ab_ += rhs.ab_; ac_ += rhs.ac_; ad_ += rhs.ad_;
+        bc_ += rhs.bc_; bd_ += rhs.bd_; cd_ += rhs.cd_;
+        weight_ += rhs.weight_;
+    }
+
+    // Return weighted average of squared distances
+    float Evaluate(const Vector3& point) const
+    {
+        if (weight_ <= 0.0)
+            return 0.f;
+
+        double x = point.x, y = point.y, z = point.z;
+        double error = a2_ * x * x + b2_ * y * y + c2_ * z * z + 2.0 * (ab_ * x * y + ac_ * x * z + bc_ * y * z) +
+            2.0 * (ad_ * x + bd_ * y + cd_ * z) + d2_;
+        return (float)Max(error / weight_, 0.0);
+    }
+
+    double a2_{}, b2_{}, c2_{}, d2_{}, ab_{}, ac_{}, ad_{}, bc_{}, bd_{}, cd_{};
+    double weight_{};
+};
+
+struct Collapse
+{
+    u32 from_;
+    u32 to_;
+    float error_;
+};
+
+} // namespace
+
+i32 SimplifyMesh(u32* dest, const u32* indices, i32 indexCount, const byte* positions, i32 positionStride,
+    i32 vertexCount, i32 targetIndexCount, float maxError, float* resultError)
+{
+    assert(indexCount >= 0 && indexCount % 3 == 0 && vertexCount >= 0 && positionStride >= (i32)sizeof(Vector3));
+
+    if (dest != indices)
+        memcpy(dest, indices, indexCount * sizeof(u32));
+    if (resultError)
+        *resultError = 0.f;
+    if (indexCount <= targetIndexCount || !vertexCount)
+        return indexCount;
+
+    auto position = [&](u32 vertex) -> const Vector3& { return *(const Vector3*)(positions + vertex * positionStride); };
+
+    BoundingBox box;
+    for (i32 i = 0; i < vertexCount; ++i)
+        box.Merge(position(i));
+    const float extent = Max(box.Size().Length(), M_EPSILON);
+    const float maxSquaredError = maxError * maxError * extent * extent;
+
+    // Vertices at the same position, split by UV or normal seams, refer to the first of them
+    Vector<u32> positionIds(vertexCount);
+    Vector<i32> positionUsers(vertexCount, 0);
+    {
+        i32 tableSize = 1;
+        while (tableSize < vertexCount * 2)
+            tableSize <<= 1;
+        Vector<i32> table(tableSize, NINDEX);
+
+        for (i32 i = 0; i < vertexCount; ++i)
+        {
+            const Vector3& p = position(i);
+            hash32 hash = 0;
+            for (i32 j = 0; j < 3; ++j)
+            {
+                hash32 bits;
+                memcpy(&bits, &p.Data()[j], sizeof(bits));
+                CombineHash(hash, bits);
+            }
+
+            i32 slot = hash & (tableSize - 1);
+            while (table[slot] != NINDEX && position(table[slot]) != p)
+                slot = (slot + 1) & (tableSize - 1);
+
+            if (table[slot] == NINDEX)
+                table[slot] = i;
+            positionIds[i] = table[slot];
+            ++positionUsers[table[slot]];
+        }
+    }
+
+    // Lock seams and open borders. A border edge has no opposite edge between the same positions
+    Vector<bool> locked(vertexCount, false);
+    for (i32 i = 0; i < vertexCount; ++i)
+        locked[i] = positionUsers[positionIds[i]] > 1;
+
+    {
+        HashSet<u64> edges;
+        for (i32 i = 0; i < indexCount; i += 3)
+        {
+            for (i32 j = 0; j < 3; ++j)
+            {
+                u64 a = positionIds[dest[i + j]];
+                u64 b = positionIds[dest[i + (j + 1) % 3]];
+                edges.Insert(a << 32u | b);
+            }
+        }
+
+        for (i32 i = 0; i < indexCount; i += 3)
+        {
+            for (i32 j = 0; j < 3; ++j)
+            {
+                u32 a = dest[i + j];
+                u32 b = dest[i + (j + 1) % 3];
+                if (!edges.Contains((u64)positionIds[b] << 32u | positionIds[a]))
+                {
+                    locked[a] = true;
+                    locked[b] = true;
+                }
+            }
+        }
+    }
+
+    Vector<Quadric> quadrics(vertexCount);
+    for (i32 i = 0; i < indexCount; i += 3)
+    {
+        const Vector3& p0 = position(dest[i]);
+        Vector3 normal = (position(dest[i + 1]) - p0).CrossProduct(position(dest[i + 2]) - p0);
+        float area = normal.Length();
+        if (area <= 0.f)
+            continue;
+
+        normal /= area;
+        float distance = -normal.DotProduct(p0);
+        for (i32 j = 0; j < 3; ++j)
+            quadrics[dest[i + j]].AddPlane(normal, distance, area);
+    }
+
+    Vector<u32> remap(vertexCount);
+    Vector<bool> touched(vertexCount);
+    Vector<i32> adjacencyOffsets(vertexCount + 1);
+    Vector<i32> adjacency;
+    Vector<Collapse> collapses;
+    float error = 0.f;
+
+    while (indexCount > targetIndexCount)
+    {
+        // Triangles around each vertex
+        fill(adjacencyOffsets.Begin(), adjacencyOffsets.End(), 0);
+        for (i32 i = 0; i < indexCount; ++i)
+            ++adjacencyOffsets[dest[i] + 1];
+        for (i32 i = 0; i < vertexCount; ++i)
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        adjacency.Resize(indexCount);
+        for (i32 i = 0; i < indexCount; ++i)
+            adjacency[adjacencyOffsets[dest[i]]++] = i / 3;
+        // Filling moved each offset to the start of the next vertex
+        for (i32 i = vertexCount; i > 0; --i)
+            adjacencyOffsets[i] = adjacencyOffsets[i - 1];
+        adjacencyOffsets[0] = 0;
+
+        // The cheapest collapse of each unlocked vertex
+        collapses.Clear();
+        for (i32 i = 0; i < vertexCount; ++i)
+        {
+            if (locked[i] || adjacencyOffsets[i] == adjacencyOffsets[i + 1])
+                continue;
+
+            Collapse best{(u32)i, (u32)i, M_INFINITY};
+            for (i32 j = adjacencyOffsets[i]; j < adjacencyOffsets[i + 1]; ++j)
+            {
+                const u32* triangle = dest + adjacency[j] * 3;
+                for (i32 k = 0; k < 3; ++k)
+                {
+                    if (triangle[k] == (u32)i)
+                        continue;
+
+                    float collapseError = quadrics[i].Evaluate(position(triangle[k]));
+                    if (collapseError < best.error_)
+                        best = Collapse{(u32)i, triangle[k], collapseError};
+                }
+            }
+
+            if (best.to_ != (u32)i && best.error_ <= maxSquaredError)
+                collapses.Push(best);
+        }
+
+        if (collapses.Empty())
+            break;
+
+        sort(collapses.Begin(), collapses.End(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.error_ < rhs.error_; });
+
+        for (i32 i = 0; i < vertexCount; ++i)
+            remap[i] = i;
+        fill(touched.Begin(), touched.End(), false);
+
+        // Collapse the cheapest edges whose neighbourhoods are not changed in this pass yet
+        i32 remainingIndexCount = indexCount;
+        i32 numCollapsed = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (remainingIndexCount <= targetIndexCount)
+                break;
+
+            u32 from = collapse.from_;
+            u32 to = collapse.to_;
+            if (touched[from] || touched[to])
+                continue;
+
+            // Do not flip triangles that are only moved, the triangles with both vertices degenerate
+            bool flips = false;
+            i32 removedTriangles = 0;
+            for (i32 j = adjacencyOffsets[from]; j < adjacencyOffsets[from + 1] && !flips; ++j)
+            {
+                const u32* triangle = dest + adjacency[j] * 3;
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                {
+                    ++removedTriangles;
+                    continue;
+                }
+
+                Vector3 p[3];
+                Vector3 moved[3];
+                for (i32 k = 0; k < 3; ++k)
+                {
+                    p[k] = position(triangle[k]);
+                    moved[k] = triangle[k] == from ? position(to) : p[k];
+                }
+
+                Vector3 normal = (p[1] - p[0]).CrossProduct(p[2] - p[0]);
+                Vector3 movedNormal = (moved[1] - moved[0]).CrossProduct(moved[2] - moved[0]);
+                flips = normal.DotProduct(movedNormal) <= 0.f;
+            }
+
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            quadrics[to].Add(quadrics[from]);
+            error = Max(error, collapse.error_);
+            remainingIndexCount -= removedTriangles * 3;
+            ++numCollapsed;
+
+            for (i32 j = adjacencyOffsets[from]; j < adjacencyOffsets[from + 1]; ++j)
+            {
+                const u32* triangle = dest + adjacency[j] * 3;
+                for (i32 k = 0; k < 3; ++k)
+                    touched[triangle[k]] = true;
+            }
+        }
+
+        if (!numCollapsed)
+            break;
+
+        // Apply the collapses and remove the degenerate triangles
+        i32 newIndexCount = 0;
+        for (i32 i = 0; i < indexCount; i += 3)
+        {
+            u32 a = remap[dest[i]];
+            u32 b = remap[dest[i + 1]];
+            u32 c = remap[dest[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+
+            dest[newIndexCount++] = a;
+            dest[newIndexCount++] = b;
+            dest[newIndexCount++] = c;
+        }
+
+        indexCount = newIndexCount;
+    }
+
+    if (resultError)
+        *resultError = sqrtf(error) / extent;
+
+    return indexCount;
+}
+
+}
@@ -0,0 +1,22 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../common/config.h"
+
+#include "../common/primitive_types.h"
+
+namespace dviglo
+{
+
+/// Simplify a triangle list by collapsing edges in the order of the quadric error, until the index count is at most
+/// targetIndexCount or the next collapse would exceed maxError (distance relative to the mesh extents). Vertices are
+/// neither moved nor created: a collapse moves all triangles of a vertex to a neighbour, so UVs, normals and skinning
+/// weights stay valid. Vertices on open borders and on attribute seams (different vertices at the same position) are not
+/// collapsed. Dest must have room for indexCount indices and may be the same as indices. Return result index count and
+/// optionally the relative error.
+DV_API i32 SimplifyMesh(u32* dest, const u32* indices, i32 indexCount, const byte* positions, i32 positionStride,
+    i32 vertexCount, i32 targetIndexCount, float maxError = 1.f, float* resultError = nullptr);
+
+}
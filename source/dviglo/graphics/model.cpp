@@ -16,6 +16,7 @@
 #include "../resource/xml_file.h"
 #include "geometry.h"
 #include "graphics.h"
+#include "mesh_simplifier.h"
 
 #include "../common/debug_new.h"
 
@@ -729,6 +730,403 @@ SharedPtr<Model> Model::Clone(const String& cloneName) const
     return ret;
 }
 
+// Triangle list range of an index buffer
+struct OptimizedIndexRange
+{
+    i32 indexBuffer_;
+    i32 vertexBuffer_;
+    i32 start_;
+    i32 count_;
+};
+
+static Vector<u32> ReadIndices(const IndexBuffer* buffer)
+{
+    Vector<u32> indices(buffer->GetIndexCount());
+    const byte* data = buffer->GetShadowData();
+
+    for (i32 i = 0; i < indices.Size(); ++i)
+        indices[i] = buffer->GetIndexSize() == sizeof(u16) ? ((const u16*)data)[i] : ((const u32*)data)[i];
+
+    return indices;
+}
+
+static void WriteIndices(IndexBuffer* buffer, const Vector<u32>& indices)
+{
+    if (buffer->GetIndexSize() == sizeof(u32))
+    {
+        buffer->SetData(&indices[0]);
+        return;
+    }
+
+    Vector<u16> shortIndices(indices.Size());
+    for (i32 i = 0; i < indices.Size(); ++i)
+        shortIndices[i] = (u16)indices[i];
+    buffer->SetData(&shortIndices[0]);
+}
+
+MeshOptimizationStats Model::OptimizeGeometry(MeshOptimizations optimizations)
+{
+    DV_PROFILE(OptimizeModelGeometry);
+
+    MeshOptimizationStats stats;
+
+    // Vertex buffers that can be reordered: no morphs and used only with triangle lists of exclusive index buffers
+    Vector<bool> remapVertices(vertexBuffers_.Size());
+    for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+    {
+        remapVertices[i] = vertexBuffers_[i] && vertexBuffers_[i]->GetShadowData() &&
+            (i >= morphRangeCounts_.Size() || !morphRangeCounts_[i]);
+    }
+    for (const ModelMorph& morph : morphs_)
+    {
+        for (HashMap<i32, VertexBufferMorph>::ConstIterator i = morph.buffers_.Begin(); i != morph.buffers_.End(); ++i)
+        {
+            if (i->first_ >= 0 && i->first_ < remapVertices.Size())
+                remapVertices[i->first_] = false;
+        }
+    }
+
+    Vector<i32> indexBufferUsers(indexBuffers_.Size(), NINDEX);
+    Vector<bool> vertexBufferUsed(vertexBuffers_.Size(), false);
+    Vector<OptimizedIndexRange> ranges;
+
+    for (const Vector<shared_ptr<Geometry>>& lodLevels : geometries_)
+    {
+        for (const shared_ptr<Geometry>& geometry : lodLevels)
+        {
+            if (!geometry)
+                continue;
+
+            i32 ibIndex = indexBuffers_.IndexOf(geometry->GetIndexBuffer());
+            i32 vbIndex = geometry->GetNumVertexBuffers() == 1 ? vertexBuffers_.IndexOf(geometry->GetVertexBuffer(0))
+                : NINDEX;
+
+            bool valid = ibIndex != NINDEX && vbIndex != NINDEX && geometry->GetPrimitiveType() == TRIANGLE_LIST &&
+                geometry->GetIndexCount() % 3 == 0 && indexBuffers_[ibIndex]->GetShadowData() &&
+                vertexBuffers_[vbIndex]->GetShadowData();
+
+            if (!valid)
+            {
+                for (const shared_ptr<VertexBuffer>& buffer : geometry->GetVertexBuffers())
+                {
+                    i32 index = vertexBuffers_.IndexOf(buffer);
+                    if (index != NINDEX)
+                        remapVertices[index] = false;
+                }
+                continue;
+            }
+
+            vertexBufferUsed[vbIndex] = true;
+            if (indexBufferUsers[ibIndex] == NINDEX)
+                indexBufferUsers[ibIndex] = vbIndex;
+            else if (indexBufferUsers[ibIndex] != vbIndex)
+            {
+                remapVertices[indexBufferUsers[ibIndex]] = false;
+                remapVertices[vbIndex] = false;
+            }
+
+            OptimizedIndexRange range{ibIndex, vbIndex, geometry->GetIndexStart(), geometry->GetIndexCount()};
+            bool shared = false;
+            for (const OptimizedIndexRange& other : ranges)
+            {
+                if (other.indexBuffer_ == range.indexBuffer_ && other.start_ == range.start_ && other.count_ == range.count_)
+                    shared = true;
+            }
+
+            if (!shared && range.count_)
+                ranges.Push(range);
+        }
+    }
+
+    // Index buffers without geometries may refer to any vertex buffer
+    for (i32 i = 0; i < indexBuffers_.Size(); ++i)
+    {
+        if (indexBufferUsers[i] == NINDEX)
+        {
+            for (i32 j = 0; j < remapVertices.Size(); ++j)
+                remapVertices[j] = false;
+        }
+    }
+    for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+        remapVertices[i] = remapVertices[i] && vertexBufferUsed[i];
+
+    Vector<Vector<u32>> indices(indexBuffers_.Size());
+    for (i32 i = 0; i < indexBuffers_.Size(); ++i)
+    {
+        if (indexBufferUsers[i] != NINDEX)
+            indices[i] = ReadIndices(indexBuffers_[i].get());
+    }
+
+    for (const OptimizedIndexRange& range : ranges)
+    {
+        i32 vertexCount = vertexBuffers_[range.vertexBuffer_]->GetVertexCount();
+        stats.acmrBefore_ += CalculateACMR(&indices[range.indexBuffer_][range.start_], range.count_, vertexCount) *
+            (range.count_ / 3);
+        stats.triangles_ += range.count_ / 3;
+    }
+    for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+        stats.verticesBefore_ += vertexBuffers_[i] ? vertexBuffers_[i]->GetVertexCount() : 0;
+
+    // Working copies of the vertices that can be reordered
+    Vector<Vector<byte>> vertices(vertexBuffers_.Size());
+    Vector<i32> vertexCounts(vertexBuffers_.Size());
+    for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+    {
+        vertexCounts[i] = vertexBuffers_[i] ? vertexBuffers_[i]->GetVertexCount() : 0;
+        if (remapVertices[i] && vertexCounts[i])
+            vertices[i] = Vector<byte>(vertexBuffers_[i]->GetShadowData(), vertexCounts[i] * vertexBuffers_[i]->GetVertexSize());
+        else
+            remapVertices[i] = false;
+    }
+
+    // Merge the vertices first, so that the triangles can share them in the cache
+    if (!!(optimizations & MeshOptimizations::MergeVertices))
+    {
+        for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+        {
+            if (!remapVertices[i])
+                continue;
+
+            i32 vertexSize = vertexBuffers_[i]->GetVertexSize();
+            Vector<i32> remap(vertexCounts[i]);
+            i32 uniqueCount = GenerateVertexRemap(&remap[0], &vertices[i][0], vertexCounts[i], vertexSize);
+            if (uniqueCount == vertexCounts[i])
+                continue;
+
+            Vector<byte> merged(uniqueCount * vertexSize);
+            RemapVertices(&merged[0], &vertices[i][0], vertexCounts[i], vertexSize, &remap[0]);
+            for (i32 j = 0; j < indexBuffers_.Size(); ++j)
+            {
+                if (indexBufferUsers[j] == i)
+                    RemapIndices(&indices[j][0], indices[j].Size(), &remap[0]);
+            }
+            vertices[i] = merged;
+            vertexCounts[i] = uniqueCount;
+        }
+    }
+
+    // Reorder the triangles. Ranges that partially overlap are left as is, as reordering one would break the other
+    for (const OptimizedIndexRange& range : ranges)
+    {
+        bool overlaps = false;
+        for (const OptimizedIndexRange& other : ranges)
+        {
+            if (&other != &range && other.indexBuffer_ == range.indexBuffer_ && other.start_ < range.start_ + range.count_
+                && range.start_ < other.start_ + other.count_)
+                overlaps = true;
+        }
+
+        if (overlaps)
+            continue;
+
+        VertexBuffer* vertexBuffer = vertexBuffers_[range.vertexBuffer_].get();
+        i32 vertexCount = vertexCounts[range.vertexBuffer_];
+        u32* rangeIndices = &indices[range.indexBuffer_][range.start_];
+
+        if (!!(optimizations & MeshOptimizations::VertexCache))
+            OptimizeVertexCache(rangeIndices, range.count_, vertexCount);
+
+        const VertexElement* position = vertexBuffer->GetElement(TYPE_VECTOR3, SEM_POSITION);
+        if (!!(optimizations & MeshOptimizations::Overdraw) && position)
+        {
+            const byte* vertexData = remapVertices[range.vertexBuffer_] ? &vertices[range.vertexBuffer_][0] :
+                vertexBuffer->GetShadowData();
+            OptimizeOverdraw(rangeIndices, range.count_, vertexData + position->offset_, vertexBuffer->GetVertexSize(),
+                vertexCount);
+        }
+    }
+
+    // Reorder the vertices in the final drawing order
+    if (!!(optimizations & MeshOptimizations::VertexFetch))
+    {
+        for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+        {
+            if (!remapVertices[i])
+                continue;
+
+            // Drawing order first, then the indices that are not drawn by any geometry
+            Vector<u32> fetchOrder;
+            for (const OptimizedIndexRange& range : ranges)
+            {
+                if (range.vertexBuffer_ != i)
+                    continue;
+
+                for (i32 j = range.start_; j < range.start_ + range.count_; ++j)
+                    fetchOrder.Push(indices[range.indexBuffer_][j]);
+            }
+            for (i32 j = 0; j < indexBuffers_.Size(); ++j)
+            {
+                if (indexBufferUsers[j] == i)
+                    fetchOrder.Push(indices[j]);
+            }
+
+            i32 vertexSize = vertexBuffers_[i]->GetVertexSize();
+            Vector<i32> remap(vertexCounts[i]);
+            i32 usedCount = GenerateVertexFetchRemap(&remap[0], &fetchOrder[0], fetchOrder.Size(), vertexCounts[i]);
+
+            Vector<byte> reordered(usedCount * vertexSize);
+            if (usedCount)
+                RemapVertices(&reordered[0], &vertices[i][0], vertexCounts[i], vertexSize, &remap[0]);
+            for (i32 j = 0; j < indexBuffers_.Size(); ++j)
+            {
+                if (indexBufferUsers[j] == i)
+                    RemapIndices(&indices[j][0], indices[j].Size(), &remap[0]);
+            }
+            vertices[i] = reordered;
+            vertexCounts[i] = usedCount;
+        }
+    }
+
+    for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+    {
+        if (!remapVertices[i])
+            continue;
+
+        VertexBuffer* vertexBuffer = vertexBuffers_[i].get();
+        if (vertexCounts[i] != vertexBuffer->GetVertexCount())
+        {
+            Vector<VertexElement> elements = vertexBuffer->GetElements();
+            vertexBuffer->SetSize(vertexCounts[i], elements, vertexBuffer->IsDynamic());
+        }
+        if (vertexCounts[i])
+            vertexBuffer->SetData(&vertices[i][0]);
+    }
+
+    for (i32 i = 0; i < indexBuffers_.Size(); ++i)
+    {
+        if (indexBufferUsers[i] != NINDEX && indices[i].Size())
+            WriteIndices(indexBuffers_[i].get(), indices[i]);
+    }
+
+    // Update the used vertex ranges
+    for (const Vector<shared_ptr<Geometry>>& lodLevels : geometries_)
+    {
+        for (const shared_ptr<Geometry>& geometry : lodLevels)
+        {
+            if (geometry && geometry->GetIndexBuffer() && geometry->GetNumVertexBuffers())
+                geometry->SetDrawRange(geometry->GetPrimitiveType(), geometry->GetIndexStart(), geometry->GetIndexCount());
+        }
+    }
+
+    for (const OptimizedIndexRange& range : ranges)
+    {
+        i32 vertexCount = vertexBuffers_[range.vertexBuffer_]->GetVertexCount();
+        stats.acmrAfter_ += CalculateACMR(&indices[range.indexBuffer_][range.start_], range.count_, vertexCount) *
+            (range.count_ / 3);
+    }
+    for (i32 i = 0; i < vertexBuffers_.Size(); ++i)
+        stats.verticesAfter_ += vertexBuffers_[i] ? vertexBuffers_[i]->GetVertexCount() : 0;
+
+    if (stats.triangles_)
+    {
+        stats.acmrBefore_ /= stats.triangles_;
+        stats.acmrAfter_ /= stats.triangles_;
+    }
+
+    return stats;
+}
+
+i32 Model::GenerateLodLevels(const Vector<float>& triangleRatios, const Vector<float>& lodDistances, float maxError)
+{
+    if (triangleRatios.Size() != lodDistances.Size())
+    {
+        DV_LOGERROR("LOD triangle ratios and distances do not match");
+        return 0;
+    }
+
+    DV_PROFILE(GenerateModelLodLevels);
+
+    struct GeneratedLod
+    {
+        i32 geometry_;
+        i32 start_;
+        i32 count_;
+        float distance_;
+    };
+
+    // Indices to append to each index buffer
+    Vector<Vector<u32>> newIndices(indexBuffers_.Size());
+    Vector<GeneratedLod> lods;
+
+    for (i32 i = 0; i < geometries_.Size(); ++i)
+    {
+        if (geometries_[i].Size() != 1 || !geometries_[i][0])
+            continue;
+
+        Geometry* geometry = geometries_[i][0].get();
+        i32 ibIndex = indexBuffers_.IndexOf(geometry->GetIndexBuffer());
+        if (ibIndex == NINDEX || geometry->GetPrimitiveType() != TRIANGLE_LIST || geometry->GetIndexCount() % 3 ||
+            !geometry->GetIndexBuffer()->GetShadowData())
+            continue;
+
+        // The position element may be in any of the vertex buffers
+        VertexBuffer* positionBuffer = nullptr;
+        const VertexElement* position = nullptr;
+        for (const shared_ptr<VertexBuffer>& buffer : geometry->GetVertexBuffers())
+        {
+            position = buffer ? buffer->GetElement(TYPE_VECTOR3, SEM_POSITION) : nullptr;
+            if (position)
+            {
+                positionBuffer = buffer.get();
+                break;
+            }
+        }
+        if (!position || !positionBuffer->GetShadowData())
+            continue;
+
+        Vector<u32> indices = ReadIndices(geometry->GetIndexBuffer().get());
+        const u32* baseIndices = &indices[geometry->GetIndexStart()];
+        i32 baseCount = geometry->GetIndexCount();
+        i32 lastCount = baseCount;
+        Vector<u32> simplified(baseCount);
+
+        for (i32 j = 0; j < triangleRatios.Size(); ++j)
+        {
+            i32 targetCount = (i32)(baseCount / 3 * Clamp(triangleRatios[j], 0.f, 1.f)) * 3;
+            i32 count = SimplifyMesh(&simplified[0], baseIndices, baseCount, positionBuffer->GetShadowData() +
+                position->offset_, positionBuffer->GetVertexSize(), positionBuffer->GetVertexCount(), targetCount,
+                maxError);
+
+            // The mesh can not be simplified further within the error
+            if (!count || count >= lastCount)
+                break;
+
+            lods.Push(GeneratedLod{i, indices.Size() + newIndices[ibIndex].Size(), count, lodDistances[j]});
+            for (i32 k = 0; k < count; ++k)
+                newIndices[ibIndex].Push(simplified[k]);
+            lastCount = count;
+        }
+    }
+
+    for (i32 i = 0; i < indexBuffers_.Size(); ++i)
+    {
+        if (newIndices[i].Empty())
+            continue;
+
+        IndexBuffer* buffer = indexBuffers_[i].get();
+        Vector<u32> indices = ReadIndices(buffer);
+        indices.Push(newIndices[i]);
+        buffer->SetSize(indices.Size(), buffer->GetIndexSize() == sizeof(u32), buffer->IsDynamic());
+        WriteIndices(buffer, indices);
+    }
+
+    for (const GeneratedLod& lod : lods)
+    {
+        const shared_ptr<Geometry>& baseGeometry = geometries_[lod.geometry_][0];
+
+        shared_ptr<Geometry> geometry = make_shared<Geometry>();
+        geometry->SetNumVertexBuffers(baseGeometry->GetNumVertexBuffers());
+        for (i32 i = 0; i < baseGeometry->GetNumVertexBuffers(); ++i)
+            geometry->SetVertexBuffer(i, baseGeometry->GetVertexBuffer(i));
+        geometry->SetIndexBuffer(baseGeometry->GetIndexBuffer());
+        geometry->SetDrawRange(TRIANGLE_LIST, lod.start_, lod.count_);
+        geometry->SetLodDistance(lod.distance_);
+        geometries_[lod.geometry_].Push(geometry);
+    }
+
+    return lods.Size();
+}
+
 i32 Model::GetNumGeometryLodLevels(i32 index) const
 {
     assert(index >= 0);
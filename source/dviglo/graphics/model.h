@@ -8,6 +8,7 @@
 #include "../graphics_api/graphics_defs.h"
 #include "../math/bounding_box.h"
 #include "../resource/resource.h"
+#include "mesh_optimizer.h"
 #include "skeleton.h"
 
 namespace dviglo
@@ -128,6 +129,14 @@ public:
     void SetMorphs(const Vector<ModelMorph>& morphs);
     /// Clone the model. The geometry data is deep-copied and can be modified in the clone without affecting the original.
     SharedPtr<Model> Clone(const String& cloneName = String::EMPTY) const;
+    /// Optimize the triangle lists for the vertex cache and overdraw, merge duplicate vertices and reorder vertices for
+    /// fetch. Only shadowed buffers are optimized, and vertex buffers with morphs keep their vertices. Return ACMR and
+    /// vertex counts before and after.
+    MeshOptimizationStats OptimizeGeometry(MeshOptimizations optimizations = MeshOptimizations::All);
+    /// Generate LOD levels by mesh simplification for the triangle list geometries that have only one LOD level. Each
+    /// ratio is the target triangle count relative to the full geometry and uses the LOD distance at the same index.
+    /// The simplified indices are appended to the shadowed index buffers. Return number of generated LOD levels.
+    i32 GenerateLodLevels(const Vector<float>& triangleRatios, const Vector<float>& lodDistances, float maxError = 1.f);
 
     /// Return bounding box.
     const BoundingBox& GetBoundingBox() const { return boundingBox_; }
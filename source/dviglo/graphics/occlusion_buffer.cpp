@@ -5,9 +5,12 @@
 #include "../core/work_queue.h"
 #include "../core/profiler.h"
 #include "camera.h"
+#include "drawable.h"
 #include "occlusion_buffer.h"
 #include "../io/log.h"
 
+#include <emmintrin.h>
+
 #include "../common/debug_new.h"
 
 using namespace std;
@@ -32,6 +35,12 @@ static constexpr float OCCLUSION_RELATIVE_BIAS = 0.00001f;
 static constexpr int OCCLUSION_FIXED_BIAS = 16;
 static constexpr float OCCLUSION_X_SCALE = 65536.0f;
 static constexpr float OCCLUSION_Z_SCALE = 16777216.0f;
+static constexpr int OCCLUSION_SIMD_WIDTH = 4;
+static constexpr int OCCLUSION_REPROJECTION_BLOCK_SIZE = 8;
+static constexpr int OCCLUSION_REPROJECTION_ERODE_BLOCKS = 2;
+static constexpr float OCCLUSION_REPROJECTION_MAX_TRANSLATION = 0.1f;
+static constexpr float OCCLUSION_REPROJECTION_MAX_ROTATION = 15.0f;
+static constexpr float OCCLUSION_REPROJECTION_MAX_PARALLAX = 0.5f;
 
 void DrawOcclusionBatchWork(const WorkItem* item, i32 threadIndex)
 {
@@ -40,6 +49,28 @@ void DrawOcclusionBatchWork(const WorkItem* item, i32 threadIndex)
     buffer->DrawBatch(batch, threadIndex);
 }
 
+void RasterizeOcclusionTilesWork(const WorkItem* item, i32 threadIndex)
+{
+    auto* buffer = reinterpret_cast<OcclusionBuffer*>(item->aux_);
+    auto* start = reinterpret_cast<OcclusionTile*>(item->start_);
+    auto* end = reinterpret_cast<OcclusionTile*>(item->end_);
+    buffer->RasterizeTiles(start, end);
+}
+
+static inline float HorizontalMin(__m128 value)
+{
+    value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+    value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(value);
+}
+
+static inline float HorizontalMax(__m128 value)
+{
+    value = _mm_max_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+    value = _mm_max_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(value);
+}
+
 OcclusionBuffer::OcclusionBuffer()
     : maxTriangles_(OCCLUSION_DEFAULT_MAX_TRIANGLES)
 {
@@ -53,7 +84,11 @@ bool OcclusionBuffer::SetSize(int width, int height, bool threaded)
     if (height & 1u)
         ++height;
 
-    if (width == width_ && height == height_)
+    // The rasterizer processes rows in groups of SIMD width pixels
+    if (width < OCCLUSION_SIMD_WIDTH)
+        width = OCCLUSION_SIMD_WIDTH;
+
+    if (width == width_ && height == height_ && threaded == threaded_)
         return true;
 
     if (width <= 0 || height <= 0)
@@ -67,17 +102,35 @@ bool OcclusionBuffer::SetSize(int width, int height, bool threaded)
 
     width_ = width;
     height_ = height;
+    threaded_ = threaded;
+    ResetTemporalState();
+
+    // Reserve extra memory in case 3D clipping is not exact
+    buffer_.dataWithSafety_ = make_unique<int[]>(width * (height + 2) + 2);
+    buffer_.data_ = buffer_.dataWithSafety_.get() + width + 1;
+
+    // Build tiles. Tile width is a multiple of the SIMD width, so that row groups never cross tiles
+    numTilesX_ = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+    numTilesY_ = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+    tiles_.Resize(numTilesX_ * numTilesY_);
+    for (int y = 0; y < numTilesY_; ++y)
+    {
+        for (int x = 0; x < numTilesX_; ++x)
+        {
+            OcclusionTile& tile = tiles_[y * numTilesX_ + x];
+            tile.rect_ = IntRect(x * OCCLUSION_TILE_WIDTH, y * OCCLUSION_TILE_HEIGHT,
+                Min((x + 1) * OCCLUSION_TILE_WIDTH, width) - 1, Min((y + 1) * OCCLUSION_TILE_HEIGHT, height) - 1);
+        }
+    }
 
-    // Build work buffers for threading
-    unsigned numThreadBuffers = threaded ? DV_WORK_QUEUE->GetNumThreads() + 1 : 1;
-    buffers_.Resize(numThreadBuffers);
-    for (unsigned i = 0; i < numThreadBuffers; ++i)
+    // Build triangle bins for threading
+    i32 numThreadBins = threaded ? DV_WORK_QUEUE->GetNumThreads() + 1 : 1;
+    threadBins_.Resize(numThreadBins);
+    for (OcclusionThreadBins& bins : threadBins_)
     {
-        // Reserve extra memory in case 3D clipping is not exact
-        OcclusionBufferData& buffer = buffers_[i];
-        buffer.dataWithSafety_ = make_unique<int[]>(width * (height + 2) + 2);
-        buffer.data_ = buffer.dataWithSafety_.get() + width + 1;
-        buffer.used_ = false;
+        bins.triangles_.Clear();
+        bins.tiles_.Clear();
+        bins.tiles_.Resize(tiles_.Size());
     }
 
     mipBuffers_.Clear();
@@ -95,7 +148,7 @@ bool OcclusionBuffer::SetSize(int width, int height, bool threaded)
     }
 
     DV_LOGDEBUG("Set occlusion buffer size " + String(width_) + "x" + String(height_) + " with " +
-             String(mipBuffers_.Size()) + " mip levels and " + String(numThreadBuffers) + " thread buffers");
+             String(mipBuffers_.Size()) + " mip levels and " + String(tiles_.Size()) + " tiles");
 
     CalculateViewport();
     return true;
@@ -106,6 +159,13 @@ void OcclusionBuffer::SetView(Camera* camera)
     if (!camera)
         return;
 
+    // Saved depth of another camera can not be reused
+    if (camera != camera_)
+    {
+        ResetTemporalState();
+        camera_ = camera;
+    }
+
     view_ = camera->GetView();
     projection_ = camera->GetProjection();
     viewProj_ = projection_ * view_;
@@ -142,11 +202,7 @@ void OcclusionBuffer::Clear()
 {
     Reset();
 
-    // Only clear the main thread buffer. Rest are cleared on-demand when drawing the first batch
-    ClearBuffer(0);
-    for (OcclusionBufferData& buffer : buffers_)
-        buffer.used_ = false;
-
+    ClearBuffer();
     depthHierarchyDirty_ = true;
 }
 
@@ -188,17 +244,23 @@ bool OcclusionBuffer::AddTriangles(const Matrix3x4& model, const void* vertexDat
 
 void OcclusionBuffer::DrawTriangles()
 {
-    if (buffers_.Size() == 1)
+    if (!buffer_.data_)
+    {
+        batches_.Clear();
+        return;
+    }
+
+    if (!threaded_)
     {
         // Not threaded
-        for (Vector<OcclusionBatch>::Iterator i = batches_.Begin(); i != batches_.End(); ++i)
-            DrawBatch(*i, 0);
+        for (const OcclusionBatch& batch : batches_)
+            DrawBatch(batch, 0);
 
-        depthHierarchyDirty_ = true;
+        RasterizeTiles(tiles_.Buffer(), tiles_.Buffer() + tiles_.Size());
     }
-    else if (buffers_.Size() > 1)
+    else
     {
-        // Threaded
+        // Threaded. First set up and bin the triangles of each batch
         WorkQueue* queue = DV_WORK_QUEUE;
 
         for (Vector<OcclusionBatch>::Iterator i = batches_.Begin(); i != batches_.End(); ++i)
@@ -213,16 +275,42 @@ void OcclusionBuffer::DrawTriangles()
 
         queue->Complete(WI_MAX_PRIORITY);
 
-        MergeBuffers();
-        depthHierarchyDirty_ = true;
+        // Then rasterize. Each work item owns a range of whole tiles, so no merging is needed
+        i32 numTiles = tiles_.Size();
+        i32 numItems = Min(numTiles, (queue->GetNumThreads() + 1) * 4);
+        OcclusionTile* tiles = tiles_.Buffer();
+
+        for (i32 i = 0; i < numItems; ++i)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = WI_MAX_PRIORITY;
+            item->workFunction_ = RasterizeOcclusionTilesWork;
+            item->aux_ = this;
+            item->start_ = tiles + i * numTiles / numItems;
+            item->end_ = tiles + (i + 1) * numTiles / numItems;
+            queue->AddWorkItem(item);
+        }
+
+        queue->Complete(WI_MAX_PRIORITY);
+    }
+
+    for (OcclusionThreadBins& bins : threadBins_)
+    {
+        if (bins.triangles_.Empty())
+            continue;
+
+        bins.triangles_.Clear();
+        for (Vector<i32>& tile : bins.tiles_)
+            tile.Clear();
     }
 
+    depthHierarchyDirty_ = true;
     batches_.Clear();
 }
 
 void OcclusionBuffer::BuildDepthHierarchy()
 {
-    if (buffers_.Empty() || !depthHierarchyDirty_)
+    if (!buffer_.data_ || !depthHierarchyDirty_)
         return;
 
     ZoneScoped;
@@ -234,7 +322,7 @@ void OcclusionBuffer::BuildDepthHierarchy()
     {
         for (int y = 0; y < height; ++y)
         {
-            int* src = buffers_[0].data_ + (y * 2) * width_;
+            int* src = buffer_.data_ + (y * 2) * width_;
             DepthValue* dest = mipBuffers_[0].get() + y * width;
             DepthValue* end = dest + width;
 
@@ -324,50 +412,58 @@ void OcclusionBuffer::ResetUseTimer()
 
 bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
 {
-    if (buffers_.Empty())
-        return true;
-
-    // Transform corners to projection space
-    Vector4 vertices[8];
-    vertices[0] = ModelTransform(viewProj_, worldSpaceBox.min_);
-    vertices[1] = ModelTransform(viewProj_, Vector3(worldSpaceBox.max_.x, worldSpaceBox.min_.y, worldSpaceBox.min_.z));
-    vertices[2] = ModelTransform(viewProj_, Vector3(worldSpaceBox.min_.x, worldSpaceBox.max_.y, worldSpaceBox.min_.z));
-    vertices[3] = ModelTransform(viewProj_, Vector3(worldSpaceBox.max_.x, worldSpaceBox.max_.y, worldSpaceBox.min_.z));
-    vertices[4] = ModelTransform(viewProj_, Vector3(worldSpaceBox.min_.x, worldSpaceBox.min_.y, worldSpaceBox.max_.z));
-    vertices[5] = ModelTransform(viewProj_, Vector3(worldSpaceBox.max_.x, worldSpaceBox.min_.y, worldSpaceBox.max_.z));
-    vertices[6] = ModelTransform(viewProj_, Vector3(worldSpaceBox.min_.x, worldSpaceBox.max_.y, worldSpaceBox.max_.z));
-    vertices[7] = ModelTransform(viewProj_, worldSpaceBox.max_);
-
-    // Apply a far clip relative bias
-    for (auto& vertice : vertices)
-        vertice.z -= OCCLUSION_RELATIVE_BIAS;
-
-    // Transform to screen space. If any of the corners cross the near plane, assume visible
-    float minX, maxX, minY, maxY, minZ;
-
-    if (vertices[0].z <= 0.0f)
+    if (!buffer_.data_)
         return true;
 
-    Vector3 projected = ViewportTransform(vertices[0]);
-    minX = maxX = projected.x;
-    minY = maxY = projected.y;
-    minZ = projected.z;
-
-    // Project the rest
-    for (unsigned i = 1; i < 8; ++i)
+    // Transform corners to projection space, 4 corners at a time
+    const Vector3& boxMin = worldSpaceBox.min_;
+    const Vector3& boxMax = worldSpaceBox.max_;
+    __m128 cornerX = _mm_setr_ps(boxMin.x, boxMax.x, boxMin.x, boxMax.x);
+    __m128 cornerY = _mm_setr_ps(boxMin.y, boxMin.y, boxMax.y, boxMax.y);
+    __m128 minXV = _mm_set1_ps(M_INFINITY);
+    __m128 maxXV = _mm_set1_ps(-M_INFINITY);
+    __m128 minYV = minXV;
+    __m128 maxYV = maxXV;
+    __m128 minZV = minXV;
+
+    for (float cornerZScalar : {boxMin.z, boxMax.z})
     {
-        if (vertices[i].z <= 0.0f)
+        __m128 cornerZ = _mm_set1_ps(cornerZScalar);
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m00_), cornerX), _mm_mul_ps(_mm_set1_ps(viewProj_.m01_), cornerY)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m02_), cornerZ), _mm_set1_ps(viewProj_.m03_)));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m10_), cornerX), _mm_mul_ps(_mm_set1_ps(viewProj_.m11_), cornerY)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m12_), cornerZ), _mm_set1_ps(viewProj_.m13_)));
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m20_), cornerX), _mm_mul_ps(_mm_set1_ps(viewProj_.m21_), cornerY)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m22_), cornerZ), _mm_set1_ps(viewProj_.m23_)));
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m30_), cornerX), _mm_mul_ps(_mm_set1_ps(viewProj_.m31_), cornerY)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m32_), cornerZ), _mm_set1_ps(viewProj_.m33_)));
+
+        // Apply a far clip relative bias
+        z = _mm_sub_ps(z, _mm_set1_ps(OCCLUSION_RELATIVE_BIAS));
+
+        // If any of the corners cross the near plane, assume visible
+        if (_mm_movemask_ps(_mm_cmple_ps(z, _mm_setzero_ps())))
             return true;
 
-        projected = ViewportTransform(vertices[i]);
-
-        if (projected.x < minX) minX = projected.x;
-        if (projected.x > maxX) maxX = projected.x;
-        if (projected.y < minY) minY = projected.y;
-        if (projected.y > maxY) maxY = projected.y;
-        if (projected.z < minZ) minZ = projected.z;
+        // Transform to screen space
+        __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), w);
+        __m128 projectedX = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(x, invW), _mm_set1_ps(scaleX_)), _mm_set1_ps(offsetX_));
+        __m128 projectedY = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, invW), _mm_set1_ps(scaleY_)), _mm_set1_ps(offsetY_));
+        __m128 projectedZ = _mm_mul_ps(_mm_mul_ps(z, invW), _mm_set1_ps(OCCLUSION_Z_SCALE));
+
+        minXV = _mm_min_ps(minXV, projectedX);
+        maxXV = _mm_max_ps(maxXV, projectedX);
+        minYV = _mm_min_ps(minYV, projectedY);
+        maxYV = _mm_max_ps(maxYV, projectedY);
+        minZV = _mm_min_ps(minZV, projectedZ);
     }
 
+    float minX = HorizontalMin(minXV);
+    float maxX = HorizontalMax(maxXV);
+    float minY = HorizontalMin(minYV);
+    float maxY = HorizontalMax(maxYV);
+    float minZ = HorizontalMin(minZV);
+
     // Expand the bounding box 1 pixel in each direction to be conservative and correct rasterization offset
     IntRect rect((int)(minX - 1.5f), (int)(minY - 1.5f), RoundToInt(maxX), RoundToInt(maxY));
 
@@ -390,6 +486,26 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
     // Convert depth to integer and apply final bias
     int z = RoundToInt(minZ) - OCCLUSION_FIXED_BIAS;
 
+    // The depth range of the overlapped tiles gives a conclusive result without reading the pixels if the box is in front
+    // of everything in one of them or behind everything in all of them
+    int tileRight = rect.right_ / OCCLUSION_TILE_WIDTH;
+    int tileBottom = rect.bottom_ / OCCLUSION_TILE_HEIGHT;
+    bool allTilesOccluded = true;
+    for (int y = rect.top_ / OCCLUSION_TILE_HEIGHT; y <= tileBottom; ++y)
+    {
+        for (int x = rect.left_ / OCCLUSION_TILE_WIDTH; x <= tileRight; ++x)
+        {
+            const OcclusionTile& tile = tiles_[y * numTilesX_ + x];
+            if (z <= tile.minDepth_)
+                return true;
+            if (z <= tile.maxDepth_)
+                allTilesOccluded = false;
+        }
+    }
+
+    if (allTilesOccluded)
+        return false;
+
     if (!depthHierarchyDirty_)
     {
         // Start from lowest mip level and check if a conclusive result can be found
@@ -425,18 +541,24 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
         }
     }
 
-    // If no conclusive result, finally check the pixel-level data
-    int* row = buffers_[0].data_ + rect.top_ * width_;
-    int* endRow = buffers_[0].data_ + rect.bottom_ * width_;
+    // If no conclusive result, finally check the pixel-level data, 4 pixels at a time
+    __m128i depth = _mm_set1_epi32(z);
+    int* row = buffer_.data_ + rect.top_ * width_;
+    int* endRow = buffer_.data_ + rect.bottom_ * width_;
     while (row <= endRow)
     {
         int* src = row + rect.left_;
         int* end = row + rect.right_;
-        while (src <= end)
+        for (; src + OCCLUSION_SIMD_WIDTH - 1 <= end; src += OCCLUSION_SIMD_WIDTH)
+        {
+            // Visible if not behind all of the pixels
+            if (_mm_movemask_epi8(_mm_cmpgt_epi32(depth, _mm_loadu_si128((const __m128i*)src))) != 0xffff)
+                return true;
+        }
+        for (; src <= end; ++src)
         {
             if (z <= *src)
                 return true;
-            ++src;
         }
         row += width_;
     }
@@ -444,6 +566,172 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
     return false;
 }
 
+bool OcclusionBuffer::BeginTemporalFrame(const Vector<Drawable*>& occluders, i32 refreshInterval, Vector<Drawable*>& stable,
+    Vector<Drawable*>& changed)
+{
+    stable.Clear();
+    changed.Clear();
+
+    // The saved depth stays valid while all occluders drawn into it are present with unchanged bounding boxes
+    i32 numSavedUnchanged = 0;
+    for (Drawable* occluder : occluders)
+    {
+        WeakPtr<Drawable> key(occluder);
+        HashMap<WeakPtr<Drawable>, BoundingBox>::ConstIterator i = temporalBoxes_.Find(key);
+        if (i != temporalBoxes_.End() && i->second_ == occluder->GetWorldBoundingBox() && savedOccluders_.Contains(key))
+            ++numSavedUnchanged;
+    }
+
+    // The saved depth is only reprojected from the frame it was rasterized on and is never saved again, so errors do not
+    // accumulate. Refresh fully now and then, as the error grows with the camera movement since the saved frame
+    bool reproject = hasSavedDepth_ && numSavedUnchanged == savedOccluders_.Size() && reprojectedFrames_ < refreshInterval;
+
+    // Also refresh after a projection change or when the camera has moved or turned too far, for example after a cut.
+    // The allowed movement is relative to the nearest saved depth, where the parallax is largest
+    if (reproject)
+    {
+        Matrix3x4 cameraTransform = view_.Inverse();
+        Matrix3x4 savedCameraTransform = savedView_.Inverse();
+        float translation = (cameraTransform.Translation() - savedCameraTransform.Translation()).Length();
+        float rotationCos = Abs(cameraTransform.Rotation().DotProduct(savedCameraTransform.Rotation()));
+
+        reproject = projection_ == savedProjection_ && translation <= savedNearestDistance_ * OCCLUSION_REPROJECTION_MAX_TRANSLATION &&
+            rotationCos >= Cos(OCCLUSION_REPROJECTION_MAX_ROTATION * 0.5f);
+    }
+    if (!reproject)
+    {
+        savedOccluders_.Clear();
+        reprojectedFrames_ = 0;
+        hasSavedDepth_ = false;
+    }
+
+    HashMap<WeakPtr<Drawable>, BoundingBox> boxes;
+    for (Drawable* occluder : occluders)
+    {
+        WeakPtr<Drawable> key(occluder);
+        const BoundingBox& box = occluder->GetWorldBoundingBox();
+        HashMap<WeakPtr<Drawable>, BoundingBox>::ConstIterator i = temporalBoxes_.Find(key);
+
+        if (i == temporalBoxes_.End() || i->second_ != box)
+            changed.Push(occluder);
+        else if (!savedOccluders_.Contains(key))
+            stable.Push(occluder);
+
+        boxes[key] = box;
+    }
+
+    temporalBoxes_.Swap(boxes);
+
+    if (reproject)
+    {
+        ++reprojectedFrames_;
+        DrawReprojectedDepth();
+    }
+
+    return reproject;
+}
+
+void OcclusionBuffer::SaveTemporalDepth(const Vector<Drawable*>& occluders, i32 count)
+{
+    if (!buffer_.data_)
+        return;
+
+    for (i32 i = 0; i < count; ++i)
+        savedOccluders_.Insert(WeakPtr<Drawable>(occluders[i]));
+
+    // Keep the farthest depth of each block. The blocks are drawn back as quads, so they stay behind the occluders.
+    // The nearest depth limits the parallax the camera movement may cause inside the block
+    auto farDepth = (int)OCCLUSION_Z_SCALE;
+    int blocksX = (width_ + OCCLUSION_REPROJECTION_BLOCK_SIZE - 1) / OCCLUSION_REPROJECTION_BLOCK_SIZE;
+    int blocksY = (height_ + OCCLUSION_REPROJECTION_BLOCK_SIZE - 1) / OCCLUSION_REPROJECTION_BLOCK_SIZE;
+    savedDepth_.Resize(blocksX * blocksY);
+    savedNearDepth_.Resize(blocksX * blocksY);
+
+    for (int by = 0; by < blocksY; ++by)
+    {
+        int top = by * OCCLUSION_REPROJECTION_BLOCK_SIZE;
+        int bottom = Min(top + OCCLUSION_REPROJECTION_BLOCK_SIZE, height_);
+
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            int left = bx * OCCLUSION_REPROJECTION_BLOCK_SIZE;
+            int right = Min(left + OCCLUSION_REPROJECTION_BLOCK_SIZE, width_);
+            int minDepth = farDepth;
+            int maxDepth = 0;
+
+            for (int y = top; y < bottom; ++y)
+            {
+                const int* row = buffer_.data_ + y * width_;
+                for (int x = left; x < right; ++x)
+                {
+                    minDepth = Min(minDepth, row[x]);
+                    maxDepth = Max(maxDepth, row[x]);
+                }
+            }
+
+            savedDepth_[by * blocksX + bx] = maxDepth;
+            savedNearDepth_[by * blocksX + bx] = minDepth;
+        }
+    }
+
+    // Drop blocks on the edges of covered areas and of the screen, and push the others back to the farthest depth of their
+    // neighbours. Seen from a moved camera, a reprojected quad could otherwise hide objects which are really visible past the
+    // occluder's silhouette or behind a depth step
+    int r = OCCLUSION_REPROJECTION_ERODE_BLOCKS;
+    int nearestDepth = farDepth;
+    erodedDepth_.Resize(savedDepth_.Size());
+    erodedNearDepth_.Resize(savedDepth_.Size());
+    for (int by = 0; by < blocksY; ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            int depth = savedDepth_[by * blocksX + bx];
+            int nearDepth = savedNearDepth_[by * blocksX + bx];
+
+            if (bx < r || by < r || bx >= blocksX - r || by >= blocksY - r)
+                depth = farDepth;
+            else
+            {
+                for (int y = by - r; y <= by + r; ++y)
+                {
+                    for (int x = bx - r; x <= bx + r; ++x)
+                    {
+                        depth = Max(depth, savedDepth_[y * blocksX + x]);
+                        nearDepth = Min(nearDepth, savedNearDepth_[y * blocksX + x]);
+                    }
+                }
+            }
+
+            erodedDepth_[by * blocksX + bx] = depth;
+            erodedNearDepth_[by * blocksX + bx] = nearDepth;
+            if (depth < farDepth)
+                nearestDepth = Min(nearestDepth, nearDepth);
+        }
+    }
+
+    savedDepth_.Swap(erodedDepth_);
+    savedNearDepth_.Swap(erodedNearDepth_);
+
+    // View distance of the nearest depth in the blocks that will be reprojected, from the depth of a point on the view axis
+    float nearestZ = (float)nearestDepth / OCCLUSION_Z_SCALE;
+    savedNearestDistance_ = (projection_.m23_ - nearestZ * projection_.m33_) / (nearestZ * projection_.m32_ - projection_.m22_);
+
+    savedView_ = view_;
+    savedProjection_ = projection_;
+    savedInvViewProj_ = viewProj_.Inverse();
+    hasSavedDepth_ = true;
+}
+
+void OcclusionBuffer::ResetTemporalState()
+{
+    temporalBoxes_.Clear();
+    savedOccluders_.Clear();
+    savedDepth_.Clear();
+    savedNearDepth_.Clear();
+    reprojectedFrames_ = 0;
+    hasSavedDepth_ = false;
+}
+
 unsigned OcclusionBuffer::GetUseTimer()
 {
     return useTimer_.GetMSec(false);
@@ -452,14 +740,7 @@ unsigned OcclusionBuffer::GetUseTimer()
 
 void OcclusionBuffer::DrawBatch(const OcclusionBatch& batch, i32 threadIndex)
 {
-    assert(threadIndex >= 0);
-
-    // If buffer not yet used, clear it
-    if (threadIndex > 0 && !buffers_[threadIndex].used_)
-    {
-        ClearBuffer(threadIndex);
-        buffers_[threadIndex].used_ = true;
-    }
+    assert(threadIndex >= 0 && threadIndex < threadBins_.Size());
 
     Matrix4 modelViewProj = viewProj_ * batch.model_;
 
@@ -626,7 +907,7 @@ void OcclusionBuffer::draw_triangle(Vector4* vertices, i32 threadIndex)
         bool clockwise = SignedArea(projected[0], projected[1], projected[2]) < 0.0f;
         if (cullMode_ == CULL_NONE || (cullMode_ == CULL_CCW && clockwise) || (cullMode_ == CULL_CW && !clockwise))
         {
-            DrawTriangle2D(projected, clockwise, threadIndex);
+            SetupTriangle(projected, threadIndex);
             drawOk = true;
         }
     }
@@ -664,7 +945,7 @@ void OcclusionBuffer::draw_triangle(Vector4* vertices, i32 threadIndex)
                 bool clockwise = SignedArea(projected[0], projected[1], projected[2]) < 0.0f;
                 if (cullMode_ == CULL_NONE || (cullMode_ == CULL_CCW && clockwise) || (cullMode_ == CULL_CW && !clockwise))
                 {
-                    DrawTriangle2D(projected, clockwise, threadIndex);
+                    SetupTriangle(projected, threadIndex);
                     drawOk = true;
                 }
             }
@@ -745,294 +1026,308 @@ void OcclusionBuffer::ClipVertices(const Vector4& plane, Vector4* vertices, bool
     }
 }
 
-// Code based on Chris Hecker's Perspective Texture Mapping series in the Game Developer magazine
-// Also available online at http://chrishecker.com/Miscellaneous_Technical_Articles
-
-/// %Gradients of a software rasterized triangle.
-struct Gradients
+void OcclusionBuffer::SetupTriangle(const Vector3* vertices, i32 threadIndex)
 {
-    /// Construct from vertices.
-    explicit Gradients(const Vector3* vertices)
+    Vector3 v0 = vertices[0];
+    Vector3 v1 = vertices[1];
+    Vector3 v2 = vertices[2];
+
+    // Orient the triangle so that the edge functions are positive inside
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (area == 0.0f)
+        return;
+    if (area < 0.0f)
     {
-        float invdX = 1.0f / (((vertices[1].x - vertices[2].x) *
-                               (vertices[0].y - vertices[2].y)) -
-                              ((vertices[0].x - vertices[2].x) *
-                               (vertices[1].y - vertices[2].y)));
+        swap(v1, v2);
+        area = -area;
+    }
+
+    // Pixels are sampled at their centers, which are at integer + 1 coordinates after the viewport transform
+    int left = Max((int)ceilf(Min(Min(v0.x, v1.x), v2.x) - 1.0f), 0);
+    int right = Min((int)floorf(Max(Max(v0.x, v1.x), v2.x) - 1.0f), width_ - 1);
+    int top = Max((int)ceilf(Min(Min(v0.y, v1.y), v2.y) - 1.0f), 0);
+    int bottom = Min((int)floorf(Max(Max(v0.y, v1.y), v2.y) - 1.0f), height_ - 1);
+    if (left > right || top > bottom)
+        return;
 
-        float invdY = -invdX;
+    OcclusionTriangle triangle;
+    const Vector3* edgeVertices[4] = {&v0, &v1, &v2, &v0};
+    for (int i = 0; i < 3; ++i)
+    {
+        const Vector3& a = *edgeVertices[i];
+        const Vector3& b = *edgeVertices[i + 1];
+        triangle.edgeA_[i] = a.y - b.y;
+        triangle.edgeB_[i] = b.x - a.x;
+        triangle.edgeC_[i] = -(triangle.edgeA_[i] * a.x + triangle.edgeB_[i] * a.y);
+
+        // Edge crossings of each row are linear in y. Edges parallel to the x axis never limit the row span
+        float invEdgeA = triangle.edgeA_[i] != 0.0f ? -1.0f / triangle.edgeA_[i] : 0.0f;
+        triangle.crossingSlope_[i] = triangle.edgeB_[i] * invEdgeA;
+        triangle.crossingOffset_[i] = triangle.edgeC_[i] * invEdgeA;
+    }
 
-        dInvZdX_ = invdX * (((vertices[1].z - vertices[2].z) * (vertices[0].y - vertices[2].y)) -
-                            ((vertices[0].z - vertices[2].z) * (vertices[1].y - vertices[2].y)));
+    float invArea = 1.0f / area;
+    triangle.depthA_ = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) * invArea;
+    triangle.depthB_ = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) * invArea;
+    triangle.depthC_ = v0.z - triangle.depthA_ * v0.x - triangle.depthB_ * v0.y;
+    triangle.minDepth_ = Min(Min(v0.z, v1.z), v2.z);
+    triangle.bounds_ = IntRect(left, top, right, bottom);
 
-        dInvZdY_ = invdY * (((vertices[1].z - vertices[2].z) * (vertices[0].x - vertices[2].x)) -
-                            ((vertices[0].z - vertices[2].z) * (vertices[1].x - vertices[2].x)));
+    OcclusionThreadBins& bins = threadBins_[threadIndex];
+    i32 triangleIndex = bins.triangles_.Size();
+    bins.triangles_.Push(triangle);
 
-        dInvZdXInt_ = (int)dInvZdX_;
+    int tileRight = right / OCCLUSION_TILE_WIDTH;
+    int tileBottom = bottom / OCCLUSION_TILE_HEIGHT;
+    for (int y = top / OCCLUSION_TILE_HEIGHT; y <= tileBottom; ++y)
+    {
+        for (int x = left / OCCLUSION_TILE_WIDTH; x <= tileRight; ++x)
+            bins.tiles_[y * numTilesX_ + x].Push(triangleIndex);
     }
+}
 
-    /// Integer horizontal gradient.
-    int dInvZdXInt_;
-    /// Horizontal gradient.
-    float dInvZdX_;
-    /// Vertical gradient.
-    float dInvZdY_;
-};
-
-/// %Edge of a software rasterized triangle.
-struct Edge
+void OcclusionBuffer::RasterizeTiles(OcclusionTile* start, OcclusionTile* end)
 {
-    /// Construct from gradients and top & bottom vertices.
-    Edge(const Gradients& gradients, const Vector3& top, const Vector3& bottom, int topY)
+    for (OcclusionTile* tile = start; tile != end; ++tile)
     {
-        float height = (bottom.y - top.y);
-        float slope = (height != 0.0f) ? (bottom.x - top.x) / height : 0.0f;
-        float yPreStep = (float)(topY + 1) - top.y;
-        float xPreStep = slope * yPreStep;
-
-        x_ = RoundToInt((xPreStep + top.x) * OCCLUSION_X_SCALE);
-        xStep_ = RoundToInt(slope * OCCLUSION_X_SCALE);
-        invZ_ = RoundToInt(top.z + xPreStep * gradients.dInvZdX_ + yPreStep * gradients.dInvZdY_);
-        invZStep_ = RoundToInt(slope * gradients.dInvZdX_ + gradients.dInvZdY_);
-    }
+        i32 tileIndex = (i32)(tile - tiles_.Buffer());
 
-    /// X coordinate.
-    int x_;
-    /// X coordinate step.
-    int xStep_;
-    /// Inverse Z.
-    int invZ_;
-    /// Inverse Z step.
-    int invZStep_;
-};
+        for (const OcclusionThreadBins& bins : threadBins_)
+        {
+            for (i32 triangleIndex : bins.tiles_[tileIndex])
+                RasterizeTriangle(bins.triangles_[triangleIndex], *tile);
+        }
+    }
+}
 
-void OcclusionBuffer::DrawTriangle2D(const Vector3* vertices, bool clockwise, i32 threadIndex)
+void OcclusionBuffer::RasterizeTriangle(const OcclusionTriangle& triangle, OcclusionTile& tile)
 {
-    assert(threadIndex >= 0);
-
-    int top, middle, bottom;
-    bool middleIsRight;
+    // Skip if the whole triangle is behind everything already in the tile
+    if (_mm_cvtss_si32(_mm_set_ss(triangle.minDepth_)) >= tile.maxDepth_)
+        return;
 
-    // Sort vertices in Y-direction
-    if (vertices[0].y < vertices[1].y)
+    const IntRect& rect = tile.rect_;
+    const IntRect& bounds = triangle.bounds_;
+
+    // Tiles start at multiples of the SIMD width, so aligning down stays inside the tile
+    int left = Max(bounds.left_, rect.left_) & ~(OCCLUSION_SIMD_WIDTH - 1);
+    int right = Min(bounds.right_, rect.right_);
+    int top = Max(bounds.top_, rect.top_);
+    int bottom = Min(bounds.bottom_, rect.bottom_);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 laneOffsets = _mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f);
+    const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA_[0]);
+    const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA_[1]);
+    const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA_[2]);
+    const __m128 edgeStep0 = _mm_set1_ps(triangle.edgeA_[0] * OCCLUSION_SIMD_WIDTH);
+    const __m128 edgeStep1 = _mm_set1_ps(triangle.edgeA_[1] * OCCLUSION_SIMD_WIDTH);
+    const __m128 edgeStep2 = _mm_set1_ps(triangle.edgeA_[2] * OCCLUSION_SIMD_WIDTH);
+    const __m128 depthA = _mm_set1_ps(triangle.depthA_);
+    const __m128 depthStep = _mm_set1_ps(triangle.depthA_ * OCCLUSION_SIMD_WIDTH);
+    const __m128 minDepth = _mm_set1_ps(triangle.minDepth_);
+    const __m128 maxDepth = _mm_set1_ps(OCCLUSION_Z_SCALE);
+
+    __m128 nearDepth = maxDepth;
+    bool rowsChanged = false;
+
+    for (int y = top; y <= bottom; ++y)
     {
-        if (vertices[2].y < vertices[0].y)
+        float sampleY = (float)(y + 1);
+
+        // Narrow the row to the span where all edge functions are non-negative. The span is widened to whole pixels,
+        // the exact coverage is decided by the edge function masks
+        float spanLeft = (float)left + 1.0f;
+        float spanRight = (float)right + 1.0f;
+        for (int i = 0; i < 3; ++i)
         {
-            top = 2;
-            middle = 0;
-            bottom = 1;
-            middleIsRight = true;
+            float crossing = triangle.crossingSlope_[i] * sampleY + triangle.crossingOffset_[i];
+            if (triangle.edgeA_[i] > 0.0f)
+                spanLeft = Max(spanLeft, crossing);
+            else if (triangle.edgeA_[i] < 0.0f)
+                spanRight = Min(spanRight, crossing);
         }
-        else
+        if (spanLeft > spanRight)
+            continue;
+
+        // Depth is linear along the row, so its nearest value on the span is at one of the ends
+        float rowDepthY = triangle.depthB_ * sampleY + triangle.depthC_;
+        float rowMinDepth = Max(Min(triangle.depthA_ * spanLeft, triangle.depthA_ * spanRight) + rowDepthY, triangle.minDepth_);
+        int& rowMaxDepth = tile.rowMaxDepth_[y - rect.top_];
+        if (_mm_cvtss_si32(_mm_set_ss(rowMinDepth)) >= rowMaxDepth)
+            continue;
+
+        // Both span ends are positive here, so truncation rounds down. This is one pixel too wide on the right at most
+        int rowLeft = Max(((int)spanLeft - 1) & ~(OCCLUSION_SIMD_WIDTH - 1), left);
+        int rowRight = Min((int)spanRight, right);
+
+        __m128 sampleX = _mm_add_ps(_mm_set1_ps((float)rowLeft), laneOffsets);
+        __m128 edge0 = _mm_add_ps(_mm_mul_ps(edgeA0, sampleX), _mm_set1_ps(triangle.edgeB_[0] * sampleY + triangle.edgeC_[0]));
+        __m128 edge1 = _mm_add_ps(_mm_mul_ps(edgeA1, sampleX), _mm_set1_ps(triangle.edgeB_[1] * sampleY + triangle.edgeC_[1]));
+        __m128 edge2 = _mm_add_ps(_mm_mul_ps(edgeA2, sampleX), _mm_set1_ps(triangle.edgeB_[2] * sampleY + triangle.edgeC_[2]));
+        __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, sampleX), _mm_set1_ps(rowDepthY));
+        __m128 rowFarDepth = zero;
+        int rowCoverage = 0xf;
+        int* dest = buffer_.data_ + y * width_ + rowLeft;
+
+        for (int x = rowLeft; x <= rowRight; x += OCCLUSION_SIMD_WIDTH)
         {
-            top = 0;
-            if (vertices[1].y < vertices[2].y)
-            {
-                middle = 1;
-                bottom = 2;
-                middleIsRight = true;
-            }
-            else
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+            int mask = _mm_movemask_ps(inside);
+            rowCoverage &= mask;
+
+            if (mask)
             {
-                middle = 2;
-                bottom = 1;
-                middleIsRight = false;
+                // Clamp the interpolated depth to the triangle's depth range to stay conservative at the edges
+                __m128 clampedDepth = _mm_min_ps(_mm_max_ps(depth, minDepth), maxDepth);
+                __m128i newDepth = _mm_cvtps_epi32(clampedDepth);
+                __m128i oldDepth = _mm_loadu_si128((const __m128i*)dest);
+                __m128i write = _mm_and_si128(_mm_castps_si128(inside), _mm_cmplt_epi32(newDepth, oldDepth));
+                _mm_storeu_si128((__m128i*)dest, _mm_or_si128(_mm_and_si128(write, newDepth), _mm_andnot_si128(write, oldDepth)));
+                rowFarDepth = _mm_max_ps(rowFarDepth, clampedDepth);
+                nearDepth = _mm_min_ps(nearDepth, _mm_or_ps(_mm_and_ps(inside, clampedDepth), _mm_andnot_ps(inside, maxDepth)));
             }
+
+            edge0 = _mm_add_ps(edge0, edgeStep0);
+            edge1 = _mm_add_ps(edge1, edgeStep1);
+            edge2 = _mm_add_ps(edge2, edgeStep2);
+            depth = _mm_add_ps(depth, depthStep);
+            dest += OCCLUSION_SIMD_WIDTH;
         }
-    }
-    else
-    {
-        if (vertices[2].y < vertices[1].y)
-        {
-            top = 2;
-            middle = 1;
-            bottom = 0;
-            middleIsRight = false;
-        }
-        else
+
+        // If the triangle covered the whole tile row, no pixel of the row can be farther than the triangle there
+        if (rowCoverage == 0xf && rowLeft == rect.left_ && rowRight == rect.right_)
         {
-            top = 1;
-            if (vertices[0].y < vertices[2].y)
-            {
-                middle = 0;
-                bottom = 2;
-                middleIsRight = false;
-            }
-            else
-            {
-                middle = 2;
-                bottom = 0;
-                middleIsRight = true;
-            }
+            rowMaxDepth = Min(rowMaxDepth, _mm_cvtss_si32(_mm_set_ss(HorizontalMax(rowFarDepth))));
+            rowsChanged = true;
         }
     }
 
-    auto topY = (int)vertices[top].y;
-    auto middleY = (int)vertices[middle].y;
-    auto bottomY = (int)vertices[bottom].y;
+    tile.minDepth_ = Min(tile.minDepth_, _mm_cvtss_si32(_mm_set_ss(HorizontalMin(nearDepth))));
 
-    // Check for degenerate triangle
-    if (topY == bottomY)
-        return;
-
-    // Reverse middleIsRight test if triangle is counterclockwise
-    if (!clockwise)
-        middleIsRight = !middleIsRight;
+    if (rowsChanged)
+    {
+        int tileMaxDepth = 0;
+        for (int y = 0; y <= rect.bottom_ - rect.top_; ++y)
+            tileMaxDepth = Max(tileMaxDepth, tile.rowMaxDepth_[y]);
+        tile.maxDepth_ = tileMaxDepth;
+    }
+}
 
-    const bool topDegenerate = topY == middleY;
-    const bool bottomDegenerate = middleY == bottomY;
+void OcclusionBuffer::DrawReprojectedDepth()
+{
+    // Saved clip space goes directly to the current clip space, no divide by w is needed in between
+    Matrix4 reprojection = viewProj_ * savedInvViewProj_;
+    int blocksX = (width_ + OCCLUSION_REPROJECTION_BLOCK_SIZE - 1) / OCCLUSION_REPROJECTION_BLOCK_SIZE;
+    int blocksY = (height_ + OCCLUSION_REPROJECTION_BLOCK_SIZE - 1) / OCCLUSION_REPROJECTION_BLOCK_SIZE;
 
-    Gradients gradients(vertices);
-    Edge topToBottom(gradients, vertices[top], vertices[bottom], topY);
+    // Reprojected blocks do not count towards the occluder triangle budget and may face either way
+    unsigned numTriangles = numTriangles_;
+    CullMode cullMode = cullMode_;
+    cullMode_ = CULL_NONE;
 
-    int* bufferData = buffers_[threadIndex].data_;
+    // Theoretical max. amount of vertices if each of the 6 clipping planes doubles the triangle count
+    Vector4 vertices[64 * 3];
 
-    if (middleIsRight)
+    for (int by = 0; by < blocksY; ++by)
     {
-        // Top half
-        if (!topDegenerate)
+        // Block edges lie halfway between pixel samples, so neighbours of equal depth leave no gaps
+        float top = ((float)(by * OCCLUSION_REPROJECTION_BLOCK_SIZE) + 0.5f - offsetY_) / scaleY_;
+        float bottom = ((float)Min((by + 1) * OCCLUSION_REPROJECTION_BLOCK_SIZE, height_) + 0.5f - offsetY_) / scaleY_;
+
+        for (int bx = 0; bx < blocksX; ++bx)
         {
-            Edge topToMiddle(gradients, vertices[top], vertices[middle], topY);
-            int* row = bufferData + topY * width_;
-            int* endRow = bufferData + middleY * width_;
-            while (row < endRow)
-            {
-                int invZ = topToBottom.invZ_;
-                int* dest = row + (topToBottom.x_ >> 16u);
-                int* end = row + (topToMiddle.x_ >> 16u);
-                while (dest < end)
-                {
-                    if (invZ < *dest)
-                        *dest = invZ;
-                    invZ += gradients.dInvZdXInt_;
-                    ++dest;
-                }
+            int depth = savedDepth_[by * blocksX + bx];
+            if (depth >= (int)OCCLUSION_Z_SCALE)
+                continue;
 
-                topToBottom.x_ += topToBottom.xStep_;
-                topToBottom.invZ_ += topToBottom.invZStep_;
-                topToMiddle.x_ += topToMiddle.xStep_;
-                row += width_;
-            }
-        }
+            float left = ((float)(bx * OCCLUSION_REPROJECTION_BLOCK_SIZE) + 0.5f - offsetX_) / scaleX_;
+            float right = ((float)Min((bx + 1) * OCCLUSION_REPROJECTION_BLOCK_SIZE, width_) + 0.5f - offsetX_) / scaleX_;
+            float z = (float)(depth + OCCLUSION_FIXED_BIAS) / OCCLUSION_Z_SCALE;
+            float nearZ = (float)savedNearDepth_[by * blocksX + bx] / OCCLUSION_Z_SCALE;
 
-        // Bottom half
-        if (!bottomDegenerate)
-        {
-            Edge middleToBottom(gradients, vertices[middle], vertices[bottom], middleY);
-            int* row = bufferData + middleY * width_;
-            int* endRow = bufferData + bottomY * width_;
-            while (row < endRow)
+            Vector4 topLeft = reprojection * Vector4(left, top, z, 1.0f);
+            Vector4 topRight = reprojection * Vector4(right, top, z, 1.0f);
+            Vector4 bottomRight = reprojection * Vector4(right, bottom, z, 1.0f);
+            Vector4 bottomLeft = reprojection * Vector4(left, bottom, z, 1.0f);
+            Vector4 nearCorners[4] =
             {
-                int invZ = topToBottom.invZ_;
-                int* dest = row + (topToBottom.x_ >> 16u);
-                int* end = row + (middleToBottom.x_ >> 16u);
-                while (dest < end)
-                {
-                    if (invZ < *dest)
-                        *dest = invZ;
-                    invZ += gradients.dInvZdXInt_;
-                    ++dest;
-                }
+                reprojection * Vector4(left, top, nearZ, 1.0f),
+                reprojection * Vector4(right, top, nearZ, 1.0f),
+                reprojection * Vector4(right, bottom, nearZ, 1.0f),
+                reprojection * Vector4(left, bottom, nearZ, 1.0f)
+            };
+
+            // Skip blocks that reach behind the camera. Flatten the others to the farthest depth of their reprojected
+            // footprint, so that the quad never occludes more than the saved block did
+            if (topLeft.w <= M_EPSILON || topRight.w <= M_EPSILON || bottomRight.w <= M_EPSILON || bottomLeft.w <= M_EPSILON)
+                continue;
 
-                topToBottom.x_ += topToBottom.xStep_;
-                topToBottom.invZ_ += topToBottom.invZStep_;
-                middleToBottom.x_ += middleToBottom.xStep_;
-                row += width_;
-            }
-        }
-    }
-    else
-    {
-        // Top half
-        if (!topDegenerate)
-        {
-            Edge topToMiddle(gradients, vertices[top], vertices[middle], topY);
-            int* row = bufferData + topY * width_;
-            int* endRow = bufferData + middleY * width_;
-            while (row < endRow)
+            // Skip blocks whose nearest and farthest occluder depths have moved apart on the screen. Occluders at different
+            // depths may then have opened gaps inside the block which the quad would cover
+            const Vector4* farCorners[4] = {&topLeft, &topRight, &bottomRight, &bottomLeft};
+            bool parallax = false;
+            for (int i = 0; i < 4 && !parallax; ++i)
             {
-                int invZ = topToMiddle.invZ_;
-                int* dest = row + (topToMiddle.x_ >> 16u);
-                int* end = row + (topToBottom.x_ >> 16u);
-                while (dest < end)
+                const Vector4& nearCorner = nearCorners[i];
+                const Vector4& farCorner = *farCorners[i];
+                if (nearCorner.w <= M_EPSILON)
                 {
-                    if (invZ < *dest)
-                        *dest = invZ;
-                    invZ += gradients.dInvZdXInt_;
-                    ++dest;
+                    parallax = true;
+                    break;
                 }
 
-                topToMiddle.x_ += topToMiddle.xStep_;
-                topToMiddle.invZ_ += topToMiddle.invZStep_;
-                topToBottom.x_ += topToBottom.xStep_;
-                row += width_;
+                float dx = (nearCorner.x / nearCorner.w - farCorner.x / farCorner.w) * scaleX_;
+                float dy = (nearCorner.y / nearCorner.w - farCorner.y / farCorner.w) * scaleY_;
+                parallax = dx * dx + dy * dy > OCCLUSION_REPROJECTION_MAX_PARALLAX * OCCLUSION_REPROJECTION_MAX_PARALLAX;
             }
-        }
-
-        // Bottom half
-        if (!bottomDegenerate)
-        {
-            Edge middleToBottom(gradients, vertices[middle], vertices[bottom], middleY);
-            int* row = bufferData + middleY * width_;
-            int* endRow = bufferData + bottomY * width_;
-            while (row < endRow)
-            {
-                int invZ = middleToBottom.invZ_;
-                int* dest = row + (middleToBottom.x_ >> 16u);
-                int* end = row + (topToBottom.x_ >> 16u);
-                while (dest < end)
-                {
-                    if (invZ < *dest)
-                        *dest = invZ;
-                    invZ += gradients.dInvZdXInt_;
-                    ++dest;
-                }
+            if (parallax)
+                continue;
 
-                middleToBottom.x_ += middleToBottom.xStep_;
-                middleToBottom.invZ_ += middleToBottom.invZStep_;
-                topToBottom.x_ += topToBottom.xStep_;
-                row += width_;
-            }
+            float maxZ = Max(Max(topLeft.z / topLeft.w, topRight.z / topRight.w),
+                Max(bottomRight.z / bottomRight.w, bottomLeft.z / bottomLeft.w));
+            topLeft.z = maxZ * topLeft.w;
+            topRight.z = maxZ * topRight.w;
+            bottomRight.z = maxZ * bottomRight.w;
+            bottomLeft.z = maxZ * bottomLeft.w;
+
+            vertices[0] = topLeft;
+            vertices[1] = topRight;
+            vertices[2] = bottomRight;
+            draw_triangle(vertices, 0);
+
+            vertices[0] = topLeft;
+            vertices[1] = bottomRight;
+            vertices[2] = bottomLeft;
+            draw_triangle(vertices, 0);
         }
     }
-}
 
-void OcclusionBuffer::MergeBuffers()
-{
-    ZoneScoped;
-
-    for (i32 i = 1; i < buffers_.Size(); ++i)
-    {
-        if (!buffers_[i].used_)
-            continue;
+    cullMode_ = cullMode;
+    numTriangles_ = numTriangles;
 
-        int* src = buffers_[i].data_;
-        int* dest = buffers_[0].data_;
-        int count = width_ * height_;
-
-        while (count--)
-        {
-            // If thread buffer's depth value is closer, overwrite the original
-            if (*src < *dest)
-                *dest = *src;
-            ++src;
-            ++dest;
-        }
-    }
+    DrawTriangles();
 }
 
-void OcclusionBuffer::ClearBuffer(i32 threadIndex)
+void OcclusionBuffer::ClearBuffer()
 {
-    assert(threadIndex >= 0);
-
-    if (threadIndex >= buffers_.Size())
+    int* dest = buffer_.data_;
+    if (!dest)
         return;
 
-    int* dest = buffers_[threadIndex].data_;
     int count = width_ * height_;
     auto fillValue = (int)OCCLUSION_Z_SCALE;
 
     while (count--)
         *dest++ = fillValue;
+
+    for (OcclusionTile& tile : tiles_)
+    {
+        tile.minDepth_ = fillValue;
+        tile.maxDepth_ = fillValue;
+        for (int& rowMaxDepth : tile.rowMaxDepth_)
+            rowMaxDepth = fillValue;
+    }
 }
 
 }
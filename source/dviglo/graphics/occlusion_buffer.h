@@ -6,21 +6,26 @@
 
 #pragma once
 
+#include "../containers/hash_set.h"
 #include "../core/object.h"
 #include "../core/timer.h"
 #include "../graphics_api/graphics_defs.h"
 #include "../math/frustum.h"
+#include "../math/rect.h"
 
 namespace dviglo
 {
 
 class BoundingBox;
 class Camera;
+class Drawable;
 class IndexBuffer;
-class IntRect;
 class VertexBuffer;
-struct Edge;
-struct Gradients;
+
+/// Occlusion buffer tile width in pixels. Must be a multiple of the SIMD width.
+inline constexpr int OCCLUSION_TILE_WIDTH = 64;
+/// Occlusion buffer tile height in pixels.
+inline constexpr int OCCLUSION_TILE_HEIGHT = 16;
 
 /// Occlusion hierarchy depth value.
 struct DepthValue
@@ -31,15 +36,60 @@ struct DepthValue
     int max_;
 };
 
-/// Per-thread occlusion buffer data.
+/// Occlusion buffer data.
 struct OcclusionBufferData
 {
     /// Full buffer data with safety padding.
     std::unique_ptr<int[]> dataWithSafety_;
     /// Buffer data.
-    int* data_;
-    /// Use flag.
-    bool used_;
+    int* data_{};
+};
+
+/// Triangle set up for rasterization: edge functions and depth plane evaluated at pixel sample positions.
+struct OcclusionTriangle
+{
+    /// Edge function X coefficients. A pixel is inside when all edge functions are non-negative.
+    float edgeA_[3];
+    /// Edge function Y coefficients.
+    float edgeB_[3];
+    /// Edge function constants.
+    float edgeC_[3];
+    /// Y slope of the x coordinate where each edge crosses a row. Zero for edges parallel to the x axis.
+    float crossingSlope_[3];
+    /// Offset of the x coordinate where each edge crosses a row.
+    float crossingOffset_[3];
+    /// Depth plane X coefficient.
+    float depthA_;
+    /// Depth plane Y coefficient.
+    float depthB_;
+    /// Depth plane constant.
+    float depthC_;
+    /// Nearest vertex depth. Interpolated depth is clamped to it.
+    float minDepth_;
+    /// Pixel bounds, inclusive.
+    IntRect bounds_;
+};
+
+/// Screen tile of the occlusion buffer. Tiles are rasterized independently, so each worker thread owns whole tiles.
+struct OcclusionTile
+{
+    /// Pixel bounds, inclusive.
+    IntRect rect_;
+    /// Conservative nearest depth in the tile. Boxes in front of it are visible without testing the pixels.
+    int minDepth_;
+    /// Conservative farthest depth in the tile. Triangles behind it are skipped.
+    int maxDepth_;
+    /// Conservative farthest depth of each tile row. Triangle rows behind it are skipped.
+    int rowMaxDepth_[OCCLUSION_TILE_HEIGHT];
+};
+
+/// Per-thread triangles and their tile bins.
+struct OcclusionThreadBins
+{
+    /// Triangles set up by the thread.
+    Vector<OcclusionTriangle> triangles_;
+    /// Triangle indices by tile.
+    Vector<Vector<i32>> tiles_;
 };
 
 /// Stored occlusion render job.
@@ -89,15 +139,25 @@ public:
     /// Submit a triangle mesh to the buffer using indexed geometry. Return true if did not overflow the allowed triangle count.
     bool AddTriangles(const Matrix3x4& model, const void* vertexData, unsigned vertexSize, const void* indexData, unsigned indexSize,
         unsigned indexStart, unsigned indexCount);
-    /// Draw submitted batches. Uses worker threads if enabled during SetSize().
+    /// Draw submitted batches. Uses worker threads for triangle setup and tile rasterization if enabled during SetSize().
     void DrawTriangles();
     /// Build reduced size mip levels.
     void BuildDepthHierarchy();
     /// Reset last used timer.
     void ResetUseTimer();
+    /// Sort occluders for temporal reuse and reproject the depth saved last frame to the current view if it is still valid.
+    /// Stable occluders have the same bounding box as last frame and are left out if already in the reprojected depth. Return true if reprojected.
+    bool BeginTemporalFrame(const Vector<Drawable*>& occluders, i32 refreshInterval, Vector<Drawable*>& stable, Vector<Drawable*>& changed);
+    /// Save the depth drawn so far for reprojection in the following frames, together with the first count occluders that were drawn into it. Call only on frames that were not reprojected, so that reprojected depth is never saved again.
+    void SaveTemporalDepth(const Vector<Drawable*>& occluders, i32 count);
+    /// Discard the saved depth and occluder bounding boxes.
+    void ResetTemporalState();
+
+    /// Return camera the view was last set from.
+    Camera* GetCamera() const { return camera_; }
 
     /// Return highest level depth values.
-    int* GetBuffer() const { return buffers_.Size() ? buffers_[0].data_ : nullptr; }
+    int* GetBuffer() const { return buffer_.data_; }
 
     /// Return view transform matrix.
     const Matrix3x4& GetView() const { return view_; }
@@ -121,15 +181,17 @@ public:
     CullMode GetCullMode() const { return cullMode_; }
 
     /// Return whether is using threads to speed up rendering.
-    bool IsThreaded() const { return buffers_.Size() > 1; }
+    bool IsThreaded() const { return threaded_; }
 
     /// Test a bounding box for visibility. For best performance, build depth hierarchy first.
     bool IsVisible(const BoundingBox& worldSpaceBox) const;
     /// Return time since last use in milliseconds.
     unsigned GetUseTimer();
 
-    /// Draw a batch. Called internally.
+    /// Transform, clip and bin the triangles of a batch. Called internally.
     void DrawBatch(const OcclusionBatch& batch, i32 threadIndex);
+    /// Rasterize binned triangles into a range of tiles. Called internally.
+    void RasterizeTiles(OcclusionTile* start, OcclusionTile* end);
 
 private:
     /// Apply modelview transform to vertex.
@@ -146,15 +208,25 @@ private:
     void draw_triangle(Vector4* vertices, i32 threadIndex);
     /// Clip vertices against a plane.
     void ClipVertices(const Vector4& plane, Vector4* vertices, bool* triangles, unsigned& numTriangles);
-    /// Draw a clipped triangle.
-    void DrawTriangle2D(const Vector3* vertices, bool clockwise, i32 threadIndex);
-    /// Clear a thread work buffer.
-    void ClearBuffer(i32 threadIndex);
-    /// Merge thread work buffers into the first buffer.
-    void MergeBuffers();
-
-    /// Highest-level buffer data per thread.
-    Vector<OcclusionBufferData> buffers_;
+    /// Set up a clipped triangle and add it to the bins of the tiles it overlaps.
+    void SetupTriangle(const Vector3* vertices, i32 threadIndex);
+    /// Rasterize a triangle into one tile.
+    void RasterizeTriangle(const OcclusionTriangle& triangle, OcclusionTile& tile);
+    /// Clear the buffer and tile depths.
+    void ClearBuffer();
+    /// Draw the saved depth blocks reprojected to the current view.
+    void DrawReprojectedDepth();
+
+    /// Highest-level buffer data.
+    OcclusionBufferData buffer_;
+    /// Screen tiles.
+    Vector<OcclusionTile> tiles_;
+    /// Number of tiles horizontally.
+    int numTilesX_{};
+    /// Number of tiles vertically.
+    int numTilesY_{};
+    /// Binned triangles per thread.
+    Vector<OcclusionThreadBins> threadBins_;
     /// Reduced size depth buffers.
     Vector<std::shared_ptr<DepthValue[]>> mipBuffers_;
     /// Submitted render jobs.
@@ -171,6 +243,8 @@ private:
     CullMode cullMode_{CULL_CCW};
     /// Depth hierarchy needs update flag.
     bool depthHierarchyDirty_{true};
+    /// Threaded rendering flag.
+    bool threaded_{};
     /// Culling reverse flag.
     bool reverseCulling_{};
     /// View transform matrix.
@@ -181,6 +255,32 @@ private:
     Matrix4 viewProj_;
     /// Last used timer.
     Timer useTimer_;
+    /// Camera the view was last set from.
+    WeakPtr<Camera> camera_;
+    /// Occluder bounding boxes of the last frame.
+    HashMap<WeakPtr<Drawable>, BoundingBox> temporalBoxes_;
+    /// Occluders drawn into the saved depth.
+    HashSet<WeakPtr<Drawable>> savedOccluders_;
+    /// Farthest depth of each screen block saved for reprojection.
+    Vector<int> savedDepth_;
+    /// Nearest depth around each screen block saved for reprojection.
+    Vector<int> savedNearDepth_;
+    /// Farthest block depth work buffer.
+    Vector<int> erodedDepth_;
+    /// Nearest block depth work buffer.
+    Vector<int> erodedNearDepth_;
+    /// View transform matrix of the saved depth.
+    Matrix3x4 savedView_;
+    /// Projection matrix of the saved depth.
+    Matrix4 savedProjection_;
+    /// Inverse view-projection matrix of the saved depth.
+    Matrix4 savedInvViewProj_;
+    /// View distance of the nearest saved depth.
+    float savedNearestDistance_{};
+    /// Number of consecutive frames started from reprojected depth.
+    i32 reprojectedFrames_{};
+    /// Saved depth valid flag.
+    bool hasSavedDepth_{};
     /// Near clip distance.
     float nearClip_{};
     /// Far clip distance.
@@ -28,6 +28,13 @@ namespace dviglo
 static const float DEFAULT_OCTREE_SIZE = 1000.0f;
 static const int DEFAULT_OCTREE_LEVELS = 8;
 
+static const char* spatialIndexNames[] =
+{
+    "Octree",
+    "Dynamic BVH",
+    nullptr
+};
+
 extern const char* SUBSYSTEM_CATEGORY;
 
 void UpdateDrawablesWork(const WorkItem* item, i32 threadIndex)
@@ -45,6 +52,20 @@ void UpdateDrawablesWork(const WorkItem* item, i32 threadIndex)
     }
 }
 
+void GetDrawablesWork(const WorkItem* item, i32 threadIndex)
+{
+    auto& queries = *(reinterpret_cast<Vector<unique_ptr<OctreeQuery>>*>(item->aux_));
+    OctreeQuery& query = *queries[threadIndex];
+    auto* start = reinterpret_cast<OctantQueryTask*>(item->start_);
+    auto* end = reinterpret_cast<OctantQueryTask*>(item->end_);
+
+    while (start != end)
+    {
+        start->octant_->GetDrawablesInternal(query, start->inside_);
+        ++start;
+    }
+}
+
 inline bool CompareRayQueryResults(const RayQueryResult& lhs, const RayQueryResult& rhs)
 {
     return lhs.distance_ < rhs.distance_;
@@ -119,6 +140,20 @@ void Octant::DeleteChild(i32 index)
 
 void Octant::InsertDrawable(Drawable* drawable)
 {
+    // With the dynamic BVH all drawables are kept in the root octant and culled by the BVH instead
+    if (this == root_ && root_->GetSpatialIndex() == SPATIAL_INDEX_DYNAMIC_BVH)
+    {
+        Octant* oldOctant = drawable->octant_;
+        if (oldOctant != this)
+        {
+            AddDrawable(drawable);
+            if (oldOctant)
+                oldOctant->RemoveDrawable(drawable, false);
+        }
+        root_->UpdateBvhDrawable(drawable);
+        return;
+    }
+
     const BoundingBox& box = drawable->GetWorldBoundingBox();
 
     // If root octant, insert all non-occludees here, so that octant occlusion does not hide the drawable.
@@ -151,6 +186,18 @@ void Octant::InsertDrawable(Drawable* drawable)
     }
 }
 
+void Octant::RemoveDrawable(Drawable* drawable, bool resetOctant/* = true*/)
+{
+    if (drawables_.Remove(drawable))
+    {
+        if (root_ && this == root_)
+            root_->RemoveBvhDrawable(drawable);
+        if (resetOctant)
+            drawable->SetOctant(nullptr);
+        DecDrawableCount();
+    }
+}
+
 bool Octant::CheckDrawableFit(const BoundingBox& box) const
 {
     Vector3 boxSize = box.Size();
@@ -240,6 +287,37 @@ void Octant::GetDrawablesInternal(OctreeQuery& query, bool inside) const
     }
 }
 
+void Octant::GetDrawablesSplitInternal(OctreeQuery& query, bool inside, i32 splitLevel, Vector<OctantQueryTask>& tasks) const
+{
+    if (this != root_)
+    {
+        Intersection res = query.test_octant(cullingBox_, inside);
+        if (res == INSIDE)
+            inside = true;
+        else if (res == OUTSIDE)
+            return;
+    }
+
+    if (drawables_.Size())
+    {
+        auto** start = const_cast<Drawable**>(&drawables_[0]);
+        Drawable** end = start + drawables_.Size();
+        query.test_drawables(start, end, inside);
+    }
+
+    for (auto child : children_)
+    {
+        if (!child)
+            continue;
+
+        // Leave the children below the split level (including their own octant test) to the worker threads
+        if (level_ + 1 >= splitLevel)
+            tasks.Push(OctantQueryTask{child, inside});
+        else
+            child->GetDrawablesSplitInternal(query, inside, splitLevel, tasks);
+    }
+}
+
 void Octant::GetDrawablesInternal(RayOctreeQuery& query) const
 {
     float octantDist = query.ray_.HitDistance(cullingBox_);
@@ -308,6 +386,7 @@ Octree::~Octree()
 {
     // Reset root pointer from all child octants now so that they do not move their drawables to root
     drawableUpdates_.Clear();
+    ClearBvh();
     ResetRoot();
 }
 
@@ -321,6 +400,7 @@ void Octree::register_object()
     DV_ATTRIBUTE_EX("Bounding Box Min", worldBoundingBox_.min_, UpdateOctreeSize, defaultBoundsMin, AM_DEFAULT);
     DV_ATTRIBUTE_EX("Bounding Box Max", worldBoundingBox_.max_, UpdateOctreeSize, defaultBoundsMax, AM_DEFAULT);
     DV_ATTRIBUTE_EX("Number of Levels", numLevels_, UpdateOctreeSize, DEFAULT_OCTREE_LEVELS, AM_DEFAULT);
+    DV_ENUM_ACCESSOR_ATTRIBUTE("Spatial Index", GetSpatialIndex, SetSpatialIndex, spatialIndexNames, SPATIAL_INDEX_OCTREE, AM_DEFAULT);
 }
 
 void Octree::draw_debug_geometry(DebugRenderer* debug, bool depthTest)
@@ -329,7 +409,10 @@ void Octree::draw_debug_geometry(DebugRenderer* debug, bool depthTest)
     {
         DV_PROFILE(OctreeDrawDebug);
 
-        Octant::draw_debug_geometry(debug, depthTest);
+        if (spatialIndex_ == SPATIAL_INDEX_DYNAMIC_BVH)
+            bvh_.draw_debug_geometry(debug, depthTest);
+        else
+            Octant::draw_debug_geometry(debug, depthTest);
     }
 }
 
@@ -348,6 +431,37 @@ void Octree::SetSize(const BoundingBox& box, i32 numLevels)
     numLevels_ = Max(numLevels, 1);
 }
 
+void Octree::SetSpatialIndex(SpatialIndexType type)
+{
+    if (type == spatialIndex_)
+        return;
+
+    DV_PROFILE(ChangeSpatialIndex);
+
+    // Move all drawables to the root. Drawables from child octants are also queued for update
+    for (i32 i = 0; i < NUM_OCTANTS; ++i)
+        DeleteChild(i);
+
+    numDrawables_ = drawables_.Size();
+    spatialIndex_ = type;
+
+    if (spatialIndex_ == SPATIAL_INDEX_DYNAMIC_BVH)
+    {
+        for (Drawable* drawable : drawables_)
+            UpdateBvhDrawable(drawable);
+    }
+    else
+    {
+        // Reinsert to octants on the next update
+        ClearBvh();
+        for (Drawable* drawable : drawables_)
+        {
+            if (!drawable->updateQueued_)
+                queue_update(drawable);
+        }
+    }
+}
+
 void Octree::Update(const FrameInfo& frame)
 {
     if (!Thread::IsMainThread())
@@ -356,6 +470,11 @@ void Octree::Update(const FrameInfo& frame)
         return;
     }
 
+    WorkQueue* queue = DV_WORK_QUEUE;
+    i32 numThreadLists = queue->GetNumThreads() + 1; // Worker threads + main thread
+    if (threadedDrawableUpdates_.Size() != numThreadLists)
+        threadedDrawableUpdates_.Resize(numThreadLists);
+
     // Let drawables update themselves before reinsertion. This can be used for animation
     if (!drawableUpdates_.Empty())
     {
@@ -364,42 +483,27 @@ void Octree::Update(const FrameInfo& frame)
         // Perform updates in worker threads. Notify the scene that a threaded update is going on and components
         // (for example physics objects) should not perform non-threadsafe work when marked dirty
         Scene* scene = GetScene();
-        WorkQueue* queue = DV_WORK_QUEUE;
         scene->BeginThreadedUpdate();
-
-        int numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
-        int drawablesPerItem = Max((int)(drawableUpdates_.Size() / numWorkItems), 1);
-
-        Vector<Drawable*>::Iterator start = drawableUpdates_.Begin();
-        // Create a work item for each thread
-        for (int i = 0; i < numWorkItems; ++i)
-        {
-            SharedPtr<WorkItem> item = queue->GetFreeItem();
-            item->priority_ = WI_MAX_PRIORITY;
-            item->workFunction_ = UpdateDrawablesWork;
-            item->aux_ = const_cast<FrameInfo*>(&frame);
-
-            Vector<Drawable*>::Iterator end = drawableUpdates_.End();
-            if (i < numWorkItems - 1 && end - start > drawablesPerItem)
-                end = start + drawablesPerItem;
-
-            item->start_ = &(*start);
-            item->end_ = &(*end);
-            queue->AddWorkItem(item);
-
-            start = end;
-        }
-
-        queue->Complete(WI_MAX_PRIORITY);
+        ProcessDrawablesThreaded(drawableUpdates_, UpdateDrawablesWork, const_cast<FrameInfo*>(&frame));
         scene->EndThreadedUpdate();
     }
 
-    // If any drawables were inserted during threaded update, update them now from the main thread
-    if (!threadedDrawableUpdates_.Empty())
+    // Merge the per-thread queues of drawables that were inserted during threaded update
+    // and update them now from the main thread
+    {
+        scoped_lock lock(octree_mutex_);
+        threadedDrawableUpdates_[0].Push(lockedDrawableUpdates_);
+        lockedDrawableUpdates_.Clear();
+    }
+
+    for (Vector<Drawable*>& threadUpdates : threadedDrawableUpdates_)
     {
+        if (threadUpdates.Empty())
+            continue;
+
         DV_PROFILE(UpdateDrawablesQueuedDuringUpdate);
 
-        for (Vector<Drawable*>::ConstIterator i = threadedDrawableUpdates_.Begin(); i != threadedDrawableUpdates_.End(); ++i)
+        for (Vector<Drawable*>::ConstIterator i = threadUpdates.Begin(); i != threadUpdates.End(); ++i)
         {
             Drawable* drawable = *i;
             if (drawable)
@@ -409,7 +513,7 @@ void Octree::Update(const FrameInfo& frame)
             }
         }
 
-        threadedDrawableUpdates_.Clear();
+        threadUpdates.Clear();
     }
 
     // Notify drawable update being finished. Custom animation (eg. IK) can be done at this point
@@ -424,9 +528,29 @@ void Octree::Update(const FrameInfo& frame)
         scene->SendEvent(E_SCENEDRAWABLEUPDATEFINISHED, eventData);
     }
 
+    // With the dynamic BVH, update the proxies of drawables that have been moved or resized. Proxies have enlarged
+    // bounding boxes, so small movements are cheap
+    if (!drawableUpdates_.Empty() && spatialIndex_ == SPATIAL_INDEX_DYNAMIC_BVH)
+    {
+        DV_PROFILE(UpdateBvh);
+
+        for (Vector<Drawable*>::Iterator i = drawableUpdates_.Begin(); i != drawableUpdates_.End(); ++i)
+        {
+            Drawable* drawable = *i;
+            drawable->updateQueued_ = false;
+            Octant* octant = drawable->GetOctant();
+
+            // Skip if no octant or does not belong to this octree anymore
+            if (!octant || octant->GetRoot() != this)
+                continue;
+
+            UpdateBvhDrawable(drawable);
+        }
+    }
     // Reinsert drawables that have been moved or resized, or that have been newly added to the octree and do not sit inside
-    // the proper octant yet
-    if (!drawableUpdates_.Empty())
+    // the proper octant yet. Runs on the main thread: refreshing the lazily calculated world bounds walks parent node
+    // transforms that drawables may share, and reinsertion modifies the octant hierarchy
+    else if (!drawableUpdates_.Empty())
     {
         DV_PROFILE(ReinsertToOctree);
 
@@ -461,6 +585,36 @@ void Octree::Update(const FrameInfo& frame)
     drawableUpdates_.Clear();
 }
 
+void Octree::ProcessDrawablesThreaded(Vector<Drawable*>& drawables, void (*workFunction)(const WorkItem*, i32), void* aux)
+{
+    WorkQueue* queue = DV_WORK_QUEUE;
+
+    int numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
+    int drawablesPerItem = Max((int)(drawables.Size() / numWorkItems), 1);
+
+    Vector<Drawable*>::Iterator start = drawables.Begin();
+    // Create a work item for each thread
+    for (int i = 0; i < numWorkItems && start != drawables.End(); ++i)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = WI_MAX_PRIORITY;
+        item->workFunction_ = workFunction;
+        item->aux_ = aux;
+
+        Vector<Drawable*>::Iterator end = drawables.End();
+        if (i < numWorkItems - 1 && end - start > drawablesPerItem)
+            end = start + drawablesPerItem;
+
+        item->start_ = &(*start);
+        item->end_ = &(*end);
+        queue->AddWorkItem(item);
+
+        start = end;
+    }
+
+    queue->Complete(WI_MAX_PRIORITY);
+}
+
 void Octree::add_manual_drawable(Drawable* drawable)
 {
     if (!drawable || drawable->GetOctant())
@@ -482,7 +636,87 @@ void Octree::remove_manual_drawable(Drawable* drawable)
 void Octree::GetDrawables(OctreeQuery& query) const
 {
     query.result_.Clear();
-    GetDrawablesInternal(query, false);
+
+    if (spatialIndex_ == SPATIAL_INDEX_DYNAMIC_BVH)
+    {
+        if (bvhNonOccludees_.Size())
+        {
+            auto** start = const_cast<Drawable**>(&bvhNonOccludees_[0]);
+            Drawable** end = start + bvhNonOccludees_.Size();
+            query.test_drawables(start, end, false);
+        }
+
+        bvh_.GetDrawables(query);
+        return;
+    }
+
+    // Threaded traversal is possible only from the main thread, when it is not already executing work items
+    if (query.threaded_ && DV_WORK_QUEUE->GetNumThreads() && Thread::IsMainThread() && !DV_WORK_QUEUE->IsCompleting())
+        GetDrawablesThreaded(query);
+    else
+        GetDrawablesInternal(query, false);
+}
+
+void Octree::GetDrawablesThreaded(OctreeQuery& query) const
+{
+    DV_PROFILE(GetDrawablesThreaded);
+
+    WorkQueue* queue = DV_WORK_QUEUE;
+    i32 numThreads = queue->GetNumThreads() + 1; // Worker threads + main thread
+
+    threadQueryResults_.Resize(numThreads);
+    threadQueries_.Resize(numThreads);
+    for (i32 i = 0; i < numThreads; ++i)
+    {
+        threadQueryResults_[i].Clear();
+        threadQueries_[i] = query.clone(threadQueryResults_[i]);
+
+        // The query does not support threaded traversal, so do it in the main thread
+        if (!threadQueries_[i])
+        {
+            GetDrawablesInternal(query, false);
+            return;
+        }
+    }
+
+    // Traverse the top levels in the main thread
+    queryTasks_.Clear();
+    GetDrawablesSplitInternal(query, false, THREADED_QUERY_SPLIT_LEVEL, queryTasks_);
+    if (queryTasks_.Empty())
+    {
+        threadQueries_.Clear();
+        return;
+    }
+
+    // Use more work items than threads, as the octant subtrees can be of very different size
+    i32 numWorkItems = Min(queryTasks_.Size(), numThreads * 4);
+    i32 tasksPerItem = queryTasks_.Size() / numWorkItems;
+    i32 remainder = queryTasks_.Size() % numWorkItems;
+
+    OctantQueryTask* start = queryTasks_.Buffer();
+    for (i32 i = 0; i < numWorkItems; ++i)
+    {
+        OctantQueryTask* end = start + tasksPerItem + (i < remainder ? 1 : 0);
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = WI_MAX_PRIORITY;
+        item->workFunction_ = GetDrawablesWork;
+        item->aux_ = &threadQueries_;
+        item->start_ = start;
+        item->end_ = end;
+        queue->AddWorkItem(item);
+
+        start = end;
+    }
+
+    queue->Complete(WI_MAX_PRIORITY);
+
+    // Each thread appended to its own list, so merging needs no locking
+    for (i32 i = 0; i < numThreads; ++i)
+    {
+        query.result_.Push(threadQueryResults_[i]);
+        threadQueries_[i].reset();
+    }
 }
 
 void Octree::Raycast(RayOctreeQuery& query) const
@@ -490,7 +724,20 @@ void Octree::Raycast(RayOctreeQuery& query) const
     DV_PROFILE(Raycast);
 
     query.result_.Clear();
-    GetDrawablesInternal(query);
+
+    if (spatialIndex_ == SPATIAL_INDEX_DYNAMIC_BVH)
+    {
+        for (Drawable* drawable : bvhNonOccludees_)
+        {
+            if (!!(drawable->GetDrawableType() & query.drawableTypes_) && (drawable->GetViewMask() & query.viewMask_))
+                drawable->ProcessRayQuery(query, query.result_);
+        }
+
+        bvh_.Raycast(query);
+    }
+    else
+        GetDrawablesInternal(query);
+
     sort(query.result_.Begin(), query.result_.End(), CompareRayQueryResults);
 }
 
@@ -500,7 +747,19 @@ void Octree::RaycastSingle(RayOctreeQuery& query) const
 
     query.result_.Clear();
     rayQueryDrawables_.Clear();
-    GetDrawablesOnlyInternal(query, rayQueryDrawables_);
+
+    if (spatialIndex_ == SPATIAL_INDEX_DYNAMIC_BVH)
+    {
+        for (Drawable* drawable : bvhNonOccludees_)
+        {
+            if (!!(drawable->GetDrawableType() & query.drawableTypes_) && (drawable->GetViewMask() & query.viewMask_))
+                rayQueryDrawables_.Push(drawable);
+        }
+
+        bvh_.GetDrawablesOnly(query, rayQueryDrawables_);
+    }
+    else
+        GetDrawablesOnlyInternal(query, rayQueryDrawables_);
 
     // Sort by increasing hit distance to AABB
     for (Vector<Drawable*>::Iterator i = rayQueryDrawables_.Begin(); i != rayQueryDrawables_.End(); ++i)
@@ -539,8 +798,15 @@ void Octree::queue_update(Drawable* drawable)
     Scene* scene = GetScene();
     if (scene && scene->IsThreadedUpdate())
     {
-        scoped_lock lock(octree_mutex_);
-        threadedDrawableUpdates_.Push(drawable);
+        // Each work queue thread owns its list, so no locking is needed for them
+        i32 threadIndex = WorkQueue::GetCurrentThreadIndex();
+        if (threadIndex >= 0 && threadIndex < threadedDrawableUpdates_.Size())
+            threadedDrawableUpdates_[threadIndex].Push(drawable);
+        else
+        {
+            scoped_lock lock(octree_mutex_);
+            lockedDrawableUpdates_.Push(drawable);
+        }
     }
     else
         drawableUpdates_.Push(drawable);
@@ -556,6 +822,73 @@ void Octree::cancel_update(Drawable* drawable)
     drawable->updateQueued_ = false;
 }
 
+void Octree::UpdateBvhDrawable(Drawable* drawable)
+{
+    const BoundingBox& box = drawable->GetWorldBoundingBox();
+
+    if (drawable->IsOccludee())
+    {
+        if (drawable->spatialProxy_ == NINDEX)
+        {
+            RemoveBvhNonOccludee(drawable);
+            drawable->spatialProxy_ = bvh_.CreateProxy(box, drawable);
+        }
+        else
+            bvh_.MoveProxy(drawable->spatialProxy_, box);
+    }
+    else
+    {
+        if (drawable->spatialProxy_ != NINDEX)
+        {
+            bvh_.DestroyProxy(drawable->spatialProxy_);
+            drawable->spatialProxy_ = NINDEX;
+        }
+
+        if (drawable->nonOccludeeIndex_ == NINDEX)
+        {
+            drawable->nonOccludeeIndex_ = bvhNonOccludees_.Size();
+            bvhNonOccludees_.Push(drawable);
+        }
+    }
+}
+
+void Octree::RemoveBvhDrawable(Drawable* drawable)
+{
+    if (drawable->spatialProxy_ != NINDEX)
+    {
+        bvh_.DestroyProxy(drawable->spatialProxy_);
+        drawable->spatialProxy_ = NINDEX;
+    }
+    else
+        RemoveBvhNonOccludee(drawable);
+}
+
+void Octree::RemoveBvhNonOccludee(Drawable* drawable)
+{
+    i32 index = drawable->nonOccludeeIndex_;
+    if (index == NINDEX)
+        return;
+
+    // Move the last drawable into the freed slot
+    Drawable* last = bvhNonOccludees_.Back();
+    bvhNonOccludees_[index] = last;
+    last->nonOccludeeIndex_ = index;
+    bvhNonOccludees_.Pop();
+    drawable->nonOccludeeIndex_ = NINDEX;
+}
+
+void Octree::ClearBvh()
+{
+    // With the dynamic BVH all drawables are in the root octant
+    for (Drawable* drawable : drawables_)
+        drawable->spatialProxy_ = NINDEX;
+    for (Drawable* drawable : bvhNonOccludees_)
+        drawable->nonOccludeeIndex_ = NINDEX;
+
+    bvh_.Clear();
+    bvhNonOccludees_.Clear();
+}
+
 void Octree::draw_debug_geometry(bool depthTest)
 {
     auto* debug = GetComponent<DebugRenderer>();
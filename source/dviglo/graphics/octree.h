@@ -5,6 +5,7 @@
 #pragma once
 
 #include "drawable.h"
+#include "dynamic_aabb_tree.h"
 #include "octree_query.h"
 
 #include <mutex>
@@ -14,12 +15,34 @@ namespace dviglo
 
 class Octree;
 
+/// Spatial index used by the octree component.
+enum SpatialIndexType
+{
+    /// Octants with fixed world size and subdivision levels.
+    SPATIAL_INDEX_OCTREE = 0,
+    /// Dynamic bounding volume hierarchy without world size limits.
+    SPATIAL_INDEX_DYNAMIC_BVH
+};
+
 static const int NUM_OCTANTS = 8;
 static const i32 ROOT_INDEX = NINDEX;
+/// Octree level at which threaded queries are split into work items.
+static const i32 THREADED_QUERY_SPLIT_LEVEL = 2;
+
+/// Octant subtree to be traversed by a threaded octree query.
+struct OctantQueryTask
+{
+    /// Octant. Tested against the query by the traversal.
+    const Octant* octant_;
+    /// Whether the parent octant was fully inside the query.
+    bool inside_;
+};
 
 /// %Octree octant.
 class DV_API Octant
 {
+    friend void GetDrawablesWork(const WorkItem* item, i32 threadIndex);
+
 public:
     /// Construct.
     Octant(const BoundingBox& box, i32 level, Octant* parent, Octree* root, i32 index = ROOT_INDEX);
@@ -44,15 +67,7 @@ public:
     }
 
     /// Remove a drawable object from this octant.
-    void RemoveDrawable(Drawable* drawable, bool resetOctant = true)
-    {
-        if (drawables_.Remove(drawable))
-        {
-            if (resetOctant)
-                drawable->SetOctant(nullptr);
-            DecDrawableCount();
-        }
-    }
+    void RemoveDrawable(Drawable* drawable, bool resetOctant = true);
 
     /// Return world-space bounding box.
     const BoundingBox& GetWorldBoundingBox() const { return worldBoundingBox_; }
@@ -85,6 +100,8 @@ protected:
     void Initialize(const BoundingBox& box);
     /// Return drawable objects by a query, called internally.
     void GetDrawablesInternal(OctreeQuery& query, bool inside) const;
+    /// Return drawable objects by a query down to the split level and collect the octants below it for threaded traversal, called internally.
+    void GetDrawablesSplitInternal(OctreeQuery& query, bool inside, i32 splitLevel, Vector<OctantQueryTask>& tasks) const;
     /// Return drawable objects by a ray query, called internally.
     void GetDrawablesInternal(RayOctreeQuery& query) const;
     /// Return drawable objects only for a threaded ray query, called internally.
@@ -138,11 +155,13 @@ protected:
     i32 index_;
 };
 
-/// %Octree component. Should be added only to the root scene node.
+/// %Octree component. Should be added only to the root scene node. Can alternatively use a dynamic BVH as the spatial index.
 class DV_API Octree : public Component, public Octant
 {
     DV_OBJECT(Octree);
 
+    friend class Octant;
+
 public:
     /// Construct.
     explicit Octree();
@@ -156,6 +175,8 @@ public:
 
     /// Set size and maximum subdivision levels. If octree is not empty, drawable objects will be temporarily moved to the root.
     void SetSize(const BoundingBox& box, i32 numLevels);
+    /// Set spatial index type. With the dynamic BVH the size and subdivision levels are not used for culling.
+    void SetSpatialIndex(SpatialIndexType type);
     /// Update and reinsert drawable objects.
     void Update(const FrameInfo& frame);
     /// Add a drawable manually.
@@ -172,6 +193,10 @@ public:
 
     /// Return subdivision levels.
     i32 GetNumLevels() const { return numLevels_; }
+    /// Return spatial index type.
+    SpatialIndexType GetSpatialIndex() const { return spatialIndex_; }
+    /// Return the dynamic BVH. Empty unless the dynamic BVH spatial index is in use.
+    const DynamicAabbTree& GetDynamicBvh() const { return bvh_; }
 
     /// Mark drawable object as requiring an update and a reinsertion.
     void queue_update(Drawable* drawable);
@@ -185,17 +210,44 @@ private:
     void HandleRenderUpdate(StringHash eventType, VariantMap& eventData);
     /// Update octree size.
     void UpdateOctreeSize() { SetSize(worldBoundingBox_, numLevels_); }
+    /// Return drawable objects by a query, splitting the traversal between work queue threads.
+    void GetDrawablesThreaded(OctreeQuery& query) const;
+    /// Add a drawable to the dynamic BVH or update its proxy after it moved.
+    void UpdateBvhDrawable(Drawable* drawable);
+    /// Remove a drawable from the dynamic BVH.
+    void RemoveBvhDrawable(Drawable* drawable);
+    /// Remove a drawable from the non-occludees kept outside the dynamic BVH. Changes the order of the list.
+    void RemoveBvhNonOccludee(Drawable* drawable);
+    /// Remove all drawables from the dynamic BVH.
+    void ClearBvh();
+
+    /// Split a list of drawables into work items for the main thread and the worker threads and complete them.
+    void ProcessDrawablesThreaded(Vector<Drawable*>& drawables, void (*workFunction)(const WorkItem*, i32), void* aux);
 
     /// Drawable objects that require update.
     Vector<Drawable*> drawableUpdates_;
-    /// Drawable objects that were inserted during threaded update phase.
-    Vector<Drawable*> threadedDrawableUpdates_;
-    /// Mutex for octree reinsertions.
+    /// Drawable objects that were inserted during threaded update phase, one list per work queue thread (0 = main thread). Written without locking.
+    Vector<Vector<Drawable*>> threadedDrawableUpdates_;
+    /// Drawable objects that were inserted during threaded update phase from threads not managed by the work queue.
+    Vector<Drawable*> lockedDrawableUpdates_;
+    /// Mutex for octree reinsertions from threads not managed by the work queue.
     std::mutex octree_mutex_;
     /// Ray query temporary list of drawables.
     mutable Vector<Drawable*> rayQueryDrawables_;
+    /// Threaded query octant subtrees.
+    mutable Vector<OctantQueryTask> queryTasks_;
+    /// Threaded query per-thread copies of the query.
+    mutable Vector<std::unique_ptr<OctreeQuery>> threadQueries_;
+    /// Threaded query per-thread result lists.
+    mutable Vector<Vector<Drawable*>> threadQueryResults_;
+    /// Dynamic BVH of occludee drawables.
+    DynamicAabbTree bvh_;
+    /// Drawables that are not occludees. Kept outside the dynamic BVH, as node occlusion must not hide them. Each stores its index in Drawable::nonOccludeeIndex_.
+    Vector<Drawable*> bvhNonOccludees_;
     /// Subdivision level.
     i32 numLevels_;
+    /// Spatial index type.
+    SpatialIndexType spatialIndex_{SPATIAL_INDEX_OCTREE};
 };
 
 }
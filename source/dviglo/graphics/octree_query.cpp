@@ -53,6 +53,11 @@ void SphereOctreeQuery::test_drawables(Drawable** start, Drawable** end, bool in
     }
 }
 
+std::unique_ptr<OctreeQuery> SphereOctreeQuery::clone(Vector<Drawable*>& result) const
+{
+    return std::make_unique<SphereOctreeQuery>(result, sphere_, drawableTypes_, viewMask_);
+}
+
 Intersection BoxOctreeQuery::test_octant(const BoundingBox& box, bool inside)
 {
     if (inside)
@@ -75,6 +80,11 @@ void BoxOctreeQuery::test_drawables(Drawable** start, Drawable** end, bool insid
     }
 }
 
+std::unique_ptr<OctreeQuery> BoxOctreeQuery::clone(Vector<Drawable*>& result) const
+{
+    return std::make_unique<BoxOctreeQuery>(result, box_, drawableTypes_, viewMask_);
+}
+
 Intersection FrustumOctreeQuery::test_octant(const BoundingBox& box, bool inside)
 {
     if (inside)
@@ -97,6 +107,11 @@ void FrustumOctreeQuery::test_drawables(Drawable** start, Drawable** end, bool i
     }
 }
 
+std::unique_ptr<OctreeQuery> FrustumOctreeQuery::clone(Vector<Drawable*>& result) const
+{
+    return std::make_unique<FrustumOctreeQuery>(result, frustum_, drawableTypes_, viewMask_);
+}
+
 
 Intersection AllContentOctreeQuery::test_octant(const BoundingBox& box, bool inside)
 {
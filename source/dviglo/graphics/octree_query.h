@@ -12,6 +12,8 @@
 #include "../math/ray.h"
 #include "../math/sphere.h"
 
+#include <memory>
+
 namespace dviglo
 {
 
@@ -42,6 +44,9 @@ public:
     virtual Intersection test_octant(const BoundingBox& box, bool inside) = 0;
     /// Intersection test for drawables.
     virtual void test_drawables(Drawable** start, Drawable** end, bool inside) = 0;
+    /// Return a copy of the query that appends to another result vector, or null if the query can not be split between threads.
+    /// Derived classes that support threaded traversal must override this to copy themselves.
+    virtual std::unique_ptr<OctreeQuery> clone(Vector<Drawable*>& result) const { return nullptr; }
 
     /// Result vector reference.
     Vector<Drawable*>& result_;
@@ -49,6 +54,8 @@ public:
     DrawableTypes drawableTypes_;
     /// Drawable layers to include.
     unsigned viewMask_;
+    /// Whether to split the octree traversal between work queue threads. Opt-in, requires clone() support. Only has effect when querying from the main thread outside of other threaded work.
+    bool threaded_{};
 };
 
 /// Point octree query.
@@ -88,6 +95,8 @@ public:
     Intersection test_octant(const BoundingBox& box, bool inside) override;
     /// Intersection test for drawables.
     void test_drawables(Drawable** start, Drawable** end, bool inside) override;
+    /// Return a copy of the query that appends to another result vector.
+    std::unique_ptr<OctreeQuery> clone(Vector<Drawable*>& result) const override;
 
     /// Sphere.
     Sphere sphere_;
@@ -109,6 +118,8 @@ public:
     Intersection test_octant(const BoundingBox& box, bool inside) override;
     /// Intersection test for drawables.
     void test_drawables(Drawable** start, Drawable** end, bool inside) override;
+    /// Return a copy of the query that appends to another result vector.
+    std::unique_ptr<OctreeQuery> clone(Vector<Drawable*>& result) const override;
 
     /// Bounding box.
     BoundingBox box_;
@@ -130,6 +141,8 @@ public:
     Intersection test_octant(const BoundingBox& box, bool inside) override;
     /// Intersection test for drawables.
     void test_drawables(Drawable** start, Drawable** end, bool inside) override;
+    /// Return a copy of the query that appends to another result vector.
+    std::unique_ptr<OctreeQuery> clone(Vector<Drawable*>& result) const override;
 
     /// Frustum.
     Frustum frustum_;
@@ -24,6 +24,7 @@ static const i32 MAX_PARTICLES_IN_FRAME = 100;
 extern const char* autoRemoveModeNames[];
 
 ParticleEmitter::ParticleEmitter() :
+    freeParticleHint_(0),
     periodTimer_(0.0f),
     emissionTimer_(0.0f),
     lastTimeStep_(0.0f),
@@ -144,97 +145,53 @@ void ParticleEmitter::Update(const FrameInfo& frame)
         }
     }
 
-    // Update existing particles
-    Vector3 relativeConstantForce = node_->GetWorldRotation().Inverse() * effect_->GetConstantForce();
-    // If billboards are not relative, apply scaling to the position update
-    Vector3 scaleVector = Vector3::ONE;
-    if (scaled_ && !relative_)
-        scaleVector = node_->GetWorldScale();
-
+    // Expire particles before the timers advance, and find the end of the active range
+    i32 activeEnd = 0;
     for (i32 i = 0; i < particles_.Size(); ++i)
     {
-        Particle& particle = particles_[i];
         Billboard& billboard = billboards_[i];
+        if (!billboard.enabled_)
+            continue;
 
-        if (billboard.enabled_)
+        needCommit = true;
+        if (particles_.timer_[i] >= particles_.timeToLive_[i])
         {
-            needCommit = true;
-
-            // Time to live
-            if (particle.timer_ >= particle.timeToLive_)
-            {
-                billboard.enabled_ = false;
-                continue;
-            }
-            particle.timer_ += lastTimeStep_;
-
-            // Velocity & position
-            const Vector3& constantForce = effect_->GetConstantForce();
-            if (constantForce != Vector3::ZERO)
-            {
-                if (relative_)
-                    particle.velocity_ += lastTimeStep_ * relativeConstantForce;
-                else
-                    particle.velocity_ += lastTimeStep_ * constantForce;
-            }
-
-            float dampingForce = effect_->GetDampingForce();
-            if (dampingForce != 0.0f)
-            {
-                Vector3 force = -dampingForce * particle.velocity_;
-                particle.velocity_ += lastTimeStep_ * force;
-            }
-            billboard.position_ += lastTimeStep_ * particle.velocity_ * scaleVector;
-            billboard.direction_ = particle.velocity_.normalized();
+            billboard.enabled_ = false;
+            freeParticleHint_ = Min(freeParticleHint_, i);
+        }
+        else
+            activeEnd = i + 1;
+    }
 
-            // Rotation
-            billboard.rotation_ += lastTimeStep_ * particle.rotationSpeed_;
+    // Integrate the active range with the SIMD kernels. Inactive particles in the range are updated too, which is
+    // harmless as emitting resets them
+    Vector3 constantForce = effect_->GetConstantForce();
+    if (relative_)
+        constantForce = node_->GetWorldRotation().Inverse() * constantForce;
+    particles_.Integrate(0, activeEnd, lastTimeStep_, constantForce, effect_->GetDampingForce());
 
-            // Scaling
-            float sizeAdd = effect_->GetSizeAdd();
-            float sizeMul = effect_->GetSizeMul();
-            if (sizeAdd != 0.0f || sizeMul != 1.0f)
-            {
-                particle.scale_ += lastTimeStep_ * sizeAdd;
-                if (particle.scale_ < 0.0f)
-                    particle.scale_ = 0.0f;
-                if (sizeMul != 1.0f)
-                    particle.scale_ *= (lastTimeStep_ * (sizeMul - 1.0f)) + 1.0f;
-                billboard.size_ = particle.size_ * particle.scale_;
-            }
+    float sizeAdd = effect_->GetSizeAdd();
+    float sizeMul = effect_->GetSizeMul();
+    bool scaling = sizeAdd != 0.0f || sizeMul != 1.0f;
+    if (scaling)
+        particles_.UpdateScales(0, activeEnd, lastTimeStep_, sizeAdd, sizeMul);
 
-            // Color interpolation
-            i32& index = particle.colorIndex_;
-            const Vector<ColorFrame>& colorFrames_ = effect_->GetColorFrames();
-            if (index < colorFrames_.Size())
-            {
-                if (index < colorFrames_.Size() - 1)
-                {
-                    if (particle.timer_ >= colorFrames_[index + 1].time_)
-                        ++index;
-                }
-                if (index < colorFrames_.Size() - 1)
-                    billboard.color_ = colorFrames_[index].Interpolate(colorFrames_[index + 1], particle.timer_);
-                else
-                    billboard.color_ = colorFrames_[index].color_;
-            }
+    // If billboards are not relative, apply scaling to the position update
+    Vector3 scaleVector = Vector3::ONE;
+    if (scaled_ && !relative_)
+        scaleVector = node_->GetWorldScale();
 
-            // Texture animation
-            i32& texIndex = particle.texIndex_;
-            const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
-            if (textureFrames_.Size() && texIndex < textureFrames_.Size() - 1)
-            {
-                if (particle.timer_ >= textureFrames_[texIndex + 1].time_)
-                {
-                    billboard.uv_ = textureFrames_[texIndex + 1].uv_;
-                    ++texIndex;
-                }
-            }
-        }
-    }
+    // Write the billboards with the SIMD kernel as well. Find the bounding box in the same pass, as the octree asks for
+    // it right after the update. Screen size scale factors change per view, so fixed screen size billboards are skipped
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    billboardsBox_.Clear();
+    particles_.UpdateBillboards(0, activeEnd, billboards_.Buffer(), lastTimeStep_, scaleVector, scaling,
+        effect_->GetColorFrames(), effect_->GetTextureFrames(), fixedScreenSize_ ? nullptr : &billboardsBox_,
+        relative_ ? worldTransform : Matrix3x4::IDENTITY, scaled_ ? worldTransform.Scale() : Vector3::ONE);
 
     if (needCommit)
         Commit();
+    billboardsBoxValid_ = !fixedScreenSize_;
 
     needUpdate_ = false;
 }
@@ -267,6 +224,7 @@ void ParticleEmitter::SetNumParticles(i32 num)
 
     particles_.Resize(num);
     SetNumBillboards(num);
+    freeParticleHint_ = 0;
 }
 
 void ParticleEmitter::SetEmitting(bool enable)
@@ -303,6 +261,7 @@ void ParticleEmitter::RemoveAllParticles()
 {
     for (Vector<Billboard>::Iterator i = billboards_.Begin(); i != billboards_.End(); ++i)
         i->enabled_ = false;
+    freeParticleHint_ = 0;
 
     Commit();
 }
@@ -349,16 +308,18 @@ void ParticleEmitter::SetParticlesAttr(const VariantVector& value)
     i32 index = 0;
     SetNumParticles(index < value.Size() ? value[index++].GetU32() : 0);
 
-    for (Vector<Particle>::Iterator i = particles_.Begin(); i != particles_.End() && index < value.Size(); ++i)
+    for (i32 i = 0; i < particles_.Size() && index < value.Size(); ++i)
     {
-        i->velocity_ = value[index++].GetVector3();
-        i->size_ = value[index++].GetVector2();
-        i->timer_ = value[index++].GetFloat();
-        i->timeToLive_ = value[index++].GetFloat();
-        i->scale_ = value[index++].GetFloat();
-        i->rotationSpeed_ = value[index++].GetFloat();
-        i->colorIndex_ = value[index++].GetI32();
-        i->texIndex_ = value[index++].GetI32();
+        Particle particle;
+        particle.velocity_ = value[index++].GetVector3();
+        particle.size_ = value[index++].GetVector2();
+        particle.timer_ = value[index++].GetFloat();
+        particle.timeToLive_ = value[index++].GetFloat();
+        particle.scale_ = value[index++].GetFloat();
+        particle.rotationSpeed_ = value[index++].GetFloat();
+        particle.colorIndex_ = value[index++].GetI32();
+        particle.texIndex_ = value[index++].GetI32();
+        particles_.Set(i, particle);
     }
 }
 
@@ -373,16 +334,17 @@ VariantVector ParticleEmitter::GetParticlesAttr() const
 
     ret.Reserve(particles_.Size() * 8 + 1);
     ret.Push(particles_.Size());
-    for (Vector<Particle>::ConstIterator i = particles_.Begin(); i != particles_.End(); ++i)
+    for (i32 i = 0; i < particles_.Size(); ++i)
     {
-        ret.Push(i->velocity_);
-        ret.Push(i->size_);
-        ret.Push(i->timer_);
-        ret.Push(i->timeToLive_);
-        ret.Push(i->scale_);
-        ret.Push(i->rotationSpeed_);
-        ret.Push(i->colorIndex_);
-        ret.Push(i->texIndex_);
+        Particle particle = particles_.Get(i);
+        ret.Push(particle.velocity_);
+        ret.Push(particle.size_);
+        ret.Push(particle.timer_);
+        ret.Push(particle.timeToLive_);
+        ret.Push(particle.scale_);
+        ret.Push(particle.rotationSpeed_);
+        ret.Push(particle.colorIndex_);
+        ret.Push(particle.texIndex_);
     }
     return ret;
 }
@@ -413,6 +375,30 @@ VariantVector ParticleEmitter::GetParticleBillboardsAttr() const
     return ret;
 }
 
+void ParticleEmitter::OnMarkedDirty(Node* node)
+{
+    billboardsBoxValid_ = false;
+    BillboardSet::OnMarkedDirty(node);
+}
+
+void ParticleEmitter::OnWorldBoundingBoxUpdate()
+{
+    // The box found in Update() is used once. Billboards changed after that, for example through Commit(), need the
+    // full pass over the billboards
+    if (!billboardsBoxValid_)
+    {
+        BillboardSet::OnWorldBoundingBoxUpdate();
+        return;
+    }
+
+    billboardsBoxValid_ = false;
+
+    // Always merge the node's own position to ensure particle emitter updates continue when the relative mode is switched
+    BoundingBox worldBox = billboardsBox_;
+    worldBox.Merge(node_->GetWorldPosition());
+    worldBoundingBox_ = worldBox;
+}
+
 void ParticleEmitter::OnSceneSet(Scene* scene)
 {
     BillboardSet::OnSceneSet(scene);
@@ -429,7 +415,8 @@ bool ParticleEmitter::EmitNewParticle()
     if (index == NINDEX)
         return false;
     assert(index < particles_.Size());
-    Particle& particle = particles_[index];
+    freeParticleHint_ = index + 1;
+    Particle particle;
     Billboard& billboard = billboards_[index];
 
     Vector3 startDir;
@@ -511,9 +498,10 @@ bool ParticleEmitter::EmitNewParticle()
     };
 
     particle.velocity_ = effect_->GetRandomVelocity() * startDir;
+    particles_.Set(index, particle);
 
     billboard.position_ = startPos;
-    billboard.size_ = particles_[index].size_;
+    billboard.size_ = particle.size_;
     const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
     billboard.uv_ = textureFrames_.Size() ? textureFrames_[0].uv_ : Rect::POSITIVE;
     billboard.rotation_ = effect_->GetRandomRotation();
@@ -527,7 +515,13 @@ bool ParticleEmitter::EmitNewParticle()
 
 i32 ParticleEmitter::GetFreeParticle() const
 {
-    for (i32 i = 0; i < billboards_.Size(); ++i)
+    // Search from the hint first. Billboards may also be disabled from outside, so wrap around before giving up
+    for (i32 i = freeParticleHint_; i < billboards_.Size(); ++i)
+    {
+        if (!billboards_[i].enabled_)
+            return i;
+    }
+    for (i32 i = 0; i < Min(freeParticleHint_, billboards_.Size()); ++i)
     {
         if (!billboards_[i].enabled_)
             return i;
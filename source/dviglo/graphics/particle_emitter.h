@@ -5,33 +5,13 @@
 #pragma once
 
 #include "billboard_set.h"
+#include "particle_store.h"
 
 namespace dviglo
 {
 
 class ParticleEffect;
 
-/// One particle in the particle system.
-struct Particle
-{
-    /// Velocity.
-    Vector3 velocity_;
-    /// Original billboard size.
-    Vector2 size_;
-    /// Time elapsed from creation.
-    float timer_;
-    /// Lifetime.
-    float timeToLive_;
-    /// Size scaling value.
-    float scale_;
-    /// Rotation speed.
-    float rotationSpeed_;
-    /// Current color animation index.
-    i32 colorIndex_;
-    /// Current texture animation index.
-    i32 texIndex_;
-};
-
 /// %Particle emitter component.
 class DV_API ParticleEmitter : public BillboardSet
 {
@@ -98,6 +78,10 @@ public:
 protected:
     /// Handle scene being assigned.
     void OnSceneSet(Scene* scene) override;
+    /// Handle node transform being dirtied.
+    void OnMarkedDirty(Node* node) override;
+    /// Recalculate the world-space bounding box.
+    void OnWorldBoundingBoxUpdate() override;
 
     /// Create a new particle. Return true if there was room.
     bool EmitNewParticle();
@@ -115,7 +99,13 @@ private:
     /// Particle effect.
     SharedPtr<ParticleEffect> effect_;
     /// Particles.
-    Vector<Particle> particles_;
+    ParticleStore particles_;
+    /// Lowest index that may be a free particle.
+    i32 freeParticleHint_;
+    /// World-space bounding box of the billboards, found while writing them in Update().
+    BoundingBox billboardsBox_;
+    /// Whether the bounding box found in Update() is still valid.
+    bool billboardsBoxValid_{};
     /// Active/inactive period timer.
     float periodTimer_;
     /// New particle emission timer.
@@ -0,0 +1,279 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "billboard_set.h"
+#include "particle_effect.h"
+#include "particle_store.h"
+
+#include "../math/math_defs.h"
+
+#include <emmintrin.h>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+static const float INV_SQRT_TWO = 1.0f / sqrtf(2.0f);
+
+void ParticleStore::Resize(i32 num)
+{
+    assert(num >= 0);
+
+    for (Vector<float>* component : {&velocityX_, &velocityY_, &velocityZ_, &sizeX_, &sizeY_, &timer_, &timeToLive_,
+        &scale_, &rotationSpeed_})
+        component->Resize(num, 0.f);
+
+    colorIndex_.Resize(num, 0);
+    texIndex_.Resize(num, 0);
+}
+
+Particle ParticleStore::Get(i32 index) const
+{
+    Particle particle;
+    particle.velocity_ = GetVelocity(index);
+    particle.size_ = Vector2(sizeX_[index], sizeY_[index]);
+    particle.timer_ = timer_[index];
+    particle.timeToLive_ = timeToLive_[index];
+    particle.scale_ = scale_[index];
+    particle.rotationSpeed_ = rotationSpeed_[index];
+    particle.colorIndex_ = colorIndex_[index];
+    particle.texIndex_ = texIndex_[index];
+    return particle;
+}
+
+void ParticleStore::Set(i32 index, const Particle& particle)
+{
+    velocityX_[index] = particle.velocity_.x;
+    velocityY_[index] = particle.velocity_.y;
+    velocityZ_[index] = particle.velocity_.z;
+    sizeX_[index] = particle.size_.x;
+    sizeY_[index] = particle.size_.y;
+    timer_[index] = particle.timer_;
+    timeToLive_[index] = particle.timeToLive_;
+    scale_[index] = particle.scale_;
+    rotationSpeed_[index] = particle.rotationSpeed_;
+    colorIndex_[index] = particle.colorIndex_;
+    texIndex_[index] = particle.texIndex_;
+}
+
+void ParticleStore::Integrate(i32 start, i32 end, float timeStep, const Vector3& force, float damping)
+{
+    assert(start >= 0 && start <= end && end <= Size());
+
+    float* vx = velocityX_.Empty() ? nullptr : &velocityX_[0];
+    float* vy = velocityY_.Empty() ? nullptr : &velocityY_[0];
+    float* vz = velocityZ_.Empty() ? nullptr : &velocityZ_[0];
+    float* timer = timer_.Empty() ? nullptr : &timer_[0];
+
+    const Vector3 forceStep = timeStep * force;
+    const float damp = 1.f - timeStep * damping;
+
+    const __m128 forceX = _mm_set1_ps(forceStep.x);
+    const __m128 forceY = _mm_set1_ps(forceStep.y);
+    const __m128 forceZ = _mm_set1_ps(forceStep.z);
+    const __m128 damp4 = _mm_set1_ps(damp);
+    const __m128 timeStep4 = _mm_set1_ps(timeStep);
+
+    i32 i = start;
+    for (; i + 4 <= end; i += 4)
+    {
+        _mm_storeu_ps(vx + i, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vx + i), forceX), damp4));
+        _mm_storeu_ps(vy + i, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vy + i), forceY), damp4));
+        _mm_storeu_ps(vz + i, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vz + i), forceZ), damp4));
+        _mm_storeu_ps(timer + i, _mm_add_ps(_mm_loadu_ps(timer + i), timeStep4));
+    }
+
+    for (; i < end; ++i)
+    {
+        vx[i] = (vx[i] + forceStep.x) * damp;
+        vy[i] = (vy[i] + forceStep.y) * damp;
+        vz[i] = (vz[i] + forceStep.z) * damp;
+        timer[i] += timeStep;
+    }
+}
+
+void ParticleStore::UpdateScales(i32 start, i32 end, float timeStep, float sizeAdd, float sizeMul)
+{
+    assert(start >= 0 && start <= end && end <= Size());
+
+    float* scale = scale_.Empty() ? nullptr : &scale_[0];
+
+    const float add = timeStep * sizeAdd;
+    const float mul = timeStep * (sizeMul - 1.f) + 1.f;
+
+    const __m128 add4 = _mm_set1_ps(add);
+    const __m128 mul4 = _mm_set1_ps(mul);
+    const __m128 zero = _mm_setzero_ps();
+
+    i32 i = start;
+    for (; i + 4 <= end; i += 4)
+        _mm_storeu_ps(scale + i, _mm_mul_ps(_mm_max_ps(_mm_add_ps(_mm_loadu_ps(scale + i), add4), zero), mul4));
+
+    for (; i < end; ++i)
+        scale[i] = Max(scale[i] + add, 0.f) * mul;
+}
+
+void ParticleStore::UpdateBillboards(i32 start, i32 end, Billboard* billboards, float timeStep, const Vector3& scale,
+    bool scaling, const Vector<ColorFrame>& colorFrames, const Vector<TextureFrame>& textureFrames, BoundingBox* box,
+    const Matrix3x4& boxTransform, const Vector3& boxScale)
+{
+    assert(start >= 0 && start <= end && end <= Size());
+
+    // Colors are interpolated as one vector per particle
+    static_assert(sizeof(Color) == 4 * sizeof(float));
+
+    const __m128 timeStep4 = _mm_set1_ps(timeStep);
+    const __m128 scaleX = _mm_set1_ps(scale.x);
+    const __m128 scaleY = _mm_set1_ps(scale.y);
+    const __m128 scaleZ = _mm_set1_ps(scale.z);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 epsilon = _mm_set1_ps(M_EPSILON);
+    const __m128 signMask = _mm_set1_ps(-0.f);
+
+    const i32 numColorFrames = colorFrames.Size();
+    const i32 numTextureFrames = textureFrames.Size();
+
+    for (i32 i = start; i < end; i += 4)
+    {
+        const float* vx = &velocityX_[i];
+        const float* vy = &velocityY_[i];
+        const float* vz = &velocityZ_[i];
+        const float* rotationSpeed = &rotationSpeed_[i];
+        const float* sizeX = &sizeX_[i];
+        const float* sizeY = &sizeY_[i];
+        const float* particleScale = &scale_[i];
+        const float* timer = &timer_[i];
+
+        // Copy the last partial group, so that it goes through the same arithmetic
+        i32 count = Min(end - i, 4);
+        alignas(16) float tail[8][4] = {};
+        if (count < 4)
+        {
+            for (i32 j = 0; j < count; ++j)
+            {
+                tail[0][j] = vx[j];
+                tail[1][j] = vy[j];
+                tail[2][j] = vz[j];
+                tail[3][j] = rotationSpeed[j];
+                tail[4][j] = sizeX[j];
+                tail[5][j] = sizeY[j];
+                tail[6][j] = particleScale[j];
+                tail[7][j] = timer[j];
+            }
+
+            vx = tail[0];
+            vy = tail[1];
+            vz = tail[2];
+            rotationSpeed = tail[3];
+            sizeX = tail[4];
+            sizeY = tail[5];
+            particleScale = tail[6];
+            timer = tail[7];
+        }
+
+        __m128 vx4 = _mm_loadu_ps(vx);
+        __m128 vy4 = _mm_loadu_ps(vy);
+        __m128 vz4 = _mm_loadu_ps(vz);
+
+        // Same as Vector3::normalized(): lengths of zero or close to one are kept
+        __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx4, vx4), _mm_mul_ps(vy4, vy4)), _mm_mul_ps(vz4, vz4));
+        __m128 normalize = _mm_and_ps(_mm_cmpgt_ps(lengthSquared, zero),
+            _mm_cmpgt_ps(_mm_andnot_ps(signMask, _mm_sub_ps(lengthSquared, one)), epsilon));
+        __m128 lengthSquaredOrOne = _mm_or_ps(_mm_and_ps(normalize, lengthSquared), _mm_andnot_ps(normalize, one));
+        __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquaredOrOne));
+
+        alignas(16) float moveX[4], moveY[4], moveZ[4], directionX[4], directionY[4], directionZ[4], rotation[4];
+        _mm_store_ps(moveX, _mm_mul_ps(_mm_mul_ps(vx4, timeStep4), scaleX));
+        _mm_store_ps(moveY, _mm_mul_ps(_mm_mul_ps(vy4, timeStep4), scaleY));
+        _mm_store_ps(moveZ, _mm_mul_ps(_mm_mul_ps(vz4, timeStep4), scaleZ));
+        _mm_store_ps(directionX, _mm_mul_ps(vx4, invLength));
+        _mm_store_ps(directionY, _mm_mul_ps(vy4, invLength));
+        _mm_store_ps(directionZ, _mm_mul_ps(vz4, invLength));
+        _mm_store_ps(rotation, _mm_mul_ps(timeStep4, _mm_loadu_ps(rotationSpeed)));
+
+        alignas(16) float width[4], height[4];
+        if (scaling)
+        {
+            __m128 scale4 = _mm_loadu_ps(particleScale);
+            _mm_store_ps(width, _mm_mul_ps(_mm_loadu_ps(sizeX), scale4));
+            _mm_store_ps(height, _mm_mul_ps(_mm_loadu_ps(sizeY), scale4));
+        }
+
+        // Advance the color frames, then find the interpolation factors of all 4 particles at once
+        alignas(16) float frameTime[4] = {}, nextFrameTime[4], colorT[4];
+        for (i32 j = 0; j < 4; ++j)
+            nextFrameTime[j] = 1.f;
+
+        for (i32 j = 0; j < count; ++j)
+        {
+            i32& index = colorIndex_[i + j];
+            if (!billboards[i + j].enabled_ || index >= numColorFrames - 1)
+                continue;
+
+            if (timer[j] >= colorFrames[index + 1].time_)
+                ++index;
+            if (index < numColorFrames - 1)
+            {
+                frameTime[j] = colorFrames[index].time_;
+                nextFrameTime[j] = colorFrames[index + 1].time_;
+            }
+        }
+
+        __m128 frameTime4 = _mm_load_ps(frameTime);
+        __m128 frameInterval = _mm_sub_ps(_mm_load_ps(nextFrameTime), frameTime4);
+        _mm_store_ps(colorT, _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(timer), frameTime4), frameInterval));
+
+        for (i32 j = 0; j < count; ++j)
+        {
+            Billboard& billboard = billboards[i + j];
+            if (!billboard.enabled_)
+                continue;
+
+            billboard.position_ += Vector3(moveX[j], moveY[j], moveZ[j]);
+            billboard.direction_ = Vector3(directionX[j], directionY[j], directionZ[j]);
+            billboard.rotation_ += rotation[j];
+            if (scaling)
+                billboard.size_ = Vector2(width[j], height[j]);
+
+            // Same as ColorFrame::Interpolate()
+            i32 index = colorIndex_[i + j];
+            if (index < numColorFrames - 1)
+            {
+                const ColorFrame& frame = colorFrames[index];
+                const ColorFrame& next = colorFrames[index + 1];
+                if (next.time_ - frame.time_ > 0.f)
+                {
+                    __m128 t = _mm_set1_ps(colorT[j]);
+                    __m128 color = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&frame.color_.r_), _mm_sub_ps(one, t)),
+                        _mm_mul_ps(_mm_loadu_ps(&next.color_.r_), t));
+                    _mm_storeu_ps(&billboard.color_.r_, color);
+                }
+                else
+                    billboard.color_ = next.color_;
+            }
+            else if (index < numColorFrames)
+                billboard.color_ = colorFrames[index].color_;
+
+            i32& texIndex = texIndex_[i + j];
+            if (texIndex < numTextureFrames - 1 && timer[j] >= textureFrames[texIndex + 1].time_)
+            {
+                billboard.uv_ = textureFrames[texIndex + 1].uv_;
+                ++texIndex;
+            }
+
+            if (box)
+            {
+                float size = INV_SQRT_TWO * (billboard.size_.x * boxScale.x + billboard.size_.y * boxScale.y);
+                Vector3 center = boxTransform * billboard.position_;
+                Vector3 edge = Vector3::ONE * size;
+                box->Merge(BoundingBox(center - edge, center + edge));
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/vector.h"
+#include "../math/bounding_box.h"
+#include "../math/matrix3x4.h"
+#include "../math/vector2.h"
+#include "../math/vector3.h"
+
+namespace dviglo
+{
+
+struct Billboard;
+struct ColorFrame;
+struct TextureFrame;
+
+/// One particle in the particle system.
+struct Particle
+{
+    /// Velocity.
+    Vector3 velocity_;
+    /// Original billboard size.
+    Vector2 size_;
+    /// Time elapsed from creation.
+    float timer_;
+    /// Lifetime.
+    float timeToLive_;
+    /// Size scaling value.
+    float scale_;
+    /// Rotation speed.
+    float rotationSpeed_;
+    /// Current color animation index.
+    i32 colorIndex_;
+    /// Current texture animation index.
+    i32 texIndex_;
+};
+
+/// Particles stored as a structure of arrays, so that the update kernels process 4 particles per SSE instruction.
+struct DV_API ParticleStore
+{
+    /// Set number of particles. New particles are zeroed.
+    void Resize(i32 num);
+    /// Return particle.
+    Particle Get(i32 index) const;
+    /// Set particle.
+    void Set(i32 index, const Particle& particle);
+
+    /// Advance the timers and integrate the velocities in range [start, end): constant force first, then damping.
+    void Integrate(i32 start, i32 end, float timeStep, const Vector3& force, float damping);
+    /// Apply the size curve in range [start, end): scale = max(scale + timeStep * sizeAdd, 0) * (timeStep * (sizeMul - 1) + 1).
+    void UpdateScales(i32 start, i32 end, float timeStep, float sizeAdd, float sizeMul);
+    /// Write the enabled billboards in range [start, end): move by timeStep * velocity * scale, face the velocity,
+    /// rotate, resize if scaling and advance the color and texture animations. If box is not null, also merge the
+    /// written billboards into it the same way as BillboardSet::OnWorldBoundingBoxUpdate(), while they are in the cache.
+    void UpdateBillboards(i32 start, i32 end, Billboard* billboards, float timeStep, const Vector3& scale, bool scaling,
+        const Vector<ColorFrame>& colorFrames, const Vector<TextureFrame>& textureFrames, BoundingBox* box = nullptr,
+        const Matrix3x4& boxTransform = Matrix3x4::IDENTITY, const Vector3& boxScale = Vector3::ONE);
+
+    /// Return number of particles.
+    i32 Size() const { return timer_.Size(); }
+
+    /// Return velocity.
+    Vector3 GetVelocity(i32 index) const { return Vector3(velocityX_[index], velocityY_[index], velocityZ_[index]); }
+
+    /// Return current billboard size.
+    Vector2 GetScaledSize(i32 index) const { return Vector2(sizeX_[index], sizeY_[index]) * scale_[index]; }
+
+    /// Velocity X components.
+    Vector<float> velocityX_;
+    /// Velocity Y components.
+    Vector<float> velocityY_;
+    /// Velocity Z components.
+    Vector<float> velocityZ_;
+    /// Original billboard widths.
+    Vector<float> sizeX_;
+    /// Original billboard heights.
+    Vector<float> sizeY_;
+    /// Times elapsed from creation.
+    Vector<float> timer_;
+    /// Lifetimes.
+    Vector<float> timeToLive_;
+    /// Size scaling values.
+    Vector<float> scale_;
+    /// Rotation speeds.
+    Vector<float> rotationSpeed_;
+    /// Current color animation indices.
+    Vector<i32> colorIndex_;
+    /// Current texture animation indices.
+    Vector<i32> texIndex_;
+};
+
+}
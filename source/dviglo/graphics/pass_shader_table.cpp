@@ -0,0 +1,215 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "pass_shader_table.h"
+#include "graphics.h"
+#include "../graphics_api/shader_variation.h"
+#include "../math/math_defs.h"
+
+#include <cstring>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+static const char* geometryVSVariations[] =
+{
+    "",
+    "SKINNED ",
+    "INSTANCED ",
+    "BILLBOARD ",
+    "DIRBILLBOARD ",
+    "TRAILFACECAM ",
+    "TRAILBONE "
+};
+
+static const char* lightVSVariations[] =
+{
+    "PERPIXEL DIRLIGHT ",
+    "PERPIXEL SPOTLIGHT ",
+    "PERPIXEL POINTLIGHT ",
+    "PERPIXEL DIRLIGHT SHADOW ",
+    "PERPIXEL SPOTLIGHT SHADOW ",
+    "PERPIXEL POINTLIGHT SHADOW ",
+    "PERPIXEL DIRLIGHT SHADOW NORMALOFFSET ",
+    "PERPIXEL SPOTLIGHT SHADOW NORMALOFFSET ",
+    "PERPIXEL POINTLIGHT SHADOW NORMALOFFSET "
+};
+
+static const char* vertexLightVSVariations[] =
+{
+    "",
+    "NUMVERTEXLIGHTS=1 ",
+    "NUMVERTEXLIGHTS=2 ",
+    "NUMVERTEXLIGHTS=3 ",
+    "NUMVERTEXLIGHTS=4 ",
+};
+
+static const char* lightPSVariations[] =
+{
+    "PERPIXEL DIRLIGHT ",
+    "PERPIXEL SPOTLIGHT ",
+    "PERPIXEL POINTLIGHT ",
+    "PERPIXEL POINTLIGHT CUBEMASK ",
+    "PERPIXEL DIRLIGHT SPECULAR ",
+    "PERPIXEL SPOTLIGHT SPECULAR ",
+    "PERPIXEL POINTLIGHT SPECULAR ",
+    "PERPIXEL POINTLIGHT CUBEMASK SPECULAR ",
+    "PERPIXEL DIRLIGHT SHADOW ",
+    "PERPIXEL SPOTLIGHT SHADOW ",
+    "PERPIXEL POINTLIGHT SHADOW ",
+    "PERPIXEL POINTLIGHT CUBEMASK SHADOW ",
+    "PERPIXEL DIRLIGHT SPECULAR SHADOW ",
+    "PERPIXEL SPOTLIGHT SPECULAR SHADOW ",
+    "PERPIXEL POINTLIGHT SPECULAR SHADOW ",
+    "PERPIXEL POINTLIGHT CUBEMASK SPECULAR SHADOW ",
+    "PERPIXEL DIRLIGHT SHADOW NORMALOFFSET ",
+    "PERPIXEL SPOTLIGHT SHADOW NORMALOFFSET ",
+    "PERPIXEL POINTLIGHT SHADOW NORMALOFFSET ",
+    "PERPIXEL POINTLIGHT CUBEMASK SHADOW NORMALOFFSET ",
+    "PERPIXEL DIRLIGHT SPECULAR SHADOW NORMALOFFSET ",
+    "PERPIXEL SPOTLIGHT SPECULAR SHADOW NORMALOFFSET ",
+    "PERPIXEL POINTLIGHT SPECULAR SHADOW NORMALOFFSET ",
+    "PERPIXEL POINTLIGHT CUBEMASK SPECULAR SHADOW NORMALOFFSET "
+};
+
+static const char* heightFogVariations[] =
+{
+    "",
+    "HEIGHTFOG "
+};
+
+// The loaded masks have a bit per combination
+static_assert((i32)MAX_GEOMETRYTYPES * MAX_LIGHT_VS_VARIATIONS <= 64);
+static_assert((i32)MAX_GEOMETRYTYPES * MAX_VERTEXLIGHT_VS_VARIATIONS <= 64);
+static_assert(MAX_LIGHT_PS_VARIATIONS * 2 <= 64);
+
+/// Return defines joined into one string with a single allocation.
+static String JoinDefines(const String& first, const char* second, const char* third, const char* fourth = "")
+{
+    i32 secondLength = (i32)strlen(second);
+    i32 thirdLength = (i32)strlen(third);
+    i32 fourthLength = (i32)strlen(fourth);
+
+    String ret;
+    ret.Reserve(first.Length() + secondLength + thirdLength + fourthLength);
+    ret.Append(first);
+    ret.Append(second, secondLength);
+    ret.Append(third, thirdLength);
+    ret.Append(fourth, fourthLength);
+    return ret;
+}
+
+PassShaderTable::PassShaderTable() = default;
+
+PassShaderTable::PassShaderTable(const PassShaderTable& table) = default;
+
+PassShaderTable::~PassShaderTable() = default;
+
+PassShaderTable& PassShaderTable::operator =(const PassShaderTable& rhs) = default;
+
+void PassShaderTable::Define(PassLightingMode mode, const String& vsName, const String& psName, const String& vsDefines,
+    const String& psDefines, const String& shadowDefines)
+{
+    lightingMode_ = mode;
+    vsName_ = vsName;
+    psName_ = psName;
+    vsDefines_ = vsDefines;
+    psDefines_ = psDefines;
+    shadowDefines_ = shadowDefines;
+
+    vertexShaders_.Clear();
+    pixelShaders_.Clear();
+    vertexShaders_.Resize(GetNumVertexShaders(mode));
+    pixelShaders_.Resize(GetNumPixelShaders(mode));
+    vsLoadedMask_ = 0;
+    psLoadedMask_ = 0;
+}
+
+void PassShaderTable::Clear()
+{
+    vertexShaders_.Clear();
+    pixelShaders_.Clear();
+    vsLoadedMask_ = 0;
+    psLoadedMask_ = 0;
+}
+
+String PassShaderTable::GetVertexShaderDefines(i32 index) const
+{
+    assert(index >= 0 && index < vertexShaders_.Size());
+
+    switch (lightingMode_)
+    {
+    case LIGHTING_PERPIXEL:
+        return JoinDefines(vsDefines_, lightVSVariations[index % MAX_LIGHT_VS_VARIATIONS],
+            geometryVSVariations[index / MAX_LIGHT_VS_VARIATIONS]);
+
+    case LIGHTING_PERVERTEX:
+        return JoinDefines(vsDefines_, vertexLightVSVariations[index % MAX_VERTEXLIGHT_VS_VARIATIONS],
+            geometryVSVariations[index / MAX_VERTEXLIGHT_VS_VARIATIONS]);
+
+    default:
+        return JoinDefines(vsDefines_, geometryVSVariations[index], "");
+    }
+}
+
+String PassShaderTable::GetPixelShaderDefines(i32 index) const
+{
+    assert(index >= 0 && index < pixelShaders_.Size());
+
+    if (lightingMode_ != LIGHTING_PERPIXEL)
+        return JoinDefines(psDefines_, heightFogVariations[index], "");
+
+    i32 light = index % MAX_LIGHT_PS_VARIATIONS;
+    const char* heightFog = heightFogVariations[index / MAX_LIGHT_PS_VARIATIONS];
+    return JoinDefines(psDefines_, lightPSVariations[light], (light & LPS_SHADOW) ? shadowDefines_.c_str() : "", heightFog);
+}
+
+i32 PassShaderTable::GetNumLoadedShaders() const
+{
+    return CountSetBits((u32)vsLoadedMask_) + CountSetBits((u32)(vsLoadedMask_ >> 32)) + CountSetBits((u32)psLoadedMask_) +
+        CountSetBits((u32)(psLoadedMask_ >> 32));
+}
+
+i32 PassShaderTable::GetNumVertexShaders(PassLightingMode mode)
+{
+    switch (mode)
+    {
+    case LIGHTING_PERPIXEL:
+        return (i32)MAX_GEOMETRYTYPES * MAX_LIGHT_VS_VARIATIONS;
+
+    case LIGHTING_PERVERTEX:
+        return (i32)MAX_GEOMETRYTYPES * MAX_VERTEXLIGHT_VS_VARIATIONS;
+
+    default:
+        return MAX_GEOMETRYTYPES;
+    }
+}
+
+i32 PassShaderTable::GetNumPixelShaders(PassLightingMode mode)
+{
+    return mode == LIGHTING_PERPIXEL ? MAX_LIGHT_PS_VARIATIONS * 2 : 2;
+}
+
+const char* PassShaderTable::GetLightPSVariation(i32 index)
+{
+    assert(index >= 0 && index < (i32)(sizeof(lightPSVariations) / sizeof(lightPSVariations[0])));
+    return lightPSVariations[index];
+}
+
+void PassShaderTable::LoadVertexShader(i32 index)
+{
+    vertexShaders_[index] = DV_GRAPHICS->GetShader(VS, vsName_, GetVertexShaderDefines(index));
+    vsLoadedMask_ |= 1ull << index;
+}
+
+void PassShaderTable::LoadPixelShader(i32 index)
+{
+    pixelShaders_[index] = DV_GRAPHICS->GetShader(PS, psName_, GetPixelShaderDefines(index));
+    psLoadedMask_ |= 1ull << index;
+}
+
+}
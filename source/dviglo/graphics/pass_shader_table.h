@@ -0,0 +1,164 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+/// \file
+
+#pragma once
+
+#include "../containers/ptr.h"
+#include "../containers/str.h"
+#include "../containers/vector.h"
+#include "../graphics_api/graphics_defs.h"
+
+namespace dviglo
+{
+
+class ShaderVariation;
+
+/// Lighting mode of a pass.
+enum PassLightingMode
+{
+    LIGHTING_UNLIT = 0,
+    LIGHTING_PERVERTEX,
+    LIGHTING_PERPIXEL
+};
+
+/// Light vertex shader variations.
+enum LightVSVariation
+{
+    LVS_DIR = 0,
+    LVS_SPOT,
+    LVS_POINT,
+    LVS_SHADOW,
+    LVS_SPOTSHADOW,
+    LVS_POINTSHADOW,
+    LVS_SHADOWNORMALOFFSET,
+    LVS_SPOTSHADOWNORMALOFFSET,
+    LVS_POINTSHADOWNORMALOFFSET,
+    MAX_LIGHT_VS_VARIATIONS
+};
+
+/// Per-vertex light vertex shader variations.
+enum VertexLightVSVariation
+{
+    VLVS_NOLIGHTS = 0,
+    VLVS_1LIGHT,
+    VLVS_2LIGHTS,
+    VLVS_3LIGHTS,
+    VLVS_4LIGHTS,
+    MAX_VERTEXLIGHT_VS_VARIATIONS
+};
+
+/// Light pixel shader variations.
+enum LightPSVariation
+{
+    LPS_NONE = 0,
+    LPS_SPOT,
+    LPS_POINT,
+    LPS_POINTMASK,
+    LPS_SPEC,
+    LPS_SPOTSPEC,
+    LPS_POINTSPEC,
+    LPS_POINTMASKSPEC,
+    LPS_SHADOW,
+    LPS_SPOTSHADOW,
+    LPS_POINTSHADOW,
+    LPS_POINTMASKSHADOW,
+    LPS_SHADOWSPEC,
+    LPS_SPOTSHADOWSPEC,
+    LPS_POINTSHADOWSPEC,
+    LPS_POINTMASKSHADOWSPEC,
+    MAX_LIGHT_PS_VARIATIONS
+};
+
+/// Shader variations of a pass for every combination of geometry type, lighting and height fog. Filled on first use of each combination.
+class DV_API PassShaderTable
+{
+public:
+    /// Construct.
+    PassShaderTable();
+    /// Copy-construct.
+    PassShaderTable(const PassShaderTable& table);
+    /// Destruct.
+    ~PassShaderTable();
+    /// Assign from another table.
+    PassShaderTable& operator =(const PassShaderTable& rhs);
+
+    /// Set lighting mode, shader names and the defines shared by all combinations. Shadow defines are appended to shadowed pixel shaders. Releases the shaders.
+    void Define(PassLightingMode mode, const String& vsName, const String& psName, const String& vsDefines, const String& psDefines,
+        const String& shadowDefines);
+    /// Release the shaders and forget the definition.
+    void Clear();
+
+    /// Return vertex shader of a combination. Loaded on first use.
+    ShaderVariation* GetVertexShader(i32 index)
+    {
+        if (!(vsLoadedMask_ & (1ull << index)))
+            LoadVertexShader(index);
+        return vertexShaders_[index];
+    }
+
+    /// Return pixel shader of a combination. Loaded on first use.
+    ShaderVariation* GetPixelShader(i32 index)
+    {
+        if (!(psLoadedMask_ & (1ull << index)))
+            LoadPixelShader(index);
+        return pixelShaders_[index];
+    }
+
+    /// Return defines of a vertex shader combination.
+    String GetVertexShaderDefines(i32 index) const;
+    /// Return defines of a pixel shader combination.
+    String GetPixelShaderDefines(i32 index) const;
+
+    /// Return whether has been defined.
+    bool IsDefined() const { return !vertexShaders_.Empty(); }
+
+    /// Return lighting mode.
+    PassLightingMode GetLightingMode() const { return lightingMode_; }
+
+    /// Return number of vertex shader combinations.
+    i32 GetNumVertexShaders() const { return vertexShaders_.Size(); }
+
+    /// Return number of pixel shader combinations.
+    i32 GetNumPixelShaders() const { return pixelShaders_.Size(); }
+
+    /// Return number of vertex and pixel shader combinations that have been loaded.
+    i32 GetNumLoadedShaders() const;
+
+    /// Return number of vertex shader combinations for a lighting mode.
+    static i32 GetNumVertexShaders(PassLightingMode mode);
+    /// Return number of pixel shader combinations for a lighting mode.
+    static i32 GetNumPixelShaders(PassLightingMode mode);
+    /// Return defines of a per-pixel light pixel shader variation. Indices past MAX_LIGHT_PS_VARIATIONS are the normal offset shadow variations.
+    static const char* GetLightPSVariation(i32 index);
+
+private:
+    /// Load a vertex shader combination.
+    void LoadVertexShader(i32 index);
+    /// Load a pixel shader combination.
+    void LoadPixelShader(i32 index);
+
+    /// Lighting mode.
+    PassLightingMode lightingMode_{LIGHTING_UNLIT};
+    /// Vertex shader name.
+    String vsName_;
+    /// Pixel shader name.
+    String psName_;
+    /// Defines shared by all vertex shaders, ending with a space.
+    String vsDefines_;
+    /// Defines shared by all pixel shaders, ending with a space.
+    String psDefines_;
+    /// Defines of shadowed pixel shaders.
+    String shadowDefines_;
+    /// Vertex shader of each combination.
+    Vector<SharedPtr<ShaderVariation>> vertexShaders_;
+    /// Pixel shader of each combination.
+    Vector<SharedPtr<ShaderVariation>> pixelShaders_;
+    /// Bit per vertex shader combination that has been loaded, including failed loads.
+    u64 vsLoadedMask_{};
+    /// Bit per pixel shader combination that has been loaded, including failed loads.
+    u64 psLoadedMask_{};
+};
+
+}
@@ -0,0 +1,143 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "pose_cache.h"
+
+#include "animation.h"
+#include "model.h"
+
+#include <cstring>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+hash32 PoseCacheKey::ToHash() const
+{
+    hash32 hash = MakeHash((const void*)model_);
+
+    for (const PoseCacheState& state : states_)
+    {
+        hash32 weightBits;
+        memcpy(&weightBits, &state.weight_, sizeof weightBits);
+
+        CombineHash(hash, MakeHash((const void*)state.animation_));
+        CombineHash(hash, (hash32)state.timeIndex_);
+        CombineHash(hash, weightBits);
+        CombineHash(hash, (hash32)state.startBone_);
+        CombineHash(hash, (hash32)state.blendMode_ << 1 | (hash32)state.looped_);
+    }
+
+    for (float boneWeight : boneWeights_)
+    {
+        hash32 weightBits;
+        memcpy(&weightBits, &boneWeight, sizeof weightBits);
+        CombineHash(hash, weightBits);
+    }
+
+    return hash;
+}
+
+PoseCache::PoseCache() :
+    timeStep_(DEFAULT_POSE_CACHE_TIME_STEP),
+    maxPoses_(DEFAULT_MAX_CACHED_POSES)
+{
+}
+
+PoseCache::~PoseCache() = default;
+
+void PoseCache::SetTimeStep(float step)
+{
+    scoped_lock lock(mutex_);
+    timeStep_ = Max(step, M_EPSILON);
+    poses_.Clear();
+}
+
+void PoseCache::SetMaxPoses(i32 count)
+{
+    scoped_lock lock(mutex_);
+    maxPoses_ = Max(count, 1);
+}
+
+bool PoseCache::GetPose(const PoseCacheKey& key, Vector<BonePose>& dest)
+{
+    shared_ptr<const Vector<BonePose>> pose;
+
+    {
+        scoped_lock lock(mutex_);
+
+        HashMap<PoseCacheKey, CachedPose>::Iterator i = poses_.Find(key);
+        if (i == poses_.End())
+        {
+            ++numMisses_;
+            return false;
+        }
+
+        // An expired pointer compares as null, so a pose of a destroyed model or animation is never returned for a new
+        // one at the same address
+        bool valid = i->second_.model_.Get() == key.model_;
+        for (i32 j = 0; valid && j < key.states_.Size(); ++j)
+            valid = i->second_.animations_[j].Get() == key.states_[j].animation_;
+
+        if (!valid)
+        {
+            poses_.Erase(i);
+            ++numMisses_;
+            return false;
+        }
+
+        pose = i->second_.pose_;
+        ++numHits_;
+    }
+
+    // The cached pose is never modified, so it can be copied while other threads use the cache
+    dest = *pose;
+    return true;
+}
+
+void PoseCache::StorePose(const PoseCacheKey& key, const Vector<BonePose>& pose)
+{
+    // Copy the pose before taking the lock
+    shared_ptr<const Vector<BonePose>> cachedPose = make_shared<const Vector<BonePose>>(pose);
+
+    scoped_lock lock(mutex_);
+
+    // The map keeps the insertion order. Old time positions are rarely requested again, so removing the oldest poses
+    // first (FIFO) is close to removing the least recently used ones
+    if (!poses_.Contains(key))
+    {
+        while (poses_.Size() >= maxPoses_)
+            poses_.Erase(poses_.Begin());
+    }
+
+    CachedPose& cached = poses_[key];
+    cached.model_ = key.model_;
+    cached.animations_.Resize(key.states_.Size());
+    for (i32 i = 0; i < key.states_.Size(); ++i)
+        cached.animations_[i] = key.states_[i].animation_;
+    cached.pose_ = move(cachedPose);
+}
+
+void PoseCache::Clear()
+{
+    scoped_lock lock(mutex_);
+    poses_.Clear();
+}
+
+void PoseCache::ResetStats()
+{
+    scoped_lock lock(mutex_);
+    numHits_ = 0;
+    numMisses_ = 0;
+}
+
+i32 PoseCache::GetNumPoses() const
+{
+    scoped_lock lock(mutex_);
+    return poses_.Size();
+}
+
+}
@@ -0,0 +1,140 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/str.h"
+#include "animation_state.h"
+#include "skeleton.h"
+
+#include <memory>
+#include <mutex>
+
+namespace dviglo
+{
+
+class Animation;
+class Model;
+
+inline constexpr float DEFAULT_POSE_CACHE_TIME_STEP = 1.f / 30.f;
+inline constexpr i32 DEFAULT_MAX_CACHED_POSES = 1024;
+
+/// Animation state as it affects a cached pose.
+struct PoseCacheState
+{
+    /// Test for equality.
+    bool operator ==(const PoseCacheState& rhs) const
+    {
+        return animation_ == rhs.animation_ && timeIndex_ == rhs.timeIndex_ && weight_ == rhs.weight_ &&
+            startBone_ == rhs.startBone_ && blendMode_ == rhs.blendMode_ && looped_ == rhs.looped_;
+    }
+
+    /// Animation.
+    Animation* animation_;
+    /// Time position divided by the cache time step.
+    i32 timeIndex_;
+    /// Blending weight.
+    float weight_;
+    /// Start bone index.
+    i32 startBone_;
+    /// Blending mode.
+    AnimationBlendMode blendMode_;
+    /// Looped flag.
+    bool looped_;
+};
+
+/// Key of a cached pose: the model that defines the skeleton and the enabled animation states in blending order.
+struct PoseCacheKey
+{
+    /// Test for equality.
+    bool operator ==(const PoseCacheKey& rhs) const
+    {
+        return model_ == rhs.model_ && states_ == rhs.states_ && boneWeights_ == rhs.boneWeights_;
+    }
+
+    /// Remove the states and bone weights, keeping the allocated memory.
+    void Clear()
+    {
+        model_ = nullptr;
+        states_.Clear();
+        boneWeights_.Clear();
+    }
+
+    /// Return hash value for HashMap.
+    hash32 ToHash() const;
+
+    /// Model.
+    Model* model_{};
+    /// Enabled animation states.
+    Vector<PoseCacheState> states_;
+    /// Per-bone weights of all the states, in state order.
+    Vector<float> boneWeights_;
+};
+
+/// Cached local pose.
+struct CachedPose
+{
+    /// Model of the key. Detects a destroyed model whose address was reused.
+    WeakPtr<Model> model_;
+    /// Animations of the key states. Detect destroyed animations whose addresses were reused.
+    Vector<WeakPtr<Animation>> animations_;
+    /// Local bone transforms. Shared and immutable, so that readers copy them outside the lock.
+    std::shared_ptr<const Vector<BonePose>> pose_;
+};
+
+/// Local poses shared by animated models that play the same animations at the same quantized time positions. Each model
+/// that uses the cache samples its states at the nearest multiple of the time step, so a larger step gives more cache hits
+/// and less accurate playback. Thread-safe, as models are animated in worker threads.
+class DV_API PoseCache : public RefCounted
+{
+public:
+    /// Construct.
+    PoseCache();
+    /// Destruct.
+    ~PoseCache() override;
+
+    /// Set the time step that animation time positions are quantized to. Clears the cache.
+    void SetTimeStep(float step);
+    /// Set the maximum number of poses. When full, poses are removed in the order they were stored (FIFO).
+    /// Cache hits do not refresh a pose, as moving it in the map would copy its key under the lock.
+    void SetMaxPoses(i32 count);
+    /// Copy a cached pose. Return true if found.
+    bool GetPose(const PoseCacheKey& key, Vector<BonePose>& dest);
+    /// Store a pose.
+    void StorePose(const PoseCacheKey& key, const Vector<BonePose>& pose);
+    /// Remove all poses, for example after modifying an animation.
+    void Clear();
+    /// Reset hit and miss counts.
+    void ResetStats();
+
+    /// Return time step.
+    float GetTimeStep() const { return timeStep_; }
+    /// Return the maximum number of poses.
+    i32 GetMaxPoses() const { return maxPoses_; }
+    /// Return time index of a time position.
+    i32 GetTimeIndex(float time) const { return RoundToInt(time / timeStep_); }
+    /// Return the quantized time position of a time index.
+    float GetTime(i32 timeIndex) const { return timeStep_ * (float)timeIndex; }
+    /// Return number of cached poses.
+    i32 GetNumPoses() const;
+    /// Return number of cache hits since the stats were reset.
+    i32 GetNumHits() const { return numHits_; }
+    /// Return number of cache misses since the stats were reset.
+    i32 GetNumMisses() const { return numMisses_; }
+
+private:
+    /// Cached poses.
+    HashMap<PoseCacheKey, CachedPose> poses_;
+    /// Time step.
+    float timeStep_;
+    /// Maximum number of poses.
+    i32 maxPoses_;
+    /// Number of cache hits.
+    i32 numHits_{};
+    /// Number of cache misses.
+    i32 numMisses_{};
+    /// Mutex for the poses and stats.
+    mutable std::mutex mutex_;
+};
+
+}
@@ -0,0 +1,226 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "potentially_visible_set.h"
+
+#include "../core/context.h"
+#include "../core/profiler.h"
+#include "../core/work_queue.h"
+#include "../io/log.h"
+#include "../resource/resource_cache.h"
+#include "../scene/node.h"
+#include "../scene/scene.h"
+#include "camera.h"
+#include "drawable.h"
+#include "occlusion_buffer.h"
+#include "octree.h"
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+extern const char* SUBSYSTEM_CATEGORY;
+
+/// Camera rotations that cover all directions with 90 degree frustums.
+static const Quaternion CUBE_FACE_ROTATIONS[] =
+{
+    Quaternion::IDENTITY,
+    Quaternion(90.f, Vector3::UP),
+    Quaternion(180.f, Vector3::UP),
+    Quaternion(-90.f, Vector3::UP),
+    Quaternion(90.f, Vector3::RIGHT),
+    Quaternion(-90.f, Vector3::RIGHT)
+};
+
+/// State of a PVS bake work item.
+struct PvsBakeWork
+{
+    /// Destination grid.
+    PvsGrid* grid_;
+    /// Occluders.
+    const Vector<Drawable*>* occluders_;
+    /// Cell bounding boxes.
+    const Vector<BoundingBox>* cellBoxes_;
+    /// Occlusion buffer of this work item.
+    SharedPtr<OcclusionBuffer> buffer_;
+    /// Camera node of this work item.
+    SharedPtr<Node> cameraNode_;
+    /// Camera of this work item.
+    Camera* camera_;
+    /// Number of sample points along each axis of a cell.
+    i32 samplesPerAxis_;
+    /// First source cell.
+    i32 firstCell_;
+    /// Source cell after the last.
+    i32 endCell_;
+};
+
+/// Work function that fills the visibility rows of a range of source cells. The rows do not share matrix words, so work items do not conflict.
+static void BakePvsCellsWork(const WorkItem* item, i32 /*threadIndex*/)
+{
+    auto* work = reinterpret_cast<PvsBakeWork*>(item->aux_);
+    PvsGrid* grid = work->grid_;
+    const Vector<BoundingBox>& cellBoxes = *work->cellBoxes_;
+    OcclusionBuffer* buffer = work->buffer_;
+    Camera* camera = work->camera_;
+    i32 samples = work->samplesPerAxis_;
+
+    for (i32 cell = work->firstCell_; cell < work->endCell_; ++cell)
+    {
+        const BoundingBox& cellBox = cellBoxes[cell];
+        grid->SetVisible(cell, cell, true);
+
+        for (i32 z = 0; z < samples; ++z)
+        {
+            for (i32 y = 0; y < samples; ++y)
+            {
+                for (i32 x = 0; x < samples; ++x)
+                {
+                    Vector3 position = cellBox.min_ + cellBox.Size() * (Vector3((float)x, (float)y, (float)z) + Vector3(0.5f, 0.5f, 0.5f)) / (float)samples;
+
+                    for (const Quaternion& rotation : CUBE_FACE_ROTATIONS)
+                    {
+                        work->cameraNode_->SetTransform(position, rotation);
+                        const Frustum& frustum = camera->GetFrustum();
+
+                        buffer->SetView(camera);
+                        buffer->Clear();
+                        for (Drawable* occluder : *work->occluders_)
+                        {
+                            if (frustum.IsInsideFast(occluder->GetWorldBoundingBox()) != OUTSIDE)
+                                occluder->DrawOcclusion(buffer);
+                        }
+                        buffer->DrawTriangles();
+                        buffer->BuildDepthHierarchy();
+
+                        for (i32 target = 0; target < cellBoxes.Size(); ++target)
+                        {
+                            if (!grid->IsVisible(cell, target) && frustum.IsInsideFast(cellBoxes[target]) != OUTSIDE
+                                && buffer->IsVisible(cellBoxes[target]))
+                                grid->SetVisible(cell, target, true);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+PotentiallyVisibleSet::PotentiallyVisibleSet() = default;
+
+PotentiallyVisibleSet::~PotentiallyVisibleSet() = default;
+
+void PotentiallyVisibleSet::register_object()
+{
+    DV_CONTEXT->RegisterFactory<PotentiallyVisibleSet>(SUBSYSTEM_CATEGORY);
+
+    DV_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, true, AM_DEFAULT);
+    DV_ACCESSOR_ATTRIBUTE("Data", GetDataAttr, SetDataAttr, ResourceRef(PvsData::GetTypeStatic()), AM_DEFAULT);
+}
+
+bool PotentiallyVisibleSet::Bake(const BoundingBox& bounds, const IntVector3& numCells, i32 samplesPerAxis, i32 bufferSize)
+{
+    Octree* octree = GetScene() ? GetScene()->GetComponent<Octree>() : nullptr;
+    if (!octree)
+    {
+        DV_LOGERROR("Can not bake PVS without an octree");
+        return false;
+    }
+
+    if (!bounds.Defined() || numCells.x <= 0 || numCells.y <= 0 || numCells.z <= 0
+        || (i64)numCells.x * numCells.y * numCells.z > PVS_MAX_CELLS)
+    {
+        DV_LOGERROR("Invalid PVS cell grid");
+        return false;
+    }
+
+    if (samplesPerAxis < 1 || bufferSize < 1 || !IsPowerOfTwo((u32)bufferSize))
+    {
+        DV_LOGERROR("Invalid PVS bake parameters");
+        return false;
+    }
+
+    DV_PROFILE(BakePvs);
+
+    SharedPtr<PvsData> data(new PvsData());
+    data->Define(bounds, numCells);
+    PvsGrid& grid = data->GetGrid();
+
+    i32 totalCells = grid.GetTotalCells();
+    Vector<BoundingBox> cellBoxes(totalCells);
+    for (i32 i = 0; i < totalCells; ++i)
+        cellBoxes[i] = grid.GetCellBox(i);
+
+    // Occluders outside the grid can still hide cells from each other, but the grid is expected to enclose the level
+    Vector<Drawable*> drawables;
+    BoxOctreeQuery query(drawables, bounds, DrawableTypes::Geometry);
+    octree->GetDrawables(query);
+
+    // World bounding boxes update lazily, so update them before the worker threads read them
+    Vector<Drawable*> occluders;
+    for (Drawable* drawable : drawables)
+    {
+        if (drawable->IsOccluder())
+        {
+            drawable->GetWorldBoundingBox();
+            occluders.Push(drawable);
+        }
+    }
+
+    WorkQueue* queue = DV_WORK_QUEUE;
+    i32 numItems = Min(totalCells, queue->GetNumThreads() + 1);
+    Vector<PvsBakeWork> work(numItems);
+
+    for (i32 i = 0; i < numItems; ++i)
+    {
+        PvsBakeWork& itemWork = work[i];
+        itemWork.grid_ = &grid;
+        itemWork.occluders_ = &occluders;
+        itemWork.cellBoxes_ = &cellBoxes;
+        itemWork.buffer_ = new OcclusionBuffer();
+        itemWork.buffer_->SetSize(bufferSize, bufferSize, false);
+        itemWork.buffer_->SetMaxTriangles(M_MAX_UNSIGNED);
+        itemWork.cameraNode_ = new Node();
+        itemWork.camera_ = itemWork.cameraNode_->create_component<Camera>();
+        itemWork.camera_->SetFov(90.f);
+        itemWork.camera_->SetAspectRatio(1.f);
+        itemWork.camera_->SetFarClip(bounds.Size().Length());
+        itemWork.samplesPerAxis_ = samplesPerAxis;
+        itemWork.firstCell_ = i * totalCells / numItems;
+        itemWork.endCell_ = (i + 1) * totalCells / numItems;
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = WI_MAX_PRIORITY;
+        item->workFunction_ = BakePvsCellsWork;
+        item->aux_ = &itemWork;
+        queue->AddWorkItem(item);
+    }
+
+    queue->Complete(WI_MAX_PRIORITY);
+
+    // Point samples may miss a narrow view in one direction but catch it in the other
+    grid.MakeSymmetric();
+    SetData(data);
+
+    return true;
+}
+
+void PotentiallyVisibleSet::SetData(PvsData* data)
+{
+    data_ = data;
+}
+
+void PotentiallyVisibleSet::SetDataAttr(const ResourceRef& value)
+{
+    SetData(DV_RES_CACHE->GetResource<PvsData>(value.name_));
+}
+
+ResourceRef PotentiallyVisibleSet::GetDataAttr() const
+{
+    return GetResourceRef(data_, PvsData::GetTypeStatic());
+}
+
+}
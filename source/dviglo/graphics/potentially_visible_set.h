@@ -0,0 +1,43 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../scene/component.h"
+#include "pvs_data.h"
+
+namespace dviglo
+{
+
+/// %Component that skips drawables hidden from the camera's cell according to a baked potentially visible set. Place it in the scene root next to the octree.
+class DV_API PotentiallyVisibleSet : public Component
+{
+    DV_OBJECT(PotentiallyVisibleSet);
+
+public:
+    /// Construct.
+    explicit PotentiallyVisibleSet();
+    /// Destruct.
+    ~PotentiallyVisibleSet() override;
+    /// Register object factory.
+    static void register_object();
+
+    /// Bake visibility between the cells of a grid with the CPU occlusion rasterizer. The occluders in the octree are drawn towards six directions from samplesPerAxis^3 points in each cell. Return true if successful.
+    bool Bake(const BoundingBox& bounds, const IntVector3& numCells, i32 samplesPerAxis = 2, i32 bufferSize = 128);
+    /// Set visibility data.
+    void SetData(PvsData* data);
+
+    /// Return visibility data.
+    PvsData* GetData() const { return data_; }
+
+    /// Set visibility data attribute.
+    void SetDataAttr(const ResourceRef& value);
+    /// Return visibility data attribute.
+    ResourceRef GetDataAttr() const;
+
+private:
+    /// Visibility data.
+    SharedPtr<PvsData> data_;
+};
+
+}
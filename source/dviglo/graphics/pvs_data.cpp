@@ -0,0 +1,57 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "pvs_data.h"
+
+#include "../core/context.h"
+#include "../io/deserializer.h"
+#include "../io/log.h"
+#include "../io/serializer.h"
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+PvsData::PvsData() = default;
+
+PvsData::~PvsData() = default;
+
+void PvsData::register_object()
+{
+    DV_CONTEXT->RegisterFactory<PvsData>();
+}
+
+bool PvsData::begin_load(Deserializer& source)
+{
+    if (source.ReadFileID() != "DPVS")
+    {
+        DV_LOGERROR(source.GetName() + " is not a valid PVS file");
+        return false;
+    }
+
+    if (!grid_.Read(source))
+    {
+        DV_LOGERROR(source.GetName() + " has invalid or truncated visibility data");
+        return false;
+    }
+
+    SetMemoryUse((i32)sizeof(PvsData) + grid_.GetDataSize());
+    return true;
+}
+
+bool PvsData::Save(Serializer& dest) const
+{
+    dest.WriteFileID("DPVS");
+    return grid_.Write(dest);
+}
+
+void PvsData::Define(const BoundingBox& bounds, const IntVector3& numCells)
+{
+    grid_.Define(bounds, numCells);
+    SetMemoryUse((i32)sizeof(PvsData) + grid_.GetDataSize());
+}
+
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../resource/resource.h"
+#include "pvs_grid.h"
+
+namespace dviglo
+{
+
+/// Potentially visible set resource.
+class DV_API PvsData : public Resource
+{
+    DV_OBJECT(PvsData);
+
+public:
+    /// Construct.
+    explicit PvsData();
+    /// Destruct.
+    ~PvsData() override;
+    /// Register object factory.
+    static void register_object();
+
+    /// Load resource from stream. May be called from a worker thread. Return true if successful.
+    bool begin_load(Deserializer& source) override;
+    /// Save resource. Return true if successful.
+    bool Save(Serializer& dest) const override;
+
+    /// Define the cell grid. All cells are invisible from each other until set.
+    void Define(const BoundingBox& bounds, const IntVector3& numCells);
+
+    /// Return cell grid and visibility for modification.
+    PvsGrid& GetGrid() { return grid_; }
+
+    /// Return cell grid and visibility.
+    const PvsGrid& GetGrid() const { return grid_; }
+
+private:
+    /// Cell grid and visibility.
+    PvsGrid grid_;
+};
+
+}
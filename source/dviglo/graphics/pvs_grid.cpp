@@ -0,0 +1,141 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "pvs_grid.h"
+
+#include "../io/deserializer.h"
+#include "../io/serializer.h"
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+void PvsGrid::Define(const BoundingBox& bounds, const IntVector3& numCells)
+{
+    bounds_ = bounds;
+    numCells_ = IntVector3(Max(numCells.x, 1), Max(numCells.y, 1), Max(numCells.z, 1));
+    Vector3 size = bounds.Size();
+    invCellSize_ = Vector3(size.x > 0.f ? numCells_.x / size.x : 0.f, size.y > 0.f ? numCells_.y / size.y : 0.f,
+        size.z > 0.f ? numCells_.z / size.z : 0.f);
+
+    i32 totalCells = GetTotalCells();
+    rowSize_ = (totalCells + 63) / 64;
+    bits_.Clear();
+    bits_.Resize(totalCells * rowSize_, 0);
+}
+
+void PvsGrid::SetVisible(i32 fromCell, i32 toCell, bool enable)
+{
+    assert(fromCell >= 0 && fromCell < GetTotalCells() && toCell >= 0 && toCell < GetTotalCells());
+
+    u64& word = bits_[fromCell * rowSize_ + (toCell >> 6u)];
+    u64 mask = 1ull << (u32)(toCell & 63u);
+    if (enable)
+        word |= mask;
+    else
+        word &= ~mask;
+}
+
+void PvsGrid::MakeSymmetric()
+{
+    i32 totalCells = GetTotalCells();
+    for (i32 from = 0; from < totalCells; ++from)
+    {
+        for (i32 to = from + 1; to < totalCells; ++to)
+        {
+            if (IsVisible(from, to) || IsVisible(to, from))
+            {
+                SetVisible(from, to, true);
+                SetVisible(to, from, true);
+            }
+        }
+    }
+}
+
+bool PvsGrid::Read(Deserializer& source)
+{
+    BoundingBox bounds = source.ReadBoundingBox();
+    IntVector3 numCells = source.ReadIntVector3();
+    if (!bounds.Defined() || numCells.x <= 0 || numCells.y <= 0 || numCells.z <= 0
+        || (i64)numCells.x * numCells.y * numCells.z > PVS_MAX_CELLS)
+        return false;
+
+    Define(bounds, numCells);
+    return source.Read(bits_.Buffer(), GetDataSize()) == GetDataSize();
+}
+
+bool PvsGrid::Write(Serializer& dest) const
+{
+    dest.WriteBoundingBox(bounds_);
+    dest.WriteIntVector3(numCells_);
+    return dest.Write(bits_.Buffer(), GetDataSize()) == GetDataSize();
+}
+
+i32 PvsGrid::GetCellIndex(const Vector3& position) const
+{
+    if (bits_.Empty() || position.x < bounds_.min_.x || position.y < bounds_.min_.y || position.z < bounds_.min_.z
+        || position.x > bounds_.max_.x || position.y > bounds_.max_.y || position.z > bounds_.max_.z)
+        return NINDEX;
+
+    Vector3 cell = (position - bounds_.min_) * invCellSize_;
+    i32 x = Min((i32)cell.x, numCells_.x - 1);
+    i32 y = Min((i32)cell.y, numCells_.y - 1);
+    i32 z = Min((i32)cell.z, numCells_.z - 1);
+    return (z * numCells_.y + y) * numCells_.x + x;
+}
+
+BoundingBox PvsGrid::GetCellBox(i32 index) const
+{
+    i32 x = index % numCells_.x;
+    i32 y = index / numCells_.x % numCells_.y;
+    i32 z = index / (numCells_.x * numCells_.y);
+    Vector3 cellSize = bounds_.Size() / Vector3((float)numCells_.x, (float)numCells_.y, (float)numCells_.z);
+    Vector3 min = bounds_.min_ + cellSize * Vector3((float)x, (float)y, (float)z);
+    return BoundingBox(min, min + cellSize);
+}
+
+bool PvsGrid::IsVisible(i32 fromCell, const BoundingBox& box) const
+{
+    if (box.min_.x < bounds_.min_.x || box.min_.y < bounds_.min_.y || box.min_.z < bounds_.min_.z
+        || box.max_.x > bounds_.max_.x || box.max_.y > bounds_.max_.y || box.max_.z > bounds_.max_.z)
+        return true;
+
+    Vector3 minCell = (box.min_ - bounds_.min_) * invCellSize_;
+    Vector3 maxCell = (box.max_ - bounds_.min_) * invCellSize_;
+    i32 minX = Min((i32)minCell.x, numCells_.x - 1);
+    i32 minY = Min((i32)minCell.y, numCells_.y - 1);
+    i32 minZ = Min((i32)minCell.z, numCells_.z - 1);
+    i32 maxX = Min((i32)maxCell.x, numCells_.x - 1);
+    i32 maxY = Min((i32)maxCell.y, numCells_.y - 1);
+    i32 maxZ = Min((i32)maxCell.z, numCells_.z - 1);
+
+    const u64* row = &bits_[fromCell * rowSize_];
+    for (i32 z = minZ; z <= maxZ; ++z)
+    {
+        for (i32 y = minY; y <= maxY; ++y)
+        {
+            i32 index = (z * numCells_.y + y) * numCells_.x;
+            for (i32 x = minX; x <= maxX; ++x)
+            {
+                if ((row[(index + x) >> 6u] >> ((index + x) & 63u)) & 1u)
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+i32 PvsGrid::GetNumVisibleCells(i32 fromCell) const
+{
+    i32 count = 0;
+    const u64* row = &bits_[fromCell * rowSize_];
+    for (i32 i = 0; i < rowSize_; ++i)
+        count += CountSetBits((u32)row[i]) + CountSetBits((u32)(row[i] >> 32u));
+    return count;
+}
+
+}
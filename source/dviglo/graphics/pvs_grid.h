@@ -0,0 +1,69 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/vector.h"
+#include "../math/bounding_box.h"
+
+namespace dviglo
+{
+
+class Deserializer;
+class Serializer;
+
+/// Maximum number of PVS cells. The bit matrix of this many cells takes 32 MB.
+inline constexpr i32 PVS_MAX_CELLS = 16384;
+
+/// Grid of cells over a bounding box and a bit matrix telling which cells can be seen from which.
+class DV_API PvsGrid
+{
+public:
+    /// Define the cell grid. All cells are invisible from each other until set.
+    void Define(const BoundingBox& bounds, const IntVector3& numCells);
+    /// Set whether a cell is visible from another.
+    void SetVisible(i32 fromCell, i32 toCell, bool enable);
+    /// Make visibility symmetric: a cell that sees another is also seen by it.
+    void MakeSymmetric();
+    /// Read grid and visibility from a stream. Return true if successful.
+    bool Read(Deserializer& source);
+    /// Write grid and visibility to a stream. Return true if successful.
+    bool Write(Serializer& dest) const;
+
+    /// Return index of the cell that contains a world position, or NINDEX if outside the grid.
+    i32 GetCellIndex(const Vector3& position) const;
+    /// Return world bounding box of a cell.
+    BoundingBox GetCellBox(i32 index) const;
+    /// Return whether a cell is visible from another.
+    bool IsVisible(i32 fromCell, i32 toCell) const { return (bits_[fromCell * rowSize_ + (toCell >> 6u)] >> (toCell & 63u)) & 1u; }
+    /// Return whether a world bounding box may be visible from a cell. Boxes that extend outside the grid are always visible.
+    bool IsVisible(i32 fromCell, const BoundingBox& box) const;
+    /// Return number of cells visible from a cell, including itself if set.
+    i32 GetNumVisibleCells(i32 fromCell) const;
+
+    /// Return grid bounding box.
+    const BoundingBox& GetBounds() const { return bounds_; }
+
+    /// Return number of cells along each axis.
+    const IntVector3& GetNumCells() const { return numCells_; }
+
+    /// Return total number of cells.
+    i32 GetTotalCells() const { return numCells_.x * numCells_.y * numCells_.z; }
+
+    /// Return size of the bit matrix in bytes.
+    i32 GetDataSize() const { return bits_.Size() * (i32)sizeof(u64); }
+
+private:
+    /// Grid bounding box.
+    BoundingBox bounds_;
+    /// Number of cells along each axis.
+    IntVector3 numCells_{IntVector3::ZERO};
+    /// Reciprocal of the cell size.
+    Vector3 invCellSize_{Vector3::ZERO};
+    /// Number of 64-bit words in a row of the matrix.
+    i32 rowSize_{};
+    /// Visibility bits. Row per source cell, bit per target cell.
+    Vector<u64> bits_;
+};
+
+}
@@ -154,39 +154,6 @@ static const unsigned short spotLightIndexData[] =
     7, 6, 5
 };
 
-static const char* geometryVSVariations[] =
-{
-    "",
-    "SKINNED ",
-    "INSTANCED ",
-    "BILLBOARD ",
-    "DIRBILLBOARD ",
-    "TRAILFACECAM ",
-    "TRAILBONE "
-};
-
-static const char* lightVSVariations[] =
-{
-    "PERPIXEL DIRLIGHT ",
-    "PERPIXEL SPOTLIGHT ",
-    "PERPIXEL POINTLIGHT ",
-    "PERPIXEL DIRLIGHT SHADOW ",
-    "PERPIXEL SPOTLIGHT SHADOW ",
-    "PERPIXEL POINTLIGHT SHADOW ",
-    "PERPIXEL DIRLIGHT SHADOW NORMALOFFSET ",
-    "PERPIXEL SPOTLIGHT SHADOW NORMALOFFSET ",
-    "PERPIXEL POINTLIGHT SHADOW NORMALOFFSET "
-};
-
-static const char* vertexLightVSVariations[] =
-{
-    "",
-    "NUMVERTEXLIGHTS=1 ",
-    "NUMVERTEXLIGHTS=2 ",
-    "NUMVERTEXLIGHTS=3 ",
-    "NUMVERTEXLIGHTS=4 ",
-};
-
 static const char* deferredLightVSVariations[] =
 {
     "",
@@ -195,40 +162,6 @@ static const char* deferredLightVSVariations[] =
     "DIRLIGHT ORTHO "
 };
 
-static const char* lightPSVariations[] =
-{
-    "PERPIXEL DIRLIGHT ",
-    "PERPIXEL SPOTLIGHT ",
-    "PERPIXEL POINTLIGHT ",
-    "PERPIXEL POINTLIGHT CUBEMASK ",
-    "PERPIXEL DIRLIGHT SPECULAR ",
-    "PERPIXEL SPOTLIGHT SPECULAR ",
-    "PERPIXEL POINTLIGHT SPECULAR ",
-    "PERPIXEL POINTLIGHT CUBEMASK SPECULAR ",
-    "PERPIXEL DIRLIGHT SHADOW ",
-    "PERPIXEL SPOTLIGHT SHADOW ",
-    "PERPIXEL POINTLIGHT SHADOW ",
-    "PERPIXEL POINTLIGHT CUBEMASK SHADOW ",
-    "PERPIXEL DIRLIGHT SPECULAR SHADOW ",
-    "PERPIXEL SPOTLIGHT SPECULAR SHADOW ",
-    "PERPIXEL POINTLIGHT SPECULAR SHADOW ",
-    "PERPIXEL POINTLIGHT CUBEMASK SPECULAR SHADOW ",
-    "PERPIXEL DIRLIGHT SHADOW NORMALOFFSET ",
-    "PERPIXEL SPOTLIGHT SHADOW NORMALOFFSET ",
-    "PERPIXEL POINTLIGHT SHADOW NORMALOFFSET ",
-    "PERPIXEL POINTLIGHT CUBEMASK SHADOW NORMALOFFSET ",
-    "PERPIXEL DIRLIGHT SPECULAR SHADOW NORMALOFFSET ",
-    "PERPIXEL SPOTLIGHT SPECULAR SHADOW NORMALOFFSET ",
-    "PERPIXEL POINTLIGHT SPECULAR SHADOW NORMALOFFSET ",
-    "PERPIXEL POINTLIGHT CUBEMASK SPECULAR SHADOW NORMALOFFSET "
-};
-
-static const char* heightFogVariations[] =
-{
-    "",
-    "HEIGHTFOG "
-};
-
 static const unsigned MAX_BUFFER_AGE = 1000;
 
 static const int MAX_EXTRA_INSTANCING_BUFFER_ELEMENTS = 4;
@@ -817,6 +750,15 @@ void Renderer::QueueViewport(RenderSurface* renderTarget, Viewport* viewport)
     }
 }
 
+void Renderer::RemoveCachedBaseBatches(Drawable* drawable)
+{
+    for (const WeakPtr<View>& view : views_)
+    {
+        if (view)
+            view->RemoveCachedBaseBatches(drawable);
+    }
+}
+
 Geometry* Renderer::GetLightGeometry(Light* light)
 {
     switch (light->GetLightType())
@@ -1119,6 +1061,22 @@ RenderSurface* Renderer::GetDepthStencil(int width, int height, int multiSample,
 OcclusionBuffer* Renderer::GetOcclusionBuffer(Camera* camera)
 {
     assert(numOcclusionBuffers_ <= occlusionBuffers_.Size());
+
+    // Prefer the buffer last used with the same camera, so that its depth can be reprojected
+    for (i32 i = numOcclusionBuffers_; i < occlusionBuffers_.Size(); ++i)
+    {
+        if (occlusionBuffers_[i]->GetCamera() == camera)
+        {
+            if (i == numOcclusionBuffers_)
+                break;
+
+            SharedPtr<OcclusionBuffer> buffer = occlusionBuffers_[i];
+            occlusionBuffers_[i] = occlusionBuffers_[numOcclusionBuffers_];
+            occlusionBuffers_[numOcclusionBuffers_] = buffer;
+            break;
+        }
+    }
+
     if (numOcclusionBuffers_ == occlusionBuffers_.Size())
     {
         SharedPtr<OcclusionBuffer> newBuffer(new OcclusionBuffer());
@@ -1183,100 +1141,95 @@ void Renderer::SetBatchShaders(Batch& batch, Technique* tech, bool allowShadows,
     if (pass->GetShadersLoadedFrameNumber() != shadersChangedFrameNumber_)
         pass->ReleaseShaders();
 
-    Vector<SharedPtr<ShaderVariation>>& vertexShaders = queue.hasExtraDefines_ ? pass->GetVertexShaders(queue.vsExtraDefinesHash_) : pass->GetVertexShaders();
-    Vector<SharedPtr<ShaderVariation>>& pixelShaders = queue.hasExtraDefines_ ? pass->GetPixelShaders(queue.psExtraDefinesHash_) : pass->GetPixelShaders();
+    PassShaderTable& shaders = queue.hasExtraDefines_ ? pass->GetShaders(queue.vsExtraDefinesHash_, queue.psExtraDefinesHash_) : pass->GetShaders();
 
-    // Load shaders now if necessary
-    if (!vertexShaders.Size() || !pixelShaders.Size())
-        LoadPassShaders(pass, vertexShaders, pixelShaders, queue);
+    // Define the shader combinations now if necessary. The shaders are loaded on first use
+    if (!shaders.IsDefined())
+        DefinePassShaders(pass, shaders, queue);
 
-    // Make sure shaders are loaded now
-    if (vertexShaders.Size() && pixelShaders.Size())
-    {
-        bool heightFog = batch.zone_ && batch.zone_->GetHeightFog();
+    bool heightFog = batch.zone_ && batch.zone_->GetHeightFog();
 
-        // If instancing is not supported, but was requested, choose static geometry vertex shader instead
-        if (batch.geometryType_ == GEOM_INSTANCED && !GetDynamicInstancing())
-            batch.geometryType_ = GEOM_STATIC;
+    // If instancing is not supported, but was requested, choose static geometry vertex shader instead
+    if (batch.geometryType_ == GEOM_INSTANCED && !GetDynamicInstancing())
+        batch.geometryType_ = GEOM_STATIC;
 
-        if (batch.geometryType_ == GEOM_STATIC_NOINSTANCING)
-            batch.geometryType_ = GEOM_STATIC;
+    if (batch.geometryType_ == GEOM_STATIC_NOINSTANCING)
+        batch.geometryType_ = GEOM_STATIC;
 
-        //  Check whether is a pixel lit forward pass. If not, there is only one pixel shader
-        if (pass->GetLightingMode() == LIGHTING_PERPIXEL)
+    //  Check whether is a pixel lit forward pass. If not, there is only one pixel shader
+    if (pass->GetLightingMode() == LIGHTING_PERPIXEL)
+    {
+        LightBatchQueue* lightQueue = batch.lightQueue_;
+        if (!lightQueue)
         {
-            LightBatchQueue* lightQueue = batch.lightQueue_;
-            if (!lightQueue)
-            {
-                // Do not log error, as it would result in a lot of spam
-                batch.vertexShader_ = nullptr;
-                batch.pixelShader_ = nullptr;
-                return;
-            }
+            // Do not log error, as it would result in a lot of spam
+            batch.vertexShader_ = nullptr;
+            batch.pixelShader_ = nullptr;
+            return;
+        }
 
-            Light* light = lightQueue->light_;
-            unsigned vsi = 0;
-            unsigned psi = 0;
-            vsi = batch.geometryType_ * MAX_LIGHT_VS_VARIATIONS;
+        Light* light = lightQueue->light_;
+        unsigned vsi = 0;
+        unsigned psi = 0;
+        vsi = batch.geometryType_ * MAX_LIGHT_VS_VARIATIONS;
 
-            bool materialHasSpecular = batch.material_ ? batch.material_->GetSpecular() : true;
-            if (specularLighting_ && light->GetSpecularIntensity() > 0.0f && materialHasSpecular)
-                psi += LPS_SPEC;
-            if (allowShadows && lightQueue->shadowMap_)
-            {
-                if (light->GetShadowBias().normalOffset_ > 0.0f)
-                    vsi += LVS_SHADOWNORMALOFFSET;
-                else
-                    vsi += LVS_SHADOW;
-                psi += LPS_SHADOW;
-            }
+        bool materialHasSpecular = batch.material_ ? batch.material_->GetSpecular() : true;
+        if (specularLighting_ && light->GetSpecularIntensity() > 0.0f && materialHasSpecular)
+            psi += LPS_SPEC;
+        if (allowShadows && lightQueue->shadowMap_)
+        {
+            if (light->GetShadowBias().normalOffset_ > 0.0f)
+                vsi += LVS_SHADOWNORMALOFFSET;
+            else
+                vsi += LVS_SHADOW;
+            psi += LPS_SHADOW;
+        }
 
-            switch (light->GetLightType())
-            {
-            case LIGHT_DIRECTIONAL:
-                vsi += LVS_DIR;
-                break;
+        switch (light->GetLightType())
+        {
+        case LIGHT_DIRECTIONAL:
+            vsi += LVS_DIR;
+            break;
 
-            case LIGHT_SPOT:
-                psi += LPS_SPOT;
-                vsi += LVS_SPOT;
-                break;
+        case LIGHT_SPOT:
+            psi += LPS_SPOT;
+            vsi += LVS_SPOT;
+            break;
 
-            case LIGHT_POINT:
-                if (light->GetShapeTexture())
-                    psi += LPS_POINTMASK;
-                else
-                    psi += LPS_POINT;
-                vsi += LVS_POINT;
-                break;
-            }
+        case LIGHT_POINT:
+            if (light->GetShapeTexture())
+                psi += LPS_POINTMASK;
+            else
+                psi += LPS_POINT;
+            vsi += LVS_POINT;
+            break;
+        }
 
-            if (heightFog)
-                psi += MAX_LIGHT_PS_VARIATIONS;
+        if (heightFog)
+            psi += MAX_LIGHT_PS_VARIATIONS;
 
-            batch.vertexShader_ = vertexShaders[vsi];
-            batch.pixelShader_ = pixelShaders[psi];
+        batch.vertexShader_ = shaders.GetVertexShader(vsi);
+        batch.pixelShader_ = shaders.GetPixelShader(psi);
+    }
+    else
+    {
+        // Check if pass has vertex lighting support
+        if (pass->GetLightingMode() == LIGHTING_PERVERTEX)
+        {
+            unsigned numVertexLights = 0;
+            if (batch.lightQueue_)
+                numVertexLights = batch.lightQueue_->vertexLights_.Size();
+
+            unsigned vsi = batch.geometryType_ * MAX_VERTEXLIGHT_VS_VARIATIONS + numVertexLights;
+            batch.vertexShader_ = shaders.GetVertexShader(vsi);
         }
         else
         {
-            // Check if pass has vertex lighting support
-            if (pass->GetLightingMode() == LIGHTING_PERVERTEX)
-            {
-                unsigned numVertexLights = 0;
-                if (batch.lightQueue_)
-                    numVertexLights = batch.lightQueue_->vertexLights_.Size();
-
-                unsigned vsi = batch.geometryType_ * MAX_VERTEXLIGHT_VS_VARIATIONS + numVertexLights;
-                batch.vertexShader_ = vertexShaders[vsi];
-            }
-            else
-            {
-                unsigned vsi = batch.geometryType_;
-                batch.vertexShader_ = vertexShaders[vsi];
-            }
-
-            batch.pixelShader_ = pixelShaders[heightFog ? 1 : 0];
+            unsigned vsi = batch.geometryType_;
+            batch.vertexShader_ = shaders.GetVertexShader(vsi);
         }
+
+        batch.pixelShader_ = shaders.GetPixelShader(heightFog ? 1 : 0);
     }
 
     // Log error if shaders could not be assigned, but only once per technique
@@ -1348,17 +1301,22 @@ void Renderer::SetLightVolumeBatchShaders(Batch& batch, Camera* camera, const St
 }
 
 void Renderer::SetCullMode(CullMode mode, Camera* camera)
+{
+    DV_GRAPHICS->SetCullMode(GetEffectiveCullMode(mode, camera));
+}
+
+CullMode Renderer::GetEffectiveCullMode(CullMode mode, const Camera* camera)
 {
     // If a camera is specified, check whether it reverses culling due to vertical flipping or reflection
     if (camera && camera->GetReverseCulling())
     {
         if (mode == CULL_CW)
-            mode = CULL_CCW;
-        else if (mode == CULL_CCW)
-            mode = CULL_CW;
+            return CULL_CCW;
+        if (mode == CULL_CCW)
+            return CULL_CW;
     }
 
-    DV_GRAPHICS->SetCullMode(mode);
+    return mode;
 }
 
 bool Renderer::ResizeInstancingBuffer(i32 numInstances)
@@ -1646,7 +1604,7 @@ void Renderer::load_shaders()
 
     for (unsigned i = 0; i < MAX_DEFERRED_LIGHT_PS_VARIATIONS; ++i)
     {
-        deferredLightPSVariations_[i] = lightPSVariations[i % DLPS_ORTHO];
+        deferredLightPSVariations_[i] = PassShaderTable::GetLightPSVariation(i % DLPS_ORTHO);
         if ((i % DLPS_ORTHO) >= DLPS_SHADOW)
             deferredLightPSVariations_[i] += GetShadowVariations();
         if (i >= DLPS_ORTHO)
@@ -1656,14 +1614,10 @@ void Renderer::load_shaders()
     shadersDirty_ = false;
 }
 
-void Renderer::LoadPassShaders(Pass* pass, Vector<SharedPtr<ShaderVariation>>& vertexShaders, Vector<SharedPtr<ShaderVariation>>& pixelShaders, const BatchQueue& queue)
+void Renderer::DefinePassShaders(Pass* pass, PassShaderTable& shaders, const BatchQueue& queue)
 {
     ZoneScoped;
 
-    // Forget all the old shaders
-    vertexShaders.Clear();
-    pixelShaders.Clear();
-
     String vsDefines = pass->GetEffectiveVertexShaderDefines();
     String psDefines = pass->GetEffectivePixelShaderDefines();
 
@@ -1693,69 +1647,8 @@ void Renderer::LoadPassShaders(Pass* pass, Vector<SharedPtr<ShaderVariation>>& v
         psDefines += "VSM_SHADOW ";
     }
 
-    Graphics* graphics = DV_GRAPHICS;
-
-    if (pass->GetLightingMode() == LIGHTING_PERPIXEL)
-    {
-        // Load forward pixel lit variations
-        vertexShaders.Resize(MAX_GEOMETRYTYPES * MAX_LIGHT_VS_VARIATIONS);
-        pixelShaders.Resize(MAX_LIGHT_PS_VARIATIONS * 2);
-
-        for (unsigned j = 0; j < MAX_GEOMETRYTYPES * MAX_LIGHT_VS_VARIATIONS; ++j)
-        {
-            unsigned g = j / MAX_LIGHT_VS_VARIATIONS;
-            unsigned l = j % MAX_LIGHT_VS_VARIATIONS;
-
-            vertexShaders[j] = graphics->GetShader(VS, pass->GetVertexShader(),
-                vsDefines + lightVSVariations[l] + geometryVSVariations[g]);
-        }
-        for (unsigned j = 0; j < MAX_LIGHT_PS_VARIATIONS * 2; ++j)
-        {
-            unsigned l = j % MAX_LIGHT_PS_VARIATIONS;
-            unsigned h = j / MAX_LIGHT_PS_VARIATIONS;
-
-            if (l & LPS_SHADOW)
-            {
-                pixelShaders[j] = graphics->GetShader(PS, pass->GetPixelShader(),
-                    psDefines + lightPSVariations[l] + GetShadowVariations() +
-                    heightFogVariations[h]);
-            }
-            else
-                pixelShaders[j] = graphics->GetShader(PS, pass->GetPixelShader(),
-                    psDefines + lightPSVariations[l] + heightFogVariations[h]);
-        }
-    }
-    else
-    {
-        // Load vertex light variations
-        if (pass->GetLightingMode() == LIGHTING_PERVERTEX)
-        {
-            vertexShaders.Resize(MAX_GEOMETRYTYPES * MAX_VERTEXLIGHT_VS_VARIATIONS);
-            for (unsigned j = 0; j < MAX_GEOMETRYTYPES * MAX_VERTEXLIGHT_VS_VARIATIONS; ++j)
-            {
-                unsigned g = j / MAX_VERTEXLIGHT_VS_VARIATIONS;
-                unsigned l = j % MAX_VERTEXLIGHT_VS_VARIATIONS;
-                vertexShaders[j] = graphics->GetShader(VS, pass->GetVertexShader(),
-                    vsDefines + vertexLightVSVariations[l] + geometryVSVariations[g]);
-            }
-        }
-        else
-        {
-            vertexShaders.Resize(MAX_GEOMETRYTYPES);
-            for (unsigned j = 0; j < MAX_GEOMETRYTYPES; ++j)
-            {
-                vertexShaders[j] = graphics->GetShader(VS, pass->GetVertexShader(),
-                    vsDefines + geometryVSVariations[j]);
-            }
-        }
-
-        pixelShaders.Resize(2);
-        for (unsigned j = 0; j < 2; ++j)
-        {
-            pixelShaders[j] =
-                graphics->GetShader(PS, pass->GetPixelShader(), psDefines + heightFogVariations[j]);
-        }
-    }
+    shaders.Define(pass->GetLightingMode(), pass->GetVertexShader(), pass->GetPixelShader(), vsDefines, psDefines,
+        pass->GetLightingMode() == LIGHTING_PERPIXEL ? GetShadowVariations() : String::EMPTY);
 
     pass->MarkShadersLoaded(shadersChangedFrameNumber_);
 }
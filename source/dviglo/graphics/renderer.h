@@ -23,6 +23,7 @@ class Drawable;
 class Light;
 class Material;
 class Pass;
+class PassShaderTable;
 class Technique;
 class Octree;
 class RenderPath;
@@ -42,54 +43,6 @@ struct BatchQueue;
 static const int SHADOW_MIN_PIXELS = 64;
 static const int INSTANCING_BUFFER_DEFAULT_SIZE = 1024;
 
-/// Light vertex shader variations.
-enum LightVSVariation
-{
-    LVS_DIR = 0,
-    LVS_SPOT,
-    LVS_POINT,
-    LVS_SHADOW,
-    LVS_SPOTSHADOW,
-    LVS_POINTSHADOW,
-    LVS_SHADOWNORMALOFFSET,
-    LVS_SPOTSHADOWNORMALOFFSET,
-    LVS_POINTSHADOWNORMALOFFSET,
-    MAX_LIGHT_VS_VARIATIONS
-};
-
-/// Per-vertex light vertex shader variations.
-enum VertexLightVSVariation
-{
-    VLVS_NOLIGHTS = 0,
-    VLVS_1LIGHT,
-    VLVS_2LIGHTS,
-    VLVS_3LIGHTS,
-    VLVS_4LIGHTS,
-    MAX_VERTEXLIGHT_VS_VARIATIONS
-};
-
-/// Light pixel shader variations.
-enum LightPSVariation
-{
-    LPS_NONE = 0,
-    LPS_SPOT,
-    LPS_POINT,
-    LPS_POINTMASK,
-    LPS_SPEC,
-    LPS_SPOTSPEC,
-    LPS_POINTSPEC,
-    LPS_POINTMASKSPEC,
-    LPS_SHADOW,
-    LPS_SPOTSHADOW,
-    LPS_POINTSHADOW,
-    LPS_POINTMASKSHADOW,
-    LPS_SHADOWSPEC,
-    LPS_SPOTSHADOWSPEC,
-    LPS_POINTSHADOWSPEC,
-    LPS_POINTMASKSHADOWSPEC,
-    MAX_LIGHT_PS_VARIATIONS
-};
-
 /// Deferred light volume vertex shader variations.
 enum DeferredLightVSVariation
 {
@@ -238,6 +191,16 @@ public:
     void SetOccluderSizeThreshold(float screenSize);
     /// Set whether to thread occluder rendering. Default false.
     void SetThreadedOcclusion(bool enable);
+    /// Set whether views start occlusion from the depth of a recent frame reprojected to the current camera and draw only occluders that changed. Default false.
+    void SetTemporalOcclusion(bool enable) { temporalOcclusion_ = enable; }
+    /// Set after how many reprojected frames occlusion is drawn again from scratch. Default 4.
+    void SetTemporalOcclusionRefreshInterval(i32 frames) { temporalOcclusionRefreshInterval_ = Max(frames, 1); }
+    /// Set whether to split the view's octree traversal for geometries, lights, zones and occluders between worker threads. Default false.
+    void SetThreadedOctreeQueries(bool enable) { threadedOctreeQueries_ = enable; }
+    /// Set whether views reuse prepared base batches of drawables whose material, technique, geometry and light state did not change. Default false.
+    void SetCacheBaseBatches(bool enable) { cacheBaseBatches_ = enable; }
+    /// Set whether unfocused spot and point lights keep a shadow map of their static shadow casters and draw only the moving casters on top of it. Default false.
+    void SetCacheStaticShadowMaps(bool enable) { cacheStaticShadowMaps_ = enable; }
     /// Set shadow depth bias multiplier for mobile platforms to counteract possible worse shadow map precision. Default 1.0 (no effect).
     void SetMobileShadowBiasMul(float mul);
     /// Set shadow depth bias addition for mobile platforms to counteract possible worse shadow map precision. Default 0.0 (no effect).
@@ -328,6 +291,21 @@ public:
     /// Return whether occlusion rendering is threaded.
     bool GetThreadedOcclusion() const { return threadedOcclusion_; }
 
+    /// Return whether occlusion depth is reprojected across frames.
+    bool GetTemporalOcclusion() const { return temporalOcclusion_; }
+
+    /// Return after how many reprojected frames occlusion is drawn again from scratch.
+    i32 GetTemporalOcclusionRefreshInterval() const { return temporalOcclusionRefreshInterval_; }
+
+    /// Return whether view octree traversal is threaded.
+    bool GetThreadedOctreeQueries() const { return threadedOctreeQueries_; }
+
+    /// Return whether views reuse prepared base batches across frames.
+    bool GetCacheBaseBatches() const { return cacheBaseBatches_; }
+
+    /// Return whether lights cache the shadow maps of their static shadow casters.
+    bool GetCacheStaticShadowMaps() const { return cacheStaticShadowMaps_; }
+
     /// Return shadow depth bias multiplier for mobile platforms.
     float GetMobileShadowBiasMul() const { return mobileShadowBiasMul_; }
 
@@ -379,6 +357,9 @@ public:
     /// Return the frame update parameters.
     const FrameInfo& GetFrameInfo() const { return frame_; }
 
+    /// Return frame number on which shaders last changed.
+    i32 GetShadersChangedFrameNumber() const { return shadersChangedFrameNumber_; }
+
     /// Update for rendering. Called by HandleRenderUpdate().
     void Update(float timeStep);
     /// Render. Called by Engine.
@@ -389,6 +370,8 @@ public:
     void QueueRenderSurface(RenderSurface* renderTarget);
     /// Queue a viewport for rendering. Null surface means backbuffer.
     void QueueViewport(RenderSurface* renderTarget, Viewport* viewport);
+    /// Forget the cached base batches of a drawable in the views of the last frame. Called by Drawable when removed from the octree.
+    void RemoveCachedBaseBatches(Drawable* drawable);
 
     /// Return volume geometry for a light.
     Geometry* GetLightGeometry(Light* light);
@@ -416,6 +399,8 @@ public:
         (Batch& batch, Camera* camera, const String& vsName, const String& psName, const String& vsDefines, const String& psDefines);
     /// Set cull mode while taking possible projection flipping into account.
     void SetCullMode(CullMode mode, Camera* camera);
+    /// Return cull mode with possible projection flipping of the camera taken into account.
+    static CullMode GetEffectiveCullMode(CullMode mode, const Camera* camera);
     /// Ensure sufficient size of the instancing vertex buffer. Return true if successful.
     bool ResizeInstancingBuffer(i32 numInstances);
     /// Optimize a light by scissor rectangle.
@@ -433,8 +418,8 @@ private:
     void Initialize();
     /// Reload shaders.
     void load_shaders();
-    /// Reload shaders for a material pass. The related batch queue is provided in case it has extra shader compilation defines.
-    void LoadPassShaders(Pass* pass, Vector<SharedPtr<ShaderVariation>>& vertexShaders, Vector<SharedPtr<ShaderVariation>>& pixelShaders, const BatchQueue& queue);
+    /// Define shader combinations for a material pass. The related batch queue is provided in case it has extra shader compilation defines.
+    void DefinePassShaders(Pass* pass, PassShaderTable& shaders, const BatchQueue& queue);
     /// Release shaders used in materials.
     void ReleaseMaterialShaders();
     /// Reload textures.
@@ -560,6 +545,8 @@ private:
     int occlusionBufferSize_{256};
     /// Occluder screen size threshold.
     float occluderSizeThreshold_{0.025f};
+    /// Reprojected occlusion frames before a full redraw.
+    i32 temporalOcclusionRefreshInterval_{4};
     /// Mobile platform shadow depth bias multiplier.
     float mobileShadowBiasMul_{1.0f};
     /// Mobile platform shadow depth bias addition.
@@ -592,6 +579,14 @@ private:
     int numExtraInstancingBufferElements_{};
     /// Threaded occlusion rendering flag.
     bool threadedOcclusion_{};
+    /// Temporal occlusion reprojection flag.
+    bool temporalOcclusion_{};
+    /// Threaded view octree traversal flag.
+    bool threadedOctreeQueries_{};
+    /// Base batch caching flag.
+    bool cacheBaseBatches_{};
+    /// Static shadow map caching flag.
+    bool cacheStaticShadowMaps_{};
     /// Shaders need reloading flag.
     bool shadersDirty_{true};
     /// Initialized flag.
@@ -64,6 +64,17 @@ struct Bone
     WeakPtr<Node> node_;
 };
 
+/// Local transform of a bone in a pose buffer.
+struct BonePose
+{
+    /// Position.
+    Vector3 position_;
+    /// Rotation.
+    Quaternion rotation_;
+    /// Scale.
+    Vector3 scale_;
+};
+
 /// Hierarchical collection of bones.
 class DV_API Skeleton
 {
@@ -15,6 +15,8 @@
 
 #include "../common/debug_new.h"
 
+using namespace std;
+
 namespace dviglo
 {
 
@@ -76,6 +78,7 @@ void StaticModelGroup::apply_attributes()
     }
 
     worldTransforms_.Resize(instanceNodes_.Size());
+    instanceBoxes_.Resize(instanceNodes_.Size());
     numWorldTransforms_ = 0; // Correct amount will be found during world bounding box update
     nodesDirty_ = false;
 
@@ -178,6 +181,129 @@ void StaticModelGroup::update_batches(const FrameInfo& frame)
     }
 }
 
+bool StaticModelGroupCameraKey::operator ==(const StaticModelGroupCameraKey& rhs) const
+{
+    if (cullCamera_ != rhs.cullCamera_ || lodCamera_ != rhs.lodCamera_)
+        return false;
+
+    // The planes are derived from the vertices
+    for (i32 i = 0; i < NUM_FRUSTUM_VERTICES; ++i)
+    {
+        if (frustum_.vertices_[i] != rhs.frustum_.vertices_[i])
+            return false;
+    }
+
+    return true;
+}
+
+hash32 StaticModelGroupCameraKey::ToHash() const
+{
+    hash32 hash = MakeHash((const void*)cullCamera_);
+    CombineHash(hash, MakeHash((const void*)lodCamera_));
+    return hash;
+}
+
+const Vector<SourceBatch>& StaticModelGroup::GetCameraBatches(Camera* cullCamera, const FrameInfo& frame)
+{
+    // Getting the world bounding box ensures the transforms are updated
+    GetWorldBoundingBox();
+
+    if (!cullCamera || !frame.camera_ || !numWorldTransforms_ || batches_.Empty())
+        return batches_;
+
+    lock_guard<mutex> lock(cullingMutex_);
+
+    if (cameraBatchesFrame_ != frame.frameNumber_)
+    {
+        // Batch queues of the previous frame have been rendered. Keep its entries to reuse their memory
+        for (HashMap<StaticModelGroupCameraKey, StaticModelGroupCameraBatches>::Iterator i = cameraBatches_.Begin();
+            i != cameraBatches_.End();)
+        {
+            if (i->second_.frameNumber_ != cameraBatchesFrame_)
+                i = cameraBatches_.Erase(i);
+            else
+                ++i;
+        }
+
+        cameraBatchesFrame_ = frame.frameNumber_;
+    }
+
+    // Batch queues of other views may still point to the transforms of an entry, so views that cull differently with the
+    // same camera get entries of their own
+    StaticModelGroupCameraKey key{cullCamera, frame.camera_, cullCamera->GetFrustum()};
+    StaticModelGroupCameraBatches& entry = cameraBatches_[key];
+    if (entry.frameNumber_ == frame.frameNumber_)
+        return entry.batches_;
+
+    entry.frameNumber_ = frame.frameNumber_;
+
+    UpdateInstanceBvh();
+    visibleInstances_.Clear();
+    instanceBvh_.Cull(key.frustum_, visibleInstances_);
+    i32 numVisible = visibleInstances_.Size();
+
+    // LOD is selected per instance, from the camera the frame is rendered with also for shadow cameras
+    visibleLodDistances_.Resize(numVisible);
+    for (i32 i = 0; i < numVisible; ++i)
+    {
+        const BoundingBox& box = instanceBoxes_[visibleInstances_[i]];
+        float distance = frame.camera_->GetDistance(box.Center());
+        visibleLodDistances_[i] = frame.camera_->GetLodDistance(distance, box.Size().DotProduct(DOT_SCALE), lodBias_);
+    }
+
+    // Each batch expands to one batch per LOD level, also when no instance uses the level, so that the batch layout
+    // stays the same for all cameras and frames. Empty batches have no transforms and are skipped by the view
+    entry.batches_.Clear();
+    entry.transforms_.Resize(numVisible * batches_.Size());
+    i32 numTransforms = 0;
+    Vector<i32> levelOffsets;
+
+    for (i32 i = 0; i < batches_.Size(); ++i)
+    {
+        const Vector<shared_ptr<Geometry>>& batchGeometries = geometries_[i];
+        i32 numLevels = Max(batchGeometries.Size(), 1);
+        levelOffsets.Resize(numLevels + 1);
+        for (i32& offset : levelOffsets)
+            offset = 0;
+
+        visibleLodLevels_.Resize(numVisible);
+        for (i32 j = 0; j < numVisible; ++j)
+        {
+            // Same selection as StaticModel::CalculateLodLevels()
+            i32 level = 1;
+            for (; level < numLevels; ++level)
+            {
+                if (batchGeometries[level] && visibleLodDistances_[j] <= batchGeometries[level]->GetLodDistance())
+                    break;
+            }
+
+            visibleLodLevels_[j] = level - 1;
+            ++levelOffsets[level];
+        }
+
+        for (i32 level = 0; level < numLevels; ++level)
+            levelOffsets[level + 1] += levelOffsets[level];
+
+        for (i32 level = 0; level < numLevels; ++level)
+        {
+            SourceBatch batch = batches_[i];
+            if (numLevels > 1)
+                batch.geometry_ = batchGeometries[level].get();
+            batch.numWorldTransforms_ = levelOffsets[level + 1] - levelOffsets[level];
+            batch.worldTransform_ = batch.numWorldTransforms_ ? &entry.transforms_[numTransforms + levelOffsets[level]] :
+                &Matrix3x4::IDENTITY;
+            entry.batches_.Push(batch);
+        }
+
+        for (i32 j = 0; j < numVisible; ++j)
+            entry.transforms_[numTransforms + levelOffsets[visibleLodLevels_[j]]++] = worldTransforms_[visibleInstances_[j]];
+
+        numTransforms += numVisible;
+    }
+
+    return entry.batches_;
+}
+
 i32 StaticModelGroup::GetNumOccluderTriangles()
 {
     // Make sure instance transforms are up-to-date
@@ -297,6 +423,16 @@ Node* StaticModelGroup::GetInstanceNode(unsigned index) const
     return index < instanceNodes_.Size() ? instanceNodes_[index] : nullptr;
 }
 
+void StaticModelGroup::GetVisibleInstances(const Frustum& frustum, Vector<i32>& dest)
+{
+    // Make sure instance transforms are up-to-date
+    GetWorldBoundingBox();
+
+    lock_guard<mutex> lock(cullingMutex_);
+    UpdateInstanceBvh();
+    instanceBvh_.Cull(frustum, dest);
+}
+
 void StaticModelGroup::SetNodeIDsAttr(const VariantVector& value)
 {
     // Just remember the node IDs. They need to go through the SceneResolver, and we actually find the nodes during
@@ -358,11 +494,13 @@ void StaticModelGroup::OnWorldBoundingBoxUpdate()
             continue;
 
         const Matrix3x4& worldTransform = node->GetWorldTransform();
-        worldTransforms_[index++] = worldTransform;
-        worldBox.Merge(boundingBox_.Transformed(worldTransform));
+        worldTransforms_[index] = worldTransform;
+        instanceBoxes_[index] = boundingBox_.Transformed(worldTransform);
+        worldBox.Merge(instanceBoxes_[index++]);
     }
 
     worldBoundingBox_ = worldBox;
+    instanceBvhDirty_ = true;
 
     // Store the amount of valid instances we found instead of resizing worldTransforms_. This is because this function may be
     // called from multiple worker threads simultaneously
@@ -372,6 +510,7 @@ void StaticModelGroup::OnWorldBoundingBoxUpdate()
 void StaticModelGroup::UpdateNumTransforms()
 {
     worldTransforms_.Resize(instanceNodes_.Size());
+    instanceBoxes_.Resize(instanceNodes_.Size());
     numWorldTransforms_ = 0; // Correct amount will be during world bounding box update
     nodeIDsDirty_ = true;
 
@@ -379,6 +518,15 @@ void StaticModelGroup::UpdateNumTransforms()
     MarkNetworkUpdate();
 }
 
+void StaticModelGroup::UpdateInstanceBvh()
+{
+    if (!instanceBvhDirty_)
+        return;
+
+    instanceBvh_.Build(instanceBoxes_.Buffer(), numWorldTransforms_);
+    instanceBvhDirty_ = false;
+}
+
 void StaticModelGroup::UpdateNodeIDs() const
 {
     unsigned numInstances = instanceNodes_.Size();
@@ -4,11 +4,45 @@
 
 #pragma once
 
+#include "instance_bvh.h"
 #include "static_model.h"
+#include "../containers/hash_map.h"
+#include "../math/frustum.h"
+
+#include <mutex>
 
 namespace dviglo
 {
 
+/// Key of the batches of a StaticModelGroup culled for one camera. Views that share a camera may cull with different
+/// frustums, for example when the camera aspect ratio follows the viewport, and may select LOD levels with other cameras.
+struct StaticModelGroupCameraKey
+{
+    /// Test for equality.
+    bool operator ==(const StaticModelGroupCameraKey& rhs) const;
+
+    /// Return hash value for HashMap.
+    hash32 ToHash() const;
+
+    /// Culling camera.
+    Camera* cullCamera_;
+    /// Camera that selects the LOD levels.
+    Camera* lodCamera_;
+    /// Culling frustum.
+    Frustum frustum_;
+};
+
+/// Batches of a StaticModelGroup culled for one camera.
+struct StaticModelGroupCameraBatches
+{
+    /// Frame number of the culling.
+    i32 frameNumber_{NINDEX};
+    /// One batch per source batch and LOD level.
+    Vector<SourceBatch> batches_;
+    /// Transforms of the visible instances, grouped by batch and LOD level.
+    Vector<Matrix3x4> transforms_;
+};
+
 /// Renders several object instances while culling and receiving light as one unit. Can be used as a CPU-side optimization, but note that also regular StaticModels will use instanced rendering if possible.
 class DV_API StaticModelGroup : public StaticModel
 {
@@ -28,6 +62,8 @@ public:
     void ProcessRayQuery(const RayOctreeQuery& query, Vector<RayQueryResult>& results) override;
     /// Calculate distance and prepare batches for rendering. May be called from worker thread(s), possibly re-entrantly.
     void update_batches(const FrameInfo& frame) override;
+    /// Return batches with only the instances inside the camera frustum, each at its own LOD level. May be called from worker threads.
+    const Vector<SourceBatch>& GetCameraBatches(Camera* cullCamera, const FrameInfo& frame) override;
     /// Return number of occlusion geometry triangles.
     i32 GetNumOccluderTriangles() override;
     /// Draw to occlusion buffer. Return true if did not run out of triangles.
@@ -45,6 +81,8 @@ public:
 
     /// Return instance node by index.
     Node* GetInstanceNode(unsigned index) const;
+    /// Return indices of the valid instance transforms whose bounding boxes are inside or intersect a frustum.
+    void GetVisibleInstances(const Frustum& frustum, Vector<i32>& dest);
 
     /// Set node IDs attribute.
     void SetNodeIDsAttr(const VariantVector& value);
@@ -63,15 +101,35 @@ private:
     void UpdateNumTransforms();
     /// Update node IDs attribute from the actual nodes.
     void UpdateNodeIDs() const;
+    /// Rebuild the instance hierarchy if instances have changed. Called with the culling mutex locked.
+    void UpdateInstanceBvh();
 
     /// Instance nodes.
     Vector<WeakPtr<Node>> instanceNodes_;
     /// World transforms of valid (existing and visible) instances.
     Vector<Matrix3x4> worldTransforms_;
+    /// World bounding boxes of valid instances.
+    Vector<BoundingBox> instanceBoxes_;
+    /// Hierarchy over the instance bounding boxes for culling.
+    InstanceBvh instanceBvh_;
+    /// Culled batches per camera and frustum.
+    HashMap<StaticModelGroupCameraKey, StaticModelGroupCameraBatches> cameraBatches_;
+    /// Visible instances during culling.
+    Vector<i32> visibleInstances_;
+    /// LOD distances of the visible instances during culling.
+    Vector<float> visibleLodDistances_;
+    /// LOD levels of the visible instances during culling.
+    Vector<i32> visibleLodLevels_;
+    /// Mutex for culling, which may happen for several cameras at once.
+    std::mutex cullingMutex_;
     /// IDs of instance nodes for serialization.
     mutable VariantVector nodeIDsAttr_;
     /// Number of valid instance node transforms.
     unsigned numWorldTransforms_{};
+    /// Frame number of the culled batches.
+    i32 cameraBatchesFrame_{NINDEX};
+    /// Whether the instance hierarchy must be rebuilt.
+    bool instanceBvhDirty_{};
     /// Whether node IDs have been set and nodes should be searched for during apply_attributes.
     mutable bool nodesDirty_{};
     /// Whether nodes have been manipulated by the API and node ID attribute should be refreshed.
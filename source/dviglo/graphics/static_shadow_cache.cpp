@@ -0,0 +1,179 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "static_shadow_cache.h"
+
+#include "drawable.h"
+#include "geometry.h"
+#include "light.h"
+#include "material.h"
+#include "../graphics_api/render_surface.h"
+#include "../graphics_api/texture_2d.h"
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+static bool CompareStaticShadowCasters(const StaticShadowCaster& lhs, const StaticShadowCaster& rhs)
+{
+    if (lhs.splitIndex_ != rhs.splitIndex_)
+        return lhs.splitIndex_ < rhs.splitIndex_;
+    return lhs.drawable_.Get() < rhs.drawable_.Get();
+}
+
+/// Hash the geometries and materials of the source batches. World transform changes are detected from the drawable's
+/// transform version instead.
+static hash32 HashSourceBatches(const Drawable* drawable)
+{
+    hash32 hash = 0;
+
+    for (const SourceBatch& batch : drawable->GetBatches())
+    {
+        CombineHash(hash, MakeHash(batch.geometry_));
+        CombineHash(hash, MakeHash(batch.material_.Get()));
+        CombineHash(hash, (hash32)batch.geometryType_);
+    }
+
+    return hash;
+}
+
+StaticShadowCache::StaticShadowCache() = default;
+
+StaticShadowCache::~StaticShadowCache() = default;
+
+bool StaticShadowCache::UpdateCaster(Drawable* drawable, i32 frameNumber)
+{
+    ShadowCasterHistory& entry = history_[drawable];
+
+    // A caster seen in several splits is recorded once per frame
+    if (entry.lastFrame_ == frameNumber && entry.drawable_.Get() == drawable)
+        return entry.stableFrames_ >= STATIC_SHADOW_CASTER_FRAMES;
+
+    // Casters whose geometry is updated every frame can change without changing the bounding box
+    bool canBeStatic = drawable->GetUpdateGeometryType() == UPDATE_NONE;
+    for (const SourceBatch& batch : drawable->GetBatches())
+    {
+        if (batch.geometryType_ != GEOM_STATIC && batch.geometryType_ != GEOM_STATIC_NOINSTANCING)
+            canBeStatic = false;
+    }
+
+    // Instance transforms of a group can change without changing the combined bounding box, but any moved node bumps
+    // the transform version
+    const BoundingBox& box = drawable->GetWorldBoundingBox();
+    u32 transformVersion = drawable->GetTransformVersion();
+    hash32 batchesHash = canBeStatic ? HashSourceBatches(drawable) : 0;
+
+    if (canBeStatic && entry.drawable_.Get() == drawable && entry.lastFrame_ == frameNumber - 1 &&
+        entry.transformVersion_ == transformVersion && entry.box_ == box && entry.batchesHash_ == batchesHash)
+    {
+        ++entry.stableFrames_;
+    }
+    else
+    {
+        entry.drawable_ = drawable;
+        entry.box_ = box;
+        entry.batchesHash_ = batchesHash;
+        entry.transformVersion_ = transformVersion;
+        entry.stableFrames_ = 0;
+    }
+
+    entry.lastFrame_ = frameNumber;
+    return entry.stableFrames_ >= STATIC_SHADOW_CASTER_FRAMES;
+}
+
+void StaticShadowCache::RemoveStaleCasters(i32 frameNumber)
+{
+    for (HashMap<Drawable*, ShadowCasterHistory>::Iterator i = history_.Begin(); i != history_.End();)
+    {
+        if (i->second_.lastFrame_ != frameNumber || !i->second_.drawable_)
+            i = history_.Erase(i);
+        else
+            ++i;
+    }
+}
+
+void StaticShadowCache::BeginUpdate()
+{
+    currentCasters_.Clear();
+}
+
+void StaticShadowCache::AddCaster(Drawable* drawable, i32 splitIndex)
+{
+    HashMap<Drawable*, ShadowCasterHistory>::ConstIterator i = history_.Find(drawable);
+    if (i == history_.End())
+        return;
+
+    StaticShadowCaster caster;
+    caster.drawable_ = i->second_.drawable_;
+    caster.box_ = i->second_.box_;
+    caster.batchesHash_ = i->second_.batchesHash_;
+    caster.transformVersion_ = i->second_.transformVersion_;
+    caster.splitIndex_ = splitIndex;
+    currentCasters_.Push(caster);
+}
+
+bool StaticShadowCache::EndUpdate(Texture2D* shadowMap, const Matrix4* viewProj, const IntRect* viewports, i32 numSplits,
+    const BiasParameters& bias)
+{
+    assert(shadowMap && numSplits > 0);
+
+    sort(currentCasters_.Begin(), currentCasters_.End(), CompareStaticShadowCasters);
+
+    // Match the shadow map that the cached depth will be copied to
+    if (!shadowMap_ || shadowMap_->GetWidth() != shadowMap->GetWidth() || shadowMap_->GetHeight() != shadowMap->GetHeight() ||
+        shadowMap_->GetFormat() != shadowMap->GetFormat())
+    {
+        if (!shadowMap_)
+            shadowMap_ = new Texture2D();
+        shadowMap_->SetNumLevels(1);
+        if (!shadowMap_->SetSize(shadowMap->GetWidth(), shadowMap->GetHeight(), shadowMap->GetFormat(), TEXTURE_DEPTHSTENCIL))
+        {
+            shadowMap_.Reset();
+            valid_ = false;
+            return false;
+        }
+        valid_ = false;
+    }
+
+    // Use the same dummy color rendertarget, if any, as the shadow map
+    shadowMap_->GetRenderSurface()->SetLinkedRenderTarget(shadowMap->GetRenderSurface()->GetLinkedRenderTarget());
+
+    bool valid = valid_ && viewProj_.Size() == numSplits && bias.constantBias_ == constantBias_ &&
+        bias.slopeScaledBias_ == slopeScaledBias_ && currentCasters_.Size() == casters_.Size();
+
+    for (i32 i = 0; valid && i < numSplits; ++i)
+        valid = viewProj_[i] == viewProj[i] && viewports_[i] == viewports[i];
+
+    for (i32 i = 0; valid && i < casters_.Size(); ++i)
+    {
+        const StaticShadowCaster& cached = casters_[i];
+        const StaticShadowCaster& current = currentCasters_[i];
+        // An expired drawable compares as null, so a destroyed caster invalidates the cache
+        valid = cached.drawable_.Get() == current.drawable_.Get() && cached.splitIndex_ == current.splitIndex_ &&
+            cached.transformVersion_ == current.transformVersion_ && cached.box_ == current.box_ &&
+            cached.batchesHash_ == current.batchesHash_;
+    }
+
+    if (valid)
+        return true;
+
+    casters_.Swap(currentCasters_);
+    viewProj_.Resize(numSplits);
+    viewports_.Resize(numSplits);
+    for (i32 i = 0; i < numSplits; ++i)
+    {
+        viewProj_[i] = viewProj[i];
+        viewports_[i] = viewports[i];
+    }
+    constantBias_ = bias.constantBias_;
+    slopeScaledBias_ = bias.slopeScaledBias_;
+
+    // The caller renders the static casters now
+    valid_ = true;
+    return false;
+}
+
+}
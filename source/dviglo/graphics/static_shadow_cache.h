@@ -0,0 +1,112 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/hash_map.h"
+#include "../containers/ptr.h"
+#include "../math/bounding_box.h"
+#include "../math/matrix4.h"
+#include "../math/rect.h"
+
+namespace dviglo
+{
+
+class Drawable;
+class Texture2D;
+struct BiasParameters;
+
+/// Number of frames a shadow caster's bounding box must stay unchanged before it is treated as static.
+inline constexpr i32 STATIC_SHADOW_CASTER_FRAMES = 8;
+
+/// Shadow caster history entry used to detect static casters.
+struct ShadowCasterHistory
+{
+    /// Drawable. Detects a destroyed drawable whose address was reused.
+    WeakPtr<Drawable> drawable_;
+    /// World bounding box when last seen.
+    BoundingBox box_;
+    /// Hash of the geometries and materials of the source batches when last seen.
+    hash32 batchesHash_{};
+    /// Transform version of the drawable when last seen.
+    u32 transformVersion_{};
+    /// Number of consecutive frames the bounding box has stayed unchanged.
+    i32 stableFrames_{};
+    /// Frame number when last seen.
+    i32 lastFrame_{};
+};
+
+/// Static shadow caster rendered into the cached shadow map.
+struct StaticShadowCaster
+{
+    /// Drawable.
+    WeakPtr<Drawable> drawable_;
+    /// World bounding box.
+    BoundingBox box_;
+    /// Hash of the geometries and materials of the source batches.
+    hash32 batchesHash_{};
+    /// Transform version of the drawable.
+    u32 transformVersion_{};
+    /// Shadow split index.
+    i32 splitIndex_{};
+};
+
+/// Per-light shadow map containing only the static shadow casters. Rendered again only when the static casters, the shadow
+/// cameras or the shadow map format change; dynamic casters are drawn on top of a copy of it every frame.
+class DV_API StaticShadowCache
+{
+public:
+    /// Construct.
+    StaticShadowCache();
+    /// Destruct.
+    ~StaticShadowCache();
+
+    /// Prevent copy construction.
+    StaticShadowCache(const StaticShadowCache& rhs) = delete;
+    /// Prevent assignment.
+    StaticShadowCache& operator =(const StaticShadowCache& rhs) = delete;
+
+    /// Record a shadow caster seen on this frame. Return true if its bounding box has stayed unchanged long enough
+    /// for it to be treated as static.
+    bool UpdateCaster(Drawable* drawable, i32 frameNumber);
+    /// Forget shadow casters that were not seen on this frame.
+    void RemoveStaleCasters(i32 frameNumber);
+
+    /// Begin collecting the static casters of the current frame.
+    void BeginUpdate();
+    /// Add a static caster of a shadow split.
+    void AddCaster(Drawable* drawable, i32 splitIndex);
+    /// Finish collecting the static casters. Return true if the cached shadow map is up to date, or false if it must be
+    /// rendered again. Creates the cached shadow map to match the shadow map it will be copied to.
+    bool EndUpdate(Texture2D* shadowMap, const Matrix4* viewProj, const IntRect* viewports, i32 numSplits,
+        const BiasParameters& bias);
+    /// Discard the cached shadow map contents.
+    void Invalidate() { valid_ = false; }
+
+    /// Return the cached shadow map.
+    Texture2D* GetShadowMap() const { return shadowMap_.Get(); }
+    /// Return number of static casters in the cached shadow map.
+    i32 GetNumCasters() const { return casters_.Size(); }
+
+private:
+    /// Shadow caster history.
+    HashMap<Drawable*, ShadowCasterHistory> history_;
+    /// Static casters in the cached shadow map, sorted.
+    Vector<StaticShadowCaster> casters_;
+    /// Static casters of the current frame.
+    Vector<StaticShadowCaster> currentCasters_;
+    /// Shadow camera view-projection matrices the cached shadow map was rendered with.
+    Vector<Matrix4> viewProj_;
+    /// Shadow split viewports the cached shadow map was rendered with.
+    Vector<IntRect> viewports_;
+    /// Constant depth bias the cached shadow map was rendered with.
+    float constantBias_{};
+    /// Slope scaled depth bias the cached shadow map was rendered with.
+    float slopeScaledBias_{};
+    /// Cached shadow map.
+    SharedPtr<Texture2D> shadowMap_;
+    /// Whether the cached shadow map contents are up to date.
+    bool valid_{};
+};
+
+}
@@ -12,13 +12,20 @@
 #include "../resource/resource_cache.h"
 #include "../resource/xml_file.h"
 
+#include <atomic>
+
 #include "../common/debug_new.h"
 
+using namespace std;
+
 namespace dviglo
 {
 
 extern const char* cullModeNames[];
 
+/// Incremented whenever the passes of a technique or the techniques of a material change.
+static atomic<u32> stateVersion{0};
+
 const char* blendModeNames[] =
 {
     "replace",
@@ -94,6 +101,7 @@ void Pass::SetDepthTestMode(CompareMode mode)
 void Pass::SetLightingMode(PassLightingMode mode)
 {
     lightingMode_ = mode;
+    ReleaseShaders();
 }
 
 void Pass::SetDepthWrite(bool enable)
@@ -110,6 +118,7 @@ void Pass::SetAlphaToCoverage(bool enable)
 void Pass::SetIsDesktop(bool enable)
 {
     isDesktop_ = enable;
+    Technique::MarkStateChanged();
 }
 
 void Pass::SetVertexShader(const String& name)
@@ -150,10 +159,9 @@ void Pass::SetPixelShaderDefineExcludes(const String& excludes)
 
 void Pass::ReleaseShaders()
 {
-    vertexShaders_.Clear();
-    pixelShaders_.Clear();
-    extraVertexShaders_.Clear();
-    extraPixelShaders_.Clear();
+    shaders_.Clear();
+    extraShaders_.Clear();
+    ++shadersVersion_;
 }
 
 void Pass::MarkShadersLoaded(i32 frameNumber)
@@ -190,21 +198,13 @@ String Pass::GetEffectivePixelShaderDefines() const
     return String::Joined(psDefines, " ");
 }
 
-Vector<SharedPtr<ShaderVariation>>& Pass::GetVertexShaders(const StringHash& extraDefinesHash)
-{
-    // If empty hash, return the base shaders
-    if (!extraDefinesHash.Value())
-        return vertexShaders_;
-    else
-        return extraVertexShaders_[extraDefinesHash];
-}
-
-Vector<SharedPtr<ShaderVariation>>& Pass::GetPixelShaders(const StringHash& extraDefinesHash)
+PassShaderTable& Pass::GetShaders(const StringHash& vsExtraDefinesHash, const StringHash& psExtraDefinesHash)
 {
-    if (!extraDefinesHash.Value())
-        return pixelShaders_;
+    // If empty hashes, return the base shaders
+    if (!vsExtraDefinesHash.Value() && !psExtraDefinesHash.Value())
+        return shaders_;
     else
-        return extraPixelShaders_[extraDefinesHash];
+        return extraShaders_[MakePair(vsExtraDefinesHash, psExtraDefinesHash)];
 }
 
 i32 Technique::basePassIndex = 0;
@@ -237,6 +237,7 @@ void Technique::register_object()
 
 bool Technique::begin_load(Deserializer& source)
 {
+    MarkStateChanged();
     passes_.Clear();
     cloneTechniques_.Clear();
 
@@ -341,6 +342,7 @@ bool Technique::begin_load(Deserializer& source)
 void Technique::SetIsDesktop(bool enable)
 {
     isDesktop_ = enable;
+    MarkStateChanged();
 }
 
 void Technique::ReleaseShaders()
@@ -396,6 +398,7 @@ Pass* Technique::CreatePass(const String& name)
     if (passIndex >= passes_.Size())
         passes_.Resize(passIndex + 1);
     passes_[passIndex] = newPass;
+    MarkStateChanged();
 
     // Calculate memory use now
     SetMemoryUse((unsigned)(sizeof(Technique) + GetNumPasses() * sizeof(Pass)));
@@ -411,6 +414,7 @@ void Technique::RemovePass(const String& name)
     else if (i->second_ < passes_.Size() && passes_[i->second_].Get())
     {
         passes_[i->second_].Reset();
+        MarkStateChanged();
         SetMemoryUse((unsigned)(sizeof(Technique) + GetNumPasses() * sizeof(Pass)));
     }
 }
@@ -535,4 +539,14 @@ i32 Technique::GetPassIndex(const String& passName)
     }
 }
 
+u32 Technique::GetStateVersion()
+{
+    return stateVersion.load(memory_order_relaxed);
+}
+
+void Technique::MarkStateChanged()
+{
+    stateVersion.fetch_add(1, memory_order_relaxed);
+}
+
 }
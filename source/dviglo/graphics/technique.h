@@ -8,20 +8,11 @@
 
 #include "../graphics_api/graphics_defs.h"
 #include "../resource/resource.h"
+#include "pass_shader_table.h"
 
 namespace dviglo
 {
 
-class ShaderVariation;
-
-/// Lighting mode of a pass.
-enum PassLightingMode
-{
-    LIGHTING_UNLIT = 0,
-    LIGHTING_PERVERTEX,
-    LIGHTING_PERPIXEL
-};
-
 /// %Material rendering pass, which defines shaders and render state.
 class DV_API Pass : public RefCounted
 {
@@ -83,6 +74,9 @@ public:
     /// Return last shaders loaded frame number.
     i32 GetShadersLoadedFrameNumber() const { return shadersLoadedFrameNumber_; }
 
+    /// Return counter that changes whenever shader pointers are reset.
+    u32 GetShadersVersion() const { return shadersVersion_; }
+
     /// Return depth write mode.
     bool GetDepthWrite() const { return depthWrite_; }
 
@@ -110,16 +104,11 @@ public:
     /// Return pixel shader define excludes.
     const String& GetPixelShaderDefineExcludes() const { return pixelShaderDefineExcludes_; }
 
-    /// Return vertex shaders.
-    Vector<SharedPtr<ShaderVariation>>& GetVertexShaders() { return vertexShaders_; }
-
-    /// Return pixel shaders.
-    Vector<SharedPtr<ShaderVariation>>& GetPixelShaders() { return pixelShaders_; }
+    /// Return shader combinations.
+    PassShaderTable& GetShaders() { return shaders_; }
 
-    /// Return vertex shaders with extra defines from the renderpath.
-    Vector<SharedPtr<ShaderVariation>>& GetVertexShaders(const StringHash& extraDefinesHash);
-    /// Return pixel shaders with extra defines from the renderpath.
-    Vector<SharedPtr<ShaderVariation>>& GetPixelShaders(const StringHash& extraDefinesHash);
+    /// Return shader combinations with extra vertex and pixel shader defines from the renderpath.
+    PassShaderTable& GetShaders(const StringHash& vsExtraDefinesHash, const StringHash& psExtraDefinesHash);
     /// Return the effective vertex shader defines, accounting for excludes. Called internally by Renderer.
     String GetEffectiveVertexShaderDefines() const;
     /// Return the effective pixel shader defines, accounting for excludes. Called internally by Renderer.
@@ -138,6 +127,8 @@ private:
     PassLightingMode lightingMode_;
     /// Last shaders loaded frame number.
     i32 shadersLoadedFrameNumber_;
+    /// Incremented when shader pointers are reset.
+    u32 shadersVersion_{};
     /// Depth write mode.
     bool depthWrite_;
     /// Alpha-to-coverage mode.
@@ -156,14 +147,10 @@ private:
     String vertexShaderDefineExcludes_;
     /// Pixel shader define excludes.
     String pixelShaderDefineExcludes_;
-    /// Vertex shaders.
-    Vector<SharedPtr<ShaderVariation>> vertexShaders_;
-    /// Pixel shaders.
-    Vector<SharedPtr<ShaderVariation>> pixelShaders_;
-    /// Vertex shaders with extra defines from the renderpath.
-    HashMap<StringHash, Vector<SharedPtr<ShaderVariation>>> extraVertexShaders_;
-    /// Pixel shaders with extra defines from the renderpath.
-    HashMap<StringHash, Vector<SharedPtr<ShaderVariation>>> extraPixelShaders_;
+    /// Shader combinations.
+    PassShaderTable shaders_;
+    /// Shader combinations with extra defines from the renderpath, keyed by the vertex and pixel shader define hashes.
+    HashMap<Pair<StringHash, StringHash>, PassShaderTable> extraShaders_;
     /// Pass name.
     String name_;
 };
@@ -246,6 +233,10 @@ public:
 
     /// Return a pass type index by name. Allocate new if not used yet.
     static i32 GetPassIndex(const String& passName);
+    /// Return a counter that changes whenever the passes of any technique or the techniques of any material change.
+    static u32 GetStateVersion();
+    /// Increment the state counter. Called internally by Technique, Pass and Material.
+    static void MarkStateChanged();
 
     /// Index for base pass. Initialized once GetPassIndex() has been called for the first time.
     static i32 basePassIndex;
@@ -4,6 +4,7 @@
 
 #include "../core/context.h"
 #include "../core/profiler.h"
+#include "../core/work_queue.h"
 #include "drawable_events.h"
 #include "geometry.h"
 #include "material.h"
@@ -19,6 +20,9 @@
 #include "../scene/node.h"
 #include "../scene/scene.h"
 
+#include <cstring>
+#include <emmintrin.h>
+
 #include "../common/debug_new.h"
 
 using namespace std;
@@ -38,6 +42,10 @@ static const unsigned STITCH_NORTH = 1;
 static const unsigned STITCH_SOUTH = 2;
 static const unsigned STITCH_WEST = 4;
 static const unsigned STITCH_EAST = 8;
+/// Position, normal, texture coordinate and tangent.
+static const i32 PATCH_VERTEX_FLOATS = 12;
+/// Limits the memory used for vertex data waiting for upload.
+static const i32 MAX_PATCHES_PER_BATCH = 256;
 
 inline void GrowUpdateRegion(IntRect& updateRegion, int x, int y)
 {
@@ -59,6 +67,75 @@ inline void GrowUpdateRegion(IntRect& updateRegion, int x, int y)
     }
 }
 
+/// Patch geometry built in a worker thread and uploaded in the main thread.
+struct TerrainPatchBuildData
+{
+    /// Smoothed heights of the patch vertices.
+    Vector<float> smoothedHeights_;
+    /// Interleaved vertex data.
+    Vector<float> vertexData_;
+    /// Vertex positions for raycasts and decals.
+    shared_ptr<byte[]> cpuVertexData_;
+    /// Vertex positions for occlusion.
+    shared_ptr<byte[]> occlusionCpuVertexData_;
+    /// Local-space bounding box.
+    BoundingBox box_;
+};
+
+/// Patches of a terrain processed in worker threads. Work items process ranges of the patches.
+struct TerrainBuildWork
+{
+    /// Terrain.
+    Terrain* terrain_;
+    /// Patches.
+    TerrainPatch** patches_;
+    /// Build data, one per patch.
+    TerrainPatchBuildData* data_;
+};
+
+void SmoothTerrainPatchesWork(const WorkItem* item, i32 /*threadIndex*/)
+{
+    auto* work = reinterpret_cast<TerrainBuildWork*>(item->aux_);
+    auto** start = reinterpret_cast<TerrainPatch**>(item->start_);
+    auto** end = reinterpret_cast<TerrainPatch**>(item->end_);
+
+    for (TerrainPatch** i = start; i != end; ++i)
+        work->terrain_->SmoothPatch(*i, work->data_[i - work->patches_].smoothedHeights_);
+}
+
+void BuildTerrainPatchesWork(const WorkItem* item, i32 /*threadIndex*/)
+{
+    auto* work = reinterpret_cast<TerrainBuildWork*>(item->aux_);
+    auto** start = reinterpret_cast<TerrainPatch**>(item->start_);
+    auto** end = reinterpret_cast<TerrainPatch**>(item->end_);
+
+    for (TerrainPatch** i = start; i != end; ++i)
+    {
+        work->terrain_->BuildPatchGeometry(*i, work->data_[i - work->patches_]);
+        work->terrain_->CalculateLodErrors(*i);
+    }
+}
+
+/// Process patches in worker threads and wait for completion. The main thread takes part.
+static void ProcessPatchesThreaded(TerrainBuildWork& work, i32 count, void (*workFunction)(const WorkItem*, i32))
+{
+    WorkQueue* queue = DV_WORK_QUEUE;
+    i32 numItems = Min(count, (queue->GetNumThreads() + 1) * 2);
+
+    for (i32 i = 0; i < numItems; ++i)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = WI_MAX_PRIORITY;
+        item->workFunction_ = workFunction;
+        item->aux_ = &work;
+        item->start_ = work.patches_ + (i64)i * count / numItems;
+        item->end_ = work.patches_ + (i64)(i + 1) * count / numItems;
+        queue->AddWorkItem(item);
+    }
+
+    queue->Complete(WI_MAX_PRIORITY);
+}
+
 Terrain::Terrain() :
     indexBuffer_(make_shared<IndexBuffer>()),
     spacing_(DEFAULT_SPACING),
@@ -548,38 +625,164 @@ TerrainPatch* Terrain::GetNeighborPatch(int x, int z) const
         return GetPatch(x, z);
 }
 
-float Terrain::GetHeight(const Vector3& worldPosition) const
+float TerrainHeightField::GetHeight(const Vector3& worldPosition) const
 {
-    if (node_)
+    if (!heights_)
+        return offsetY_;
+
+    // The position is clamped to the heightmap, so that truncation equals floor and the corners stay inside
+    Vector3 position = inverseTransform_ * worldPosition;
+    float xPos = Min(Max((position.x - origin_.x) / spacing_.x, 0.0f), (float)(numVertices_.x - 1));
+    float zPos = Min(Max((position.z - origin_.y) / spacing_.z, 0.0f), (float)(numVertices_.y - 1));
+    i32 x0 = (i32)xPos;
+    i32 z0 = (i32)zPos;
+    i32 x1 = Min(x0 + 1, numVertices_.x - 1);
+    i32 z1 = Min(z0 + 1, numVertices_.y - 1);
+    float xFrac = xPos - (float)x0;
+    float zFrac = zPos - (float)z0;
+    const float* row0 = heights_ + z0 * numVertices_.x;
+    const float* row1 = heights_ + z1 * numVertices_.x;
+    float h1, h2, h3;
+
+    if (xFrac + zFrac >= 1.0f)
     {
-        Vector3 position = node_->GetWorldTransform().Inverse() * worldPosition;
-        float xPos = (position.x - patchWorldOrigin_.x) / spacing_.x;
-        float zPos = (position.z - patchWorldOrigin_.y) / spacing_.z;
-        float xFrac = Fract(xPos);
-        float zFrac = Fract(zPos);
-        float h1, h2, h3;
+        h1 = row1[x1];
+        h2 = row1[x0];
+        h3 = row0[x1];
+        xFrac = 1.0f - xFrac;
+        zFrac = 1.0f - zFrac;
+    }
+    else
+    {
+        h1 = row0[x0];
+        h2 = row0[x1];
+        h3 = row1[x0];
+    }
 
-        if (xFrac + zFrac >= 1.0f)
-        {
-            h1 = GetRawHeight((unsigned)xPos + 1, (unsigned)zPos + 1);
-            h2 = GetRawHeight((unsigned)xPos, (unsigned)zPos + 1);
-            h3 = GetRawHeight((unsigned)xPos + 1, (unsigned)zPos);
-            xFrac = 1.0f - xFrac;
-            zFrac = 1.0f - zFrac;
-        }
-        else
+    float h = h1 * (1.0f - xFrac - zFrac) + h2 * xFrac + h3 * zFrac;
+    /// \todo This assumes that the terrain scene node is upright
+    return scaleY_ * h + offsetY_;
+}
+
+void TerrainHeightField::GetHeights(const Vector3* worldPositions, float* dest, i32 count) const
+{
+    if (!heights_)
+    {
+        for (i32 i = 0; i < count; ++i)
+            dest[i] = offsetY_;
+        return;
+    }
+
+    // Same operations in the same order as GetHeight(), so that the results are equal
+    const Matrix3x4& inverse = inverseTransform_;
+    const __m128 m00 = _mm_set1_ps(inverse.m00_), m01 = _mm_set1_ps(inverse.m01_), m02 = _mm_set1_ps(inverse.m02_);
+    const __m128 m03 = _mm_set1_ps(inverse.m03_), m20 = _mm_set1_ps(inverse.m20_), m21 = _mm_set1_ps(inverse.m21_);
+    const __m128 m22 = _mm_set1_ps(inverse.m22_), m23 = _mm_set1_ps(inverse.m23_);
+    const __m128 originX = _mm_set1_ps(origin_.x);
+    const __m128 originZ = _mm_set1_ps(origin_.y);
+    const __m128 spacingX = _mm_set1_ps(spacing_.x);
+    const __m128 spacingZ = _mm_set1_ps(spacing_.z);
+    const __m128 maxX = _mm_set1_ps((float)(numVertices_.x - 1));
+    const __m128 maxZ = _mm_set1_ps((float)(numVertices_.y - 1));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scaleY = _mm_set1_ps(scaleY_);
+    const __m128 offsetY = _mm_set1_ps(offsetY_);
+    const float* heights = heights_;
+    i32 width = numVertices_.x;
+
+    for (i32 i = 0; i < count; i += 4)
+    {
+        // The last positions are repeated to fill a group of four
+        const Vector3* p[4];
+        for (i32 j = 0; j < 4; ++j)
+            p[j] = &worldPositions[Min(i + j, count - 1)];
+
+        __m128 x = _mm_set_ps(p[3]->x, p[2]->x, p[1]->x, p[0]->x);
+        __m128 y = _mm_set_ps(p[3]->y, p[2]->y, p[1]->y, p[0]->y);
+        __m128 z = _mm_set_ps(p[3]->z, p[2]->z, p[1]->z, p[0]->z);
+
+        __m128 localX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m02, z)), _mm_add_ps(_mm_mul_ps(m01, y), m03));
+        __m128 localZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m22, z)), _mm_add_ps(_mm_mul_ps(m21, y), m23));
+        __m128 xPos = _mm_min_ps(_mm_max_ps(_mm_div_ps(_mm_sub_ps(localX, originX), spacingX), zero), maxX);
+        __m128 zPos = _mm_min_ps(_mm_max_ps(_mm_div_ps(_mm_sub_ps(localZ, originZ), spacingZ), zero), maxZ);
+
+        // Positions are not negative, so truncation equals floor
+        __m128i xInt = _mm_cvttps_epi32(xPos);
+        __m128i zInt = _mm_cvttps_epi32(zPos);
+        __m128 xFrac = _mm_sub_ps(xPos, _mm_cvtepi32_ps(xInt));
+        __m128 zFrac = _mm_sub_ps(zPos, _mm_cvtepi32_ps(zInt));
+
+        // SSE2 has no gather, so the corner heights are loaded one by one
+        alignas(16) i32 xs[4], zs[4];
+        alignas(16) float h00[4], h10[4], h01[4], h11[4];
+        _mm_store_si128((__m128i*)xs, xInt);
+        _mm_store_si128((__m128i*)zs, zInt);
+        for (i32 j = 0; j < 4; ++j)
         {
-            h1 = GetRawHeight((unsigned)xPos, (unsigned)zPos);
-            h2 = GetRawHeight((unsigned)xPos + 1, (unsigned)zPos);
-            h3 = GetRawHeight((unsigned)xPos, (unsigned)zPos + 1);
+            const float* row0 = heights + zs[j] * width;
+            const float* row1 = heights + Min(zs[j] + 1, numVertices_.y - 1) * width;
+            i32 x1 = Min(xs[j] + 1, width - 1);
+            h00[j] = row0[xs[j]];
+            h10[j] = row0[x1];
+            h01[j] = row1[xs[j]];
+            h11[j] = row1[x1];
         }
 
-        float h = h1 * (1.0f - xFrac - zFrac) + h2 * xFrac + h3 * zFrac;
-        /// \todo This assumes that the terrain scene node is upright
-        return node_->GetWorldScale().y * h + node_->GetWorldPosition().y;
+        __m128 c00 = _mm_load_ps(h00), c10 = _mm_load_ps(h10), c01 = _mm_load_ps(h01), c11 = _mm_load_ps(h11);
+        __m128 upper = _mm_cmpge_ps(_mm_add_ps(xFrac, zFrac), one);
+
+        // Lower triangle: h00, h10, h01. Upper triangle: h11, h01, h10 with mirrored fractions
+        __m128 lowerHeight = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(c00, _mm_sub_ps(_mm_sub_ps(one, xFrac), zFrac)),
+            _mm_mul_ps(c10, xFrac)),
+            _mm_mul_ps(c01, zFrac));
+        __m128 xMirror = _mm_sub_ps(one, xFrac);
+        __m128 zMirror = _mm_sub_ps(one, zFrac);
+        __m128 upperHeight = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(c11, _mm_sub_ps(_mm_sub_ps(one, xMirror), zMirror)),
+            _mm_mul_ps(c01, xMirror)),
+            _mm_mul_ps(c10, zMirror));
+        __m128 height = _mm_or_ps(_mm_and_ps(upper, upperHeight), _mm_andnot_ps(upper, lowerHeight));
+        height = _mm_add_ps(_mm_mul_ps(scaleY, height), offsetY);
+
+        alignas(16) float result[4];
+        _mm_store_ps(result, height);
+        for (i32 j = 0; j < 4 && i + j < count; ++j)
+            dest[i + j] = result[j];
     }
+}
+
+float Terrain::GetHeight(const Vector3& worldPosition) const
+{
+    return node_ ? GetHeightField().GetHeight(worldPosition) : 0.0f;
+}
+
+void Terrain::GetHeights(const Vector3* worldPositions, float* dest, i32 count) const
+{
+    if (node_)
+        GetHeightField().GetHeights(worldPositions, dest, count);
     else
-        return 0.0f;
+    {
+        for (i32 i = 0; i < count; ++i)
+            dest[i] = 0.0f;
+    }
+}
+
+TerrainHeightField Terrain::GetHeightField() const
+{
+    TerrainHeightField field;
+    field.heights_ = heightData_.get();
+    field.numVertices_ = numVertices_;
+    field.origin_ = patchWorldOrigin_;
+    field.spacing_ = spacing_;
+    if (node_)
+    {
+        field.inverseTransform_ = node_->GetWorldTransform().Inverse();
+        field.scaleY_ = node_->GetWorldScale().y;
+        field.offsetY_ = node_->GetWorldPosition().y;
+    }
+    return field;
 }
 
 Vector3 Terrain::GetNormal(const Vector3& worldPosition) const
@@ -648,112 +851,126 @@ void Terrain::CreatePatchGeometry(TerrainPatch* patch)
 {
     ZoneScoped;
 
-    auto row = (unsigned)(patchSize_ + 1);
-    VertexBuffer* vertexBuffer = patch->GetVertexBuffer().get();
-    Geometry* geometry = patch->GetGeometry();
-    Geometry* maxLodGeometry = patch->GetMaxLodGeometry();
-    Geometry* occlusionGeometry = patch->GetOcclusionGeometry();
+    TerrainPatchBuildData data;
+    BuildPatchGeometry(patch, data);
+    CommitPatchGeometry(patch, data);
+}
 
-    if (vertexBuffer->GetVertexCount() != row * row)
-    {
-        vertexBuffer->SetSize(row * row, VertexElements::Position | VertexElements::Normal
-                                         | VertexElements::TexCoord1 | VertexElements::Tangent);
-    }
+void Terrain::BuildPatchGeometry(TerrainPatch* patch, TerrainPatchBuildData& dest) const
+{
+    ZoneScoped;
 
-    shared_ptr<byte[]> cpuVertexData = make_shared<byte[]>(row * row * sizeof(Vector3));
-    shared_ptr<byte[]> occlusionCpuVertexData = make_shared<byte[]>(row * row * sizeof(Vector3));
+    i32 row = patchSize_ + 1;
+    dest.vertexData_.Resize(row * row * PATCH_VERTEX_FLOATS);
+    dest.cpuVertexData_ = make_shared<byte[]>(row * row * sizeof(Vector3));
+    dest.occlusionCpuVertexData_ = make_shared<byte[]>(row * row * sizeof(Vector3));
+    dest.box_.Clear();
 
-    auto* vertexData = (float*)vertexBuffer->Lock(0, vertexBuffer->GetVertexCount());
-    auto* positionData = (float*)cpuVertexData.get();
-    auto* occlusionData = (float*)occlusionCpuVertexData.get();
-    BoundingBox box;
+    float* vertexData = dest.vertexData_.Buffer();
+    auto* positionData = (float*)dest.cpuVertexData_.get();
+    auto* occlusionData = (float*)dest.occlusionCpuVertexData_.get();
 
     i32 occlusionLevel = occlusionLodLevel_;
     if (occlusionLevel > numLodLevels_ - 1 || occlusionLevel == NINDEX)
         occlusionLevel = numLodLevels_ - 1;
 
-    if (vertexData)
-    {
-        const IntVector2& coords = patch->GetCoordinates();
-        unsigned lodExpand = (1u << (occlusionLevel)) - 1;
-        unsigned halfLodExpand = (1u << (occlusionLevel)) / 2;
+    const IntVector2& coords = patch->GetCoordinates();
+    unsigned lodExpand = (1u << (occlusionLevel)) - 1;
+    unsigned halfLodExpand = (1u << (occlusionLevel)) / 2;
 
-        for (i32 z = 0; z <= patchSize_; ++z)
+    for (i32 z = 0; z <= patchSize_; ++z)
+    {
+        for (i32 x = 0; x <= patchSize_; ++x)
         {
-            for (i32 x = 0; x <= patchSize_; ++x)
+            int xPos = coords.x * patchSize_ + x;
+            int zPos = coords.y * patchSize_ + z;
+
+            // Position
+            Vector3 position((float)x * spacing_.x, GetRawHeight(xPos, zPos), (float)z * spacing_.z);
+            *vertexData++ = position.x;
+            *vertexData++ = position.y;
+            *vertexData++ = position.z;
+            *positionData++ = position.x;
+            *positionData++ = position.y;
+            *positionData++ = position.z;
+
+            dest.box_.Merge(position);
+
+            // For vertices that are part of the occlusion LOD, calculate the minimum height in the neighborhood
+            // to prevent false positive occlusion due to inaccuracy between occlusion LOD & visible LOD
+            float minHeight = position.y;
+            if (halfLodExpand > 0 && (x & lodExpand) == 0 && (z & lodExpand) == 0)
             {
-                int xPos = coords.x * patchSize_ + x;
-                int zPos = coords.y * patchSize_ + z;
-
-                // Position
-                Vector3 position((float)x * spacing_.x, GetRawHeight(xPos, zPos), (float)z * spacing_.z);
-                *vertexData++ = position.x;
-                *vertexData++ = position.y;
-                *vertexData++ = position.z;
-                *positionData++ = position.x;
-                *positionData++ = position.y;
-                *positionData++ = position.z;
-
-                box.Merge(position);
-
-                // For vertices that are part of the occlusion LOD, calculate the minimum height in the neighborhood
-                // to prevent false positive occlusion due to inaccuracy between occlusion LOD & visible LOD
-                float minHeight = position.y;
-                if (halfLodExpand > 0 && (x & lodExpand) == 0 && (z & lodExpand) == 0)
+                int minX = Max(xPos - halfLodExpand, 0);
+                int maxX = Min(xPos + halfLodExpand, numVertices_.x - 1);
+                int minZ = Max(zPos - halfLodExpand, 0);
+                int maxZ = Min(zPos + halfLodExpand, numVertices_.y - 1);
+                for (int nZ = minZ; nZ <= maxZ; ++nZ)
                 {
-                    int minX = Max(xPos - halfLodExpand, 0);
-                    int maxX = Min(xPos + halfLodExpand, numVertices_.x - 1);
-                    int minZ = Max(zPos - halfLodExpand, 0);
-                    int maxZ = Min(zPos + halfLodExpand, numVertices_.y - 1);
-                    for (int nZ = minZ; nZ <= maxZ; ++nZ)
-                    {
-                        for (int nX = minX; nX <= maxX; ++nX)
-                            minHeight = Min(minHeight, GetRawHeight(nX, nZ));
-                    }
+                    for (int nX = minX; nX <= maxX; ++nX)
+                        minHeight = Min(minHeight, GetRawHeight(nX, nZ));
                 }
-                *occlusionData++ = position.x;
-                *occlusionData++ = minHeight;
-                *occlusionData++ = position.z;
-
-                // Normal
-                Vector3 normal = GetRawNormal(xPos, zPos);
-                *vertexData++ = normal.x;
-                *vertexData++ = normal.y;
-                *vertexData++ = normal.z;
-
-                // Texture coordinate
-                Vector2 texCoord((float)xPos / (float)(numVertices_.x - 1), 1.0f - (float)zPos / (float)(numVertices_.y - 1));
-                *vertexData++ = texCoord.x;
-                *vertexData++ = texCoord.y;
-
-                // Tangent
-                Vector3 xyz = (Vector3::RIGHT - normal * normal.DotProduct(Vector3::RIGHT)).normalized();
-                *vertexData++ = xyz.x;
-                *vertexData++ = xyz.y;
-                *vertexData++ = xyz.z;
-                *vertexData++ = 1.0f;
             }
+            *occlusionData++ = position.x;
+            *occlusionData++ = minHeight;
+            *occlusionData++ = position.z;
+
+            // Normal
+            Vector3 normal = GetRawNormal(xPos, zPos);
+            *vertexData++ = normal.x;
+            *vertexData++ = normal.y;
+            *vertexData++ = normal.z;
+
+            // Texture coordinate
+            Vector2 texCoord((float)xPos / (float)(numVertices_.x - 1), 1.0f - (float)zPos / (float)(numVertices_.y - 1));
+            *vertexData++ = texCoord.x;
+            *vertexData++ = texCoord.y;
+
+            // Tangent
+            Vector3 xyz = (Vector3::RIGHT - normal * normal.DotProduct(Vector3::RIGHT)).normalized();
+            *vertexData++ = xyz.x;
+            *vertexData++ = xyz.y;
+            *vertexData++ = xyz.z;
+            *vertexData++ = 1.0f;
         }
+    }
+}
+
+void Terrain::CommitPatchGeometry(TerrainPatch* patch, TerrainPatchBuildData& data)
+{
+    i32 row = patchSize_ + 1;
+    VertexBuffer* vertexBuffer = patch->GetVertexBuffer().get();
+    Geometry* geometry = patch->GetGeometry();
+    Geometry* maxLodGeometry = patch->GetMaxLodGeometry();
+    Geometry* occlusionGeometry = patch->GetOcclusionGeometry();
 
-        vertexBuffer->Unlock();
-        vertexBuffer->ClearDataLost();
+    if (vertexBuffer->GetVertexCount() != row * row)
+    {
+        vertexBuffer->SetSize(row * row, VertexElements::Position | VertexElements::Normal
+                                         | VertexElements::TexCoord1 | VertexElements::Tangent);
     }
 
-    patch->SetBoundingBox(box);
+    vertexBuffer->SetData(data.vertexData_.Buffer());
+    vertexBuffer->ClearDataLost();
+
+    patch->SetBoundingBox(data.box_);
 
     if (drawRanges_.Size())
     {
+        i32 occlusionLevel = occlusionLodLevel_;
+        if (occlusionLevel > numLodLevels_ - 1 || occlusionLevel == NINDEX)
+            occlusionLevel = numLodLevels_ - 1;
         unsigned occlusionDrawRange = occlusionLevel << 4u;
 
         geometry->SetIndexBuffer(indexBuffer_);
         geometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
-        geometry->SetRawVertexData(cpuVertexData, VertexElements::Position);
+        geometry->SetRawVertexData(data.cpuVertexData_, VertexElements::Position);
         maxLodGeometry->SetIndexBuffer(indexBuffer_);
         maxLodGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
-        maxLodGeometry->SetRawVertexData(cpuVertexData, VertexElements::Position);
+        maxLodGeometry->SetRawVertexData(data.cpuVertexData_, VertexElements::Position);
         occlusionGeometry->SetIndexBuffer(indexBuffer_);
         occlusionGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[occlusionDrawRange].first_, drawRanges_[occlusionDrawRange].second_, false);
-        occlusionGeometry->SetRawVertexData(occlusionCpuVertexData, VertexElements::Position);
+        occlusionGeometry->SetRawVertexData(data.occlusionCpuVertexData_, VertexElements::Position);
     }
 
     patch->ResetLod();
@@ -1073,51 +1290,19 @@ void Terrain::CreateGeometry()
         if (updateAll)
             CreateIndexData();
 
-        // Create vertex data for patches. First update smoothing to ensure normals are calculated correctly across patch borders
-        if (smoothing_)
-        {
-            DV_PROFILE(UpdateSmoothing);
-
-            for (i32 i = 0; i < patches_.Size(); ++i)
-            {
-                if (dirtyPatches[i])
-                {
-                    TerrainPatch* patch = patches_[i];
-                    const IntVector2& coords = patch->GetCoordinates();
-                    int startX = coords.x * patchSize_;
-                    int endX = startX + patchSize_;
-                    int startZ = coords.y * patchSize_;
-                    int endZ = startZ + patchSize_;
-
-                    for (int z = startZ; z <= endZ; ++z)
-                    {
-                        for (int x = startX; x <= endX; ++x)
-                        {
-                            float smoothedHeight = (
-                                GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
-                                GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
-                                GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
-                            ) / 16.0f;
-
-                            heightData_[z * numVertices_.x + x] = smoothedHeight;
-                        }
-                    }
-                }
-            }
-        }
-
+        // Create vertex data for patches. Smoothing of all patches is finished first to ensure normals are calculated
+        // correctly across patch borders
+        Vector<TerrainPatch*> dirty;
         for (i32 i = 0; i < patches_.Size(); ++i)
         {
-            TerrainPatch* patch = patches_[i];
-
             if (dirtyPatches[i])
-            {
-                CreatePatchGeometry(patch);
-                CalculateLodErrors(patch);
-            }
+                dirty.Push(patches_[i]);
+        }
+
+        CreatePatchesThreaded(dirty);
 
+        for (const WeakPtr<TerrainPatch>& patch : patches_)
             SetPatchNeighbors(patch);
-        }
     }
 
     // Send event only if new geometry was generated, or the old was cleared
@@ -1291,6 +1476,79 @@ void Terrain::CreateIndexData()
     indexBuffer_->SetData(&indices[0]);
 }
 
+void Terrain::CreatePatchesThreaded(const Vector<TerrainPatch*>& patches)
+{
+    DV_PROFILE(CreatePatchesThreaded);
+
+    Vector<TerrainPatchBuildData> data;
+
+    // Smoothed heights are copied to the height data only after the work items are done, because neighbor patches
+    // share the edge vertices
+    if (smoothing_)
+    {
+        DV_PROFILE(UpdateSmoothing);
+
+        for (i32 batchStart = 0; batchStart < patches.Size(); batchStart += MAX_PATCHES_PER_BATCH)
+        {
+            i32 count = Min(patches.Size() - batchStart, MAX_PATCHES_PER_BATCH);
+            data.Clear();
+            data.Resize(count);
+
+            TerrainBuildWork work{this, patches.Buffer() + batchStart, data.Buffer()};
+            ProcessPatchesThreaded(work, count, SmoothTerrainPatchesWork);
+
+            i32 row = patchSize_ + 1;
+            for (i32 i = 0; i < count; ++i)
+            {
+                const IntVector2& coords = patches[batchStart + i]->GetCoordinates();
+                for (i32 z = 0; z < row; ++z)
+                {
+                    memcpy(&heightData_[(coords.y * patchSize_ + z) * numVertices_.x + coords.x * patchSize_],
+                        &data[i].smoothedHeights_[z * row], row * sizeof(float));
+                }
+            }
+        }
+    }
+
+    for (i32 batchStart = 0; batchStart < patches.Size(); batchStart += MAX_PATCHES_PER_BATCH)
+    {
+        i32 count = Min(patches.Size() - batchStart, MAX_PATCHES_PER_BATCH);
+        data.Clear();
+        data.Resize(count);
+
+        TerrainBuildWork work{this, patches.Buffer() + batchStart, data.Buffer()};
+        ProcessPatchesThreaded(work, count, BuildTerrainPatchesWork);
+
+        // Uploading to the GPU must happen in the main thread
+        for (i32 i = 0; i < count; ++i)
+            CommitPatchGeometry(patches[batchStart + i], data[i]);
+    }
+}
+
+void Terrain::SmoothPatch(TerrainPatch* patch, Vector<float>& dest) const
+{
+    const IntVector2& coords = patch->GetCoordinates();
+    int startX = coords.x * patchSize_;
+    int endX = startX + patchSize_;
+    int startZ = coords.y * patchSize_;
+    int endZ = startZ + patchSize_;
+
+    dest.Resize((patchSize_ + 1) * (patchSize_ + 1));
+    float* smoothedData = dest.Buffer();
+
+    for (int z = startZ; z <= endZ; ++z)
+    {
+        for (int x = startX; x <= endX; ++x)
+        {
+            *smoothedData++ = (
+                GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
+                GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
+                GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
+            ) / 16.0f;
+        }
+    }
+}
+
 float Terrain::GetRawHeight(int x, int z) const
 {
     if (!heightData_)
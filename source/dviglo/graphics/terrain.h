@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "../math/matrix3x4.h"
 #include "../scene/component.h"
 
 namespace dviglo
@@ -14,12 +15,41 @@ class IndexBuffer;
 class Material;
 class Node;
 class TerrainPatch;
+struct TerrainPatchBuildData;
+struct WorkItem;
+
+/// Height data of a terrain with its placement in the world, for height queries.
+struct DV_API TerrainHeightField
+{
+    /// Return interpolated height at world coordinates. Positions outside the terrain use the heights of the edges.
+    float GetHeight(const Vector3& worldPosition) const;
+    /// Return heights at world coordinates in a batch. Four positions are interpolated at a time with SSE2, with the same result as GetHeight().
+    void GetHeights(const Vector3* worldPositions, float* dest, i32 count) const;
+
+    /// Heights, row by row from the south. Null if the terrain has no heightmap.
+    const float* heights_{};
+    /// Number of vertices.
+    IntVector2 numVertices_{IntVector2::ZERO};
+    /// Local-space position of the first vertex on the XZ plane.
+    Vector2 origin_{Vector2::ZERO};
+    /// Vertex spacing.
+    Vector3 spacing_{Vector3::ONE};
+    /// Transform from world space to the terrain's space.
+    Matrix3x4 inverseTransform_{Matrix3x4::IDENTITY};
+    /// World scale of the heights.
+    float scaleY_{1.0f};
+    /// World height of the terrain's origin.
+    float offsetY_{};
+};
 
 /// Heightmap terrain component.
 class DV_API Terrain : public Component
 {
     DV_OBJECT(Terrain);
 
+    friend void SmoothTerrainPatchesWork(const WorkItem* item, i32 threadIndex);
+    friend void BuildTerrainPatchesWork(const WorkItem* item, i32 threadIndex);
+
 public:
     /// Construct.
     explicit Terrain();
@@ -113,8 +143,12 @@ public:
     TerrainPatch* GetPatch(int x, int z) const;
     /// Return patch by patch coordinates including neighbor terrains.
     TerrainPatch* GetNeighborPatch(int x, int z) const;
-    /// Return height at world coordinates.
+    /// Return height at world coordinates. Positions outside the terrain use the heights of the edges.
     float GetHeight(const Vector3& worldPosition) const;
+    /// Return heights at world coordinates in a batch. Four positions are interpolated at a time with SSE. Positions outside the terrain use the heights of the edges.
+    void GetHeights(const Vector3* worldPositions, float* dest, i32 count) const;
+    /// Return the height data with the current world transform. Valid until the heightmap or the terrain changes.
+    TerrainHeightField GetHeightField() const;
     /// Return normal at world coordinates.
     Vector3 GetNormal(const Vector3& worldPosition) const;
     /// Convert world position to heightmap pixel position. Note that the internal height data representation is reversed vertically, but in the heightmap image north is at the top.
@@ -197,6 +231,14 @@ private:
     void CreateGeometry();
     /// Create index data shared by all patches.
     void CreateIndexData();
+    /// Smooth and build the geometry of patches in worker threads, then upload the geometry.
+    void CreatePatchesThreaded(const Vector<TerrainPatch*>& patches);
+    /// Calculate smoothed heights of patch vertices. May be called from a worker thread.
+    void SmoothPatch(TerrainPatch* patch, Vector<float>& dest) const;
+    /// Build patch vertex data. May be called from a worker thread.
+    void BuildPatchGeometry(TerrainPatch* patch, TerrainPatchBuildData& dest) const;
+    /// Upload built patch vertex data and set up the patch geometries.
+    void CommitPatchGeometry(TerrainPatch* patch, TerrainPatchBuildData& data);
     /// Return an uninterpolated terrain height value, clamping to edges.
     float GetRawHeight(int x, int z) const;
     /// Return a source terrain height value, clamping to edges. The source data is used for smoothing.
@@ -205,7 +247,7 @@ private:
     float GetLodHeight(int x, int z, unsigned lodLevel) const;
     /// Get slope-based terrain normal at position.
     Vector3 GetRawNormal(int x, int z) const;
-    /// Calculate LOD errors for a patch.
+    /// Calculate LOD errors for a patch. May be called from a worker thread.
     void CalculateLodErrors(TerrainPatch* patch);
     /// Set neighbors for a patch.
     void SetPatchNeighbors(TerrainPatch* patch);
@@ -122,13 +122,9 @@ void TerrainPatch::update_batches(const FrameInfo& frame)
 
 void TerrainPatch::UpdateGeometry(const FrameInfo& frame)
 {
-    if (vertexBuffer_->IsDataLost())
-    {
-        if (owner_)
-            owner_->CreatePatchGeometry(this);
-        else
-            vertexBuffer_->ClearDataLost();
-    }
+    // Patches without an owner terrain belong to a CdlodTerrain, which checks the data lost flag and rebuilds them
+    if (vertexBuffer_->IsDataLost() && owner_)
+        owner_->CreatePatchGeometry(this);
 
     if (owner_)
         owner_->UpdatePatchLod(this);
@@ -13,9 +13,11 @@
 #include "material.h"
 #include "occlusion_buffer.h"
 #include "octree.h"
+#include "potentially_visible_set.h"
 #include "renderer.h"
 #include "render_path.h"
 #include "skybox.h"
+#include "static_shadow_cache.h"
 #include "technique.h"
 #include "view.h"
 #include "../graphics_api/graphics_impl.h"
@@ -64,6 +66,12 @@ public:
             }
         }
     }
+
+    /// Return a copy of the query that appends to another result vector.
+    std::unique_ptr<OctreeQuery> clone(Vector<Drawable*>& result) const override
+    {
+        return std::make_unique<ShadowCasterOctreeQuery>(result, frustum_, drawableTypes_, viewMask_);
+    }
 };
 
 /// %Frustum octree query for zones and occluders.
@@ -93,8 +101,26 @@ public:
             }
         }
     }
+
+    /// Return a copy of the query that appends to another result vector.
+    std::unique_ptr<OctreeQuery> clone(Vector<Drawable*>& result) const override
+    {
+        return std::make_unique<ZoneOccluderOctreeQuery>(result, frustum_, drawableTypes_, viewMask_);
+    }
 };
 
+/// Minimum number of zones to build a zone grid for. Fewer zones are searched one by one.
+static const i32 MIN_ZONE_GRID_ZONES = 16;
+
+/// Last assigned zone set ID.
+static u32 lastZoneSetId = 0;
+
+/// Compare zones for sorting by descending priority.
+static bool CompareZonePriorities(Zone* lhs, Zone* rhs)
+{
+    return lhs->GetPriority() > rhs->GetPriority();
+}
+
 /// %Frustum octree query with occlusion.
 class OccludedFrustumOctreeQuery : public FrustumOctreeQuery
 {
@@ -136,6 +162,12 @@ public:
         }
     }
 
+    /// Return a copy of the query that appends to another result vector.
+    std::unique_ptr<OctreeQuery> clone(Vector<Drawable*>& result) const override
+    {
+        return std::make_unique<OccludedFrustumOctreeQuery>(result, frustum_, buffer_, drawableTypes_, viewMask_);
+    }
+
     /// Occlusion buffer.
     OcclusionBuffer* buffer_;
 };
@@ -146,6 +178,8 @@ void CheckVisibilityWork(const WorkItem* item, i32 threadIndex)
     auto** start = reinterpret_cast<Drawable**>(item->start_);
     auto** end = reinterpret_cast<Drawable**>(item->end_);
     OcclusionBuffer* buffer = view->occlusionBuffer_;
+    const PvsGrid* pvsGrid = view->pvsGrid_;
+    i32 pvsCell = view->pvsCell_;
     const Matrix3x4& viewMatrix = view->cullCamera_->GetView();
     Vector3 viewZ = Vector3(viewMatrix.m20_, viewMatrix.m21_, viewMatrix.m22_);
     Vector3 absViewZ = viewZ.Abs();
@@ -157,6 +191,11 @@ void CheckVisibilityWork(const WorkItem* item, i32 threadIndex)
     {
         Drawable* drawable = *start++;
 
+        // The potentially visible set is cheaper to test than the occlusion buffer. Like the occlusion buffer, it only culls
+        // occludees, so that drawables such as skyboxes are never hidden
+        if (pvsGrid && drawable->IsOccludee() && !pvsGrid->IsVisible(pvsCell, drawable->GetWorldBoundingBox()))
+            continue;
+
         if (!buffer || !drawable->IsOccludee() || buffer->IsVisible(drawable->GetWorldBoundingBox()))
         {
             drawable->update_batches(view->frame_);
@@ -257,7 +296,53 @@ void SortShadowQueueWork(const WorkItem* item, i32 threadIndex)
 {
     LightBatchQueue* start = reinterpret_cast<LightBatchQueue*>(item->start_);
     for (ShadowBatchQueue& shadowSplit : start->shadowSplits_)
+    {
         shadowSplit.shadowBatches_.SortFrontToBack();
+        shadowSplit.staticShadowBatches_.SortFrontToBack();
+    }
+}
+
+void RecordBatchQueueWork(const WorkItem* item, i32 threadIndex)
+{
+    auto* queue = reinterpret_cast<BatchQueue*>(item->start_);
+    auto* command = reinterpret_cast<const RenderPathCommand*>(item->aux_);
+    auto* view = reinterpret_cast<View*>(item->end_);
+
+    queue->Record(view->GetCamera(), command->markToStencil_, false);
+}
+
+void RecordLightQueueWork(const WorkItem* item, i32 threadIndex)
+{
+    auto* start = reinterpret_cast<LightBatchQueue*>(item->start_);
+    auto* view = reinterpret_cast<View*>(item->end_);
+
+    start->litBaseBatches_.Record(view->GetCamera(), false, false);
+    start->litBatches_.Record(view->GetCamera(), false, true);
+
+    for (ShadowBatchQueue& shadowSplit : start->shadowSplits_)
+    {
+        shadowSplit.shadowBatches_.Record(shadowSplit.shadowCamera_, false, false);
+        shadowSplit.staticShadowBatches_.Record(shadowSplit.shadowCamera_, false, false);
+    }
+}
+
+/// Add a non-instanced batch with shaders already chosen to a queue.
+static void AddBatchCopiesToQueue(BatchQueue& queue, Batch& batch)
+{
+    // If batch is static with multiple world transforms and cannot instance, we must push copies of the batch individually
+    if (batch.geometryType_ == GEOM_STATIC && batch.numWorldTransforms_ > 1)
+    {
+        i32 numTransforms = batch.numWorldTransforms_;
+        batch.numWorldTransforms_ = 1;
+        for (i32 i = 0; i < numTransforms; ++i)
+        {
+            // Move the transform pointer to generate copies of the batch which only refer to 1 world transform
+            queue.batches_.Push(batch);
+            ++batch.worldTransform_;
+        }
+    }
+    else
+        queue.batches_.Push(batch);
 }
 
 StringHash ParseTextureTypeXml(const String& filename);
@@ -476,6 +561,15 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
     drawShadows_ = renderer->GetDrawShadows();
     materialQuality_ = renderer->GetMaterialQuality();
     maxOccluderTriangles_ = renderer->GetMaxOccluderTriangles();
+    threadedOctreeQueries_ = renderer->GetThreadedOctreeQueries();
+    cacheBaseBatches_ = renderer->GetCacheBaseBatches();
+    temporalOcclusion_ = renderer->GetTemporalOcclusion();
+    cacheStaticShadowMaps_ = renderer->GetCacheStaticShadowMaps();
+#if defined(DV_GLES2)
+    // Copying depth textures is not supported on OpenGL ES 2
+    cacheStaticShadowMaps_ = false;
+#endif
+    temporalOcclusionRefreshInterval_ = renderer->GetTemporalOcclusionRefreshInterval();
     minInstances_ = renderer->GetMinInstances();
 
     // Set possible quality overrides from the camera
@@ -594,6 +688,10 @@ void View::Render()
             camera_->SetFlipVertical(!camera_->GetFlipVertical());
     }
 
+    // Record the draw commands of the batch queues in parallel. Queues shared with a source view are recorded on first draw
+    if (!sourceView_)
+        RecordBatchQueues();
+
     // Render
     ExecuteRenderPathCommands();
 
@@ -743,6 +841,46 @@ void View::SetCameraShaderParameters(Camera* camera)
         SetCommandShaderParameters(*passCommand_);
 }
 
+void View::SetZoneShaderParameters(Zone* zone, Camera* camera, bool overrideFogColorToBlack)
+{
+    Graphics* graphics = DV_GRAPHICS;
+
+    graphics->SetShaderParameter(VSP_AMBIENTSTARTCOLOR, zone->GetAmbientStartColor());
+    graphics->SetShaderParameter(VSP_AMBIENTENDCOLOR,
+        zone->GetAmbientEndColor().ToVector4() - zone->GetAmbientStartColor().ToVector4());
+
+    const BoundingBox& box = zone->GetBoundingBox();
+    Vector3 boxSize = box.Size();
+    Matrix3x4 adjust(Matrix3x4::IDENTITY);
+    adjust.SetScale(Vector3(1.0f / boxSize.x, 1.0f / boxSize.y, 1.0f / boxSize.z));
+    adjust.SetTranslation(Vector3(0.5f, 0.5f, 0.5f));
+    Matrix3x4 zoneTransform = adjust * zone->GetInverseWorldTransform();
+    graphics->SetShaderParameter(VSP_ZONE, zoneTransform);
+
+    graphics->SetShaderParameter(PSP_AMBIENTCOLOR, zone->GetAmbientColor());
+    graphics->SetShaderParameter(PSP_FOGCOLOR, overrideFogColorToBlack ? Color::BLACK : zone->GetFogColor());
+    graphics->SetShaderParameter(PSP_ZONEMIN, zone->GetBoundingBox().min_);
+    graphics->SetShaderParameter(PSP_ZONEMAX, zone->GetBoundingBox().max_);
+
+    float farClip = camera->GetFarClip();
+    float fogStart = Min(zone->GetFogStart(), farClip);
+    float fogEnd = Min(zone->GetFogEnd(), farClip);
+    if (fogStart >= fogEnd * (1.0f - M_LARGE_EPSILON))
+        fogStart = fogEnd * (1.0f - M_LARGE_EPSILON);
+    float fogRange = Max(fogEnd - fogStart, M_EPSILON);
+    Vector4 fogParams(fogEnd / farClip, farClip / fogRange, 0.0f, 0.0f);
+
+    Node* zoneNode = zone->GetNode();
+    if (zone->GetHeightFog() && zoneNode)
+    {
+        Vector3 worldFogHeightVec = zoneNode->GetWorldTransform() * Vector3(0.0f, zone->GetFogHeight(), 0.0f);
+        fogParams.z = worldFogHeightVec.y;
+        fogParams.w = zone->GetFogHeightScale() / Max(zoneNode->GetWorldScale().y, M_EPSILON);
+    }
+
+    graphics->SetShaderParameter(PSP_FOGPARAMS, fogParams);
+}
+
 void View::SetCommandShaderParameters(const RenderPathCommand& command)
 {
     const HashMap<StringHash, Variant>& parameters = command.shaderParameters_;
@@ -791,6 +929,7 @@ void View::GetDrawables()
     {
         ZoneOccluderOctreeQuery
             query(tempDrawables, cullCamera_->GetFrustum(), DrawableTypes::Geometry | DrawableTypes::Zone, cullCamera_->GetViewMask());
+        query.threaded_ = threadedOctreeQueries_;
         octree_->GetDrawables(query);
     }
 
@@ -799,6 +938,17 @@ void View::GetDrawables()
     Node* cameraNode = cullCamera_->GetNode();
     Vector3 cameraPos = cameraNode->GetWorldPosition();
 
+    // Find the potentially visible set cell of the camera
+    pvsGrid_ = nullptr;
+    pvsCell_ = NINDEX;
+    auto* pvs = scene_->GetComponent<PotentiallyVisibleSet>();
+    if (pvs && pvs->IsEnabledEffective() && pvs->GetData())
+    {
+        pvsCell_ = pvs->GetData()->GetGrid().GetCellIndex(cameraPos);
+        if (pvsCell_ != NINDEX)
+            pvsGrid_ = &pvs->GetData()->GetGrid();
+    }
+
     for (Vector<Drawable*>::ConstIterator i = tempDrawables.Begin(); i != tempDrawables.End(); ++i)
     {
         Drawable* drawable = *i;
@@ -817,7 +967,7 @@ void View::GetDrawables()
                 bestPriority = priority;
             }
         }
-        else
+        else if (!pvsGrid_ || pvsGrid_->IsVisible(pvsCell_, drawable->GetWorldBoundingBox()))
             occluders_.Push(drawable);
     }
 
@@ -841,6 +991,8 @@ void View::GetDrawables()
     if (farClipZone_ == DV_RENDERER->GetDefaultZone())
         farClipZone_ = cameraZone_;
 
+    PrepareZoneSearch();
+
     // If occlusion in use, get & render the occluders
     occlusionBuffer_ = nullptr;
     if (maxOccluderTriangles_ > 0)
@@ -862,11 +1014,13 @@ void View::GetDrawables()
     {
         OccludedFrustumOctreeQuery query
             (tempDrawables, cullCamera_->GetFrustum(), occlusionBuffer_, DrawableTypes::Geometry | DrawableTypes::Light, cullCamera_->GetViewMask());
+        query.threaded_ = threadedOctreeQueries_;
         octree_->GetDrawables(query);
     }
     else
     {
         FrustumOctreeQuery query(tempDrawables, cullCamera_->GetFrustum(), DrawableTypes::Geometry | DrawableTypes::Light, cullCamera_->GetViewMask());
+        query.threaded_ = threadedOctreeQueries_;
         octree_->GetDrawables(query);
     }
 
@@ -954,6 +1108,7 @@ void View::GetBatches()
     threadedGeometries_.Clear();
 
     ProcessLights();
+
     GetLightBatches();
     GetBaseBatches();
 }
@@ -1061,49 +1216,23 @@ void View::GetLightBatches()
                     shadowQueue.nearSplit_ = query.shadowNearSplits_[j];
                     shadowQueue.farSplit_ = query.shadowFarSplits_[j];
                     shadowQueue.shadowBatches_.Clear(maxSortedInstances);
+                    shadowQueue.staticShadowBatches_.Clear(maxSortedInstances);
 
                     // Setup the shadow split viewport and finalize shadow camera parameters
                     shadowQueue.shadowViewport_ = GetShadowMapViewport(light, j, lightQueue.shadowMap_);
                     FinalizeShadowCamera(shadowCamera, light, shadowQueue.shadowViewport_, query.shadowCasterBox_[j]);
 
                     // Loop through shadow casters
-                    for (Vector<Drawable*>::ConstIterator k = query.shadowCasters_.Begin() + query.shadowCasterBegin_[j];
-                         k < query.shadowCasters_.Begin() + query.shadowCasterEnd_[j]; ++k)
-                    {
-                        Drawable* drawable = *k;
-                        // If drawable is not in actual view frustum, mark it in view here and check its geometry update type
-                        if (!drawable->IsInView(frame_, true))
-                        {
-                            drawable->MarkInView(frame_.frameNumber_);
-                            UpdateGeometryType type = drawable->GetUpdateGeometryType();
-                            if (type == UPDATE_MAIN_THREAD)
-                                nonThreadedGeometries_.Push(drawable);
-                            else if (type == UPDATE_WORKER_THREAD)
-                                threadedGeometries_.Push(drawable);
-                        }
-
-                        const Vector<SourceBatch>& batches = drawable->GetBatches();
-
-                        for (const SourceBatch& srcBatch : batches)
-                        {
-                            Technique* tech = GetTechnique(drawable, srcBatch.material_);
-                            if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
-                                continue;
-
-                            Pass* pass = tech->GetSupportedPass(Technique::shadowPassIndex);
-                            // Skip if material has no shadow pass
-                            if (!pass)
-                                continue;
-
-                            Batch destBatch(srcBatch);
-                            destBatch.pass_ = pass;
-                            destBatch.zone_ = nullptr;
-
-                            AddBatchToQueue(shadowQueue.shadowBatches_, destBatch, tech);
-                        }
-                    }
+                    AddShadowBatches(shadowQueue.shadowBatches_, shadowCamera, query.shadowCasters_,
+                        query.shadowCasterBegin_[j], query.shadowCasterEnd_[j]);
                 }
 
+                // Static shadow casters are drawn only when the light's cached shadow map is out of date
+                lightQueue.staticShadowMap_ = nullptr;
+                lightQueue.renderStaticShadowMap_ = false;
+                if (shadowSplits > 0 && query.cacheStaticShadows_ && !query.staticShadowCasters_.Empty())
+                    SetupStaticShadowMap(query, lightQueue);
+
                 // Process lit geometries
                 for (Vector<Drawable*>::ConstIterator j = query.litGeometries_.Begin(); j != query.litGeometries_.End(); ++j)
                 {
@@ -1177,6 +1306,11 @@ void View::GetBaseBatches()
 {
     ZoneScoped;
 
+    if (cacheBaseBatches_)
+        ValidateBaseBatchCache();
+    else if (baseBatchCache_.Size())
+        baseBatchCache_.Clear();
+
     for (Vector<Drawable*>::ConstIterator i = geometries_.Begin(); i != geometries_.End(); ++i)
     {
         Drawable* drawable = *i;
@@ -1186,25 +1320,59 @@ void View::GetBaseBatches()
         else if (type == UPDATE_WORKER_THREAD)
             threadedGeometries_.Push(drawable);
 
-        const Vector<SourceBatch>& batches = drawable->GetBatches();
+        const Vector<SourceBatch>& batches = drawable->GetCameraBatches(cullCamera_, frame_);
+
+        // Check here if the material refers to a rendertarget texture with camera(s) attached
+        // Only check this for backbuffer views (null rendertarget)
+        if (!renderTarget_)
+        {
+            for (const SourceBatch& srcBatch : batches)
+            {
+                if (srcBatch.material_ && srcBatch.material_->GetAuxViewFrameNumber() != frame_.frameNumber_)
+                    CheckMaterialForAuxView(srcBatch.material_);
+            }
+        }
+
+        if (cacheBaseBatches_ && AddCachedBaseBatches(drawable))
+            continue;
+
+        BaseBatchCacheEntry* cacheEntry = nullptr;
+        if (cacheBaseBatches_)
+        {
+            Zone* zone = GetZone(drawable);
+            cacheEntry = &baseBatchCache_[WeakPtr<Drawable>(drawable)];
+            cacheEntry->sources_.Clear();
+            cacheEntry->batches_.Clear();
+            cacheEntry->zone_ = zone;
+            cacheEntry->heightFog_ = zone->GetHeightFog();
+            cacheEntry->lightMask_ = GetLightMask(drawable);
+            cacheEntry->basePassFlags_ = drawable->GetBasePassFlags();
+            cacheEntry->frameNumber_ = frame_.frameNumber_;
+        }
+
         bool vertexLightsProcessed = false;
 
         for (i32 j = 0; j < batches.Size(); ++j)
         {
             const SourceBatch& srcBatch = batches[j];
 
-            // Check here if the material refers to a rendertarget texture with camera(s) attached
-            // Only check this for backbuffer views (null rendertarget)
-            if (srcBatch.material_ && srcBatch.material_->GetAuxViewFrameNumber() != frame_.frameNumber_ && !renderTarget_)
-                CheckMaterialForAuxView(srcBatch.material_);
-
             Technique* tech = GetTechnique(drawable, srcBatch.material_);
-            if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
+            bool skip = !srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech;
+
+            if (cacheEntry)
+            {
+                cacheEntry->sources_.Push({srcBatch.material_, srcBatch.geometry_, srcBatch.geometryType_, skip ? nullptr : tech,
+                    srcBatch.material_ && srcBatch.material_->GetNumTechniques() > 1});
+            }
+
+            if (skip)
                 continue;
 
             // Check each of the scene passes
-            for (const ScenePassInfo& info : scenePasses_)
+            for (i32 k = 0; k < scenePasses_.Size(); ++k)
             {
+                const ScenePassInfo& info = scenePasses_[k];
+
                 // Skip forward base pass if the corresponding litbase pass already exists
                 if (info.passIndex_ == basePassIndex_ && j < 32 && drawable->HasBasePass(j))
                     continue;
@@ -1255,9 +1423,138 @@ void View::GetBaseBatches()
                     allowInstancing = false;
 
                 AddBatchToQueue(*info.batchQueue_, destBatch, tech, allowInstancing);
+
+                if (cacheEntry)
+                {
+                    cacheEntry->batches_.Push({j, k, SharedPtr<Pass>(pass), pass->GetShadersVersion(), allowInstancing,
+                        destBatch.geometryType_, destBatch.vertexShader_, destBatch.pixelShader_, destBatch.sortKey_});
+                }
             }
         }
+
+        // Vertex light queues are recreated every frame, so vertex lit drawables are not cached
+        if (cacheEntry && drawable->GetVertexLights().Size())
+            baseBatchCache_.Erase(WeakPtr<Drawable>(drawable));
+    }
+
+    // Forget drawables that have been destroyed or have not been visible recently
+    if (baseBatchCache_.Size() > geometries_.Size() * 2 + 64)
+    {
+        for (HashMap<WeakPtr<Drawable>, BaseBatchCacheEntry>::Iterator i = baseBatchCache_.Begin(); i != baseBatchCache_.End();)
+        {
+            if (i->first_.Expired() || i->second_.frameNumber_ != frame_.frameNumber_)
+                i = baseBatchCache_.Erase(i);
+            else
+                ++i;
+        }
+    }
+}
+
+void View::RemoveCachedBaseBatches(Drawable* drawable)
+{
+    baseBatchCache_.Erase(WeakPtr<Drawable>(drawable));
+}
+
+void View::ValidateBaseBatchCache()
+{
+    Renderer* renderer = DV_RENDERER;
+
+    Vector<u32> state;
+    state.Push((u32)renderer->GetShadersChangedFrameNumber());
+    state.Push(renderer->GetDynamicInstancing() ? 1u : 0u);
+    // Technique and supported pass choices are not resolved again while the techniques and materials are unchanged
+    state.Push(Technique::GetStateVersion());
+    state.Push((u32)materialQuality_);
+
+    for (const ScenePassInfo& info : scenePasses_)
+    {
+        state.Push((u32)info.passIndex_);
+        state.Push((info.allowInstancing_ ? 1u : 0u) | (info.markToStencil_ ? 2u : 0u) | (info.vertexLights_ ? 4u : 0u));
+        state.Push(info.batchQueue_->hasExtraDefines_ ? info.batchQueue_->vsExtraDefinesHash_.Value() : 0u);
+        state.Push(info.batchQueue_->hasExtraDefines_ ? info.batchQueue_->psExtraDefinesHash_.Value() : 0u);
+    }
+
+    if (state != baseBatchCacheState_)
+    {
+        baseBatchCache_.Clear();
+        baseBatchCacheState_ = state;
+    }
+}
+
+bool View::AddCachedBaseBatches(Drawable* drawable)
+{
+    HashMap<WeakPtr<Drawable>, BaseBatchCacheEntry>::Iterator it = baseBatchCache_.Find(WeakPtr<Drawable>(drawable));
+    if (it == baseBatchCache_.End())
+        return false;
+
+    BaseBatchCacheEntry& entry = it->second_;
+    const Vector<SourceBatch>& batches = drawable->GetCameraBatches(cullCamera_, frame_);
+    Zone* zone = GetZone(drawable);
+
+    if (entry.sources_.Size() != batches.Size() || entry.zone_ != zone || entry.heightFog_ != zone->GetHeightFog() ||
+        entry.lightMask_ != GetLightMask(drawable) || entry.basePassFlags_ != drawable->GetBasePassFlags() ||
+        drawable->GetVertexLights().Size())
+        return false;
+
+    // The supported passes can only change with the technique state version, which clears the cache. Only techniques chosen
+    // by LOD distance are resolved again
+    for (i32 j = 0; j < batches.Size(); ++j)
+    {
+        const SourceBatch& srcBatch = batches[j];
+        const BaseBatchCacheSource& source = entry.sources_[j];
+
+        if (srcBatch.material_ != source.material_ || srcBatch.geometry_ != source.geometry_ ||
+            srcBatch.geometryType_ != source.geometryType_)
+            return false;
+
+        bool skip = !srcBatch.geometry_ || !srcBatch.numWorldTransforms_;
+        if (skip != !source.technique_)
+            return false;
+        if (!skip && source.lodTechnique_ && GetTechnique(drawable, srcBatch.material_) != source.technique_)
+            return false;
+    }
+
+    for (const CachedBaseBatch& cached : entry.batches_)
+    {
+        if (cached.passShadersVersion_ != cached.pass_->GetShadersVersion())
+            return false;
+    }
+
+    entry.frameNumber_ = frame_.frameNumber_;
+    unsigned char lightMask = (unsigned char)entry.lightMask_;
+
+    for (const CachedBaseBatch& cached : entry.batches_)
+    {
+        const SourceBatch& srcBatch = batches[cached.sourceIndex_];
+        const ScenePassInfo& info = scenePasses_[cached.scenePassIndex_];
+
+        Batch destBatch(srcBatch);
+        destBatch.pass_ = cached.pass_;
+        destBatch.zone_ = zone;
+        destBatch.isBase_ = true;
+        destBatch.lightMask_ = lightMask;
+        destBatch.lightQueue_ = nullptr;
+
+        if (cached.geometryType_ == GEOM_INSTANCED)
+        {
+            // Instance groups are recreated every frame
+            destBatch.geometryType_ = GEOM_INSTANCED;
+            AddBatchToQueue(*info.batchQueue_, destBatch, entry.sources_[cached.sourceIndex_].technique_, cached.allowInstancing_);
+        }
+        else
+        {
+            if (!destBatch.material_)
+                destBatch.material_ = DV_RENDERER->GetDefaultMaterial();
+
+            destBatch.geometryType_ = cached.geometryType_;
+            destBatch.vertexShader_ = cached.vertexShader_;
+            destBatch.pixelShader_ = cached.pixelShader_;
+            destBatch.sortKey_ = cached.sortKey_;
+            AddBatchCopiesToQueue(*info.batchQueue_, destBatch);
+        }
     }
+
+    return true;
 }
 
 void View::UpdateGeometries()
@@ -1358,11 +1655,62 @@ void View::UpdateGeometries()
     geometriesUpdated_ = true;
 }
 
+void View::RecordBatchQueues()
+{
+    DV_PROFILE(RecordBatchQueues);
+
+    // Update the lazily calculated camera matrices on the main thread, as several queues may use the same shadow camera
+    for (LightBatchQueue& lightQueue : lightQueues_)
+    {
+        for (ShadowBatchQueue& shadowSplit : lightQueue.shadowSplits_)
+        {
+            shadowSplit.shadowCamera_->GetView();
+            shadowSplit.shadowCamera_->GetProjection();
+        }
+    }
+
+    WorkQueue* queue = DV_WORK_QUEUE;
+    Vector<i32> recordedPasses;
+
+    for (const RenderPathCommand& command : renderPath_->commands_)
+    {
+        if (!IsNecessary(command) || command.type_ != CMD_SCENEPASS)
+            continue;
+
+        // A queue drawn by several commands is recorded for the first one, and recorded again on draw if the arguments differ
+        BatchQueue& batchQueue = batchQueues_[command.passIndex_];
+        if (batchQueue.IsEmpty() || recordedPasses.Contains(command.passIndex_))
+            continue;
+
+        recordedPasses.Push(command.passIndex_);
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = WI_MAX_PRIORITY;
+        item->workFunction_ = RecordBatchQueueWork;
+        item->start_ = &batchQueue;
+        item->end_ = this;
+        item->aux_ = const_cast<RenderPathCommand*>(&command);
+        queue->AddWorkItem(item);
+    }
+
+    for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = WI_MAX_PRIORITY;
+        item->workFunction_ = RecordLightQueueWork;
+        item->start_ = &(*i);
+        item->end_ = this;
+        queue->AddWorkItem(item);
+    }
+
+    queue->Complete(WI_MAX_PRIORITY);
+}
+
 void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue)
 {
     Light* light = lightQueue.light_;
     Zone* zone = GetZone(drawable);
-    const Vector<SourceBatch>& batches = drawable->GetBatches();
+    const Vector<SourceBatch>& batches = drawable->GetCameraBatches(cullCamera_, frame_);
 
     bool allowLitBase =
         useLitBase_ && !lightQueue.negative_ && light == drawable->first_light() && drawable->GetVertexLights().Empty() &&
@@ -2224,13 +2572,34 @@ void View::DrawOccluders(OcclusionBuffer* buffer, const Vector<Drawable*>& occlu
     buffer->SetMaxTriangles(maxOccluderTriangles_);
     buffer->Clear();
 
+    if (temporalOcclusion_)
+    {
+        // Start from the depth saved on the last refresh frame if possible. On a refresh frame the stable occluders go to the
+        // saved depth, changed occluders are drawn after saving
+        bool reprojected = buffer->BeginTemporalFrame(occluders, temporalOcclusionRefreshInterval_, stableOccluders_, changedOccluders_);
+        i32 numStable = DrawOccluderList(buffer, stableOccluders_, reprojected);
+        if (!reprojected)
+            buffer->SaveTemporalDepth(stableOccluders_, numStable);
+
+        if (numStable == stableOccluders_.Size() && buffer->GetNumTriangles() <= buffer->GetMaxTriangles())
+            DrawOccluderList(buffer, changedOccluders_, true);
+    }
+    else
+        DrawOccluderList(buffer, occluders, false);
+
+    // Finally build the depth mip levels
+    buffer->BuildDepthHierarchy();
+}
+
+i32 View::DrawOccluderList(OcclusionBuffer* buffer, const Vector<Drawable*>& occluders, bool testFirst)
+{
     if (!buffer->IsThreaded())
     {
         // If not threaded, draw occluders one by one and test the next occluder against already rasterized depth
         for (i32 i = 0; i < occluders.Size(); ++i)
         {
             Drawable* occluder = occluders[i];
-            if (i > 0)
+            if (i > 0 || testFirst)
             {
                 // For subsequent occluders, do a test against the pixel-level occlusion buffer to see if rendering is necessary
                 if (!buffer->IsVisible(occluder->GetWorldBoundingBox()))
@@ -2243,26 +2612,28 @@ void View::DrawOccluders(OcclusionBuffer* buffer, const Vector<Drawable*>& occlu
             // Draw triangles submitted by this occluder
             buffer->DrawTriangles();
             if (!success)
-                break;
+                return i + 1;
         }
     }
     else
     {
         // In threaded mode submit all triangles first, then render (cannot test in this case)
-        for (Drawable* occluder : occluders)
+        for (i32 i = 0; i < occluders.Size(); ++i)
         {
             // Check for running out of triangles
             ++activeOccluders_;
 
-            if (!occluder->DrawOcclusion(buffer))
-                break;
+            if (!occluders[i]->DrawOcclusion(buffer))
+            {
+                buffer->DrawTriangles();
+                return i + 1;
+            }
         }
 
         buffer->DrawTriangles();
     }
 
-    // Finally build the depth mip levels
-    buffer->BuildDepthHierarchy();
+    return occluders.Size();
 }
 
 void View::ProcessLight(LightQueryResult& query, i32 threadIndex)
@@ -2336,17 +2707,30 @@ void View::ProcessLight(LightQueryResult& query, i32 threadIndex)
     // Determine number of shadow cameras and setup their initial positions
     SetupShadowCameras(query);
 
+    // Shadow cameras of point lights and unfocused spot lights depend only on the light, so their static shadow casters can
+    // be kept in a cached shadow map. Variance shadow maps are blurred after rendering, so can not be drawn on top of
+    query.cacheStaticShadows_ = cacheStaticShadowMaps_ && DV_RENDERER->GetShadowQuality() < SHADOWQUALITY_VSM &&
+        (type == LIGHT_POINT || (type == LIGHT_SPOT && !light->GetShadowFocus().focus_));
+
     // Process each split for shadow casters
     query.shadowCasters_.Clear();
+    query.staticShadowCasters_.Clear();
     for (i32 i = 0; i < query.numSplits_; ++i)
     {
         Camera* shadowCamera = query.shadowCameras_[i];
         const Frustum& shadowCameraFrustum = shadowCamera->GetFrustum();
         query.shadowCasterBegin_[i] = query.shadowCasterEnd_[i] = query.shadowCasters_.Size();
+        query.staticShadowCasterBegin_[i] = query.staticShadowCasterEnd_[i] = query.staticShadowCasters_.Size();
 
-        // For point light check that the face is visible: if not, can skip the split
+        // For point light check that the face is visible: if not, can skip the split. When caching, the static casters
+        // of the face are still needed to keep the cached shadow map complete
+        bool splitVisible = true;
         if (type == LIGHT_POINT && frustum.IsInsideFast(BoundingBox(shadowCameraFrustum)) == OUTSIDE)
-            continue;
+        {
+            if (!query.cacheStaticShadows_)
+                continue;
+            splitVisible = false;
+        }
 
         // For directional light check that the split is inside the visible scene: if not, can skip the split
         if (type == LIGHT_DIRECTIONAL)
@@ -2362,16 +2746,19 @@ void View::ProcessLight(LightQueryResult& query, i32 threadIndex)
         }
 
         // Check which shadow casters actually contribute to the shadowing
-        ProcessShadowCasters(query, tempDrawables, i);
+        ProcessShadowCasters(query, tempDrawables, i, splitVisible);
     }
 
+    if (query.cacheStaticShadows_)
+        light->GetStaticShadowCache()->RemoveStaleCasters(frame_.frameNumber_);
+
     // If no shadow casters, the light can be rendered unshadowed. At this point we have not allocated a shadow map yet, so the
     // only cost has been the shadow camera setup & queries
-    if (query.shadowCasters_.Empty())
+    if (query.shadowCasters_.Empty() && query.staticShadowCasters_.Empty())
         query.numSplits_ = 0;
 }
 
-void View::ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>& drawables, i32 splitIndex)
+void View::ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>& drawables, i32 splitIndex, bool splitVisible)
 {
     assert(splitIndex >= 0);
 
@@ -2385,6 +2772,7 @@ void View::ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>
     LightType type = light->GetLightType();
 
     query.shadowCasterBox_[splitIndex].Clear();
+    StaticShadowCache* staticShadowCache = query.cacheStaticShadows_ ? light->GetStaticShadowCache() : nullptr;
 
     // Transform scene frustum into shadow camera's view space for shadow caster visibility check. For point & spot lights,
     // we can use the whole scene frustum. For directional lights, use the intersection of the scene frustum and the split
@@ -2398,9 +2786,14 @@ void View::ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>
 
     BoundingBox lightViewFrustumBox(lightViewFrustum);
 
-    // Check for degenerate split frustum: in that case there is no need to get shadow casters
+    // Check for degenerate split frustum: in that case there is no need to get shadow casters, except static ones for the
+    // cached shadow map
     if (lightViewFrustum.vertices_[0] == lightViewFrustum.vertices_[4])
-        return;
+    {
+        if (!staticShadowCache)
+            return;
+        splitVisible = false;
+    }
 
     BoundingBox lightViewBox;
     BoundingBox lightProjBox;
@@ -2431,6 +2824,17 @@ void View::ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>
         if (maxShadowDistance > 0.0f && drawable->distance() > maxShadowDistance)
             continue;
 
+        // Static casters go to the cached shadow map whether or not their shadow is currently visible, so that the cached
+        // shadow map does not depend on the view
+        if (staticShadowCache && staticShadowCache->UpdateCaster(drawable, frame_.frameNumber_))
+        {
+            query.staticShadowCasters_.Push(drawable);
+            continue;
+        }
+
+        if (!splitVisible)
+            continue;
+
         // Project shadow caster bounding box to light view space for visibility check
         lightViewBox = drawable->GetWorldBoundingBox().Transformed(lightView);
 
@@ -2447,6 +2851,7 @@ void View::ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>
     }
 
     query.shadowCasterEnd_[splitIndex] = query.shadowCasters_.Size();
+    query.staticShadowCasterEnd_[splitIndex] = query.staticShadowCasters_.Size();
 }
 
 bool View::IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, Camera* shadowCamera, const Matrix3x4& lightView,
@@ -2485,6 +2890,89 @@ bool View::IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, C
     }
 }
 
+void View::AddShadowBatches(BatchQueue& queue, Camera* shadowCamera, const Vector<Drawable*>& casters, i32 begin, i32 end)
+{
+    for (i32 i = begin; i < end; ++i)
+    {
+        Drawable* drawable = casters[i];
+        // If drawable is not in actual view frustum, mark it in view here and check its geometry update type
+        if (!drawable->IsInView(frame_, true))
+        {
+            drawable->MarkInView(frame_.frameNumber_);
+            UpdateGeometryType type = drawable->GetUpdateGeometryType();
+            if (type == UPDATE_MAIN_THREAD)
+                nonThreadedGeometries_.Push(drawable);
+            else if (type == UPDATE_WORKER_THREAD)
+                threadedGeometries_.Push(drawable);
+        }
+
+        const Vector<SourceBatch>& batches = drawable->GetCameraBatches(shadowCamera, frame_);
+
+        for (const SourceBatch& srcBatch : batches)
+        {
+            Technique* tech = GetTechnique(drawable, srcBatch.material_);
+            if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
+                continue;
+
+            Pass* pass = tech->GetSupportedPass(Technique::shadowPassIndex);
+            // Skip if material has no shadow pass
+            if (!pass)
+                continue;
+
+            Batch destBatch(srcBatch);
+            destBatch.pass_ = pass;
+            destBatch.zone_ = nullptr;
+
+            AddBatchToQueue(queue, destBatch, tech);
+        }
+    }
+}
+
+void View::SetupStaticShadowMap(const LightQueryResult& query, LightBatchQueue& lightQueue)
+{
+    Light* light = query.light_;
+    StaticShadowCache* cache = light->GetStaticShadowCache();
+    i32 numSplits = lightQueue.shadowSplits_.Size();
+
+    Matrix4 viewProj[MAX_LIGHT_SPLITS];
+    IntRect viewports[MAX_LIGHT_SPLITS];
+
+    cache->BeginUpdate();
+    for (i32 i = 0; i < numSplits; ++i)
+    {
+        const ShadowBatchQueue& shadowQueue = lightQueue.shadowSplits_[i];
+        viewProj[i] = shadowQueue.shadowCamera_->GetProjection() * shadowQueue.shadowCamera_->GetView();
+        viewports[i] = shadowQueue.shadowViewport_;
+
+        for (i32 j = query.staticShadowCasterBegin_[i]; j < query.staticShadowCasterEnd_[i]; ++j)
+            cache->AddCaster(query.staticShadowCasters_[j], i);
+    }
+
+    bool upToDate = cache->EndUpdate(lightQueue.shadowMap_, viewProj, viewports, numSplits, light->GetShadowBias());
+    lightQueue.staticShadowMap_ = cache->GetShadowMap();
+
+    // If the cached shadow map could not be created, draw the static casters with the others
+    if (!lightQueue.staticShadowMap_)
+    {
+        for (i32 i = 0; i < numSplits; ++i)
+        {
+            AddShadowBatches(lightQueue.shadowSplits_[i].shadowBatches_, lightQueue.shadowSplits_[i].shadowCamera_,
+                query.staticShadowCasters_, query.staticShadowCasterBegin_[i], query.staticShadowCasterEnd_[i]);
+        }
+        return;
+    }
+
+    if (upToDate)
+        return;
+
+    lightQueue.renderStaticShadowMap_ = true;
+    for (i32 i = 0; i < numSplits; ++i)
+    {
+        AddShadowBatches(lightQueue.shadowSplits_[i].staticShadowBatches_, lightQueue.shadowSplits_[i].shadowCamera_,
+            query.staticShadowCasters_, query.staticShadowCasterBegin_[i], query.staticShadowCasterEnd_[i]);
+    }
+}
+
 IntRect View::GetShadowMapViewport(Light* light, int splitIndex, Texture2D* shadowMap)
 {
     int width = shadowMap->GetWidth();
@@ -2772,11 +3260,42 @@ void View::QuantizeDirLightShadowCamera(Camera* shadowCamera, Light* light, cons
     }
 }
 
+void View::PrepareZoneSearch()
+{
+    // Stable sort keeps the octree order of equal priority zones, so the first zone found is the one a linear search would pick
+    sortedZones_ = zones_;
+    stable_sort(sortedZones_.Begin(), sortedZones_.End(), CompareZonePriorities);
+
+    zoneSet_.Clear();
+    for (Zone* zone : sortedZones_)
+        zoneSet_.Push(ZoneSetEntry{zone, zone->GetZoneMask(), zone->GetWorldBoundingBox()});
+
+    if (zoneSetId_ && zoneSet_ == lastZoneSet_)
+        return;
+
+    swap(zoneSet_, lastZoneSet_);
+    if (++lastZoneSetId == 0)
+        ++lastZoneSetId;
+    zoneSetId_ = lastZoneSetId;
+
+    if (sortedZones_.Size() >= MIN_ZONE_GRID_ZONES)
+    {
+        Vector<BoundingBox> boxes(sortedZones_.Size());
+        for (i32 i = 0; i < sortedZones_.Size(); ++i)
+            boxes[i] = lastZoneSet_[i].box_;
+        zoneGrid_.Build(boxes.Buffer(), boxes.Size());
+    }
+    else
+        zoneGrid_.Clear();
+}
+
 void View::FindZone(Drawable* drawable)
 {
+    // A drawable that has not moved since it was searched with the same zones would get the same zone
+    if (drawable->GetZoneSetId() == zoneSetId_)
+        return;
+
     Vector3 center = drawable->GetWorldBoundingBox().Center();
-    int bestPriority = M_MIN_INT;
-    Zone* newZone = nullptr;
 
     // If bounding box center is in view, the zone assignment is conclusive also for next frames. Otherwise it is temporary
     // (possibly incorrect) and must be re-evaluated on the next frame
@@ -2787,22 +3306,28 @@ void View::FindZone(Drawable* drawable)
 
     if (lastZone && (lastZone->GetViewMask() & cullCamera_->GetViewMask()) && lastZone->GetPriority() >= highestZonePriority_ &&
         (drawable->GetZoneMask() & lastZone->GetZoneMask()) && lastZone->IsInside(center))
-        newZone = lastZone;
-    else
     {
-        for (Vector<Zone*>::Iterator i = zones_.Begin(); i != zones_.End(); ++i)
+        drawable->SetZone(lastZone, temporary);
+        return;
+    }
+
+    // The zones are sorted by descending priority, so the first one that contains the center is the best
+    Zone* newZone = nullptr;
+    mask32 zoneMask = drawable->GetZoneMask();
+    i32 numCandidates = sortedZones_.Size();
+    const i32* candidates = zoneGrid_.IsEmpty() ? nullptr : zoneGrid_.GetCandidates(center, numCandidates);
+
+    for (i32 i = 0; i < numCandidates; ++i)
+    {
+        Zone* zone = sortedZones_[candidates ? candidates[i] : i];
+        if ((zoneMask & zone->GetZoneMask()) && zone->IsInside(center))
         {
-            Zone* zone = *i;
-            int priority = zone->GetPriority();
-            if (priority > bestPriority && (drawable->GetZoneMask() & zone->GetZoneMask()) && zone->IsInside(center))
-            {
-                newZone = zone;
-                bestPriority = priority;
-            }
+            newZone = zone;
+            break;
         }
     }
 
-    drawable->SetZone(newZone, temporary);
+    drawable->SetZone(newZone, temporary, zoneSetId_);
 }
 
 Technique* View::GetTechnique(Drawable* drawable, Material* material)
@@ -2929,21 +3454,7 @@ void View::AddBatchToQueue(BatchQueue& queue, Batch& batch, Technique* tech, boo
     {
         renderer->SetBatchShaders(batch, tech, allowShadows, queue);
         batch.CalculateSortKey();
-
-        // If batch is static with multiple world transforms and cannot instance, we must push copies of the batch individually
-        if (batch.geometryType_ == GEOM_STATIC && batch.numWorldTransforms_ > 1)
-        {
-            i32 numTransforms = batch.numWorldTransforms_;
-            batch.numWorldTransforms_ = 1;
-            for (i32 i = 0; i < numTransforms; ++i)
-            {
-                // Move the transform pointer to generate copies of the batch which only refer to 1 world transform
-                queue.batches_.Push(batch);
-                ++batch.worldTransform_;
-            }
-        }
-        else
-            queue.batches_.Push(batch);
+        AddBatchCopiesToQueue(queue, batch);
     }
 }
 
@@ -2967,7 +3478,10 @@ void View::PrepareInstancingBuffer()
     for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
     {
         for (const ShadowBatchQueue& shadowSplit : i->shadowSplits_)
+        {
             totalInstances += shadowSplit.shadowBatches_.GetNumInstances();
+            totalInstances += shadowSplit.staticShadowBatches_.GetNumInstances();
+        }
 
         totalInstances += i->litBaseBatches_.GetNumInstances();
         totalInstances += i->litBatches_.GetNumInstances();
@@ -2989,7 +3503,10 @@ void View::PrepareInstancingBuffer()
     for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
     {
         for (ShadowBatchQueue& shadowSplit : i->shadowSplits_)
+        {
             shadowSplit.shadowBatches_.SetInstancingData(dest, stride, freeIndex);
+            shadowSplit.staticShadowBatches_.SetInstancingData(dest, stride, freeIndex);
+        }
 
         i->litBaseBatches_.SetInstancingData(dest, stride, freeIndex);
         i->litBatches_.SetInstancingData(dest, stride, freeIndex);
@@ -3077,13 +3594,32 @@ void View::RenderShadowMap(const LightBatchQueue& queue)
     if (shadowMap->GetUsage() == TEXTURE_DEPTHSTENCIL)
     {
         graphics->SetColorWrite(false);
-        graphics->SetDepthStencil(shadowMap);
-        graphics->SetRenderTarget(0, shadowMap->GetRenderSurface()->GetLinkedRenderTarget());
         // Disable other render targets
         for (i32 i = 1; i < MAX_RENDERTARGETS; ++i)
             graphics->SetRenderTarget(i, (RenderSurface*) nullptr);
+
+        Texture2D* staticShadowMap = queue.staticShadowMap_;
+        if (staticShadowMap && queue.renderStaticShadowMap_)
+        {
+            graphics->SetDepthStencil(staticShadowMap);
+            graphics->SetRenderTarget(0, staticShadowMap->GetRenderSurface()->GetLinkedRenderTarget());
+            graphics->SetViewport(IntRect(0, 0, staticShadowMap->GetWidth(), staticShadowMap->GetHeight()));
+            graphics->Clear(CLEAR_DEPTH);
+            RenderShadowSplits(queue, parameters, true);
+        }
+
+        graphics->SetDepthStencil(shadowMap);
+        graphics->SetRenderTarget(0, shadowMap->GetRenderSurface()->GetLinkedRenderTarget());
         graphics->SetViewport(IntRect(0, 0, shadowMap->GetWidth(), shadowMap->GetHeight()));
-        graphics->Clear(CLEAR_DEPTH);
+
+        // Start from the static casters' depth if it is cached
+        if (!staticShadowMap || !graphics->CopyDepth(shadowMap, staticShadowMap))
+        {
+            graphics->Clear(CLEAR_DEPTH);
+            // The cached shadow map contents can not be used, so render them again next time
+            if (staticShadowMap)
+                queue.light_->GetStaticShadowCache()->Invalidate();
+        }
     }
     else // if the shadow map is a color rendertarget
     {
@@ -3100,10 +3636,26 @@ void View::RenderShadowMap(const LightBatchQueue& queue)
         parameters = BiasParameters(0.0f, 0.0f);
     }
 
+    RenderShadowSplits(queue, parameters, false);
+
+    // Scale filter blur amount to shadow map viewport size so that different shadow map resolutions don't behave differently
+    float blurScale = queue.shadowSplits_[0].shadowViewport_.Width() / 1024.0f;
+    renderer->ApplyShadowMapFilter(this, shadowMap, blurScale);
+
+    // reset some parameters
+    graphics->SetColorWrite(true);
+    graphics->SetDepthBias(0.0f, 0.0f);
+}
+
+void View::RenderShadowSplits(const LightBatchQueue& queue, const BiasParameters& parameters, bool staticCasters)
+{
+    Graphics* graphics = DV_GRAPHICS;
+
     // Render each of the splits
     for (i32 i = 0; i < queue.shadowSplits_.Size(); ++i)
     {
         const ShadowBatchQueue& shadowQueue = queue.shadowSplits_[i];
+        const BatchQueue& batches = staticCasters ? shadowQueue.staticShadowBatches_ : shadowQueue.shadowBatches_;
 
         float multiplier = 1.0f;
         // For directional light cascade splits, adjust depth bias according to the far clip ratio of the splits
@@ -3125,20 +3677,12 @@ void View::RenderShadowMap(const LightBatchQueue& queue)
 
         graphics->SetDepthBias(multiplier * parameters.constantBias_ + addition, multiplier * parameters.slopeScaledBias_);
 
-        if (!shadowQueue.shadowBatches_.IsEmpty())
+        if (!batches.IsEmpty())
         {
             graphics->SetViewport(shadowQueue.shadowViewport_);
-            shadowQueue.shadowBatches_.Draw(this, shadowQueue.shadowCamera_, false, false, true);
+            batches.Draw(this, shadowQueue.shadowCamera_, false, false, true);
         }
     }
-
-    // Scale filter blur amount to shadow map viewport size so that different shadow map resolutions don't behave differently
-    float blurScale = queue.shadowSplits_[0].shadowViewport_.Width() / 1024.0f;
-    renderer->ApplyShadowMapFilter(this, shadowMap, blurScale);
-
-    // reset some parameters
-    graphics->SetColorWrite(true);
-    graphics->SetDepthBias(0.0f, 0.0f);
 }
 
 RenderSurface* View::GetDepthStencil(RenderSurface* renderTarget)
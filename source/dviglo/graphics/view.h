@@ -8,7 +8,9 @@
 #include "../core/object.h"
 #include "batch.h"
 #include "light.h"
+#include "technique.h"
 #include "zone.h"
+#include "zone_grid.h"
 #include "../math/polyhedron.h"
 
 namespace dviglo
@@ -20,6 +22,7 @@ class Light;
 class Drawable;
 class OcclusionBuffer;
 class Octree;
+class PvsGrid;
 class RenderPath;
 class RenderSurface;
 class Technique;
@@ -45,6 +48,12 @@ struct LightQueryResult
     i32 shadowCasterBegin_[MAX_LIGHT_SPLITS];
     /// Shadow caster end indices.
     i32 shadowCasterEnd_[MAX_LIGHT_SPLITS];
+    /// Static shadow casters, rendered to the light's cached shadow map.
+    Vector<Drawable*> staticShadowCasters_;
+    /// Static shadow caster start indices.
+    i32 staticShadowCasterBegin_[MAX_LIGHT_SPLITS];
+    /// Static shadow caster end indices.
+    i32 staticShadowCasterEnd_[MAX_LIGHT_SPLITS];
     /// Combined bounding box of shadow casters in light projection space. Only used for focused spot lights.
     BoundingBox shadowCasterBox_[MAX_LIGHT_SPLITS];
     /// Shadow camera near splits (directional lights only).
@@ -53,6 +62,8 @@ struct LightQueryResult
     float shadowFarSplits_[MAX_LIGHT_SPLITS];
     /// Shadow map split count.
     i32 numSplits_;
+    /// Whether static shadow casters are separated for the light's cached shadow map.
+    bool cacheStaticShadows_;
 };
 
 /// Scene render pass info.
@@ -70,6 +81,77 @@ struct ScenePassInfo
     BatchQueue* batchQueue_;
 };
 
+/// Source batch state that cached base batches were prepared from.
+struct BaseBatchCacheSource
+{
+    /// Material.
+    Material* material_;
+    /// Geometry.
+    Geometry* geometry_;
+    /// Geometry type.
+    GeometryType geometryType_;
+    /// Chosen technique, null if the source batch was skipped.
+    Technique* technique_;
+    /// Whether the technique depends on LOD distance and must be chosen again every frame.
+    bool lodTechnique_;
+};
+
+/// Base pass batch prepared on an earlier frame.
+struct CachedBaseBatch
+{
+    /// Source batch index.
+    i32 sourceIndex_;
+    /// Scene pass info index.
+    i32 scenePassIndex_;
+    /// Pass. Holds a reference so that a reloaded technique can not reuse the address.
+    SharedPtr<Pass> pass_;
+    /// Shaders version of the pass when the shaders were chosen.
+    u32 passShadersVersion_;
+    /// Allow instancing flag.
+    bool allowInstancing_;
+    /// Geometry type after shader selection.
+    GeometryType geometryType_;
+    /// Vertex shader.
+    ShaderVariation* vertexShader_;
+    /// Pixel shader.
+    ShaderVariation* pixelShader_;
+    /// State sorting key.
+    hash64 sortKey_;
+};
+
+/// Base batches of a drawable cached across frames.
+struct BaseBatchCacheEntry
+{
+    /// Source batch states.
+    Vector<BaseBatchCacheSource> sources_;
+    /// Prepared batches in the order they were added to the queues.
+    Vector<CachedBaseBatch> batches_;
+    /// Zone.
+    Zone* zone_;
+    /// Zone height fog flag.
+    bool heightFog_;
+    /// Light mask including the zone.
+    unsigned lightMask_;
+    /// Base pass flags of the drawable.
+    flagset32 basePassFlags_;
+    /// Frame number on which the entry was last used.
+    i32 frameNumber_;
+};
+
+/// Zone of a view's zone set. Used to detect whether the zones changed since the previous frame.
+struct ZoneSetEntry
+{
+    /// Test for equality with another entry.
+    bool operator ==(const ZoneSetEntry& rhs) const { return zone_ == rhs.zone_ && zoneMask_ == rhs.zoneMask_ && box_ == rhs.box_; }
+
+    /// Zone.
+    Zone* zone_;
+    /// Zone mask.
+    mask32 zoneMask_;
+    /// World bounding box.
+    BoundingBox box_;
+};
+
 /// Per-thread geometry, light and scene range collection structure.
 struct PerThreadSceneResult
 {
@@ -158,11 +240,18 @@ public:
     void SetGlobalShaderParameters();
     /// Set camera-specific shader parameters. Called by Batch and internally by View.
     void SetCameraShaderParameters(Camera* camera);
+    /// Set zone-specific shader parameters. Called by Batch.
+    void SetZoneShaderParameters(Zone* zone, Camera* camera, bool overrideFogColorToBlack);
+    /// Forget the cached base batches of a drawable. Called by Renderer when the drawable is removed from the octree.
+    void RemoveCachedBaseBatches(Drawable* drawable);
     /// Set command's shader parameters if any. Called internally by View.
     void SetCommandShaderParameters(const RenderPathCommand& command);
     /// Set G-buffer offset and inverse size shader parameters. Called by Batch and internally by View.
     void SetGBufferShaderParameters(const IntVector2& texSize, const IntRect& viewRect);
 
+    /// Return the command buffer for drawing single batches immediately. Called by Batch, which clears it before recording.
+    DrawCommandBuffer& GetScratchCommands() { return scratchCommands_; }
+
     /// Draw a fullscreen quad. Shaders and renderstates must have been set beforehand. Quad will be drawn to the middle of depth range, similarly to deferred directional lights.
     void DrawFullscreenQuad(bool setIdentityProjection = false);
 
@@ -182,6 +271,8 @@ private:
     void GetBaseBatches();
     /// Update geometries and sort batches.
     void UpdateGeometries();
+    /// Record draw commands of the scene pass and light batch queues in worker threads.
+    void RecordBatchQueues();
     /// Get pixel lit batches for a certain light and drawable.
     void GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue);
     /// Execute render commands.
@@ -208,10 +299,16 @@ private:
     void UpdateOccluders(Vector<Drawable*>& occluders, Camera* camera);
     /// Draw occluders to occlusion buffer.
     void DrawOccluders(OcclusionBuffer* buffer, const Vector<Drawable*>& occluders);
+    /// Draw a list of occluders to occlusion buffer, optionally testing also the first one for visibility. Return number of occluders processed before running out of triangles.
+    i32 DrawOccluderList(OcclusionBuffer* buffer, const Vector<Drawable*>& occluders, bool testFirst);
     /// Query for lit geometries and shadow casters for a light.
     void ProcessLight(LightQueryResult& query, i32 threadIndex);
-    /// Process shadow casters' visibilities and build their combined view- or projection-space bounding box.
-    void ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>& drawables, i32 splitIndex);
+    /// Process shadow casters' visibilities and build their combined view- or projection-space bounding box. If the split is not visible, only collects static casters for the cached shadow map.
+    void ProcessShadowCasters(LightQueryResult& query, const Vector<Drawable*>& drawables, i32 splitIndex, bool splitVisible = true);
+    /// Add the shadow batches of a range of shadow casters to a queue, culled for the split's shadow camera.
+    void AddShadowBatches(BatchQueue& queue, Camera* shadowCamera, const Vector<Drawable*>& casters, i32 begin, i32 end);
+    /// Check the light's cached shadow map of static shadow casters and queue the static casters if it must be rendered again.
+    void SetupStaticShadowMap(const LightQueryResult& query, LightBatchQueue& lightQueue);
     /// Set up initial shadow camera view(s).
     void SetupShadowCameras(LightQueryResult& query);
     /// Set up a directional light shadow camera.
@@ -227,6 +324,8 @@ private:
         const Frustum& lightViewFrustum, const BoundingBox& lightViewFrustumBox);
     /// Return the viewport for a shadow map split.
     IntRect GetShadowMapViewport(Light* light, int splitIndex, Texture2D* shadowMap);
+    /// Sort the visible zones for zone searches and index them if they changed.
+    void PrepareZoneSearch();
     /// Find and set a new zone for a drawable when it has moved.
     void FindZone(Drawable* drawable);
     /// Return material technique, considering the drawable's LOD distance.
@@ -235,6 +334,10 @@ private:
     void CheckMaterialForAuxView(Material* material);
     /// Set shader defines for a batch queue if used.
     void SetQueueShaderDefines(BatchQueue& queue, const RenderPathCommand& command);
+    /// Clear the base batch cache if the scene passes or shaders changed since it was filled.
+    void ValidateBaseBatchCache();
+    /// Add the drawable's base batches from the cache if its batch state has not changed. Return false if the batches need to be rebuilt.
+    bool AddCachedBaseBatches(Drawable* drawable);
     /// Choose shaders for a batch and add it to queue.
     void AddBatchToQueue(BatchQueue& queue, Batch& batch, Technique* tech, bool allowInstancing = true, bool allowShadows = true);
     /// Prepare instancing buffer by filling it with all instance transforms.
@@ -245,6 +348,8 @@ private:
     bool NeedRenderShadowMap(const LightBatchQueue& queue);
     /// Render a shadow map.
     void RenderShadowMap(const LightBatchQueue& queue);
+    /// Render the shadow caster batches of each split to the current shadow map, either the static or the other casters.
+    void RenderShadowSplits(const LightBatchQueue& queue, const BiasParameters& parameters, bool staticCasters);
     /// Return the proper depth-stencil surface to use for a rendertarget.
     RenderSurface* GetDepthStencil(RenderSurface* renderTarget);
     /// Helper function to get the render surface from a texture. 2D textures will always return the first face only.
@@ -298,6 +403,10 @@ private:
     Zone* farClipZone_{};
     /// Occlusion buffer for the main camera.
     OcclusionBuffer* occlusionBuffer_{};
+    /// Potentially visible set of the scene. Null if none, or if the camera is outside its cells.
+    const PvsGrid* pvsGrid_{};
+    /// Potentially visible set cell the camera is inside.
+    i32 pvsCell_{NINDEX};
     /// Destination color rendertarget.
     RenderSurface* renderTarget_{};
     /// Substitute rendertarget for deferred rendering. Allocated if necessary.
@@ -328,6 +437,8 @@ private:
     int materialQuality_{};
     /// Maximum number of occluder triangles.
     int maxOccluderTriangles_{};
+    /// Reprojected occlusion frames before a full redraw.
+    i32 temporalOcclusionRefreshInterval_{};
     /// Minimum number of instances required in a batch group to render as instanced.
     int minInstances_{};
     /// Highest zone priority currently visible.
@@ -338,6 +449,14 @@ private:
     bool cameraZoneOverride_{};
     /// Draw shadows flag.
     bool drawShadows_{};
+    /// Threaded octree traversal flag.
+    bool threadedOctreeQueries_{};
+    /// Base batch caching flag.
+    bool cacheBaseBatches_{};
+    /// Temporal occlusion reprojection flag.
+    bool temporalOcclusion_{};
+    /// Static shadow map caching flag.
+    bool cacheStaticShadowMaps_{};
     /// Deferred flag. Inferred from the existence of a light volume command in the renderpath.
     bool deferred_{};
     /// Deferred ambient pass flag. This means that the destination rendertarget is being written to at the same time as albedo/normal/depth buffers, and needs to be RGBA on OpenGL.
@@ -358,6 +477,16 @@ private:
     Vector<PerThreadSceneResult> sceneResults_;
     /// Visible zones.
     Vector<Zone*> zones_;
+    /// Visible zones sorted by descending priority for zone searches.
+    Vector<Zone*> sortedZones_;
+    /// Sorted zones of the current frame, their masks and bounding boxes.
+    Vector<ZoneSetEntry> zoneSet_;
+    /// Sorted zones of the previous frame, their masks and bounding boxes.
+    Vector<ZoneSetEntry> lastZoneSet_;
+    /// Spatial index of the sorted zones. Empty when there are only a few zones.
+    ZoneGrid zoneGrid_;
+    /// ID of the sorted zones. Changes whenever they change.
+    u32 zoneSetId_{};
     /// Visible geometry objects.
     Vector<Drawable*> geometries_;
     /// Geometry objects that will be updated in the main thread.
@@ -366,6 +495,10 @@ private:
     Vector<Drawable*> threadedGeometries_;
     /// Occluder objects.
     Vector<Drawable*> occluders_;
+    /// Occluders with unchanged bounding boxes that need drawing when using temporal occlusion.
+    Vector<Drawable*> stableOccluders_;
+    /// Occluders with changed bounding boxes when using temporal occlusion.
+    Vector<Drawable*> changedOccluders_;
     /// Lights.
     Vector<Light*> lights_;
     /// Number of active occluders.
@@ -385,6 +518,10 @@ private:
     HashMap<hash64, LightBatchQueue> vertexLightQueues_;
     /// Batch queues by pass index.
     HashMap<i32, BatchQueue> batchQueues_;
+    /// Base batches prepared on earlier frames by drawable. Weak keys do not match a new drawable allocated at the address of a destroyed one.
+    HashMap<WeakPtr<Drawable>, BaseBatchCacheEntry> baseBatchCache_;
+    /// Scene pass and shader state the base batch cache was filled with.
+    Vector<u32> baseBatchCacheState_;
     /// Index of the GBuffer pass.
     i32 gBufferPassIndex_{};
     /// Index of the opaque forward base pass.
@@ -405,6 +542,8 @@ private:
     const RenderPathCommand* passCommand_{};
     /// Flag for scene being resolved from the backbuffer.
     bool usedResolve_{};
+    /// Command buffer reused for drawing single batches, e.g. light volumes, so that its storage is not reallocated.
+    DrawCommandBuffer scratchCommands_;
 };
 
 }
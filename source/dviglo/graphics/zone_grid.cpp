@@ -0,0 +1,148 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "zone_grid.h"
+
+#include <algorithm>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+/// Maximum number of cells along an axis.
+static const i32 MAX_CELLS_PER_AXIS = 32;
+/// Number of cells per zone when the grid would otherwise be larger.
+static const i32 CELLS_PER_ZONE = 8;
+/// Minimum cell budget regardless of the zone count.
+static const i32 MIN_CELL_BUDGET = 64;
+/// Relative and absolute expansion of the boxes when assigning them to cells.
+static const float BOX_MARGIN = 0.001f;
+
+/// Return median of the values. Reorders the values.
+static float Median(Vector<float>& values)
+{
+    auto middle = values.Begin() + values.Size() / 2;
+    nth_element(values.Begin(), middle, values.End());
+    return *middle;
+}
+
+void ZoneGrid::Build(const BoundingBox* boxes, i32 count)
+{
+    Clear();
+    if (count <= 0)
+        return;
+
+    // Cells follow the typical zone size. A level-wide zone then spans all cells instead of making every cell level-wide
+    Vector<float> sizes[3];
+    for (Vector<float>& axisSizes : sizes)
+        axisSizes.Reserve(count);
+    for (i32 i = 0; i < count; ++i)
+    {
+        Vector3 size = boxes[i].Size();
+        sizes[0].Push(size.x);
+        sizes[1].Push(size.y);
+        sizes[2].Push(size.z);
+    }
+    Vector3 medianSize(Median(sizes[0]), Median(sizes[1]), Median(sizes[2]));
+
+    BoundingBox bounds;
+    for (i32 i = 0; i < count; ++i)
+    {
+        Vector3 center = boxes[i].Center();
+        bounds.Merge(BoundingBox(center - medianSize * 0.5f, center + medianSize * 0.5f));
+    }
+
+    Vector3 extent = bounds.Size();
+    i32 cells[3];
+    for (i32 axis = 0; axis < 3; ++axis)
+    {
+        float axisSize = medianSize.Data()[axis];
+        float ratio = axisSize > 0.f ? extent.Data()[axis] / axisSize : 1.f;
+        cells[axis] = ratio > 1.f ? (ratio < MAX_CELLS_PER_AXIS ? CeilToInt(ratio) : MAX_CELLS_PER_AXIS) : 1;
+    }
+
+    // Halve the longest axis until the grid fits the cell budget
+    i32 cellBudget = Max(MIN_CELL_BUDGET, count * CELLS_PER_ZONE);
+    while (cells[0] * cells[1] * cells[2] > cellBudget)
+    {
+        i32 longest = cells[0] >= cells[1] && cells[0] >= cells[2] ? 0 : (cells[1] >= cells[2] ? 1 : 2);
+        cells[longest] = (cells[longest] + 1) / 2;
+    }
+
+    origin_ = bounds.min_;
+    numCells_ = IntVector3(cells[0], cells[1], cells[2]);
+    invCellSize_ = Vector3(extent.x > 0.f ? cells[0] / extent.x : 0.f, extent.y > 0.f ? cells[1] / extent.y : 0.f,
+        extent.z > 0.f ? cells[2] / extent.z : 0.f);
+
+    // Count the candidates of each cell, then fill them in box order, so that each cell lists them in ascending order
+    i32 numCells = cells[0] * cells[1] * cells[2];
+    cellStarts_.Resize(numCells + 1, 0);
+
+    for (i32 pass = 0; pass < 2; ++pass)
+    {
+        Vector<i32> cursors;
+        if (pass == 1)
+        {
+            for (i32 i = 0; i < numCells; ++i)
+                cellStarts_[i + 1] += cellStarts_[i];
+            candidates_.Resize(cellStarts_[numCells]);
+            cursors = cellStarts_;
+        }
+
+        for (i32 i = 0; i < count; ++i)
+        {
+            // Oriented zone tests can accept a point slightly outside the world bounding box due to rounding
+            Vector3 margin = boxes[i].Size() * BOX_MARGIN + Vector3(BOX_MARGIN, BOX_MARGIN, BOX_MARGIN);
+            IntVector3 minCell = GetCellCoords(boxes[i].min_ - margin);
+            IntVector3 maxCell = GetCellCoords(boxes[i].max_ + margin);
+
+            for (i32 z = minCell.z; z <= maxCell.z; ++z)
+            {
+                for (i32 y = minCell.y; y <= maxCell.y; ++y)
+                {
+                    for (i32 x = minCell.x; x <= maxCell.x; ++x)
+                    {
+                        i32 cell = (z * numCells_.y + y) * numCells_.x + x;
+                        if (pass == 0)
+                            ++cellStarts_[cell + 1];
+                        else
+                            candidates_[cursors[cell]++] = i;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ZoneGrid::Clear()
+{
+    numCells_ = IntVector3::ZERO;
+    cellStarts_.Clear();
+    candidates_.Clear();
+}
+
+const i32* ZoneGrid::GetCandidates(const Vector3& point, i32& count) const
+{
+    if (cellStarts_.Empty())
+    {
+        count = 0;
+        return nullptr;
+    }
+
+    IntVector3 coords = GetCellCoords(point);
+    i32 cell = (coords.z * numCells_.y + coords.y) * numCells_.x + coords.x;
+    count = cellStarts_[cell + 1] - cellStarts_[cell];
+    return candidates_.Buffer() + cellStarts_[cell];
+}
+
+IntVector3 ZoneGrid::GetCellCoords(const Vector3& point) const
+{
+    Vector3 cell = (point - origin_) * invCellSize_;
+    return IntVector3((i32)Clamp(cell.x, 0.f, (float)(numCells_.x - 1)), (i32)Clamp(cell.y, 0.f, (float)(numCells_.y - 1)),
+        (i32)Clamp(cell.z, 0.f, (float)(numCells_.z - 1)));
+}
+
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/vector.h"
+#include "../math/bounding_box.h"
+
+namespace dviglo
+{
+
+/// Uniform grid over zone bounding boxes for finding the zones that may contain a point.
+class DV_API ZoneGrid
+{
+public:
+    /// Build from zone world bounding boxes. The cell size follows the median box size.
+    void Build(const BoundingBox* boxes, i32 count);
+    /// Clear the grid.
+    void Clear();
+    /// Return indices of the boxes that may contain a point, in ascending order, and their number. Points outside the grid use the nearest cell.
+    const i32* GetCandidates(const Vector3& point, i32& count) const;
+
+    /// Return whether the grid is empty.
+    bool IsEmpty() const { return cellStarts_.Empty(); }
+
+    /// Return number of cells along each axis.
+    const IntVector3& GetNumCells() const { return numCells_; }
+
+private:
+    /// Return cell coordinates of a point, clamped to the grid.
+    IntVector3 GetCellCoords(const Vector3& point) const;
+
+    /// Grid origin.
+    Vector3 origin_{Vector3::ZERO};
+    /// Reciprocal of the cell size.
+    Vector3 invCellSize_{Vector3::ZERO};
+    /// Number of cells along each axis.
+    IntVector3 numCells_{IntVector3::ZERO};
+    /// Start of each cell's candidates, followed by the total number of candidates.
+    Vector<i32> cellStarts_;
+    /// Box indices of all cells.
+    Vector<i32> candidates_;
+};
+
+}
@@ -26,12 +26,13 @@ void ConstantBuffer::SetParameter(unsigned offset, unsigned size, const void* da
         return; // Would overflow the buffer
 
     memcpy(&shadowData_[offset], data, size);
-    dirty_ = true;
+    MarkDirty(offset, size);
 }
 
 void ConstantBuffer::SetVector3ArrayParameter(unsigned offset, unsigned rows, const void* data)
 {
-    if (offset + rows * 4 * sizeof(float) > size_)
+    unsigned size = rows * 4 * sizeof(float);
+    if (offset + size > size_)
         return; // Would overflow the buffer
 
     auto* dest = (float*)&shadowData_[offset];
@@ -45,7 +46,7 @@ void ConstantBuffer::SetVector3ArrayParameter(unsigned offset, unsigned rows, co
         ++dest; // Skip over the w coordinate
     }
 
-    dirty_ = true;
+    MarkDirty(offset, size);
 }
 
 void ConstantBuffer::Release()
@@ -29,18 +29,24 @@ public:
 
     /// Set size and create GPU-side buffer. Return true on success.
     bool SetSize(unsigned size);
-    /// Set a generic parameter and mark buffer dirty.
+    /// Set a generic parameter and add its bytes to the dirty range.
     void SetParameter(unsigned offset, unsigned size, const void* data);
-    /// Set a Vector3 array parameter and mark buffer dirty.
+    /// Set a Vector3 array parameter and add its bytes to the dirty range.
     void SetVector3ArrayParameter(unsigned offset, unsigned rows, const void* data);
-    /// Apply to GPU.
+    /// Apply the dirty range to GPU.
     void Apply();
 
     /// Return size.
     unsigned GetSize() const { return size_; }
 
     /// Return whether has unapplied data.
-    bool IsDirty() const { return dirty_; }
+    bool IsDirty() const { return dirtyEnd_ > dirtyStart_; }
+
+    /// Return start of the byte range that has unapplied data.
+    unsigned GetDirtyStart() const { return dirtyStart_; }
+
+    /// Return end of the byte range that has unapplied data.
+    unsigned GetDirtyEnd() const { return dirtyEnd_; }
 
 private:
 #ifdef DV_OPENGL
@@ -50,12 +56,29 @@ private:
     void Apply_OGL();
 #endif // def DV_OPENGL
 
+    /// Add a byte range to the dirty range.
+    void MarkDirty(unsigned offset, unsigned size)
+    {
+        if (IsDirty())
+        {
+            dirtyStart_ = Min(dirtyStart_, offset);
+            dirtyEnd_ = Max(dirtyEnd_, offset + size);
+        }
+        else
+        {
+            dirtyStart_ = offset;
+            dirtyEnd_ = offset + size;
+        }
+    }
+
     /// Shadow data.
     std::unique_ptr<unsigned char[]> shadowData_;
     /// Buffer byte size.
     unsigned size_{};
-    /// Dirty flag.
-    bool dirty_{};
+    /// Start of the byte range that has unapplied data.
+    unsigned dirtyStart_{};
+    /// End of the byte range that has unapplied data. Equal to the start if nothing to apply.
+    unsigned dirtyEnd_{};
 };
 
 }
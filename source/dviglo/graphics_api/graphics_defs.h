@@ -10,6 +10,7 @@
 #include "../containers/hash_base.h"
 #include "../math/string_hash.h"
 #include "../math/vector3.h"
+#include "shader_parameter_slot.h"
 
 namespace dviglo
 {
@@ -370,72 +371,72 @@ enum ShadowQuality
     SHADOWQUALITY_BLUR_VSM
 };
 
-// Inbuilt shader parameters.
-inline const StringHash VSP_AMBIENTENDCOLOR{"AmbientEndColor"};
-inline const StringHash VSP_AMBIENTSTARTCOLOR{"AmbientStartColor"};
-inline const StringHash VSP_BILLBOARDROT{"BillboardRot"};
-inline const StringHash VSP_CLIPPLANE{"ClipPlane"};
-inline const StringHash VSP_DEPTHMODE{"DepthMode"};
-inline const StringHash VSP_FRUSTUMSIZE{"FrustumSize"};
-inline const StringHash VSP_GBUFFEROFFSETS{"GBufferOffsets"};
-inline const StringHash VSP_MODEL{"Model"};
-inline const StringHash VSP_SKINMATRICES{"SkinMatrices"};
-inline const StringHash VSP_UOFFSET{"UOffset"};
-inline const StringHash VSP_VERTEXLIGHTS{"VertexLights"};
-inline const StringHash VSP_VIEW{"View"};
-inline const StringHash VSP_VIEWINV{"ViewInv"};
-inline const StringHash VSP_VIEWPROJ{"ViewProj"};
-inline const StringHash VSP_VOFFSET{"VOffset"};
-inline const StringHash VSP_ZONE{"Zone"};
-inline const StringHash PSP_AMBIENTCOLOR{"AmbientColor"};
-inline const StringHash PSP_DEPTHRECONSTRUCT{"DepthReconstruct"};
-inline const StringHash PSP_FOGCOLOR{"FogColor"};
-inline const StringHash PSP_FOGPARAMS{"FogParams"};
-inline const StringHash PSP_GBUFFERINVSIZE{"GBufferInvSize"};
-inline const StringHash PSP_LIGHTCOLOR{"LightColor"};
-inline const StringHash PSP_LIGHTLENGTH{"LightLength"};
-inline const StringHash PSP_LIGHTRAD{"LightRad"};
-inline const StringHash PSP_MATDIFFCOLOR{"MatDiffColor"};
-inline const StringHash PSP_MATEMISSIVECOLOR{"MatEmissiveColor"};
-inline const StringHash PSP_MATENVMAPCOLOR{"MatEnvMapColor"};
-inline const StringHash PSP_MATSPECCOLOR{"MatSpecColor"};
-inline const StringHash PSP_METALLIC{"Metallic"};
-inline const StringHash PSP_ROUGHNESS{"Roughness"};
-inline const StringHash PSP_SHADOWCUBEADJUST{"ShadowCubeAdjust"};
-inline const StringHash PSP_SHADOWDEPTHFADE{"ShadowDepthFade"};
-inline const StringHash PSP_SHADOWINTENSITY{"ShadowIntensity"};
-inline const StringHash PSP_SHADOWMAPINVSIZE{"ShadowMapInvSize"};
-inline const StringHash PSP_SHADOWSPLITS{"ShadowSplits"};
-inline const StringHash PSP_VSMSHADOWPARAMS{"VSMShadowParams"};
-inline const StringHash PSP_ZONEMAX{"ZoneMax"};
-inline const StringHash PSP_ZONEMIN{"ZoneMin"};
-
-inline const StringHash VSP_CAMERAPOS{"CameraPos"};
-inline const StringHash PSP_CAMERAPOS{"CameraPosPS"};
-
-inline const StringHash VSP_DELTATIME{"DeltaTime"};
-inline const StringHash PSP_DELTATIME{"DeltaTimePS"};
-
-inline const StringHash VSP_ELAPSEDTIME{"ElapsedTime"};
-inline const StringHash PSP_ELAPSEDTIME{"ElapsedTimePS"};
-
-inline const StringHash VSP_FARCLIP{"FarClip"};
-inline const StringHash PSP_FARCLIP{"FarClipPS"};
-
-inline const StringHash VSP_LIGHTDIR{"LightDir"};
-inline const StringHash PSP_LIGHTDIR{"LightDirPS"};
-
-inline const StringHash VSP_LIGHTMATRICES{"LightMatrices"};
-inline const StringHash PSP_LIGHTMATRICES{"LightMatricesPS"};
-
-inline const StringHash VSP_LIGHTPOS{"LightPos"};
-inline const StringHash PSP_LIGHTPOS{"LightPosPS"};
-
-inline const StringHash VSP_NEARCLIP{"NearClip"};
-inline const StringHash PSP_NEARCLIP{"NearClipPS"};
-
-inline const StringHash VSP_NORMALOFFSETSCALE{"NormalOffsetScale"};
-inline const StringHash PSP_NORMALOFFSETSCALE{"NormalOffsetScalePS"};
+// Inbuilt shader parameters. Slots let the renderer set them without hash map lookups.
+inline const ShaderParameterSlot VSP_AMBIENTENDCOLOR{"AmbientEndColor"};
+inline const ShaderParameterSlot VSP_AMBIENTSTARTCOLOR{"AmbientStartColor"};
+inline const ShaderParameterSlot VSP_BILLBOARDROT{"BillboardRot"};
+inline const ShaderParameterSlot VSP_CLIPPLANE{"ClipPlane"};
+inline const ShaderParameterSlot VSP_DEPTHMODE{"DepthMode"};
+inline const ShaderParameterSlot VSP_FRUSTUMSIZE{"FrustumSize"};
+inline const ShaderParameterSlot VSP_GBUFFEROFFSETS{"GBufferOffsets"};
+inline const ShaderParameterSlot VSP_MODEL{"Model"};
+inline const ShaderParameterSlot VSP_SKINMATRICES{"SkinMatrices"};
+inline const ShaderParameterSlot VSP_UOFFSET{"UOffset"};
+inline const ShaderParameterSlot VSP_VERTEXLIGHTS{"VertexLights"};
+inline const ShaderParameterSlot VSP_VIEW{"View"};
+inline const ShaderParameterSlot VSP_VIEWINV{"ViewInv"};
+inline const ShaderParameterSlot VSP_VIEWPROJ{"ViewProj"};
+inline const ShaderParameterSlot VSP_VOFFSET{"VOffset"};
+inline const ShaderParameterSlot VSP_ZONE{"Zone"};
+inline const ShaderParameterSlot PSP_AMBIENTCOLOR{"AmbientColor"};
+inline const ShaderParameterSlot PSP_DEPTHRECONSTRUCT{"DepthReconstruct"};
+inline const ShaderParameterSlot PSP_FOGCOLOR{"FogColor"};
+inline const ShaderParameterSlot PSP_FOGPARAMS{"FogParams"};
+inline const ShaderParameterSlot PSP_GBUFFERINVSIZE{"GBufferInvSize"};
+inline const ShaderParameterSlot PSP_LIGHTCOLOR{"LightColor"};
+inline const ShaderParameterSlot PSP_LIGHTLENGTH{"LightLength"};
+inline const ShaderParameterSlot PSP_LIGHTRAD{"LightRad"};
+inline const ShaderParameterSlot PSP_MATDIFFCOLOR{"MatDiffColor"};
+inline const ShaderParameterSlot PSP_MATEMISSIVECOLOR{"MatEmissiveColor"};
+inline const ShaderParameterSlot PSP_MATENVMAPCOLOR{"MatEnvMapColor"};
+inline const ShaderParameterSlot PSP_MATSPECCOLOR{"MatSpecColor"};
+inline const ShaderParameterSlot PSP_METALLIC{"Metallic"};
+inline const ShaderParameterSlot PSP_ROUGHNESS{"Roughness"};
+inline const ShaderParameterSlot PSP_SHADOWCUBEADJUST{"ShadowCubeAdjust"};
+inline const ShaderParameterSlot PSP_SHADOWDEPTHFADE{"ShadowDepthFade"};
+inline const ShaderParameterSlot PSP_SHADOWINTENSITY{"ShadowIntensity"};
+inline const ShaderParameterSlot PSP_SHADOWMAPINVSIZE{"ShadowMapInvSize"};
+inline const ShaderParameterSlot PSP_SHADOWSPLITS{"ShadowSplits"};
+inline const ShaderParameterSlot PSP_VSMSHADOWPARAMS{"VSMShadowParams"};
+inline const ShaderParameterSlot PSP_ZONEMAX{"ZoneMax"};
+inline const ShaderParameterSlot PSP_ZONEMIN{"ZoneMin"};
+
+inline const ShaderParameterSlot VSP_CAMERAPOS{"CameraPos"};
+inline const ShaderParameterSlot PSP_CAMERAPOS{"CameraPosPS"};
+
+inline const ShaderParameterSlot VSP_DELTATIME{"DeltaTime"};
+inline const ShaderParameterSlot PSP_DELTATIME{"DeltaTimePS"};
+
+inline const ShaderParameterSlot VSP_ELAPSEDTIME{"ElapsedTime"};
+inline const ShaderParameterSlot PSP_ELAPSEDTIME{"ElapsedTimePS"};
+
+inline const ShaderParameterSlot VSP_FARCLIP{"FarClip"};
+inline const ShaderParameterSlot PSP_FARCLIP{"FarClipPS"};
+
+inline const ShaderParameterSlot VSP_LIGHTDIR{"LightDir"};
+inline const ShaderParameterSlot PSP_LIGHTDIR{"LightDirPS"};
+
+inline const ShaderParameterSlot VSP_LIGHTMATRICES{"LightMatrices"};
+inline const ShaderParameterSlot PSP_LIGHTMATRICES{"LightMatricesPS"};
+
+inline const ShaderParameterSlot VSP_LIGHTPOS{"LightPos"};
+inline const ShaderParameterSlot PSP_LIGHTPOS{"LightPosPS"};
+
+inline const ShaderParameterSlot VSP_NEARCLIP{"NearClip"};
+inline const ShaderParameterSlot PSP_NEARCLIP{"NearClipPS"};
+
+inline const ShaderParameterSlot VSP_NORMALOFFSETSCALE{"NormalOffsetScale"};
+inline const ShaderParameterSlot PSP_NORMALOFFSETSCALE{"NormalOffsetScalePS"};
 
 // Scale calculation from bounding box diagonal.
 inline const Vector3 DOT_SCALE{1 / 3.0f, 1 / 3.0f, 1 / 3.0f};
@@ -14,6 +14,9 @@ using namespace std;
 namespace dviglo
 {
 
+/// A dirty range of at least 1/ORPHAN_DIVISOR of the buffer is uploaded by respecifying the whole buffer.
+static const unsigned ORPHAN_DIVISOR = 2;
+
 void ConstantBuffer::Release_OGL()
 {
     if (gpu_object_name_)
@@ -51,7 +54,7 @@ bool ConstantBuffer::SetSize_OGL(unsigned size)
     size &= 0xfffffff0;
 
     size_ = size;
-    dirty_ = false;
+    dirtyStart_ = dirtyEnd_ = 0;
     shadowData_ = make_unique<unsigned char[]>(size_);
     memset(shadowData_.get(), 0, size_);
 
@@ -70,14 +73,26 @@ bool ConstantBuffer::SetSize_OGL(unsigned size)
 
 void ConstantBuffer::Apply_OGL()
 {
-    if (dirty_ && gpu_object_name_)
+    if (!IsDirty())
+        return;
+
+    if (gpu_object_name_)
     {
 #ifndef GL_ES_VERSION_2_0
         DV_GRAPHICS->SetUBO_OGL(gpu_object_name_);
-        glBufferData(GL_UNIFORM_BUFFER, size_, shadowData_.get(), GL_DYNAMIC_DRAW);
+
+        /* Usually only a few parameters change between draw calls, e.g. the model matrix. Drivers copy such small
+           updates into the command stream, so they do not wait for draw calls still reading the old data. A large
+           update is not worth the copy: respecify the storage from the shadow data instead, which orphans the old
+           storage */
+        if ((dirtyEnd_ - dirtyStart_) * ORPHAN_DIVISOR >= size_)
+            glBufferData(GL_UNIFORM_BUFFER, size_, shadowData_.get(), GL_DYNAMIC_DRAW);
+        else
+            glBufferSubData(GL_UNIFORM_BUFFER, dirtyStart_, dirtyEnd_ - dirtyStart_, &shadowData_[dirtyStart_]);
 #endif
-        dirty_ = false;
     }
+
+    dirtyStart_ = dirtyEnd_ = 0;
 }
 
 }
@@ -649,6 +649,65 @@ bool Graphics::ResolveToTexture_OGL(TextureCube* texture)
 #endif
 }
 
+bool Graphics::CopyDepth_OGL(Texture2D* destination, Texture2D* source)
+{
+#ifndef DV_GLES2
+    if (!destination || !source || destination == source)
+        return false;
+    if (destination->GetUsage() != TEXTURE_DEPTHSTENCIL || source->GetUsage() != TEXTURE_DEPTHSTENCIL)
+        return false;
+    if (destination->GetWidth() != source->GetWidth() || destination->GetHeight() != source->GetHeight() ||
+        destination->GetFormat() != source->GetFormat())
+        return false;
+
+    DV_PROFILE(CopyDepth_OGL);
+
+    GraphicsImpl_OGL* impl = GetImpl_OGL();
+
+    // Use the resolve FBOs to not disturb the currently set rendertarget(s)
+    if (!impl->resolveSrcFBO_)
+        impl->resolveSrcFBO_ = CreateFramebuffer_OGL();
+    if (!impl->resolveDestFBO_)
+        impl->resolveDestFBO_ = CreateFramebuffer_OGL();
+
+    // Blits are clipped by the scissor test and may be masked by depth write
+    if (scissorTest_)
+        glDisable(GL_SCISSOR_TEST);
+    if (!depthWrite_)
+        glDepthMask(GL_TRUE);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, impl->resolveSrcFBO_);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, source->gpu_object_name(), 0);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, impl->resolveDestFBO_);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, destination->gpu_object_name(), 0);
+    glDrawBuffer(GL_NONE);
+    glBlitFramebuffer(0, 0, source->GetWidth(), source->GetHeight(), 0, 0, destination->GetWidth(), destination->GetHeight(),
+        GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    // Detach the depth textures so that the resolve FBOs stay complete for color resolves
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, impl->resolveSrcFBO_);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    if (scissorTest_)
+        glEnable(GL_SCISSOR_TEST);
+    if (!depthWrite_)
+        glDepthMask(GL_FALSE);
+
+    // Restore previously bound FBO
+    BindFramebuffer_OGL(impl->boundFBO_);
+    return true;
+#else
+    // Not supported on GLES 2
+    return false;
+#endif
+}
+
 void Graphics::Draw_OGL(PrimitiveType type, unsigned vertexStart, unsigned vertexCount)
 {
     if (!vertexCount)
@@ -969,7 +1028,7 @@ void Graphics::SetShaders_OGL(ShaderVariation* vs, ShaderVariation* ps)
             }
         }
 
-        SetShaderParameter_OGL(VSP_CLIPPLANE, useClipPlane_ ? clipPlane_ : Vector4(0.0f, 0.0f, 0.0f, 1.0f));
+        SetShaderParameter_OGL(GetShaderParameter_OGL(VSP_CLIPPLANE), useClipPlane_ ? clipPlane_ : Vector4(0.0f, 0.0f, 0.0f, 1.0f));
     }
 #endif
 
@@ -991,333 +1050,293 @@ void Graphics::SetShaders_OGL(ShaderVariation* vs, ShaderVariation* ps)
     impl->vertexBuffersDirty_ = true;
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const float* data, unsigned count)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const float* data, unsigned count)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, (unsigned)(count * sizeof(float)), data);
-                return;
-            }
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, (unsigned)(count * sizeof(float)), data);
+            return;
+        }
 
-            // Если испольузется массив, то в шейдере указывается максимальный размер,
-            // а функции glUniform*v могут заполнять только часть массива:
-            // https://registry.khronos.org/OpenGL-Refpages/gl4/html/glUniform.xhtml
+        // Если испольузется массив, то в шейдере указывается максимальный размер,
+        // а функции glUniform*v могут заполнять только часть массива:
+        // https://registry.khronos.org/OpenGL-Refpages/gl4/html/glUniform.xhtml
 
-            switch (info->glType_)
-            {
-            case GL_FLOAT:
-                glUniform1fv(info->location_, count, data);
-                break;
+        switch (info->glType_)
+        {
+        case GL_FLOAT:
+            glUniform1fv(info->location_, count, data);
+            break;
 
-            case GL_FLOAT_VEC2:
-                glUniform2fv(info->location_, count / 2, data);
-                break;
+        case GL_FLOAT_VEC2:
+            glUniform2fv(info->location_, count / 2, data);
+            break;
 
-            case GL_FLOAT_VEC3:
-                glUniform3fv(info->location_, count / 3, data);
-                break;
+        case GL_FLOAT_VEC3:
+            glUniform3fv(info->location_, count / 3, data);
+            break;
 
-            case GL_FLOAT_VEC4:
-                glUniform4fv(info->location_, count / 4, data);
-                break;
+        case GL_FLOAT_VEC4:
+            glUniform4fv(info->location_, count / 4, data);
+            break;
 
-            case GL_FLOAT_MAT3:
-                glUniformMatrix3fv(info->location_, count / 9, GL_FALSE, data);
-                break;
+        case GL_FLOAT_MAT3:
+            glUniformMatrix3fv(info->location_, count / 9, GL_FALSE, data);
+            break;
 
-            case GL_FLOAT_MAT4:
-                glUniformMatrix4fv(info->location_, count / 16, GL_FALSE, data);
-                break;
+        case GL_FLOAT_MAT4:
+            glUniformMatrix4fv(info->location_, count / 16, GL_FALSE, data);
+            break;
 
-            default: break;
-            }
+        default: break;
         }
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, float value)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, float value)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(float), &value);
-                return;
-            }
-
-            glUniform1fv(info->location_, 1, &value);
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(float), &value);
+            return;
         }
+
+        glUniform1fv(info->location_, 1, &value);
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, int value)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, int value)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(int), &value);
-                return;
-            }
-
-            glUniform1i(info->location_, value);
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(int), &value);
+            return;
         }
+
+        glUniform1i(info->location_, value);
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, bool value)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, bool value)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
     // \todo Not tested
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(bool), &value);
-                return;
-            }
-
-            glUniform1i(info->location_, (int)value);
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(bool), &value);
+            return;
         }
+
+        glUniform1i(info->location_, (int)value);
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const Color& color)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const Color& color)
 {
-    SetShaderParameter_OGL(param, color.Data(), 4);
+    SetShaderParameter_OGL(info, color.Data(), 4);
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const Vector2& vector)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const Vector2& vector)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(Vector2), &vector);
-                return;
-            }
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(Vector2), &vector);
+            return;
+        }
 
-            // Check the uniform type to avoid mismatch
-            switch (info->glType_)
-            {
-            case GL_FLOAT:
-                glUniform1fv(info->location_, 1, vector.Data());
-                break;
+        // Check the uniform type to avoid mismatch
+        switch (info->glType_)
+        {
+        case GL_FLOAT:
+            glUniform1fv(info->location_, 1, vector.Data());
+            break;
 
-            case GL_FLOAT_VEC2:
-                glUniform2fv(info->location_, 1, vector.Data());
-                break;
+        case GL_FLOAT_VEC2:
+            glUniform2fv(info->location_, 1, vector.Data());
+            break;
 
-            default: break;
-            }
+        default: break;
         }
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const Matrix3& matrix)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const Matrix3& matrix)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetVector3ArrayParameter(info->offset_, 3, &matrix);
-                return;
-            }
-
-            glUniformMatrix3fv(info->location_, 1, GL_FALSE, matrix.Data());
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetVector3ArrayParameter(info->offset_, 3, &matrix);
+            return;
         }
+
+        glUniformMatrix3fv(info->location_, 1, GL_FALSE, matrix.Data());
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const Vector3& vector)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const Vector3& vector)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(Vector3), &vector);
-                return;
-            }
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(Vector3), &vector);
+            return;
+        }
 
-            // Check the uniform type to avoid mismatch
-            switch (info->glType_)
-            {
-            case GL_FLOAT:
-                glUniform1fv(info->location_, 1, vector.Data());
-                break;
+        // Check the uniform type to avoid mismatch
+        switch (info->glType_)
+        {
+        case GL_FLOAT:
+            glUniform1fv(info->location_, 1, vector.Data());
+            break;
 
-            case GL_FLOAT_VEC2:
-                glUniform2fv(info->location_, 1, vector.Data());
-                break;
+        case GL_FLOAT_VEC2:
+            glUniform2fv(info->location_, 1, vector.Data());
+            break;
 
-            case GL_FLOAT_VEC3:
-                glUniform3fv(info->location_, 1, vector.Data());
-                break;
+        case GL_FLOAT_VEC3:
+            glUniform3fv(info->location_, 1, vector.Data());
+            break;
 
-            default: break;
-            }
+        default: break;
         }
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const Matrix4& matrix)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const Matrix4& matrix)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(Matrix4), &matrix);
-                return;
-            }
-
-            glUniformMatrix4fv(info->location_, 1, GL_FALSE, matrix.Data());
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(Matrix4), &matrix);
+            return;
         }
+
+        glUniformMatrix4fv(info->location_, 1, GL_FALSE, matrix.Data());
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const Vector4& vector)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const Vector4& vector)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
+    if (info)
     {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+        if (info->bufferPtr_)
         {
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(Vector4), &vector);
-                return;
-            }
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(Vector4), &vector);
+            return;
+        }
 
-            // Check the uniform type to avoid mismatch
-            switch (info->glType_)
-            {
-            case GL_FLOAT:
-                glUniform1fv(info->location_, 1, vector.Data());
-                break;
+        // Check the uniform type to avoid mismatch
+        switch (info->glType_)
+        {
+        case GL_FLOAT:
+            glUniform1fv(info->location_, 1, vector.Data());
+            break;
 
-            case GL_FLOAT_VEC2:
-                glUniform2fv(info->location_, 1, vector.Data());
-                break;
+        case GL_FLOAT_VEC2:
+            glUniform2fv(info->location_, 1, vector.Data());
+            break;
 
-            case GL_FLOAT_VEC3:
-                glUniform3fv(info->location_, 1, vector.Data());
-                break;
+        case GL_FLOAT_VEC3:
+            glUniform3fv(info->location_, 1, vector.Data());
+            break;
 
-            case GL_FLOAT_VEC4:
-                glUniform4fv(info->location_, 1, vector.Data());
-                break;
+        case GL_FLOAT_VEC4:
+            glUniform4fv(info->location_, 1, vector.Data());
+            break;
 
-            default: break;
-            }
+        default: break;
         }
     }
 }
 
-void Graphics::SetShaderParameter_OGL(StringHash param, const Matrix3x4& matrix)
+void Graphics::SetShaderParameter_OGL(const ShaderParameter* info, const Matrix3x4& matrix)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
 
-    if (impl->shaderProgram_)
-    {
-        const ShaderParameter* info = impl->shaderProgram_->GetParameter(param);
-        if (info)
+    if (info)
+    {
+        // Expand to a full Matrix4
+        static Matrix4 fullMatrix;
+        fullMatrix.m00_ = matrix.m00_;
+        fullMatrix.m01_ = matrix.m01_;
+        fullMatrix.m02_ = matrix.m02_;
+        fullMatrix.m03_ = matrix.m03_;
+        fullMatrix.m10_ = matrix.m10_;
+        fullMatrix.m11_ = matrix.m11_;
+        fullMatrix.m12_ = matrix.m12_;
+        fullMatrix.m13_ = matrix.m13_;
+        fullMatrix.m20_ = matrix.m20_;
+        fullMatrix.m21_ = matrix.m21_;
+        fullMatrix.m22_ = matrix.m22_;
+        fullMatrix.m23_ = matrix.m23_;
+
+        if (info->bufferPtr_)
         {
-            // Expand to a full Matrix4
-            static Matrix4 fullMatrix;
-            fullMatrix.m00_ = matrix.m00_;
-            fullMatrix.m01_ = matrix.m01_;
-            fullMatrix.m02_ = matrix.m02_;
-            fullMatrix.m03_ = matrix.m03_;
-            fullMatrix.m10_ = matrix.m10_;
-            fullMatrix.m11_ = matrix.m11_;
-            fullMatrix.m12_ = matrix.m12_;
-            fullMatrix.m13_ = matrix.m13_;
-            fullMatrix.m20_ = matrix.m20_;
-            fullMatrix.m21_ = matrix.m21_;
-            fullMatrix.m22_ = matrix.m22_;
-            fullMatrix.m23_ = matrix.m23_;
-
-            if (info->bufferPtr_)
-            {
-                ConstantBuffer* buffer = info->bufferPtr_;
-                if (!buffer->IsDirty())
-                    impl->dirtyConstantBuffers_.Push(buffer);
-                buffer->SetParameter(info->offset_, sizeof(Matrix4), &fullMatrix);
-                return;
-            }
-
-            glUniformMatrix4fv(info->location_, 1, GL_FALSE, fullMatrix.Data());
+            ConstantBuffer* buffer = info->bufferPtr_;
+            if (!buffer->IsDirty())
+                impl->dirtyConstantBuffers_.Push(buffer);
+            buffer->SetParameter(info->offset_, sizeof(Matrix4), &fullMatrix);
+            return;
         }
+
+        glUniformMatrix4fv(info->location_, 1, GL_FALSE, fullMatrix.Data());
     }
 }
 
@@ -1333,6 +1352,24 @@ bool Graphics::HasShaderParameter_OGL(StringHash param)
     return impl->shaderProgram_ && impl->shaderProgram_->HasParameter(param);
 }
 
+bool Graphics::HasShaderParameter_OGL(const ShaderParameterSlot& param)
+{
+    GraphicsImpl_OGL* impl = GetImpl_OGL();
+    return impl->shaderProgram_ && impl->shaderProgram_->HasParameter(param);
+}
+
+const ShaderParameter* Graphics::GetShaderParameter_OGL(StringHash param)
+{
+    GraphicsImpl_OGL* impl = GetImpl_OGL();
+    return impl->shaderProgram_ ? impl->shaderProgram_->GetParameter(param) : nullptr;
+}
+
+const ShaderParameter* Graphics::GetShaderParameter_OGL(const ShaderParameterSlot& param)
+{
+    GraphicsImpl_OGL* impl = GetImpl_OGL();
+    return impl->shaderProgram_ ? impl->shaderProgram_->GetParameter(param) : nullptr;
+}
+
 bool Graphics::HasTextureUnit_OGL(TextureUnit unit)
 {
     GraphicsImpl_OGL* impl = GetImpl_OGL();
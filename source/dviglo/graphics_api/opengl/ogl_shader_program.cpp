@@ -84,6 +84,7 @@ void ShaderProgram_OGL::Release()
         gpu_object_name_ = 0;
         linkerOutput_.Clear();
         shaderParameters_.Clear();
+        parameterSlots_.Clear();
         vertexAttributes_.Clear();
         usedVertexAttributes_ = 0;
 
@@ -300,6 +301,7 @@ bool ShaderProgram_OGL::Link()
     // Rehash the parameter & vertex attributes maps to ensure minimal load factor
     vertexAttributes_.Rehash(NextPowerOfTwo(vertexAttributes_.Size()));
     shaderParameters_.Rehash(NextPowerOfTwo(shaderParameters_.Size()));
+    ShaderParameterSlot::MapParameters(shaderParameters_, parameterSlots_);
 
     return true;
 }
@@ -8,6 +8,7 @@
 #include "../../containers/ref_counted.h"
 #include "../gpu_object.h"
 #include "../graphics_defs.h"
+#include "../shader_parameter_slot.h"
 #include "../shader_variation.h"
 
 namespace dviglo
@@ -40,12 +41,22 @@ public:
     /// Return whether uses a shader parameter.
     bool HasParameter(StringHash param) const;
 
+    /// Return whether uses a shader parameter.
+    bool HasParameter(const ShaderParameterSlot& param) const { return GetParameter(param) != nullptr; }
+
     /// Return whether uses a texture unit.
     bool HasTextureUnit(TextureUnit unit) const { return useTextureUnits_[unit]; }
 
     /// Return the info for a shader parameter, or null if does not exist.
     const ShaderParameter* GetParameter(StringHash param) const;
 
+    /// Return the info for a shader parameter, or null if does not exist.
+    const ShaderParameter* GetParameter(const ShaderParameterSlot& param) const
+    {
+        i32 index = param.GetIndex();
+        return index >= 0 && index < parameterSlots_.Size() ? parameterSlots_[index] : nullptr;
+    }
+
     /// Return linker output.
     const String& GetLinkerOutput() const { return linkerOutput_; }
 
@@ -75,6 +86,8 @@ private:
     WeakPtr<ShaderVariation> pixelShader_;
     /// Shader parameters.
     HashMap<StringHash, ShaderParameter> shaderParameters_;
+    /// Shader parameters indexed by slot. Null for the slots that the program does not use.
+    Vector<const ShaderParameter*> parameterSlots_;
     /// Texture unit use.
     bool useTextureUnits_[MAX_TEXTURE_UNITS]{};
     /// Vertex attributes.
@@ -0,0 +1,66 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "shader_parameter_slot.h"
+#include "shader_variation.h"
+
+#include <mutex>
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+// Slots of the built-in parameters are registered during static initialization, so the registry is created on first use
+static HashMap<StringHash, i32>& GetSlotRegistry()
+{
+    static HashMap<StringHash, i32> registry;
+    return registry;
+}
+
+static mutex& GetSlotRegistryMutex()
+{
+    static mutex registryMutex;
+    return registryMutex;
+}
+
+ShaderParameterSlot::ShaderParameterSlot(StringHash nameHash) :
+    nameHash_(nameHash)
+{
+    scoped_lock lock(GetSlotRegistryMutex());
+    HashMap<StringHash, i32>& registry = GetSlotRegistry();
+
+    HashMap<StringHash, i32>::ConstIterator i = registry.Find(nameHash);
+    if (i != registry.End())
+    {
+        index_ = i->second_;
+    }
+    else
+    {
+        index_ = registry.Size();
+        registry[nameHash] = index_;
+    }
+}
+
+i32 ShaderParameterSlot::GetNumSlots()
+{
+    scoped_lock lock(GetSlotRegistryMutex());
+    return GetSlotRegistry().Size();
+}
+
+void ShaderParameterSlot::MapParameters(const HashMap<StringHash, ShaderParameter>& parameters, Vector<const ShaderParameter*>& dest)
+{
+    dest.Clear();
+
+    for (HashMap<StringHash, ShaderParameter>::ConstIterator i = parameters.Begin(); i != parameters.End(); ++i)
+    {
+        ShaderParameterSlot slot(i->first_);
+        if (slot.index_ >= dest.Size())
+            dest.Resize(slot.index_ + 1, nullptr);
+        dest[slot.index_] = &i->second_;
+    }
+}
+
+}
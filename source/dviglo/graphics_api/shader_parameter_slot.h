@@ -0,0 +1,46 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../containers/hash_map.h"
+#include "../containers/vector.h"
+#include "../math/string_hash.h"
+
+namespace dviglo
+{
+
+struct ShaderParameter;
+
+/// Shader parameter name hash with a slot index that is the same in all shader programs. Shader programs keep their parameters in arrays indexed by slot, so setting a parameter by slot needs no hash map lookup.
+class DV_API ShaderParameterSlot
+{
+public:
+    /// Construct an invalid slot.
+    ShaderParameterSlot() = default;
+
+    /// Construct from a name hash. The slot is registered on first use of the hash.
+    explicit ShaderParameterSlot(StringHash nameHash);
+
+    /// Return the name hash. Allows using the slot wherever a name hash is expected.
+    operator StringHash() const { return nameHash_; } // NOLINT(google-explicit-constructor)
+
+    /// Return the name hash.
+    StringHash GetNameHash() const { return nameHash_; }
+
+    /// Return the slot index, or NINDEX if invalid.
+    i32 GetIndex() const { return index_; }
+
+    /// Return number of registered slots.
+    static i32 GetNumSlots();
+    /// Fill an array indexed by slot with pointers to the parameters of a shader program. Registers the slots of new names.
+    static void MapParameters(const HashMap<StringHash, ShaderParameter>& parameters, Vector<const ShaderParameter*>& dest);
+
+private:
+    /// Name hash.
+    StringHash nameHash_;
+    /// Slot index.
+    i32 index_{NINDEX};
+};
+
+}
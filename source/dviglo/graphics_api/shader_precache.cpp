@@ -86,6 +86,22 @@ void ShaderPrecache::load_shaders(Graphics* graphics, Deserializer& source)
 {
     DV_LOGDEBUG("Begin precaching shaders");
 
+    Vector<ShaderCombination> combinations;
+    read_combinations(source, combinations);
+
+    for (const ShaderCombination& combination : combinations)
+    {
+        ShaderVariation* vs = graphics->GetShader(VS, combination.vsName_, combination.vsDefines_);
+        ShaderVariation* ps = graphics->GetShader(PS, combination.psName_, combination.psDefines_);
+        // Set the shaders active to actually compile them
+        graphics->SetShaders(vs, ps);
+    }
+
+    DV_LOGDEBUG("End precaching shaders");
+}
+
+void ShaderPrecache::read_combinations(Deserializer& source, Vector<ShaderCombination>& dest)
+{
     XmlFile xmlFile;
     xmlFile.Load(source);
 
@@ -108,15 +124,10 @@ void ShaderPrecache::load_shaders(Graphics* graphics, Deserializer& source)
         }
 #endif
 
-        ShaderVariation* vs = graphics->GetShader(VS, shader.GetAttribute("vs"), vsDefines);
-        ShaderVariation* ps = graphics->GetShader(PS, shader.GetAttribute("ps"), psDefines);
-        // Set the shaders active to actually compile them
-        graphics->SetShaders(vs, ps);
+        dest.Push({shader.GetAttribute("vs"), vsDefines, shader.GetAttribute("ps"), psDefines});
 
         shader = shader.GetNext("shader");
     }
-
-    DV_LOGDEBUG("End precaching shaders");
 }
 
 }
@@ -14,6 +14,19 @@ namespace dviglo
 class Graphics;
 class ShaderVariation;
 
+/// Shader combination listed in a precache file.
+struct ShaderCombination
+{
+    /// Vertex shader name.
+    String vsName_;
+    /// Vertex shader defines.
+    String vsDefines_;
+    /// Pixel shader name.
+    String psName_;
+    /// Pixel shader defines.
+    String psDefines_;
+};
+
 /// Utility class for collecting used shader combinations during runtime for precaching.
 class DV_API ShaderPrecache : public Object
 {
@@ -30,6 +43,8 @@ public:
 
     /// Load shaders from an XML file.
     static void load_shaders(Graphics* graphics, Deserializer& source);
+    /// Read shader combinations from an XML file. Skip combinations that are not supported on the current platform.
+    static void read_combinations(Deserializer& source, Vector<ShaderCombination>& dest);
 
 private:
     /// XML file name.
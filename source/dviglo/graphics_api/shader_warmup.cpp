@@ -0,0 +1,81 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../core/timer.h"
+#include "../graphics/graphics.h"
+#include "../io/log.h"
+#include "../resource/resource_cache.h"
+#include "shader.h"
+#include "shader_warmup.h"
+
+#include "../common/debug_new.h"
+
+using namespace std;
+
+namespace dviglo
+{
+
+ShaderWarmup::ShaderWarmup(Deserializer& source, i32 maxMsPerFrame) :
+    maxMsPerFrame_(Max(maxMsPerFrame, 1))
+{
+    ShaderPrecache::read_combinations(source, combinations_);
+
+    // Read and preprocess the shader sources on the background loader thread. Compiling needs the main thread
+    Graphics* graphics = DV_GRAPHICS;
+    ResourceCache* cache = DV_RES_CACHE;
+    HashSet<String> names;
+
+    for (const ShaderCombination& combination : combinations_)
+    {
+        names.Insert(combination.vsName_);
+        names.Insert(combination.psName_);
+    }
+
+    for (const String& name : names)
+        cache->background_load_resource<Shader>(graphics->GetShaderPath() + name + graphics->GetShaderExtension());
+
+    DV_LOGDEBUG("Begin warming up " + String(combinations_.Size()) + " shader combinations");
+}
+
+bool ShaderWarmup::Update()
+{
+    if (IsFinished())
+        return true;
+
+    Graphics* graphics = DV_GRAPHICS;
+    HiresTimer timer;
+
+    while (!IsFinished())
+    {
+        const ShaderCombination& combination = combinations_[nextCombination_];
+        if (IsLoading(combination.vsName_) || IsLoading(combination.psName_))
+            break;
+
+        ShaderVariation* vs = graphics->GetShader(VS, combination.vsName_, combination.vsDefines_);
+        ShaderVariation* ps = graphics->GetShader(PS, combination.psName_, combination.psDefines_);
+        // Set the shaders active to actually compile them
+        graphics->SetShaders(vs, ps);
+        ++nextCombination_;
+
+        if (timer.GetUSec(false) >= maxMsPerFrame_ * 1000LL)
+            break;
+    }
+
+    if (!IsFinished())
+        return false;
+
+    DV_LOGDEBUG("End warming up shader combinations");
+    return true;
+}
+
+bool ShaderWarmup::IsLoading(const String& name) const
+{
+    Graphics* graphics = DV_GRAPHICS;
+    ResourceCache* cache = DV_RES_CACHE;
+
+    // A source that failed to load is not waited for. Compiling the combination then logs the error
+    return !cache->GetExistingResource<Shader>(graphics->GetShaderPath() + name + graphics->GetShaderExtension()) &&
+        cache->GetNumBackgroundLoadResources() > 0;
+}
+
+}
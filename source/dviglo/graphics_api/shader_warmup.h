@@ -0,0 +1,48 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#pragma once
+
+#include "../core/object.h"
+#include "shader_precache.h"
+
+namespace dviglo
+{
+
+/// Compiles the shader combinations of a precache file over several frames, so that a loading screen stays responsive.
+class DV_API ShaderWarmup : public Object
+{
+    DV_OBJECT(ShaderWarmup);
+
+public:
+    /// Construct from an XML file generated with Graphics::BeginDumpShaders() and begin loading the shader sources in the background.
+    ShaderWarmup(Deserializer& source, i32 maxMsPerFrame);
+
+    /// Compile combinations until the frame time budget is used or a shader source is still loading. Return true when finished.
+    bool Update();
+
+    /// Return whether all combinations have been compiled.
+    bool IsFinished() const { return nextCombination_ >= combinations_.Size(); }
+
+    /// Return number of combinations.
+    i32 GetNumCombinations() const { return combinations_.Size(); }
+
+    /// Return number of compiled combinations.
+    i32 GetNumCompiled() const { return nextCombination_; }
+
+    /// Return the compiled fraction of the combinations.
+    float GetProgress() const { return combinations_.Empty() ? 1.f : (float)nextCombination_ / combinations_.Size(); }
+
+private:
+    /// Return whether a shader source is still loading in the background.
+    bool IsLoading(const String& name) const;
+
+    /// Combinations to compile.
+    Vector<ShaderCombination> combinations_;
+    /// Index of the next combination to compile.
+    i32 nextCombination_{};
+    /// Compile time budget per frame in milliseconds.
+    i32 maxMsPerFrame_;
+};
+
+}
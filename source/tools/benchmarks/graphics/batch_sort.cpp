@@ -0,0 +1,104 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Сравнение сортировки сравнением и поразрядной сортировки очереди батчей
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/batch.h>
+#include <dviglo/math/random.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 NUM_REPEATS = 20;
+
+bool compare_front_to_back(Batch* lhs, Batch* rhs)
+{
+    if (lhs->renderOrder_ != rhs->renderOrder_)
+        return lhs->renderOrder_ < rhs->renderOrder_;
+    else if (lhs->distance_ != rhs->distance_)
+        return lhs->distance_ < rhs->distance_;
+    else
+        return lhs->sortKey_ < rhs->sortKey_;
+}
+
+void run(i32 num_batches)
+{
+    set_random_seed(1);
+
+    BatchQueue queue;
+    queue.Clear(0);
+    queue.batches_.Resize(num_batches);
+
+    // Ключи как у Batch::CalculateSortKey(): шейдеры, очереди источников света, материалы и геометрия
+    for (Batch& batch : queue.batches_)
+    {
+        hash64 shader = (hash64)Random(200) * 97;
+        hash64 material = (hash64)Random(500) * 31;
+        hash64 geometry = (hash64)Random(1000) * 13;
+        batch.sortKey_ = shader << 48u | material << 16u | geometry;
+        batch.distance_ = Random(0.f, 1000.f);
+        batch.renderOrder_ = Random(10) ? DEFAULT_RENDER_ORDER : DEFAULT_RENDER_ORDER + 1;
+    }
+
+    Vector<Batch*> batches;
+    HiresTimer timer;
+    long long comparison_us = 0;
+    long long radix_us = 0;
+
+    for (i32 i = 0; i < NUM_REPEATS; ++i)
+    {
+        batches.Clear();
+        for (Batch& batch : queue.batches_)
+            batches.Push(&batch);
+
+        timer.Reset();
+        sort(batches.Begin(), batches.End(), compare_front_to_back);
+        comparison_us += timer.GetUSec(false);
+
+        Vector<Batch*> sorted = batches;
+
+        batches.Clear();
+        for (Batch& batch : queue.batches_)
+            batches.Push(&batch);
+
+        timer.Reset();
+        queue.SortBatches(batches, BATCH_SORT_FRONT_TO_BACK);
+        radix_us += timer.GetUSec(false);
+
+        // Порядок совпадает, кроме батчей с полностью одинаковыми ключами
+        for (i32 j = 0; j < num_batches; ++j)
+        {
+            if (sorted[j] != batches[j] && (compare_front_to_back(sorted[j], batches[j]) || compare_front_to_back(batches[j], sorted[j])))
+            {
+                PrintLine("Batch sort order mismatch");
+                break;
+            }
+        }
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%8d batches | comparison %8.3f ms | radix %8.3f ms",
+        num_batches, comparison_us / 1000.0 / NUM_REPEATS, radix_us / 1000.0 / NUM_REPEATS);
+    PrintLine(String(line));
+}
+
+} // namespace
+
+void benchmark_graphics_batch_sort()
+{
+    PrintLine("Batch queue front to back sort (" + String(NUM_REPEATS) + " repeats)");
+
+    for (i32 num_batches : {100, 1000, 10000, 100000})
+        run(num_batches);
+}
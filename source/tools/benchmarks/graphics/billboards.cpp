@@ -0,0 +1,130 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Сортировка билбордов по расстоянию и запись вершин: сортировка сравнением и скалярная запись против поразрядной
+// сортировки и записи через SSE
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/billboard_set.h>
+#include <dviglo/math/random.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 NUM_BILLBOARDS = 100000;
+const i32 NUM_REPEATS = 20;
+
+// Запись вершин до SIMD-версии
+void write_scalar(float* dest, Billboard* const* billboards, i32 count)
+{
+    for (i32 i = 0; i < count; ++i)
+    {
+        const Billboard& billboard = *billboards[i];
+        const Vector2& size = billboard.size_;
+        color32 color = billboard.color_.ToU32();
+
+        float rotation[2][2];
+        SinCos(billboard.rotation_, rotation[0][1], rotation[0][0]);
+        rotation[1][0] = -rotation[0][1];
+        rotation[1][1] = rotation[0][0];
+
+        const float corner_uv[4][2] =
+        {
+            {billboard.uv_.min_.x, billboard.uv_.min_.y},
+            {billboard.uv_.max_.x, billboard.uv_.min_.y},
+            {billboard.uv_.max_.x, billboard.uv_.max_.y},
+            {billboard.uv_.min_.x, billboard.uv_.max_.y}
+        };
+        const float corner_signs[4][2] = {{-1.f, 1.f}, {1.f, 1.f}, {1.f, -1.f}, {-1.f, -1.f}};
+
+        for (i32 j = 0; j < 4; ++j)
+        {
+            dest[0] = billboard.position_.x;
+            dest[1] = billboard.position_.y;
+            dest[2] = billboard.position_.z;
+            memcpy(&dest[3], &color, sizeof(color));
+            dest[4] = corner_uv[j][0];
+            dest[5] = corner_uv[j][1];
+            dest[6] = corner_signs[j][0] * size.x * rotation[0][0] + corner_signs[j][1] * size.y * rotation[0][1];
+            dest[7] = corner_signs[j][0] * size.x * rotation[1][0] + corner_signs[j][1] * size.y * rotation[1][1];
+            dest += 8;
+        }
+    }
+}
+
+} // namespace
+
+void benchmark_graphics_billboards()
+{
+    PrintLine("Billboards (" + String(NUM_BILLBOARDS) + " sorted billboards)");
+
+    set_random_seed(1);
+
+    Vector<Billboard> billboards(NUM_BILLBOARDS);
+    for (Billboard& billboard : billboards)
+    {
+        billboard.position_ = Vector3(Random(-100.f, 100.f), Random(0.f, 20.f), Random(-100.f, 100.f));
+        billboard.size_ = Vector2(Random(0.1f, 1.f), Random(0.1f, 1.f));
+        billboard.uv_ = Rect::POSITIVE;
+        billboard.color_ = Color(Random(1.f), Random(1.f), Random(1.f));
+        billboard.rotation_ = Random(360.f);
+        billboard.enabled_ = true;
+    }
+
+    Vector<Billboard*> sorted(NUM_BILLBOARDS);
+    Vector<RadixSortItem> items(NUM_BILLBOARDS);
+    Vector<RadixSortItem> temp(NUM_BILLBOARDS);
+    Vector<float> vertices(NUM_BILLBOARDS * 32);
+
+    HiresTimer timer;
+    long long comparison_sort_us = 0;
+    long long scalar_write_us = 0;
+    long long radix_sort_us = 0;
+    long long simd_write_us = 0;
+
+    for (i32 repeat = 0; repeat < NUM_REPEATS; ++repeat)
+    {
+        // Камера двигается между кадрами
+        Vector3 camera(repeat * 2.f, 10.f, 0.f);
+        for (Billboard& billboard : billboards)
+            billboard.sortDistance_ = (billboard.position_ - camera).LengthSquared();
+
+        timer.Reset();
+        for (i32 i = 0; i < NUM_BILLBOARDS; ++i)
+            sorted[i] = &billboards[i];
+        sort(sorted.Begin(), sorted.End(), [](Billboard* lhs, Billboard* rhs) { return lhs->sortDistance_ > rhs->sortDistance_; });
+        comparison_sort_us += timer.GetUSec(true);
+
+        write_scalar(&vertices[0], &sorted[0], NUM_BILLBOARDS);
+        scalar_write_us += timer.GetUSec(true);
+
+        for (i32 i = 0; i < NUM_BILLBOARDS; ++i)
+            items[i] = RadixSortItem{~FloatToRadixKey(billboards[i].sortDistance_), i};
+        RadixSort(&items[0], &temp[0], NUM_BILLBOARDS, sizeof(u32));
+        for (i32 i = 0; i < NUM_BILLBOARDS; ++i)
+            sorted[i] = &billboards[items[i].index_];
+        radix_sort_us += timer.GetUSec(true);
+
+        WriteBillboardVertices(&vertices[0], &sorted[0], NUM_BILLBOARDS, Vector3::ONE, false);
+        simd_write_us += timer.GetUSec(true);
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "sort: comparison %8.2f ms | radix %8.2f ms", comparison_sort_us / 1000.0 / NUM_REPEATS,
+        radix_sort_us / 1000.0 / NUM_REPEATS);
+    PrintLine(String(line));
+    snprintf(line, sizeof(line), "vertices: scalar %8.2f ms | SSE %8.2f ms", scalar_write_us / 1000.0 / NUM_REPEATS,
+        simd_write_us / 1000.0 / NUM_REPEATS);
+    PrintLine(String(line));
+}
@@ -0,0 +1,170 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Запись очередей батчей в буферы команд: все очереди в главном потоке против записи в рабочих потоках, как в
+// View::RecordBatchQueues()
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/core/work_queue.h>
+#include <dviglo/graphics/batch.h>
+#include <dviglo/graphics/camera.h>
+#include <dviglo/graphics/geometry.h>
+#include <dviglo/graphics/light.h>
+#include <dviglo/graphics/material.h>
+#include <dviglo/graphics/technique.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+// Очереди проходов сцены и освещённые очереди источников света
+const i32 NUM_QUEUES = 16;
+const i32 NUM_BATCHES = 4000;
+const i32 NUM_MATERIALS = 64;
+const i32 NUM_LIGHT_QUEUES = 32;
+const i32 NUM_REPEATS = 20;
+
+void record_queue_work(const WorkItem* item, i32 /*threadIndex*/)
+{
+    static_cast<BatchQueue*>(item->start_)->Record(static_cast<Camera*>(item->aux_), false, false);
+}
+
+} // namespace
+
+void benchmark_graphics_draw_recording()
+{
+    WorkQueue* work_queue = DV_WORK_QUEUE;
+    PrintLine("Batch queue recording (" + String(NUM_QUEUES) + " queues of " + String(NUM_BATCHES) + " batches, "
+        + String(work_queue->GetNumThreads()) + " worker threads)");
+
+    set_random_seed(1);
+
+    SharedPtr<Scene> scene(new Scene());
+    Camera* camera = scene->create_child("Camera")->create_component<Camera>();
+
+    SharedPtr<Technique> technique(new Technique());
+    Pass* pass = technique->CreatePass("base");
+
+    Vector<SharedPtr<Material>> materials;
+    for (i32 i = 0; i < NUM_MATERIALS; ++i)
+    {
+        SharedPtr<Material> material(new Material());
+        material->SetShaderParameter("MatDiffColor", Color(Random(), Random(), Random()));
+        material->SetShaderParameter("MatSpecColor", Vector4(Random(), Random(), Random(), Random(100.f)));
+        materials.Push(material);
+    }
+
+    SharedPtr<Geometry> geometry(new Geometry());
+    geometry->SetDrawRange(TRIANGLE_LIST, 0, 36, 0, 24, false);
+
+    // Вершинное освещение: у каждой очереди свой набор из четырёх источников
+    Vector<Light*> lights;
+    for (i32 i = 0; i < 16; ++i)
+    {
+        Node* node = scene->create_child();
+        node->SetPosition(Vector3(Random(-100.f, 100.f), Random(10.f), Random(-100.f, 100.f)));
+        Light* light = node->create_component<Light>();
+        light->SetLightType(LIGHT_POINT);
+        light->SetRange(Random(5.f, 30.f));
+        lights.Push(light);
+    }
+
+    Vector<LightBatchQueue> light_queues(NUM_LIGHT_QUEUES);
+    for (LightBatchQueue& light_queue : light_queues)
+    {
+        light_queue.light_ = nullptr;
+        for (i32 i = 0; i < 4; ++i)
+            light_queue.vertexLights_.Push(lights[Random(lights.Size())]);
+    }
+
+    // Шейдеры при записи не разыменовываются
+    ShaderVariation* shaders[8];
+    for (i32 i = 0; i < 8; ++i)
+        shaders[i] = reinterpret_cast<ShaderVariation*>((uintptr_t)(i + 1) * 0x100);
+
+    Vector<Matrix3x4> transforms(NUM_QUEUES * NUM_BATCHES);
+    for (Matrix3x4& transform : transforms)
+        transform = Matrix3x4(Vector3(Random(-100.f, 100.f), 0.f, Random(-100.f, 100.f)), Quaternion(Random(360.f), Vector3::UP), 1.f);
+
+    Vector<BatchQueue> queues(NUM_QUEUES);
+    for (i32 i = 0; i < NUM_QUEUES; ++i)
+    {
+        BatchQueue& queue = queues[i];
+        queue.Clear(0);
+        queue.batches_.Resize(NUM_BATCHES);
+
+        for (i32 j = 0; j < NUM_BATCHES; ++j)
+        {
+            Batch& batch = queue.batches_[j];
+            batch.isBase_ = true;
+            batch.distance_ = Random(1000.f);
+            batch.renderOrder_ = DEFAULT_RENDER_ORDER;
+            batch.geometry_ = geometry;
+            batch.material_ = materials[Random(NUM_MATERIALS)];
+            batch.pass_ = pass;
+            batch.vertexShader_ = shaders[Random(4)];
+            batch.pixelShader_ = shaders[4 + Random(4)];
+            batch.worldTransform_ = &transforms[i * NUM_BATCHES + j];
+            batch.numWorldTransforms_ = 1;
+            batch.instancingData_ = nullptr;
+            batch.lightQueue_ = Random(2) ? &light_queues[Random(NUM_LIGHT_QUEUES)] : nullptr;
+            batch.zone_ = nullptr;
+            batch.geometryType_ = GEOM_STATIC;
+            batch.CalculateSortKey();
+        }
+
+        queue.SortFrontToBack();
+    }
+
+    HiresTimer timer;
+    long long serial_us = 0;
+    long long parallel_us = 0;
+    i32 num_commands = 0;
+
+    for (i32 repeat = 0; repeat < NUM_REPEATS; ++repeat)
+    {
+        timer.Reset();
+        for (const BatchQueue& queue : queues)
+            queue.Record(camera, false, false);
+        serial_us += timer.GetUSec(false);
+
+        num_commands = 0;
+        for (const BatchQueue& queue : queues)
+            num_commands += queue.commands_.GetNumCommands();
+
+        timer.Reset();
+        for (BatchQueue& queue : queues)
+        {
+            SharedPtr<WorkItem> item = work_queue->GetFreeItem();
+            item->priority_ = WI_MAX_PRIORITY;
+            item->workFunction_ = record_queue_work;
+            item->start_ = &queue;
+            item->aux_ = camera;
+            work_queue->AddWorkItem(item);
+        }
+        work_queue->Complete(WI_MAX_PRIORITY);
+        parallel_us += timer.GetUSec(false);
+
+        // Рабочие потоки записывают те же команды
+        i32 parallel_commands = 0;
+        for (const BatchQueue& queue : queues)
+            parallel_commands += queue.commands_.GetNumCommands();
+        if (parallel_commands != num_commands)
+            PrintLine("Recorded command count mismatch");
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%d commands | main thread %8.3f ms | work items %8.3f ms",
+        num_commands, serial_us / 1000.0 / NUM_REPEATS, parallel_us / 1000.0 / NUM_REPEATS);
+    PrintLine(String(line));
+}
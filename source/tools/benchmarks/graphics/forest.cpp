@@ -0,0 +1,138 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Лес из StaticModelGroup: отсечение экземпляров по иерархии и выбор LOD для каждого экземпляра
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/camera.h>
+#include <dviglo/graphics/geometry.h>
+#include <dviglo/graphics/model.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/graphics/static_model_group.h>
+#include <dviglo/graphics_api/index_buffer.h>
+#include <dviglo/graphics_api/vertex_buffer.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 NUM_TREES = 100000;
+const float FOREST_SIZE = 2000.f;
+const i32 NUM_FRAMES = 60;
+
+// Куб с двумя уровнями детализации. Содержимое геометрии для отсечения не важно
+SharedPtr<Model> create_tree_model()
+{
+    const Vector3 vertices[8] =
+    {
+        {-1.f, 0.f, -1.f}, {1.f, 0.f, -1.f}, {1.f, 0.f, 1.f}, {-1.f, 0.f, 1.f},
+        {-1.f, 8.f, -1.f}, {1.f, 8.f, -1.f}, {1.f, 8.f, 1.f}, {-1.f, 8.f, 1.f}
+    };
+    const u16 indices[36] =
+    {
+        0, 1, 2, 0, 2, 3, 4, 6, 5, 4, 7, 6, 0, 4, 5, 0, 5, 1,
+        1, 5, 6, 1, 6, 2, 2, 6, 7, 2, 7, 3, 3, 7, 4, 3, 4, 0
+    };
+
+    shared_ptr<VertexBuffer> vertex_buffer = make_shared<VertexBuffer>();
+    vertex_buffer->SetShadowed(true);
+    vertex_buffer->SetSize(8, VertexElements::Position);
+    vertex_buffer->SetData(vertices);
+
+    shared_ptr<IndexBuffer> index_buffer = make_shared<IndexBuffer>();
+    index_buffer->SetShadowed(true);
+    index_buffer->SetSize(36, false);
+    index_buffer->SetData(indices);
+
+    SharedPtr<Model> model(new Model());
+    model->SetVertexBuffers({vertex_buffer}, {0}, {0});
+    model->SetIndexBuffers({index_buffer});
+    model->SetNumGeometries(1);
+    model->SetNumGeometryLodLevels(0, 2);
+
+    for (i32 level = 0; level < 2; ++level)
+    {
+        shared_ptr<Geometry> geometry = make_shared<Geometry>();
+        geometry->SetVertexBuffer(0, vertex_buffer);
+        geometry->SetIndexBuffer(index_buffer);
+        geometry->SetDrawRange(TRIANGLE_LIST, 0, level ? 12 : 36);
+        geometry->SetLodDistance(level ? 100.f : 0.f);
+        model->SetGeometry(0, level, geometry);
+    }
+
+    model->SetBoundingBox(BoundingBox(Vector3(-1.f, 0.f, -1.f), Vector3(1.f, 8.f, 1.f)));
+    return model;
+}
+
+} // namespace
+
+void benchmark_graphics_forest()
+{
+    PrintLine("Forest (" + String(NUM_TREES) + " trees in one StaticModelGroup)");
+
+    set_random_seed(1);
+    SharedPtr<Model> model = create_tree_model();
+
+    SharedPtr<Scene> scene(new Scene());
+    scene->create_component<Octree>();
+
+    StaticModelGroup* group = scene->create_child("Forest")->create_component<StaticModelGroup>();
+    group->SetModel(model);
+    for (i32 i = 0; i < NUM_TREES; ++i)
+    {
+        Node* tree = scene->create_child();
+        tree->SetPosition(Vector3(Random(-FOREST_SIZE, FOREST_SIZE) * 0.5f, 0.f, Random(-FOREST_SIZE, FOREST_SIZE) * 0.5f));
+        tree->SetRotation(Quaternion(Random(360.f), Vector3::UP));
+        tree->SetScale(Random(0.5f, 2.f));
+        group->AddInstanceNode(tree);
+    }
+
+    Node* camera_node = scene->create_child("Camera");
+    camera_node->SetPosition(Vector3(0.f, 2.f, 0.f));
+    Camera* camera = camera_node->create_component<Camera>();
+    camera->SetFarClip(500.f);
+
+    FrameInfo frame{};
+    frame.camera_ = camera;
+    frame.viewSize_ = IntVector2(1920, 1080);
+
+    // Первое обращение строит иерархию
+    HiresTimer timer;
+    group->GetWorldBoundingBox();
+    timer.Reset();
+    group->GetCameraBatches(camera, frame);
+    long long build_us = timer.GetUSec(false);
+
+    long long cull_us = 0;
+    i32 num_visible = 0;
+    i32 num_lod1 = 0;
+
+    for (i32 frame_index = 0; frame_index < NUM_FRAMES; ++frame_index)
+    {
+        ++frame.frameNumber_;
+        camera_node->SetRotation(Quaternion(360.f * frame_index / NUM_FRAMES, Vector3::UP));
+
+        timer.Reset();
+        const Vector<SourceBatch>& batches = group->GetCameraBatches(camera, frame);
+        cull_us += timer.GetUSec(false);
+
+        num_visible = batches[0].numWorldTransforms_ + batches[1].numWorldTransforms_;
+        num_lod1 = batches[1].numWorldTransforms_;
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%d visible trees (%d at LOD 1) | first call with hierarchy build %8.2f ms | culling %8.2f ms/frame",
+        num_visible, num_lod1, build_us / 1000.0, cull_us / 1000.0 / NUM_FRAMES);
+    PrintLine(String(line));
+}
@@ -0,0 +1,122 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Оптимизация геометрии модели: кэш вершин, перерисовка, порядок выборки вершин и объединение дубликатов
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/geometry.h>
+#include <dviglo/graphics/model.h>
+#include <dviglo/graphics_api/index_buffer.h>
+#include <dviglo/graphics_api/vertex_buffer.h>
+#include <dviglo/math/random.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 NUM_RINGS = 100;
+const i32 NUM_SEGMENTS = 200;
+
+// Сфера как после экспорта без сварки вершин: у каждого треугольника свои вершины, порядок треугольников случайный
+SharedPtr<Model> create_sphere()
+{
+    struct Vertex
+    {
+        Vector3 position;
+        Vector3 normal;
+    };
+
+    auto sphere_vertex = [](i32 ring, i32 segment)
+    {
+        float theta = 180.f * ring / NUM_RINGS;
+        float phi = 360.f * (segment % NUM_SEGMENTS) / NUM_SEGMENTS;
+        // Полюса - одна точка, чтобы вершины совпадали побайтно
+        if (ring == 0 || ring == NUM_RINGS)
+            phi = 0.f;
+        Vector3 normal(Sin(theta) * Cos(phi), Cos(theta), Sin(theta) * Sin(phi));
+        return Vertex{normal, normal};
+    };
+
+    Vector<Vertex> vertices;
+    for (i32 ring = 0; ring < NUM_RINGS; ++ring)
+    {
+        for (i32 segment = 0; segment < NUM_SEGMENTS; ++segment)
+        {
+            Vertex v0 = sphere_vertex(ring, segment);
+            Vertex v1 = sphere_vertex(ring, segment + 1);
+            Vertex v2 = sphere_vertex(ring + 1, segment);
+            Vertex v3 = sphere_vertex(ring + 1, segment + 1);
+
+            vertices.Push(v0);
+            vertices.Push(v1);
+            vertices.Push(v2);
+            vertices.Push(v1);
+            vertices.Push(v3);
+            vertices.Push(v2);
+        }
+    }
+
+    // Перемешивание треугольников
+    for (i32 i = vertices.Size() / 3 - 1; i > 0; --i)
+    {
+        i32 j = Random(i + 1);
+        for (i32 k = 0; k < 3; ++k)
+            swap(vertices[i * 3 + k], vertices[j * 3 + k]);
+    }
+
+    Vector<u32> indices(vertices.Size());
+    for (i32 i = 0; i < indices.Size(); ++i)
+        indices[i] = i;
+
+    shared_ptr<VertexBuffer> vertex_buffer = make_shared<VertexBuffer>();
+    vertex_buffer->SetShadowed(true);
+    vertex_buffer->SetSize(vertices.Size(), VertexElements::Position | VertexElements::Normal);
+    vertex_buffer->SetData(&vertices[0]);
+
+    shared_ptr<IndexBuffer> index_buffer = make_shared<IndexBuffer>();
+    index_buffer->SetShadowed(true);
+    index_buffer->SetSize(indices.Size(), true);
+    index_buffer->SetData(&indices[0]);
+
+    shared_ptr<Geometry> geometry = make_shared<Geometry>();
+    geometry->SetVertexBuffer(0, vertex_buffer);
+    geometry->SetIndexBuffer(index_buffer);
+    geometry->SetDrawRange(TRIANGLE_LIST, 0, indices.Size());
+
+    SharedPtr<Model> model(new Model());
+    model->SetVertexBuffers({vertex_buffer}, {0}, {0});
+    model->SetIndexBuffers({index_buffer});
+    model->SetNumGeometries(1);
+    model->SetGeometry(0, 0, geometry);
+    model->SetBoundingBox(BoundingBox(-1.f, 1.f));
+    return model;
+}
+
+} // namespace
+
+void benchmark_graphics_mesh_optimization()
+{
+    PrintLine("Mesh optimization (" + String(NUM_RINGS * NUM_SEGMENTS * 2) + " triangles, FIFO cache of "
+        + String(DEFAULT_VERTEX_CACHE_SIZE) + " vertices)");
+
+    set_random_seed(1);
+    SharedPtr<Model> model = create_sphere();
+
+    HiresTimer timer;
+    MeshOptimizationStats stats = model->OptimizeGeometry();
+    long long optimization_us = timer.GetUSec(false);
+
+    char line[256];
+    snprintf(line, sizeof(line), "ACMR %.3f -> %.3f | vertices %d -> %d | %8.2f ms", stats.acmrBefore_, stats.acmrAfter_,
+        stats.verticesBefore_, stats.verticesAfter_, optimization_us / 1000.0);
+    PrintLine(String(line));
+}
@@ -0,0 +1,256 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Программный растеризатор окклюзии: отрисовка окклюдеров и проверка видимости боксов
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/core/context.h>
+#include <dviglo/graphics/camera.h>
+#include <dviglo/graphics/drawable.h>
+#include <dviglo/graphics/occlusion_buffer.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const i32 NUM_OCCLUDERS = 200;
+const i32 NUM_TESTS = 20000;
+const i32 NUM_FRAMES = 200;
+
+// Единичный куб
+const Vector3 BOX_VERTICES[] =
+{
+    {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f},
+    {-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}
+};
+
+const u16 BOX_INDICES[] =
+{
+    0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5
+};
+
+/// Box occluder.
+class BoxOccluder : public Drawable
+{
+    DV_OBJECT(BoxOccluder);
+
+public:
+    BoxOccluder() :
+        Drawable(DrawableTypes::Geometry)
+    {
+        boundingBox_ = BoundingBox(-0.5f, 0.5f);
+    }
+
+    bool DrawOcclusion(OcclusionBuffer* buffer) override
+    {
+        buffer->SetCullMode(CULL_CCW);
+        return buffer->AddTriangles(node_->GetWorldTransform(), BOX_VERTICES, sizeof(Vector3), BOX_INDICES, sizeof(u16), 0, 36);
+    }
+
+protected:
+    void OnWorldBoundingBoxUpdate() override
+    {
+        worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+    }
+};
+
+void run(bool threaded)
+{
+    set_random_seed(1);
+
+    SharedPtr<Scene> scene(new Scene());
+    Camera* camera = scene->create_child()->create_component<Camera>();
+    camera->SetFarClip(500.f);
+    camera->SetAspectRatio(16.f / 9.f);
+
+    Vector<Matrix3x4> occluders;
+    for (i32 i = 0; i < NUM_OCCLUDERS; ++i)
+    {
+        Vector3 position(Random(-150.f, 150.f), Random(-40.f, 40.f), Random(20.f, 300.f));
+        Vector3 scale(Random(2.f, 30.f), Random(2.f, 30.f), Random(2.f, 30.f));
+        occluders.Push(Matrix3x4(position, Quaternion(Random(360.f), Vector3::UP), scale));
+    }
+
+    Vector<BoundingBox> tests;
+    for (i32 i = 0; i < NUM_TESTS; ++i)
+    {
+        Vector3 center(Random(-200.f, 200.f), Random(-60.f, 60.f), Random(10.f, 450.f));
+        tests.Push(BoundingBox(center - Vector3::ONE, center + Vector3::ONE));
+    }
+
+    SharedPtr<OcclusionBuffer> buffer(new OcclusionBuffer());
+    buffer->SetSize(256, 144, threaded);
+    buffer->SetMaxTriangles(NUM_OCCLUDERS * 12);
+    buffer->SetView(camera);
+    buffer->SetCullMode(CULL_CCW);
+
+    HiresTimer timer;
+    long long draw_us = 0;
+    long long test_us = 0;
+    i32 num_visible = 0;
+
+    for (i32 frame = 0; frame < NUM_FRAMES; ++frame)
+    {
+        timer.Reset();
+
+        buffer->Reset();
+        buffer->Clear();
+        for (const Matrix3x4& model : occluders)
+            buffer->AddTriangles(model, BOX_VERTICES, sizeof(Vector3), BOX_INDICES, sizeof(u16), 0, 36);
+        buffer->DrawTriangles();
+        buffer->BuildDepthHierarchy();
+
+        draw_us += timer.GetUSec(true);
+
+        num_visible = 0;
+        for (const BoundingBox& box : tests)
+        {
+            if (buffer->IsVisible(box))
+                ++num_visible;
+        }
+
+        test_us += timer.GetUSec(true);
+    }
+
+    // String::AppendWithFormat() does not support width and precision
+    char line[256];
+    snprintf(line, sizeof(line), "%-12s draw %8.3f ms/frame | test %8.3f ms/frame | triangles %u | visible %d",
+        threaded ? "threaded" : "single", draw_us / 1000.0 / NUM_FRAMES, test_us / 1000.0 / NUM_FRAMES,
+        buffer->GetNumTriangles(), num_visible);
+    PrintLine(String(line));
+}
+
+// Камера плавно движется, каждый десятый окклюдер движется каждый кадр.
+// Сравнивается с полной перерисовкой каждого кадра: боксы, которые полная перерисовка считает видимыми,
+// а перепроецирование - невидимыми, считаются ошибками
+void run_temporal(bool temporal)
+{
+    set_random_seed(1);
+
+    SharedPtr<Scene> scene(new Scene());
+    Node* camera_node = scene->create_child();
+    Camera* camera = camera_node->create_component<Camera>();
+    camera->SetFarClip(500.f);
+    camera->SetAspectRatio(16.f / 9.f);
+
+    Vector<Drawable*> occluders;
+    for (i32 i = 0; i < NUM_OCCLUDERS; ++i)
+    {
+        Node* node = scene->create_child();
+        node->SetPosition(Vector3(Random(-150.f, 150.f), Random(-40.f, 40.f), Random(20.f, 300.f)));
+        node->SetRotation(Quaternion(Random(360.f), Vector3::UP));
+        node->SetScale(Vector3(Random(2.f, 30.f), Random(2.f, 30.f), Random(2.f, 30.f)));
+        occluders.Push(node->create_component<BoxOccluder>());
+    }
+
+    Vector<BoundingBox> tests;
+    for (i32 i = 0; i < NUM_TESTS; ++i)
+    {
+        Vector3 center(Random(-200.f, 200.f), Random(-60.f, 60.f), Random(10.f, 450.f));
+        tests.Push(BoundingBox(center - Vector3::ONE, center + Vector3::ONE));
+    }
+
+    SharedPtr<OcclusionBuffer> buffer(new OcclusionBuffer());
+    SharedPtr<OcclusionBuffer> reference(new OcclusionBuffer());
+    Vector<Drawable*> stable;
+    Vector<Drawable*> changed;
+
+    HiresTimer timer;
+    long long draw_us = 0;
+    i32 num_visible = 0;
+    i32 num_errors = 0;
+    i32 num_reprojected = 0;
+
+    for (i32 frame = 0; frame < NUM_FRAMES; ++frame)
+    {
+        camera_node->SetPosition(Vector3(0.f, 0.f, frame * 0.1f));
+        camera_node->SetRotation(Quaternion(frame * 0.1f, Vector3::UP));
+
+        for (i32 i = 0; i < NUM_OCCLUDERS; i += 10)
+            occluders[i]->GetNode()->Translate(Vector3(0.05f, 0.f, 0.f));
+
+        timer.Reset();
+
+        buffer->SetSize(256, 144, false);
+        buffer->SetView(camera);
+        buffer->SetMaxTriangles(NUM_OCCLUDERS * 12);
+        buffer->Reset();
+        buffer->Clear();
+
+        if (temporal)
+        {
+            bool reprojected = buffer->BeginTemporalFrame(occluders, 4, stable, changed);
+            if (reprojected)
+                ++num_reprojected;
+            for (Drawable* occluder : stable)
+                occluder->DrawOcclusion(buffer);
+            buffer->DrawTriangles();
+            if (!reprojected)
+                buffer->SaveTemporalDepth(stable, stable.Size());
+            for (Drawable* occluder : changed)
+                occluder->DrawOcclusion(buffer);
+        }
+        else
+        {
+            for (Drawable* occluder : occluders)
+                occluder->DrawOcclusion(buffer);
+        }
+
+        buffer->DrawTriangles();
+        buffer->BuildDepthHierarchy();
+
+        draw_us += timer.GetUSec(true);
+
+        reference->SetSize(256, 144, false);
+        reference->SetView(camera);
+        reference->SetMaxTriangles(NUM_OCCLUDERS * 12);
+        reference->Reset();
+        reference->Clear();
+        for (Drawable* occluder : occluders)
+            occluder->DrawOcclusion(reference);
+        reference->DrawTriangles();
+        reference->BuildDepthHierarchy();
+
+        num_visible = 0;
+        for (const BoundingBox& box : tests)
+        {
+            bool visible = buffer->IsVisible(box);
+            if (visible)
+                ++num_visible;
+            else if (reference->IsVisible(box))
+                ++num_errors;
+        }
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-12s draw %8.3f ms/frame | reprojected frames %d | visible %d | wrongly occluded %d in all frames",
+        temporal ? "temporal" : "full", draw_us / 1000.0 / NUM_FRAMES, num_reprojected, num_visible, num_errors);
+    PrintLine(String(line));
+}
+
+} // namespace
+
+void benchmark_graphics_occlusion()
+{
+    PrintLine("Occlusion buffer (" + String(NUM_OCCLUDERS) + " box occluders, " + String(NUM_TESTS) + " box tests)");
+
+    for (bool threaded : {false, true})
+        run(threaded);
+
+    DV_CONTEXT->RegisterFactory<BoxOccluder>();
+    PrintLine("Moving camera");
+
+    for (bool temporal : {false, true})
+        run_temporal(temporal);
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Обновление частиц: SoA-хранилище с SIMD-ядрами, эмиттеры обновляются параллельно в Octree::Update()
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/graphics/particle_effect.h>
+#include <dviglo/graphics/particle_emitter.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const i32 NUM_EMITTERS = 500;
+const i32 NUM_PARTICLES = 1000;
+// Эмиттер выпускает не больше 100 частиц за кадр, поэтому сначала ждём заполнения
+const i32 NUM_WARMUP_FRAMES = 20;
+const i32 NUM_FRAMES = 60;
+
+SharedPtr<ParticleEffect> create_effect()
+{
+    SharedPtr<ParticleEffect> effect(new ParticleEffect());
+    effect->SetNumParticles(NUM_PARTICLES);
+    effect->SetUpdateInvisible(true);
+    effect->SetEmitterType(EMITTER_SPHERE);
+    effect->SetEmitterSize(Vector3::ONE);
+    effect->SetMinEmissionRate(10000.f);
+    effect->SetMaxEmissionRate(10000.f);
+    effect->SetMinTimeToLive(100.f);
+    effect->SetMaxTimeToLive(100.f);
+    effect->SetMinVelocity(1.f);
+    effect->SetMaxVelocity(2.f);
+    effect->SetConstantForce(Vector3(0.f, -9.8f, 0.f));
+    effect->SetDampingForce(0.2f);
+    effect->SetSizeAdd(0.1f);
+    effect->SetSizeMul(1.01f);
+    effect->SetMinRotationSpeed(-45.f);
+    effect->SetMaxRotationSpeed(45.f);
+    effect->SetColorFrames({ColorFrame(Color::WHITE, 0.f), ColorFrame(Color::RED, 50.f), ColorFrame(Color::BLACK, 100.f)});
+    return effect;
+}
+
+} // namespace
+
+void benchmark_graphics_particles()
+{
+    PrintLine("Particles (" + String(NUM_EMITTERS) + " emitters, " + String(NUM_EMITTERS * NUM_PARTICLES) + " particles)");
+
+    set_random_seed(1);
+    SharedPtr<ParticleEffect> effect = create_effect();
+
+    SharedPtr<Scene> scene(new Scene());
+    Octree* octree = scene->create_component<Octree>();
+
+    Vector<ParticleEmitter*> emitters;
+    for (i32 i = 0; i < NUM_EMITTERS; ++i)
+    {
+        Node* node = scene->create_child();
+        node->SetPosition(Vector3(Random(-200.f, 200.f), 0.f, Random(-200.f, 200.f)));
+        ParticleEmitter* emitter = node->create_component<ParticleEmitter>();
+        emitter->SetEffect(effect);
+        emitters.Push(emitter);
+    }
+
+    FrameInfo frame{};
+    frame.timeStep_ = 1.f / 60.f;
+
+    HiresTimer timer;
+    long long update_us = 0;
+
+    for (i32 frame_index = 0; frame_index < NUM_WARMUP_FRAMES + NUM_FRAMES; ++frame_index)
+    {
+        ++frame.frameNumber_;
+
+        // Эмиттеры запрашивают обновление в E_SCENEPOSTUPDATE, а обновляются в Octree::Update()
+        scene->Update(frame.timeStep_);
+        timer.Reset();
+        octree->Update(frame);
+        if (frame_index >= NUM_WARMUP_FRAMES)
+            update_us += timer.GetUSec(false);
+    }
+
+    i32 num_active = 0;
+    for (ParticleEmitter* emitter : emitters)
+    {
+        for (const Billboard& billboard : emitter->GetBillboards())
+            num_active += billboard.enabled_;
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%d active particles | update %8.2f ms/frame", num_active,
+        update_us / 1000.0 / NUM_FRAMES);
+    PrintLine(String(line));
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Дефайны шейдеров прохода: все комбинации сразу (как раньше) и только используемые комбинации из таблицы
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/pass_shader_table.h>
+#include <dviglo/math/random.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const i32 NUM_PASSES = 300;
+const i32 NUM_REPEATS = 20;
+// Типичная сцена: статика, скининг и инстансинг под направленным светом с тенью и точечными светами без теней
+const i32 USED_VERTEX_SHADERS[] =
+{
+    (i32)GEOM_STATIC * MAX_LIGHT_VS_VARIATIONS + LVS_SHADOW,
+    (i32)GEOM_STATIC * MAX_LIGHT_VS_VARIATIONS + LVS_POINT,
+    (i32)GEOM_SKINNED * MAX_LIGHT_VS_VARIATIONS + LVS_SHADOW,
+    (i32)GEOM_SKINNED * MAX_LIGHT_VS_VARIATIONS + LVS_POINT,
+    (i32)GEOM_INSTANCED * MAX_LIGHT_VS_VARIATIONS + LVS_SHADOW,
+    (i32)GEOM_INSTANCED * MAX_LIGHT_VS_VARIATIONS + LVS_POINT
+};
+const i32 USED_PIXEL_SHADERS[] = {LPS_SHADOWSPEC, LPS_POINTSPEC};
+
+// Вариации, склеиваемые так же, как раньше в Renderer::LoadPassShaders()
+const char* GEOMETRY_VARIATIONS[] = {"", "SKINNED ", "INSTANCED ", "BILLBOARD ", "DIRBILLBOARD ", "TRAILFACECAM ", "TRAILBONE "};
+const char* LIGHT_VS_VARIATIONS[] =
+{
+    "PERPIXEL DIRLIGHT ", "PERPIXEL SPOTLIGHT ", "PERPIXEL POINTLIGHT ", "PERPIXEL DIRLIGHT SHADOW ", "PERPIXEL SPOTLIGHT SHADOW ",
+    "PERPIXEL POINTLIGHT SHADOW ", "PERPIXEL DIRLIGHT SHADOW NORMALOFFSET ", "PERPIXEL SPOTLIGHT SHADOW NORMALOFFSET ",
+    "PERPIXEL POINTLIGHT SHADOW NORMALOFFSET "
+};
+const char* HEIGHT_FOG_VARIATIONS[] = {"", "HEIGHTFOG "};
+
+} // namespace
+
+void benchmark_graphics_pass_shaders()
+{
+    PrintLine("Pass shader defines (" + String(NUM_PASSES) + " lit passes, " + String(NUM_REPEATS) + " shader reloads)");
+
+    set_random_seed(1);
+
+    Vector<String> pass_defines(NUM_PASSES);
+    for (String& defines : pass_defines)
+        defines = "DIFFMAP NORMALMAP " + String(Random(1000)) + " ";
+
+    const String shadow_defines = "PCF_SHADOW ";
+    i64 total_length = 0;
+
+    // Все 63 вершинные и 32 пиксельные комбинации каждого прохода при первом использовании
+    HiresTimer timer;
+    i32 eager_count = 0;
+    for (i32 repeat = 0; repeat < NUM_REPEATS; ++repeat)
+    {
+        for (const String& defines : pass_defines)
+        {
+            for (i32 j = 0; j < (i32)MAX_GEOMETRYTYPES * MAX_LIGHT_VS_VARIATIONS; ++j)
+            {
+                String vs_defines = defines + LIGHT_VS_VARIATIONS[j % MAX_LIGHT_VS_VARIATIONS] + GEOMETRY_VARIATIONS[j / MAX_LIGHT_VS_VARIATIONS];
+                total_length += vs_defines.Length();
+                ++eager_count;
+            }
+
+            for (i32 j = 0; j < MAX_LIGHT_PS_VARIATIONS * 2; ++j)
+            {
+                i32 light = j % MAX_LIGHT_PS_VARIATIONS;
+                String ps_defines = (light & LPS_SHADOW) ? defines + PassShaderTable::GetLightPSVariation(light) + shadow_defines +
+                    HEIGHT_FOG_VARIATIONS[j / MAX_LIGHT_PS_VARIATIONS] : defines + PassShaderTable::GetLightPSVariation(light) +
+                    HEIGHT_FOG_VARIATIONS[j / MAX_LIGHT_PS_VARIATIONS];
+                total_length += ps_defines.Length();
+                ++eager_count;
+            }
+        }
+    }
+    long long eager_us = timer.GetUSec(true);
+
+    // Таблица: только комбинации, которые встречаются в сцене
+    Vector<PassShaderTable> tables(NUM_PASSES);
+    i32 lazy_count = 0;
+    for (i32 repeat = 0; repeat < NUM_REPEATS; ++repeat)
+    {
+        for (i32 i = 0; i < NUM_PASSES; ++i)
+        {
+            PassShaderTable& table = tables[i];
+            table.Define(LIGHTING_PERPIXEL, "LitSolid", "LitSolid", pass_defines[i], pass_defines[i], shadow_defines);
+
+            for (i32 index : USED_VERTEX_SHADERS)
+            {
+                total_length += table.GetVertexShaderDefines(index).Length();
+                ++lazy_count;
+            }
+
+            for (i32 index : USED_PIXEL_SHADERS)
+            {
+                total_length += table.GetPixelShaderDefines(index).Length();
+                ++lazy_count;
+            }
+        }
+    }
+    long long lazy_us = timer.GetUSec(false);
+
+    char line[256];
+    snprintf(line, sizeof(line), "all combinations %7d defines %8.2f ms | used combinations %7d defines %8.2f ms | %lld chars",
+        eager_count, eager_us / 1000.0, lazy_count, lazy_us / 1000.0, total_length);
+    PrintLine(String(line));
+}
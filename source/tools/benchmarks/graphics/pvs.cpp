@@ -0,0 +1,195 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Потенциально видимое множество: запекание для уровня из комнат и отсечение объектов из ячейки камеры
+
+#include <dviglo/core/context.h>
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/core/work_queue.h>
+#include <dviglo/graphics/camera.h>
+#include <dviglo/graphics/occlusion_buffer.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/graphics/potentially_visible_set.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+// 8x8 комнат 10x10 м с дверными проёмами в случайных местах
+const i32 NUM_ROOMS = 8;
+const float ROOM_SIZE = 10.f;
+const float WALL_HEIGHT = 4.f;
+const float WALL_THICKNESS = 0.4f;
+const float DOOR_WIDTH = 1.5f;
+const i32 PROPS_PER_ROOM = 30;
+const i32 NUM_VIEWS = 500;
+
+// Единичный куб
+const Vector3 BOX_VERTICES[] =
+{
+    {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f},
+    {-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}
+};
+
+const u16 BOX_INDICES[] =
+{
+    0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5
+};
+
+/// Box drawable. Walls are occluders.
+class PvsBox : public Drawable
+{
+    DV_OBJECT(PvsBox);
+
+public:
+    PvsBox() :
+        Drawable(DrawableTypes::Geometry)
+    {
+        boundingBox_ = BoundingBox(-0.5f, 0.5f);
+    }
+
+    bool DrawOcclusion(OcclusionBuffer* buffer) override
+    {
+        buffer->SetCullMode(CULL_CCW);
+        return buffer->AddTriangles(node_->GetWorldTransform(), BOX_VERTICES, sizeof(Vector3), BOX_INDICES, sizeof(u16), 0, 36);
+    }
+
+protected:
+    void OnWorldBoundingBoxUpdate() override
+    {
+        worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+    }
+};
+
+void create_box(Scene* scene, const Vector3& center, const Vector3& size, bool occluder)
+{
+    Node* node = scene->create_child();
+    node->SetPosition(center);
+    node->SetScale(size);
+    node->create_component<PvsBox>()->SetOccluder(occluder);
+}
+
+// Стена вдоль оси X (along_x) или Z, с проёмом или без
+void create_wall(Scene* scene, const Vector3& start, bool along_x, bool door)
+{
+    Vector3 axis = along_x ? Vector3::RIGHT : Vector3::FORWARD;
+    Vector3 thickness = along_x ? Vector3(0.f, WALL_HEIGHT, WALL_THICKNESS) : Vector3(WALL_THICKNESS, WALL_HEIGHT, 0.f);
+    Vector3 base = start + Vector3(0.f, WALL_HEIGHT * 0.5f, 0.f);
+
+    if (!door)
+    {
+        create_box(scene, base + axis * ROOM_SIZE * 0.5f, thickness + axis * ROOM_SIZE, true);
+        return;
+    }
+
+    float door_start = Random(1.f, ROOM_SIZE - 1.f - DOOR_WIDTH);
+    float door_end = door_start + DOOR_WIDTH;
+    create_box(scene, base + axis * door_start * 0.5f, thickness + axis * door_start, true);
+    create_box(scene, base + axis * (door_end + ROOM_SIZE) * 0.5f, thickness + axis * (ROOM_SIZE - door_end), true);
+}
+
+} // namespace
+
+void benchmark_graphics_pvs()
+{
+    PrintLine("Potentially visible set (" + String(NUM_ROOMS) + "x" + String(NUM_ROOMS) + " rooms, "
+        + String(DV_WORK_QUEUE->GetNumThreads()) + " worker threads)");
+
+    DV_CONTEXT->RegisterFactory<PvsBox>();
+    set_random_seed(1);
+
+    SharedPtr<Scene> scene(new Scene());
+    Octree* octree = scene->create_component<Octree>();
+
+    // Стены лежат на границах ячеек, наружные стены сдвинуты внутрь сетки
+    const float half_size = NUM_ROOMS * ROOM_SIZE * 0.5f;
+    const float outer_offset = WALL_THICKNESS * 0.5f;
+
+    for (i32 i = 0; i <= NUM_ROOMS; ++i)
+    {
+        float line = -half_size + i * ROOM_SIZE;
+        if (i == 0)
+            line += outer_offset;
+        else if (i == NUM_ROOMS)
+            line -= outer_offset;
+
+        for (i32 j = 0; j < NUM_ROOMS; ++j)
+        {
+            float start = -half_size + j * ROOM_SIZE;
+            bool door = i > 0 && i < NUM_ROOMS;
+            create_wall(scene, Vector3(start, 0.f, line), true, door);
+            create_wall(scene, Vector3(line, 0.f, start), false, door);
+        }
+    }
+
+    for (i32 i = 0; i < NUM_ROOMS * NUM_ROOMS * PROPS_PER_ROOM; ++i)
+    {
+        Vector3 center(Random(-half_size + 1.f, half_size - 1.f), 0.5f, Random(-half_size + 1.f, half_size - 1.f));
+        create_box(scene, center, Vector3(0.6f, 1.f, 0.6f), false);
+    }
+
+    // Две ячейки на комнату вдоль каждой горизонтальной оси
+    BoundingBox bounds(Vector3(-half_size, 0.f, -half_size), Vector3(half_size, WALL_HEIGHT, half_size));
+    PotentiallyVisibleSet* pvs = scene->create_component<PotentiallyVisibleSet>();
+
+    HiresTimer timer;
+    pvs->Bake(bounds, IntVector3(NUM_ROOMS * 2, 1, NUM_ROOMS * 2));
+    long long bake_us = timer.GetUSec(false);
+
+    const PvsGrid& grid = pvs->GetData()->GetGrid();
+    i32 total_visible_cells = 0;
+    for (i32 i = 0; i < grid.GetTotalCells(); ++i)
+        total_visible_cells += grid.GetNumVisibleCells(i);
+
+    Node* camera_node = scene->create_child("Camera");
+    Camera* camera = camera_node->create_component<Camera>();
+    camera->SetFarClip(200.f);
+    camera->SetAspectRatio(16.f / 9.f);
+
+    Vector<Drawable*> drawables;
+    i64 num_frustum = 0;
+    i64 num_pvs = 0;
+    long long query_us = 0;
+    long long filter_us = 0;
+
+    for (i32 view = 0; view < NUM_VIEWS; ++view)
+    {
+        camera_node->SetPosition(Vector3(Random(-half_size + 1.f, half_size - 1.f), 1.7f, Random(-half_size + 1.f, half_size - 1.f)));
+        camera_node->SetRotation(Quaternion(Random(360.f), Vector3::UP));
+
+        timer.Reset();
+        drawables.Clear();
+        FrustumOctreeQuery query(drawables, camera->GetFrustum(), DrawableTypes::Geometry);
+        octree->GetDrawables(query);
+        query_us += timer.GetUSec(true);
+
+        i32 cell = grid.GetCellIndex(camera_node->GetWorldPosition());
+        for (Drawable* drawable : drawables)
+        {
+            if (grid.IsVisible(cell, drawable->GetWorldBoundingBox()))
+                ++num_pvs;
+        }
+        filter_us += timer.GetUSec(false);
+        num_frustum += drawables.Size();
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "bake %d cells in %8.2f ms | %.1f of %d cells visible on average | matrix %d bytes",
+        grid.GetTotalCells(), bake_us / 1000.0, (double)total_visible_cells / grid.GetTotalCells(), grid.GetTotalCells(),
+        grid.GetDataSize());
+    PrintLine(String(line));
+    snprintf(line, sizeof(line), "frustum %8.1f drawables/view (%6.3f ms) | after PVS %8.1f drawables/view (+%6.3f ms)",
+        (double)num_frustum / NUM_VIEWS, query_us / 1000.0 / NUM_VIEWS, (double)num_pvs / NUM_VIEWS, filter_us / 1000.0 / NUM_VIEWS);
+    PrintLine(String(line));
+}
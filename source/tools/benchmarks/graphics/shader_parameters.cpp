@@ -0,0 +1,151 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Установка параметров шейдера: поиск по хешу имени (как раньше) и по слоту.
+// Без GPU: параметры пишутся в теневые копии константных буферов, как в Graphics::SetShaderParameter()
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics_api/constant_buffer.h>
+#include <dviglo/graphics_api/shader_variation.h>
+#include <dviglo/math/matrix4.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const i32 NUM_BATCHES = 10000;
+const i32 NUM_REPEATS = 20;
+
+// Параметры освещённого прохода с тенью, сгруппированные по константным буферам
+struct ParameterDesc
+{
+    ShaderParameterSlot slot;
+    ShaderParameterGroup group;
+    unsigned size;
+};
+
+const unsigned VEC4 = sizeof(Vector4);
+const unsigned MAT4 = sizeof(Matrix4);
+const unsigned SKIN_MATRICES_SIZE = 64 * 3 * VEC4;
+
+const ParameterDesc PARAMETERS[] =
+{
+    {VSP_DELTATIME, SP_FRAME, VEC4}, {VSP_ELAPSEDTIME, SP_FRAME, VEC4},
+    {VSP_CAMERAPOS, SP_CAMERA, VEC4}, {VSP_NEARCLIP, SP_CAMERA, VEC4}, {VSP_FARCLIP, SP_CAMERA, VEC4},
+    {VSP_DEPTHMODE, SP_CAMERA, VEC4}, {VSP_FRUSTUMSIZE, SP_CAMERA, VEC4}, {VSP_GBUFFEROFFSETS, SP_CAMERA, VEC4},
+    {VSP_VIEW, SP_CAMERA, MAT4}, {VSP_VIEWINV, SP_CAMERA, MAT4}, {VSP_VIEWPROJ, SP_CAMERA, MAT4}, {VSP_CLIPPLANE, SP_CAMERA, VEC4},
+    {VSP_AMBIENTSTARTCOLOR, SP_ZONE, VEC4}, {VSP_AMBIENTENDCOLOR, SP_ZONE, VEC4}, {VSP_ZONE, SP_ZONE, MAT4},
+    {PSP_AMBIENTCOLOR, SP_ZONE, VEC4}, {PSP_FOGCOLOR, SP_ZONE, VEC4}, {PSP_FOGPARAMS, SP_ZONE, VEC4},
+    {VSP_LIGHTDIR, SP_LIGHT, VEC4}, {VSP_LIGHTPOS, SP_LIGHT, VEC4}, {VSP_LIGHTMATRICES, SP_LIGHT, 4 * MAT4},
+    {PSP_LIGHTCOLOR, SP_LIGHT, VEC4}, {PSP_SHADOWSPLITS, SP_LIGHT, VEC4}, {PSP_SHADOWINTENSITY, SP_LIGHT, VEC4},
+    {PSP_SHADOWMAPINVSIZE, SP_LIGHT, VEC4}, {PSP_SHADOWDEPTHFADE, SP_LIGHT, VEC4},
+    {PSP_MATDIFFCOLOR, SP_MATERIAL, VEC4}, {PSP_MATSPECCOLOR, SP_MATERIAL, VEC4}, {PSP_MATEMISSIVECOLOR, SP_MATERIAL, VEC4},
+    {PSP_MATENVMAPCOLOR, SP_MATERIAL, VEC4}, {VSP_UOFFSET, SP_MATERIAL, VEC4}, {VSP_VOFFSET, SP_MATERIAL, VEC4},
+    {VSP_MODEL, SP_OBJECT, MAT4}, {VSP_BILLBOARDROT, SP_OBJECT, VEC4 * 3}
+};
+
+const i32 NUM_PARAMETERS = sizeof(PARAMETERS) / sizeof(PARAMETERS[0]);
+
+} // namespace
+
+void benchmark_graphics_shader_parameters()
+{
+    PrintLine("Shader parameters (" + String(NUM_PARAMETERS) + " parameters per batch, " + String(NUM_BATCHES) + " batches)");
+
+    // Константные буферы и параметры программы так же, как после ShaderProgram_OGL::Link()
+    SharedPtr<ConstantBuffer> buffers[MAX_SHADER_PARAMETER_GROUPS];
+    unsigned buffer_sizes[MAX_SHADER_PARAMETER_GROUPS]{};
+    HashMap<StringHash, ShaderParameter> parameters;
+
+    for (const ParameterDesc& desc : PARAMETERS)
+    {
+        ShaderParameter& parameter = parameters[desc.slot];
+        parameter.offset_ = buffer_sizes[desc.group];
+        buffer_sizes[desc.group] += desc.size;
+    }
+
+    // Матрицы костей занимают большую часть буфера объекта, но у статических моделей не устанавливаются
+    buffer_sizes[SP_OBJECT] += SKIN_MATRICES_SIZE;
+
+    for (i32 i = 0; i < MAX_SHADER_PARAMETER_GROUPS; ++i)
+    {
+        buffers[i] = new ConstantBuffer();
+        buffers[i]->SetSize(buffer_sizes[i]);
+    }
+
+    for (const ParameterDesc& desc : PARAMETERS)
+        parameters[desc.slot].bufferPtr_ = buffers[desc.group];
+
+    parameters.Rehash(NextPowerOfTwo(parameters.Size()));
+    Vector<const ShaderParameter*> slots;
+    ShaderParameterSlot::MapParameters(parameters, slots);
+
+    Vector<float> data(4 * MAT4 / sizeof(float), 1.f);
+
+    // Все параметры каждого батча, как при смене шейдеров перед каждым батчем
+    HiresTimer timer;
+    for (i32 repeat = 0; repeat < NUM_REPEATS; ++repeat)
+    {
+        for (i32 batch = 0; batch < NUM_BATCHES; ++batch)
+        {
+            for (const ParameterDesc& desc : PARAMETERS)
+            {
+                HashMap<StringHash, ShaderParameter>::ConstIterator i = parameters.Find(desc.slot.GetNameHash());
+                if (i != parameters.End())
+                    i->second_.bufferPtr_->SetParameter(i->second_.offset_, desc.size, data.Buffer());
+            }
+        }
+    }
+    long long hash_us = timer.GetUSec(true);
+
+    for (i32 repeat = 0; repeat < NUM_REPEATS; ++repeat)
+    {
+        for (i32 batch = 0; batch < NUM_BATCHES; ++batch)
+        {
+            for (const ParameterDesc& desc : PARAMETERS)
+            {
+                i32 index = desc.slot.GetIndex();
+                const ShaderParameter* info = index >= 0 && index < slots.Size() ? slots[index] : nullptr;
+                if (info)
+                    info->bufferPtr_->SetParameter(info->offset_, desc.size, data.Buffer());
+            }
+        }
+    }
+    long long slot_us = timer.GetUSec(false);
+
+    // Батчи с одним материалом: меняется только матрица модели
+    for (SharedPtr<ConstantBuffer>& buffer : buffers)
+        buffer->Apply();
+
+    long long whole_bytes = 0;
+    long long range_bytes = 0;
+    const ShaderParameter* model = slots[VSP_MODEL.GetIndex()];
+    for (i32 batch = 0; batch < NUM_BATCHES; ++batch)
+    {
+        model->bufferPtr_->SetParameter(model->offset_, MAT4, data.Buffer());
+        for (SharedPtr<ConstantBuffer>& buffer : buffers)
+        {
+            if (buffer->IsDirty())
+            {
+                whole_bytes += buffer->GetSize();
+                range_bytes += buffer->GetDirtyEnd() - buffer->GetDirtyStart();
+                buffer->Apply();
+            }
+        }
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "by hash %8.2f ms | by slot %8.2f ms per %d batches", hash_us / 1000.0 / NUM_REPEATS,
+        slot_us / 1000.0 / NUM_REPEATS, NUM_BATCHES);
+    PrintLine(String(line));
+    snprintf(line, sizeof(line), "uploaded for model matrix changes: whole buffer %lld KB | dirty range %lld KB", whole_bytes / 1024,
+        range_bytes / 1024);
+    PrintLine(String(line));
+}
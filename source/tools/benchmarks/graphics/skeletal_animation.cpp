@@ -0,0 +1,203 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Анимация толпы персонажей: запись позы в узлы костей, отложенная синхронизация узлов и общий кэш поз
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/animated_model.h>
+#include <dviglo/graphics/animation.h>
+#include <dviglo/graphics/animation_state.h>
+#include <dviglo/graphics/model.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/graphics/pose_cache.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const i32 NUM_MODELS = 2000;
+const i32 NUM_BONES = 60;
+const i32 NUM_KEY_FRAMES = 30;
+const i32 NUM_FRAMES = 50;
+const i32 NUM_COMPARED_MODELS = 20;
+
+// Бинарное дерево костей, родитель всегда идёт раньше потомка
+SharedPtr<Model> create_model()
+{
+    Skeleton skeleton;
+    Vector<Bone>& bones = skeleton.GetModifiableBones();
+    Vector<Matrix3x4> bind_transforms;
+
+    for (i32 i = 0; i < NUM_BONES; ++i)
+    {
+        Bone bone;
+        bone.name_ = "Bone" + String(i);
+        bone.nameHash_ = bone.name_;
+        bone.parentIndex_ = i ? (i - 1) / 2 : 0;
+        bone.initialPosition_ = i ? Vector3(Random(-0.1f, 0.1f), 0.2f, Random(-0.1f, 0.1f)) : Vector3::ZERO;
+        bone.initialRotation_ = Quaternion(Random(-30.f, 30.f), Vector3::FORWARD);
+        bone.collisionMask_ = BONECOLLISION_SPHERE;
+        bone.radius_ = 0.2f;
+
+        Matrix3x4 transform(bone.initialPosition_, bone.initialRotation_, bone.initialScale_);
+        bind_transforms.Push(i ? bind_transforms[bone.parentIndex_] * transform : transform);
+        bone.offsetMatrix_ = bind_transforms[i].Inverse();
+        bones.Push(bone);
+    }
+    skeleton.SetRootBoneIndex(0);
+
+    SharedPtr<Model> model(new Model());
+    model->SetNumGeometries(1);
+    model->SetBoundingBox(BoundingBox(-2.f, 2.f));
+    model->SetSkeleton(skeleton);
+    return model;
+}
+
+SharedPtr<Animation> create_animation(Model* model, bool partial)
+{
+    SharedPtr<Animation> animation(new Animation());
+    animation->SetLength(1.f);
+
+    const Vector<Bone>& bones = model->GetSkeleton().GetBones();
+    for (i32 i = partial ? NUM_BONES / 2 : 0; i < NUM_BONES; ++i)
+    {
+        AnimationTrack* track = animation->CreateTrack(bones[i].name_);
+        track->channelMask_ = AnimationChannels::Position | AnimationChannels::Rotation;
+
+        for (i32 j = 0; j < NUM_KEY_FRAMES; ++j)
+        {
+            AnimationKeyFrame key_frame;
+            key_frame.time_ = (float)j / (NUM_KEY_FRAMES - 1);
+            key_frame.position_ = bones[i].initialPosition_ + Vector3(0.f, Random(-0.02f, 0.02f), 0.f);
+            key_frame.rotation_ = Quaternion(Random(-45.f, 45.f), Random(-45.f, 45.f), Random(-45.f, 45.f));
+            track->AddKeyFrame(key_frame);
+        }
+    }
+
+    return animation;
+}
+
+// Возвращает матрицы скининга первых моделей для сравнения режимов
+Vector<Matrix3x4> run(Model* model, Animation* walk, Animation* wave, bool lazy, PoseCache* pose_cache = nullptr)
+{
+    set_random_seed(2);
+
+    SharedPtr<Scene> scene(new Scene());
+    Octree* octree = scene->create_component<Octree>();
+
+    // Без камеры анимация обновляется как в режиме headless
+    FrameInfo frame{};
+    frame.timeStep_ = 1.f / 60.f;
+
+    Vector<AnimatedModel*> models;
+    for (i32 i = 0; i < NUM_MODELS; ++i)
+    {
+        Node* node = scene->create_child();
+        node->SetPosition(Vector3(Random(-200.f, 200.f), 0.f, Random(-200.f, 200.f)));
+
+        AnimatedModel* animated_model = node->create_component<AnimatedModel>();
+        animated_model->SetModel(model);
+        animated_model->SetLazyBoneNodes(lazy);
+        animated_model->SetPoseCache(pose_cache);
+
+        AnimationState* walk_state = animated_model->AddAnimationState(walk);
+        walk_state->SetWeight(1.f);
+        walk_state->SetLooped(true);
+        walk_state->SetTime(Random(1.f));
+
+        AnimationState* wave_state = animated_model->AddAnimationState(wave);
+        wave_state->SetWeight(0.5f);
+        wave_state->SetLooped(true);
+        wave_state->SetLayer(1);
+
+        models.Push(animated_model);
+    }
+    octree->Update(frame);
+
+    HiresTimer timer;
+    long long animation_us = 0;
+    long long skinning_us = 0;
+
+    for (i32 frame_index = 0; frame_index < NUM_FRAMES; ++frame_index)
+    {
+        ++frame.frameNumber_;
+        for (AnimatedModel* animated_model : models)
+        {
+            animated_model->GetNode()->Translate(Vector3(0.f, 0.f, 0.01f));
+            for (const SharedPtr<AnimationState>& state : animated_model->GetAnimationStates())
+                state->AddTime(frame.timeStep_);
+        }
+
+        // Модели анимируются параллельно в Octree::Update()
+        timer.Reset();
+        octree->Update(frame);
+        animation_us += timer.GetUSec(true);
+
+        for (AnimatedModel* animated_model : models)
+            animated_model->UpdateGeometry(frame);
+        skinning_us += timer.GetUSec(true);
+    }
+
+    Vector<Matrix3x4> skin_matrices;
+    for (i32 i = 0; i < NUM_COMPARED_MODELS; ++i)
+    {
+        const SourceBatch& batch = models[i]->GetBatches()[0];
+        for (i32 j = 0; j < batch.numWorldTransforms_; ++j)
+            skin_matrices.Push(batch.worldTransform_[j]);
+    }
+
+    const char* mode = pose_cache ? "pose cache" : lazy ? "lazy bone nodes" : "bone nodes";
+    char line[256];
+    snprintf(line, sizeof(line), "%-18s animation %8.2f ms/frame | skinning %8.2f ms/frame",
+        mode, animation_us / 1000.0 / NUM_FRAMES, skinning_us / 1000.0 / NUM_FRAMES);
+    PrintLine(String(line));
+
+    return skin_matrices;
+}
+
+float max_difference(const Vector<Matrix3x4>& lhs, const Vector<Matrix3x4>& rhs)
+{
+    float result = 0.f;
+    for (i32 i = 0; i < lhs.Size(); ++i)
+    {
+        const float* lhs_data = lhs[i].Data();
+        const float* rhs_data = rhs[i].Data();
+        for (i32 j = 0; j < 12; ++j)
+            result = Max(result, Abs(lhs_data[j] - rhs_data[j]));
+    }
+    return result;
+}
+
+} // namespace
+
+void benchmark_graphics_skeletal_animation()
+{
+    PrintLine("Skeletal animation (" + String(NUM_MODELS) + " models, " + String(NUM_BONES) + " bones, 2 blended states)");
+
+    set_random_seed(1);
+    SharedPtr<Model> model = create_model();
+    SharedPtr<Animation> walk = create_animation(model, false);
+    SharedPtr<Animation> wave = create_animation(model, true);
+
+    Vector<Matrix3x4> node_matrices = run(model, walk, wave, false);
+    Vector<Matrix3x4> lazy_matrices = run(model, walk, wave, true);
+
+    // Время квантуется с шагом кэша, поэтому матрицы отличаются сильнее
+    SharedPtr<PoseCache> pose_cache(new PoseCache());
+    Vector<Matrix3x4> cached_matrices = run(model, walk, wave, true, pose_cache);
+
+    i32 num_lookups = pose_cache->GetNumHits() + pose_cache->GetNumMisses();
+    PrintLine("Pose cache hit rate: " + String(num_lookups ? 100.f * pose_cache->GetNumHits() / num_lookups : 0.f) + "%");
+    PrintLine("Max skin matrix difference: lazy " + String(max_difference(node_matrices, lazy_matrices)) + ", cached "
+        + String(max_difference(node_matrices, cached_matrices)));
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Сравнение Octree и динамической BVH на равномерно распределённой и на кластеризованной сцене
+
+#include <dviglo/core/context.h>
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/drawable.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+/// Drawable with a fixed local bounding box.
+class BenchmarkDrawable : public Drawable
+{
+    DV_OBJECT(BenchmarkDrawable);
+
+public:
+    BenchmarkDrawable() :
+        Drawable(DrawableTypes::Geometry)
+    {
+        boundingBox_ = BoundingBox(-0.5f, 0.5f);
+    }
+
+protected:
+    void OnWorldBoundingBoxUpdate() override
+    {
+        worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+    }
+};
+
+const i32 NUM_OBJECTS = 20000;
+const i32 NUM_QUERIES = 1000;
+const i32 NUM_UPDATE_FRAMES = 100;
+const float WORLD_HALF_SIZE = 2000.f; // Default octree size is 1000, so part of the objects end up in the root octant
+const i32 NUM_CLUSTERS = 8;
+const float CLUSTER_RADIUS = 20.f;
+
+Vector3 random_position(bool clustered, const Vector<Vector3>& clusters)
+{
+    if (clustered)
+    {
+        const Vector3& center = clusters[Random((int)clusters.Size())];
+        return center + Vector3(Random(-CLUSTER_RADIUS, CLUSTER_RADIUS), Random(-CLUSTER_RADIUS, CLUSTER_RADIUS),
+            Random(-CLUSTER_RADIUS, CLUSTER_RADIUS));
+    }
+
+    return Vector3(Random(-WORLD_HALF_SIZE, WORLD_HALF_SIZE), Random(-50.f, 50.f), Random(-WORLD_HALF_SIZE, WORLD_HALF_SIZE));
+}
+
+void run(SpatialIndexType type, bool clustered)
+{
+    set_random_seed(1);
+
+    Vector<Vector3> clusters;
+    for (i32 i = 0; i < NUM_CLUSTERS; ++i)
+        clusters.Push(Vector3(Random(-WORLD_HALF_SIZE, WORLD_HALF_SIZE), 0.f, Random(-WORLD_HALF_SIZE, WORLD_HALF_SIZE)));
+
+    SharedPtr<Scene> scene(new Scene());
+    Octree* octree = scene->create_component<Octree>();
+    octree->SetSpatialIndex(type);
+
+    FrameInfo frame;
+    frame.timeStep_ = 1.f / 60.f;
+
+    HiresTimer timer;
+
+    Vector<Node*> nodes;
+    for (i32 i = 0; i < NUM_OBJECTS; ++i)
+    {
+        Node* node = scene->create_child();
+        node->SetPosition(random_position(clustered, clusters));
+        node->SetScale(Random(0.5f, 4.f));
+        node->create_component<BenchmarkDrawable>();
+        nodes.Push(node);
+    }
+    octree->Update(frame);
+
+    long long insert_us = timer.GetUSec(true);
+
+    // Box queries around the objects
+    Vector<Drawable*> result;
+    i64 num_found = 0;
+    for (i32 i = 0; i < NUM_QUERIES; ++i)
+    {
+        Vector3 center = nodes[Random(NUM_OBJECTS)]->GetPosition();
+        BoxOctreeQuery query(result, BoundingBox(center - Vector3(30.f, 30.f, 30.f), center + Vector3(30.f, 30.f, 30.f)));
+        octree->GetDrawables(query);
+        num_found += result.Size();
+    }
+
+    long long box_us = timer.GetUSec(true);
+
+    // Frustum queries from random cameras
+    for (i32 i = 0; i < NUM_QUERIES; ++i)
+    {
+        Vector3 position = random_position(clustered, clusters);
+        Quaternion rotation(Random(360.f), Vector3::UP);
+        Frustum frustum;
+        frustum.Define(60.f, 16.f / 9.f, 1.f, 0.1f, 300.f, Matrix3x4(position, rotation, 1.f));
+        FrustumOctreeQuery query(result, frustum);
+        octree->GetDrawables(query);
+        num_found += result.Size();
+    }
+
+    long long frustum_us = timer.GetUSec(true);
+
+    // Closest hit raycasts. Octree misses objects outside of its bounds when the ray does not hit the root octant,
+    // so BVH may find a bit more
+    Vector<RayQueryResult> ray_result;
+    for (i32 i = 0; i < NUM_QUERIES; ++i)
+    {
+        Vector3 origin = random_position(clustered, clusters);
+        Vector3 direction = Vector3(Random(-1.f, 1.f), Random(-0.1f, 0.1f), Random(-1.f, 1.f)).normalized();
+        RayOctreeQuery query(ray_result, Ray(origin, direction), RAY_AABB, 500.f);
+        octree->RaycastSingle(query);
+        num_found += ray_result.Size();
+    }
+
+    long long raycast_us = timer.GetUSec(true);
+
+    // Move 10% of the objects every frame
+    for (i32 frame_index = 0; frame_index < NUM_UPDATE_FRAMES; ++frame_index)
+    {
+        for (i32 i = frame_index % 10; i < NUM_OBJECTS; i += 10)
+            nodes[i]->Translate(Vector3(Random(-1.f, 1.f), 0.f, Random(-1.f, 1.f)));
+        octree->Update(frame);
+    }
+
+    long long update_us = timer.GetUSec(true);
+
+    // String::AppendWithFormat() does not support width and precision
+    char line[256];
+    snprintf(line, sizeof(line), "%-12s %-10s insert %8.2f ms | box %8.2f ms | frustum %8.2f ms | raycast %8.2f ms | update %8.2f ms/frame | found %lld",
+        type == SPATIAL_INDEX_OCTREE ? "octree" : "dynamic bvh", clustered ? "clustered" : "spread",
+        insert_us / 1000.0, box_us / 1000.0, frustum_us / 1000.0, raycast_us / 1000.0,
+        update_us / 1000.0 / NUM_UPDATE_FRAMES, (long long)num_found);
+    PrintLine(String(line));
+}
+
+} // namespace
+
+void benchmark_graphics_spatial_index()
+{
+    DV_CONTEXT->RegisterFactory<BenchmarkDrawable>();
+
+    PrintLine("Spatial index (" + String(NUM_OBJECTS) + " objects, " + String(NUM_QUERIES) + " queries of each type)");
+
+    for (bool clustered : {false, true})
+    {
+        run(SPATIAL_INDEX_OCTREE, clustered);
+        run(SPATIAL_INDEX_DYNAMIC_BVH, clustered);
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Ландшафт: построение патчей в рабочих потоках и пакетный запрос высот
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/core/work_queue.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/graphics/terrain.h>
+#include <dviglo/math/random.h>
+#include <dviglo/resource/image.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 HEIGHT_MAP_SIZE = 1025;
+const i32 NUM_QUERIES = 1000000;
+
+// 16-битная карта высот: старший байт в красном канале, младший в зелёном
+SharedPtr<Image> create_height_map()
+{
+    SharedPtr<Image> image(new Image());
+    image->SetSize(HEIGHT_MAP_SIZE, HEIGHT_MAP_SIZE, 3);
+    unsigned char* data = image->GetData();
+
+    for (i32 z = 0; z < HEIGHT_MAP_SIZE; ++z)
+    {
+        for (i32 x = 0; x < HEIGHT_MAP_SIZE; ++x)
+        {
+            u16 height = (u16)(32768.f + 16000.f * Sin(x * 0.7f) * Cos(z * 0.5f) + 8000.f * Sin((x + z) * 2.3f));
+            unsigned char* pixel = data + (z * HEIGHT_MAP_SIZE + x) * 3;
+            pixel[0] = (unsigned char)(height >> 8u);
+            pixel[1] = (unsigned char)(height & 0xffu);
+            pixel[2] = 0;
+        }
+    }
+
+    return image;
+}
+
+} // namespace
+
+void benchmark_graphics_terrain_heights()
+{
+    PrintLine("Terrain (" + String(HEIGHT_MAP_SIZE) + "x" + String(HEIGHT_MAP_SIZE) + " heightmap, "
+        + String(DV_WORK_QUEUE->GetNumThreads()) + " worker threads)");
+
+    set_random_seed(1);
+    SharedPtr<Image> height_map = create_height_map();
+
+    SharedPtr<Scene> scene(new Scene());
+    scene->create_component<Octree>();
+    Node* terrain_node = scene->create_child("Terrain");
+    terrain_node->SetPosition(Vector3(10.f, -5.f, 20.f));
+    terrain_node->SetRotation(Quaternion(30.f, Vector3::UP));
+    Terrain* terrain = terrain_node->create_component<Terrain>();
+    terrain->SetSmoothing(true);
+
+    HiresTimer timer;
+    terrain->SetHeightMap(height_map);
+    long long build_us = timer.GetUSec(false);
+
+    Vector<Vector3> positions(NUM_QUERIES);
+    for (Vector3& position : positions)
+        position = terrain_node->GetWorldTransform() * Vector3(Random(-500.f, 500.f), 0.f, Random(-500.f, 500.f));
+
+    Vector<float> heights(NUM_QUERIES);
+    timer.Reset();
+    for (i32 i = 0; i < NUM_QUERIES; ++i)
+        heights[i] = terrain->GetHeight(positions[i]);
+    long long single_us = timer.GetUSec(false);
+
+    Vector<float> batch_heights(NUM_QUERIES);
+    timer.Reset();
+    terrain->GetHeights(&positions[0], &batch_heights[0], NUM_QUERIES);
+    long long batch_us = timer.GetUSec(false);
+
+    float max_error = 0.f;
+    for (i32 i = 0; i < NUM_QUERIES; ++i)
+        max_error = Max(max_error, Abs(heights[i] - batch_heights[i]));
+
+    char line[256];
+    snprintf(line, sizeof(line), "%d patches built in %8.2f ms | %d heights: GetHeight() %8.2f ms, GetHeights() %8.2f ms, max difference %g",
+        terrain->GetNumPatches().x * terrain->GetNumPatches().y, build_us / 1000.0, NUM_QUERIES, single_us / 1000.0,
+        batch_us / 1000.0, max_error);
+    PrintLine(String(line));
+}
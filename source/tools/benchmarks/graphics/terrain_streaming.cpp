@@ -0,0 +1,115 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Ландшафт CDLOD: подгрузка патчей из файла карты высот при полёте камеры
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/core/work_queue.h>
+#include <dviglo/graphics/camera.h>
+#include <dviglo/graphics/cdlod_terrain.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/io/file.h>
+#include <dviglo/io/file_system.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 HEIGHT_MAP_SIZE = 4097;
+const i32 NUM_FRAMES = 300;
+const float FLIGHT_SPEED = 10.f;
+
+// Холмы из синусоид, чтобы у патчей были разные высоты
+bool write_height_map(const String& path)
+{
+    File file(path, FILE_WRITE);
+    if (!file.IsOpen())
+        return false;
+
+    Vector<u16> row(HEIGHT_MAP_SIZE);
+    for (i32 z = 0; z < HEIGHT_MAP_SIZE; ++z)
+    {
+        for (i32 x = 0; x < HEIGHT_MAP_SIZE; ++x)
+            row[x] = (u16)(32768.f + 16000.f * Sin(x * 0.2f) * Cos(z * 0.15f) + 8000.f * Sin((x + z) * 1.3f));
+
+        file.Write(row.Buffer(), row.Size() * (i32)sizeof(u16));
+    }
+
+    return true;
+}
+
+} // namespace
+
+void benchmark_graphics_terrain_streaming()
+{
+    PrintLine("CDLOD terrain (" + String(HEIGHT_MAP_SIZE) + "x" + String(HEIGHT_MAP_SIZE) + " heightmap streamed from file)");
+
+    String path = DV_FILE_SYSTEM->GetTemporaryDir() + "dviglo_benchmark_heightmap.r16";
+    if (!write_height_map(path))
+    {
+        PrintLine("Could not write " + path);
+        return;
+    }
+
+    SharedPtr<Scene> scene(new Scene());
+    scene->create_component<Octree>();
+
+    Node* camera_node = scene->create_child("Camera");
+    camera_node->SetPosition(Vector3(-1500.f, 200.f, -1500.f));
+    camera_node->SetRotation(Quaternion(45.f, Vector3::UP));
+    Camera* camera = camera_node->create_component<Camera>();
+
+    CdlodTerrain* terrain = scene->create_child("Terrain")->create_component<CdlodTerrain>();
+    terrain->SetSpacing(Vector3(1.f, 0.5f, 1.f));
+    terrain->SetViewDistance(1000.f);
+    terrain->SetLodCamera(camera);
+    terrain->SetHeightMapFile(path, IntVector2(HEIGHT_MAP_SIZE, HEIGHT_MAP_SIZE));
+
+    // Без рабочих потоков задания сборки выполняются здесь, а не между кадрами
+    HiresTimer timer;
+    long long update_us = 0;
+    long long build_us = 0;
+    i32 max_patches = 0;
+    i32 max_pending = 0;
+
+    for (i32 frame_index = 0; frame_index < NUM_FRAMES; ++frame_index)
+    {
+        camera_node->Translate(Vector3::FORWARD * FLIGHT_SPEED);
+
+        timer.Reset();
+        scene->Update(1.f / 60.f);
+        update_us += timer.GetUSec(false);
+        max_pending = Max(max_pending, terrain->GetNumPendingPatches());
+
+        timer.Reset();
+        DV_WORK_QUEUE->Complete(0);
+        build_us += timer.GetUSec(false);
+        max_patches = Max(max_patches, terrain->GetNumPatches());
+    }
+
+    // Резидентные патчи: вершины на GPU и высоты для запросов
+    i32 patch_row = terrain->GetPatchSize() + 1;
+    long long patch_bytes = (patch_row * patch_row + 4 * patch_row) * 12 * sizeof(float) + patch_row * patch_row * sizeof(float);
+    long long full_bytes = (long long)HEIGHT_MAP_SIZE * HEIGHT_MAP_SIZE * (12 + 1) * sizeof(float);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%d drawn patches | up to %d resident (%.1f MB, %.1f MB for the whole Terrain) | up to %d pending",
+        terrain->GetNumDrawnPatches(), max_patches, max_patches * patch_bytes / 1048576.0, full_bytes / 1048576.0, max_pending);
+    PrintLine(String(line));
+    snprintf(line, sizeof(line), "update %8.2f ms/frame | patch build %8.2f ms/frame",
+        update_us / 1000.0 / NUM_FRAMES, build_us / 1000.0 / NUM_FRAMES);
+    PrintLine(String(line));
+
+    scene.Reset();
+    DV_FILE_SYSTEM->Delete(path);
+}
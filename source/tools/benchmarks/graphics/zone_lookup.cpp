@@ -0,0 +1,130 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Поиск зоны для объектов: перебор всех зон и сетка по зонам, отсортированным по приоритету
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/core/timer.h>
+#include <dviglo/graphics/octree.h>
+#include <dviglo/graphics/zone.h>
+#include <dviglo/graphics/zone_grid.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+#include <dviglo/scene/scene.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 NUM_ZONES = 400;
+const i32 NUM_POSITIONS = 100000;
+
+// Как в View::FindZone() до сетки: зона с наибольшим приоритетом, первая из равных
+Zone* find_linear(const Vector<Zone*>& zones, const Vector3& position)
+{
+    i32 best_priority = M_MIN_INT;
+    Zone* best_zone = nullptr;
+
+    for (Zone* zone : zones)
+    {
+        i32 priority = zone->GetPriority();
+        if (priority > best_priority && zone->IsInside(position))
+        {
+            best_zone = zone;
+            best_priority = priority;
+        }
+    }
+
+    return best_zone;
+}
+
+// Первая подходящая зона среди кандидатов из сетки
+Zone* find_grid(const Vector<Zone*>& sorted_zones, const ZoneGrid& grid, const Vector3& position)
+{
+    i32 count;
+    const i32* candidates = grid.GetCandidates(position, count);
+
+    for (i32 i = 0; i < count; ++i)
+    {
+        Zone* zone = sorted_zones[candidates[i]];
+        if (zone->IsInside(position))
+            return zone;
+    }
+
+    return nullptr;
+}
+
+} // namespace
+
+void benchmark_graphics_zone_lookup()
+{
+    PrintLine("Zone lookup (" + String(NUM_ZONES) + " rotated zones, " + String(NUM_POSITIONS) + " drawables)");
+
+    set_random_seed(1);
+
+    SharedPtr<Scene> scene(new Scene());
+    scene->create_component<Octree>();
+
+    // Зоны тумана и освещения на уровне 1x1 км и одна зона на весь уровень
+    Vector<Zone*> zones;
+    for (i32 i = 0; i < NUM_ZONES; ++i)
+    {
+        Node* node = scene->create_child();
+        node->SetPosition(Vector3(Random(-500.f, 500.f), 0.f, Random(-500.f, 500.f)));
+        node->SetRotation(Quaternion(Random(360.f), Vector3::UP));
+        Zone* zone = node->create_component<Zone>();
+        zone->SetBoundingBox(BoundingBox(Vector3(-Random(10.f, 40.f), -20.f, -Random(10.f, 40.f)), Vector3(Random(10.f, 40.f), 20.f, Random(10.f, 40.f))));
+        zone->SetPriority(Random(0, 4));
+        zones.Push(zone);
+    }
+
+    Zone* level_zone = scene->create_child()->create_component<Zone>();
+    level_zone->SetBoundingBox(BoundingBox(Vector3(-600.f, -50.f, -600.f), Vector3(600.f, 50.f, 600.f)));
+    level_zone->SetPriority(-1);
+    zones.Push(level_zone);
+
+    Vector<Vector3> positions(NUM_POSITIONS);
+    for (Vector3& position : positions)
+        position = Vector3(Random(-550.f, 550.f), Random(-10.f, 10.f), Random(-550.f, 550.f));
+
+    HiresTimer timer;
+    Vector<Zone*> linear_result(NUM_POSITIONS);
+    for (i32 i = 0; i < NUM_POSITIONS; ++i)
+        linear_result[i] = find_linear(zones, positions[i]);
+    long long linear_us = timer.GetUSec(true);
+
+    Vector<Zone*> sorted_zones = zones;
+    stable_sort(sorted_zones.Begin(), sorted_zones.End(), [](Zone* lhs, Zone* rhs) { return lhs->GetPriority() > rhs->GetPriority(); });
+    Vector<BoundingBox> boxes;
+    for (Zone* zone : sorted_zones)
+        boxes.Push(zone->GetWorldBoundingBox());
+    ZoneGrid grid;
+    grid.Build(&boxes[0], boxes.Size());
+    long long build_us = timer.GetUSec(true);
+
+    Vector<Zone*> grid_result(NUM_POSITIONS);
+    for (i32 i = 0; i < NUM_POSITIONS; ++i)
+        grid_result[i] = find_grid(sorted_zones, grid, positions[i]);
+    long long grid_us = timer.GetUSec(false);
+
+    i32 num_mismatches = 0;
+    for (i32 i = 0; i < NUM_POSITIONS; ++i)
+    {
+        if (linear_result[i] != grid_result[i])
+            ++num_mismatches;
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "linear %8.2f ms | grid %dx%dx%d build %6.3f ms + lookup %8.2f ms | mismatches %d",
+        linear_us / 1000.0, grid.GetNumCells().x, grid.GetNumCells().y, grid.GetNumCells().z, build_us / 1000.0,
+        grid_us / 1000.0, num_mismatches);
+    PrintLine(String(line));
+}
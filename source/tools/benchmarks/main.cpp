@@ -0,0 +1,68 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+// Замеры производительности подсистем движка без GPU.
+// Движок запускается в режиме headless, результаты выводятся в консоль
+
+#include <dviglo/core/process_utils.h>
+#include <dviglo/engine/application.h>
+#include <dviglo/engine/engine.h>
+#include <dviglo/engine/engine_defs.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+void benchmark_graphics_batch_sort();
+void benchmark_graphics_billboards();
+void benchmark_graphics_draw_recording();
+void benchmark_graphics_forest();
+void benchmark_graphics_mesh_optimization();
+void benchmark_graphics_occlusion();
+void benchmark_graphics_particles();
+void benchmark_graphics_pass_shaders();
+void benchmark_graphics_pvs();
+void benchmark_graphics_shader_parameters();
+void benchmark_graphics_spatial_index();
+void benchmark_graphics_skeletal_animation();
+void benchmark_graphics_terrain_heights();
+void benchmark_graphics_terrain_streaming();
+void benchmark_graphics_zone_lookup();
+
+class Benchmarks : public Application
+{
+    DV_OBJECT(Benchmarks);
+
+public:
+    void Setup() override
+    {
+        engineParameters_[EP_HEADLESS] = true;
+        engineParameters_[EP_RESOURCE_PATHS] = String::EMPTY;
+        engineParameters_[EP_AUTOLOAD_PATHS] = String::EMPTY;
+        engineParameters_[EP_LOG_NAME] = String::EMPTY;
+    }
+
+    void Start() override
+    {
+        benchmark_graphics_batch_sort();
+        benchmark_graphics_billboards();
+        benchmark_graphics_occlusion();
+        benchmark_graphics_pvs();
+        benchmark_graphics_spatial_index();
+        benchmark_graphics_skeletal_animation();
+        benchmark_graphics_mesh_optimization();
+        benchmark_graphics_particles();
+        benchmark_graphics_forest();
+        benchmark_graphics_terrain_heights();
+        benchmark_graphics_terrain_streaming();
+        benchmark_graphics_zone_lookup();
+        benchmark_graphics_pass_shaders();
+        benchmark_graphics_shader_parameters();
+        benchmark_graphics_draw_recording();
+
+        DV_ENGINE->Exit();
+    }
+};
+
+DV_DEFINE_APPLICATION_MAIN(Benchmarks)
@@ -5,10 +5,13 @@
 #include <dviglo/core/context.h>
 #include <dviglo/core/process_utils.h>
 #include <dviglo/core/string_utils.h>
+#include <dviglo/graphics/mesh_optimizer.h>
+#include <dviglo/graphics/mesh_simplifier.h>
 #include <dviglo/graphics/tangent.h>
 #include <dviglo/io/file.h>
 #include <dviglo/io/file_system.h>
 #include <dviglo/io/log.h>
+#include <dviglo/io/vector_buffer.h>
 #include <dviglo/resource/xml_file.h>
 
 #include "ogre_importer_utils.h"
@@ -19,8 +22,6 @@
 
 using namespace std;
 
-static const int VERTEX_CACHE_SIZE = 32;
-
 Context context;
 Log log_;
 
@@ -42,9 +43,10 @@ int main(int argc, char** argv);
 void Run(const Vector<String>& arguments);
 void LoadSkeleton(const String& skeletonFileName);
 void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubMeshes, bool exportMorphs);
-void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotationsOnly, bool saveMaterialList);
-void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib);
-void CalculateScore(ModelVertex& vertex);
+void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotationsOnly, float sampleRate,
+    bool saveMaterialList);
+void GenerateLodLevels(unsigned numLevels, float distanceStep);
+void OptimizeGeometry();
 String SanitateAssetName(const String& name);
 
 int main(int argc, char** argv)
@@ -68,9 +70,13 @@ void Run(const Vector<String>& arguments)
         ErrorExit(
             "Usage: ogre_importer <input file> <output file> [options]\n\n"
             "Options:\n"
+            "-c <x>  Compress animations, resampling at x frames per second\n"
             "-l      Output a material list file\n"
+            "-lod <x> Generate x LOD levels by mesh simplification, halving the triangles per level\n"
+            "-ld <x> Distance between the generated LOD levels, default 20\n"
             "-na     Do not output animations\n"
             "-nm     Do not output morphs\n"
+            "-no     Do not optimize geometry\n"
             "-r      Output only rotations from animations\n"
             "-s      Split each submesh into own vertex buffer\n"
             "-t      Generate tangents\n"
@@ -82,8 +88,12 @@ void Run(const Vector<String>& arguments)
     bool splitSubMeshes = false;
     bool exportAnimations = true;
     bool exportMorphs = true;
+    bool optimizeGeometry = true;
     bool rotationsOnly = false;
+    float sampleRate = 0.f;
     bool saveMaterialList = false;
+    unsigned numLodLevels = 0;
+    float lodDistanceStep = 20.f;
 
     if (arguments.Size() > 2)
     {
@@ -111,9 +121,32 @@ void Run(const Vector<String>& arguments)
                     case 'm':
                         exportMorphs = false;
                         break;
+
+                    case 'o':
+                        optimizeGeometry = false;
+                        break;
                     }
                     break;
                 }
+                else if (argument == "c" && i < arguments.Size() - 1)
+                {
+                    sampleRate = ToFloat(arguments[i + 1]);
+                    if (sampleRate <= 0.f)
+                        sampleRate = DEFAULT_ANIMATION_SAMPLE_RATE;
+                    ++i;
+                }
+                else if (argument == "lod" && i < arguments.Size() - 1)
+                {
+                    numLodLevels = ToU32(arguments[i + 1]);
+                    ++i;
+                }
+                else if (argument == "ld" && i < arguments.Size() - 1)
+                {
+                    lodDistanceStep = ToFloat(arguments[i + 1]);
+                    if (lodDistanceStep <= 0.f)
+                        lodDistanceStep = 20.f;
+                    ++i;
+                }
                 else if (argument == "mb" && i < arguments.Size() - 1)
                 {
                     maxBones_ = ToU32(arguments[i + 1]);
@@ -126,7 +159,11 @@ void Run(const Vector<String>& arguments)
     }
 
     LoadMesh(arguments[0], generateTangents, splitSubMeshes, exportMorphs);
-    WriteOutput(arguments[1], exportAnimations, rotationsOnly, saveMaterialList);
+    if (numLodLevels)
+        GenerateLodLevels(numLodLevels, lodDistanceStep);
+    if (optimizeGeometry)
+        OptimizeGeometry();
+    WriteOutput(arguments[1], exportAnimations, rotationsOnly, sampleRate, saveMaterialList);
 
     PrintLine("Finished");
 }
@@ -572,8 +609,6 @@ void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubM
         indexStart += indices;
         vertexStart += vertices;
 
-        OptimizeIndices(&subGeometryLodLevel, vBuf, iBuf);
-
         PrintLine("Processed submesh " + String(subMeshIndex + 1) + ": " + String(vertices) + " vertices " +
             String(triangles) + " triangles");
         Vector<ModelSubGeometryLodLevel> thisSubGeometry;
@@ -646,8 +681,6 @@ void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubM
                         triangle = triangle.GetNext("face");
                     }
 
-                    OptimizeIndices(&newLodLevel, vBuf, iBuf);
-
                     subGeometries_[subMeshIndex].Push(newLodLevel);
                     PrintLine("Processed LOD level for submesh " + String(subMeshIndex + 1) + ": distance " + String(distance));
 
@@ -828,7 +861,8 @@ void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubM
     }
 }
 
-void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotationsOnly, bool saveMaterialList)
+void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotationsOnly, float sampleRate,
+    bool saveMaterialList)
 {
     /// \todo Use save functions of Model & Animation classes
 
@@ -1000,7 +1034,11 @@ void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotat
 
                     // Do not add tracks with no keyframes
                     if (newAnimationTrack.keyFrames_.Size())
+                    {
+                        if (sampleRate > 0.f)
+                            newAnimationTrack.Compress(newAnimation.length_, sampleRate);
                         newAnimation.tracks_.Push(newAnimationTrack);
+                    }
 
                     track = track.GetNext("track");
                 }
@@ -1013,7 +1051,7 @@ void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotat
                 if (!dest.Open(animationFileName, FILE_WRITE))
                     ErrorExit("Could not open output file " + animationFileName);
 
-                dest.WriteFileID("UANI");
+                dest.WriteFileID(sampleRate > 0.f ? "UANC" : "UANI");
                 dest.WriteString(newAnimation.name_);
                 dest.WriteFloat(newAnimation.length_);
                 dest.WriteU32(newAnimation.tracks_.Size());
@@ -1022,6 +1060,14 @@ void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotat
                     AnimationTrack& track = newAnimation.tracks_[i];
                     dest.WriteString(track.name_);
                     dest.WriteU8(to_u8(track.channelMask_));
+
+                    if (sampleRate > 0.f)
+                    {
+                        dest.WriteBool(true);
+                        track.SaveCompressed(dest);
+                        continue;
+                    }
+
                     dest.WriteU32(track.keyFrames_.Size());
                     for (unsigned j = 0; j < track.keyFrames_.Size(); ++j)
                     {
@@ -1043,166 +1089,195 @@ void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotat
     }
 }
 
-void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib)
+void GenerateLodLevels(unsigned numLevels, float distanceStep)
 {
-    Vector<Triangle> oldTriangles;
-    Vector<Triangle> newTriangles;
-
-    if (subGeom->indexCount_ % 3)
-    {
-        PrintLine("Index count is not divisible by 3, skipping index optimization");
-        return;
-    }
-
-    for (unsigned i = 0; i < vb->vertices_.Size(); ++i)
-    {
-        vb->vertices_[i].useCount_ = 0;
-        vb->vertices_[i].cachePosition_ = -1;
-    }
+    unsigned numGenerated = 0;
 
-    for (unsigned i = subGeom->indexStart_; i < subGeom->indexStart_ + subGeom->indexCount_; i += 3)
+    for (Vector<ModelSubGeometryLodLevel>& lodLevels : subGeometries_)
     {
-        Triangle triangle{ib->indices_[i], ib->indices_[i + 1], ib->indices_[i + 2]};
-        vb->vertices_[triangle.v0_].useCount_++;
-        vb->vertices_[triangle.v1_].useCount_++;
-        vb->vertices_[triangle.v2_].useCount_++;
-        oldTriangles.Push(triangle);
+        // Submeshes with LODs from the source file keep them
+        if (lodLevels.Size() != 1 || lodLevels[0].primitiveType_ != TRIANGLE_LIST || lodLevels[0].indexCount_ % 3)
+            continue;
+
+        const ModelSubGeometryLodLevel& base = lodLevels[0];
+        ModelVertexBuffer& vb = vertexBuffers_[base.vertexBuffer_];
+        ModelIndexBuffer& ib = indexBuffers_[base.indexBuffer_];
+        if (vb.vertices_.Empty() || !base.indexCount_)
+            continue;
+
+        // Bone weights are only needed by the first LOD level
+        ModelSubGeometryLodLevel lodLevel;
+        lodLevel.primitiveType_ = base.primitiveType_;
+        lodLevel.vertexBuffer_ = base.vertexBuffer_;
+        lodLevel.indexBuffer_ = base.indexBuffer_;
+        lodLevel.boneMapping_ = base.boneMapping_;
+
+        Vector<u32> baseIndices(&ib.indices_[base.indexStart_], base.indexCount_);
+        Vector<u32> simplified(base.indexCount_);
+        unsigned lastCount = base.indexCount_;
+
+        for (unsigned i = 1; i <= numLevels; ++i)
+        {
+            i32 targetCount = (base.indexCount_ / 3 >> i) * 3;
+            unsigned count = SimplifyMesh(&simplified[0], &baseIndices[0], baseIndices.Size(),
+                (const byte*)&vb.vertices_[0].position_, sizeof(ModelVertex), vb.vertices_.Size(), targetCount);
+
+            // The mesh can not be simplified further
+            if (!count || count >= lastCount)
+                break;
+
+            lodLevel.distance_ = distanceStep * i;
+            lodLevel.indexStart_ = ib.indices_.Size();
+            lodLevel.indexCount_ = count;
+            for (unsigned j = 0; j < count; ++j)
+                ib.indices_.Push(simplified[j]);
+
+            lodLevels.Push(lodLevel);
+            lastCount = count;
+            ++numGenerated;
+        }
     }
 
-    for (unsigned i = 0; i < vb->vertices_.Size(); ++i)
-        CalculateScore(vb->vertices_[i]);
+    PrintLine("Generated " + String(numGenerated) + " LOD levels");
+}
 
-    Vector<unsigned> vertexCache;
+void OptimizeGeometry()
+{
+    // Vertex buffers with morphs keep their vertex order, as the morphs refer to it
+    Vector<Vector<i32>> remaps(vertexBuffers_.Size());
 
-    while (oldTriangles.Size())
+    auto remapIndices = [&](unsigned vbIndex, const Vector<i32>& remap)
     {
-        unsigned bestTriangle = M_MAX_UNSIGNED;
-        float bestTriangleScore = -1.0f;
-
-        // Find the best triangle at this point
-        for (unsigned i = 0; i < oldTriangles.Size(); ++i)
+        for (const Vector<ModelSubGeometryLodLevel>& lodLevels : subGeometries_)
         {
-            Triangle& triangle = oldTriangles[i];
-            float triangleScore =
-                vb->vertices_[triangle.v0_].score_ +
-                vb->vertices_[triangle.v1_].score_ +
-                vb->vertices_[triangle.v2_].score_;
-
-            if (triangleScore > bestTriangleScore)
+            for (const ModelSubGeometryLodLevel& lodLevel : lodLevels)
             {
-                bestTriangle = i;
-                bestTriangleScore = triangleScore;
+                if (lodLevel.vertexBuffer_ == vbIndex)
+                {
+                    ModelIndexBuffer& ib = indexBuffers_[lodLevel.indexBuffer_];
+                    RemapIndices(&ib.indices_[lodLevel.indexStart_], lodLevel.indexCount_, &remap[0]);
+                }
             }
         }
+    };
 
-        if (bestTriangle == M_MAX_UNSIGNED)
+    auto remapVertices = [&](ModelVertexBuffer& vb, const Vector<i32>& remap, i32 newCount)
+    {
+        Vector<ModelVertex> vertices(newCount);
+        for (unsigned i = 0; i < vb.vertices_.Size(); ++i)
         {
-            PrintLine("Could not find next triangle, aborting index optimization");
-            return;
+            if (remap[i] != NINDEX)
+                vertices[remap[i]] = vb.vertices_[i];
         }
+        vb.vertices_ = vertices;
+    };
 
-        // Add the best triangle
-        Triangle triangleCopy = oldTriangles[bestTriangle];
-        newTriangles.Push(triangleCopy);
-        oldTriangles.Erase(oldTriangles.Begin() + bestTriangle);
-
-        // Reduce the use count
-        vb->vertices_[triangleCopy.v0_].useCount_--;
-        vb->vertices_[triangleCopy.v1_].useCount_--;
-        vb->vertices_[triangleCopy.v2_].useCount_--;
+    float acmrBefore = 0.f;
+    float acmrAfter = 0.f;
+    i32 triangles = 0;
+    i32 verticesBefore = 0;
+    i32 verticesAfter = 0;
 
-        // Model the LRU cache behaviour
-        // Erase the triangle vertices from the middle of the cache, if they were there
-        for (unsigned i = 0; i < vertexCache.Size(); ++i)
+    for (const Vector<ModelSubGeometryLodLevel>& lodLevels : subGeometries_)
+    {
+        for (const ModelSubGeometryLodLevel& lodLevel : lodLevels)
         {
-            if ((vertexCache[i] == triangleCopy.v0_) ||
-                (vertexCache[i] == triangleCopy.v1_) ||
-                (vertexCache[i] == triangleCopy.v2_))
+            if (lodLevel.indexCount_ % 3)
             {
-                vertexCache.Erase(vertexCache.Begin() + i);
-                --i;
+                PrintLine("Index count is not divisible by 3, skipping geometry optimization");
+                return;
             }
+
+            acmrBefore += CalculateACMR(&indexBuffers_[lodLevel.indexBuffer_].indices_[lodLevel.indexStart_],
+                lodLevel.indexCount_, vertexBuffers_[lodLevel.vertexBuffer_].vertices_.Size()) * (lodLevel.indexCount_ / 3);
+            triangles += lodLevel.indexCount_ / 3;
         }
+    }
+
+    // Merge vertices that are identical in the output
+    for (unsigned i = 0; i < vertexBuffers_.Size(); ++i)
+    {
+        ModelVertexBuffer& vb = vertexBuffers_[i];
+        verticesBefore += vb.vertices_.Size();
+        if (vb.morphCount_ || vb.vertices_.Empty())
+            continue;
+
+        VectorBuffer vertexData;
+        for (const ModelVertex& vertex : vb.vertices_)
+            vb.WriteVertex(vertexData, vertex);
 
-        // Then push them to the front
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v0_);
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v1_);
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v2_);
+        Vector<i32> remap(vb.vertices_.Size());
+        i32 uniqueCount = GenerateVertexRemap(&remap[0], vertexData.GetData(), vb.vertices_.Size(),
+            VertexBuffer::GetVertexSize(vb.elementMask_));
 
-        // Update positions & scores of all vertices in the cache
-        // Give position -1 if vertex is going to be erased
-        for (unsigned i = 0; i < vertexCache.Size(); ++i)
+        if (uniqueCount < vb.vertices_.Size())
         {
-            ModelVertex& vertex = vb->vertices_[vertexCache[i]];
-            if (i >= VERTEX_CACHE_SIZE)
-                vertex.cachePosition_ = -1;
-            else
-                vertex.cachePosition_ = i;
-            CalculateScore(vertex);
+            remapIndices(i, remap);
+            remapVertices(vb, remap, uniqueCount);
         }
-
-        // Finally erase the extra vertices
-        if (vertexCache.Size() > VERTEX_CACHE_SIZE)
-            vertexCache.Resize(VERTEX_CACHE_SIZE);
     }
 
-    // Rewrite the index data now
-    unsigned i = subGeom->indexStart_;
-    for (unsigned j = 0; j < newTriangles.Size(); ++j)
+    // Reorder the triangles of each LOD level
+    for (const Vector<ModelSubGeometryLodLevel>& lodLevels : subGeometries_)
     {
-        ib->indices_[i++] = newTriangles[j].v0_;
-        ib->indices_[i++] = newTriangles[j].v1_;
-        ib->indices_[i++] = newTriangles[j].v2_;
-    }
-}
+        for (const ModelSubGeometryLodLevel& lodLevel : lodLevels)
+        {
+            if (!lodLevel.indexCount_)
+                continue;
 
-void CalculateScore(ModelVertex& vertex)
-{
-    // Linear-Speed Vertex Cache Optimisation by Tom Forsyth from
-    // http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html
-    const float cacheDecayPower = 1.5f;
-    const float lastTriScore = 0.75f;
-    const float valenceBoostScale = 2.0f;
-    const float valenceBoostPower = 0.5f;
-
-    if (vertex.useCount_ == 0)
-    {
-        // No tri needs this vertex!
-        vertex.score_ = -1.0f;
-        return;
-    }
+            ModelVertexBuffer& vb = vertexBuffers_[lodLevel.vertexBuffer_];
+            u32* indices = &indexBuffers_[lodLevel.indexBuffer_].indices_[lodLevel.indexStart_];
+            OptimizeVertexCache(indices, lodLevel.indexCount_, vb.vertices_.Size());
+            OptimizeOverdraw(indices, lodLevel.indexCount_, (const byte*)&vb.vertices_[0].position_, sizeof(ModelVertex),
+                vb.vertices_.Size());
 
-    float score = 0.0f;
-    int cachePosition = vertex.cachePosition_;
-    if (cachePosition < 0)
-    {
-        // Vertex is not in FIFO cache - no score.
+            acmrAfter += CalculateACMR(indices, lodLevel.indexCount_, vb.vertices_.Size()) * (lodLevel.indexCount_ / 3);
+        }
     }
-    else
+
+    // Reorder the vertices in drawing order. Vertices that no LOD level uses are kept at the end
+    for (unsigned i = 0; i < vertexBuffers_.Size(); ++i)
     {
-        if (cachePosition < 3)
+        ModelVertexBuffer& vb = vertexBuffers_[i];
+        if (vb.morphCount_ || vb.vertices_.Empty())
         {
-            // This vertex was used in the last triangle,
-            // so it has a fixed score, whichever of the three
-            // it's in. Otherwise, you can get very different
-            // answers depending on whether you add
-            // the triangle 1,2,3 or 3,1,2 - which is silly.
-            score = lastTriScore;
+            verticesAfter += vb.vertices_.Size();
+            continue;
         }
-        else
+
+        Vector<u32> fetchOrder;
+        for (const Vector<ModelSubGeometryLodLevel>& lodLevels : subGeometries_)
+        {
+            for (const ModelSubGeometryLodLevel& lodLevel : lodLevels)
+            {
+                if (lodLevel.vertexBuffer_ != i)
+                    continue;
+
+                const ModelIndexBuffer& ib = indexBuffers_[lodLevel.indexBuffer_];
+                for (unsigned j = lodLevel.indexStart_; j < lodLevel.indexStart_ + lodLevel.indexCount_; ++j)
+                    fetchOrder.Push(ib.indices_[j]);
+            }
+        }
+
+        Vector<i32> remap(vb.vertices_.Size());
+        i32 usedCount = GenerateVertexFetchRemap(&remap[0], fetchOrder.Empty() ? nullptr : &fetchOrder[0], fetchOrder.Size(),
+            vb.vertices_.Size());
+        for (i32& index : remap)
         {
-            // Points for being high in the cache.
-            const float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
-            score = 1.0f - (cachePosition - 3) * scaler;
-            score = powf(score, cacheDecayPower);
+            if (index == NINDEX)
+                index = usedCount++;
         }
+
+        remapIndices(i, remap);
+        remapVertices(vb, remap, usedCount);
+        verticesAfter += usedCount;
     }
 
-    // Bonus points for having a low number of tris still to
-    // use the vert, so we get rid of lone verts quickly.
-    float valenceBoost = powf((float)vertex.useCount_, -valenceBoostPower);
-    score += valenceBoostScale * valenceBoost;
-    vertex.score_ = score;
+    if (triangles)
+    {
+        PrintLine("Optimized geometry: ACMR " + String(acmrBefore / triangles) + " -> " + String(acmrAfter / triangles) +
+            ", vertices " + String(verticesBefore) + " -> " + String(verticesAfter));
+    }
 }
 
 String SanitateAssetName(const String& name)
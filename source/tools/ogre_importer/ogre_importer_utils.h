@@ -14,23 +14,6 @@
 
 using namespace dviglo;
 
-struct Triangle
-{
-    // Fields are not initialized.
-    Triangle() = default;
-
-    Triangle(unsigned v0, unsigned v1, unsigned v2) :
-        v0_{v0},
-        v1_{v1},
-        v2_{v2}
-    {
-    }
-
-    unsigned v0_;
-    unsigned v1_;
-    unsigned v2_;
-};
-
 struct ModelBone
 {
     String name_;
@@ -90,9 +73,6 @@ struct ModelVertex
     float blendWeights_[4]{};
     unsigned char blendIndices_[4]{};
     bool hasBlendWeights_{};
-    unsigned useCount_{};
-    int cachePosition_{};
-    float score_{};
 };
 
 struct ModelVertexBuffer
@@ -109,6 +89,30 @@ struct ModelVertexBuffer
     {
     }
 
+    void WriteVertex(Serializer& dest, const ModelVertex& vertex) const
+    {
+        if (!!(elementMask_ & VertexElements::Position))
+            dest.WriteVector3(vertex.position_);
+        if (!!(elementMask_ & VertexElements::Normal))
+            dest.WriteVector3(vertex.normal_);
+        if (!!(elementMask_ & VertexElements::Color))
+            dest.WriteU32(vertex.color_.ToU32());
+        if (!!(elementMask_ & VertexElements::TexCoord1))
+            dest.WriteVector2(vertex.texCoord1_);
+        if (!!(elementMask_ & VertexElements::TexCoord2))
+            dest.WriteVector2(vertex.texCoord2_);
+        if (!!(elementMask_ & VertexElements::CubeTexCoord1))
+            dest.WriteVector3(vertex.cubeTexCoord1_);
+        if (!!(elementMask_ & VertexElements::CubeTexCoord2))
+            dest.WriteVector3(vertex.cubeTexCoord2_);
+        if (!!(elementMask_ & VertexElements::Tangent))
+            dest.WriteVector4(vertex.tangent_);
+        if (!!(elementMask_ & VertexElements::BlendWeights))
+            dest.Write(&vertex.blendWeights_[0], 4 * sizeof(float));
+        if (!!(elementMask_ & VertexElements::BlendIndices))
+            dest.Write(&vertex.blendIndices_[0], 4 * sizeof(unsigned char));
+    }
+
     void WriteData(Serializer& dest)
     {
         dest.WriteU32(vertices_.Size());
@@ -127,28 +131,7 @@ struct ModelVertexBuffer
         dest.WriteU32(morphCount_);
 
         for (unsigned i = 0; i < vertices_.Size(); ++i)
-        {
-            if (!!(elementMask_ & VertexElements::Position))
-                dest.WriteVector3(vertices_[i].position_);
-            if (!!(elementMask_ & VertexElements::Normal))
-                dest.WriteVector3(vertices_[i].normal_);
-            if (!!(elementMask_ & VertexElements::Color))
-                dest.WriteU32(vertices_[i].color_.ToU32());
-            if (!!(elementMask_ & VertexElements::TexCoord1))
-                dest.WriteVector2(vertices_[i].texCoord1_);
-            if (!!(elementMask_ & VertexElements::TexCoord2))
-                dest.WriteVector2(vertices_[i].texCoord2_);
-            if (!!(elementMask_ & VertexElements::CubeTexCoord1))
-                dest.WriteVector3(vertices_[i].cubeTexCoord1_);
-            if (!!(elementMask_ & VertexElements::CubeTexCoord2))
-                dest.WriteVector3(vertices_[i].cubeTexCoord2_);
-            if (!!(elementMask_ & VertexElements::Tangent))
-                dest.WriteVector4(vertices_[i].tangent_);
-            if (!!(elementMask_ & VertexElements::BlendWeights))
-                dest.Write(&vertices_[i].blendWeights_[0], 4 * sizeof(float));
-            if (!!(elementMask_ & VertexElements::BlendIndices))
-                dest.Write(&vertices_[i].blendIndices_[0], 4 * sizeof(unsigned char));
-        }
+            WriteVertex(dest, vertices_[i]);
     }
 };
 
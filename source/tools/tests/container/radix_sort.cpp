@@ -0,0 +1,65 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/containers/radix_sort.h>
+#include <dviglo/containers/vector.h>
+#include <dviglo/math/math_defs.h>
+#include <dviglo/math/random.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+void test_containers_radix_sort()
+{
+    // Порядок ключей с плавающей точкой
+    assert(FloatToRadixKey(-10.f) < FloatToRadixKey(-1.f));
+    assert(FloatToRadixKey(-1.f) < FloatToRadixKey(0.f));
+    assert(FloatToRadixKey(0.f) < FloatToRadixKey(0.5f));
+    assert(FloatToRadixKey(0.5f) < FloatToRadixKey(1000.f));
+    assert(FloatToRadixKey(1000.f) < FloatToRadixKey(M_INFINITY));
+
+    // Пустой массив и массив из одного элемента
+    {
+        RadixSortItem item{5, 0};
+        RadixSort(nullptr, nullptr, 0);
+        RadixSort(&item, nullptr, 1);
+        assert(item.key_ == 5 && item.index_ == 0);
+    }
+
+    // Сортировка случайных ключей, в том числе с одинаковыми старшими байтами
+    for (u64 mask : {0xffffffffffffffffull, 0xff00ff00ull, 0xfull})
+    {
+        set_random_seed(1);
+
+        Vector<RadixSortItem> items;
+        for (i32 i = 0; i < 5000; ++i)
+        {
+            u64 key = ((u64)Rand() << 48) ^ ((u64)Rand() << 32) ^ ((u64)Rand() << 16) ^ (u64)Rand();
+            items.Push({key & mask, i});
+        }
+
+        Vector<RadixSortItem> temp(items.Size());
+        RadixSort(items.Buffer(), temp.Buffer(), items.Size());
+
+        for (i32 i = 1; i < items.Size(); ++i)
+        {
+            assert(items[i - 1].key_ <= items[i].key_);
+
+            // Сортировка устойчивая
+            if (items[i - 1].key_ == items[i].key_)
+                assert(items[i - 1].index_ < items[i].index_);
+        }
+    }
+
+    // Используются только младшие байты ключа
+    {
+        RadixSortItem items[] = {{0x0102, 0}, {0x0201, 1}, {0x0301, 2}};
+        RadixSortItem temp[3];
+        RadixSort(items, temp, 3, 1);
+        assert(items[0].index_ == 1 && items[1].index_ == 2 && items[2].index_ == 0);
+    }
+}
@@ -0,0 +1,225 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/animation.h>
+#include <dviglo/io/vector_buffer.h>
+#include <dviglo/math/random.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const float LENGTH = 2.f;
+const i32 NUM_KEY_FRAMES = 61; // Ключи совпадают с сэмплами при частоте 30
+
+// Индекс последнего ключа не позже момента времени, полным перебором
+i32 reference_key_frame_index(const AnimationTrack& track, float time)
+{
+    i32 index = 0;
+    for (i32 i = 0; i < track.keyFrames_.Size(); ++i)
+    {
+        if (time >= track.keyFrames_[i].time_)
+            index = i;
+    }
+    return index;
+}
+
+AnimationTrack create_track(bool uniform)
+{
+    AnimationTrack track;
+    track.channelMask_ = AnimationChannels::Position | AnimationChannels::Rotation | AnimationChannels::Scale;
+
+    Vector3 position(1.f, 2.f, 3.f);
+    Quaternion rotation;
+    for (i32 i = 0; i < NUM_KEY_FRAMES; ++i)
+    {
+        AnimationKeyFrame key_frame;
+        key_frame.time_ = uniform ? LENGTH * i / (NUM_KEY_FRAMES - 1) : Random(LENGTH);
+        key_frame.position_ = position;
+        key_frame.rotation_ = rotation;
+        key_frame.scale_ = Vector3(2.f, 2.f, 2.f);
+        track.AddKeyFrame(key_frame);
+
+        position += Vector3(Random(-0.1f, 0.1f), Random(-0.1f, 0.1f), Random(-0.1f, 0.1f));
+        rotation = (Quaternion(Random(-5.f, 5.f), Random(-5.f, 5.f), Random(-5.f, 5.f)) * rotation).normalized();
+    }
+
+    return track;
+}
+
+} // namespace
+
+void test_graphics_animation_compression()
+{
+    set_random_seed(1);
+
+    // Поиск ключа с любой подсказкой совпадает с полным перебором
+    {
+        AnimationTrack track = create_track(false);
+
+        for (i32 i = 0; i < 1000; ++i)
+        {
+            float time = Random(-0.1f, LENGTH + 0.1f);
+            i32 index = Random(-1, NUM_KEY_FRAMES + 1);
+            assert(track.GetKeyFrameIndex(time, index));
+            assert(index == reference_key_frame_index(track, time));
+        }
+
+        // Воспроизведение назад
+        i32 index = NUM_KEY_FRAMES - 1;
+        for (float time = LENGTH; time >= 0.f; time -= 0.01f)
+        {
+            assert(track.GetKeyFrameIndex(time, index));
+            assert(index == reference_key_frame_index(track, time));
+        }
+
+        AnimationTrack empty;
+        assert(!empty.GetKeyFrameIndex(0.f, index));
+    }
+
+    // Сжатая дорожка близка к исходной, а постоянный канал хранится один раз
+    {
+        AnimationTrack track = create_track(true);
+        AnimationTrack compressed = track;
+        compressed.Compress(LENGTH, 30.f);
+
+        assert(compressed.IsCompressed());
+        assert(compressed.keyFrames_.Empty());
+        assert(compressed.numSamples_ == NUM_KEY_FRAMES);
+        assert(compressed.constantChannels_ == AnimationChannels::Scale);
+        assert(compressed.samples_.Size() == NUM_KEY_FRAMES * 6);
+        assert(compressed.GetDataSize() * 3 < track.GetDataSize());
+
+        for (i32 i = 0; i < 1000; ++i)
+        {
+            float time = i < 2 ? i * LENGTH : Random(LENGTH);
+            i32 index = 0;
+            i32 compressed_index = Random(NUM_KEY_FRAMES);
+            Vector3 position, compressed_position;
+            Quaternion rotation, compressed_rotation;
+            Vector3 scale, compressed_scale;
+
+            assert(track.Sample(time, LENGTH, false, index, position, rotation, scale));
+            assert(compressed.Sample(time, LENGTH, false, compressed_index, compressed_position, compressed_rotation,
+                compressed_scale));
+
+            assert((position - compressed_position).Length() < 0.001f);
+            assert(Abs(rotation.DotProduct(compressed_rotation)) > 0.99999f);
+            assert(scale == compressed_scale);
+        }
+
+        // Сохранение и загрузка не меняют данные
+        VectorBuffer buffer;
+        compressed.SaveCompressed(buffer);
+        buffer.Seek(0);
+
+        AnimationTrack loaded;
+        loaded.channelMask_ = compressed.channelMask_;
+        assert(loaded.LoadCompressed(buffer));
+        assert(loaded.numSamples_ == compressed.numSamples_);
+        assert(loaded.sampleRate_ == compressed.sampleRate_);
+        assert(loaded.constantChannels_ == compressed.constantChannels_);
+        assert(loaded.positionMin_ == compressed.positionMin_);
+        assert(loaded.scaleMin_ == compressed.scaleMin_);
+        assert(loaded.samples_ == compressed.samples_);
+
+        // Повреждённые данные не загружаются
+        VectorBuffer truncated(buffer.GetData(), buffer.GetSize() - 2);
+        AnimationTrack broken;
+        broken.channelMask_ = compressed.channelMask_;
+        assert(!broken.LoadCompressed(truncated));
+        assert(!broken.IsCompressed());
+    }
+
+    // Последний ключ раньше конца анимации: при зацикливании сжатая дорожка тоже возвращается к первому ключу
+    {
+        AnimationTrack track = create_track(true);
+        const float SHORT_LENGTH = LENGTH + 0.5f;
+        AnimationTrack compressed = track;
+        compressed.Compress(SHORT_LENGTH, 30.f);
+
+        assert(compressed.numLoopSamples_ > 0);
+        assert(compressed.numLoopSamples_ < compressed.numSamples_);
+
+        for (bool looped : {false, true})
+        {
+            for (i32 i = 0; i < 1000; ++i)
+            {
+                float time = i < 2 ? i * SHORT_LENGTH : Random(SHORT_LENGTH);
+                i32 index = 0;
+                i32 compressed_index = 0;
+                Vector3 position, compressed_position;
+                Quaternion rotation, compressed_rotation;
+                Vector3 scale, compressed_scale;
+
+                assert(track.Sample(time, SHORT_LENGTH, looped, index, position, rotation, scale));
+                assert(compressed.Sample(time, SHORT_LENGTH, looped, compressed_index, compressed_position,
+                    compressed_rotation, compressed_scale));
+
+                // Между сэмплами интерполяция линейная, поэтому допуск больше
+                assert((position - compressed_position).Length() < 0.05f);
+                assert(Abs(rotation.DotProduct(compressed_rotation)) > 0.999f);
+            }
+        }
+
+        // В конце зацикленной анимации поза совпадает с первым ключом
+        i32 index = 0;
+        Vector3 position, scale;
+        Quaternion rotation;
+        assert(compressed.Sample(SHORT_LENGTH, SHORT_LENGTH, true, index, position, rotation, scale));
+        assert((position - track.keyFrames_[0].position_).Length() < 0.001f);
+
+        // Сохранение и загрузка сохраняют дополнительные сэмплы
+        VectorBuffer buffer;
+        compressed.SaveCompressed(buffer);
+        buffer.Seek(0);
+
+        AnimationTrack loaded;
+        loaded.channelMask_ = compressed.channelMask_;
+        assert(loaded.LoadCompressed(buffer));
+        assert(loaded.numLoopSamples_ == compressed.numLoopSamples_);
+        assert(loaded.samples_ == compressed.samples_);
+    }
+
+    // Огромное число сэмплов в заголовке отвергается до выделения памяти
+    {
+        VectorBuffer buffer;
+        buffer.WriteI32(1 << 28);
+        buffer.WriteI32(0);
+        buffer.WriteFloat(30.f);
+        buffer.WriteU8(0);
+        buffer.WriteQuaternion(Quaternion::IDENTITY);
+        buffer.WriteI32(3 << 28);
+        buffer.Seek(0);
+
+        AnimationTrack broken;
+        broken.channelMask_ = AnimationChannels::Rotation;
+        assert(!broken.LoadCompressed(buffer));
+        assert(broken.samples_.Capacity() == 0);
+    }
+
+    // Дорожка из одного ключа становится постоянной
+    {
+        AnimationTrack track;
+        track.channelMask_ = AnimationChannels::Rotation;
+        AnimationKeyFrame key_frame;
+        key_frame.rotation_ = Quaternion(30.f, Vector3::UP);
+        track.AddKeyFrame(key_frame);
+        track.Compress(LENGTH);
+
+        assert(track.constantChannels_ == (AnimationChannels::Position | AnimationChannels::Rotation | AnimationChannels::Scale));
+        assert(track.samples_.Empty());
+
+        i32 index = 0;
+        Vector3 position, scale;
+        Quaternion rotation;
+        assert(track.Sample(1.f, LENGTH, true, index, position, rotation, scale));
+        assert(rotation == key_frame.rotation_);
+    }
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/billboard_set.h>
+#include <dviglo/math/random.h>
+
+#include <cstring>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const i32 NUM_BILLBOARDS = 50;
+
+// Скалярная запись вершин, как до SIMD-версии
+void write_reference(float* dest, const Billboard& billboard, const Vector3& scale, bool fixed_screen_size)
+{
+    Vector2 size(billboard.size_.x * scale.x, billboard.size_.y * scale.y);
+    color32 color = billboard.color_.ToU32();
+    if (fixed_screen_size)
+        size *= billboard.screenScaleFactor_;
+
+    float rotation[2][2];
+    SinCos(billboard.rotation_, rotation[0][1], rotation[0][0]);
+    rotation[1][0] = -rotation[0][1];
+    rotation[1][1] = rotation[0][0];
+
+    const float corner_uv[4][2] =
+    {
+        {billboard.uv_.min_.x, billboard.uv_.min_.y},
+        {billboard.uv_.max_.x, billboard.uv_.min_.y},
+        {billboard.uv_.max_.x, billboard.uv_.max_.y},
+        {billboard.uv_.min_.x, billboard.uv_.max_.y}
+    };
+    const float corner_signs[4][2] = {{-1.f, 1.f}, {1.f, 1.f}, {1.f, -1.f}, {-1.f, -1.f}};
+
+    for (i32 i = 0; i < 4; ++i)
+    {
+        float sx = corner_signs[i][0] * size.x;
+        float sy = corner_signs[i][1] * size.y;
+        dest[0] = billboard.position_.x;
+        dest[1] = billboard.position_.y;
+        dest[2] = billboard.position_.z;
+        memcpy(&dest[3], &color, sizeof(color));
+        dest[4] = corner_uv[i][0];
+        dest[5] = corner_uv[i][1];
+        dest[6] = sx * rotation[0][0] + sy * rotation[0][1];
+        dest[7] = sx * rotation[1][0] + sy * rotation[1][1];
+        dest += 8;
+    }
+}
+
+} // namespace
+
+void test_graphics_billboard_vertices()
+{
+    set_random_seed(1);
+
+    Vector<Billboard> billboards(NUM_BILLBOARDS);
+    Vector<Billboard*> pointers;
+    for (i32 i = 0; i < NUM_BILLBOARDS; ++i)
+    {
+        Billboard& billboard = billboards[i];
+        billboard.position_ = Vector3(Random(-10.f, 10.f), Random(-10.f, 10.f), Random(-10.f, 10.f));
+        billboard.size_ = Vector2(Random(0.1f, 3.f), Random(0.1f, 3.f));
+        billboard.uv_ = Rect(Random(0.5f), Random(0.5f), Random(0.5f, 1.f), Random(0.5f, 1.f));
+        billboard.color_ = Color(Random(1.f), Random(1.f), Random(1.f), Random(1.f));
+        // Каждый четвёртый без поворота
+        billboard.rotation_ = i % 4 ? Random(-360.f, 360.f) : 0.f;
+        billboard.screenScaleFactor_ = Random(0.5f, 2.f);
+        billboard.enabled_ = true;
+        pointers.Push(&billboard);
+    }
+
+    const Vector3 scale(2.f, 0.5f, 1.f);
+
+    for (bool fixed_screen_size : {false, true})
+    {
+        Vector<float> vertices(NUM_BILLBOARDS * 32, 0.f);
+        WriteBillboardVertices(&vertices[0], &pointers[0], NUM_BILLBOARDS, scale, fixed_screen_size);
+
+        Vector<float> expected(NUM_BILLBOARDS * 32, 0.f);
+        for (i32 i = 0; i < NUM_BILLBOARDS; ++i)
+            write_reference(&expected[i * 32], billboards[i], scale, fixed_screen_size);
+
+        // Результат совпадает побитово
+        assert(memcmp(&vertices[0], &expected[0], vertices.Size() * sizeof(float)) == 0);
+    }
+
+    // Сортировка от дальних к ближним по ключам расстояний
+    Vector<RadixSortItem> items;
+    for (i32 i = 0; i < NUM_BILLBOARDS; ++i)
+        items.Push(RadixSortItem{~(u64)FloatToRadixKey(billboards[i].position_.LengthSquared()) & 0xffffffffu, i});
+
+    Vector<RadixSortItem> temp(items.Size());
+    RadixSort(&items[0], &temp[0], items.Size(), sizeof(u32));
+    for (i32 i = 1; i < items.Size(); ++i)
+        assert(billboards[items[i - 1].index_].position_.LengthSquared() >= billboards[items[i].index_].position_.LengthSquared());
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/cdlod_quadtree.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+// Размер не кратен размеру патча, чтобы проверить узлы на краю карты высот
+const IntVector2 NUM_VERTICES(1001, 777);
+const i32 PATCH_SIZE = 32;
+
+// Проверяет, что узлы покрывают карту высот без пропусков и наложений
+bool covers_without_overlap(const CdlodQuadtree& quadtree, const Vector<CdlodNode>& nodes)
+{
+    const IntVector2 num_quads = NUM_VERTICES - IntVector2::ONE;
+    Vector<u8> covered(num_quads.x * num_quads.y, 0);
+
+    for (const CdlodNode& node : nodes)
+    {
+        if (!quadtree.IsValid(node))
+            return false;
+
+        IntVector2 start = quadtree.GetNodeOrigin(node);
+        i32 size = PATCH_SIZE << node.level_;
+
+        for (i32 z = start.y; z < Min(start.y + size, num_quads.y); ++z)
+        {
+            for (i32 x = start.x; x < Min(start.x + size, num_quads.x); ++x)
+            {
+                if (covered[z * num_quads.x + x])
+                    return false;
+
+                covered[z * num_quads.x + x] = 1;
+            }
+        }
+    }
+
+    for (u8 value : covered)
+    {
+        if (!value)
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+void test_graphics_cdlod_quadtree()
+{
+    CdlodQuadtree quadtree;
+    quadtree.Define(NUM_VERTICES, PATCH_SIZE, Vector3(1.f, 0.25f, 1.f), 0.f, 64.f);
+
+    // Корень (32 << 5 = 1024 квада) покрывает всю карту высот
+    assert(quadtree.GetNumLevels() == 6);
+    assert(quadtree.GetRoot().level_ == 5);
+    assert(quadtree.GetOrigin() == Vector2(-500.f, -388.f));
+    assert(quadtree.GetNodeBox(quadtree.GetRoot()).min_ == Vector3(-500.f, 0.f, -388.f));
+    assert(quadtree.GetNodeBox(quadtree.GetRoot()).max_ == Vector3(500.f, 64.f, 388.f));
+    assert(!quadtree.IsValid(CdlodNode{0, IntVector2(32, 0)}));
+    assert(quadtree.IsValid(CdlodNode{0, IntVector2(31, 24)}));
+    assert((CdlodNode{0, IntVector2(7, 5)}.GetParent() == CdlodNode{1, IntVector2(3, 2)}));
+
+    // Без ограничения дальности узлы покрывают весь ландшафт, а уровень узлов растёт с расстоянием
+    const Vector3 view_position(-400.f, 10.f, -300.f);
+    const float lod_distance = 40.f;
+    Vector<CdlodNode> selected;
+    quadtree.Select(view_position, lod_distance, 0.f, selected);
+    assert(covers_without_overlap(quadtree, selected));
+
+    bool has_detailed_node = false;
+    for (const CdlodNode& node : selected)
+    {
+        float distance = quadtree.GetNodeDistance(node, view_position);
+        if (node.level_ > 0)
+            assert(distance >= lod_distance * (float)(1 << (node.level_ - 1)));
+        if (node.level_ == 0 && distance == 0.f)
+            has_detailed_node = true;
+    }
+    assert(has_detailed_node);
+
+    // Дальность видимости ограничивает число узлов
+    Vector<CdlodNode> near_nodes;
+    quadtree.Select(view_position, lod_distance, 200.f, near_nodes);
+    assert(!near_nodes.Empty() && near_nodes.Size() < selected.Size());
+    for (const CdlodNode& node : near_nodes)
+        assert(quadtree.GetNodeDistance(node, view_position) <= 200.f);
+
+    // Все узлы загружены
+    HashSet<u64> resident;
+    resident.Insert(quadtree.GetRoot().GetKey());
+    for (const CdlodNode& node : selected)
+        resident.Insert(node.GetKey());
+
+    Vector<CdlodNode> drawn;
+    quadtree.ResolveResident(selected, resident, drawn);
+    assert(drawn == selected);
+
+    // Незагруженный узел заменяется загруженным родителем, который закрывает и соседние узлы
+    CdlodNode missing = selected[0];
+    for (const CdlodNode& node : selected)
+    {
+        if (node.level_ == 0)
+            missing = node;
+    }
+    CdlodNode parent = missing.GetParent();
+    resident.Erase(missing.GetKey());
+    resident.Insert(parent.GetKey());
+
+    drawn.Clear();
+    quadtree.ResolveResident(selected, resident, drawn);
+    assert(drawn.Contains(parent));
+    assert(!drawn.Contains(missing));
+    for (const CdlodNode& node : drawn)
+        assert(node.level_ >= 1 || node.GetParent() != parent);
+    assert(covers_without_overlap(quadtree, drawn));
+
+    // Без загруженного родителя остаётся только корень
+    resident.Erase(parent.GetKey());
+    drawn.Clear();
+    quadtree.ResolveResident(selected, resident, drawn);
+    assert(drawn.Size() == 1 && drawn[0] == quadtree.GetRoot());
+
+    // Ничего не загружено
+    drawn.Clear();
+    quadtree.ResolveResident(selected, HashSet<u64>(), drawn);
+    assert(drawn.Empty());
+}
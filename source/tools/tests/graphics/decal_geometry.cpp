@@ -0,0 +1,219 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/decal_geometry.h>
+#include <dviglo/math/random.h>
+
+#include <memory>
+#include <thread>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+// Число квадратов сетки по каждой оси
+const i32 GRID_SIZE = 32;
+
+// Вершина сетки: позиция и нормаль подряд
+struct GridVertex
+{
+    Vector3 position;
+    Vector3 normal;
+};
+
+// Холмистая сетка в плоскости XZ с 16-битными индексами
+void create_grid(Vector<GridVertex>& vertices, Vector<unsigned short>& indices)
+{
+    for (i32 z = 0; z <= GRID_SIZE; ++z)
+    {
+        for (i32 x = 0; x <= GRID_SIZE; ++x)
+        {
+            float height = Sin(x * 20.f) * Cos(z * 15.f) * 0.5f;
+            vertices.Push({Vector3((float)x, height, (float)z), Vector3(-height * 0.2f, 1.f, 0.f).normalized()});
+        }
+    }
+
+    for (i32 z = 0; z < GRID_SIZE; ++z)
+    {
+        for (i32 x = 0; x < GRID_SIZE; ++x)
+        {
+            unsigned short i = (unsigned short)(z * (GRID_SIZE + 1) + x);
+            unsigned short row = GRID_SIZE + 1;
+            indices.Push(i);
+            indices.Push(i + row);
+            indices.Push(i + 1);
+            indices.Push(i + 1);
+            indices.Push(i + row);
+            indices.Push(i + row + 1);
+        }
+    }
+}
+
+DecalGeometrySource make_source(const Vector<GridVertex>& vertices, const Vector<unsigned short>& indices)
+{
+    DecalGeometrySource source;
+    source.positionData_ = (const byte*)vertices.Buffer();
+    source.normalData_ = (const byte*)vertices.Buffer() + offsetof(GridVertex, normal);
+    source.indexData_ = (const byte*)indices.Buffer();
+    source.positionStride_ = sizeof(GridVertex);
+    source.normalStride_ = sizeof(GridVertex);
+    source.indexStride_ = sizeof(unsigned short);
+    source.indexCount_ = indices.Size();
+    source.vertexCount_ = vertices.Size();
+    return source;
+}
+
+// Декаль, смотрящая сверху вниз на случайную точку сетки
+DecalRequest make_request(const shared_ptr<DecalGeometryData>& data)
+{
+    DecalRequest request;
+    Vector3 position(Random(2.f, GRID_SIZE - 2.f), 0.f, Random(2.f, GRID_SIZE - 2.f));
+    Quaternion rotation(90.f, Random(360.f), 0.f);
+    request.Define(Matrix3x4::IDENTITY, position, rotation, Random(0.5f, 4.f), Random(0.5f, 2.f), 2.f);
+    request.transform_ = Matrix3x4::IDENTITY;
+    request.topLeftUV_ = Vector2::ZERO;
+    request.bottomRightUV_ = Vector2::ONE;
+    request.normalCutoff_ = 0.1f;
+    request.geometries_.Push(data);
+    return request;
+}
+
+bool equal_decals(const Decal& a, const Decal& b)
+{
+    if (a.vertices_.Size() != b.vertices_.Size() || a.indices_ != b.indices_)
+        return false;
+
+    for (i32 i = 0; i < a.vertices_.Size(); ++i)
+    {
+        const DecalVertex& va = a.vertices_[i];
+        const DecalVertex& vb = b.vertices_[i];
+        if (va.position_ != vb.position_ || va.normal_ != vb.normal_ || va.texCoord_ != vb.texCoord_ ||
+            va.tangent_ != vb.tangent_)
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+void test_graphics_decal_geometry()
+{
+    set_random_seed(1);
+
+    Vector<GridVertex> vertices;
+    Vector<unsigned short> indices;
+    create_grid(vertices, indices);
+    DecalGeometrySource source = make_source(vertices, indices);
+
+    shared_ptr<DecalGeometryData> data = make_shared<DecalGeometryData>();
+    assert(data->Define(source));
+    assert(data->IsValid(source));
+    assert(data->indices_.Size() == GRID_SIZE * GRID_SIZE * 6);
+
+    // Треугольники, найденные иерархией, должны совпадать с полным перебором
+    for (i32 i = 0; i < 20; ++i)
+    {
+        DecalRequest request = make_request(data);
+
+        Vector<Vector<DecalVertex>> faces;
+        data->GetFaces(faces, request.frustum_, request.decalNormal_, request.normalCutoff_);
+
+        Vector<Vector<DecalVertex>> expected;
+        for (i32 j = 0; j < indices.Size(); j += 3)
+        {
+            const GridVertex& v0 = vertices[indices[j]];
+            const GridVertex& v1 = vertices[indices[j + 1]];
+            const GridVertex& v2 = vertices[indices[j + 2]];
+            if (request.decalNormal_.DotProduct((v0.normal + v1.normal + v2.normal) / 3.f) < request.normalCutoff_)
+                continue;
+
+            bool culled = false;
+            for (const Plane& plane : request.frustum_.planes_)
+            {
+                culled = plane.Distance(v0.position) < 0.f && plane.Distance(v1.position) < 0.f &&
+                    plane.Distance(v2.position) < 0.f;
+                if (culled)
+                    break;
+            }
+
+            if (!culled)
+                expected.Push({DecalVertex(v0.position, v0.normal), DecalVertex(v1.position, v1.normal), DecalVertex(v2.position, v2.normal)});
+        }
+
+        assert(!expected.Empty());
+        assert(faces.Size() == expected.Size());
+        for (i32 j = 0; j < faces.Size(); ++j)
+        {
+            for (i32 k = 0; k < 3; ++k)
+                assert(faces[j][k].position_ == expected[j][k].position_ && faces[j][k].normal_ == expected[j][k].normal_);
+        }
+    }
+
+    // Отсечение в рабочем потоке должно давать те же вершины, что и синхронное.
+    // Новая копия геометрии, чтобы иерархия строилась одновременно из двух потоков
+    data = make_shared<DecalGeometryData>();
+    assert(data->Define(source));
+
+    DecalClipJob job;
+    for (i32 i = 0; i < 50; ++i)
+        job.requests_.Push(make_request(data));
+
+    job.item_ = new WorkItem();
+    job.item_->workFunction_ = ClipDecalsWork;
+    job.item_->aux_ = &job;
+
+    thread worker([&job]()
+    {
+        job.item_->workFunction_(job.item_.Get(), 1);
+        job.item_->completed_ = true;
+    });
+
+    Vector<Decal> expected(job.requests_.Size());
+    for (i32 i = 0; i < job.requests_.Size(); ++i)
+        ClipDecal(expected[i], job.requests_[i]);
+
+    worker.join();
+    assert(job.item_->completed_);
+    assert(job.results_.Size() == expected.Size());
+
+    i32 numHits = 0;
+    for (i32 i = 0; i < expected.Size(); ++i)
+    {
+        assert(equal_decals(job.results_[i], expected[i]));
+        if (!expected[i].vertices_.Empty())
+            ++numHits;
+    }
+
+    assert(numHits == expected.Size());
+
+    // Копия устаревает, когда у геометрии меняются данные или диапазон отрисовки
+    DecalGeometrySource changed = source;
+    changed.indexCount_ -= 6;
+    assert(!data->IsValid(changed));
+
+    changed = source;
+    changed.indexStart_ = 6;
+    assert(!data->IsValid(changed));
+
+    Vector<GridVertex> reallocated = vertices;
+    changed = make_source(reallocated, indices);
+    assert(!data->IsValid(changed));
+
+    changed = source;
+    changed.normalData_ = nullptr;
+    assert(!data->IsValid(changed));
+
+    assert(data->IsValid(make_source(vertices, indices)));
+
+    // Без позиций копию сделать нельзя
+    DecalGeometryData empty;
+    assert(!empty.Define(DecalGeometrySource()));
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/draw_command_buffer.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+void test_graphics_draw_command_buffer()
+{
+    // Запись не обращается к Graphics, поэтому указатели на шейдеры и геометрию не разыменовываются
+    ShaderVariation* vs = reinterpret_cast<ShaderVariation*>(0x10);
+    ShaderVariation* ps = reinterpret_cast<ShaderVariation*>(0x20);
+    Geometry* geometry = reinterpret_cast<Geometry*>(0x30);
+    Texture* texture = reinterpret_cast<Texture*>(0x40);
+    Matrix3x4 transforms[2];
+
+    DrawCommandBuffer commands;
+    assert(commands.IsEmpty());
+
+    // Одинаковые состояния подряд записываются один раз
+    commands.SetShaders(vs, ps);
+    commands.SetBlendMode(BLEND_REPLACE, false);
+    commands.SetTexture(TU_DIFFUSE, texture);
+    if (commands.BeginParameterGroup(SP_OBJECT, &transforms[0]))
+    {
+        commands.SetShaderParameter(VSP_MODEL, transforms[0]);
+        commands.EndParameterGroup();
+    }
+    commands.Draw(geometry);
+    i32 numCommands = commands.GetNumCommands();
+    assert(numCommands == 6);
+
+    commands.SetShaders(vs, ps);
+    commands.SetBlendMode(BLEND_REPLACE, false);
+    commands.SetTexture(TU_DIFFUSE, texture);
+    assert(!commands.BeginParameterGroup(SP_OBJECT, &transforms[0]));
+    commands.Draw(geometry);
+    assert(commands.GetNumCommands() == numCommands + 1);
+
+    // Другой источник группы параметров записывается вместе с параметрами
+    assert(commands.BeginParameterGroup(SP_OBJECT, &transforms[1]));
+    commands.SetShaderParameter(VSP_MODEL, transforms[1]);
+    commands.EndParameterGroup();
+    assert(commands.GetCommands()[numCommands + 1].type_ == DCMD_PARAMETERGROUP);
+    assert(commands.GetCommands()[numCommands + 1].args_[1] == 1);
+
+    // После смены шейдеров текстуры и группы параметров записываются снова
+    numCommands = commands.GetNumCommands();
+    commands.SetShaders(ps, vs);
+    commands.SetBlendMode(BLEND_ADD, false);
+    commands.SetTexture(TU_DIFFUSE, texture);
+    assert(commands.BeginParameterGroup(SP_OBJECT, &transforms[1]));
+    commands.EndParameterGroup();
+    assert(commands.GetNumCommands() == numCommands + 4);
+    assert(commands.GetNumDraws() == 2);
+
+    commands.Clear();
+    assert(commands.IsEmpty() && commands.GetNumDraws() == 0);
+    commands.SetShaders(vs, ps);
+    assert(commands.GetNumCommands() == 1);
+}
@@ -0,0 +1,214 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/core/context.h>
+#include <dviglo/graphics/drawable.h>
+#include <dviglo/graphics/dynamic_aabb_tree.h>
+#include <dviglo/math/random.h>
+
+#include <algorithm>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 NUM_SLOTS = 500;
+const i32 NUM_STEPS = 4000;
+
+// Объект с заданным мировым ограничивающим боксом без узла сцены
+class BoxDrawable : public Drawable
+{
+public:
+    BoxDrawable() : Drawable(DrawableTypes::Geometry) {}
+
+    void set_box(const BoundingBox& box)
+    {
+        worldBoundingBox_ = box;
+        worldBoundingBoxDirty_ = false;
+    }
+
+protected:
+    void OnWorldBoundingBoxUpdate() override {}
+};
+
+BoundingBox random_box(const Vector3& center)
+{
+    Vector3 half_size(Random(0.5f, 5.f), Random(0.5f, 5.f), Random(0.5f, 5.f));
+    return BoundingBox(center - half_size, center + half_size);
+}
+
+Vector3 random_position()
+{
+    return Vector3(Random(-200.f, 200.f), Random(-20.f, 20.f), Random(-200.f, 200.f));
+}
+
+// Сравнивает результаты запросов к дереву с перебором всех живых объектов
+void check_queries(const DynamicAabbTree& tree, const Vector<SharedPtr<BoxDrawable>>& drawables, const Vector<i32>& proxies)
+{
+    Vector<Drawable*> alive;
+    for (i32 i = 0; i < NUM_SLOTS; ++i)
+    {
+        if (proxies[i] != NINDEX)
+            alive.Push(drawables[i]);
+    }
+
+    assert(tree.GetNumProxies() == alive.Size());
+
+    for (i32 i = 0; i < NUM_SLOTS; ++i)
+    {
+        if (proxies[i] == NINDEX)
+            continue;
+
+        // Увеличенный бокс листа содержит точный бокс объекта
+        assert(tree.GetDrawable(proxies[i]) == drawables[i]);
+        assert(tree.GetProxyBox(proxies[i]).IsInside(drawables[i]->GetWorldBoundingBox()) == INSIDE);
+    }
+
+    // Бокс
+    {
+        BoundingBox box = random_box(random_position());
+        box.Merge(random_box(random_position()));
+
+        Vector<Drawable*> expected;
+        for (Drawable* drawable : alive)
+        {
+            if (box.IsInsideFast(drawable->GetWorldBoundingBox()) != OUTSIDE)
+                expected.Push(drawable);
+        }
+
+        Vector<Drawable*> result;
+        BoxOctreeQuery query(result, box);
+        tree.GetDrawables(query);
+        sort(expected.Begin(), expected.End());
+        sort(result.Begin(), result.End());
+        assert(result == expected);
+    }
+
+    // Пирамида видимости
+    {
+        Matrix3x4 transform(random_position(), Quaternion(Random(-30.f, 30.f), Random(360.f), 0.f), 1.f);
+        Frustum frustum;
+        frustum.Define(Random(30.f, 90.f), 16.f / 9.f, 1.f, 0.1f, Random(20.f, 300.f), transform);
+
+        Vector<Drawable*> expected;
+        for (Drawable* drawable : alive)
+        {
+            if (frustum.IsInsideFast(drawable->GetWorldBoundingBox()) != OUTSIDE)
+                expected.Push(drawable);
+        }
+
+        Vector<Drawable*> result;
+        FrustumOctreeQuery query(result, frustum);
+        tree.GetDrawables(query);
+        sort(expected.Begin(), expected.End());
+        sort(result.Begin(), result.End());
+        assert(result == expected);
+    }
+
+    // Луч
+    {
+        Ray ray(random_position(), Vector3(Random(-1.f, 1.f), Random(-0.2f, 0.2f), Random(-1.f, 1.f)).normalized());
+        float max_distance = Random(50.f, 500.f);
+
+        Vector<Drawable*> expected;
+        for (Drawable* drawable : alive)
+        {
+            if (ray.HitDistance(drawable->GetWorldBoundingBox()) < max_distance)
+                expected.Push(drawable);
+        }
+
+        Vector<RayQueryResult> results;
+        RayOctreeQuery query(results, ray, RAY_AABB, max_distance);
+        tree.Raycast(query);
+
+        Vector<Drawable*> result;
+        for (const RayQueryResult& ray_result : results)
+            result.Push(ray_result.drawable_);
+
+        Vector<Drawable*> only;
+        tree.GetDrawablesOnly(query, only);
+
+        sort(expected.Begin(), expected.End());
+        sort(result.Begin(), result.End());
+        assert(result == expected);
+
+        // Без проверки самих объектов - все объекты, которых коснулся луч, плюс, возможно, лишние
+        sort(only.Begin(), only.End());
+        for (Drawable* drawable : expected)
+            assert(binary_search(only.Begin(), only.End(), drawable));
+    }
+}
+
+} // namespace
+
+void test_graphics_dynamic_aabb_tree()
+{
+    // Объекты - наследники Object, им нужен контекст
+    Context context;
+
+    set_random_seed(1);
+
+    Vector<SharedPtr<BoxDrawable>> drawables;
+    for (i32 i = 0; i < NUM_SLOTS; ++i)
+        drawables.Push(SharedPtr<BoxDrawable>(new BoxDrawable()));
+
+    // Индекс прокси каждого объекта или NINDEX, если объекта нет в дереве
+    Vector<i32> proxies(NUM_SLOTS);
+    for (i32& proxy : proxies)
+        proxy = NINDEX;
+
+    DynamicAabbTree tree;
+    tree.SetMargin(1.f);
+    check_queries(tree, drawables, proxies);
+
+    // Случайные добавления, небольшие и большие перемещения и удаления
+    for (i32 step = 0; step < NUM_STEPS; ++step)
+    {
+        i32 slot = Random(NUM_SLOTS);
+        BoxDrawable* drawable = drawables[slot];
+        i32 action = Random(10);
+
+        if (proxies[slot] == NINDEX)
+        {
+            drawable->set_box(random_box(random_position()));
+            proxies[slot] = tree.CreateProxy(drawable->GetWorldBoundingBox(), drawable);
+        }
+        else if (action < 2)
+        {
+            tree.DestroyProxy(proxies[slot]);
+            proxies[slot] = NINDEX;
+        }
+        else
+        {
+            Vector3 center = drawable->GetWorldBoundingBox().Center();
+            if (action < 8)
+                center += Vector3(Random(-0.5f, 0.5f), Random(-0.5f, 0.5f), Random(-0.5f, 0.5f));
+            else
+                center = random_position();
+
+            drawable->set_box(random_box(center));
+            tree.MoveProxy(proxies[slot], drawable->GetWorldBoundingBox());
+        }
+
+        if (step % 100 == 99)
+        {
+            check_queries(tree, drawables, proxies);
+
+            // Дерево остаётся сбалансированным
+            assert(tree.GetHeight() < 30);
+        }
+    }
+
+    tree.Clear();
+    for (i32& proxy : proxies)
+        proxy = NINDEX;
+    check_queries(tree, drawables, proxies);
+    assert(tree.GetHeight() == 0);
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/instance_bvh.h>
+#include <dviglo/math/frustum.h>
+#include <dviglo/math/random.h>
+
+#include <algorithm>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+// Не кратно ни размеру листа, ни четырём, чтобы проверить хвосты SIMD-проверки
+const i32 NUM_INSTANCES = 1001;
+
+} // namespace
+
+void test_graphics_instance_bvh()
+{
+    set_random_seed(1);
+
+    // Лес: деревья разного размера на плоскости
+    Vector<BoundingBox> boxes;
+    for (i32 i = 0; i < NUM_INSTANCES; ++i)
+    {
+        Vector3 position(Random(-500.f, 500.f), 0.f, Random(-500.f, 500.f));
+        Vector3 half_size(Random(0.5f, 3.f), Random(2.f, 10.f), Random(0.5f, 3.f));
+        boxes.Push(BoundingBox(position - half_size, position + half_size));
+    }
+
+    InstanceBvh bvh;
+    bvh.Build(&boxes[0], boxes.Size());
+    assert(bvh.GetNumInstances() == NUM_INSTANCES);
+    assert(bvh.GetNodes()[0].count_ == NUM_INSTANCES);
+
+    // Результат должен в точности совпадать с проверкой каждого экземпляра по отдельности
+    for (i32 i = 0; i < 20; ++i)
+    {
+        Matrix3x4 transform(Vector3(Random(-300.f, 300.f), Random(1.f, 50.f), Random(-300.f, 300.f)),
+            Quaternion(Random(-30.f, 30.f), Random(360.f), 0.f), 1.f);
+        Frustum frustum;
+        frustum.Define(Random(30.f, 90.f), 16.f / 9.f, 1.f, 0.1f, Random(50.f, 800.f), transform);
+
+        Vector<i32> expected;
+        for (i32 j = 0; j < NUM_INSTANCES; ++j)
+        {
+            if (frustum.IsInsideFast(boxes[j]) != OUTSIDE)
+                expected.Push(j);
+        }
+
+        Vector<i32> visible;
+        bvh.Cull(frustum, visible);
+        sort(visible.Begin(), visible.End());
+        assert(visible == expected);
+    }
+
+    // Все экземпляры внутри и пустая иерархия
+    Frustum all;
+    all.Define(BoundingBox(-1000.f, 1000.f));
+    Vector<i32> visible;
+    bvh.Cull(all, visible);
+    assert(visible.Size() == NUM_INSTANCES);
+
+    bvh.Clear();
+    visible.Clear();
+    bvh.Cull(all, visible);
+    assert(visible.Empty());
+}
@@ -0,0 +1,143 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/containers/vector.h>
+#include <dviglo/graphics/mesh_optimizer.h>
+#include <dviglo/math/random.h>
+#include <dviglo/math/vector3.h>
+
+#include <algorithm>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 GRID_SIZE = 40;
+
+// Сетка квадратов, у каждого квадрата свои 4 вершины, треугольники перемешаны
+void create_grid(Vector<Vector3>& vertices, Vector<u32>& indices)
+{
+    for (i32 y = 0; y < GRID_SIZE; ++y)
+    {
+        for (i32 x = 0; x < GRID_SIZE; ++x)
+        {
+            u32 base = vertices.Size();
+            vertices.Push(Vector3((float)x, (float)y, 0.f));
+            vertices.Push(Vector3((float)x + 1.f, (float)y, 0.f));
+            vertices.Push(Vector3((float)x, (float)y + 1.f, 0.f));
+            vertices.Push(Vector3((float)x + 1.f, (float)y + 1.f, 0.f));
+
+            indices.Push(base);
+            indices.Push(base + 2);
+            indices.Push(base + 1);
+            indices.Push(base + 1);
+            indices.Push(base + 2);
+            indices.Push(base + 3);
+        }
+    }
+
+    for (i32 i = indices.Size() / 3 - 1; i > 0; --i)
+    {
+        i32 j = Random(i + 1);
+        for (i32 k = 0; k < 3; ++k)
+            swap(indices[i * 3 + k], indices[j * 3 + k]);
+    }
+}
+
+// Треугольники как отсортированный список вершин, чтобы сравнивать наборы треугольников
+Vector<Vector3> sorted_triangles(const Vector<Vector3>& vertices, const Vector<u32>& indices)
+{
+    Vector<Vector3> triangles;
+    for (u32 index : indices)
+        triangles.Push(vertices[index]);
+
+    auto less = [](const Vector3& lhs, const Vector3& rhs)
+    {
+        return lhs.x != rhs.x ? lhs.x < rhs.x : lhs.y != rhs.y ? lhs.y < rhs.y : lhs.z < rhs.z;
+    };
+
+    Vector<Vector<Vector3>> sorted;
+    for (i32 i = 0; i < triangles.Size(); i += 3)
+    {
+        Vector<Vector3> triangle{triangles[i], triangles[i + 1], triangles[i + 2]};
+        sort(triangle.Begin(), triangle.End(), less);
+        sorted.Push(triangle);
+    }
+    sort(sorted.Begin(), sorted.End(), [&](const Vector<Vector3>& lhs, const Vector<Vector3>& rhs)
+    {
+        return lexicographical_compare(lhs.Begin(), lhs.End(), rhs.Begin(), rhs.End(), less);
+    });
+
+    Vector<Vector3> result;
+    for (const Vector<Vector3>& triangle : sorted)
+        result.Push(triangle);
+    return result;
+}
+
+} // namespace
+
+void test_graphics_mesh_optimizer()
+{
+    set_random_seed(1);
+
+    Vector<Vector3> vertices;
+    Vector<u32> indices;
+    create_grid(vertices, indices);
+    const Vector<Vector3> original_triangles = sorted_triangles(vertices, indices);
+
+    // Совпадающие вершины соседних квадратов объединяются
+    Vector<i32> remap(vertices.Size());
+    i32 unique_count = GenerateVertexRemap(&remap[0], (const byte*)&vertices[0], vertices.Size(), sizeof(Vector3));
+    assert(unique_count == (GRID_SIZE + 1) * (GRID_SIZE + 1));
+
+    Vector<Vector3> merged(unique_count);
+    RemapVertices((byte*)&merged[0], (const byte*)&vertices[0], vertices.Size(), sizeof(Vector3), &remap[0]);
+    RemapIndices(&indices[0], indices.Size(), &remap[0]);
+    vertices = merged;
+    assert(sorted_triangles(vertices, indices) == original_triangles);
+
+    // Перемешанные треугольники почти не используют кэш
+    const float shuffled_acmr = CalculateACMR(&indices[0], indices.Size(), vertices.Size());
+    assert(shuffled_acmr > 2.f);
+
+    // Оптимизация для кэша вершин не теряет треугольники
+    OptimizeVertexCache(&indices[0], indices.Size(), vertices.Size());
+    const float cache_acmr = CalculateACMR(&indices[0], indices.Size(), vertices.Size());
+    assert(cache_acmr < 0.8f);
+    assert(sorted_triangles(vertices, indices) == original_triangles);
+
+    // Сортировка кластеров почти не ухудшает ACMR
+    OptimizeOverdraw(&indices[0], indices.Size(), (const byte*)&vertices[0], sizeof(Vector3), vertices.Size());
+    const float overdraw_acmr = CalculateACMR(&indices[0], indices.Size(), vertices.Size());
+    assert(overdraw_acmr <= cache_acmr * 1.1f);
+    assert(sorted_triangles(vertices, indices) == original_triangles);
+
+    // После переупорядочивания вершины идут в порядке первого использования, неиспользуемые удаляются
+    vertices.Push(Vector3(100.f, 100.f, 100.f));
+    remap.Resize(vertices.Size());
+    i32 used_count = GenerateVertexFetchRemap(&remap[0], &indices[0], indices.Size(), vertices.Size());
+    assert(used_count == vertices.Size() - 1);
+    assert(remap.Back() == NINDEX);
+
+    Vector<Vector3> reordered(used_count);
+    RemapVertices((byte*)&reordered[0], (const byte*)&vertices[0], vertices.Size(), sizeof(Vector3), &remap[0]);
+    RemapIndices(&indices[0], indices.Size(), &remap[0]);
+    vertices = reordered;
+    assert(sorted_triangles(vertices, indices) == original_triangles);
+    assert(CalculateACMR(&indices[0], indices.Size(), vertices.Size()) == overdraw_acmr);
+
+    u32 next_vertex = 0;
+    for (u32 index : indices)
+    {
+        assert(index <= next_vertex);
+        if (index == next_vertex)
+            ++next_vertex;
+    }
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/containers/vector.h>
+#include <dviglo/graphics/mesh_simplifier.h>
+#include <dviglo/math/random.h>
+#include <dviglo/math/vector3.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 GRID_SIZE = 20;
+
+// Сетка из двух половин, вершины на шве между половинами продублированы (как при разрыве UV)
+void create_grid(Vector<Vector3>& vertices, Vector<u32>& indices, bool bumpy)
+{
+    const i32 seam = GRID_SIZE / 2;
+
+    auto vertex_index = [&](i32 x, i32 y, bool right_half)
+    {
+        i32 index = y * (GRID_SIZE + 1) + x;
+        if (x == seam && right_half)
+            index = (GRID_SIZE + 1) * (GRID_SIZE + 1) + y;
+        return (u32)index;
+    };
+
+    for (i32 y = 0; y <= GRID_SIZE; ++y)
+    {
+        for (i32 x = 0; x <= GRID_SIZE; ++x)
+        {
+            float z = bumpy ? Random(1.f) : 0.f;
+            vertices.Push(Vector3((float)x, (float)y, z));
+        }
+    }
+    for (i32 y = 0; y <= GRID_SIZE; ++y)
+        vertices.Push(vertices[y * (GRID_SIZE + 1) + seam]);
+
+    for (i32 y = 0; y < GRID_SIZE; ++y)
+    {
+        for (i32 x = 0; x < GRID_SIZE; ++x)
+        {
+            bool right_half = x >= seam;
+            indices.Push(vertex_index(x, y, right_half));
+            indices.Push(vertex_index(x + 1, y, right_half));
+            indices.Push(vertex_index(x, y + 1, right_half));
+            indices.Push(vertex_index(x + 1, y, right_half));
+            indices.Push(vertex_index(x + 1, y + 1, right_half));
+            indices.Push(vertex_index(x, y + 1, right_half));
+        }
+    }
+}
+
+// Площадь треугольников со знаком по оси Z, чтобы заметить вывернутые треугольники
+float signed_area(const Vector<Vector3>& vertices, const u32* indices, i32 index_count)
+{
+    float area = 0.f;
+    for (i32 i = 0; i < index_count; i += 3)
+    {
+        const Vector3& p0 = vertices[indices[i]];
+        area += (vertices[indices[i + 1]] - p0).CrossProduct(vertices[indices[i + 2]] - p0).z * 0.5f;
+    }
+    return area;
+}
+
+} // namespace
+
+void test_graphics_mesh_simplifier()
+{
+    set_random_seed(1);
+
+    // Плоская сетка упрощается, края и шов остаются на месте
+    {
+        Vector<Vector3> vertices;
+        Vector<u32> indices;
+        create_grid(vertices, indices, false);
+        const float area = signed_area(vertices, &indices[0], indices.Size());
+
+        Vector<u32> simplified(indices.Size());
+        float error = -1.f;
+        i32 count = SimplifyMesh(&simplified[0], &indices[0], indices.Size(), (const byte*)&vertices[0], sizeof(Vector3),
+            vertices.Size(), indices.Size() / 4, 1.f, &error);
+
+        assert(count <= indices.Size() / 4);
+        assert(count > 0 && count % 3 == 0);
+        assert(error == 0.f);
+
+        Vector<bool> used(vertices.Size(), false);
+        for (i32 i = 0; i < count; i += 3)
+        {
+            for (i32 j = 0; j < 3; ++j)
+            {
+                assert(simplified[i + j] < (u32)vertices.Size());
+                used[simplified[i + j]] = true;
+            }
+            assert(simplified[i] != simplified[i + 1] && simplified[i + 1] != simplified[i + 2] &&
+                simplified[i] != simplified[i + 2]);
+        }
+
+        // Площадь не меняется, если ни один треугольник не вывернулся
+        assert(Abs(signed_area(vertices, &simplified[0], count) - area) < 0.01f);
+
+        // Вершины шва и углы сетки используются
+        for (i32 y = 0; y <= GRID_SIZE; ++y)
+        {
+            assert(used[y * (GRID_SIZE + 1) + GRID_SIZE / 2]);
+            assert(used[(GRID_SIZE + 1) * (GRID_SIZE + 1) + y]);
+        }
+        assert(used[0] && used[GRID_SIZE] && used[GRID_SIZE * (GRID_SIZE + 1)] && used[(GRID_SIZE + 1) * (GRID_SIZE + 1) - 1]);
+    }
+
+    // На неровной сетке упрощение ограничено допустимой ошибкой
+    {
+        Vector<Vector3> vertices;
+        Vector<u32> indices;
+        create_grid(vertices, indices, true);
+
+        Vector<u32> simplified(indices.Size());
+        float error = 0.f;
+        i32 strict_count = SimplifyMesh(&simplified[0], &indices[0], indices.Size(), (const byte*)&vertices[0],
+            sizeof(Vector3), vertices.Size(), 0, 0.001f, &error);
+        assert(error <= 0.001f);
+
+        i32 loose_count = SimplifyMesh(&simplified[0], &indices[0], indices.Size(), (const byte*)&vertices[0],
+            sizeof(Vector3), vertices.Size(), 0, 1.f, &error);
+        assert(loose_count < strict_count);
+        assert(strict_count > indices.Size() / 2);
+
+        // Индексы можно упрощать на месте
+        Vector<u32> in_place = indices;
+        i32 in_place_count = SimplifyMesh(&in_place[0], &in_place[0], in_place.Size(), (const byte*)&vertices[0],
+            sizeof(Vector3), vertices.Size(), 0, 1.f);
+        assert(in_place_count == loose_count);
+        for (i32 i = 0; i < loose_count; ++i)
+            assert(in_place[i] == simplified[i]);
+    }
+}
@@ -0,0 +1,282 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/core/context.h>
+#include <dviglo/graphics/camera.h>
+#include <dviglo/graphics/drawable.h>
+#include <dviglo/graphics/occlusion_buffer.h>
+#include <dviglo/io/log.h>
+#include <dviglo/math/random.h>
+#include <dviglo/scene/node.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+const i32 WIDTH = 256;
+const i32 HEIGHT = 128;
+
+// Расстояние до стены
+const float WALL_Z = 10.f;
+
+// Стена в плоскости XY, смотрит на камеру
+Vector<Vector3> create_wall(float half_width, float half_height)
+{
+    return {
+        Vector3(-half_width, -half_height, WALL_Z), Vector3(-half_width, half_height, WALL_Z), Vector3(half_width, half_height, WALL_Z),
+        Vector3(-half_width, -half_height, WALL_Z), Vector3(half_width, half_height, WALL_Z), Vector3(half_width, -half_height, WALL_Z)
+    };
+}
+
+void draw(OcclusionBuffer* buffer, Camera* camera, const Vector<Vector3>& vertices)
+{
+    buffer->SetView(camera);
+    buffer->SetCullMode(CULL_NONE);
+    buffer->Reset();
+    buffer->Clear();
+    if (vertices.Size())
+        buffer->AddTriangles(Matrix3x4::IDENTITY, vertices.Buffer(), sizeof(Vector3), 0, vertices.Size());
+    buffer->DrawTriangles();
+}
+
+// Результат не зависит от того, построена ли иерархия глубины
+bool is_visible(OcclusionBuffer* buffer, const BoundingBox& box)
+{
+    bool visible = buffer->IsVisible(box);
+    buffer->BuildDepthHierarchy();
+    assert(buffer->IsVisible(box) == visible);
+    return visible;
+}
+
+BoundingBox make_box(const Vector3& center, const Vector3& half_size)
+{
+    return BoundingBox(center - half_size, center + half_size);
+}
+
+// Единичный куб
+const Vector3 BOX_VERTICES[] =
+{
+    {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f},
+    {-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}
+};
+
+const u16 BOX_INDICES[] =
+{
+    0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5
+};
+
+// Окклюдер в виде куба, преобразованного узлом
+class BoxOccluder : public Drawable
+{
+public:
+    BoxOccluder() : Drawable(DrawableTypes::Geometry)
+    {
+        boundingBox_ = BoundingBox(-0.5f, 0.5f);
+    }
+
+    bool DrawOcclusion(OcclusionBuffer* buffer) override
+    {
+        buffer->SetCullMode(CULL_CCW);
+        return buffer->AddTriangles(node_->GetWorldTransform(), BOX_VERTICES, sizeof(Vector3), BOX_INDICES, sizeof(u16), 0, 36);
+    }
+
+protected:
+    void OnWorldBoundingBoxUpdate() override
+    {
+        worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+    }
+};
+
+// Камера движется по сцене из окклюдеров-кубов. Буфер, который использует глубину прошлых кадров,
+// не должен скрывать ни одного бокса, видимого при полной перерисовке
+void test_temporal()
+{
+    const i32 num_occluders = 100;
+    const i32 num_tests = 4000;
+    const i32 num_frames = 80;
+
+    // Узлы без сцены, компоненты создаются без фабрик
+    SharedPtr<Node> root(new Node());
+    Node* camera_node = root->create_child();
+    SharedPtr<Camera> camera(new Camera());
+    camera_node->AddComponent(camera, 0, LOCAL);
+    camera->SetFarClip(500.f);
+    camera->SetAspectRatio(16.f / 9.f);
+
+    Vector<Drawable*> occluders;
+    for (i32 i = 0; i < num_occluders; ++i)
+    {
+        Node* node = root->create_child();
+        node->SetPosition(Vector3(Random(-60.f, 60.f), Random(-20.f, 20.f), Random(5.f, 150.f)));
+        node->SetRotation(Quaternion(Random(360.f), Vector3::UP));
+        node->SetScale(Vector3(Random(1.f, 10.f), Random(1.f, 20.f), Random(1.f, 30.f)));
+        SharedPtr<BoxOccluder> occluder(new BoxOccluder());
+        node->AddComponent(occluder, 0, LOCAL);
+        occluders.Push(occluder);
+    }
+
+    Vector<BoundingBox> tests;
+    for (i32 i = 0; i < num_tests; ++i)
+        tests.Push(make_box(Vector3(Random(-200.f, 200.f), Random(-60.f, 60.f), Random(10.f, 450.f)), Vector3::ONE));
+
+    SharedPtr<OcclusionBuffer> buffer(new OcclusionBuffer());
+    SharedPtr<OcclusionBuffer> reference(new OcclusionBuffer());
+    assert(buffer->SetSize(256, 144, false));
+    assert(reference->SetSize(256, 144, false));
+    Vector<Drawable*> stable;
+    Vector<Drawable*> changed;
+    i32 num_reprojected = 0;
+
+    for (i32 frame = 0; frame < num_frames; ++frame)
+    {
+        // Плавное движение и поворот, прерываемые резким переносом камеры, резким поворотом и сменой угла обзора
+        Vector3 position(frame * 0.5f, 0.f, frame * 0.2f);
+        float yaw = frame * 0.2f;
+        if (frame >= 20)
+            position += Vector3(8.f, 0.f, 4.f);
+        if (frame >= 40)
+            yaw += 40.f;
+        camera_node->SetPosition(position);
+        camera_node->SetRotation(Quaternion(yaw, Vector3::UP));
+        camera->SetFov(frame >= 60 ? 50.f : 45.f);
+
+        // Часть окклюдеров движется
+        for (i32 i = 0; i < num_occluders; i += 10)
+            occluders[i]->GetNode()->Translate(Vector3(0.05f, 0.f, 0.f));
+
+        reference->SetView(camera);
+        reference->SetMaxTriangles(num_occluders * 12);
+        reference->Reset();
+        reference->Clear();
+        for (Drawable* occluder : occluders)
+            occluder->DrawOcclusion(reference);
+        reference->DrawTriangles();
+        reference->BuildDepthHierarchy();
+
+        // Каждый восьмой кадр глубина рисуется заново. Между ними перерисовку вызывают проверки движения камеры
+        buffer->SetView(camera);
+        buffer->SetMaxTriangles(num_occluders * 12);
+        buffer->Reset();
+        buffer->Clear();
+        bool reprojected = buffer->BeginTemporalFrame(occluders, 8, stable, changed);
+        for (Drawable* occluder : stable)
+            occluder->DrawOcclusion(buffer);
+        buffer->DrawTriangles();
+        if (!reprojected)
+            buffer->SaveTemporalDepth(stable, stable.Size());
+        for (Drawable* occluder : changed)
+            occluder->DrawOcclusion(buffer);
+        buffer->DrawTriangles();
+        buffer->BuildDepthHierarchy();
+
+        if (reprojected)
+            ++num_reprojected;
+
+        // После переноса, поворота и смены проекции глубина рисуется заново
+        if (frame == 0 || frame == 20 || frame == 40 || frame == 60)
+            assert(!reprojected);
+
+        for (const BoundingBox& box : tests)
+            assert(buffer->IsVisible(box) || !reference->IsVisible(box));
+    }
+
+    // Большую часть кадров камера движется плавно и глубина перепроецируется
+    assert(num_reprojected > num_frames / 2);
+}
+
+} // namespace
+
+void test_graphics_occlusion_buffer()
+{
+    // Буфер, камера и узлы - объекты, им нужен контекст. Буфер пишет в лог
+    Context context;
+    Log log;
+    log.SetQuiet(true);
+
+    set_random_seed(1);
+
+    // Камера в начале координат смотрит вдоль +Z
+    SharedPtr<Node> node(new Node());
+    SharedPtr<Camera> camera(new Camera());
+    node->AddComponent(camera, 0, LOCAL);
+    camera->SetFov(60.f);
+    camera->SetAspectRatio((float)WIDTH / HEIGHT);
+    camera->SetNearClip(0.1f);
+    camera->SetFarClip(100.f);
+
+    SharedPtr<OcclusionBuffer> buffer(new OcclusionBuffer());
+    assert(buffer->SetSize(WIDTH, HEIGHT, false));
+
+    // Пустой буфер ничего не скрывает
+    draw(buffer, camera, {});
+    assert(is_visible(buffer, make_box(Vector3(0.f, 0.f, 20.f), Vector3::ONE)));
+
+    // Стена 6x6 в середине экрана. За ней на расстоянии 20 скрыто всё, что проецируется в квадрат 12x12
+    draw(buffer, camera, create_wall(3.f, 3.f));
+
+    // Полностью за стеной
+    assert(!is_visible(buffer, make_box(Vector3(0.f, 0.f, 20.f), Vector3::ONE)));
+    assert(!is_visible(buffer, make_box(Vector3(4.f, -4.f, 20.f), Vector3(0.5f, 0.5f, 0.5f))));
+    assert(!is_visible(buffer, make_box(Vector3(0.f, 0.f, 90.f), Vector3(10.f, 10.f, 5.f))));
+
+    // Перед стеной и пересекает стену
+    assert(is_visible(buffer, make_box(Vector3(0.f, 0.f, 5.f), Vector3::ONE)));
+    assert(is_visible(buffer, make_box(Vector3(0.f, 0.f, WALL_Z), Vector3::ONE)));
+
+    // Частично выходит из-за края стены и полностью рядом со стеной
+    assert(is_visible(buffer, make_box(Vector3(6.f, 0.f, 20.f), Vector3::ONE)));
+    assert(is_visible(buffer, make_box(Vector3(0.f, 6.5f, 20.f), Vector3(2.f, 1.f, 1.f))));
+    assert(is_visible(buffer, make_box(Vector3(15.f, 0.f, 20.f), Vector3::ONE)));
+
+    // Пересекает ближнюю плоскость отсечения
+    assert(is_visible(buffer, make_box(Vector3::ZERO, Vector3::ONE)));
+
+    // Случайные боксы: результат должен совпадать с аналитическим везде, кроме полосы в пару пикселей у краёв стены
+    float pixel_size = 2.f * WALL_Z * tanf(30.f * M_DEGTORAD) / HEIGHT;
+    float margin = 3.f * pixel_size;
+    for (i32 i = 0; i < 5000; ++i)
+    {
+        BoundingBox box = make_box(Vector3(Random(-12.f, 12.f), Random(-6.f, 6.f), Random(0.5f, 60.f)),
+            Vector3(Random(0.05f, 2.f), Random(0.05f, 2.f), Random(0.05f, 2.f)));
+        bool visible = is_visible(buffer, box);
+
+        // Видим, если хотя бы частично перед стеной. Вплотную за стеной результат зависит от смещения глубины
+        if (box.min_.z < WALL_Z)
+        {
+            assert(visible);
+            continue;
+        }
+        if (box.min_.z < WALL_Z + 0.5f)
+            continue;
+
+        // Проекция бокса на плоскость стены
+        float scale = WALL_Z / box.min_.z;
+        Rect projected(box.min_.x * scale, box.min_.y * scale, box.max_.x * scale, box.max_.y * scale);
+        scale = WALL_Z / box.max_.z;
+        projected.Merge(Rect(box.min_.x * scale, box.min_.y * scale, box.max_.x * scale, box.max_.y * scale));
+
+        if (projected.min_.x > -3.f + margin && projected.max_.x < 3.f - margin &&
+            projected.min_.y > -3.f + margin && projected.max_.y < 3.f - margin)
+            assert(!visible);
+        else if (projected.min_.x < -3.f - margin || projected.max_.x > 3.f + margin ||
+            projected.min_.y < -3.f - margin || projected.max_.y > 3.f + margin)
+            assert(visible);
+    }
+
+    // Стена закрывает весь экран. Бокс за ней, частично за краем экрана, скрыт.
+    // Бокс целиком за краем экрана считается видимым: его отсекает пирамида видимости
+    draw(buffer, camera, create_wall(100.f, 100.f));
+    assert(!is_visible(buffer, make_box(Vector3(-25.f, 0.f, 20.f), Vector3(3.f, 1.f, 1.f))));
+    assert(!is_visible(buffer, make_box(Vector3(0.f, 13.f, 20.f), Vector3(1.f, 3.f, 1.f))));
+    assert(is_visible(buffer, make_box(Vector3(-60.f, 0.f, 20.f), Vector3::ONE)));
+    assert(is_visible(buffer, make_box(Vector3(0.f, 0.f, -20.f), Vector3::ONE)));
+
+    test_temporal();
+}
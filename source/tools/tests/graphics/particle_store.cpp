@@ -0,0 +1,216 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/billboard_set.h>
+#include <dviglo/graphics/particle_effect.h>
+#include <dviglo/graphics/particle_store.h>
+#include <dviglo/math/random.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+// Нечётное количество, чтобы проверить и SIMD-часть, и хвост
+const i32 NUM_PARTICLES = 37;
+
+bool equals(float lhs, float rhs)
+{
+    return Abs(lhs - rhs) <= 1e-5f * Max(1.f, Abs(rhs));
+}
+
+// Скалярная запись билборда, как было в ParticleEmitter::Update()
+void update_billboard(Billboard& billboard, Particle& particle, float time_step, const Vector3& scale, bool scaling,
+    const Vector<ColorFrame>& color_frames, const Vector<TextureFrame>& texture_frames)
+{
+    billboard.position_ += time_step * particle.velocity_ * scale;
+    billboard.direction_ = particle.velocity_.normalized();
+    billboard.rotation_ += time_step * particle.rotationSpeed_;
+    if (scaling)
+        billboard.size_ = particle.size_ * particle.scale_;
+
+    i32& index = particle.colorIndex_;
+    if (index < color_frames.Size())
+    {
+        if (index < color_frames.Size() - 1 && particle.timer_ >= color_frames[index + 1].time_)
+            ++index;
+        if (index < color_frames.Size() - 1)
+            billboard.color_ = color_frames[index].Interpolate(color_frames[index + 1], particle.timer_);
+        else
+            billboard.color_ = color_frames[index].color_;
+    }
+
+    i32& tex_index = particle.texIndex_;
+    if (texture_frames.Size() && tex_index < texture_frames.Size() - 1 &&
+        particle.timer_ >= texture_frames[tex_index + 1].time_)
+    {
+        billboard.uv_ = texture_frames[tex_index + 1].uv_;
+        ++tex_index;
+    }
+}
+
+void test_billboards()
+{
+    // Кадр с нулевой длительностью не интерполируется
+    const Vector<ColorFrame> color_frames{ColorFrame(Color::WHITE, 0.f), ColorFrame(Color::RED, 0.5f),
+        ColorFrame(Color::GREEN, 0.5f), ColorFrame(Color(0.2f, 0.4f, 0.6f, 0.f), 1.5f)};
+    Vector<TextureFrame> texture_frames(3);
+    for (i32 i = 0; i < texture_frames.Size(); ++i)
+    {
+        texture_frames[i].uv_ = Rect(0.f, 0.f, 1.f, (float)(i + 1));
+        texture_frames[i].time_ = 0.4f * i;
+    }
+
+    ParticleStore store;
+    store.Resize(NUM_PARTICLES);
+    Vector<Particle> particles;
+    Vector<Billboard> billboards(NUM_PARTICLES);
+    for (i32 i = 0; i < NUM_PARTICLES; ++i)
+    {
+        // Есть неподвижные частицы и частицы с единичной скоростью, которые не нормализуются
+        Particle particle;
+        particle.velocity_ = i % 7 == 0 ? Vector3::ZERO : i % 7 == 1 ? Vector3::UP :
+            Vector3(Random(-5.f, 5.f), Random(-5.f, 5.f), Random(-5.f, 5.f));
+        particle.size_ = Vector2(Random(0.1f, 2.f), Random(0.1f, 2.f));
+        particle.timer_ = Random(2.f);
+        particle.scale_ = Random(0.1f, 1.f);
+        particle.rotationSpeed_ = Random(-90.f, 90.f);
+        particle.colorIndex_ = Random(color_frames.Size());
+        particle.texIndex_ = 0;
+        store.Set(i, particle);
+        particles.Push(particle);
+
+        Billboard& billboard = billboards[i];
+        billboard.position_ = Vector3(Random(-10.f, 10.f), Random(-10.f, 10.f), Random(-10.f, 10.f));
+        billboard.size_ = particle.size_;
+        billboard.uv_ = Rect::POSITIVE;
+        billboard.color_ = Color::BLACK;
+        billboard.rotation_ = 0.f;
+        billboard.direction_ = Vector3::UP;
+        billboard.enabled_ = i % 5 != 3;
+    }
+
+    Vector<Billboard> expected = billboards;
+    const Matrix3x4 transform(Vector3(1.f, 2.f, 3.f), Quaternion(30.f, Vector3::UP), Vector3(2.f, 1.f, 0.5f));
+    const i32 start = 1;
+    const i32 end = NUM_PARTICLES - 2;
+    const float time_step = 1.f / 30.f;
+    const Vector3 scale(1.f, 2.f, 0.5f);
+
+    BoundingBox box;
+    store.UpdateBillboards(start, end, billboards.Buffer(), time_step, scale, true, color_frames, texture_frames, &box,
+        transform, transform.Scale());
+
+    BoundingBox expected_box;
+    for (i32 i = start; i < end; ++i)
+    {
+        if (!expected[i].enabled_)
+            continue;
+
+        update_billboard(expected[i], particles[i], time_step, scale, true, color_frames, texture_frames);
+
+        // Как в BillboardSet::OnWorldBoundingBoxUpdate()
+        Vector3 billboard_scale = transform.Scale();
+        const Vector2& billboard_size = expected[i].size_;
+        float size = 1.f / sqrtf(2.f) * (billboard_size.x * billboard_scale.x + billboard_size.y * billboard_scale.y);
+        Vector3 center = transform * expected[i].position_;
+        expected_box.Merge(BoundingBox(center - Vector3::ONE * size, center + Vector3::ONE * size));
+    }
+
+    // Результат совпадает точно, билборды вне диапазона и выключенные билборды не меняются
+    for (i32 i = 0; i < NUM_PARTICLES; ++i)
+    {
+        const Billboard& billboard = billboards[i];
+        assert(billboard.position_ == expected[i].position_ && billboard.direction_ == expected[i].direction_);
+        assert(billboard.rotation_ == expected[i].rotation_ && billboard.size_ == expected[i].size_);
+        assert(billboard.color_ == expected[i].color_ && billboard.uv_ == expected[i].uv_);
+
+        Particle particle = store.Get(i);
+        assert(particle.colorIndex_ == particles[i].colorIndex_ && particle.texIndex_ == particles[i].texIndex_);
+    }
+
+    assert(box.Defined() && box.min_ == expected_box.min_ && box.max_ == expected_box.max_);
+}
+
+} // namespace
+
+void test_graphics_particle_store()
+{
+    set_random_seed(1);
+
+    ParticleStore store;
+    store.Resize(NUM_PARTICLES);
+    assert(store.Size() == NUM_PARTICLES);
+
+    Vector<Particle> reference;
+    for (i32 i = 0; i < NUM_PARTICLES; ++i)
+    {
+        Particle particle;
+        particle.velocity_ = Vector3(Random(-5.f, 5.f), Random(-5.f, 5.f), Random(-5.f, 5.f));
+        particle.size_ = Vector2(Random(0.1f, 2.f), Random(0.1f, 2.f));
+        particle.timer_ = Random(1.f);
+        particle.timeToLive_ = 2.f;
+        particle.scale_ = Random(0.1f, 1.f);
+        particle.rotationSpeed_ = Random(-90.f, 90.f);
+        particle.colorIndex_ = i % 3;
+        particle.texIndex_ = i % 5;
+        store.Set(i, particle);
+        reference.Push(particle);
+    }
+
+    // Запись и чтение без потерь
+    for (i32 i = 0; i < NUM_PARTICLES; ++i)
+    {
+        Particle particle = store.Get(i);
+        assert(particle.velocity_ == reference[i].velocity_ && particle.size_ == reference[i].size_);
+        assert(particle.timer_ == reference[i].timer_ && particle.scale_ == reference[i].scale_);
+        assert(particle.colorIndex_ == reference[i].colorIndex_ && particle.texIndex_ == reference[i].texIndex_);
+    }
+
+    // Ядра совпадают со скалярным обновлением из ParticleEmitter. Частицы вне диапазона не меняются
+    const i32 start = 2;
+    const i32 end = NUM_PARTICLES - 1;
+    const float time_step = 1.f / 60.f;
+    const Vector3 force(0.f, -9.8f, 1.f);
+    const float damping = 0.5f;
+    const float size_add = -0.3f;
+    const float size_mul = 1.5f;
+
+    for (i32 frame = 0; frame < 100; ++frame)
+    {
+        store.Integrate(start, end, time_step, force, damping);
+        store.UpdateScales(start, end, time_step, size_add, size_mul);
+
+        for (i32 i = start; i < end; ++i)
+        {
+            Particle& particle = reference[i];
+            particle.timer_ += time_step;
+            particle.velocity_ += time_step * force;
+            particle.velocity_ += time_step * (-damping * particle.velocity_);
+            particle.scale_ = Max(particle.scale_ + time_step * size_add, 0.f);
+            particle.scale_ *= time_step * (size_mul - 1.f) + 1.f;
+        }
+    }
+
+    for (i32 i = 0; i < NUM_PARTICLES; ++i)
+    {
+        Particle particle = store.Get(i);
+        assert(equals(particle.velocity_.x, reference[i].velocity_.x));
+        assert(equals(particle.velocity_.y, reference[i].velocity_.y));
+        assert(equals(particle.velocity_.z, reference[i].velocity_.z));
+        assert(equals(particle.timer_, reference[i].timer_));
+        assert(equals(particle.scale_, reference[i].scale_));
+        assert(store.GetScaledSize(i) == particle.size_ * particle.scale_);
+    }
+
+    // Новые частицы обнулены
+    store.Resize(NUM_PARTICLES + 3);
+    assert(store.Get(NUM_PARTICLES + 2).timer_ == 0.f && store.GetVelocity(NUM_PARTICLES + 2) == Vector3::ZERO);
+
+    test_billboards();
+}
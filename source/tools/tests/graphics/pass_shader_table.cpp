@@ -0,0 +1,65 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/containers/hash_set.h>
+#include <dviglo/graphics/pass_shader_table.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+void test_graphics_pass_shader_table()
+{
+    assert(PassShaderTable::GetNumVertexShaders(LIGHTING_PERPIXEL) == (i32)MAX_GEOMETRYTYPES * MAX_LIGHT_VS_VARIATIONS);
+    assert(PassShaderTable::GetNumVertexShaders(LIGHTING_PERVERTEX) == (i32)MAX_GEOMETRYTYPES * MAX_VERTEXLIGHT_VS_VARIATIONS);
+    assert(PassShaderTable::GetNumVertexShaders(LIGHTING_UNLIT) == MAX_GEOMETRYTYPES);
+    assert(PassShaderTable::GetNumPixelShaders(LIGHTING_PERPIXEL) == MAX_LIGHT_PS_VARIATIONS * 2);
+    assert(PassShaderTable::GetNumPixelShaders(LIGHTING_UNLIT) == 2);
+
+    PassShaderTable table;
+    assert(!table.IsDefined());
+
+    // Попиксельное освещение: тени добавляют свои дефайны только к пиксельным шейдерам с тенью
+    table.Define(LIGHTING_PERPIXEL, "LitSolid", "LitSolid", "NORMALMAP ", "DIFFMAP ", "PCF_SHADOW ");
+    assert(table.IsDefined());
+    assert(table.GetNumVertexShaders() == (i32)MAX_GEOMETRYTYPES * MAX_LIGHT_VS_VARIATIONS);
+    assert(table.GetNumPixelShaders() == MAX_LIGHT_PS_VARIATIONS * 2);
+    assert(table.GetNumLoadedShaders() == 0);
+
+    assert(table.GetVertexShaderDefines((i32)GEOM_SKINNED * MAX_LIGHT_VS_VARIATIONS + LVS_SPOTSHADOW)
+        == "NORMALMAP PERPIXEL SPOTLIGHT SHADOW SKINNED ");
+    assert(table.GetPixelShaderDefines(LPS_SPEC) == "DIFFMAP PERPIXEL DIRLIGHT SPECULAR ");
+    assert(table.GetPixelShaderDefines(MAX_LIGHT_PS_VARIATIONS + LPS_POINTMASKSHADOW)
+        == "DIFFMAP PERPIXEL POINTLIGHT CUBEMASK SHADOW PCF_SHADOW HEIGHTFOG ");
+
+    // Каждой комбинации соответствуют свои дефайны
+    HashSet<String> defines;
+    for (i32 i = 0; i < table.GetNumVertexShaders(); ++i)
+        defines.Insert(table.GetVertexShaderDefines(i));
+    assert(defines.Size() == table.GetNumVertexShaders());
+
+    defines.Clear();
+    for (i32 i = 0; i < table.GetNumPixelShaders(); ++i)
+        defines.Insert(table.GetPixelShaderDefines(i));
+    assert(defines.Size() == table.GetNumPixelShaders());
+
+    // Повершинное освещение и без освещения
+    table.Define(LIGHTING_PERVERTEX, "LitSolid", "LitSolid", "", "", "");
+    assert(table.GetNumVertexShaders() == (i32)MAX_GEOMETRYTYPES * MAX_VERTEXLIGHT_VS_VARIATIONS);
+    assert(table.GetVertexShaderDefines((i32)GEOM_INSTANCED * MAX_VERTEXLIGHT_VS_VARIATIONS + VLVS_3LIGHTS) == "NUMVERTEXLIGHTS=3 INSTANCED ");
+    assert(table.GetPixelShaderDefines(1) == "HEIGHTFOG ");
+
+    table.Define(LIGHTING_UNLIT, "Unlit", "Unlit", "VERTEXCOLOR ", "", "PCF_SHADOW ");
+    assert(table.GetVertexShaderDefines(GEOM_BILLBOARD) == "VERTEXCOLOR BILLBOARD ");
+    assert(table.GetPixelShaderDefines(0) == "");
+
+    table.Clear();
+    assert(!table.IsDefined() && table.GetNumVertexShaders() == 0 && table.GetNumLoadedShaders() == 0);
+
+    // Дефайны теней для отложенного освещения идут после обычных вариаций
+    assert(String(PassShaderTable::GetLightPSVariation(MAX_LIGHT_PS_VARIATIONS + LPS_SPOT)) == "PERPIXEL SPOTLIGHT SHADOW NORMALOFFSET ");
+}
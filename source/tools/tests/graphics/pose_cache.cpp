@@ -0,0 +1,100 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/core/context.h>
+#include <dviglo/graphics/animation.h>
+#include <dviglo/graphics/model.h>
+#include <dviglo/graphics/pose_cache.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+
+
+namespace
+{
+
+PoseCacheKey create_key(Model* model, Animation* walk, Animation* wave, i32 time_index, float weight, float bone_weight = 1.f)
+{
+    PoseCacheKey key;
+    key.model_ = model;
+    key.states_.Push(PoseCacheState{walk, time_index, 1.f, 0, ABM_LERP, true});
+    key.states_.Push(PoseCacheState{wave, time_index, weight, 0, ABM_ADDITIVE, true});
+    key.boneWeights_ = {1.f, 1.f, 1.f, bone_weight, 1.f, 1.f};
+    return key;
+}
+
+Vector<BonePose> create_pose(float x)
+{
+    Vector<BonePose> pose(3);
+    for (BonePose& bone_pose : pose)
+        bone_pose = BonePose{Vector3(x, 0.f, 0.f), Quaternion::IDENTITY, Vector3::ONE};
+    return pose;
+}
+
+} // namespace
+
+void test_graphics_pose_cache()
+{
+    // Модели и анимации - объекты, им нужен контекст
+    Context context;
+
+    SharedPtr<Model> model(new Model());
+    SharedPtr<Animation> walk(new Animation());
+    SharedPtr<Animation> wave(new Animation());
+
+    SharedPtr<PoseCache> cache(new PoseCache());
+    cache->SetTimeStep(0.1f);
+
+    // Близкие моменты времени попадают в один ключ
+    assert(cache->GetTimeIndex(0.51f) == 5);
+    assert(cache->GetTimeIndex(0.54f) == 5);
+    assert(cache->GetTimeIndex(0.56f) == 6);
+
+    Vector<BonePose> pose;
+    assert(!cache->GetPose(create_key(model, walk, wave, 5, 0.5f), pose));
+    cache->StorePose(create_key(model, walk, wave, 5, 0.5f), create_pose(1.f));
+
+    assert(cache->GetPose(create_key(model, walk, wave, 5, 0.5f), pose));
+    assert(pose.Size() == 3 && pose[2].position_.x == 1.f);
+
+    // Другой вес, вес кости или время - другая поза
+    assert(!cache->GetPose(create_key(model, walk, wave, 5, 0.6f), pose));
+    assert(!cache->GetPose(create_key(model, walk, wave, 6, 0.5f), pose));
+    assert(!cache->GetPose(create_key(model, walk, wave, 5, 0.5f, 0.5f), pose));
+    assert(cache->GetNumHits() == 1);
+    assert(cache->GetNumMisses() == 4);
+
+    // Переполненный кэш удаляет самые старые позы в порядке добавления, попадание не продлевает жизнь позы
+    cache->Clear();
+    cache->SetMaxPoses(4);
+    for (i32 i = 0; i < 4; ++i)
+        cache->StorePose(create_key(model, walk, wave, i, 1.f), create_pose((float)i));
+    assert(cache->GetNumPoses() == 4);
+    assert(cache->GetPose(create_key(model, walk, wave, 0, 1.f), pose) && pose[0].position_.x == 0.f);
+    cache->StorePose(create_key(model, walk, wave, 10, 1.f), create_pose(10.f));
+    assert(cache->GetNumPoses() == 4);
+    assert(!cache->GetPose(create_key(model, walk, wave, 0, 1.f), pose));
+    assert(cache->GetPose(create_key(model, walk, wave, 1, 1.f), pose) && pose[0].position_.x == 1.f);
+    assert(cache->GetPose(create_key(model, walk, wave, 10, 1.f), pose) && pose[0].position_.x == 10.f);
+
+    // Замена позы не меняет уже полученную копию
+    cache->StorePose(create_key(model, walk, wave, 10, 1.f), create_pose(20.f));
+    assert(pose[0].position_.x == 10.f);
+    assert(cache->GetPose(create_key(model, walk, wave, 10, 1.f), pose) && pose[0].position_.x == 20.f);
+
+    // Поза удалённой анимации не возвращается, даже если её адрес займёт новая анимация
+    {
+        Animation* removed = wave.Get();
+        PoseCacheKey key = create_key(model, walk, removed, 10, 1.f);
+        wave.Reset();
+        assert(!cache->GetPose(key, pose));
+        assert(cache->GetNumPoses() == 3);
+    }
+
+    // Смена шага делает старые индексы недействительными
+    cache->SetTimeStep(0.2f);
+    assert(cache->GetNumPoses() == 0);
+}
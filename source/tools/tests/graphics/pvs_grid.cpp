@@ -0,0 +1,76 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/pvs_grid.h>
+#include <dviglo/io/vector_buffer.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+void test_graphics_pvs_grid()
+{
+    // Сетка 10x2x8 ячеек размером 2x2x2, всего 160 ячеек: строка матрицы занимает несколько слов
+    PvsGrid grid;
+    grid.Define(BoundingBox(Vector3(-10.f, 0.f, -8.f), Vector3(10.f, 4.f, 8.f)), IntVector3(10, 2, 8));
+    assert(grid.GetTotalCells() == 160);
+
+    assert(grid.GetCellIndex(Vector3(-9.f, 1.f, -7.f)) == 0);
+    assert(grid.GetCellIndex(Vector3(-7.f, 1.f, -7.f)) == 1);
+    assert(grid.GetCellIndex(Vector3(-9.f, 3.f, -7.f)) == 10);
+    assert(grid.GetCellIndex(Vector3(-9.f, 1.f, -5.f)) == 20);
+    assert(grid.GetCellIndex(Vector3(10.f, 4.f, 8.f)) == 159);
+    assert(grid.GetCellIndex(Vector3(10.1f, 1.f, 0.f)) == NINDEX);
+
+    BoundingBox cellBox = grid.GetCellBox(21);
+    assert(cellBox.min_ == Vector3(-8.f, 0.f, -6.f));
+    assert(cellBox.max_ == Vector3(-6.f, 2.f, -4.f));
+    assert(grid.GetCellIndex(cellBox.Center()) == 21);
+
+    // Ячейки изначально невидимы друг для друга
+    const i32 from = grid.GetCellIndex(Vector3(-9.f, 1.f, -7.f));
+    const i32 to = grid.GetCellIndex(Vector3(9.f, 3.f, 7.f));
+    assert(grid.GetNumVisibleCells(from) == 0);
+    assert(!grid.IsVisible(from, BoundingBox(Vector3(8.5f, 2.5f, 6.5f), Vector3(9.5f, 3.5f, 7.5f))));
+
+    grid.SetVisible(from, to, true);
+    assert(grid.IsVisible(from, to));
+    assert(!grid.IsVisible(to, from));
+    assert(grid.GetNumVisibleCells(from) == 1);
+
+    // Объект виден, если видна хотя бы одна ячейка, которую он задевает
+    assert(grid.IsVisible(from, BoundingBox(Vector3(8.5f, 2.5f, 6.5f), Vector3(9.5f, 3.5f, 7.5f))));
+    assert(grid.IsVisible(from, BoundingBox(Vector3(0.f, 0.f, 0.f), Vector3(9.f, 3.f, 7.f))));
+    assert(!grid.IsVisible(from, BoundingBox(Vector3(0.f, 0.f, 0.f), Vector3(7.f, 3.f, 7.f))));
+
+    // Объект, выходящий за пределы сетки, виден всегда
+    assert(grid.IsVisible(from, BoundingBox(Vector3(0.f, 0.f, 0.f), Vector3(11.f, 1.f, 1.f))));
+
+    grid.MakeSymmetric();
+    assert(grid.IsVisible(to, from));
+    assert(grid.GetNumVisibleCells(to) == 1);
+
+    // Сохранение и загрузка
+    VectorBuffer buffer;
+    assert(grid.Write(buffer));
+    buffer.Seek(0);
+
+    PvsGrid loaded;
+    assert(loaded.Read(buffer));
+    assert(loaded.GetNumCells() == IntVector3(10, 2, 8));
+    assert(loaded.GetBounds().min_ == grid.GetBounds().min_ && loaded.GetBounds().max_ == grid.GetBounds().max_);
+
+    for (i32 i = 0; i < grid.GetTotalCells(); ++i)
+    {
+        for (i32 j = 0; j < grid.GetTotalCells(); ++j)
+            assert(loaded.IsVisible(i, j) == grid.IsVisible(i, j));
+    }
+
+    // Обрезанные данные не загружаются
+    VectorBuffer truncated(buffer.GetData(), buffer.GetSize() - 1);
+    assert(!loaded.Read(truncated));
+}
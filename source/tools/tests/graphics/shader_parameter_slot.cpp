@@ -0,0 +1,43 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics_api/graphics_defs.h>
+#include <dviglo/graphics_api/shader_variation.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+void test_graphics_shader_parameter_slot()
+{
+    // Встроенные параметры получают слоты при статической инициализации
+    assert(VSP_MODEL.GetIndex() >= 0);
+    assert(VSP_MODEL.GetIndex() != PSP_MATDIFFCOLOR.GetIndex());
+    assert(ShaderParameterSlot(StringHash("Model")).GetIndex() == VSP_MODEL.GetIndex());
+    assert(StringHash(VSP_MODEL) == StringHash("Model"));
+    assert(ShaderParameterSlot().GetIndex() == NINDEX);
+
+    // Новое имя получает следующий слот, повторная регистрация возвращает тот же
+    i32 num_slots = ShaderParameterSlot::GetNumSlots();
+    ShaderParameterSlot custom(StringHash("TestCustomParameter"));
+    assert(custom.GetIndex() == num_slots);
+    assert(ShaderParameterSlot::GetNumSlots() == num_slots + 1);
+    assert(ShaderParameterSlot(StringHash("TestCustomParameter")).GetIndex() == custom.GetIndex());
+
+    // Массив параметров программы по слотам
+    HashMap<StringHash, ShaderParameter> parameters;
+    parameters[VSP_MODEL] = ShaderParameter("Model", 0, 1);
+    parameters[StringHash("TestProgramParameter")] = ShaderParameter("TestProgramParameter", 0, 2);
+
+    Vector<const ShaderParameter*> slots;
+    ShaderParameterSlot::MapParameters(parameters, slots);
+    assert(slots.Size() == ShaderParameterSlot::GetNumSlots());
+    assert(slots[VSP_MODEL.GetIndex()]->location_ == 1);
+    assert(slots[ShaderParameterSlot(StringHash("TestProgramParameter")).GetIndex()]->location_ == 2);
+    assert(slots[custom.GetIndex()] == nullptr);
+    assert(slots[PSP_MATDIFFCOLOR.GetIndex()] == nullptr);
+}
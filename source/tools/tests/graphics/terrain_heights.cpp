@@ -0,0 +1,80 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/terrain.h>
+#include <dviglo/math/random.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+void test_graphics_terrain_heights()
+{
+    set_random_seed(1);
+
+    // Неквадратная карта высот, чтобы не перепутать строки и столбцы
+    IntVector2 num_vertices(37, 29);
+    Vector<float> heights(num_vertices.x * num_vertices.y);
+    for (float& height : heights)
+        height = Random(0.f, 50.f);
+
+    TerrainHeightField field;
+    field.heights_ = heights.Buffer();
+    field.numVertices_ = num_vertices;
+    field.spacing_ = Vector3(1.5f, 0.25f, 0.75f);
+    field.origin_ = Vector2(-0.5f * (num_vertices.x - 1) * field.spacing_.x, -0.5f * (num_vertices.y - 1) * field.spacing_.z);
+
+    // Ландшафт повёрнут вокруг вертикальной оси, сдвинут и масштабирован
+    Matrix3x4 transform(Vector3(10.f, -3.f, 7.f), Quaternion(33.f, Vector3::UP), Vector3(1.f, 2.f, 1.f));
+    field.inverseTransform_ = transform.Inverse();
+    field.scaleY_ = 2.f;
+    field.offsetY_ = -3.f;
+
+    // Позиции и внутри, и за краями ландшафта
+    const i32 max_count = 103;
+    Vector<Vector3> positions(max_count);
+    for (Vector3& position : positions)
+        position = transform * Vector3(Random(-40.f, 40.f), Random(-10.f, 10.f), Random(-30.f, 30.f));
+
+    // Вершины сетки и её углы: дробные части нулевые или переход в верхний треугольник
+    positions[0] = transform * Vector3(field.origin_.x, 0.f, field.origin_.y);
+    positions[1] = transform * Vector3(-field.origin_.x, 0.f, -field.origin_.y);
+    positions[2] = transform * Vector3(field.origin_.x + 0.75f, 0.f, field.origin_.y + 0.375f);
+
+    i32 num_outside = 0;
+    for (const Vector3& position : positions)
+    {
+        Vector3 local = field.inverseTransform_ * position;
+        if (Abs(local.x) > -field.origin_.x || Abs(local.z) > -field.origin_.y)
+            ++num_outside;
+    }
+    assert(num_outside > 0 && num_outside < max_count);
+
+    // Пакетный SSE2-вариант должен в точности совпадать со скалярным, в том числе для хвостов не кратных четырём
+    for (i32 count = 1; count <= max_count; count += count < 12 ? 1 : 13)
+    {
+        Vector<float> batch(count + 1, -1.f);
+        field.GetHeights(&positions[0], &batch[0], count);
+
+        for (i32 i = 0; i < count; ++i)
+            assert(batch[i] == field.GetHeight(positions[i]));
+
+        // За последней позицией ничего не записывается
+        assert(batch[count] == -1.f);
+    }
+
+    // На краях и за ними используются высоты краёв
+    float corner = field.scaleY_ * heights[0] + field.offsetY_;
+    assert(Abs(field.GetHeight(positions[0]) - corner) < 0.001f);
+    assert(Abs(field.GetHeight(transform * Vector3(field.origin_.x - 100.f, 0.f, field.origin_.y - 100.f)) - corner) < 0.001f);
+
+    // Без карты высот возвращается высота узла
+    field.heights_ = nullptr;
+    float height;
+    field.GetHeights(&positions[0], &height, 1);
+    assert(height == field.offsetY_ && field.GetHeight(positions[0]) == field.offsetY_);
+}
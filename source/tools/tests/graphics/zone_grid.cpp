@@ -0,0 +1,75 @@
+// Copyright (c) 2022-2023 the Dviglo project
+// License: MIT
+
+#include "../force_assert.h"
+
+#include <dviglo/graphics/zone_grid.h>
+#include <dviglo/math/random.h>
+
+#include <dviglo/common/debug_new.h>
+
+using namespace dviglo;
+using namespace std;
+
+
+namespace
+{
+
+const i32 NUM_BOXES = 300;
+const i32 NUM_POINTS = 20000;
+
+} // namespace
+
+void test_graphics_zone_grid()
+{
+    set_random_seed(1);
+
+    // Небольшие зоны, одна зона на весь уровень и плоская зона
+    Vector<BoundingBox> boxes;
+    boxes.Push(BoundingBox(Vector3(-1000.f, -100.f, -1000.f), Vector3(1000.f, 100.f, 1000.f)));
+    for (i32 i = 0; i < NUM_BOXES; ++i)
+    {
+        Vector3 center(Random(-500.f, 500.f), Random(-20.f, 20.f), Random(-500.f, 500.f));
+        Vector3 half_size(Random(5.f, 40.f), Random(2.f, 10.f), Random(5.f, 40.f));
+        boxes.Push(BoundingBox(center - half_size, center + half_size));
+    }
+    boxes.Push(BoundingBox(Vector3(-50.f, 0.f, -50.f), Vector3(50.f, 0.f, 50.f)));
+
+    ZoneGrid grid;
+    assert(grid.IsEmpty());
+    grid.Build(&boxes[0], boxes.Size());
+    assert(!grid.IsEmpty());
+    assert(grid.GetNumCells().x > 1 && grid.GetNumCells().z > 1);
+
+    // Каждая зона, содержащая точку, есть среди кандидатов, а кандидатов меньше, чем зон
+    i32 total_candidates = 0;
+    for (i32 i = 0; i < NUM_POINTS; ++i)
+    {
+        Vector3 point(Random(-1200.f, 1200.f), Random(-120.f, 120.f), Random(-1200.f, 1200.f));
+        if (i % 10 == 0)
+            point.y = 0.f;
+
+        i32 count;
+        const i32* candidates = grid.GetCandidates(point, count);
+        total_candidates += count;
+
+        for (i32 j = 1; j < count; ++j)
+            assert(candidates[j - 1] < candidates[j]);
+
+        i32 candidate = 0;
+        for (i32 j = 0; j < boxes.Size(); ++j)
+        {
+            if (boxes[j].IsInside(point) == OUTSIDE)
+                continue;
+
+            while (candidate < count && candidates[candidate] < j)
+                ++candidate;
+            assert(candidate < count && candidates[candidate] == j);
+        }
+    }
+    assert(total_candidates < NUM_POINTS * boxes.Size() / 10);
+
+    grid.Clear();
+    i32 count;
+    assert(grid.IsEmpty() && grid.GetCandidates(Vector3::ZERO, count) == nullptr && count == 0);
+}
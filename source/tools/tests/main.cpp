@@ -7,13 +7,49 @@
 using namespace std;
 
 
+void test_containers_radix_sort();
 void test_containers_str();
+void test_graphics_animation_compression();
+void test_graphics_billboard_vertices();
+void test_graphics_cdlod_quadtree();
+void test_graphics_decal_geometry();
+void test_graphics_draw_command_buffer();
+void test_graphics_dynamic_aabb_tree();
+void test_graphics_instance_bvh();
+void test_graphics_mesh_optimizer();
+void test_graphics_mesh_simplifier();
+void test_graphics_occlusion_buffer();
+void test_graphics_particle_store();
+void test_graphics_pass_shader_table();
+void test_graphics_pose_cache();
+void test_graphics_pvs_grid();
+void test_graphics_shader_parameter_slot();
+void test_graphics_terrain_heights();
+void test_graphics_zone_grid();
 void test_math_big_int();
 void test_third_party_sdl();
 
 void run()
 {
+    test_containers_radix_sort();
     test_containers_str();
+    test_graphics_animation_compression();
+    test_graphics_billboard_vertices();
+    test_graphics_cdlod_quadtree();
+    test_graphics_decal_geometry();
+    test_graphics_draw_command_buffer();
+    test_graphics_dynamic_aabb_tree();
+    test_graphics_instance_bvh();
+    test_graphics_mesh_optimizer();
+    test_graphics_mesh_simplifier();
+    test_graphics_occlusion_buffer();
+    test_graphics_particle_store();
+    test_graphics_pass_shader_table();
+    test_graphics_pose_cache();
+    test_graphics_pvs_grid();
+    test_graphics_shader_parameter_slot();
+    test_graphics_terrain_heights();
+    test_graphics_zone_grid();
     test_math_big_int();
     test_third_party_sdl();
 }